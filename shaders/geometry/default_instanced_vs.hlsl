@@ -0,0 +1,40 @@
+#include "../rs/default_pbr_rs.hlsli"
+
+StructuredBuffer<TransformCb> Instances : register(t0, space3);
+
+struct VsInput
+{
+    float3 Position : POSITION;
+    float2 UV       : TEXCOORDS;
+    float3 Normal   : NORMAL;
+    float3 Tangent  : TANGENT;
+
+    uint InstanceID : SV_InstanceID;
+};
+
+struct VsOutput
+{
+    float2 UV       : TEXCOORDS;
+    float3x3 TBN    : TANGENT_FRAME;
+    float3 WorldPos : POSITION;
+    float4 Pos      : SV_Position;
+};
+
+[RootSignature(DEFAULT_PBR_INSTANCED_RS)]
+VsOutput main(VsInput vin) 
+{
+    TransformCb transform = Instances[vin.InstanceID];
+
+    VsOutput vout;
+    vout.Pos = mul(transform.MeshViewProj, float4(vin.Position, 1.f));
+
+    vout.UV = vin.UV;
+    vout.WorldPos = (mul(transform.Mesh, float4(vin.Position, 1.f))).xyz;
+
+    float3 normal = normalize(mul(transform.Mesh, float4(vin.Normal, 0.f)).xyz);
+    float3 tangent = normalize(mul(transform.Mesh, float4(vin.Tangent, 0.f)).xyz);
+    float3 bitangent = normalize(cross(normal, tangent));
+    vout.TBN = float3x3(tangent, bitangent, normal);
+
+    return vout;
+}
\ No newline at end of file
@@ -1,6 +1,7 @@
 #include "../rs/depth_only_rs.hlsli"
 
 ConstantBuffer<DepthOnlyTransformCb> Transform : register(b0);
+ConstantBuffer<DepthOnlyObjectIdCb> Id : register(b1);
 
 struct MeshVertex
 {
@@ -26,6 +27,7 @@ struct VsOutput
 {
 	float3 NDC				: NDC;
 	float3 PrevFrameNDC		: PREV_FRAME_NDC;
+	nointerpolation uint ObjectId : OBJECT_ID;
 
 	float4 Position			: SV_POSITION;
 };
@@ -39,5 +41,6 @@ VsOutput main(VsInput vin)
 
 	float3 prevFramePosition = PrevFrameVertices[vin.VertexID].Position;
 	vout.PrevFrameNDC = mul(Transform.PrevFrameMVP, float4(prevFramePosition, 1.f)).xyw;
+	vout.ObjectId = Id.Id;
 	return vout;
 }
\ No newline at end of file
@@ -1,13 +1,13 @@
 #include "../rs/depth_only_rs.hlsli"
 #include "../common/camera.hlsli"
 
-ConstantBuffer<DepthOnlyObjectIdCb> Id	: register(b1);
 ConstantBuffer<CameraCb> Camera			: register(b2);
 
 struct PsInput
 {
 	float3 NDC				: NDC;
 	float3 PrevFrameNDC		: PREV_FRAME_NDC;
+	nointerpolation uint ObjectId : OBJECT_ID;
 };
 
 struct PsOutput
@@ -25,6 +25,6 @@ PsOutput main(PsInput pin)
 
 	PsOutput pout;
 	pout.ScreenVelocity = motion;
-	pout.ObjectId = Id.Id;
+	pout.ObjectId = pin.ObjectId;
 	return pout;
 }
\ No newline at end of file
@@ -1,7 +1,7 @@
 #include "../rs/depth_only_rs.hlsli"
 
 
-ConstantBuffer<DepthOnlyTransformCb> Transform : register(b0);
+StructuredBuffer<DepthOnlyInstance> Instances : register(t0);
 
 struct VsInput
 {
@@ -9,12 +9,15 @@ struct VsInput
 	float2 UV			: TEXCOORDS;
 	float3 Normal		: NORMAL;
 	float3 Tangent		: TANGENT;
+
+	uint InstanceID		: SV_InstanceID;
 };
 
 struct VsOutput
 {
 	float3 NDC				: NDC;
 	float3 PrevFrameNDC		: PREV_FRAME_NDC;
+	nointerpolation uint ObjectId : OBJECT_ID;
 
 	float4 Position			: SV_POSITION;
 };
@@ -22,9 +25,12 @@ struct VsOutput
 [RootSignature(DEPTH_ONLY_RS)]
 VsOutput main(VsInput vin)
 {
+	DepthOnlyInstance instance = Instances[vin.InstanceID];
+
 	VsOutput vout;
-	vout.Position = mul(Transform.MeshViewProj, float4(vin.Position, 1.f));
+	vout.Position = mul(instance.MeshViewProj, float4(vin.Position, 1.f));
 	vout.NDC = vout.Position.xyw;
-	vout.PrevFrameNDC = mul(Transform.PrevFrameMVP, float4(vin.Position, 1.f)).xyw;
+	vout.PrevFrameNDC = mul(instance.PrevFrameMVP, float4(vin.Position, 1.f)).xyw;
+	vout.ObjectId = instance.ObjectId;
 	return vout;
 }
\ No newline at end of file
@@ -0,0 +1,16 @@
+#include "../rs/depth_only_rs.hlsli"
+
+struct PsInput
+{
+	float2 UV				: TEXCOORDS;
+	float4 ScreenPosition	: SV_POSITION;
+};
+
+Texture2D<float> StaticShadowMap : register(t0);
+
+[RootSignature(SHADOW_MAP_COPY_RS)]
+float main(PsInput pin) : SV_Depth
+{
+	// The cache has the same layout as the shadow map, so the pixel position addresses the same texel in both.
+	return StaticShadowMap[int2(pin.ScreenPosition.xy)];
+}
@@ -1,7 +1,8 @@
 #include "../rs/depth_only_rs.hlsli"
 
 
-ConstantBuffer<PointShadowTransformCb> Transform : register(b0);
+ConstantBuffer<PointShadowCb> Light : register(b0);
+StructuredBuffer<float4x4> Instances : register(t0);
 
 struct VsInput
 {
@@ -9,6 +10,8 @@ struct VsInput
 	float2 UV			: TEXCOORDS;
 	float3 Normal		: NORMAL;
 	float3 Tangent		: TANGENT;
+
+	uint InstanceID		: SV_InstanceID;
 };
 
 struct VsOutput
@@ -20,11 +23,11 @@ struct VsOutput
 [RootSignature(POINT_SHADOW_RS)]
 VsOutput main(VsInput vin)
 {
-	float3 position = mul(Transform.Mesh, float4(vin.Position, 1.f)).xyz;
+	float3 position = mul(Instances[vin.InstanceID], float4(vin.Position, 1.f)).xyz;
 	
-	float3 L = position - Transform.LightPosition;
+	float3 L = position - Light.LightPosition;
 
-	L.z *= Transform.Flip;
+	L.z *= Light.Flip;
 
 	float l = length(L);
 	L /= l;
@@ -33,6 +36,6 @@ VsOutput main(VsInput vin)
 
 	VsOutput vout;
 	vout.ClipDepth = L.z;
-	vout.Position = float4(L.xy, l / Transform.MaxDistance, 1.f);
+	vout.Position = float4(L.xy, l / Light.MaxDistance, 1.f);
 	return vout;
 }
\ No newline at end of file
@@ -1,7 +1,7 @@
 #include "../rs/depth_only_rs.hlsli"
 
 
-ConstantBuffer<ShadowTransformCb> Transform : register(b0);
+StructuredBuffer<float4x4> Instances : register(t0);
 
 struct VsInput
 {
@@ -9,6 +9,8 @@ struct VsInput
 	float2 UV			: TEXCOORDS;
 	float3 Normal		: NORMAL;
 	float3 Tangent		: TANGENT;
+
+	uint InstanceID		: SV_InstanceID;
 };
 
 struct VsOutput
@@ -20,6 +22,6 @@ struct VsOutput
 VsOutput main(VsInput vin)
 {
 	VsOutput vout;
-	vout.Position = mul(Transform.MeshViewProj, float4(vin.Position, 1.f));
+	vout.Position = mul(Instances[vin.InstanceID], float4(vin.Position, 1.f));
 	return vout;
 }
\ No newline at end of file
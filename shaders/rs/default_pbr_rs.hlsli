@@ -13,6 +13,16 @@ struct LightingCb
 "RootFlags(ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT | DENY_HULL_SHADER_ROOT_ACCESS | DENY_DOMAIN_SHADER_ROOT_ACCESS | "\
 "          DENY_GEOMETRY_SHADER_ROOT_ACCESS)," \
 "RootConstants(num32BitConstants=32, b0, visibility=SHADER_VISIBILITY_VERTEX),"  \
+DEFAULT_PBR_RS_MATERIAL_AND_FRAME
+
+// Same layout, but root parameter 0 points to a StructuredBuffer<TransformCb> with one entry per instance.
+#define DEFAULT_PBR_INSTANCED_RS \
+"RootFlags(ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT | DENY_HULL_SHADER_ROOT_ACCESS | DENY_DOMAIN_SHADER_ROOT_ACCESS | "\
+"          DENY_GEOMETRY_SHADER_ROOT_ACCESS)," \
+"SRV(t0, space=3, visibility=SHADER_VISIBILITY_VERTEX),"  \
+DEFAULT_PBR_RS_MATERIAL_AND_FRAME
+
+#define DEFAULT_PBR_RS_MATERIAL_AND_FRAME \
 "RootConstants(num32BitConstants=6, b0, space=1, visibility=SHADER_VISIBILITY_PIXEL),"  \
 "RootConstants(num32BitConstants=3, b2, space=1, visibility=SHADER_VISIBILITY_PIXEL),"  \
 "CBV(b1, space=1, visibility=SHADER_VISIBILITY_PIXEL), " \
@@ -38,7 +48,7 @@ struct LightingCb
 "              filter = FILTER_COMPARISON_MIN_MAG_LINEAR_MIP_POINT," \
 "              visibility=SHADER_VISIBILITY_PIXEL)"
 
-#define DefaultPbrRsMvp             0
+#define DefaultPbrRsMvp             0 // Transform constants, or the instance transforms in the instanced variant.
 #define DefaultPbrRsMaterial        1
 #define DefaultPbrRsLighting        2
 #define DefaultPbrRsCamera          3
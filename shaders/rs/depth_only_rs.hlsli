@@ -3,14 +3,9 @@
 
 #include "../common/common.hlsli"
 
-struct ShadowTransformCb
+// Per light constants. The mesh matrices are read per instance from a structured buffer.
+struct PointShadowCb
 {
-    mat4 MeshViewProj;
-};
-
-struct PointShadowTransformCb
-{
-    mat4 Mesh;
     vec3 LightPosition;
     float MaxDistance;
     float Flip;
@@ -28,35 +23,58 @@ struct DepthOnlyTransformCb
     mat4 PrevFrameMVP;
 };
 
+// Per instance data of the (instanced) static and dynamic depth-only draws.
+struct DepthOnlyInstance
+{
+    mat4 MeshViewProj;
+    mat4 PrevFrameMVP;
+    uint32 ObjectId;
+    uint32 Padding[3];
+};
+
 #define SHADOW_RS \
 "RootFlags(ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT | DENY_HULL_SHADER_ROOT_ACCESS | DENY_DOMAIN_SHADER_ROOT_ACCESS |" \
 "          DENY_GEOMETRY_SHADER_ROOT_ACCESS | DENY_PIXEL_SHADER_ROOT_ACCESS)," \
-"RootConstants(num32BitConstants=16, b0, visibility=SHADER_VISIBILITY_VERTEX)"
+"SRV(t0, visibility=SHADER_VISIBILITY_VERTEX)"
 
 #define POINT_SHADOW_RS \
 "RootFlags(ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT | DENY_HULL_SHADER_ROOT_ACCESS | DENY_DOMAIN_SHADER_ROOT_ACCESS |" \
 "          DENY_GEOMETRY_SHADER_ROOT_ACCESS | DENY_PIXEL_SHADER_ROOT_ACCESS)," \
-"RootConstants(num32BitConstants=24, b0, visibility=SHADER_VISIBILITY_VERTEX)"
+"RootConstants(num32BitConstants=8, b0, visibility=SHADER_VISIBILITY_VERTEX), " \
+"SRV(t0, visibility=SHADER_VISIBILITY_VERTEX)"
+
+#define SHADOW_MAP_COPY_RS \
+"RootFlags(DENY_HULL_SHADER_ROOT_ACCESS | DENY_DOMAIN_SHADER_ROOT_ACCESS | DENY_GEOMETRY_SHADER_ROOT_ACCESS)," \
+"DescriptorTable(SRV(t0, numDescriptors=1), visibility=SHADER_VISIBILITY_PIXEL)"
 
 #define DEPTH_ONLY_RS \
 "RootFlags(ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT | DENY_HULL_SHADER_ROOT_ACCESS | DENY_DOMAIN_SHADER_ROOT_ACCESS | DENY_GEOMETRY_SHADER_ROOT_ACCESS)," \
-"RootConstants(num32BitConstants=1, b1, visibility=SHADER_VISIBILITY_PIXEL), " \
-"RootConstants(num32BitConstants=32, b0, visibility=SHADER_VISIBILITY_VERTEX), " \
+"SRV(t0, visibility=SHADER_VISIBILITY_VERTEX), " \
 "CBV(b2)"
 
 #define ANIMATED_DEPTH_ONLY_RS \
 "RootFlags(ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT | DENY_HULL_SHADER_ROOT_ACCESS | DENY_DOMAIN_SHADER_ROOT_ACCESS | DENY_GEOMETRY_SHADER_ROOT_ACCESS)," \
-"RootConstants(num32BitConstants=1, b1, visibility=SHADER_VISIBILITY_PIXEL), " \
+"RootConstants(num32BitConstants=1, b1, visibility=SHADER_VISIBILITY_VERTEX), " \
 "RootConstants(num32BitConstants=32, b0, visibility=SHADER_VISIBILITY_VERTEX), " \
 "CBV(b2), " \
 "SRV(t0)"
 
+// Static and dynamic (instanced).
+#define DepthOnlyRsInstances            0
+#define DepthOnlyRsInstancedCamera      1
+
+// Animated.
 #define DepthOnlyRsObjectId             0
 #define DepthOnlyRsMvp                  1
 #define DepthOnlyRsCamera               2
 #define DepthOnlyRsPrevFramePositions   3
 
-#define ShadowRsMvp                     0
+#define ShadowRsInstances               0
+
+#define PointShadowRsCb                 0
+#define PointShadowRsInstances          1
+
+#define ShadowMapCopyRsTexture          0
 
 
 #endif
\ No newline at end of file
@@ -25,8 +25,9 @@ void main(CsInput input)
 		return;
 	}
 
-	float NdotV = float(input.DispatchThreadId.x) / (TextureDim - 1);
-	float roughness = float(input.DispatchThreadId.y) / (TextureDim - 1);
+	// Same layout as the table from brdfIntegration.h, which is how SpecularIBL samples it.
+	float roughness = float(input.DispatchThreadId.x) / (TextureDim - 1);
+	float NdotV = float(input.DispatchThreadId.y) / (TextureDim - 1);
 
 
 	float3 V;
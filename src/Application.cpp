@@ -10,6 +10,9 @@
 #include "directx/DxBarrierBatcher.h"
 #include "directx/DxCommandList.h"
 #include "render/ShadowMapCache.h"
+#include "core/assetCache.h"
+#include "core/cpuProfiling.h"
+#include "directx/DxProfiling.h"
 #include <iostream>
 
 #include "../vcpkg_installed/x64-windows/include/DirectXColors.h"
@@ -82,6 +85,11 @@ namespace {
 			return {};
 		}
 	}
+
+	BoundingSphere GetWorldSpaceBounds(const BoundingBox& aabb, const trs& transform) {
+		float scale = Max(abs(transform.scale.x), Max(abs(transform.scale.y), abs(transform.scale.z)));
+		return { transformPosition(transform, aabb.GetCenter()), length(aabb.GetRadius()) * scale };
+	}
 }
 
 struct RasterComponent {
@@ -105,17 +113,6 @@ struct RaytraceComponent {
 };
 
 void Application::LoadCustomShaders() {
-	// ShadowMapLightInfo info;
-	// info.Viewport.CpuVP[0] = 2048;
-	// info.Viewport.CpuVP[1] = 2048;
-	// info.Viewport.CpuVP[2] = 4096;
-	// info.Viewport.CpuVP[3] = 4096;
-	//
-	// info.LightMovedOrAppeared = false;
-	// info.GeometryInRangeMoved = false;
-	//
-	// ShadowMapLightInfo::TestShadowMapCache(&info, 1);
-
 	if (DxContext::Instance().MeshShaderSupported()) {
 		InitializeMeshShader();
 	}
@@ -186,6 +183,11 @@ bool Application::Initialize() {
 	DxContext& dxContext = DxContext::Instance();
 	JobFactory::Instance()->InitializeJobSystem();
 
+	// Before anything is loaded. Collecting garbage only compares sizes and write times of the known sources, unless something changed.
+	AssetCache* assetCache = AssetCache::Instance();
+	assetCache->Initialize();
+	assetCache->CollectGarbage();
+
 	constexpr ColorDepth colorDepth = EColorDepth8;
 	DXGI_FORMAT screenFormat = (colorDepth == EColorDepth8) ? DXGI_FORMAT_R8G8B8A8_UNORM : DXGI_FORMAT_R10G10B10A2_UNORM;
 
@@ -218,8 +220,26 @@ bool Application::Initialize() {
 		_raytracingTlas.Initialize();
 	}
 
+	// The files are independent, so they are loaded on the job system. LoadMeshFromFile itself fans out further, into submeshes and materials.
+	Ptr<CompositeMesh> sponzaMesh, maxMesh, unrealMesh;
+	{
+		ThreadJobContext context;
+		context.AddWork([&sponzaMesh]() {
+			sponzaMesh = LoadMeshFromFile("assets/meshes/sponza.obj");
+		});
+		context.AddWork([&maxMesh]() {
+			maxMesh = LoadAnimatedMeshFromFile("assets/meshes/max.fbx");
+		});
+		context.AddWork([&unrealMesh]() {
+			unrealMesh = LoadAnimatedMeshFromFile("assets/meshes/unreal_mannequin.fbx");
+			if (unrealMesh) {
+				unrealMesh->Skeleton.PushAssimpAnimationsInDirectory("assets/animations");
+			}
+		});
+		context.WaitForWorkCompletion();
+	}
+
 	// Sponza
-	auto sponzaMesh = LoadMeshFromFile("assets/meshes/sponza.obj");
 	if (sponzaMesh) {
 		auto sponzaBlas = DefineBlasFromMesh(sponzaMesh, _pathTracer);
 		_appScene.CreateEntity("Sponza").AddComponent<trs>(vec3(0.f, 0.f, 0.f), quat::identity, 0.01f)
@@ -227,17 +247,10 @@ bool Application::Initialize() {
 	}
 
 	// Max caufield
-	auto maxMesh = LoadAnimatedMeshFromFile("assets/meshes/max.fbx");
 	if (maxMesh) {
 		maxMesh->Submeshes[0].Material = CreatePBRMaterial("", nullptr, nullptr, nullptr, vec4(0.f), vec4(1.f), 0.f, 0.f);
 	}
 
-	// Unreal Mannequin.
-	auto unrealMesh = LoadAnimatedMeshFromFile("assets/meshes/unreal_mannequin.fbx");
-	if (unrealMesh) {
-		unrealMesh->Skeleton.PushAssimpAnimationsInDirectory("assets/animations");
-	}
-
 	if (maxMesh) {
 		_appScene.CreateEntity("Max 1").AddComponent<trs>(vec3(-5.f, 0.f, -1.f), quat::identity)
 		.AddComponent<RasterComponent>(maxMesh).AddComponent<AnimationComponent>(1.5f);
@@ -325,6 +338,8 @@ bool Application::Initialize() {
 	_sun.Bias = vec4(0.000049f, 0.000114f, 0.000082f, 0.0035f);
 	_sun.BlendDistances = vec4(3.f, 3.f, 10.f, 10.f);
 
+	_shadowMapCache.Initialize(SHADOW_MAP_WIDTH, SHADOW_MAP_HEIGHT, 128, 2048);
+
 	for (uint32 i = 0; i < NUM_BUFFERED_FRAMES; i++) {
 		_pointLightBuffer[i] = DxBuffer::CreateUpload(sizeof(PointLightCb), 512, 0);
 		_spotLightBuffer[i] = DxBuffer::CreateUpload(sizeof(SpotLightCb), 512, 0);
@@ -335,6 +350,8 @@ bool Application::Initialize() {
 		SET_NAME(_decalBuffer[i]->Resource, "Decals");
 	}
 
+	assetCache->SaveManifest();
+
 	_timer.Reset();
 
 	return true;
@@ -429,9 +446,114 @@ void Application::DrawSceneHierarchy() {}
 
 void Application::DrawSettings(float dt) {}
 
-void Application::AssignShadowMapViewports() {}
+void Application::AssignShadowMapViewports() {
+	ShadowMapViewport sunViewports[MAX_NUM_SHADOW_CASCADES] = {};
+	ShadowMapViewport spotViewports[arraysize(_spotShadowRenderPasses)] = {};
+	ShadowMapViewport pointViewports[arraysize(_pointShadowRenderPasses)][2] = {};
+
+	ShadowMapRequest requests[MAX_NUM_SHADOW_CASCADES + arraysize(_spotShadowRenderPasses) + 2 * arraysize(_pointShadowRenderPasses)];
+	uint32 numRequests = 0;
+
+	// The cascades cover the whole view, so they always get the full size.
+	for (uint32 i = 0; i < _sun.NumShadowCascades; ++i) {
+		requests[numRequests++] = { GetSunShadowMapId(i), (float)_sun.ShadowDimensions, &sunViewports[i] };
+	}
+
+	float maxTileSize = (float)_shadowMapCache.GetAtlas().MaximumSize;
+
+	// Passes without a light get no casters.
+	for (uint32 i = 0; i < std::size(_spotShadowRenderPasses); ++i) {
+		_spotShadowBounds[i] = { vec3(0.f), -1.f };
+	}
+	for (uint32 i = 0; i < std::size(_pointShadowRenderPasses); ++i) {
+		_pointShadowBounds[i] = { vec3(0.f), -1.f };
+	}
+
+	for (uint32 i = 0; i < (uint32)_spotLights.size(); ++i) {
+		SpotLightCb& sl = _spotLights[i];
+		if (sl.ShadowInfoIndex < 0 or sl.ShadowInfoIndex >= (int32)std::size(_spotShadowRenderPasses)) {
+			continue;
+		}
+
+		BoundingSphere& bounds = _spotShadowBounds[sl.ShadowInfoIndex];
+		GetSpotLightBoundingSphere(sl.Position, sl.Direction, acos(sl.GetOuterCutoff()), sl.MaxDistance, bounds.Center, bounds.Radius);
+
+		float importance = GetShadowMapImportance(_camera.Position, _camera.verticalFOV, bounds.Center, bounds.Radius);
+		requests[numRequests++] = { GetSpotShadowMapId(i), importance * maxTileSize, &spotViewports[sl.ShadowInfoIndex] };
+	}
+
+	for (uint32 i = 0; i < (uint32)_pointLights.size(); ++i) {
+		PointLightCb& pl = _pointLights[i];
+		if (pl.ShadowInfoIndex < 0 or pl.ShadowInfoIndex >= (int32)std::size(_pointShadowRenderPasses)) {
+			continue;
+		}
+
+		_pointShadowBounds[pl.ShadowInfoIndex] = { pl.Position, pl.Radius };
+
+		float importance = GetShadowMapImportance(_camera.Position, _camera.verticalFOV, pl.Position, pl.Radius);
+		for (uint32 v = 0; v < 2; ++v) {
+			requests[numRequests++] = { GetPointShadowMapId(i, v), importance * maxTileSize, &pointViewports[pl.ShadowInfoIndex][v] };
+		}
+	}
+
+	_shadowMapCache.Update(requests, numRequests);
+
+	for (uint32 i = 0; i < _sun.NumShadowCascades; ++i) {
+		_sunShadowRenderPass.Viewports[i] = sunViewports[i].AsVec4();
+	}
+	for (uint32 i = 0; i < (uint32)_spotLights.size(); ++i) {
+		int32 pass = _spotLights[i].ShadowInfoIndex;
+		if (pass >= 0 and pass < (int32)std::size(_spotShadowRenderPasses)) {
+			_spotShadowRenderPasses[pass].ViewportWasCached = _shadowMapCache.WasCached(GetSpotShadowMapId(i));
+		}
+	}
+	for (uint32 i = 0; i < (uint32)_pointLights.size(); ++i) {
+		int32 pass = _pointLights[i].ShadowInfoIndex;
+		if (pass >= 0 and pass < (int32)std::size(_pointShadowRenderPasses)) {
+			_pointShadowRenderPasses[pass].ViewportWasCached = _shadowMapCache.WasCached(GetPointShadowMapId(i, 0)) and _shadowMapCache.WasCached(GetPointShadowMapId(i, 1));
+		}
+	}
+
+	for (uint32 i = 0; i < std::size(_spotShadowRenderPasses); ++i) {
+		_spotShadowRenderPasses[i].Viewport = spotViewports[i].AsVec4();
+	}
+	for (uint32 i = 0; i < std::size(_pointShadowRenderPasses); ++i) {
+		_pointShadowRenderPasses[i].Viewport0 = pointViewports[i][0].AsVec4();
+		_pointShadowRenderPasses[i].Viewport1 = pointViewports[i][1].AsVec4();
+	}
+}
+
+void Application::SubmitShadowCaster(const BoundingSphere& bounds, const Ptr<DxVertexBuffer>& vertexBuffer, const Ptr<DxIndexBuffer>& indexBuffer, SubmeshInfo submesh, const mat4& transform, bool dynamic) {
+	_sunShadowRenderPass.RenderObject(0, vertexBuffer, indexBuffer, submesh, transform);
+
+	BoundingSphere casterBounds = bounds;
+
+	for (uint32 i = 0; i < std::size(_spotShadowRenderPasses); ++i) {
+		if (casterBounds.Collide(_spotShadowBounds[i])) {
+			if (dynamic) {
+				_spotShadowRenderPasses[i].RenderDynamicObject(vertexBuffer, indexBuffer, submesh, transform);
+			}
+			else {
+				_spotShadowRenderPasses[i].RenderStaticObject(vertexBuffer, indexBuffer, submesh, transform);
+			}
+		}
+	}
+
+	for (uint32 i = 0; i < std::size(_pointShadowRenderPasses); ++i) {
+		if (casterBounds.Collide(_pointShadowBounds[i])) {
+			if (dynamic) {
+				_pointShadowRenderPasses[i].RenderDynamicObject(vertexBuffer, indexBuffer, submesh, transform);
+			}
+			else {
+				_pointShadowRenderPasses[i].RenderStaticObject(vertexBuffer, indexBuffer, submesh, transform);
+			}
+		}
+	}
+}
 
 void Application::Update(const UserInput &input, float dt) {
+	CPU_PROFILE_BLOCK("Update");
+
 	ResetRenderPasses();
 	HandleUserInput(input, dt);
 
@@ -484,6 +606,8 @@ void Application::Update(const UserInput &input, float dt) {
 
 			mat4* mats = skinningMatrices;
 			context.AddWork([&skeleton, &anim, mats]() {
+				CPU_PROFILE_BLOCK("Skinning");
+
 				trs localTransforms[128];
 				skeleton.SampleAnimation(skeleton.Clips[anim.AnimationIndex].Name, anim.Time, localTransforms);
 				skeleton.GetSkinningMatricesFromLocalTransforms(localTransforms, mats);
@@ -514,6 +638,10 @@ void Application::Update(const UserInput &input, float dt) {
 
 				uint32 numSubmeshes = (uint32)raster.Mesh->Submeshes.size();
 
+				// The bounds are in bind pose. They are padded, because the animation may move vertices outside.
+				BoundingSphere bounds = GetWorldSpaceBounds(raster.Mesh->AABB, transform);
+				bounds.Radius *= 1.5f;
+
 				for (uint32 i = 0; i < numSubmeshes; ++i) {
 					SubmeshInfo submesh = anim.SMs[i];
 					SubmeshInfo prevFrameSubmesh = anim.PrefFrameSMs[i];
@@ -526,10 +654,7 @@ void Application::Update(const UserInput &input, float dt) {
 					else {
 						_opaqueRenderPass.RenderAnimatedObject(anim.VB, anim.PrevFrameVB, mesh.IndexBuffer, submesh, prevFrameSubmesh, material, m, m,
 							(uint32)entityHandle, outline);
-						_sunShadowRenderPass.RenderObject(0, anim.VB, mesh.IndexBuffer, submesh, m);
-						_spotShadowRenderPasses[0].RenderObject(anim.VB, mesh.IndexBuffer, submesh, m);
-						_spotShadowRenderPasses[1].RenderObject(anim.VB, mesh.IndexBuffer, submesh, m);
-						_pointShadowRenderPasses[0].RenderObject(anim.VB, mesh.IndexBuffer, submesh, m);
+						SubmitShadowCaster(bounds, anim.VB, mesh.IndexBuffer, submesh, m, true);
 					}
 				}
 			}
@@ -543,10 +668,7 @@ void Application::Update(const UserInput &input, float dt) {
 					}
 					else {
 						_opaqueRenderPass.RenderStaticObject(mesh.VertexBuffer, mesh.IndexBuffer, submesh, material, m, (uint32)entityHandle, outline);
-						_sunShadowRenderPass.RenderObject(0, mesh.VertexBuffer, mesh.IndexBuffer, submesh, m);
-						_spotShadowRenderPasses[0].RenderObject(mesh.VertexBuffer, mesh.IndexBuffer, submesh, m);
-						_spotShadowRenderPasses[1].RenderObject(mesh.VertexBuffer, mesh.IndexBuffer, submesh, m);
-						_pointShadowRenderPasses[0].RenderObject(mesh.VertexBuffer, mesh.IndexBuffer, submesh, m);
+						SubmitShadowCaster(GetWorldSpaceBounds(sm.AABB, transform), mesh.VertexBuffer, mesh.IndexBuffer, submesh, m, false);
 					}
 				}
 			}
@@ -588,6 +710,8 @@ void Application::Run() {
 
 	fenceValues[NUM_BUFFERED_FRAMES - 1] = dxContext.RenderQueue.Signal();
 
+	CPU_PROFILE_THREAD_NAME("Main thread");
+
 	_running = true;
 	while (NewFrame()) {
 		dxContext.RenderQueue.WaitForFence(fenceValues[_mainWindow.CurrentBackBufferIndex()]);
@@ -605,8 +729,18 @@ void Application::Run() {
 		fenceValues[_mainWindow.CurrentBackBufferIndex()] = RenderToWindow(clearColor1);
 
 		_mainWindow.SwapBuffers();
+
+		CPU_PROFILE_FRAME_MARKER(frameId);
+		MEMORY_TRACKING_NEW_FRAME(frameId);
 		++frameId;
 	}
 
+	// Open in chrome://tracing or ui.perfetto.dev. Needs ENABLE_CPU_PROFILING, and ENABLE_DX_PROFILING for the GPU tracks.
+	// ExportProfileTrace("profile.json", 60);
+	// ExportProfileStatistics("profile");
+
+	// Textures loaded at runtime may have added cache files.
+	AssetCache::Instance()->SaveManifest();
+
 	dxContext.Quit();
 }
@@ -12,6 +12,7 @@
 #include "render/LightSource.h"
 #include "render/TrasformationGizmo.h"
 #include "render/Raytracing.h"
+#include "render/ShadowMapCache.h"
 
 #include "render/PathTracing.h"
 
@@ -49,6 +50,7 @@ private:
 	void HandleUserInput(const UserInput& input, float dt);
 
 	void AssignShadowMapViewports();
+	void SubmitShadowCaster(const BoundingSphere& bounds, const Ptr<DxVertexBuffer>& vertexBuffer, const Ptr<DxIndexBuffer>& indexBuffer, SubmeshInfo submesh, const mat4& transform, bool dynamic);
 
 	bool HandleWindowsMessages();
 
@@ -88,6 +90,11 @@ private:
 	SunShadowRenderPass _sunShadowRenderPass;
 	SpotShadowRenderPass _spotShadowRenderPasses[2];
 	PointShadowRenderPass _pointShadowRenderPasses[2];
+	ShadowMapCache _shadowMapCache;
+
+	// Range of the light of each spot and point shadow pass. Casters outside are not submitted, so they can't invalidate the cached shadow maps.
+	BoundingSphere _spotShadowBounds[arraysize(_spotShadowRenderPasses)];
+	BoundingSphere _pointShadowBounds[arraysize(_pointShadowRenderPasses)];
 	OverlayRenderPass _overlayRenderPass;
 
 	UserInput _input = {};
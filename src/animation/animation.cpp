@@ -1,6 +1,8 @@
 #include "animation.h"
 
 #include "../physics/assimp.h"
+#include "../core/gltf.h"
+#include "../core/threading.h"
 
 #include <filesystem>
 #include <iostream>
@@ -97,9 +99,36 @@ void AnimationSkeleton::PushAssimpAnimations(const char* sceneFilename, float sc
 
 void AnimationSkeleton::PushAssimpAnimationsInDirectory(const char* directory, float scale)
 {
+	std::vector<std::string> filenames;
 	for (auto& p : fs::directory_iterator(directory))
 	{
-		PushAssimpAnimations(p.path().string().c_str());
+		filenames.push_back(p.path().string());
+	}
+
+	// Importing dominates, so all files are imported in parallel. The clips are pushed afterwards in directory order, which keeps the clip ids stable.
+	uint32 numFiles = (uint32)filenames.size();
+	std::unique_ptr<Assimp::Importer[]> importers(new Assimp::Importer[numFiles]);
+	std::vector<const aiScene*> scenes(numFiles);
+
+	ThreadJobContext context;
+	for (uint32 i = 0; i < numFiles; ++i)
+	{
+		context.AddWork([&filenames, &importers, &scenes, i]()
+		{
+			scenes[i] = LoadAssimpSceneFile(filenames[i].c_str(), importers[i]);
+		});
+	}
+	context.WaitForWorkCompletion();
+
+	for (uint32 f = 0; f < numFiles; ++f)
+	{
+		if (scenes[f])
+		{
+			for (uint32 i = 0; i < scenes[f]->mNumAnimations; ++i)
+			{
+				PushAssimpAnimation(filenames[f].c_str(), scenes[f]->mAnimations[i], scale);
+			}
+		}
 	}
 }
 
@@ -173,6 +202,253 @@ void AnimationSkeleton::LoadFromAssimp(const aiScene* scene, float scale)
 	readAssimpSkeletonHierarchy(scene->mRootNode, *this, insertIndex);
 }
 
+bool AnimationSkeleton::LoadFromGltf(const GltfDocument& document)
+{
+	uint32 numNodes = (uint32)document.Nodes.size();
+
+	// The first skin listing a joint provides its inverse bind matrix.
+	std::vector<const GltfSkin*> jointSkin(numNodes, nullptr);
+	std::vector<uint32> indexInSkin(numNodes, 0);
+	std::vector<std::vector<mat4>> invBindMatrices(document.Skins.size());
+
+	for (uint32 s = 0; s < (uint32)document.Skins.size(); ++s)
+	{
+		const GltfSkin& skin = document.Skins[s];
+		for (uint32 i = 0; i < (uint32)skin.Joints.size(); ++i)
+		{
+			if (not jointSkin[skin.Joints[i]])
+			{
+				jointSkin[skin.Joints[i]] = &skin;
+				indexInSkin[skin.Joints[i]] = i;
+			}
+		}
+
+		std::vector<mat4>& matrices = invBindMatrices[s];
+		matrices.resize(skin.Joints.size(), mat4::identity);
+		if (skin.InverseBindMatrices != GLTF_NONE)
+		{
+			const GltfAccessor& accessor = document.Accessors[skin.InverseBindMatrices];
+			if (accessor.NumComponents != 16 or accessor.Count < skin.Joints.size()
+				or not ReadGltfFloats(document, accessor, 16, matrices.data(), sizeof(mat4)))
+			{
+				return false;
+			}
+		}
+	}
+
+	// Depth first through the hierarchy, which puts parents before their children. Nodes between two joints are skipped, like in the
+	// Assimp path, so a joint's parent is its closest ancestor that is a joint.
+	std::vector<std::pair<uint32, uint32>> stack; // Node and parent joint.
+	for (uint32 i = numNodes; i-- > 0;)
+	{
+		if (document.Nodes[i].Parent == GLTF_NONE)
+		{
+			stack.push_back({ i, NO_PARENT });
+		}
+	}
+
+	while (not stack.empty())
+	{
+		auto [nodeIndex, parentId] = stack.back();
+		stack.pop_back();
+
+		const GltfNode& node = document.Nodes[nodeIndex];
+		if (jointSkin[nodeIndex])
+		{
+			if (NameToJointId.find(node.Name) != NameToJointId.end())
+			{
+				return false;
+			}
+
+			uint32 skinIndex = (uint32)(jointSkin[nodeIndex] - document.Skins.data());
+
+			NameToJointId[node.Name] = (uint32)Joints.size();
+
+			SkeletonJoint& joint = Joints.emplace_back();
+			joint.Name = node.Name;
+			joint.ParentId = parentId;
+			joint.InvBindMatrix = invBindMatrices[skinIndex][indexInSkin[nodeIndex]];
+			joint.BindTransform = trs(invert(joint.InvBindMatrix));
+
+			parentId = (uint32)Joints.size() - 1;
+		}
+
+		for (uint32 i = (uint32)node.Children.size(); i-- > 0;)
+		{
+			stack.push_back({ node.Children[i], parentId });
+		}
+	}
+
+	return true;
+}
+
+static void readGltfChannel(const GltfDocument& document, const GltfAnimationSampler& sampler, uint32 numComponents,
+	std::vector<float>& outTimestamps, std::vector<float>& outValues)
+{
+	const GltfAccessor& input = document.Accessors[sampler.Input];
+	const GltfAccessor& output = document.Accessors[sampler.Output];
+
+	// Cubic splines store an in-tangent, the value and an out-tangent per keyframe. Only the values are kept, and interpolated linearly.
+	uint32 valuesPerKey = (sampler.Interpolation == EGltfInterpolationCubicSpline) ? 3 : 1;
+
+	uint32 numKeys = input.Count;
+	if (input.NumComponents != 1 or output.NumComponents != numComponents or output.Count != numKeys * valuesPerKey)
+	{
+		numKeys = 0;
+	}
+
+	outTimestamps.resize(numKeys);
+	std::vector<float> values((uint64)numKeys * valuesPerKey * numComponents);
+	if (not ReadGltfFloats(document, input, 1, outTimestamps.data(), sizeof(float))
+		or not ReadGltfFloats(document, output, numComponents, values.data(), numComponents * sizeof(float)))
+	{
+		numKeys = 0;
+		outTimestamps.clear();
+	}
+
+	outValues.resize((uint64)numKeys * numComponents);
+	for (uint32 i = 0; i < numKeys; ++i)
+	{
+		uint32 source = (i * valuesPerKey + valuesPerKey / 2) * numComponents;
+		memcpy(&outValues[i * numComponents], &values[source], numComponents * sizeof(float));
+	}
+}
+
+void AnimationSkeleton::PushGltfAnimation(const char* suffix, const GltfDocument& document, uint32 animationIndex)
+{
+	const GltfAnimation& animation = document.Animations[animationIndex];
+
+	AnimationClip& clip = Clips.emplace_back();
+
+	std::string name = animation.Name.empty() ? "Animation" + std::to_string(animationIndex) : animation.Name;
+	clip.Name = name + "(" + suffix + ")";
+
+	uint32 numJoints = (uint32)Joints.size();
+	clip.Joints.resize(numJoints);
+
+	// Channels are matched to joints by node name, but only nodes which are actually joints count.
+	std::vector<uint32> jointNode(numJoints, GLTF_NONE);
+	std::vector<int32> nodeJoint(document.Nodes.size(), GLTF_NONE);
+	for (const GltfSkin& skin : document.Skins)
+	{
+		for (uint32 node : skin.Joints)
+		{
+			auto it = NameToJointId.find(document.Nodes[node].Name);
+			if (it != NameToJointId.end())
+			{
+				jointNode[it->second] = node;
+				nodeJoint[node] = (int32)it->second;
+			}
+		}
+	}
+
+	// Per joint the channel for translation, rotation and scale.
+	std::vector<std::array<const GltfAnimationChannel*, 3>> jointChannels(numJoints, { nullptr, nullptr, nullptr });
+	for (const GltfAnimationChannel& channel : animation.Channels)
+	{
+		if (channel.Path != EGltfAnimationPathWeights and nodeJoint[channel.Node] != GLTF_NONE)
+		{
+			jointChannels[nodeJoint[channel.Node]][channel.Path] = &channel;
+		}
+	}
+
+	std::vector<std::vector<float>> timestamps(numJoints * 3);
+	std::vector<std::vector<float>> values(numJoints * 3);
+
+	float length = 0.f;
+	for (uint32 i = 0; i < numJoints; ++i)
+	{
+		for (uint32 path = 0; path < 3; ++path)
+		{
+			const GltfAnimationChannel* channel = jointChannels[i][path];
+			if (channel)
+			{
+				readGltfChannel(document, animation.Samplers[channel->Sampler], (path == EGltfAnimationPathRotation) ? 4 : 3,
+					timestamps[i * 3 + path], values[i * 3 + path]);
+				if (!timestamps[i * 3 + path].empty())
+				{
+					length = Max(length, timestamps[i * 3 + path].back());
+				}
+			}
+		}
+	}
+	clip.LengthInSeconds = length;
+
+	for (uint32 i = 0; i < numJoints; ++i)
+	{
+		AnimationJoint& joint = clip.Joints[i];
+		const GltfNode& node = document.Nodes[jointNode[i]];
+
+		// Every joint is animated, since the sampler replaces joints without keyframes by the identity, and glTF joints usually rest
+		// somewhere else. Paths without a channel get a single keyframe with the rest pose. All other paths are extended to cover the
+		// whole clip, because the sampler expects a keyframe at or after every time in it.
+		joint.IsAnimated = true;
+
+		const float* rest[3] = { node.Translation, node.Rotation, node.Scale };
+		uint32 firstKeyframe[3];
+		uint32 numKeyframes[3];
+
+		for (uint32 path = 0; path < 3; ++path)
+		{
+			std::vector<float>& ts = timestamps[i * 3 + path];
+			std::vector<float>& vs = values[i * 3 + path];
+			uint32 numComponents = (path == EGltfAnimationPathRotation) ? 4 : 3;
+
+			if (ts.empty())
+			{
+				ts.push_back(0.f);
+				vs.assign(rest[path], rest[path] + numComponents);
+			}
+			else
+			{
+				if (ts.front() > 0.f)
+				{
+					ts.insert(ts.begin(), 0.f);
+					vs.insert(vs.begin(), vs.begin(), vs.begin() + numComponents);
+				}
+				if (ts.back() < length)
+				{
+					ts.push_back(length);
+					vs.insert(vs.end(), vs.end() - numComponents, vs.end());
+				}
+			}
+
+			AnimationVector<float>& clipTimestamps = (path == EGltfAnimationPathTranslation) ? clip.PositionTimestamps
+				: (path == EGltfAnimationPathRotation) ? clip.RotationTimestamps
+				: clip.ScaleTimestamps;
+			firstKeyframe[path] = (uint32)clipTimestamps.size();
+			numKeyframes[path] = (uint32)ts.size();
+			clipTimestamps.insert(clipTimestamps.end(), ts.begin(), ts.end());
+
+			for (uint32 k = 0; k < (uint32)ts.size(); ++k)
+			{
+				const float* v = &vs[k * numComponents];
+				if (path == EGltfAnimationPathTranslation)
+				{
+					clip.PositionKeyframes.push_back(vec3(v[0], v[1], v[2]));
+				}
+				else if (path == EGltfAnimationPathRotation)
+				{
+					clip.RotationKeyframes.push_back(normalize(quat(v[0], v[1], v[2], v[3])));
+				}
+				else
+				{
+					clip.ScaleKeyframes.push_back(vec3(v[0], v[1], v[2]));
+				}
+			}
+		}
+
+		joint.FirstPositionKeyframe = firstKeyframe[EGltfAnimationPathTranslation];
+		joint.NumPositionKeyframes = numKeyframes[EGltfAnimationPathTranslation];
+		joint.FirstRotationKeyframe = firstKeyframe[EGltfAnimationPathRotation];
+		joint.NumRotationKeyframes = numKeyframes[EGltfAnimationPathRotation];
+		joint.FirstScaleKeyframe = firstKeyframe[EGltfAnimationPathScale];
+		joint.NumScaleKeyframes = numKeyframes[EGltfAnimationPathScale];
+	}
+
+	NameToClipId[clip.Name] = (uint32)Clips.size() - 1;
+}
+
 static vec3 samplePosition(const AnimationClip& clip, const AnimationJoint& animJoint, float time)
 {
 	if (animJoint.NumPositionKeyframes == 1)
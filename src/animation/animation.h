@@ -4,6 +4,7 @@
 
 #include "../pch.h"
 #include "../core/math.h"
+#include "../core/memoryTracking.h"
 
 #define NO_PARENT 0xffffffff
 
@@ -32,18 +33,21 @@ struct AnimationJoint {
 	uint32 NumScaleKeyframes;
 };
 
+template<typename T>
+using AnimationVector = std::vector<T, TrackedAllocator<T, EMemoryCategoryAnimation>>;
+
 struct AnimationClip {
 	std::string Name;
 
-	std::vector<float> PositionTimestamps;
-	std::vector<float> RotationTimestamps;
-	std::vector<float> ScaleTimestamps;
+	AnimationVector<float> PositionTimestamps;
+	AnimationVector<float> RotationTimestamps;
+	AnimationVector<float> ScaleTimestamps;
 
-	std::vector<vec3> PositionKeyframes;
-	std::vector<quat> RotationKeyframes;
-	std::vector<vec3> ScaleKeyframes;
+	AnimationVector<vec3> PositionKeyframes;
+	AnimationVector<quat> RotationKeyframes;
+	AnimationVector<vec3> ScaleKeyframes;
 
-	std::vector<AnimationJoint> Joints;
+	AnimationVector<AnimationJoint> Joints;
 
 	float LengthInSeconds;
 };
@@ -60,6 +64,11 @@ struct AnimationSkeleton {
 	void PushAssimpAnimations(const char* sceneFilename, float scale = 1.f);
 	void PushAssimpAnimationsInDirectory(const char* directory, float scale = 1.f);
 
+	// The joints are the nodes used by any skin of the document. Returns false if two joints share a name, since joints and animation
+	// channels are matched by name.
+	bool LoadFromGltf(const struct GltfDocument& document);
+	void PushGltfAnimation(const char* suffix, const struct GltfDocument& document, uint32 animationIndex);
+
 	void SampleAnimation(const std::string& name, float time, trs* outLocalTransforms) const;
 	void GetSkinningMatricesFromLocalTransforms(const trs* localTransforms, mat4* outSkinningMatrices, const trs& worldTransform = trs::identity) const;
 
@@ -0,0 +1,302 @@
+#include "assetCache.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#define XXH_INLINE_ALL
+#include <xxhash.h>
+
+AssetCache* AssetCache::_instance = new AssetCache{};
+
+namespace {
+	std::string GetSourceName(const fs::path& source) {
+		return source.lexically_normal().generic_string();
+	}
+
+	int64 GetWriteTime(const fs::file_time_type& time) {
+		return (int64)time.time_since_epoch().count();
+	}
+}
+
+bool HashFileContents(const fs::path& filename, uint64& outHash) {
+	std::ifstream stream(filename, std::ios::binary);
+	if (not stream) {
+		return false;
+	}
+
+	XXH3_state_t state;
+	XXH3_INITSTATE(&state);
+	XXH3_64bits_reset(&state);
+
+	std::vector<char> buffer(256 * 1024);
+	while (stream) {
+		stream.read(buffer.data(), buffer.size());
+		std::streamsize numBytesRead = stream.gcount();
+		if (numBytesRead > 0) {
+			XXH3_64bits_update(&state, buffer.data(), (size_t)numBytesRead);
+		}
+	}
+
+	if (stream.bad()) {
+		return false;
+	}
+
+	outHash = XXH3_64bits_digest(&state);
+	return true;
+}
+
+uint64 AssetCache::GetKey(uint64 contentHash, uint64 importerVersion, uint32 flags) {
+	uint64 data[] = { contentHash, importerVersion, flags };
+	return XXH3_64bits(data, sizeof(data));
+}
+
+std::string AssetCache::GetCacheFilename(uint64 key, const char* extension) {
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx", (unsigned long long)key);
+	return std::string(name) + extension;
+}
+
+void AssetCache::Initialize(const fs::path& directory) {
+	_directory = directory;
+	_sources.clear();
+	_entries.clear();
+	_newSources.clear();
+	_newEntries.clear();
+
+	std::ifstream stream(_directory / ASSET_CACHE_MANIFEST_NAME);
+	if (not stream) {
+		return;
+	}
+
+	std::string line;
+	while (std::getline(stream, line)) {
+		std::istringstream lineStream(line);
+
+		std::string tag;
+		lineStream >> tag;
+
+		// The source path comes last, since it may contain spaces.
+		if (tag == "S") {
+			SourceInfo info;
+			std::string source;
+			lineStream >> info.Size >> info.WriteTime >> std::hex >> info.ContentHash >> std::dec >> std::ws;
+			std::getline(lineStream, source);
+			if (lineStream and not source.empty()) {
+				_sources[source] = info;
+			}
+		}
+		else if (tag == "E") {
+			uint64 key;
+			CacheEntry entry;
+			lineStream >> std::hex >> key >> entry.ContentHash >> std::dec >> entry.Filename >> std::ws;
+			std::getline(lineStream, entry.Source);
+			if (lineStream and not entry.Source.empty()) {
+				_entries[key] = entry;
+			}
+		}
+	}
+}
+
+bool AssetCache::GetSourceInfo(const fs::path& source, bool forceHash, SourceInfo& outInfo) {
+	std::error_code error;
+	uint64 size = (uint64)fs::file_size(source, error);
+	if (error) {
+		return false;
+	}
+	int64 writeTime = GetWriteTime(fs::last_write_time(source, error));
+	if (error) {
+		return false;
+	}
+
+	std::string name = GetSourceName(source);
+
+	if (not forceHash) {
+		// Same size and write time as when the source was last hashed. The write time is only trusted to tell that a file did
+		// not change. If it did change, the file is hashed again, and a file which only got touched still finds its cache.
+		auto it = _sources.find(name);
+		if (it != _sources.end() and it->second.Size == size and it->second.WriteTime == writeTime) {
+			outInfo = it->second;
+			return true;
+		}
+
+		std::lock_guard lock(_mutex);
+		auto newIt = _newSources.find(name);
+		if (newIt != _newSources.end() and newIt->second.Size == size and newIt->second.WriteTime == writeTime) {
+			outInfo = newIt->second;
+			return true;
+		}
+	}
+
+	uint64 contentHash;
+	if (not HashFileContents(source, contentHash)) {
+		return false;
+	}
+	++NumHashedFiles;
+
+	outInfo = { size, writeTime, contentHash };
+
+	std::lock_guard lock(_mutex);
+	_newSources[name] = outInfo;
+	return true;
+}
+
+bool AssetCache::Lookup(const fs::path& source, uint64 importerVersion, uint32 flags, const char* extension, fs::path& outCacheFile, bool hashUnchangedFiles) {
+	SourceInfo info;
+	if (not GetSourceInfo(source, hashUnchangedFiles, info)) {
+		outCacheFile.clear();
+		return false;
+	}
+
+	uint64 key = GetKey(info.ContentHash, importerVersion, flags);
+	outCacheFile = _directory / GetCacheFilename(key, extension);
+
+	if (_entries.contains(key)) {
+		return true;
+	}
+
+	std::lock_guard lock(_mutex);
+	return _newEntries.contains(key);
+}
+
+void AssetCache::Register(const fs::path& source, uint64 importerVersion, uint32 flags, const char* extension) {
+	SourceInfo info;
+	if (not GetSourceInfo(source, false, info)) {
+		return;
+	}
+
+	uint64 key = GetKey(info.ContentHash, importerVersion, flags);
+
+	std::lock_guard lock(_mutex);
+	_newEntries[key] = { GetSourceName(source), info.ContentHash, GetCacheFilename(key, extension) };
+}
+
+bool AssetCache::SaveManifest() {
+	std::error_code error;
+	fs::create_directories(_directory, error);
+
+	// Write to a temporary file first, so that a crash doesn't leave a half-written manifest behind.
+	fs::path manifestPath = _directory / ASSET_CACHE_MANIFEST_NAME;
+	fs::path tempPath = manifestPath;
+	tempPath += ".tmp";
+
+	{
+		std::ofstream stream(tempPath, std::ios::trunc);
+		if (not stream) {
+			return false;
+		}
+
+		auto writeSource = [&stream](const std::string& source, const SourceInfo& info) {
+			stream << "S " << info.Size << ' ' << info.WriteTime << ' ' << std::hex << info.ContentHash << std::dec << ' ' << source << '\n';
+		};
+		auto writeEntry = [&stream](uint64 key, const CacheEntry& entry) {
+			stream << "E " << std::hex << key << ' ' << entry.ContentHash << std::dec << ' ' << entry.Filename << ' ' << entry.Source << '\n';
+		};
+
+		for (auto& [source, info] : _sources) {
+			if (not _newSources.contains(source)) {
+				writeSource(source, info);
+			}
+		}
+		for (auto& [source, info] : _newSources) {
+			writeSource(source, info);
+		}
+
+		for (auto& [key, entry] : _entries) {
+			if (not _newEntries.contains(key)) {
+				writeEntry(key, entry);
+			}
+		}
+		for (auto& [key, entry] : _newEntries) {
+			writeEntry(key, entry);
+		}
+
+		if (not stream) {
+			return false;
+		}
+	}
+
+	fs::rename(tempPath, manifestPath, error);
+	return not error;
+}
+
+uint32 AssetCache::CollectGarbage() {
+	for (auto& [source, info] : _newSources) {
+		_sources[source] = info;
+	}
+	for (auto& [key, entry] : _newEntries) {
+		_entries[key] = entry;
+	}
+	_newSources.clear();
+	_newEntries.clear();
+
+	uint32 numDeletedFiles = 0;
+	std::error_code error;
+
+	for (auto it = _sources.begin(); it != _sources.end();) {
+		if (not fs::exists(it->first, error)) {
+			it = _sources.erase(it);
+		}
+		else {
+			++it;
+		}
+	}
+
+	for (auto it = _entries.begin(); it != _entries.end();) {
+		SourceInfo info;
+		bool stale = not GetSourceInfo(it->second.Source, false, info) or info.ContentHash != it->second.ContentHash;
+		if (stale) {
+			if (fs::remove(_directory / it->second.Filename, error)) {
+				++numDeletedFiles;
+			}
+			it = _entries.erase(it);
+		}
+		else {
+			++it;
+		}
+	}
+
+	// GetSourceInfo above records rehashed sources as new.
+	for (auto& [source, info] : _newSources) {
+		_sources[source] = info;
+	}
+	_newSources.clear();
+
+	// Everything else in the cache directory is unreferenced, e.g. files of an older cache layout or of interrupted runs.
+	std::unordered_map<std::string, bool> referenced;
+	for (auto& [key, entry] : _entries) {
+		referenced[entry.Filename] = true;
+	}
+
+	std::vector<fs::path> unreferenced;
+	std::vector<fs::path> directories;
+	for (auto it = fs::recursive_directory_iterator(_directory, error); not error and it != fs::recursive_directory_iterator(); it.increment(error)) {
+		const fs::path& path = it->path();
+		if (it->is_directory(error)) {
+			directories.push_back(path);
+			continue;
+		}
+
+		fs::path relative = path.lexically_relative(_directory);
+		if (relative == ASSET_CACHE_MANIFEST_NAME or referenced.contains(relative.generic_string())) {
+			continue;
+		}
+		unreferenced.push_back(path);
+	}
+
+	for (const fs::path& path : unreferenced) {
+		if (fs::remove(path, error)) {
+			++numDeletedFiles;
+		}
+	}
+
+	// Deepest first, so that parents are empty once they are reached. Non-empty directories are left alone.
+	std::sort(directories.begin(), directories.end(), [](const fs::path& a, const fs::path& b) { return a.native().size() > b.native().size(); });
+	for (const fs::path& path : directories) {
+		if (fs::is_empty(path, error)) {
+			fs::remove(path, error);
+		}
+	}
+
+	return numDeletedFiles;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "../pch.h"
+#include <atomic>
+#include <unordered_map>
+
+// Bump these when the preprocessing of the respective asset type changes, so that old cache files are no longer used.
+#define TEXTURE_CACHE_VERSION 3
+#define MESH_CACHE_VERSION 1
+#define ENVIRONMENT_CACHE_VERSION 1
+
+#define ASSET_CACHE_DIRECTORY "asset_cache"
+#define ASSET_CACHE_MANIFEST_NAME "manifest.txt"
+
+// Decides whether a preprocessed cache file is still valid for its source asset, based on file contents instead of write times.
+// The key of a cache file is a hash of the source's contents, the version of the importer which produced it and the import flags.
+// Cache files are named after their key, and a single manifest remembers which keys exist and the content hash of each source.
+//
+// The manifest read at startup is never modified afterwards, so lookups of assets which were cached in an earlier run don't take any lock.
+// Cache files written during this run go into a second table, which is guarded by a mutex and merged into the manifest by SaveManifest.
+class AssetCache {
+public:
+	static AssetCache* Instance() { return _instance; }
+
+	// Reads the manifest from 'directory'. A missing or unreadable manifest starts an empty cache.
+	void Initialize(const fs::path& directory = ASSET_CACHE_DIRECTORY);
+
+	// Returns true and the path of the cache file if 'source' was already preprocessed with the same contents, version and flags.
+	// Otherwise, 'outCacheFile' is the path under which the new cache file must be written, followed by a call to Register.
+	// If 'hashUnchangedFiles' is false, a source whose size and write time match the manifest is not hashed again.
+	// Thread safe.
+	bool Lookup(const fs::path& source, uint64 importerVersion, uint32 flags, const char* extension, fs::path& outCacheFile, bool hashUnchangedFiles = false);
+
+	// Records that the cache file returned by the last Lookup for this source, version and flags was written. Thread safe.
+	void Register(const fs::path& source, uint64 importerVersion, uint32 flags, const char* extension);
+
+	// Writes all entries to the manifest. Not thread safe with respect to Lookup and Register.
+	bool SaveManifest();
+
+	// Removes manifest entries whose source no longer exists or has changed, and deletes their cache files, as well as any file in the
+	// cache directory which the manifest doesn't know about. Call at a point where no loads are running, e.g. right after startup.
+	// Returns the number of deleted files. Not thread safe.
+	uint32 CollectGarbage();
+
+	uint32 GetNumEntries() const { return (uint32)_entries.size() + (uint32)_newEntries.size(); }
+
+	std::atomic<uint32> NumHashedFiles = 0; // Sources whose contents had to be hashed, because they were new or their size or write time changed.
+
+private:
+	struct SourceInfo {
+		uint64 Size;
+		int64 WriteTime;
+		uint64 ContentHash;
+	};
+
+	struct CacheEntry {
+		std::string Source;
+		uint64 ContentHash;
+		std::string Filename; // Relative to the cache directory.
+	};
+
+	bool GetSourceInfo(const fs::path& source, bool forceHash, SourceInfo& outInfo);
+	static uint64 GetKey(uint64 contentHash, uint64 importerVersion, uint32 flags);
+	static std::string GetCacheFilename(uint64 key, const char* extension);
+
+	fs::path _directory;
+
+	// Read-only after Initialize.
+	std::unordered_map<std::string, SourceInfo> _sources;
+	std::unordered_map<uint64, CacheEntry> _entries;
+
+	std::mutex _mutex;
+	std::unordered_map<std::string, SourceInfo> _newSources;
+	std::unordered_map<uint64, CacheEntry> _newEntries;
+
+	static AssetCache* _instance;
+};
+
+// Fast 64-bit hash of the whole file. Returns false if the file can't be read.
+bool HashFileContents(const fs::path& filename, uint64& outHash);
@@ -0,0 +1,745 @@
+#include "blockCompression.h"
+#include "threading.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+#if defined(_M_X64) or defined(__SSE2__)
+#include <emmintrin.h>
+#define BLOCK_COMPRESSION_SSE
+#endif
+
+namespace {
+	constexpr uint32 MinBlocksForParallel = 1024;
+	constexpr uint32 MinBlockRowsPerBand = 4;
+	constexpr uint32 TargetNumBands = 32;
+
+	// Interpolation weights of BC1 and BC3 color indices, from the first to the second endpoint.
+	const float ColorWeights[4] = { 0.f, 1.f, 1.f / 3.f, 2.f / 3.f };
+
+	// Same for the eight-step mode of BC4 (first endpoint greater than the second).
+	const float SingleChannelWeights[8] = { 0.f, 1.f, 1.f / 7.f, 2.f / 7.f, 3.f / 7.f, 4.f / 7.f, 5.f / 7.f, 6.f / 7.f };
+
+	// 4-bit index weights of BC7, out of 64.
+	const uint32 BC7Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	// One array per channel, so that a SIMD register holds the same channel of four texels.
+	struct BlockTexels {
+		alignas(16) float Channels[4][16];
+	};
+
+	void LoadBlock(const uint8* pixels, uint32 width, uint32 height, uint64 rowPitch, uint32 bytesPerPixel, uint32 numChannels,
+		uint32 blockX, uint32 blockY, BlockTexels& block) {
+		for (uint32 y = 0; y < 4; ++y) {
+			const uint8* row = pixels + Min(blockY * 4 + y, height - 1) * rowPitch;
+			for (uint32 x = 0; x < 4; ++x) {
+				const uint8* texel = row + (uint64)Min(blockX * 4 + x, width - 1) * bytesPerPixel;
+				for (uint32 c = 0; c < numChannels; ++c) {
+					block.Channels[c][y * 4 + x] = texel[c];
+				}
+			}
+		}
+	}
+
+	float Clamp255(float v) {
+		return std::fmin(std::fmax(v, 0.f), 255.f);
+	}
+
+	// Picks the closest palette entry for every texel, over the channels [firstChannel, firstChannel + numChannels), and returns the summed
+	// squared error. Palette entries hold the channels starting at index 0.
+	float SelectIndices(const BlockTexels& block, uint32 firstChannel, uint32 numChannels, const float (*palette)[4], uint32 numColors, uint8* indices) {
+		float error = 0.f;
+
+#ifdef BLOCK_COMPRESSION_SSE
+		for (uint32 group = 0; group < 16; group += 4) {
+			__m128 best = _mm_set1_ps(FLT_MAX);
+			__m128i bestIndex = _mm_setzero_si128();
+
+			for (uint32 k = 0; k < numColors; ++k) {
+				__m128 distance = _mm_setzero_ps();
+				for (uint32 c = 0; c < numChannels; ++c) {
+					__m128 d = _mm_sub_ps(_mm_load_ps(block.Channels[firstChannel + c] + group), _mm_set1_ps(palette[k][c]));
+					distance = _mm_add_ps(distance, _mm_mul_ps(d, d));
+				}
+
+				__m128i closer = _mm_castps_si128(_mm_cmplt_ps(distance, best));
+				best = _mm_min_ps(distance, best);
+				bestIndex = _mm_or_si128(_mm_andnot_si128(closer, bestIndex), _mm_and_si128(closer, _mm_set1_epi32((int32)k)));
+			}
+
+			alignas(16) int32 groupIndices[4];
+			alignas(16) float groupErrors[4];
+			_mm_store_si128((__m128i*)groupIndices, bestIndex);
+			_mm_store_ps(groupErrors, best);
+			for (uint32 i = 0; i < 4; ++i) {
+				indices[group + i] = (uint8)groupIndices[i];
+				error += groupErrors[i];
+			}
+		}
+#else
+		for (uint32 i = 0; i < 16; ++i) {
+			float best = FLT_MAX;
+			for (uint32 k = 0; k < numColors; ++k) {
+				float distance = 0.f;
+				for (uint32 c = 0; c < numChannels; ++c) {
+					float d = block.Channels[firstChannel + c][i] - palette[k][c];
+					distance += d * d;
+				}
+				if (distance < best) {
+					best = distance;
+					indices[i] = (uint8)k;
+				}
+			}
+			error += best;
+		}
+#endif
+
+		return error;
+	}
+
+	// Endpoints at the extremes of the block's projection onto its principal axis. The fast mode uses the corners of the bounding box, pulled
+	// in slightly, since the extreme texels are rarely hit exactly by the interpolated palette.
+	void ComputeEndpoints(const BlockTexels& block, uint32 firstChannel, uint32 numChannels, EBlockCompressionQuality quality, float* e0, float* e1) {
+		float minimum[4], maximum[4], mean[4];
+		for (uint32 c = 0; c < numChannels; ++c) {
+			const float* channel = block.Channels[firstChannel + c];
+			minimum[c] = maximum[c] = channel[0];
+			mean[c] = 0.f;
+			for (uint32 i = 0; i < 16; ++i) {
+				minimum[c] = std::fmin(minimum[c], channel[i]);
+				maximum[c] = std::fmax(maximum[c], channel[i]);
+				mean[c] += channel[i];
+			}
+			mean[c] /= 16.f;
+		}
+
+		if (quality == EBlockCompressionQualityFast) {
+			for (uint32 c = 0; c < numChannels; ++c) {
+				float inset = (maximum[c] - minimum[c]) / 16.f;
+				e0[c] = maximum[c] - inset;
+				e1[c] = minimum[c] + inset;
+			}
+			return;
+		}
+
+		float covariance[4][4] = {};
+		for (uint32 i = 0; i < 16; ++i) {
+			for (uint32 c = 0; c < numChannels; ++c) {
+				float dc = block.Channels[firstChannel + c][i] - mean[c];
+				for (uint32 d = c; d < numChannels; ++d) {
+					covariance[c][d] += dc * (block.Channels[firstChannel + d][i] - mean[d]);
+				}
+			}
+		}
+		for (uint32 c = 0; c < numChannels; ++c) {
+			for (uint32 d = 0; d < c; ++d) {
+				covariance[c][d] = covariance[d][c];
+			}
+		}
+
+		// Power iteration, starting from the diagonal of the bounding box.
+		float axis[4];
+		for (uint32 c = 0; c < numChannels; ++c) {
+			axis[c] = maximum[c] - minimum[c];
+		}
+		for (uint32 iteration = 0; iteration < 8; ++iteration) {
+			float next[4] = {};
+			float largest = 0.f;
+			for (uint32 c = 0; c < numChannels; ++c) {
+				for (uint32 d = 0; d < numChannels; ++d) {
+					next[c] += covariance[c][d] * axis[d];
+				}
+				largest = std::fmax(largest, std::abs(next[c]));
+			}
+			if (largest < 1e-6f) {
+				break;
+			}
+			for (uint32 c = 0; c < numChannels; ++c) {
+				axis[c] = next[c] / largest;
+			}
+		}
+
+		float lengthSquared = 0.f;
+		for (uint32 c = 0; c < numChannels; ++c) {
+			lengthSquared += axis[c] * axis[c];
+		}
+
+		if (lengthSquared < 1e-6f) {
+			// Flat block.
+			for (uint32 c = 0; c < numChannels; ++c) {
+				e0[c] = e1[c] = mean[c];
+			}
+			return;
+		}
+
+		float minT = FLT_MAX, maxT = -FLT_MAX;
+		for (uint32 i = 0; i < 16; ++i) {
+			float t = 0.f;
+			for (uint32 c = 0; c < numChannels; ++c) {
+				t += (block.Channels[firstChannel + c][i] - mean[c]) * axis[c];
+			}
+			minT = std::fmin(minT, t);
+			maxT = std::fmax(maxT, t);
+		}
+
+		for (uint32 c = 0; c < numChannels; ++c) {
+			e0[c] = Clamp255(mean[c] + axis[c] * maxT / lengthSquared);
+			e1[c] = Clamp255(mean[c] + axis[c] * minT / lengthSquared);
+		}
+	}
+
+	// Least-squares endpoints for fixed indices. 'weights' maps each index to its position between the first (0) and second (1) endpoint.
+	bool SolveEndpoints(const BlockTexels& block, uint32 firstChannel, uint32 numChannels, const uint8* indices, const float* weights, float* e0, float* e1) {
+		float aa = 0.f, ab = 0.f, bb = 0.f;
+		float av[4] = {}, bv[4] = {};
+		for (uint32 i = 0; i < 16; ++i) {
+			float b = weights[indices[i]];
+			float a = 1.f - b;
+			aa += a * a;
+			ab += a * b;
+			bb += b * b;
+			for (uint32 c = 0; c < numChannels; ++c) {
+				float v = block.Channels[firstChannel + c][i];
+				av[c] += a * v;
+				bv[c] += b * v;
+			}
+		}
+
+		float determinant = aa * bb - ab * ab;
+		if (std::abs(determinant) < 1e-6f) {
+			return false;
+		}
+
+		float invDeterminant = 1.f / determinant;
+		for (uint32 c = 0; c < numChannels; ++c) {
+			e0[c] = Clamp255((av[c] * bb - bv[c] * ab) * invDeterminant);
+			e1[c] = Clamp255((bv[c] * aa - av[c] * ab) * invDeterminant);
+		}
+		return true;
+	}
+
+	uint32 GetNumRefinements(EBlockCompressionQuality quality) {
+		return (quality == EBlockCompressionQualityHigh) ? 2 : (quality == EBlockCompressionQualityNormal) ? 1 : 0;
+	}
+
+	void WriteLittleEndian(uint8* out, uint64 value, uint32 numBytes) {
+		for (uint32 i = 0; i < numBytes; ++i) {
+			out[i] = (uint8)(value >> (8 * i));
+		}
+	}
+
+	uint64 ReadLittleEndian(const uint8* in, uint32 numBytes) {
+		uint64 value = 0;
+		for (uint32 i = 0; i < numBytes; ++i) {
+			value |= (uint64)in[i] << (8 * i);
+		}
+		return value;
+	}
+
+
+	// BC1 color block, also used by BC3.
+
+	uint16 QuantizeTo565(const float* color) {
+		uint32 r = (uint32)std::lround(Clamp255(color[0]) * 31.f / 255.f);
+		uint32 g = (uint32)std::lround(Clamp255(color[1]) * 63.f / 255.f);
+		uint32 b = (uint32)std::lround(Clamp255(color[2]) * 31.f / 255.f);
+		return (uint16)((r << 11) | (g << 5) | b);
+	}
+
+	void Expand565(uint16 color, uint32* out) {
+		uint32 r = color >> 11;
+		uint32 g = (color >> 5) & 63;
+		uint32 b = color & 31;
+		out[0] = (r << 3) | (r >> 2);
+		out[1] = (g << 2) | (g >> 4);
+		out[2] = (b << 3) | (b >> 2);
+	}
+
+	float EvaluateColorEndpoints(const BlockTexels& block, uint16 c0, uint16 c1, uint8* indices) {
+		uint32 e0[3], e1[3];
+		Expand565(c0, e0);
+		Expand565(c1, e1);
+
+		float palette[4][4];
+		for (uint32 c = 0; c < 3; ++c) {
+			palette[0][c] = (float)e0[c];
+			palette[1][c] = (float)e1[c];
+			palette[2][c] = (2.f * e0[c] + e1[c]) / 3.f;
+			palette[3][c] = (e0[c] + 2.f * e1[c]) / 3.f;
+		}
+		return SelectIndices(block, 0, 3, palette, 4, indices);
+	}
+
+	void EncodeColorBlock(const BlockTexels& block, EBlockCompressionQuality quality, uint8* out) {
+		float e0[4], e1[4];
+		ComputeEndpoints(block, 0, 3, quality, e0, e1);
+
+		uint16 c0 = QuantizeTo565(e0);
+		uint16 c1 = QuantizeTo565(e1);
+		uint8 indices[16];
+		float error = EvaluateColorEndpoints(block, c0, c1, indices);
+
+		for (uint32 i = 0; i < GetNumRefinements(quality); ++i) {
+			if (not SolveEndpoints(block, 0, 3, indices, ColorWeights, e0, e1)) {
+				break;
+			}
+
+			uint16 n0 = QuantizeTo565(e0);
+			uint16 n1 = QuantizeTo565(e1);
+			uint8 newIndices[16];
+			float newError = EvaluateColorEndpoints(block, n0, n1, newIndices);
+			if (newError >= error) {
+				break;
+			}
+
+			c0 = n0;
+			c1 = n1;
+			memcpy(indices, newIndices, sizeof(indices));
+			error = newError;
+		}
+
+		// The four-color palette requires c0 > c1. Swapping the endpoints swaps indices 0 and 1, and 2 and 3.
+		// With equal endpoints, the block would be decoded with the three-color palette, whose index 3 is transparent black. Index 0 is safe.
+		if (c0 < c1) {
+			std::swap(c0, c1);
+			for (uint8& index : indices) {
+				index ^= 1;
+			}
+		}
+		else if (c0 == c1) {
+			memset(indices, 0, sizeof(indices));
+		}
+
+		uint64 bits = 0;
+		for (uint32 i = 0; i < 16; ++i) {
+			bits |= (uint64)indices[i] << (2 * i);
+		}
+
+		WriteLittleEndian(out, c0, 2);
+		WriteLittleEndian(out + 2, c1, 2);
+		WriteLittleEndian(out + 4, bits, 4);
+	}
+
+
+	// BC4 block, also used for the alpha of BC3 and both channels of BC5.
+
+	void GetSingleChannelPalette(uint32 r0, uint32 r1, float (*palette)[4]) {
+		palette[0][0] = (float)r0;
+		palette[1][0] = (float)r1;
+		if (r0 > r1) {
+			for (uint32 i = 2; i < 8; ++i) {
+				palette[i][0] = ((8 - i) * r0 + (i - 1) * r1) / 7.f;
+			}
+		}
+		else {
+			for (uint32 i = 2; i < 6; ++i) {
+				palette[i][0] = ((6 - i) * r0 + (i - 1) * r1) / 5.f;
+			}
+			palette[6][0] = 0.f;
+			palette[7][0] = 255.f;
+		}
+	}
+
+	float EvaluateSingleChannelEndpoints(const BlockTexels& block, uint32 channel, uint32 r0, uint32 r1, uint8* indices) {
+		float palette[8][4];
+		GetSingleChannelPalette(r0, r1, palette);
+		return SelectIndices(block, channel, 1, palette, 8, indices);
+	}
+
+	void EncodeSingleChannelBlock(const BlockTexels& block, uint32 channel, EBlockCompressionQuality quality, uint8* out) {
+		const float* values = block.Channels[channel];
+
+		float minimum = values[0], maximum = values[0];
+		for (uint32 i = 1; i < 16; ++i) {
+			minimum = std::fmin(minimum, values[i]);
+			maximum = std::fmax(maximum, values[i]);
+		}
+
+		// Eight-step mode, which requires r0 > r1. Equal endpoints select the six-step mode, where index 0 is still r0.
+		uint32 r0 = (uint32)std::lround(maximum);
+		uint32 r1 = (uint32)std::lround(minimum);
+		uint8 indices[16] = {};
+		float error = EvaluateSingleChannelEndpoints(block, channel, r0, r1, indices);
+
+		if (r0 > r1) {
+			for (uint32 i = 0; i < GetNumRefinements(quality); ++i) {
+				float e0, e1;
+				if (not SolveEndpoints(block, channel, 1, indices, SingleChannelWeights, &e0, &e1)) {
+					break;
+				}
+
+				uint32 n0 = (uint32)std::lround(e0);
+				uint32 n1 = (uint32)std::lround(e1);
+				if (n0 <= n1) {
+					break;
+				}
+
+				uint8 newIndices[16];
+				float newError = EvaluateSingleChannelEndpoints(block, channel, n0, n1, newIndices);
+				if (newError >= error) {
+					break;
+				}
+
+				r0 = n0;
+				r1 = n1;
+				memcpy(indices, newIndices, sizeof(indices));
+				error = newError;
+			}
+		}
+
+		// The six-step mode has explicit 0 and 255 entries, so the interpolated range only needs to cover the values in between.
+		// This helps blocks with a few fully transparent or opaque texels.
+		if (quality == EBlockCompressionQualityHigh) {
+			float innerMinimum = 255.f, innerMaximum = 0.f;
+			for (uint32 i = 0; i < 16; ++i) {
+				if (values[i] > 0.f and values[i] < 255.f) {
+					innerMinimum = std::fmin(innerMinimum, values[i]);
+					innerMaximum = std::fmax(innerMaximum, values[i]);
+				}
+			}
+
+			if (innerMinimum <= innerMaximum) {
+				uint32 n0 = (uint32)std::lround(innerMinimum);
+				uint32 n1 = (uint32)std::lround(innerMaximum);
+				uint8 newIndices[16];
+				float newError = EvaluateSingleChannelEndpoints(block, channel, n0, n1, newIndices);
+				if (newError < error) {
+					r0 = n0;
+					r1 = n1;
+					memcpy(indices, newIndices, sizeof(indices));
+					error = newError;
+				}
+			}
+		}
+
+		uint64 bits = 0;
+		for (uint32 i = 0; i < 16; ++i) {
+			bits |= (uint64)indices[i] << (3 * i);
+		}
+
+		out[0] = (uint8)r0;
+		out[1] = (uint8)r1;
+		WriteLittleEndian(out + 2, bits, 6);
+	}
+
+
+	// BC7 mode 6.
+
+	struct BitWriter {
+		uint8* Data;
+		uint32 Position = 0;
+
+		void Write(uint32 value, uint32 numBits) {
+			for (uint32 i = 0; i < numBits; ++i, ++Position) {
+				Data[Position / 8] |= (uint8)(((value >> i) & 1) << (Position % 8));
+			}
+		}
+	};
+
+	struct BitReader {
+		const uint8* Data;
+		uint32 Position = 0;
+
+		uint32 Read(uint32 numBits) {
+			uint32 value = 0;
+			for (uint32 i = 0; i < numBits; ++i, ++Position) {
+				value |= (uint32)((Data[Position / 8] >> (Position % 8)) & 1) << i;
+			}
+			return value;
+		}
+	};
+
+	// 8-bit endpoint values, whose lowest bit is the parity bit shared by all channels of the endpoint.
+	void QuantizeBC7Endpoint(const float* endpoint, uint32 parity, uint8* out) {
+		for (uint32 c = 0; c < 4; ++c) {
+			int32 q = std::clamp((int32)std::lround((endpoint[c] - parity) * 0.5f), 0, 127);
+			out[c] = (uint8)((q << 1) | parity);
+		}
+	}
+
+	float EvaluateBC7Endpoints(const BlockTexels& block, const uint8* e0, const uint8* e1, uint8* indices) {
+		float palette[16][4];
+		for (uint32 k = 0; k < 16; ++k) {
+			uint32 w = BC7Weights[k];
+			for (uint32 c = 0; c < 4; ++c) {
+				palette[k][c] = (float)(((64 - w) * e0[c] + w * e1[c] + 32) >> 6);
+			}
+		}
+		return SelectIndices(block, 0, 4, palette, 16, indices);
+	}
+
+	// Tries the parity bit combinations and keeps the best. Below high quality, only equal parity bits are tried.
+	float QuantizeBC7Endpoints(const BlockTexels& block, const float* e0, const float* e1, EBlockCompressionQuality quality, uint8* outE0, uint8* outE1, uint8* outIndices) {
+		float bestError = FLT_MAX;
+		for (uint32 p = 0; p < 4; ++p) {
+			uint32 p0 = p & 1;
+			uint32 p1 = p >> 1;
+			if (p0 != p1 and quality != EBlockCompressionQualityHigh) {
+				continue;
+			}
+
+			uint8 q0[4], q1[4], indices[16];
+			QuantizeBC7Endpoint(e0, p0, q0);
+			QuantizeBC7Endpoint(e1, p1, q1);
+			float error = EvaluateBC7Endpoints(block, q0, q1, indices);
+			if (error < bestError) {
+				bestError = error;
+				memcpy(outE0, q0, 4);
+				memcpy(outE1, q1, 4);
+				memcpy(outIndices, indices, 16);
+			}
+		}
+		return bestError;
+	}
+
+	void EncodeBC7Block(const BlockTexels& block, EBlockCompressionQuality quality, uint8* out) {
+		static float weights[16];
+		static bool weightsInitialized = [] {
+			for (uint32 k = 0; k < 16; ++k) {
+				weights[k] = BC7Weights[k] / 64.f;
+			}
+			return true;
+		}();
+		(void)weightsInitialized;
+
+		float e0[4], e1[4];
+		ComputeEndpoints(block, 0, 4, quality, e0, e1);
+
+		uint8 q0[4], q1[4], indices[16];
+		float error = QuantizeBC7Endpoints(block, e0, e1, quality, q0, q1, indices);
+
+		for (uint32 i = 0; i < GetNumRefinements(quality); ++i) {
+			if (not SolveEndpoints(block, 0, 4, indices, weights, e0, e1)) {
+				break;
+			}
+
+			uint8 n0[4], n1[4], newIndices[16];
+			float newError = QuantizeBC7Endpoints(block, e0, e1, quality, n0, n1, newIndices);
+			if (newError >= error) {
+				break;
+			}
+
+			memcpy(q0, n0, 4);
+			memcpy(q1, n1, 4);
+			memcpy(indices, newIndices, 16);
+			error = newError;
+		}
+
+		// The index of the first texel is stored with 3 bits, so its top bit must be 0. Swapping the endpoints mirrors all indices.
+		if (indices[0] >= 8) {
+			for (uint32 c = 0; c < 4; ++c) {
+				std::swap(q0[c], q1[c]);
+			}
+			for (uint8& index : indices) {
+				index = 15 - index;
+			}
+		}
+
+		memset(out, 0, 16);
+		BitWriter writer = { out };
+		writer.Write(1 << 6, 7);
+		for (uint32 c = 0; c < 4; ++c) {
+			writer.Write(q0[c] >> 1, 7);
+			writer.Write(q1[c] >> 1, 7);
+		}
+		writer.Write(q0[0] & 1, 1);
+		writer.Write(q1[0] & 1, 1);
+		writer.Write(indices[0], 3);
+		for (uint32 i = 1; i < 16; ++i) {
+			writer.Write(indices[i], 4);
+		}
+	}
+
+
+	// Decoding, for the benchmark and for validation.
+
+	void DecodeColorBlock(const uint8* in, uint8 (*texels)[4]) {
+		uint16 c0 = (uint16)ReadLittleEndian(in, 2);
+		uint16 c1 = (uint16)ReadLittleEndian(in + 2, 2);
+		uint32 bits = (uint32)ReadLittleEndian(in + 4, 4);
+
+		uint32 palette[4][4];
+		Expand565(c0, palette[0]);
+		Expand565(c1, palette[1]);
+		palette[0][3] = palette[1][3] = palette[2][3] = palette[3][3] = 255;
+		for (uint32 c = 0; c < 3; ++c) {
+			if (c0 > c1) {
+				palette[2][c] = (2 * palette[0][c] + palette[1][c] + 1) / 3;
+				palette[3][c] = (palette[0][c] + 2 * palette[1][c] + 1) / 3;
+			}
+			else {
+				palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+				palette[3][c] = 0;
+			}
+		}
+		if (c0 <= c1) {
+			palette[3][3] = 0;
+		}
+
+		for (uint32 i = 0; i < 16; ++i) {
+			uint32 index = (bits >> (2 * i)) & 3;
+			for (uint32 c = 0; c < 4; ++c) {
+				texels[i][c] = (uint8)palette[index][c];
+			}
+		}
+	}
+
+	void DecodeSingleChannelBlock(const uint8* in, uint8 (*texels)[4], uint32 channel) {
+		float palette[8][4];
+		GetSingleChannelPalette(in[0], in[1], palette);
+		uint64 bits = ReadLittleEndian(in + 2, 6);
+		for (uint32 i = 0; i < 16; ++i) {
+			texels[i][channel] = (uint8)(palette[(bits >> (3 * i)) & 7][0] + 0.5f);
+		}
+	}
+
+	void DecodeBC7Block(const uint8* in, uint8 (*texels)[4]) {
+		BitReader reader = { in };
+		if (reader.Read(7) != (1 << 6)) {
+			// Not mode 6. CompressBlocks never writes these.
+			for (uint32 i = 0; i < 16; ++i) {
+				texels[i][0] = 255; texels[i][1] = 0; texels[i][2] = 255; texels[i][3] = 255;
+			}
+			return;
+		}
+
+		uint32 e0[4], e1[4];
+		for (uint32 c = 0; c < 4; ++c) {
+			e0[c] = reader.Read(7) << 1;
+			e1[c] = reader.Read(7) << 1;
+		}
+		uint32 p0 = reader.Read(1);
+		uint32 p1 = reader.Read(1);
+		for (uint32 c = 0; c < 4; ++c) {
+			e0[c] |= p0;
+			e1[c] |= p1;
+		}
+
+		for (uint32 i = 0; i < 16; ++i) {
+			uint32 w = BC7Weights[reader.Read(i == 0 ? 3 : 4)];
+			for (uint32 c = 0; c < 4; ++c) {
+				texels[i][c] = (uint8)(((64 - w) * e0[c] + w * e1[c] + 32) >> 6);
+			}
+		}
+	}
+
+	uint32 GetNumSourceChannels(EBlockFormat format) {
+		switch (format) {
+			case EBlockFormatBC4: return 1;
+			case EBlockFormatBC5: return 2;
+			default: return 4;
+		}
+	}
+
+	void EncodeBlock(EBlockFormat format, const BlockTexels& block, EBlockCompressionQuality quality, uint8* out) {
+		switch (format) {
+			case EBlockFormatBC1:
+				EncodeColorBlock(block, quality, out);
+				break;
+			case EBlockFormatBC3:
+				EncodeSingleChannelBlock(block, 3, quality, out);
+				EncodeColorBlock(block, quality, out + 8);
+				break;
+			case EBlockFormatBC4:
+				EncodeSingleChannelBlock(block, 0, quality, out);
+				break;
+			case EBlockFormatBC5:
+				EncodeSingleChannelBlock(block, 0, quality, out);
+				EncodeSingleChannelBlock(block, 1, quality, out + 8);
+				break;
+			case EBlockFormatBC7:
+				EncodeBC7Block(block, quality, out);
+				break;
+		}
+	}
+
+	void DecodeBlock(EBlockFormat format, const uint8* in, uint8 (*texels)[4]) {
+		switch (format) {
+			case EBlockFormatBC1:
+				DecodeColorBlock(in, texels);
+				break;
+			case EBlockFormatBC3:
+				DecodeColorBlock(in + 8, texels);
+				DecodeSingleChannelBlock(in, texels, 3);
+				break;
+			case EBlockFormatBC4:
+				DecodeSingleChannelBlock(in, texels, 0);
+				break;
+			case EBlockFormatBC5:
+				DecodeSingleChannelBlock(in, texels, 0);
+				DecodeSingleChannelBlock(in + 8, texels, 1);
+				break;
+			case EBlockFormatBC7:
+				DecodeBC7Block(in, texels);
+				break;
+		}
+	}
+
+	// Runs 'work' for bands of block rows, on the job system if the image is large enough.
+	template <typename Work>
+	void ForEachBand(uint32 numBlocksX, uint32 numBlocksY, bool parallel, const Work& work) {
+		if (not parallel or numBlocksX * numBlocksY < MinBlocksForParallel) {
+			work(0u, numBlocksY);
+			return;
+		}
+
+		uint32 rowsPerBand = Max(MinBlockRowsPerBand, (numBlocksY + TargetNumBands - 1) / TargetNumBands);
+
+		uint32 numBands = (numBlocksY + rowsPerBand - 1) / rowsPerBand;
+
+		// Not a ThreadJobContext: its wait runs unrelated jobs, which may block on the texture load this is part of.
+		ParallelFor(numBands, [&](uint32 band) {
+			uint32 y = band * rowsPerBand;
+			work(y, Min(y + rowsPerBand, numBlocksY));
+		});
+	}
+}
+
+uint32 GetBlockSize(EBlockFormat format) {
+	return (format == EBlockFormatBC1 or format == EBlockFormatBC4) ? 8 : 16;
+}
+
+void CompressBlocks(EBlockFormat format, const uint8* pixels, uint32 width, uint32 height, uint64 rowPitch, uint32 bytesPerPixel,
+	uint8* blocks, uint64 blockRowPitch, const BlockCompressionSettings& settings) {
+	uint32 numBlocksX = Max((width + 3) / 4, 1u);
+	uint32 numBlocksY = Max((height + 3) / 4, 1u);
+	uint32 blockSize = GetBlockSize(format);
+	uint32 numChannels = GetNumSourceChannels(format);
+	assert(bytesPerPixel >= numChannels);
+
+	ForEachBand(numBlocksX, numBlocksY, settings.Parallel, [&](uint32 firstRow, uint32 endRow) {
+		BlockTexels block;
+		for (uint32 y = firstRow; y < endRow; ++y) {
+			uint8* out = blocks + y * blockRowPitch;
+			for (uint32 x = 0; x < numBlocksX; ++x, out += blockSize) {
+				LoadBlock(pixels, width, height, rowPitch, bytesPerPixel, numChannels, x, y, block);
+				EncodeBlock(format, block, settings.Quality, out);
+			}
+		}
+	});
+}
+
+void DecompressBlocks(EBlockFormat format, const uint8* blocks, uint64 blockRowPitch, uint32 width, uint32 height,
+	uint8* pixels, uint64 rowPitch, uint32 bytesPerPixel) {
+	uint32 numBlocksX = Max((width + 3) / 4, 1u);
+	uint32 numBlocksY = Max((height + 3) / 4, 1u);
+	uint32 blockSize = GetBlockSize(format);
+	uint32 numChannels = GetNumSourceChannels(format);
+	assert(bytesPerPixel >= numChannels);
+
+	for (uint32 by = 0; by < numBlocksY; ++by) {
+		for (uint32 bx = 0; bx < numBlocksX; ++bx) {
+			uint8 texels[16][4] = {};
+			DecodeBlock(format, blocks + by * blockRowPitch + bx * blockSize, texels);
+
+			for (uint32 y = 0; y < 4 and by * 4 + y < height; ++y) {
+				for (uint32 x = 0; x < 4 and bx * 4 + x < width; ++x) {
+					uint8* texel = pixels + (by * 4 + y) * rowPitch + (uint64)(bx * 4 + x) * bytesPerPixel;
+					memcpy(texel, texels[y * 4 + x], numChannels);
+				}
+			}
+		}
+	}
+}
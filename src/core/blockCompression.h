@@ -0,0 +1,43 @@
+#pragma once
+
+#include "../pch.h"
+
+// Block compression of 8-bit images into BC1, BC3, BC4, BC5 and BC7. Independent of DirectXTex and D3D.
+//
+// The BC1 to BC5 encoders fit the endpoints along the principal axis of each block and refine them with a least-squares solve for the
+// chosen indices. The BC7 encoder only writes mode 6 (one subset, RGBA endpoints, 16 interpolation steps), which covers most content well
+// and is an order of magnitude faster than a search over all modes. Rows of blocks run in parallel on the job system.
+
+enum EBlockFormat {
+	EBlockFormatBC1, // RGB, 4 bits per texel. Always opaque.
+	EBlockFormatBC3, // RGBA, 8 bits per texel. BC1 color with a BC4 alpha block.
+	EBlockFormatBC4, // R, 4 bits per texel.
+	EBlockFormatBC5, // RG, 8 bits per texel. Two BC4 blocks.
+	EBlockFormatBC7, // RGBA, 8 bits per texel.
+
+	EBlockFormatCount,
+};
+
+enum EBlockCompressionQuality {
+	EBlockCompressionQualityFast,   // Bounding box endpoints, no refinement.
+	EBlockCompressionQualityNormal, // Principal axis endpoints and one refinement step.
+	EBlockCompressionQualityHigh,   // Two refinement steps. BC4 also tries its six-step mode, and BC7 all parity bit combinations.
+
+	EBlockCompressionQualityCount,
+};
+
+struct BlockCompressionSettings {
+	EBlockCompressionQuality Quality = EBlockCompressionQualityNormal;
+	bool Parallel = true;
+};
+
+uint32 GetBlockSize(EBlockFormat format); // 8 or 16 bytes per 4x4 block.
+
+// Texels are read as 8-bit channels from the start of each pixel: RGBA for BC1, BC3 and BC7, R for BC4 and RG for BC5. 'bytesPerPixel'
+// must cover these channels. Edge blocks of images whose size is not a multiple of 4 repeat the last row and column.
+void CompressBlocks(EBlockFormat format, const uint8* pixels, uint32 width, uint32 height, uint64 rowPitch, uint32 bytesPerPixel,
+	uint8* blocks, uint64 blockRowPitch, const BlockCompressionSettings& settings);
+
+// Writes the same channels that CompressBlocks reads. Only decodes the BC7 blocks CompressBlocks writes, i.e. mode 6.
+void DecompressBlocks(EBlockFormat format, const uint8* blocks, uint64 blockRowPitch, uint32 width, uint32 height,
+	uint8* pixels, uint64 rowPitch, uint32 bytesPerPixel);
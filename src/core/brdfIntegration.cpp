@@ -0,0 +1,145 @@
+#include "brdfIntegration.h"
+#include "ddsLayout.h"
+#include "threading.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+	constexpr double Pi = 3.14159265358979323846;
+
+	constexpr uint32 MinColumnsPerBand = 2;
+	constexpr uint32 TargetNumBands = 32;
+
+	// Runs 'work' for bands of columns, on the job system if 'parallel' is set. Each column has its own roughness, so a band shares its
+	// samples between all its texels.
+	template <typename Work>
+	void ForEachBand(uint32 numColumns, bool parallel, const Work& work) {
+		if (not parallel) {
+			work(0u, numColumns);
+			return;
+		}
+
+		uint32 columnsPerBand = Max(MinColumnsPerBand, (numColumns + TargetNumBands - 1) / TargetNumBands);
+
+		uint32 numBands = (numColumns + columnsPerBand - 1) / columnsPerBand;
+		ParallelFor(numBands, [&](uint32 band) {
+			uint32 x = band * columnsPerBand;
+			work(x, Min(x + columnsPerBand, numColumns));
+		});
+	}
+
+	// Same point set as Hammersley in random.hlsli.
+	double RadicalInverse(uint32 bits) {
+		bits = (bits << 16u) | (bits >> 16u);
+		bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+		bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+		bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+		bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+		return bits * 2.3283064365386963e-10;
+	}
+
+	// Smith-Schlick with k = roughness^2 / 2, as GeometrySmith in brdf.hlsli.
+	double GeometrySmith(double NdotL, double NdotV, double roughness) {
+		double k = roughness * roughness * 0.5;
+		return (NdotV / (NdotV * (1.0 - k) + k)) * (NdotL / (NdotL * (1.0 - k) + k));
+	}
+
+	double Pow5(double x) {
+		double x2 = x * x;
+		return x2 * x2 * x;
+	}
+
+	struct SplitSum {
+		double Scale;
+		double Bias;
+	};
+
+	// 'cosThetaH' and 'sinThetaH' are the GGX importance samples for one roughness, 'cosPhi' the azimuths they share with every roughness.
+	// The half vectors are the ones ImportanceSampleGGX generates from the same Hammersley points. V lies in the xz-plane, so the y
+	// component of the half vectors never matters.
+	SplitSum IntegrateTexel(double NdotV, double roughness, const double* cosThetaH, const double* sinThetaH, const double* cosPhi, uint32 numSamples) {
+		double vx = std::sqrt(1.0 - NdotV * NdotV);
+		double vz = NdotV;
+
+		double scale = 0.0;
+		double bias = 0.0;
+		for (uint32 i = 0; i < numSamples; ++i) {
+			double hx = cosPhi[i] * sinThetaH[i];
+			double hz = cosThetaH[i];
+
+			double VdotH = vx * hx + vz * hz;
+			double NdotL = 2.0 * VdotH * hz - vz;
+			if (NdotL > 0.0 and VdotH > 0.0) {
+				double G = GeometrySmith(NdotL, NdotV, roughness);
+				double visibility = G * VdotH / (hz * NdotV);
+				double Fc = Pow5(1.0 - VdotH);
+
+				scale += (1.0 - Fc) * visibility;
+				bias += Fc * visibility;
+			}
+		}
+		return { scale / numSamples, bias / numSamples };
+	}
+
+	uint16 ToUnorm16(float value) {
+		return (uint16)std::lround(std::clamp(value, 0.f, 1.f) * 65535.f);
+	}
+}
+
+void IntegrateBrdfLut(uint32 size, uint32 numSamples, float* outTexels, bool parallel) {
+	std::vector<double> cosPhi(numSamples), xi(numSamples);
+	for (uint32 i = 0; i < numSamples; ++i) {
+		cosPhi[i] = std::cos(2.0 * Pi * i / numSamples);
+		xi[i] = RadicalInverse(i);
+	}
+
+	ForEachBand(size, parallel, [&](uint32 firstColumn, uint32 endColumn) {
+		std::vector<double> cosThetaH(numSamples), sinThetaH(numSamples);
+
+		for (uint32 x = firstColumn; x < endColumn; ++x) {
+			double roughness = (x + 0.5) / size;
+			double alpha = roughness * roughness;
+			double a2 = alpha * alpha;
+			for (uint32 i = 0; i < numSamples; ++i) {
+				cosThetaH[i] = std::sqrt((1.0 - xi[i]) / (1.0 + (a2 - 1.0) * xi[i]));
+				sinThetaH[i] = std::sqrt(1.0 - cosThetaH[i] * cosThetaH[i]);
+			}
+
+			// Midpoint rule over the rows for the average albedo.
+			double averageAlbedo = 0.0;
+			for (uint32 y = 0; y < size; ++y) {
+				double NdotV = (y + 0.5) / size;
+				SplitSum texel = IntegrateTexel(NdotV, roughness, cosThetaH.data(), sinThetaH.data(), cosPhi.data(), numSamples);
+
+				float* out = outTexels + ((uint64)y * size + x) * 4;
+				out[0] = (float)texel.Scale;
+				out[1] = (float)texel.Bias;
+				out[3] = 1.f;
+
+				averageAlbedo += (texel.Scale + texel.Bias) * NdotV;
+			}
+			averageAlbedo *= 2.0 / size;
+
+			for (uint32 y = 0; y < size; ++y) {
+				outTexels[((uint64)y * size + x) * 4 + 2] = (float)averageAlbedo;
+			}
+		}
+	});
+}
+
+void QuantizeBrdfLut(const float* texels, uint32 size, uint16* outTexels) {
+	for (uint64 i = 0; i < (uint64)size * size * 4; ++i) {
+		outTexels[i] = ToUnorm16(texels[i]);
+	}
+}
+
+bool WriteBrdfLutFile(const fs::path& filename) {
+	std::vector<float> texels((size_t)BRDF_LUT_SIZE * BRDF_LUT_SIZE * 4);
+	IntegrateBrdfLut(BRDF_LUT_SIZE, BRDF_LUT_NUM_SAMPLES, texels.data());
+
+	std::vector<uint16> quantized(texels.size());
+	QuantizeBrdfLut(texels.data(), BRDF_LUT_SIZE, quantized.data());
+
+	return WriteDdsFile(filename, BRDF_LUT_FORMAT, BRDF_LUT_SIZE, BRDF_LUT_SIZE, quantized.data());
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "../pch.h"
+
+// CPU integration of the BRDF lookup table for the split-sum approximation of specular image-based lighting [Karis 2013]. Independent of
+// D3D. The table only depends on its resolution, so it ships precomputed as BRDF_LUT_FILE and the renderer doesn't integrate anything at
+// startup. Run WriteBrdfLutFile after changing anything here.
+//
+// Texel (x, y) belongs to roughness (x + 0.5) / size and NdotV (y + 0.5) / size, which is how SpecularIBL samples it. The channels are:
+//   R, G: Scale and bias of F0, as written by integrate_brdf_cs. R + G is the directional albedo E(NdotV) of a white GGX surface.
+//   B:    Average albedo over all directions, E_avg = 2 * integral of E(mu) mu dmu. It only depends on the roughness. With E, this gives the
+//         multiple-scattering lobe (1 - E(NdotV)) (1 - E(NdotL)) / (pi (1 - E_avg)), which restores the energy the single-scattering
+//         BRDF loses at high roughness [Kulla and Conty 2017].
+//   A:    1.
+//
+// Every texel sums the same Hammersley points in the same order in double precision, so the table is identical bit for bit no matter how
+// many threads integrate it.
+
+#define BRDF_LUT_SIZE 128
+#define BRDF_LUT_NUM_SAMPLES 4096
+#define BRDF_LUT_FORMAT 11 // DXGI_FORMAT_R16G16B16A16_UNORM.
+#define BRDF_LUT_FILE "assets/textures/brdf_lut.dds"
+
+// 'outTexels' receives size * size RGBA texels.
+void IntegrateBrdfLut(uint32 size, uint32 numSamples, float* outTexels, bool parallel = true);
+
+// Converts the table to BRDF_LUT_FORMAT. 'outTexels' receives size * size * 4 values.
+void QuantizeBrdfLut(const float* texels, uint32 size, uint16* outTexels);
+
+// Integrates the table with the default settings and writes it to 'filename' in BRDF_LUT_FORMAT.
+bool WriteBrdfLutFile(const fs::path& filename = BRDF_LUT_FILE);
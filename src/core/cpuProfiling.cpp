@@ -0,0 +1,363 @@
+#include "cpuProfiling.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+
+static_assert((MAX_NUM_CPU_PROFILE_EVENTS_PER_THREAD & (MAX_NUM_CPU_PROFILE_EVENTS_PER_THREAD - 1)) == 0);
+
+namespace {
+	struct ThreadBuffer {
+		// Atomic, so that the collector may read entries which are being overwritten. It drops them afterwards.
+		struct Entry {
+			std::atomic<const char*> Name;
+			std::atomic<uint64> BeginClock;
+			std::atomic<uint64> EndClock;
+		};
+
+		std::atomic<uint64> WriteIndex = 0;
+		uint64 ReadIndex = 0; // Collector only.
+		uint32 ThreadIndex;
+		uint32 ThreadId;
+		std::atomic<const char*> Name = nullptr;
+
+		Entry Entries[MAX_NUM_CPU_PROFILE_EVENTS_PER_THREAD];
+	};
+
+	// Buffers are never freed, so that threads which exit don't take their last events with them.
+	std::atomic<ThreadBuffer*> threadBuffers[MAX_NUM_CPU_PROFILE_THREADS];
+	std::atomic<uint32> numThreads = 0;
+	thread_local ThreadBuffer* threadBuffer = nullptr;
+
+#ifdef _WIN32
+	uint64 QueryQpc() {
+		LARGE_INTEGER qpc;
+		QueryPerformanceCounter(&qpc);
+		return qpc.QuadPart;
+	}
+
+	uint64 QueryQpcFrequency() {
+		LARGE_INTEGER frequency;
+		QueryPerformanceFrequency(&frequency);
+		return frequency.QuadPart;
+	}
+
+	uint32 QueryThreadId() {
+		return GetCurrentThreadId();
+	}
+#else
+	uint64 QueryQpc() {
+		return (uint64)std::chrono::steady_clock::now().time_since_epoch().count();
+	}
+
+	uint64 QueryQpcFrequency() {
+		return std::chrono::steady_clock::period::den / std::chrono::steady_clock::period::num;
+	}
+
+	uint32 QueryThreadId() {
+		return (uint32)std::hash<std::thread::id>()(std::this_thread::get_id());
+	}
+#endif
+
+	const uint64 startClock = CpuProfileClock();
+	const uint64 startQpc = QueryQpc();
+	const uint64 qpcFrequency = QueryQpcFrequency();
+	double clocksPerMicrosecond = 0.0; // Main thread only.
+
+	// Against the start, so the estimate gets better the longer the application runs.
+	void UpdateCalibration() {
+		uint64 clock, qpc;
+		do {
+			clock = CpuProfileClock();
+			qpc = QueryQpc();
+			if (qpc - startQpc < qpcFrequency / 100) {
+				std::this_thread::yield();
+			}
+		} while (qpc - startQpc < qpcFrequency / 100);
+
+		clocksPerMicrosecond = (double)(clock - startClock) / ((double)(qpc - startQpc) * 1e6 / qpcFrequency);
+	}
+
+	ThreadBuffer* GetThreadBuffer() {
+		if (not threadBuffer and numThreads.load(std::memory_order_relaxed) < MAX_NUM_CPU_PROFILE_THREADS) {
+			uint32 index = numThreads.fetch_add(1);
+			if (index < MAX_NUM_CPU_PROFILE_THREADS) {
+				threadBuffer = new ThreadBuffer;
+				threadBuffer->ThreadIndex = index;
+				threadBuffer->ThreadId = QueryThreadId();
+				threadBuffers[index].store(threadBuffer, std::memory_order_release);
+			}
+		}
+		return threadBuffer;
+	}
+
+	CpuProfileFrame frames[MAX_NUM_CPU_PROFILE_FRAMES];
+	uint32 frameWriteIndex = 0;
+	uint32 numCollectedFrames = 0;
+	uint64 lastFrameMarkerClock = startClock;
+
+	// Events of one thread, in the order they ended. Sorted by begin, the open scopes form a stack.
+	void ComputeDepths(CpuProfileEvent* events, uint64 numEvents) {
+		std::sort(events, events + numEvents, [](const CpuProfileEvent& a, const CpuProfileEvent& b) {
+			return (a.BeginClock != b.BeginClock) ? (a.BeginClock < b.BeginClock) : (a.EndClock > b.EndClock);
+		});
+
+		uint64 openEnds[256];
+		uint32 numOpen = 0;
+		for (uint64 i = 0; i < numEvents; i++) {
+			CpuProfileEvent& e = events[i];
+			while (numOpen > 0 and openEnds[numOpen - 1] <= e.BeginClock) {
+				numOpen--;
+			}
+			e.Depth = numOpen;
+			if (numOpen < arraysize(openEnds)) {
+				openEnds[numOpen++] = e.EndClock;
+			}
+		}
+	}
+
+	void CollectStatistics(CpuProfileFrame& frame) {
+		std::unordered_map<std::string_view, uint32> indices;
+		for (const CpuProfileEvent& e : frame.Events) {
+			auto [it, inserted] = indices.try_emplace(e.Name, (uint32)frame.Statistics.size());
+			if (inserted) {
+				frame.Statistics.push_back({ .Name = e.Name, .Count = 0, .TotalMilliseconds = 0.0, .MaxMilliseconds = 0.0 });
+			}
+
+			double milliseconds = (e.EndClock - e.BeginClock) / clocksPerMicrosecond * 1e-3;
+			CpuProfileStatistic& statistic = frame.Statistics[it->second];
+			statistic.Count++;
+			statistic.TotalMilliseconds += milliseconds;
+			statistic.MaxMilliseconds = Max(statistic.MaxMilliseconds, milliseconds);
+		}
+
+		std::sort(frame.Statistics.begin(), frame.Statistics.end(), [](const CpuProfileStatistic& a, const CpuProfileStatistic& b) {
+			return a.TotalMilliseconds > b.TotalMilliseconds;
+		});
+	}
+
+	ProfileStatistics cpuStatistics("CPU");
+	std::vector<ProfileStatisticsEvent> statisticsEvents;
+	std::vector<const CpuProfileEvent*> openEvents;
+
+	// Threads of the same name share a track. Their events don't interleave, so the track's blocks still nest.
+	void AddToStatistics(const CpuProfileFrame& frame) {
+		auto toMilliseconds = [&](uint64 clock) {
+			return (double)(int64)(clock - frame.BeginClock) / clocksPerMicrosecond * 1e-3;
+		};
+
+		const char* track = nullptr;
+		auto closeEvents = [&](uint32 depth) {
+			while (openEvents.size() > depth) {
+				const CpuProfileEvent* e = openEvents.back();
+				statisticsEvents.push_back({ EProfileStatisticsEventEnd, track, e->Name, toMilliseconds(e->EndClock) });
+				openEvents.pop_back();
+			}
+		};
+
+		statisticsEvents.clear();
+		uint32 threadIndex = UINT32_MAX;
+		for (const CpuProfileEvent& e : frame.Events) {
+			if (e.ThreadIndex != threadIndex) {
+				closeEvents(0);
+				threadIndex = e.ThreadIndex;
+				const char* name = threadBuffers[threadIndex].load(std::memory_order_acquire)->Name.load(std::memory_order_acquire);
+				track = name ? name : "Unnamed thread";
+			}
+
+			closeEvents(e.Depth);
+			statisticsEvents.push_back({ EProfileStatisticsEventBegin, track, e.Name, toMilliseconds(e.BeginClock) });
+			openEvents.push_back(&e);
+		}
+		closeEvents(0);
+
+		cpuStatistics.AddFrame(frame.FrameId, (float)toMilliseconds(frame.EndClock), statisticsEvents.data(), (uint32)statisticsEvents.size());
+	}
+
+	void WriteJsonString(std::ostream& stream, const char* string) {
+		stream << '"';
+		for (const char* c = string; *c; c++) {
+			if (*c == '"' or *c == '\\') {
+				stream << '\\' << *c;
+			}
+			else if ((uint8)*c < 0x20) {
+				char escaped[8];
+				snprintf(escaped, sizeof(escaped), "\\u%04x", (uint32)(uint8)*c);
+				stream << escaped;
+			}
+			else {
+				stream << *c;
+			}
+		}
+		stream << '"';
+	}
+
+	void WriteTraceEvent(std::ostream& stream, const char* name, const char* category, double beginMicroseconds, double durationMicroseconds, uint32 threadId) {
+		char numbers[128];
+		snprintf(numbers, sizeof(numbers), "\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u", beginMicroseconds, durationMicroseconds, threadId);
+
+		stream << ",\n{\"name\":";
+		WriteJsonString(stream, name);
+		stream << ",\"cat\":";
+		WriteJsonString(stream, category);
+		stream << ",\"ph\":\"X\"," << numbers << "}";
+	}
+
+	void WriteThreadName(std::ostream& stream, uint32 threadId, const char* name) {
+		stream << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << threadId << ",\"args\":{\"name\":";
+		WriteJsonString(stream, name);
+		stream << "}}";
+	}
+}
+
+double CpuProfileClockToMicroseconds(uint64 clock) {
+	if (clocksPerMicrosecond == 0.0) {
+		UpdateCalibration();
+	}
+	return (double)(int64)(clock - startClock) / clocksPerMicrosecond;
+}
+
+double QpcToCpuProfileMicroseconds(uint64 qpc) {
+	return (double)(int64)(qpc - startQpc) * 1e6 / qpcFrequency;
+}
+
+void RecordCpuProfileEvent(const char* name, uint64 beginClock, uint64 endClock) {
+	ThreadBuffer* buffer = GetThreadBuffer();
+	if (not buffer) {
+		return;
+	}
+
+	uint64 index = buffer->WriteIndex.load(std::memory_order_relaxed);
+	ThreadBuffer::Entry& entry = buffer->Entries[index & (MAX_NUM_CPU_PROFILE_EVENTS_PER_THREAD - 1)];
+	entry.Name.store(name, std::memory_order_relaxed);
+	entry.BeginClock.store(beginClock, std::memory_order_relaxed);
+	entry.EndClock.store(endClock, std::memory_order_relaxed);
+	buffer->WriteIndex.store(index + 1, std::memory_order_release);
+}
+
+void SetCpuProfileThreadName(const char* name) {
+	if (ThreadBuffer* buffer = GetThreadBuffer()) {
+		buffer->Name.store(name, std::memory_order_release);
+	}
+}
+
+void CpuProfileFrameMarker(uint64 frameId) {
+	uint64 now = CpuProfileClock();
+	UpdateCalibration();
+
+	CpuProfileFrame& frame = frames[frameWriteIndex];
+	frame.FrameId = frameId;
+	frame.BeginClock = lastFrameMarkerClock;
+	frame.EndClock = now;
+	frame.NumLostEvents = 0;
+	frame.Events.clear();
+	frame.Statistics.clear();
+
+	uint32 count = Min(numThreads.load(), (uint32)MAX_NUM_CPU_PROFILE_THREADS);
+	for (uint32 i = 0; i < count; i++) {
+		ThreadBuffer* buffer = threadBuffers[i].load(std::memory_order_acquire);
+		if (not buffer) {
+			continue;
+		}
+
+		uint64 write = buffer->WriteIndex.load(std::memory_order_acquire);
+		uint64 read = buffer->ReadIndex;
+		if (write - read > MAX_NUM_CPU_PROFILE_EVENTS_PER_THREAD) {
+			frame.NumLostEvents += (uint32)(write - read - MAX_NUM_CPU_PROFILE_EVENTS_PER_THREAD);
+			read = write - MAX_NUM_CPU_PROFILE_EVENTS_PER_THREAD;
+		}
+
+		uint64 first = frame.Events.size();
+		for (uint64 j = read; j < write; j++) {
+			const ThreadBuffer::Entry& entry = buffer->Entries[j & (MAX_NUM_CPU_PROFILE_EVENTS_PER_THREAD - 1)];
+			frame.Events.push_back({ entry.Name.load(std::memory_order_relaxed), entry.BeginClock.load(std::memory_order_relaxed),
+				entry.EndClock.load(std::memory_order_relaxed), i, 0 });
+		}
+
+		// The thread keeps recording while we copy. Entries it has overwritten in the meantime are dropped, including the one it may be
+		// writing right now.
+		std::atomic_thread_fence(std::memory_order_acquire);
+		uint64 writeAfterCopy = buffer->WriteIndex.load(std::memory_order_relaxed) + 1;
+		if (writeAfterCopy - read > MAX_NUM_CPU_PROFILE_EVENTS_PER_THREAD) {
+			uint64 numOverwritten = Min(writeAfterCopy - read - MAX_NUM_CPU_PROFILE_EVENTS_PER_THREAD, write - read);
+			frame.Events.erase(frame.Events.begin() + first, frame.Events.begin() + first + numOverwritten);
+			frame.NumLostEvents += (uint32)numOverwritten;
+		}
+		buffer->ReadIndex = write;
+
+		ComputeDepths(frame.Events.data() + first, frame.Events.size() - first);
+	}
+
+	CollectStatistics(frame);
+	AddToStatistics(frame);
+
+	lastFrameMarkerClock = now;
+	frameWriteIndex = (frameWriteIndex + 1) % MAX_NUM_CPU_PROFILE_FRAMES;
+	numCollectedFrames = Min(numCollectedFrames + 1, (uint32)MAX_NUM_CPU_PROFILE_FRAMES);
+}
+
+const CpuProfileFrame* GetCpuProfileFrame(uint32 framesAgo) {
+	if (framesAgo >= numCollectedFrames) {
+		return nullptr;
+	}
+	return &frames[(frameWriteIndex + MAX_NUM_CPU_PROFILE_FRAMES - 1 - framesAgo) % MAX_NUM_CPU_PROFILE_FRAMES];
+}
+
+ProfileStatistics& GetCpuProfileStatistics() {
+	return cpuStatistics;
+}
+
+bool ExportChromeTrace(const fs::path& filename, uint32 numFrames, const std::vector<TraceEvent>& otherEvents) {
+	std::ofstream stream(filename, std::ios::trunc);
+	if (not stream) {
+		return false;
+	}
+
+	UpdateCalibration();
+
+	stream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	stream << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"Application\"}}";
+
+	uint32 count = Min(numThreads.load(), (uint32)MAX_NUM_CPU_PROFILE_THREADS);
+	std::vector<uint32> threadIds(count, 0);
+	for (uint32 i = 0; i < count; i++) {
+		if (ThreadBuffer* buffer = threadBuffers[i].load(std::memory_order_acquire)) {
+			threadIds[i] = buffer->ThreadId;
+			const char* name = buffer->Name.load(std::memory_order_acquire);
+			std::string fallback = "Thread " + std::to_string(buffer->ThreadId);
+			WriteThreadName(stream, buffer->ThreadId, name ? name : fallback.c_str());
+		}
+	}
+
+	for (uint32 f = Min(numFrames, numCollectedFrames); f-- > 0;) {
+		const CpuProfileFrame& frame = *GetCpuProfileFrame(f);
+
+		char marker[128];
+		snprintf(marker, sizeof(marker), ",\n{\"name\":\"Frame %llu\",\"ph\":\"i\",\"s\":\"g\",\"ts\":%.3f,\"pid\":1,\"tid\":0}",
+			(unsigned long long)frame.FrameId, CpuProfileClockToMicroseconds(frame.EndClock));
+		stream << marker;
+
+		for (const CpuProfileEvent& e : frame.Events) {
+			double begin = CpuProfileClockToMicroseconds(e.BeginClock);
+			double end = CpuProfileClockToMicroseconds(e.EndClock);
+			WriteTraceEvent(stream, e.Name, "CPU", begin, end - begin, threadIds[e.ThreadIndex]);
+		}
+	}
+
+	// Every other track shows up as a thread of its own, with ids no real thread has.
+	std::unordered_map<std::string_view, uint32> trackIds;
+	for (const TraceEvent& e : otherEvents) {
+		auto [it, inserted] = trackIds.try_emplace(e.Track, UINT32_MAX - (uint32)trackIds.size());
+		if (inserted) {
+			WriteThreadName(stream, it->second, e.Track);
+		}
+		WriteTraceEvent(stream, e.Name, e.Track, e.BeginMicroseconds, e.DurationMicroseconds, it->second);
+	}
+
+	stream << "\n]}\n";
+	return (bool)stream;
+}
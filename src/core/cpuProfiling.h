@@ -0,0 +1,116 @@
+#pragma once
+
+#include "../pch.h"
+#include "profileStatistics.h"
+
+#include <chrono>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) or defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// CPU side counterpart of DX_PROFILE_BLOCK. Every thread records its scopes into a ring buffer of its own, which only it writes, so
+// recording takes no lock. CpuProfileFrameMarker collects the buffers of all threads once per frame, and ExportChromeTrace writes the last
+// frames as a trace for chrome://tracing or Perfetto, together with events of other timelines like the GPU's.
+//
+// Scopes are timed with the time stamp counter and only written when they end. Their nesting is reconstructed when they are collected.
+// Without one, e.g. on ARM, they are timed with the steady clock.
+// With ENABLE_CPU_PROFILING set to 0, the macros compile to nothing.
+
+#define ENABLE_CPU_PROFILING 0
+
+#define MAX_NUM_CPU_PROFILE_THREADS 64
+#define MAX_NUM_CPU_PROFILE_EVENTS_PER_THREAD 4096 // Power of two. Events which a thread records beyond this between two frame markers are lost.
+#define MAX_NUM_CPU_PROFILE_FRAMES 256
+
+struct CpuProfileEvent {
+	const char* Name;
+	uint64 BeginClock; // Time stamp counter.
+	uint64 EndClock;
+	uint32 ThreadIndex; // Into the profiler's threads, in the order they recorded their first event.
+	uint32 Depth;       // Relative to the scopes collected in the same frame.
+};
+
+// All scopes of one name in a frame, over all threads.
+struct CpuProfileStatistic {
+	const char* Name;
+	uint32 Count;
+	double TotalMilliseconds;
+	double MaxMilliseconds;
+};
+
+struct CpuProfileFrame {
+	uint64 FrameId;
+	uint64 BeginClock;
+	uint64 EndClock;
+	uint32 NumLostEvents;
+
+	std::vector<CpuProfileEvent> Events;          // By thread, then begin.
+	std::vector<CpuProfileStatistic> Statistics;  // By total time, longest first.
+};
+
+// An event of another timeline, already converted to the profiler's microseconds. Events of the same track appear as one thread.
+struct TraceEvent {
+	const char* Name;
+	const char* Track;
+	double BeginMicroseconds;
+	double DurationMicroseconds;
+};
+
+#if defined(_MSC_VER) or defined(__x86_64__) or defined(__i386__)
+inline uint64 CpuProfileClock() { return __rdtsc(); }
+#else
+inline uint64 CpuProfileClock() { return (uint64)std::chrono::steady_clock::now().time_since_epoch().count(); }
+#endif
+
+// Since the profiler was started. The counter is calibrated against QueryPerformanceCounter, which is also the CPU clock of D3D12's
+// GetClockCalibration, so GPU timestamps can be converted with QpcToCpuProfileMicroseconds. Other platforms calibrate against the steady
+// clock, and 'qpc' is in its ticks.
+double CpuProfileClockToMicroseconds(uint64 clock);
+double QpcToCpuProfileMicroseconds(uint64 qpc);
+
+void RecordCpuProfileEvent(const char* name, uint64 beginClock, uint64 endClock);
+void SetCpuProfileThreadName(const char* name); // Shown in exported traces. Must outlive the profiler, like the names of scopes.
+
+struct CpuProfileBlockRecorder {
+	const char* Name;
+	uint64 BeginClock;
+
+	CpuProfileBlockRecorder(const char* name) : Name(name), BeginClock(CpuProfileClock()) {}
+
+	~CpuProfileBlockRecorder() {
+		RecordCpuProfileEvent(Name, BeginClock, CpuProfileClock());
+	}
+};
+
+// Main thread only. Collects everything recorded since the last call into a frame.
+void CpuProfileFrameMarker(uint64 frameId);
+
+// 0 is the last collected frame. Returns nullptr for frames which weren't collected (yet).
+const CpuProfileFrame* GetCpuProfileFrame(uint32 framesAgo);
+
+// Rolling statistics over the collected frames, with a track per thread name. Main thread only.
+ProfileStatistics& GetCpuProfileStatistics();
+
+// Main thread only. Writes the last 'numFrames' frames, the frame markers and 'otherEvents' as Chrome trace JSON.
+bool ExportChromeTrace(const fs::path& filename, uint32 numFrames, const std::vector<TraceEvent>& otherEvents = {});
+
+#if ENABLE_CPU_PROFILING
+
+#define CPU_PROFILE_VARNAME_(a, b) a##b
+#define CPU_PROFILE_VARNAME(a, b) CPU_PROFILE_VARNAME_(a, b)
+
+#define CPU_PROFILE_BLOCK_(counter, name) CpuProfileBlockRecorder CPU_PROFILE_VARNAME(__CPU_PROFILE_BLOCK, counter)(name)
+#define CPU_PROFILE_BLOCK(name) CPU_PROFILE_BLOCK_(__COUNTER__, name)
+#define CPU_PROFILE_THREAD_NAME(name) SetCpuProfileThreadName(name)
+#define CPU_PROFILE_FRAME_MARKER(frameId) CpuProfileFrameMarker(frameId)
+
+#else
+
+#define CPU_PROFILE_BLOCK(name)
+#define CPU_PROFILE_THREAD_NAME(name)
+#define CPU_PROFILE_FRAME_MARKER(frameId)
+
+#endif
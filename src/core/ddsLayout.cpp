@@ -0,0 +1,416 @@
+#include "ddsLayout.h"
+#include "memory.h"
+
+#include <cstring>
+#include <fstream>
+
+namespace {
+	constexpr uint32 MakeFourCC(char a, char b, char c, char d) {
+		return (uint32)(uint8)a | ((uint32)(uint8)b << 8) | ((uint32)(uint8)c << 16) | ((uint32)(uint8)d << 24);
+	}
+
+	constexpr uint32 DdsMagic = MakeFourCC('D', 'D', 'S', ' ');
+	constexpr uint32 DdsMaxDimension = 16384; // D3D12_REQ_TEXTURE2D_U_OR_V_DIMENSION.
+	constexpr uint32 DdsMaxArraySize = 2048;  // D3D12_REQ_TEXTURE2D_ARRAY_AXIS_DIMENSION.
+
+	// Header flags.
+	constexpr uint32 DdsFlagCaps = 0x1;
+	constexpr uint32 DdsFlagHeight = 0x2;
+	constexpr uint32 DdsFlagWidth = 0x4;
+	constexpr uint32 DdsFlagPitch = 0x8;
+	constexpr uint32 DdsFlagPixelFormat = 0x1000;
+	constexpr uint32 DdsFlagMipMapCount = 0x20000;
+	constexpr uint32 DdsFlagDepth = 0x800000;
+
+	// Pixel format flags.
+	constexpr uint32 DdsPixelFormatAlpha = 0x2;
+	constexpr uint32 DdsPixelFormatFourCC = 0x4;
+	constexpr uint32 DdsPixelFormatRGB = 0x40;
+	constexpr uint32 DdsPixelFormatLuminance = 0x20000;
+
+	// Caps.
+	constexpr uint32 DdsCapsTexture = 0x1000;
+
+	// Caps2.
+	constexpr uint32 DdsCubemap = 0x200;
+	constexpr uint32 DdsCubemapAllFaces = 0xFC00;
+	constexpr uint32 DdsVolume = 0x200000;
+
+	// DX10 header.
+	constexpr uint32 DdsResourceDimension1D = 2;
+	constexpr uint32 DdsResourceDimension2D = 3;
+	constexpr uint32 DdsResourceDimension3D = 4;
+	constexpr uint32 DdsResourceMiscTextureCube = 0x4;
+
+	struct DdsPixelFormat {
+		uint32 Size;
+		uint32 Flags;
+		uint32 FourCC;
+		uint32 RGBBitCount;
+		uint32 RBitMask;
+		uint32 GBitMask;
+		uint32 BBitMask;
+		uint32 ABitMask;
+	};
+
+	struct DdsHeader {
+		uint32 Size;
+		uint32 Flags;
+		uint32 Height;
+		uint32 Width;
+		uint32 PitchOrLinearSize;
+		uint32 Depth;
+		uint32 MipMapCount;
+		uint32 Reserved1[11];
+		DdsPixelFormat PixelFormat;
+		uint32 Caps;
+		uint32 Caps2;
+		uint32 Caps3;
+		uint32 Caps4;
+		uint32 Reserved2;
+	};
+
+	struct DdsHeaderDX10 {
+		uint32 DxgiFormat;
+		uint32 ResourceDimension;
+		uint32 MiscFlag;
+		uint32 ArraySize;
+		uint32 MiscFlags2;
+	};
+
+	static_assert(sizeof(DdsPixelFormat) == 32);
+	static_assert(sizeof(DdsHeader) == 124);
+	static_assert(sizeof(DdsHeaderDX10) == 20);
+
+	// Returns the bits per pixel of uncompressed formats, or the bytes per 4x4 block of block-compressed formats.
+	// Returns 0 for formats this parser doesn't handle (planar, video and packed formats).
+	uint32 GetFormatSize(uint32 format, bool& outBlockCompressed) {
+		outBlockCompressed = false;
+
+		if (format >= 1 and format <= 4) return 128;   // R32G32B32A32
+		if (format >= 5 and format <= 8) return 96;    // R32G32B32
+		if (format >= 9 and format <= 18) return 64;   // R16G16B16A16, R32G32
+		if (format >= 23 and format <= 43) return 32;  // R10G10B10A2, R11G11B10, R8G8B8A8, R16G16, R32
+		if (format >= 48 and format <= 59) return 16;  // R8G8, R16
+		if (format >= 60 and format <= 65) return 8;   // R8, A8
+		if (format == 67) return 32;                   // R9G9B9E5
+		if (format == 85 or format == 86) return 16;   // B5G6R5, B5G5R5A1
+		if (format >= 87 and format <= 93) return 32;  // B8G8R8A8, B8G8R8X8
+		if (format == 115) return 16;                  // B4G4R4A4
+
+		outBlockCompressed = true;
+		if (format >= 70 and format <= 72) return 8;   // BC1
+		if (format >= 73 and format <= 78) return 16;  // BC2, BC3
+		if (format >= 79 and format <= 81) return 8;   // BC4
+		if (format >= 82 and format <= 84) return 16;  // BC5
+		if (format >= 94 and format <= 99) return 16;  // BC6H, BC7
+
+		outBlockCompressed = false;
+		return 0;
+	}
+
+	bool IsBitMask(const DdsPixelFormat& pf, uint32 r, uint32 g, uint32 b, uint32 a) {
+		return pf.RBitMask == r and pf.GBitMask == g and pf.BBitMask == b and pf.ABitMask == a;
+	}
+
+	// Legacy headers, as written by DirectXTex for formats which have a D3D9 equivalent.
+	uint32 GetLegacyFormat(const DdsPixelFormat& pf) {
+		if (pf.Flags & DdsPixelFormatFourCC) {
+			switch (pf.FourCC) {
+				case MakeFourCC('D', 'X', 'T', '1'): return 71;
+				case MakeFourCC('D', 'X', 'T', '2'):
+				case MakeFourCC('D', 'X', 'T', '3'): return 74;
+				case MakeFourCC('D', 'X', 'T', '4'):
+				case MakeFourCC('D', 'X', 'T', '5'): return 77;
+				case MakeFourCC('A', 'T', 'I', '1'):
+				case MakeFourCC('B', 'C', '4', 'U'): return 80;
+				case MakeFourCC('B', 'C', '4', 'S'): return 81;
+				case MakeFourCC('A', 'T', 'I', '2'):
+				case MakeFourCC('B', 'C', '5', 'U'): return 83;
+				case MakeFourCC('B', 'C', '5', 'S'): return 84;
+
+				// D3DFORMAT values stored in the FourCC field.
+				case 36: return 11;  // A16B16G16R16
+				case 110: return 13; // Q16W16V16U16
+				case 111: return 54; // R16F
+				case 112: return 34; // G16R16F
+				case 113: return 10; // A16B16G16R16F
+				case 114: return 41; // R32F
+				case 115: return 16; // G32R32F
+				case 116: return 2;  // A32B32G32R32F
+			}
+			return 0;
+		}
+
+		if (pf.Flags & DdsPixelFormatRGB) {
+			switch (pf.RGBBitCount) {
+				case 32:
+					if (IsBitMask(pf, 0x000000ff, 0x0000ff00, 0x00ff0000, 0xff000000)) return 28;
+					if (IsBitMask(pf, 0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000)) return 87;
+					if (IsBitMask(pf, 0x00ff0000, 0x0000ff00, 0x000000ff, 0)) return 88;
+					if (IsBitMask(pf, 0x3ff00000, 0x000ffc00, 0x000003ff, 0xc0000000)) return 24; // DirectXTex writes R10G10B10A2 with swapped masks.
+					if (IsBitMask(pf, 0x0000ffff, 0xffff0000, 0, 0)) return 35;
+					if (IsBitMask(pf, 0xffffffff, 0, 0, 0)) return 41;
+					break;
+				case 16:
+					if (IsBitMask(pf, 0xf800, 0x07e0, 0x001f, 0)) return 85;
+					if (IsBitMask(pf, 0x7c00, 0x03e0, 0x001f, 0x8000)) return 86;
+					if (IsBitMask(pf, 0x0f00, 0x00f0, 0x000f, 0xf000)) return 115;
+					break;
+			}
+			return 0;
+		}
+
+		if (pf.Flags & DdsPixelFormatLuminance) {
+			if (pf.RGBBitCount == 8 and IsBitMask(pf, 0xff, 0, 0, 0)) return 61;
+			if (pf.RGBBitCount == 16 and IsBitMask(pf, 0xffff, 0, 0, 0)) return 56;
+			if (pf.RGBBitCount == 16 and IsBitMask(pf, 0x00ff, 0, 0, 0xff00)) return 49;
+			return 0;
+		}
+
+		if (pf.Flags & DdsPixelFormatAlpha) {
+			if (pf.RGBBitCount == 8) return 65;
+		}
+
+		return 0;
+	}
+}
+
+bool ParseDdsFile(const uint8* data, uint64 size, DdsTextureInfo& outInfo) {
+	outInfo = {};
+
+	if (size < sizeof(uint32) + sizeof(DdsHeader)) {
+		return false;
+	}
+
+	uint32 magic;
+	memcpy(&magic, data, sizeof(magic));
+	if (magic != DdsMagic) {
+		return false;
+	}
+
+	DdsHeader header;
+	memcpy(&header, data + sizeof(uint32), sizeof(header));
+	if (header.Size != sizeof(DdsHeader) or header.PixelFormat.Size != sizeof(DdsPixelFormat)) {
+		return false;
+	}
+
+	uint64 offset = sizeof(uint32) + sizeof(DdsHeader);
+
+	outInfo.Width = header.Width;
+	outInfo.Height = Max(header.Height, 1u);
+	outInfo.Depth = 1;
+	outInfo.ArraySize = 1;
+	outInfo.NumMipLevels = (header.Flags & DdsFlagMipMapCount) ? Max(header.MipMapCount, 1u) : 1;
+	outInfo.Dimension = EDdsDimension2D;
+
+	if ((header.PixelFormat.Flags & DdsPixelFormatFourCC) and header.PixelFormat.FourCC == MakeFourCC('D', 'X', '1', '0')) {
+		if (size < offset + sizeof(DdsHeaderDX10)) {
+			return false;
+		}
+
+		DdsHeaderDX10 header10;
+		memcpy(&header10, data + offset, sizeof(header10));
+		offset += sizeof(DdsHeaderDX10);
+
+		outInfo.Format = header10.DxgiFormat;
+		outInfo.ArraySize = header10.ArraySize;
+
+		// Checked before cubemaps multiply it by 6, which could wrap around.
+		if (outInfo.ArraySize == 0 or outInfo.ArraySize > DdsMaxArraySize) {
+			return false;
+		}
+
+		switch (header10.ResourceDimension) {
+			case DdsResourceDimension1D:
+				outInfo.Dimension = EDdsDimension1D;
+				outInfo.Height = 1;
+				break;
+			case DdsResourceDimension2D:
+				if (header10.MiscFlag & DdsResourceMiscTextureCube) {
+					outInfo.IsCubemap = true;
+					outInfo.ArraySize *= 6;
+				}
+				break;
+			case DdsResourceDimension3D:
+				if (not (header.Flags & DdsFlagDepth) or outInfo.ArraySize != 1) {
+					return false;
+				}
+				outInfo.Dimension = EDdsDimension3D;
+				outInfo.Depth = Max(header.Depth, 1u);
+				break;
+			default:
+				return false;
+		}
+	}
+	else {
+		outInfo.Format = GetLegacyFormat(header.PixelFormat);
+
+		if (header.Caps2 & DdsCubemap) {
+			// Partial cubemaps are not supported by D3D10+.
+			if ((header.Caps2 & DdsCubemapAllFaces) != DdsCubemapAllFaces) {
+				return false;
+			}
+			outInfo.IsCubemap = true;
+			outInfo.ArraySize = 6;
+		}
+		else if ((header.Flags & DdsFlagDepth) and (header.Caps2 & DdsVolume)) {
+			outInfo.Dimension = EDdsDimension3D;
+			outInfo.Depth = Max(header.Depth, 1u);
+		}
+	}
+
+	uint32 formatSize = GetFormatSize(outInfo.Format, outInfo.IsBlockCompressed);
+	if (formatSize == 0) {
+		return false;
+	}
+
+	// Reject anything D3D12 couldn't create anyway. This also keeps the size computations below from overflowing.
+	uint32 largestDimension = Max(outInfo.Width, Max(outInfo.Height, outInfo.Depth));
+	if (outInfo.Width == 0 or largestDimension > DdsMaxDimension or outInfo.ArraySize > DdsMaxArraySize) {
+		return false;
+	}
+
+	uint32 maxNumMipLevels = 1;
+	while ((largestDimension >> maxNumMipLevels) > 0) {
+		++maxNumMipLevels;
+	}
+	if (outInfo.NumMipLevels > maxNumMipLevels) {
+		return false;
+	}
+
+	outInfo.Subresources.resize((size_t)outInfo.ArraySize * outInfo.NumMipLevels);
+
+	// The file stores all mips of the first array slice, then all mips of the second and so on. This is also the D3D12 subresource order.
+	for (uint32 slice = 0; slice < outInfo.ArraySize; ++slice) {
+		for (uint32 mip = 0; mip < outInfo.NumMipLevels; ++mip) {
+			DdsSubresourceLayout& subresource = outInfo.Subresources[mip + slice * outInfo.NumMipLevels];
+			subresource.Width = Max(outInfo.Width >> mip, 1u);
+			subresource.Height = Max(outInfo.Height >> mip, 1u);
+			subresource.Depth = Max(outInfo.Depth >> mip, 1u);
+
+			if (outInfo.IsBlockCompressed) {
+				subresource.RowSize = Max((subresource.Width + 3) / 4, 1u) * formatSize;
+				subresource.NumRows = Max((subresource.Height + 3) / 4, 1u);
+			}
+			else {
+				subresource.RowSize = (subresource.Width * formatSize + 7) / 8;
+				subresource.NumRows = subresource.Height;
+			}
+
+			subresource.SliceSize = (uint64)subresource.RowSize * subresource.NumRows;
+			subresource.SourceOffset = offset;
+
+			offset += subresource.SliceSize * subresource.Depth;
+			if (offset > size) {
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+bool PlanDdsUpload(const DdsTextureInfo& info, uint64 stagingBudget, std::vector<DdsUploadRegion>& outRegions, std::vector<DdsUploadBatch>& outBatches) {
+	outRegions.clear();
+	outBatches.clear();
+
+	DdsUploadBatch batch = {};
+
+	for (uint32 i = 0; i < (uint32)info.Subresources.size(); ++i) {
+		const DdsSubresourceLayout& subresource = info.Subresources[i];
+		if (subresource.Depth != 1) {
+			return false;
+		}
+
+		uint32 rowPitch = AlignTo(subresource.RowSize, (uint32)DDS_ROW_PITCH_ALIGNMENT);
+		if (rowPitch > stagingBudget) {
+			return false;
+		}
+
+		uint32 firstRow = 0;
+		while (firstRow < subresource.NumRows) {
+			uint64 offset = AlignTo(batch.StagingSize, (uint64)DDS_PLACEMENT_ALIGNMENT);
+			uint64 maxNumRows = (offset < stagingBudget) ? (stagingBudget - offset) / rowPitch : 0;
+
+			if (maxNumRows == 0) {
+				// The staging buffer is full. Since a single row always fits into an empty one, the next iteration makes progress.
+				outBatches.push_back(batch);
+				batch = { 0, (uint32)outRegions.size(), 0 };
+				continue;
+			}
+
+			uint32 numRows = (uint32)Min((uint64)(subresource.NumRows - firstRow), maxNumRows);
+			outRegions.push_back({ i, firstRow, numRows, offset, rowPitch });
+
+			batch.StagingSize = offset + (uint64)numRows * rowPitch;
+			++batch.NumRegions;
+			firstRow += numRows;
+		}
+	}
+
+	if (batch.NumRegions > 0) {
+		outBatches.push_back(batch);
+	}
+
+	return true;
+}
+
+void CopyDdsRegion(const uint8* fileData, const DdsTextureInfo& info, const DdsUploadRegion& region, uint8* staging) {
+	const DdsSubresourceLayout& subresource = info.Subresources[region.Subresource];
+
+	const uint8* source = fileData + subresource.SourceOffset + (uint64)region.FirstRow * subresource.RowSize;
+	uint8* dest = staging + region.StagingOffset;
+
+	if (region.StagingRowPitch == subresource.RowSize) {
+		memcpy(dest, source, (uint64)region.NumRows * subresource.RowSize);
+		return;
+	}
+
+	for (uint32 row = 0; row < region.NumRows; ++row) {
+		memcpy(dest, source, subresource.RowSize);
+		source += subresource.RowSize;
+		dest += region.StagingRowPitch;
+	}
+}
+
+uint64 GetDdsTextureDataSize(const DdsTextureInfo& info) {
+	uint64 size = 0;
+	for (const DdsSubresourceLayout& subresource : info.Subresources) {
+		size += subresource.SliceSize * subresource.Depth;
+	}
+	return size;
+}
+
+bool WriteDdsFile(const fs::path& filename, uint32 format, uint32 width, uint32 height, const void* pixels) {
+	bool blockCompressed;
+	uint32 bitsPerPixel = GetFormatSize(format, blockCompressed);
+	if (bitsPerPixel == 0 or blockCompressed) {
+		return false;
+	}
+
+	uint32 rowSize = (width * bitsPerPixel + 7) / 8;
+
+	DdsHeader header = {};
+	header.Size = sizeof(DdsHeader);
+	header.Flags = DdsFlagCaps | DdsFlagHeight | DdsFlagWidth | DdsFlagPitch | DdsFlagPixelFormat;
+	header.Height = height;
+	header.Width = width;
+	header.PitchOrLinearSize = rowSize;
+	header.PixelFormat.Size = sizeof(DdsPixelFormat);
+	header.PixelFormat.Flags = DdsPixelFormatFourCC;
+	header.PixelFormat.FourCC = MakeFourCC('D', 'X', '1', '0');
+	header.Caps = DdsCapsTexture;
+
+	DdsHeaderDX10 header10 = {};
+	header10.DxgiFormat = format;
+	header10.ResourceDimension = DdsResourceDimension2D;
+	header10.ArraySize = 1;
+
+	std::ofstream stream(filename, std::ios::binary);
+	stream.write((const char*)&DdsMagic, sizeof(DdsMagic));
+	stream.write((const char*)&header, sizeof(header));
+	stream.write((const char*)&header10, sizeof(header10));
+	stream.write((const char*)pixels, (std::streamsize)rowSize * height);
+	return (bool)stream;
+}
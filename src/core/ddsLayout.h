@@ -0,0 +1,72 @@
+#pragma once
+
+#include "../pch.h"
+
+// Parses DDS files and plans their upload without going through DirectXTex, so that a memory-mapped cache file can be copied straight
+// into upload memory. Nothing in here touches D3D, formats are plain DXGI_FORMAT values.
+
+#define DDS_ROW_PITCH_ALIGNMENT 256       // D3D12_TEXTURE_DATA_PITCH_ALIGNMENT.
+#define DDS_PLACEMENT_ALIGNMENT 512       // D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT.
+
+struct DdsSubresourceLayout {
+	uint64 SourceOffset; // Of the first row, relative to the start of the file.
+	uint32 Width;
+	uint32 Height;
+	uint32 Depth;
+	uint32 RowSize;      // Bytes per row. For block-compressed formats, a row is a row of 4x4 blocks.
+	uint32 NumRows;
+	uint64 SliceSize;    // RowSize * NumRows.
+};
+
+enum EDdsDimension {
+	EDdsDimension1D,
+	EDdsDimension2D,
+	EDdsDimension3D,
+};
+
+struct DdsTextureInfo {
+	uint32 Format;       // DXGI_FORMAT.
+	EDdsDimension Dimension;
+	uint32 Width;
+	uint32 Height;
+	uint32 Depth;
+	uint32 ArraySize;    // Includes the faces of cubemaps, i.e. 6 per cube.
+	uint32 NumMipLevels;
+	bool IsCubemap;
+	bool IsBlockCompressed;
+
+	// In D3D12 subresource order, i.e. mip + arraySlice * NumMipLevels.
+	std::vector<DdsSubresourceLayout> Subresources;
+};
+
+// Returns false if the file is not a DDS file, uses a format this parser doesn't know, or is truncated.
+bool ParseDdsFile(const uint8* data, uint64 size, DdsTextureInfo& outInfo);
+
+// A range of rows of one subresource, copied to 'StagingOffset' in the staging buffer with a row pitch of 'StagingRowPitch'.
+struct DdsUploadRegion {
+	uint32 Subresource;
+	uint32 FirstRow;
+	uint32 NumRows;
+	uint64 StagingOffset;
+	uint32 StagingRowPitch;
+};
+
+// Regions which fit into the staging buffer at the same time.
+struct DdsUploadBatch {
+	uint64 StagingSize;
+	uint32 FirstRegion;
+	uint32 NumRegions;
+};
+
+// Splits the upload into batches of at most 'stagingBudget' bytes. Subresources which don't fit into the budget as a whole are split by rows.
+// Returns false if a single row doesn't fit, or if the texture has volume subresources (Depth > 1), which can't be split this way.
+bool PlanDdsUpload(const DdsTextureInfo& info, uint64 stagingBudget, std::vector<DdsUploadRegion>& outRegions, std::vector<DdsUploadBatch>& outBatches);
+
+// Copies the rows of 'region' from the file to the staging memory. This is the only copy of the texture data on the CPU.
+void CopyDdsRegion(const uint8* fileData, const DdsTextureInfo& info, const DdsUploadRegion& region, uint8* staging);
+
+uint64 GetDdsTextureDataSize(const DdsTextureInfo& info);
+
+// Writes a single 2D image without mips, with a DX10 header. 'pixels' are tightly packed rows. Returns false for block-compressed and
+// unknown formats, or if the file can't be written.
+bool WriteDdsFile(const fs::path& filename, uint32 format, uint32 width, uint32 height, const void* pixels);
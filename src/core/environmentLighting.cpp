@@ -0,0 +1,535 @@
+#include "environmentLighting.h"
+#include "threading.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(_M_X64) or defined(__SSE2__)
+#include <xmmintrin.h>
+#define ENVIRONMENT_LIGHTING_SSE
+#endif
+
+namespace {
+	constexpr double Pi = 3.14159265358979323846;
+
+	constexpr uint32 MinRowsPerBand = 4;
+	constexpr uint32 TargetNumBands = 32;
+	constexpr uint64 MinPixelsForParallelProjection = 256 * 256;
+	constexpr uint64 MinTexelsForParallelPrefilter = 16 * 16 * 6;
+
+	// Cosine lobe convolution of each SH band [Ramamoorthi and Hanrahan 2001], divided by pi: pi, 2pi/3 and pi/4.
+	const float CosineLobe[9] = { 1.f, 2.f / 3.f, 2.f / 3.f, 2.f / 3.f, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f };
+
+	struct Vec3 {
+		float X, Y, Z;
+	};
+
+	Vec3 operator+(Vec3 a, Vec3 b) { return { a.X + b.X, a.Y + b.Y, a.Z + b.Z }; }
+	Vec3 operator*(Vec3 a, float s) { return { a.X * s, a.Y * s, a.Z * s }; }
+	float Dot(Vec3 a, Vec3 b) { return a.X * b.X + a.Y * b.Y + a.Z * b.Z; }
+	Vec3 Normalize(Vec3 a) { return a * (1.f / std::sqrt(Dot(a, a))); }
+
+	// Real SH basis up to band 2, in the usual order: (0,0), (1,-1), (1,0), (1,1), (2,-2), (2,-1), (2,0), (2,1), (2,2).
+	void EvaluateSHBasis(Vec3 d, float* basis) {
+		basis[0] = 0.282095f;
+		basis[1] = 0.488603f * d.Y;
+		basis[2] = 0.488603f * d.Z;
+		basis[3] = 0.488603f * d.X;
+		basis[4] = 1.092548f * d.X * d.Y;
+		basis[5] = 1.092548f * d.Y * d.Z;
+		basis[6] = 0.315392f * (3.f * d.Z * d.Z - 1.f);
+		basis[7] = 1.092548f * d.X * d.Z;
+		basis[8] = 0.546274f * (d.X * d.X - d.Y * d.Y);
+	}
+
+	// Direction of an equirectangular texel coordinate in [0, 1], in the space cubemaps are sampled in. This inverts the mapping in
+	// equirectangular_to_cubemap_cs, including its flip of z.
+	Vec3 EquirectangularDirection(float u, float v) {
+		float theta = (float)Pi * v;
+		float phi = 2.f * (float)Pi * u;
+		float sinTheta = std::sin(theta);
+		return { -sinTheta * std::sin(phi), std::cos(theta), sinTheta * std::cos(phi) };
+	}
+
+	void DirectionToEquirectangular(Vec3 d, float& u, float& v) {
+		u = std::atan2(-d.X, d.Z) * (float)(0.5 / Pi);
+		u = (u < 0.f) ? u + 1.f : u;
+		v = std::acos(std::clamp(d.Y, -1.f, 1.f)) * (float)(1.0 / Pi);
+	}
+
+	// Texel coordinates in [0, 1] to direction, same as the face rotations in the GPU shaders.
+	Vec3 CubemapDirection(uint32 face, float u, float v) {
+		float a = 2.f * u - 1.f;
+		float b = 2.f * v - 1.f;
+		switch (face) {
+			case 0: return Normalize({ 1.f, -b, -a });
+			case 1: return Normalize({ -1.f, -b, a });
+			case 2: return Normalize({ a, 1.f, b });
+			case 3: return Normalize({ a, -1.f, -b });
+			case 4: return Normalize({ a, -b, 1.f });
+			default: return Normalize({ -a, -b, -1.f });
+		}
+	}
+
+	// Face selection of D3D cubemap sampling.
+	void DirectionToCubemap(Vec3 d, uint32& face, float& u, float& v) {
+		float ax = std::abs(d.X), ay = std::abs(d.Y), az = std::abs(d.Z);
+		float major, s, t;
+		if (ax >= ay and ax >= az) {
+			face = (d.X > 0.f) ? 0 : 1;
+			major = ax;
+			s = (d.X > 0.f) ? -d.Z : d.Z;
+			t = -d.Y;
+		}
+		else if (ay >= az) {
+			face = (d.Y > 0.f) ? 2 : 3;
+			major = ay;
+			s = d.X;
+			t = (d.Y > 0.f) ? d.Z : -d.Z;
+		}
+		else {
+			face = (d.Z > 0.f) ? 4 : 5;
+			major = az;
+			s = (d.Z > 0.f) ? d.X : -d.X;
+			t = -d.Y;
+		}
+		u = 0.5f * (s / major + 1.f);
+		v = 0.5f * (t / major + 1.f);
+	}
+
+	void GetTangentFrame(Vec3 n, Vec3& t, Vec3& b) {
+		// [Duff et al. 2017], branchless and continuous except at n.Z == 0.
+		float sign = std::copysign(1.f, n.Z);
+		float a = -1.f / (sign + n.Z);
+		float c = n.X * n.Y * a;
+		t = { 1.f + sign * n.X * n.X * a, sign * c, -sign * n.X };
+		b = { c, sign + n.Y * n.Y * a, -n.Y };
+	}
+
+	float Hammersley(uint32 i) {
+		uint32 bits = i;
+		bits = (bits << 16u) | (bits >> 16u);
+		bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+		bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+		bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+		bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+		return bits * 2.3283064365386963e-10f;
+	}
+
+	// DistributionGGX of brdf.hlsli, without its clamp of the denominator. The clamp cuts off the peak of low roughnesses, which would
+	// make the pdf far too small and select much blurrier source levels than the lobe calls for.
+	float DistributionGGX(float NdotH, float roughness) {
+		float a = roughness * roughness;
+		float a2 = a * a;
+		float d = NdotH * NdotH * (a2 - 1.f) + 1.f;
+		return a2 / (d * d * (float)Pi);
+	}
+
+	// Runs 'work' for bands of rows, on the job system if 'parallel' is set.
+	template <typename Work>
+	void ForEachBand(uint32 numRows, bool parallel, const Work& work) {
+		if (not parallel) {
+			work(0u, numRows);
+			return;
+		}
+
+		uint32 rowsPerBand = Max(MinRowsPerBand, (numRows + TargetNumBands - 1) / TargetNumBands);
+
+		uint32 numBands = (numRows + rowsPerBand - 1) / rowsPerBand;
+		ParallelFor(numBands, [&](uint32 band) {
+			uint32 y = band * rowsPerBand;
+			work(y, Min(y + rowsPerBand, numRows));
+		});
+	}
+
+	// Adds the SH projection of rows [firstRow, endRow) to 'sums', which holds 9 coefficients times 3 channels.
+	// 'sinPhi' and 'cosPhi' hold the longitude of every column, since it doesn't change between rows.
+	void ProjectRows(const EnvironmentImage& image, const float* sinPhi, const float* cosPhi, uint32 firstRow, uint32 endRow, double* sums) {
+		double texelSolidAngle = (2.0 * Pi / image.Width) * (Pi / image.Height);
+
+		for (uint32 y = firstRow; y < endRow; ++y) {
+			float theta = (float)(Pi * (y + 0.5) / image.Height);
+			float sinTheta = std::sin(theta);
+			float cosTheta = std::cos(theta);
+			const float* row = (const float*)((const uint8*)image.Pixels + y * image.RowPitch);
+
+			float rowSums[27] = {};
+			uint32 x = 0;
+
+#ifdef ENVIRONMENT_LIGHTING_SSE
+			__m128 accumulators[27];
+			for (__m128& accumulator : accumulators) {
+				accumulator = _mm_setzero_ps();
+			}
+
+			const __m128 s = _mm_set1_ps(sinTheta);
+			const __m128 dy = _mm_set1_ps(cosTheta);
+
+			for (; x + 4 <= image.Width; x += 4) {
+				__m128 r = _mm_loadu_ps(row + x * 4);
+				__m128 g = _mm_loadu_ps(row + x * 4 + 4);
+				__m128 b = _mm_loadu_ps(row + x * 4 + 8);
+				__m128 a = _mm_loadu_ps(row + x * 4 + 12);
+				_MM_TRANSPOSE4_PS(r, g, b, a);
+
+				__m128 dx = _mm_sub_ps(_mm_setzero_ps(), _mm_mul_ps(s, _mm_loadu_ps(sinPhi + x)));
+				__m128 dz = _mm_mul_ps(s, _mm_loadu_ps(cosPhi + x));
+
+				__m128 basis[9];
+				basis[0] = _mm_set1_ps(0.282095f);
+				basis[1] = _mm_mul_ps(_mm_set1_ps(0.488603f), dy);
+				basis[2] = _mm_mul_ps(_mm_set1_ps(0.488603f), dz);
+				basis[3] = _mm_mul_ps(_mm_set1_ps(0.488603f), dx);
+				basis[4] = _mm_mul_ps(_mm_set1_ps(1.092548f), _mm_mul_ps(dx, dy));
+				basis[5] = _mm_mul_ps(_mm_set1_ps(1.092548f), _mm_mul_ps(dy, dz));
+				basis[6] = _mm_mul_ps(_mm_set1_ps(0.315392f), _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(3.f), _mm_mul_ps(dz, dz)), _mm_set1_ps(1.f)));
+				basis[7] = _mm_mul_ps(_mm_set1_ps(1.092548f), _mm_mul_ps(dx, dz));
+				basis[8] = _mm_mul_ps(_mm_set1_ps(0.546274f), _mm_sub_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)));
+
+				for (uint32 k = 0; k < 9; ++k) {
+					accumulators[k * 3 + 0] = _mm_add_ps(accumulators[k * 3 + 0], _mm_mul_ps(basis[k], r));
+					accumulators[k * 3 + 1] = _mm_add_ps(accumulators[k * 3 + 1], _mm_mul_ps(basis[k], g));
+					accumulators[k * 3 + 2] = _mm_add_ps(accumulators[k * 3 + 2], _mm_mul_ps(basis[k], b));
+				}
+			}
+
+			for (uint32 i = 0; i < 27; ++i) {
+				alignas(16) float lanes[4];
+				_mm_store_ps(lanes, accumulators[i]);
+				rowSums[i] = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+			}
+#endif
+
+			for (; x < image.Width; ++x) {
+				float basis[9];
+				EvaluateSHBasis({ -sinTheta * sinPhi[x], cosTheta, sinTheta * cosPhi[x] }, basis);
+				for (uint32 k = 0; k < 9; ++k) {
+					for (uint32 c = 0; c < 3; ++c) {
+						rowSums[k * 3 + c] += basis[k] * row[x * 4 + c];
+					}
+				}
+			}
+
+			double rowWeight = texelSolidAngle * sinTheta;
+			for (uint32 i = 0; i < 27; ++i) {
+				sums[i] += rowSums[i] * rowWeight;
+			}
+		}
+	}
+
+
+	// RGBA32F cubemap with a full mip chain. The faces of a level are stored one after another.
+	struct SourceCubemap {
+		std::vector<std::vector<float>> Levels;
+		std::vector<uint32> Sizes;
+
+		const float* GetFace(uint32 level, uint32 face) const {
+			return Levels[level].data() + (size_t)face * Sizes[level] * Sizes[level] * 4;
+		}
+	};
+
+	void SampleEquirectangular(const EnvironmentImage& image, float u, float v, float* out) {
+		float x = u * image.Width - 0.5f;
+		float y = std::clamp(v * image.Height - 0.5f, 0.f, (float)(image.Height - 1));
+		float fx = std::floor(x);
+		float fy = std::floor(y);
+		float tx = x - fx;
+		float ty = y - fy;
+
+		int32 x0 = ((int32)fx % (int32)image.Width + (int32)image.Width) % (int32)image.Width;
+		int32 x1 = (x0 + 1) % (int32)image.Width;
+		uint32 y0 = (uint32)fy;
+		uint32 y1 = Min(y0 + 1, image.Height - 1);
+
+		const float* row0 = (const float*)((const uint8*)image.Pixels + y0 * image.RowPitch);
+		const float* row1 = (const float*)((const uint8*)image.Pixels + y1 * image.RowPitch);
+		for (uint32 c = 0; c < 3; ++c) {
+			float top = row0[x0 * 4 + c] + (row0[x1 * 4 + c] - row0[x0 * 4 + c]) * tx;
+			float bottom = row1[x0 * 4 + c] + (row1[x1 * 4 + c] - row1[x0 * 4 + c]) * tx;
+			out[c] = top + (bottom - top) * ty;
+		}
+	}
+
+	// Bilinear, clamped at the face edges. The seams this leaves are far below what the GGX lobes average over.
+	void SampleFace(const float* face, uint32 size, float u, float v, float* out) {
+		float x = std::clamp(u * size - 0.5f, 0.f, (float)(size - 1));
+		float y = std::clamp(v * size - 0.5f, 0.f, (float)(size - 1));
+		uint32 x0 = (uint32)x;
+		uint32 y0 = (uint32)y;
+		uint32 x1 = Min(x0 + 1, size - 1);
+		uint32 y1 = Min(y0 + 1, size - 1);
+		float tx = x - x0;
+		float ty = y - y0;
+
+		const float* p00 = face + ((size_t)y0 * size + x0) * 4;
+		const float* p01 = face + ((size_t)y0 * size + x1) * 4;
+		const float* p10 = face + ((size_t)y1 * size + x0) * 4;
+		const float* p11 = face + ((size_t)y1 * size + x1) * 4;
+		for (uint32 c = 0; c < 3; ++c) {
+			float top = p00[c] + (p01[c] - p00[c]) * tx;
+			float bottom = p10[c] + (p11[c] - p10[c]) * tx;
+			out[c] = top + (bottom - top) * ty;
+		}
+	}
+
+	void SampleCubemap(const SourceCubemap& cubemap, Vec3 d, float level, float* out) {
+		uint32 face;
+		float u, v;
+		DirectionToCubemap(d, face, u, v);
+
+		uint32 maxLevel = (uint32)cubemap.Sizes.size() - 1;
+		level = std::clamp(level, 0.f, (float)maxLevel);
+		uint32 level0 = (uint32)level;
+		uint32 level1 = Min(level0 + 1, maxLevel);
+		float t = level - level0;
+
+		SampleFace(cubemap.GetFace(level0, face), cubemap.Sizes[level0], u, v, out);
+		if (t > 0.f) {
+			float upper[3];
+			SampleFace(cubemap.GetFace(level1, face), cubemap.Sizes[level1], u, v, upper);
+			for (uint32 c = 0; c < 3; ++c) {
+				out[c] += (upper[c] - out[c]) * t;
+			}
+		}
+	}
+
+	// Resamples the environment into a cubemap and box-filters its mip chain. Each texel averages a grid of samples, sized so that the
+	// equirectangular texels at the equator are all covered.
+	void BuildSourceCubemap(const EnvironmentImage& image, uint32 size, bool parallel, SourceCubemap& cubemap) {
+		uint32 numLevels = 1;
+		while ((size >> numLevels) > 0) {
+			++numLevels;
+		}
+		cubemap.Levels.resize(numLevels);
+		cubemap.Sizes.resize(numLevels);
+		for (uint32 level = 0; level < numLevels; ++level) {
+			cubemap.Sizes[level] = size >> level;
+			cubemap.Levels[level].resize((size_t)cubemap.Sizes[level] * cubemap.Sizes[level] * 6 * 4);
+		}
+
+		uint32 samplesPerAxis = std::clamp((image.Width + 4 * size - 1) / (4 * size), 1u, 8u);
+		float sampleWeight = 1.f / (samplesPerAxis * samplesPerAxis);
+
+		ForEachBand(size * 6, parallel, [&](uint32 firstRow, uint32 endRow) {
+			for (uint32 row = firstRow; row < endRow; ++row) {
+				uint32 face = row / size;
+				uint32 y = row % size;
+				float* out = cubemap.Levels[0].data() + ((size_t)face * size + y) * size * 4;
+
+				for (uint32 x = 0; x < size; ++x, out += 4) {
+					float sum[3] = {};
+					for (uint32 sy = 0; sy < samplesPerAxis; ++sy) {
+						for (uint32 sx = 0; sx < samplesPerAxis; ++sx) {
+							Vec3 d = CubemapDirection(face, (x + (sx + 0.5f) / samplesPerAxis) / size, (y + (sy + 0.5f) / samplesPerAxis) / size);
+							float u, v, color[3];
+							DirectionToEquirectangular(d, u, v);
+							SampleEquirectangular(image, u, v, color);
+							sum[0] += color[0];
+							sum[1] += color[1];
+							sum[2] += color[2];
+						}
+					}
+					out[0] = sum[0] * sampleWeight;
+					out[1] = sum[1] * sampleWeight;
+					out[2] = sum[2] * sampleWeight;
+					out[3] = 1.f;
+				}
+			}
+		});
+
+		for (uint32 level = 1; level < numLevels; ++level) {
+			uint32 srcSize = cubemap.Sizes[level - 1];
+			uint32 dstSize = cubemap.Sizes[level];
+			for (uint32 face = 0; face < 6; ++face) {
+				const float* src = cubemap.GetFace(level - 1, face);
+				float* dst = (float*)cubemap.GetFace(level, face);
+				for (uint32 y = 0; y < dstSize; ++y) {
+					for (uint32 x = 0; x < dstSize; ++x) {
+						const float* p = src + ((size_t)(2 * y) * srcSize + 2 * x) * 4;
+						for (uint32 c = 0; c < 4; ++c) {
+							dst[((size_t)y * dstSize + x) * 4 + c] = 0.25f * (p[c] + p[4 + c] + p[srcSize * 4 + c] + p[srcSize * 4 + 4 + c]);
+						}
+					}
+				}
+			}
+		}
+	}
+
+	// GGX samples around +z with N = V = R, as in prefilter_environment_cs. They don't depend on the texel, so they are computed once per
+	// level and rotated into the frame of each texel.
+	struct PrefilterSample {
+		Vec3 L;
+		float NdotL;
+		float SourceLevel;
+	};
+
+	std::vector<PrefilterSample> ComputePrefilterSamples(float roughness, uint32 numSamples, uint32 sourceSize) {
+		float a = roughness * roughness;
+		float a2 = a * a;
+		float texelSolidAngle = 4.f * (float)Pi / (6.f * sourceSize * sourceSize);
+
+		std::vector<PrefilterSample> samples;
+		samples.reserve(numSamples);
+		for (uint32 i = 0; i < numSamples; ++i) {
+			float xi0 = (float)i / numSamples;
+			float xi1 = Hammersley(i);
+
+			float phi = 2.f * (float)Pi * xi0;
+			float cosTheta = std::sqrt((1.f - xi1) / (1.f + (a2 - 1.f) * xi1));
+			float sinTheta = std::sqrt(1.f - cosTheta * cosTheta);
+
+			// L = 2 (V.H) H - V, with V = (0, 0, 1).
+			float NdotL = 2.f * cosTheta * cosTheta - 1.f;
+			if (NdotL <= 0.f) {
+				continue;
+			}
+
+			// With N = V, the pdf of L is D * (N.H) / (4 * (V.H)) = D / 4.
+			float pdf = DistributionGGX(cosTheta, roughness) * 0.25f + 0.0001f;
+			float sampleSolidAngle = 1.f / (numSamples * pdf + 0.00001f);
+
+			PrefilterSample sample;
+			sample.L = { 2.f * cosTheta * sinTheta * std::cos(phi), 2.f * cosTheta * sinTheta * std::sin(phi), NdotL };
+			sample.NdotL = NdotL;
+			sample.SourceLevel = std::fmax(0.f, 0.5f * std::log2(sampleSolidAngle / texelSolidAngle));
+			samples.push_back(sample);
+		}
+		return samples;
+	}
+
+	void PrefilterLevel(const SourceCubemap& source, const CubemapLevel& level, float roughness, const GGXPrefilterSettings& settings) {
+		std::vector<PrefilterSample> samples;
+		float directLevel = std::log2((float)source.Sizes[0] / level.Size);
+		if (roughness > 0.f) {
+			samples = ComputePrefilterSamples(roughness, settings.NumSamples, source.Sizes[0]);
+		}
+
+		bool parallel = settings.Parallel and (uint64)level.Size * level.Size * 6 >= MinTexelsForParallelPrefilter;
+		ForEachBand(level.Size * 6, parallel, [&](uint32 firstRow, uint32 endRow) {
+			for (uint32 row = firstRow; row < endRow; ++row) {
+				uint32 face = row / level.Size;
+				uint32 y = row % level.Size;
+				float* out = (float*)((uint8*)level.Faces[face] + y * level.RowPitch);
+
+				for (uint32 x = 0; x < level.Size; ++x, out += 4) {
+					Vec3 n = CubemapDirection(face, (x + 0.5f) / level.Size, (y + 0.5f) / level.Size);
+
+					if (samples.empty()) {
+						SampleCubemap(source, n, directLevel, out);
+						out[3] = 1.f;
+						continue;
+					}
+
+					Vec3 t, b;
+					GetTangentFrame(n, t, b);
+
+					float sum[3] = {};
+					float totalWeight = 0.f;
+					for (const PrefilterSample& sample : samples) {
+						Vec3 l = t * sample.L.X + b * sample.L.Y + n * sample.L.Z;
+						float color[3];
+						SampleCubemap(source, l, sample.SourceLevel, color);
+						sum[0] += color[0] * sample.NdotL;
+						sum[1] += color[1] * sample.NdotL;
+						sum[2] += color[2] * sample.NdotL;
+						totalWeight += sample.NdotL;
+					}
+
+					out[0] = sum[0] / totalWeight;
+					out[1] = sum[1] / totalWeight;
+					out[2] = sum[2] / totalWeight;
+					out[3] = 1.f;
+				}
+			}
+		});
+	}
+}
+
+SHIrradiance ProjectEnvironmentToSH(const EnvironmentImage& image, bool parallel) {
+	std::vector<float> sinPhi(image.Width), cosPhi(image.Width);
+	for (uint32 x = 0; x < image.Width; ++x) {
+		double phi = 2.0 * Pi * (x + 0.5) / image.Width;
+		sinPhi[x] = (float)std::sin(phi);
+		cosPhi[x] = (float)std::cos(phi);
+	}
+
+	// Every band sums into its own slot, and the slots are added in order, so the result doesn't depend on the scheduling.
+	parallel = parallel and (uint64)image.Width * image.Height >= MinPixelsForParallelProjection;
+	uint32 rowsPerBand = parallel ? Max(MinRowsPerBand, (image.Height + TargetNumBands - 1) / TargetNumBands) : image.Height;
+	uint32 numBands = (image.Height + rowsPerBand - 1) / rowsPerBand;
+	std::vector<std::array<double, 27>> bandSums(numBands);
+
+	ForEachBand(numBands, parallel, [&](uint32 firstBand, uint32 endBand) {
+		for (uint32 band = firstBand; band < endBand; ++band) {
+			bandSums[band].fill(0.0);
+			ProjectRows(image, sinPhi.data(), cosPhi.data(), band * rowsPerBand, Min((band + 1) * rowsPerBand, image.Height), bandSums[band].data());
+		}
+	});
+
+	double sums[27] = {};
+	for (const auto& bandSum : bandSums) {
+		for (uint32 i = 0; i < 27; ++i) {
+			sums[i] += bandSum[i];
+		}
+	}
+
+	SHIrradiance sh;
+	for (uint32 k = 0; k < 9; ++k) {
+		for (uint32 c = 0; c < 3; ++c) {
+			sh.Coefficients[k][c] = (float)(sums[k * 3 + c] * CosineLobe[k]);
+		}
+	}
+	return sh;
+}
+
+void EvaluateSHIrradiance(const SHIrradiance& sh, const float* direction, float* outColor) {
+	float basis[9];
+	EvaluateSHBasis({ direction[0], direction[1], direction[2] }, basis);
+
+	for (uint32 c = 0; c < 3; ++c) {
+		float sum = 0.f;
+		for (uint32 k = 0; k < 9; ++k) {
+			sum += basis[k] * sh.Coefficients[k][c];
+		}
+		// Order-2 SH ring around very bright light sources and can go slightly negative on the opposite side.
+		outColor[c] = std::fmax(sum, 0.f);
+	}
+}
+
+void BakeSHIrradianceCubemap(const SHIrradiance& sh, const CubemapLevel& level) {
+	for (uint32 face = 0; face < 6; ++face) {
+		for (uint32 y = 0; y < level.Size; ++y) {
+			float* out = (float*)((uint8*)level.Faces[face] + y * level.RowPitch);
+			for (uint32 x = 0; x < level.Size; ++x, out += 4) {
+				Vec3 n = CubemapDirection(face, (x + 0.5f) / level.Size, (y + 0.5f) / level.Size);
+				EvaluateSHIrradiance(sh, &n.X, out);
+				out[3] = 1.f;
+			}
+		}
+	}
+}
+
+void PrefilterEnvironmentGGX(const EnvironmentImage& image, const CubemapLevel* levels, uint32 numLevels, const GGXPrefilterSettings& settings) {
+	// Twice the output resolution, so that level 0 is filtered as well instead of point-sampled.
+	SourceCubemap source;
+	BuildSourceCubemap(image, levels[0].Size * 2, settings.Parallel, source);
+
+	for (uint32 level = 0; level < numLevels; ++level) {
+		float roughness = (numLevels > 1) ? (float)level / (numLevels - 1) : 0.f;
+		PrefilterLevel(source, levels[level], roughness, settings);
+	}
+}
+
+void GetEquirectangularDirection(float u, float v, float* outDirection) {
+	Vec3 d = EquirectangularDirection(u, v);
+	outDirection[0] = d.X;
+	outDirection[1] = d.Y;
+	outDirection[2] = d.Z;
+}
+
+void GetCubemapDirection(uint32 face, float u, float v, float* outDirection) {
+	Vec3 d = CubemapDirection(face, u, v);
+	outDirection[0] = d.X;
+	outDirection[1] = d.Y;
+	outDirection[2] = d.Z;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "../pch.h"
+
+// CPU precomputation of image-based lighting from an equirectangular HDR environment. Independent of DirectXTex and D3D.
+//
+// Diffuse lighting is projected into 9 spherical harmonics coefficients per color channel. Convolved with the cosine lobe, these reproduce
+// the irradiance of typical environments within a few percent [Ramamoorthi and Hanrahan 2001]. Specular lighting is prefiltered with the
+// GGX distribution into a cubemap mip chain, one roughness per level, using filtered importance sampling [Krivanek and Colbert 2008].
+//
+// Directions, cubemap faces and the roughness of each level follow the GPU texture preprocessing shaders, so the results can replace theirs.
+
+struct EnvironmentImage {
+	const float* Pixels; // RGBA32F, equirectangular. Alpha is ignored.
+	uint32 Width;
+	uint32 Height;
+	uint64 RowPitch;
+};
+
+// One mip level of an RGBA32F cubemap. Faces are in D3D order: +x, -x, +y, -y, +z, -z.
+struct CubemapLevel {
+	float* Faces[6];
+	uint32 Size;
+	uint64 RowPitch;
+};
+
+// Irradiance divided by pi, i.e. the outgoing radiance of a white Lambertian surface, which is what the irradiance cubemap stores.
+// The cosine convolution is already applied, so evaluating the basis functions for a normal gives the result directly.
+struct SHIrradiance {
+	float Coefficients[9][3];
+};
+
+SHIrradiance ProjectEnvironmentToSH(const EnvironmentImage& image, bool parallel = true);
+void EvaluateSHIrradiance(const SHIrradiance& sh, const float* direction, float* outColor);
+
+// Fills every texel of 'level' with the SH irradiance in its direction. Alpha is set to 1.
+void BakeSHIrradianceCubemap(const SHIrradiance& sh, const CubemapLevel& level);
+
+struct GGXPrefilterSettings {
+	uint32 NumSamples = 256; // Per texel. Filtered importance sampling needs far fewer samples than plain Monte Carlo.
+	bool Parallel = true;
+};
+
+// Level i is filtered with roughness i / (numLevels - 1). Level 0 is a plain downsampling of the environment. Every level must be allocated
+// by the caller with size max(1, levels[0].Size >> i).
+void PrefilterEnvironmentGGX(const EnvironmentImage& image, const CubemapLevel* levels, uint32 numLevels, const GGXPrefilterSettings& settings);
+
+// Directions of texel coordinates in [0, 1], as the GPU shaders define them. 'outDirection' receives a normalized xyz vector.
+void GetEquirectangularDirection(float u, float v, float* outDirection);
+void GetCubemapDirection(uint32 face, float u, float v, float* outDirection);
@@ -0,0 +1,110 @@
+#include "fenceRecycler.h"
+
+#include <algorithm>
+
+#ifndef _WIN32
+#include <time.h>
+#endif
+
+namespace {
+	// User space pointers fit into 48 bits on x64 and ARM64.
+	constexpr uint32 FreeHeadCounterShift = 48;
+	constexpr uint64 FreeHeadPointerMask = (1ull << FreeHeadCounterShift) - 1;
+
+	uint64 PackFreeHead(FenceRecyclable* object, uint64 previousHead) {
+		assert(((uint64)object & ~FreeHeadPointerMask) == 0);
+		return (((previousHead >> FreeHeadCounterShift) + 1) << FreeHeadCounterShift) | (uint64)object;
+	}
+
+	FenceRecyclable* UnpackFreeHead(uint64 head) {
+		return (FenceRecyclable*)(head & FreeHeadPointerMask);
+	}
+
+	// Comparison for a min-heap.
+	bool HasHigherFenceValue(const FenceRecyclable* a, const FenceRecyclable* b) {
+		return a->FenceValue > b->FenceValue;
+	}
+}
+
+bool FenceRecycler::Submit(FenceRecyclable* object) {
+	_numSubmitted.fetch_add(1);
+
+	FenceRecyclable* head = _submitted.load(std::memory_order_relaxed);
+	do {
+		object->NextRecyclable.store(head, std::memory_order_relaxed);
+	} while (not _submitted.compare_exchange_weak(head, object));
+
+	// Pairs with BeginIdleWait: either the recycler sees the object, or we see that it sleeps.
+	return _idle.load();
+}
+
+void FenceRecycler::GatherSubmitted() {
+	FenceRecyclable* object = _submitted.exchange(nullptr, std::memory_order_acquire);
+	while (object) {
+		FenceRecyclable* next = object->NextRecyclable.load(std::memory_order_relaxed);
+		_pending.push_back(object);
+		std::push_heap(_pending.begin(), _pending.end(), HasHigherFenceValue);
+		object = next;
+	}
+}
+
+FenceRecyclable* FenceRecycler::PopPending() {
+	std::pop_heap(_pending.begin(), _pending.end(), HasHigherFenceValue);
+	FenceRecyclable* result = _pending.back();
+	_pending.pop_back();
+	return result;
+}
+
+void FenceRecycler::PushFree(FenceRecyclable* first, FenceRecyclable* last) {
+	uint64 head = _freeHead.load(std::memory_order_relaxed);
+	do {
+		last->NextRecyclable.store(UnpackFreeHead(head), std::memory_order_relaxed);
+	} while (not _freeHead.compare_exchange_weak(head, PackFreeHead(first, head), std::memory_order_release, std::memory_order_relaxed));
+}
+
+FenceRecyclable* FenceRecycler::PopFree() {
+	uint64 head = _freeHead.load(std::memory_order_acquire);
+	while (FenceRecyclable* object = UnpackFreeHead(head)) {
+		// The top may be popped and submitted by another thread under us, which changes its 'NextRecyclable', but then the counter changed
+		// as well and the exchange fails.
+		FenceRecyclable* next = object->NextRecyclable.load(std::memory_order_relaxed);
+		if (_freeHead.compare_exchange_weak(head, PackFreeHead(next, head), std::memory_order_acquire, std::memory_order_acquire)) {
+			return object;
+		}
+	}
+	return nullptr;
+}
+
+bool FenceRecycler::BeginIdleWait() {
+	_idle.store(true);
+	return _submitted.load() == nullptr;
+}
+
+FenceRecyclerStatistics FenceRecycler::GetStatistics() const {
+	FenceRecyclerStatistics result = {};
+	result.NumSubmitted = _numSubmitted.load();
+	result.NumRecycled = _numRecycled.load();
+	result.NumUpdates = _numUpdates;
+	result.NumBatches = _numBatches;
+	return result;
+}
+
+double GetCurrentThreadCpuMilliseconds() {
+#ifdef _WIN32
+	FILETIME creationTime, exitTime, kernelTime, userTime;
+	if (not GetThreadTimes(GetCurrentThread(), &creationTime, &exitTime, &kernelTime, &userTime)) {
+		return 0.0;
+	}
+
+	// In units of 100 ns.
+	uint64 kernel = ((uint64)kernelTime.dwHighDateTime << 32) | kernelTime.dwLowDateTime;
+	uint64 user = ((uint64)userTime.dwHighDateTime << 32) | userTime.dwLowDateTime;
+	return (kernel + user) * 1e-4;
+#else
+	timespec time;
+	if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time) != 0) {
+		return 0.0;
+	}
+	return time.tv_sec * 1e3 + time.tv_nsec * 1e-6;
+#endif
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "../pch.h"
+
+#include <atomic>
+
+// Recycling of objects which the GPU uses until a fence reaches a value, like command lists. Independent of D3D: the owner reads and waits
+// on the fence, so that the scheduling can be tested against a simulated one.
+
+// Base of recyclable objects. Both fields belong to the recycler while the object is submitted or free.
+struct FenceRecyclable {
+	std::atomic<FenceRecyclable*> NextRecyclable = nullptr; // Read by PopFree while another thread may already have taken the object.
+	uint64 FenceValue = 0;
+};
+
+struct FenceRecyclerStatistics {
+	uint64 NumSubmitted;
+	uint64 NumRecycled;
+	uint64 NumUpdates;       // Times the recycler thread woke up.
+	uint64 NumBatches;       // Updates which recycled anything.
+	double CpuMilliseconds;  // Spent by the recycler thread. Filled in by its owner.
+};
+
+// User and kernel time the calling thread has spent so far.
+double GetCurrentThreadCpuMilliseconds();
+
+// Submitted objects are pushed onto a lock-free stack. The recycler thread moves them into a heap ordered by fence value, so that it always
+// waits for the lowest pending value and recycles everything the fence has passed in one batch, no matter in which order objects were
+// submitted. Recycled objects go onto a lock-free free list, from which threads pop one at a time. Like the free list of the IndexAllocator,
+// its head carries a counter, so that a pop can't succeed on a head which was popped and pushed again in between.
+class FenceRecycler {
+public:
+	FenceRecycler() = default;
+	FenceRecycler(const FenceRecycler&) = delete;
+	FenceRecycler& operator=(const FenceRecycler&) = delete;
+
+	// Any thread, after the object's work was submitted with 'FenceValue'. Returns true if the recycler thread is idle and must be woken.
+	bool Submit(FenceRecyclable* object);
+
+	// Any thread. Returns nullptr if nothing is free.
+	FenceRecyclable* PopFree();
+
+	// Recycler thread only. Recycles everything up to 'completedFenceValue', after calling 'reset' on it. Returns the fence value to wait for
+	// next, or 0 if nothing is pending. Then the thread calls BeginIdleWait.
+	template<typename Reset>
+	uint64 Update(uint64 completedFenceValue, const Reset& reset);
+
+	// Recycler thread only. Returns false if objects were submitted in the meantime, so that the thread must not go to sleep. Submit returns
+	// true between these two calls.
+	bool BeginIdleWait();
+	void EndIdleWait() { _idle.store(false); }
+
+	uint32 NumInFlight() const { return (uint32)(_numSubmitted.load() - _numRecycled.load()); } // Submitted and not recycled yet.
+	FenceRecyclerStatistics GetStatistics() const;
+
+private:
+	void GatherSubmitted();
+	FenceRecyclable* PopPending();
+	void PushFree(FenceRecyclable* first, FenceRecyclable* last);
+
+	std::atomic<FenceRecyclable*> _submitted = nullptr;
+	std::atomic<uint64> _freeHead = 0; // The top object in the lower 48 bits, a counter in the upper 16.
+	std::atomic<bool> _idle = false;
+
+	std::vector<FenceRecyclable*> _pending; // Min-heap by fence value. Recycler thread only.
+
+	std::atomic<uint64> _numSubmitted = 0;
+	std::atomic<uint64> _numRecycled = 0;
+	uint64 _numUpdates = 0;
+	uint64 _numBatches = 0;
+};
+
+template<typename Reset>
+uint64 FenceRecycler::Update(uint64 completedFenceValue, const Reset& reset) {
+	GatherSubmitted();
+	_numUpdates++;
+
+	FenceRecyclable* first = nullptr;
+	FenceRecyclable* last = nullptr;
+	uint64 numRecycled = 0;
+
+	while (not _pending.empty() and _pending.front()->FenceValue <= completedFenceValue) {
+		FenceRecyclable* object = PopPending();
+		reset(object);
+
+		object->NextRecyclable.store(first, std::memory_order_relaxed);
+		first = object;
+		if (not last) {
+			last = object;
+		}
+		numRecycled++;
+	}
+
+	if (first) {
+		PushFree(first, last);
+		_numRecycled.fetch_add(numRecycled);
+		_numBatches++;
+	}
+
+	return _pending.empty() ? 0 : _pending.front()->FenceValue;
+}
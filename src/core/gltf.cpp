@@ -0,0 +1,827 @@
+#include "gltf.h"
+#include "json.h"
+
+#include <cmath>
+#include <cstring>
+
+#if defined(_M_X64) or defined(__SSE2__)
+#include <emmintrin.h>
+#define GLTF_SSE
+#endif
+
+namespace {
+	constexpr uint32 GlbMagic = 0x46546C67;     // "glTF"
+	constexpr uint32 GlbChunkJson = 0x4E4F534A; // "JSON"
+	constexpr uint32 GlbChunkBin = 0x004E4942;  // "BIN\0"
+
+	// Extensions which only add information. Files requiring anything else are left to the fallback importer.
+	const char* SupportedRequiredExtensions[] = {
+		"KHR_materials_emissive_strength",
+		"KHR_materials_ior",
+		"KHR_materials_specular",
+		"KHR_texture_transform",
+	};
+
+	uint32 ReadUint32(const uint8* data) {
+		uint32 result;
+		memcpy(&result, data, sizeof(result));
+		return result;
+	}
+
+	uint32 GetComponentSize(uint32 componentType) {
+		switch (componentType) {
+			case EGltfComponentTypeByte:
+			case EGltfComponentTypeUnsignedByte: return 1;
+			case EGltfComponentTypeShort:
+			case EGltfComponentTypeUnsignedShort: return 2;
+			case EGltfComponentTypeUnsignedInt:
+			case EGltfComponentTypeFloat: return 4;
+			default: return 0;
+		}
+	}
+
+	uint32 GetNumComponents(const std::string& type) {
+		if (type == "SCALAR") return 1;
+		if (type == "VEC2") return 2;
+		if (type == "VEC3") return 3;
+		if (type == "VEC4") return 4;
+		if (type == "MAT2") return 4;
+		if (type == "MAT3") return 9;
+		if (type == "MAT4") return 16;
+		return 0;
+	}
+
+	int32 DecodeBase64Digit(char c) {
+		if (c >= 'A' and c <= 'Z') return c - 'A';
+		if (c >= 'a' and c <= 'z') return c - 'a' + 26;
+		if (c >= '0' and c <= '9') return c - '0' + 52;
+		if (c == '+') return 62;
+		if (c == '/') return 63;
+		return -1;
+	}
+
+	bool DecodeBase64(const char* text, uint64 length, std::vector<uint8>& out) {
+		out.clear();
+		out.reserve(length / 4 * 3);
+
+		uint32 accumulator = 0;
+		uint32 numBits = 0;
+		for (uint64 i = 0; i < length; ++i) {
+			if (text[i] == '=') {
+				break;
+			}
+			int32 digit = DecodeBase64Digit(text[i]);
+			if (digit < 0) {
+				return false;
+			}
+			accumulator = (accumulator << 6) | (uint32)digit;
+			numBits += 6;
+			if (numBits >= 8) {
+				numBits -= 8;
+				out.push_back((uint8)(accumulator >> numBits));
+			}
+		}
+		return true;
+	}
+
+	// URIs in glTF are percent-encoded, e.g. spaces in file names become %20.
+	std::string DecodeUri(const std::string& uri) {
+		std::string result;
+		result.reserve(uri.size());
+		for (uint64 i = 0; i < uri.size(); ++i) {
+			if (uri[i] == '%' and i + 2 < uri.size()) {
+				char hex[3] = { uri[i + 1], uri[i + 2], 0 };
+				char* end;
+				long value = strtol(hex, &end, 16);
+				if (end == hex + 2) {
+					result += (char)value;
+					i += 2;
+					continue;
+				}
+			}
+			result += uri[i];
+		}
+		return result;
+	}
+
+	bool IsDataUri(const std::string& uri) {
+		return uri.compare(0, 5, "data:") == 0;
+	}
+
+	bool LoadBuffer(const JsonValue& buffer, const fs::path& directory, const uint8* binChunk, uint64 binChunkSize, bool isFirstBuffer,
+		GltfDocument& document) {
+		uint64 byteLength = buffer["byteLength"].AsUint64();
+		const std::string& uri = buffer["uri"].AsString();
+
+		GltfBuffer result = {};
+		if (uri.empty()) {
+			// Only the first buffer of a GLB file may refer to the binary chunk.
+			if (not isFirstBuffer or not binChunk or binChunkSize < byteLength) {
+				return false;
+			}
+			result = { binChunk, byteLength };
+		}
+		else if (IsDataUri(uri)) {
+			uint64 comma = uri.find(',');
+			if (comma == std::string::npos or uri.rfind(";base64", comma) == std::string::npos) {
+				return false;
+			}
+			std::vector<uint8>& decoded = document.DecodedBuffers.emplace_back();
+			if (not DecodeBase64(uri.data() + comma + 1, uri.size() - comma - 1, decoded) or decoded.size() < byteLength) {
+				return false;
+			}
+			result = { decoded.data(), byteLength };
+		}
+		else {
+			Ptr<MemoryMappedFile> file = MakePtr<MemoryMappedFile>();
+			if (not file->Open(directory / fs::u8path(DecodeUri(uri))) or file->Size() < byteLength) {
+				return false;
+			}
+			result = { file->Data(), byteLength };
+			document.MappedFiles.push_back(file);
+		}
+
+		document.Buffers.push_back(result);
+		return true;
+	}
+
+	bool IsValidIndex(int32 index, uint64 count) {
+		return index == GLTF_NONE or (index >= 0 and (uint64)index < count);
+	}
+
+	// Missing indices become GLTF_NONE, present but invalid ones a value IsValidIndex rejects.
+	int32 ReadIndex(const JsonValue& value) {
+		if (not value.IsNumber()) {
+			return GLTF_NONE;
+		}
+		int32 index = value.AsInt(INT32_MIN);
+		return (index >= 0 and index == value.AsNumber()) ? index : INT32_MIN;
+	}
+
+	// Rotation of an orthonormal, right-handed 3x3 matrix, given as columns.
+	void MatrixToQuaternion(const float* c0, const float* c1, const float* c2, float* q) {
+		float trace = c0[0] + c1[1] + c2[2];
+		if (trace > 0.f) {
+			float s = 0.5f / std::sqrt(trace + 1.f);
+			q[3] = 0.25f / s;
+			q[0] = (c1[2] - c2[1]) * s;
+			q[1] = (c2[0] - c0[2]) * s;
+			q[2] = (c0[1] - c1[0]) * s;
+		}
+		else if (c0[0] > c1[1] and c0[0] > c2[2]) {
+			float s = 2.f * std::sqrt(1.f + c0[0] - c1[1] - c2[2]);
+			q[3] = (c1[2] - c2[1]) / s;
+			q[0] = 0.25f * s;
+			q[1] = (c1[0] + c0[1]) / s;
+			q[2] = (c2[0] + c0[2]) / s;
+		}
+		else if (c1[1] > c2[2]) {
+			float s = 2.f * std::sqrt(1.f + c1[1] - c0[0] - c2[2]);
+			q[3] = (c2[0] - c0[2]) / s;
+			q[0] = (c1[0] + c0[1]) / s;
+			q[1] = 0.25f * s;
+			q[2] = (c2[1] + c1[2]) / s;
+		}
+		else {
+			float s = 2.f * std::sqrt(1.f + c2[2] - c0[0] - c1[1]);
+			q[3] = (c0[1] - c1[0]) / s;
+			q[0] = (c2[0] + c0[2]) / s;
+			q[1] = (c2[1] + c1[2]) / s;
+			q[2] = 0.25f * s;
+		}
+	}
+
+	void DecomposeMatrix(const float* m, GltfNode& node) {
+		float columns[3][3];
+		for (uint32 c = 0; c < 3; ++c) {
+			float length = std::sqrt(m[c * 4] * m[c * 4] + m[c * 4 + 1] * m[c * 4 + 1] + m[c * 4 + 2] * m[c * 4 + 2]);
+			node.Scale[c] = length;
+			for (uint32 r = 0; r < 3; ++r) {
+				columns[c][r] = (length > 0.f) ? m[c * 4 + r] / length : 0.f;
+			}
+		}
+
+		// A mirroring matrix has a negative determinant. The flip goes into the scale, so that the rotation stays a rotation.
+		float determinant = columns[0][0] * (columns[1][1] * columns[2][2] - columns[2][1] * columns[1][2])
+			- columns[1][0] * (columns[0][1] * columns[2][2] - columns[2][1] * columns[0][2])
+			+ columns[2][0] * (columns[0][1] * columns[1][2] - columns[1][1] * columns[0][2]);
+		if (determinant < 0.f) {
+			node.Scale[0] = -node.Scale[0];
+			for (uint32 r = 0; r < 3; ++r) {
+				columns[0][r] = -columns[0][r];
+			}
+		}
+
+		MatrixToQuaternion(columns[0], columns[1], columns[2], node.Rotation);
+		node.Translation[0] = m[12];
+		node.Translation[1] = m[13];
+		node.Translation[2] = m[14];
+	}
+
+	void ReadFloats(const JsonValue& array, float* out, uint32 count) {
+		if (array.Size() == count) {
+			for (uint32 i = 0; i < count; ++i) {
+				out[i] = array[i].AsFloat(out[i]);
+			}
+		}
+	}
+
+	int32 GetTextureImage(const JsonValue& textureInfo, const JsonValue& textures) {
+		int32 texture = ReadIndex(textureInfo["index"]);
+		if (texture == GLTF_NONE) {
+			return GLTF_NONE;
+		}
+		return ReadIndex(textures[(uint32)texture]["source"]);
+	}
+
+	bool ParseDocument(const JsonValue& root, const fs::path& directory, const uint8* binChunk, uint64 binChunkSize, GltfDocument& document) {
+		if (not root.IsObject() or root["asset"]["version"].AsString().compare(0, 2, "2.") != 0) {
+			return false;
+		}
+
+		const JsonValue& extensionsRequired = root["extensionsRequired"];
+		for (const JsonValue& extension : extensionsRequired.Elements) {
+			bool supported = false;
+			for (const char* name : SupportedRequiredExtensions) {
+				supported |= extension.AsString() == name;
+			}
+			if (not supported) {
+				return false;
+			}
+		}
+
+		const JsonValue& buffers = root["buffers"];
+		for (uint32 i = 0; i < buffers.Size(); ++i) {
+			if (not LoadBuffer(buffers[i], directory, binChunk, binChunkSize, i == 0, document)) {
+				return false;
+			}
+		}
+
+		const JsonValue& bufferViews = root["bufferViews"];
+		for (const JsonValue& view : bufferViews.Elements) {
+			GltfBufferView& result = document.BufferViews.emplace_back();
+			int32 buffer = ReadIndex(view["buffer"]);
+			result.ByteOffset = view["byteOffset"].AsUint64();
+			result.ByteLength = view["byteLength"].AsUint64();
+			result.ByteStride = view["byteStride"].AsUint();
+
+			if (buffer == GLTF_NONE or not IsValidIndex(buffer, document.Buffers.size())) {
+				return false;
+			}
+			result.Buffer = (uint32)buffer;
+
+			const GltfBuffer& data = document.Buffers[result.Buffer];
+			if (result.ByteOffset > data.Size or result.ByteLength > data.Size - result.ByteOffset) {
+				return false;
+			}
+		}
+
+		const JsonValue& accessors = root["accessors"];
+		for (const JsonValue& accessor : accessors.Elements) {
+			if (not accessor["sparse"].IsNull()) {
+				return false;
+			}
+
+			GltfAccessor& result = document.Accessors.emplace_back();
+			result.BufferView = ReadIndex(accessor["bufferView"]);
+			result.ByteOffset = accessor["byteOffset"].AsUint64();
+			result.Count = accessor["count"].AsUint();
+			result.ComponentType = accessor["componentType"].AsUint();
+			result.NumComponents = GetNumComponents(accessor["type"].AsString());
+			result.Normalized = accessor["normalized"].AsBool();
+
+			if (not IsValidIndex(result.BufferView, document.BufferViews.size()) or GetComponentSize(result.ComponentType) == 0
+				or result.NumComponents == 0) {
+				return false;
+			}
+		}
+
+		auto isAccessor = [&document](int32 index) { return IsValidIndex(index, document.Accessors.size()); };
+
+		const JsonValue& images = root["images"];
+		for (const JsonValue& image : images.Elements) {
+			GltfImage& result = document.Images.emplace_back();
+			const std::string& uri = image["uri"].AsString();
+			if (not uri.empty() and not IsDataUri(uri)) {
+				result.Path = directory / fs::u8path(DecodeUri(uri));
+			}
+		}
+
+		const JsonValue& textures = root["textures"];
+		const JsonValue& materials = root["materials"];
+		for (const JsonValue& material : materials.Elements) {
+			GltfMaterial& result = document.Materials.emplace_back();
+			result.Name = material["name"].AsString();
+
+			const JsonValue& pbr = material["pbrMetallicRoughness"];
+			ReadFloats(pbr["baseColorFactor"], result.BaseColorFactor, 4);
+			ReadFloats(material["emissiveFactor"], result.EmissiveFactor, 3);
+			result.MetallicFactor = pbr["metallicFactor"].AsFloat(1.f);
+			result.RoughnessFactor = pbr["roughnessFactor"].AsFloat(1.f);
+
+			result.BaseColorImage = GetTextureImage(pbr["baseColorTexture"], textures);
+			result.MetallicRoughnessImage = GetTextureImage(pbr["metallicRoughnessTexture"], textures);
+			result.NormalImage = GetTextureImage(material["normalTexture"], textures);
+			result.EmissiveImage = GetTextureImage(material["emissiveTexture"], textures);
+
+			for (int32 image : { result.BaseColorImage, result.MetallicRoughnessImage, result.NormalImage, result.EmissiveImage }) {
+				if (not IsValidIndex(image, document.Images.size())) {
+					return false;
+				}
+			}
+		}
+
+		const JsonValue& meshes = root["meshes"];
+		for (const JsonValue& mesh : meshes.Elements) {
+			GltfMesh& result = document.Meshes.emplace_back();
+			result.Name = mesh["name"].AsString();
+
+			for (const JsonValue& primitive : mesh["primitives"].Elements) {
+				GltfPrimitive& p = result.Primitives.emplace_back();
+				const JsonValue& attributes = primitive["attributes"];
+				p.Position = ReadIndex(attributes["POSITION"]);
+				p.Normal = ReadIndex(attributes["NORMAL"]);
+				p.Tangent = ReadIndex(attributes["TANGENT"]);
+				p.TexCoord0 = ReadIndex(attributes["TEXCOORD_0"]);
+				p.Joints0 = ReadIndex(attributes["JOINTS_0"]);
+				p.Weights0 = ReadIndex(attributes["WEIGHTS_0"]);
+				p.Indices = ReadIndex(primitive["indices"]);
+				p.Material = ReadIndex(primitive["material"]);
+				p.Mode = primitive["mode"].AsUint(EGltfPrimitiveModeTriangles);
+
+				for (int32 accessor : { p.Position, p.Normal, p.Tangent, p.TexCoord0, p.Joints0, p.Weights0, p.Indices }) {
+					if (not isAccessor(accessor)) {
+						return false;
+					}
+				}
+				if (not IsValidIndex(p.Material, document.Materials.size())) {
+					return false;
+				}
+			}
+		}
+
+		const JsonValue& skins = root["skins"];
+		const JsonValue& nodes = root["nodes"];
+		uint32 numNodes = nodes.Size();
+
+		for (const JsonValue& skin : skins.Elements) {
+			GltfSkin& result = document.Skins.emplace_back();
+			result.InverseBindMatrices = ReadIndex(skin["inverseBindMatrices"]);
+			if (not isAccessor(result.InverseBindMatrices)) {
+				return false;
+			}
+			for (const JsonValue& joint : skin["joints"].Elements) {
+				int32 node = ReadIndex(joint);
+				if (node == GLTF_NONE or not IsValidIndex(node, numNodes)) {
+					return false;
+				}
+				result.Joints.push_back((uint32)node);
+			}
+		}
+
+		document.Nodes.resize(numNodes);
+		for (uint32 i = 0; i < numNodes; ++i) {
+			const JsonValue& node = nodes[i];
+			GltfNode& result = document.Nodes[i];
+			result.Name = node["name"].AsString();
+			if (result.Name.empty()) {
+				result.Name = "Node" + std::to_string(i);
+			}
+			result.Mesh = ReadIndex(node["mesh"]);
+			result.Skin = ReadIndex(node["skin"]);
+			if (not IsValidIndex(result.Mesh, document.Meshes.size()) or not IsValidIndex(result.Skin, document.Skins.size())) {
+				return false;
+			}
+
+			if (node["matrix"].Size() == 16) {
+				float matrix[16];
+				for (uint32 j = 0; j < 16; ++j) {
+					matrix[j] = node["matrix"][j].AsFloat();
+				}
+				DecomposeMatrix(matrix, result);
+			}
+			else {
+				ReadFloats(node["translation"], result.Translation, 3);
+				ReadFloats(node["rotation"], result.Rotation, 4);
+				ReadFloats(node["scale"], result.Scale, 3);
+			}
+
+			for (const JsonValue& child : node["children"].Elements) {
+				int32 c = ReadIndex(child);
+				if (c == GLTF_NONE or not IsValidIndex(c, numNodes)) {
+					return false;
+				}
+				result.Children.push_back((uint32)c);
+			}
+		}
+
+		// Every node may only have one parent. Together with the check for cycles below, this makes the hierarchy a forest.
+		for (uint32 i = 0; i < numNodes; ++i) {
+			for (uint32 child : document.Nodes[i].Children) {
+				if (document.Nodes[child].Parent != GLTF_NONE or child == i) {
+					return false;
+				}
+				document.Nodes[child].Parent = (int32)i;
+			}
+		}
+		for (uint32 i = 0; i < numNodes; ++i) {
+			uint32 depth = 0;
+			for (int32 n = document.Nodes[i].Parent; n != GLTF_NONE; n = document.Nodes[n].Parent) {
+				if (++depth > numNodes) {
+					return false;
+				}
+			}
+		}
+
+		const JsonValue& scenes = root["scenes"];
+		if (scenes.Size() > 0) {
+			const JsonValue& scene = scenes[root["scene"].AsUint(0)];
+			for (const JsonValue& node : scene["nodes"].Elements) {
+				int32 n = ReadIndex(node);
+				if (n == GLTF_NONE or not IsValidIndex(n, numNodes) or document.Nodes[n].Parent != GLTF_NONE) {
+					return false;
+				}
+				document.SceneRoots.push_back((uint32)n);
+			}
+		}
+		else {
+			for (uint32 i = 0; i < numNodes; ++i) {
+				if (document.Nodes[i].Parent == GLTF_NONE) {
+					document.SceneRoots.push_back(i);
+				}
+			}
+		}
+
+		const JsonValue& animations = root["animations"];
+		for (const JsonValue& animation : animations.Elements) {
+			GltfAnimation& result = document.Animations.emplace_back();
+			result.Name = animation["name"].AsString();
+
+			for (const JsonValue& sampler : animation["samplers"].Elements) {
+				int32 input = ReadIndex(sampler["input"]);
+				int32 output = ReadIndex(sampler["output"]);
+				if (input == GLTF_NONE or output == GLTF_NONE or not isAccessor(input) or not isAccessor(output)) {
+					return false;
+				}
+
+				const std::string& interpolation = sampler["interpolation"].AsString();
+				EGltfInterpolation mode = (interpolation == "STEP") ? EGltfInterpolationStep
+					: (interpolation == "CUBICSPLINE") ? EGltfInterpolationCubicSpline
+					: EGltfInterpolationLinear;
+				result.Samplers.push_back({ (uint32)input, (uint32)output, mode });
+			}
+
+			for (const JsonValue& channel : animation["channels"].Elements) {
+				int32 sampler = ReadIndex(channel["sampler"]);
+				int32 node = ReadIndex(channel["target"]["node"]);
+				const std::string& path = channel["target"]["path"].AsString();
+
+				// Channels without a node belong to extensions and are skipped.
+				if (node == GLTF_NONE) {
+					continue;
+				}
+				if (sampler == GLTF_NONE or not IsValidIndex(sampler, result.Samplers.size()) or not IsValidIndex(node, numNodes)) {
+					return false;
+				}
+
+				EGltfAnimationPath target;
+				if (path == "translation") target = EGltfAnimationPathTranslation;
+				else if (path == "rotation") target = EGltfAnimationPathRotation;
+				else if (path == "scale") target = EGltfAnimationPathScale;
+				else if (path == "weights") target = EGltfAnimationPathWeights;
+				else return false;
+
+				result.Channels.push_back({ (uint32)sampler, node, target });
+			}
+		}
+
+		return true;
+	}
+
+	// Start of the accessor's data and the distance between its elements. Returns false if the elements don't fit into the buffer view.
+	bool GetAccessorData(const GltfDocument& document, const GltfAccessor& accessor, const uint8*& outData, uint64& outStride) {
+		uint64 elementSize = (uint64)GetComponentSize(accessor.ComponentType) * accessor.NumComponents;
+
+		if (accessor.BufferView == GLTF_NONE) {
+			outData = nullptr;
+			outStride = 0;
+			return true;
+		}
+
+		const GltfBufferView& view = document.BufferViews[accessor.BufferView];
+		outStride = view.ByteStride ? view.ByteStride : elementSize;
+
+		if (accessor.Count > 0) {
+			uint64 end = accessor.ByteOffset + outStride * (accessor.Count - 1) + elementSize;
+			if (end > view.ByteLength or end < accessor.ByteOffset) {
+				return false;
+			}
+		}
+
+		outData = document.Buffers[view.Buffer].Data + view.ByteOffset + accessor.ByteOffset;
+		return true;
+	}
+
+	float ReadComponent(const uint8* data, uint32 componentType, bool normalized) {
+		switch (componentType) {
+			case EGltfComponentTypeByte: {
+				int8 value = (int8)data[0];
+				return normalized ? Max(value / 127.f, -1.f) : (float)value;
+			}
+			case EGltfComponentTypeUnsignedByte: {
+				return normalized ? data[0] / 255.f : (float)data[0];
+			}
+			case EGltfComponentTypeShort: {
+				int16 value;
+				memcpy(&value, data, sizeof(value));
+				return normalized ? Max(value / 32767.f, -1.f) : (float)value;
+			}
+			case EGltfComponentTypeUnsignedShort: {
+				uint16 value;
+				memcpy(&value, data, sizeof(value));
+				return normalized ? value / 65535.f : (float)value;
+			}
+			case EGltfComponentTypeUnsignedInt: {
+				return (float)ReadUint32(data);
+			}
+			default: {
+				float value;
+				memcpy(&value, data, sizeof(value));
+				return value;
+			}
+		}
+	}
+
+	uint32 ReadUintComponent(const uint8* data, uint32 componentType) {
+		switch (componentType) {
+			case EGltfComponentTypeByte:
+			case EGltfComponentTypeUnsignedByte: return data[0];
+			case EGltfComponentTypeShort:
+			case EGltfComponentTypeUnsignedShort: {
+				uint16 value;
+				memcpy(&value, data, sizeof(value));
+				return value;
+			}
+			case EGltfComponentTypeUnsignedInt: return ReadUint32(data);
+			default: {
+				float value;
+				memcpy(&value, data, sizeof(value));
+				return (value > 0.f) ? (uint32)value : 0;
+			}
+		}
+	}
+
+	void ReadFloatsScalar(const uint8* source, uint64 sourceStride, const GltfAccessor& accessor, uint32 numComponents, uint8* destination,
+		uint64 destinationStride) {
+		uint32 componentSize = GetComponentSize(accessor.ComponentType);
+		for (uint32 i = 0; i < accessor.Count; ++i) {
+			float* out = (float*)(destination + i * destinationStride);
+			const uint8* in = source + i * sourceStride;
+			for (uint32 c = 0; c < numComponents; ++c) {
+				out[c] = ReadComponent(in + c * componentSize, accessor.ComponentType, accessor.Normalized);
+			}
+		}
+	}
+
+#ifdef GLTF_SSE
+	// Loads the first NumComponents components of an element into the lanes of a vector, converted to float. The element is copied to a
+	// local first, so that the loads never reach past the end of the buffer.
+	template <uint32 NumComponents, uint32 ComponentType>
+	__m128 LoadElement(const uint8* data, __m128 scale) {
+		constexpr uint32 size = NumComponents * (ComponentType == EGltfComponentTypeFloat ? 4 : (ComponentType == EGltfComponentTypeShort
+			or ComponentType == EGltfComponentTypeUnsignedShort) ? 2 : 1);
+
+		alignas(16) uint8 element[16] = {};
+		memcpy(element, data, size);
+		__m128i bits = _mm_load_si128((const __m128i*)element);
+
+		switch (ComponentType) {
+			case EGltfComponentTypeFloat: {
+				return _mm_castsi128_ps(bits);
+			}
+			case EGltfComponentTypeUnsignedByte: {
+				__m128i zero = _mm_setzero_si128();
+				__m128i values = _mm_unpacklo_epi16(_mm_unpacklo_epi8(bits, zero), zero);
+				return _mm_mul_ps(_mm_cvtepi32_ps(values), scale);
+			}
+			case EGltfComponentTypeByte: {
+				// Sign extension by duplicating each value into the high half and shifting it back down.
+				__m128i words = _mm_srai_epi16(_mm_unpacklo_epi8(bits, bits), 8);
+				__m128i values = _mm_srai_epi32(_mm_unpacklo_epi16(words, words), 16);
+				return _mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(values), scale), _mm_set1_ps(-1.f));
+			}
+			case EGltfComponentTypeUnsignedShort: {
+				__m128i values = _mm_unpacklo_epi16(bits, _mm_setzero_si128());
+				return _mm_mul_ps(_mm_cvtepi32_ps(values), scale);
+			}
+			default: { // Short.
+				__m128i values = _mm_srai_epi32(_mm_unpacklo_epi16(bits, bits), 16);
+				return _mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(values), scale), _mm_set1_ps(-1.f));
+			}
+		}
+	}
+
+	template <uint32 NumComponents>
+	void StoreElement(uint8* destination, __m128 value) {
+		if constexpr (NumComponents == 4) {
+			_mm_storeu_ps((float*)destination, value);
+		}
+		else {
+			alignas(16) float lanes[4];
+			_mm_store_ps(lanes, value);
+			memcpy(destination, lanes, NumComponents * sizeof(float));
+		}
+	}
+
+	template <uint32 NumComponents, uint32 ComponentType>
+	void ConvertElements(const uint8* source, uint64 sourceStride, uint32 count, float scale, uint8* destination, uint64 destinationStride) {
+		__m128 scaleVector = _mm_set1_ps(scale);
+		for (uint32 i = 0; i < count; ++i) {
+			StoreElement<NumComponents>(destination, LoadElement<NumComponents, ComponentType>(source, scaleVector));
+			source += sourceStride;
+			destination += destinationStride;
+		}
+	}
+
+	template <uint32 ComponentType>
+	bool ConvertElements(uint32 numComponents, const uint8* source, uint64 sourceStride, uint32 count, float scale, uint8* destination,
+		uint64 destinationStride) {
+		switch (numComponents) {
+			case 1: ConvertElements<1, ComponentType>(source, sourceStride, count, scale, destination, destinationStride); return true;
+			case 2: ConvertElements<2, ComponentType>(source, sourceStride, count, scale, destination, destinationStride); return true;
+			case 3: ConvertElements<3, ComponentType>(source, sourceStride, count, scale, destination, destinationStride); return true;
+			case 4: ConvertElements<4, ComponentType>(source, sourceStride, count, scale, destination, destinationStride); return true;
+			default: return false;
+		}
+	}
+
+	// Handles up to 4 components of every type except 32-bit integers, which SSE2 can't convert without losing the upper bit.
+	bool ReadFloatsSSE(const uint8* source, uint64 sourceStride, const GltfAccessor& accessor, uint32 numComponents, uint8* destination,
+		uint64 destinationStride) {
+		bool normalized = accessor.Normalized;
+		uint32 count = accessor.Count;
+		switch (accessor.ComponentType) {
+			case EGltfComponentTypeFloat:
+				return ConvertElements<EGltfComponentTypeFloat>(numComponents, source, sourceStride, count, 1.f, destination, destinationStride);
+			case EGltfComponentTypeUnsignedByte:
+				return ConvertElements<EGltfComponentTypeUnsignedByte>(numComponents, source, sourceStride, count, normalized ? 1.f / 255.f : 1.f, destination, destinationStride);
+			case EGltfComponentTypeByte:
+				return ConvertElements<EGltfComponentTypeByte>(numComponents, source, sourceStride, count, normalized ? 1.f / 127.f : 1.f, destination, destinationStride);
+			case EGltfComponentTypeUnsignedShort:
+				return ConvertElements<EGltfComponentTypeUnsignedShort>(numComponents, source, sourceStride, count, normalized ? 1.f / 65535.f : 1.f, destination, destinationStride);
+			case EGltfComponentTypeShort:
+				return ConvertElements<EGltfComponentTypeShort>(numComponents, source, sourceStride, count, normalized ? 1.f / 32767.f : 1.f, destination, destinationStride);
+			default:
+				return false;
+		}
+	}
+#endif
+}
+
+bool LoadGltfDocument(const fs::path& filename, GltfDocument& outDocument) {
+	outDocument = GltfDocument();
+
+	Ptr<MemoryMappedFile> file = MakePtr<MemoryMappedFile>();
+	if (not file->Open(filename)) {
+		return false;
+	}
+
+	const uint8* data = file->Data();
+	uint64 size = file->Size();
+
+	const char* json = (const char*)data;
+	uint64 jsonSize = size;
+	const uint8* binChunk = nullptr;
+	uint64 binChunkSize = 0;
+
+	if (size >= 12 and ReadUint32(data) == GlbMagic) {
+		if (ReadUint32(data + 4) != 2 or ReadUint32(data + 8) > size) {
+			return false;
+		}
+		size = ReadUint32(data + 8);
+
+		// The JSON chunk comes first, an optional binary chunk second. Unknown chunks are skipped.
+		json = nullptr;
+		for (uint64 offset = 12; offset + 8 <= size;) {
+			uint64 chunkSize = ReadUint32(data + offset);
+			uint32 chunkType = ReadUint32(data + offset + 4);
+			offset += 8;
+			if (chunkSize > size - offset) {
+				return false;
+			}
+
+			if (chunkType == GlbChunkJson and not json) {
+				json = (const char*)data + offset;
+				jsonSize = chunkSize;
+			}
+			else if (chunkType == GlbChunkBin and json and not binChunk) {
+				binChunk = data + offset;
+				binChunkSize = chunkSize;
+			}
+			offset += (chunkSize + 3) & ~3ull;
+		}
+
+		if (not json) {
+			return false;
+		}
+	}
+
+	// Some exporters pad the JSON chunk with zeros instead of spaces.
+	while (jsonSize > 0 and json[jsonSize - 1] == 0) {
+		--jsonSize;
+	}
+
+	JsonValue root;
+	if (not ParseJson(json, jsonSize, root)) {
+		return false;
+	}
+
+	outDocument.MappedFiles.push_back(file);
+	if (not ParseDocument(root, filename.parent_path(), binChunk, binChunkSize, outDocument)) {
+		outDocument = GltfDocument();
+		return false;
+	}
+	return true;
+}
+
+bool ReadGltfFloats(const GltfDocument& document, const GltfAccessor& accessor, uint32 numComponents, void* destination, uint64 destinationStride) {
+	assert(numComponents <= accessor.NumComponents);
+
+	const uint8* source;
+	uint64 sourceStride;
+	if (not GetAccessorData(document, accessor, source, sourceStride)) {
+		return false;
+	}
+
+	uint8* out = (uint8*)destination;
+	if (not source) {
+		for (uint32 i = 0; i < accessor.Count; ++i) {
+			memset(out + i * destinationStride, 0, numComponents * sizeof(float));
+		}
+		return true;
+	}
+
+#ifdef GLTF_SSE
+	if (ReadFloatsSSE(source, sourceStride, accessor, numComponents, out, destinationStride)) {
+		return true;
+	}
+#endif
+
+	ReadFloatsScalar(source, sourceStride, accessor, numComponents, out, destinationStride);
+	return true;
+}
+
+bool ReadGltfUints(const GltfDocument& document, const GltfAccessor& accessor, uint32 numComponents, void* destination, uint64 destinationStride) {
+	assert(numComponents <= accessor.NumComponents);
+
+	const uint8* source;
+	uint64 sourceStride;
+	if (not GetAccessorData(document, accessor, source, sourceStride)) {
+		return false;
+	}
+
+	uint8* out = (uint8*)destination;
+	if (not source) {
+		for (uint32 i = 0; i < accessor.Count; ++i) {
+			memset(out + i * destinationStride, 0, numComponents * sizeof(uint32));
+		}
+		return true;
+	}
+
+	uint32 count = accessor.Count;
+	uint32 componentSize = GetComponentSize(accessor.ComponentType);
+	bool packed = numComponents == accessor.NumComponents and sourceStride == (uint64)componentSize * numComponents
+		and destinationStride == numComponents * sizeof(uint32);
+
+	// Index buffers are the common case here, and are usually tightly packed.
+	if (packed and accessor.ComponentType == EGltfComponentTypeUnsignedInt) {
+		memcpy(out, source, (uint64)count * numComponents * sizeof(uint32));
+		return true;
+	}
+
+	uint64 i = 0;
+#ifdef GLTF_SSE
+	if (packed and accessor.ComponentType == EGltfComponentTypeUnsignedShort) {
+		uint64 numValues = (uint64)count * numComponents;
+		__m128i zero = _mm_setzero_si128();
+		for (; i + 8 <= numValues; i += 8) {
+			__m128i values = _mm_loadu_si128((const __m128i*)(source + i * 2));
+			_mm_storeu_si128((__m128i*)(out + i * 4), _mm_unpacklo_epi16(values, zero));
+			_mm_storeu_si128((__m128i*)(out + i * 4 + 16), _mm_unpackhi_epi16(values, zero));
+		}
+		for (; i < numValues; ++i) {
+			((uint32*)out)[i] = ReadUintComponent(source + i * 2, accessor.ComponentType);
+		}
+		return true;
+	}
+#endif
+
+	for (; i < count; ++i) {
+		uint32* element = (uint32*)(out + i * destinationStride);
+		const uint8* in = source + i * sourceStride;
+		for (uint32 c = 0; c < numComponents; ++c) {
+			element[c] = ReadUintComponent(in + c * componentSize, accessor.ComponentType);
+		}
+	}
+	return true;
+}
@@ -0,0 +1,170 @@
+#pragma once
+
+#include "../pch.h"
+#include "memoryMappedFile.h"
+
+#include <string>
+
+// Reader for glTF 2.0 files (.gltf with external or embedded buffers, and binary .glb). Independent of D3D and of the engine's math types.
+//
+// The document only holds indices into its arrays and pointers into the buffers, which stay memory-mapped for as long as it lives.
+// Accessor data is converted straight from the buffers into the caller's memory, so nothing is copied twice. Features the reader doesn't
+// handle (sparse accessors, compression extensions listed as required) make LoadGltfDocument fail, so that callers can fall back to a
+// general importer.
+
+#define GLTF_NONE -1
+
+enum EGltfComponentType {
+	EGltfComponentTypeByte			= 5120,
+	EGltfComponentTypeUnsignedByte	= 5121,
+	EGltfComponentTypeShort			= 5122,
+	EGltfComponentTypeUnsignedShort	= 5123,
+	EGltfComponentTypeUnsignedInt	= 5125,
+	EGltfComponentTypeFloat			= 5126,
+};
+
+enum EGltfPrimitiveMode {
+	EGltfPrimitiveModePoints		= 0,
+	EGltfPrimitiveModeLines			= 1,
+	EGltfPrimitiveModeLineLoop		= 2,
+	EGltfPrimitiveModeLineStrip		= 3,
+	EGltfPrimitiveModeTriangles		= 4,
+	EGltfPrimitiveModeTriangleStrip	= 5,
+	EGltfPrimitiveModeTriangleFan	= 6,
+};
+
+enum EGltfAnimationPath {
+	EGltfAnimationPathTranslation,
+	EGltfAnimationPathRotation,
+	EGltfAnimationPathScale,
+	EGltfAnimationPathWeights, // Morph targets. Read, but not supported by the engine.
+};
+
+enum EGltfInterpolation {
+	EGltfInterpolationLinear,
+	EGltfInterpolationStep,
+	EGltfInterpolationCubicSpline, // Outputs hold an in-tangent, the value and an out-tangent per keyframe.
+};
+
+struct GltfBufferView {
+	uint32 Buffer;
+	uint64 ByteOffset;
+	uint64 ByteLength;
+	uint32 ByteStride; // 0 if tightly packed.
+};
+
+struct GltfAccessor {
+	int32 BufferView;  // GLTF_NONE means all zeros.
+	uint64 ByteOffset; // Relative to the buffer view.
+	uint32 Count;
+	uint32 ComponentType;
+	uint32 NumComponents; // 1 for SCALAR up to 16 for MAT4.
+	bool Normalized;
+};
+
+struct GltfPrimitive {
+	int32 Position = GLTF_NONE; // Accessor indices.
+	int32 Normal = GLTF_NONE;
+	int32 Tangent = GLTF_NONE;
+	int32 TexCoord0 = GLTF_NONE;
+	int32 Joints0 = GLTF_NONE;
+	int32 Weights0 = GLTF_NONE;
+	int32 Indices = GLTF_NONE;
+	int32 Material = GLTF_NONE;
+	uint32 Mode = EGltfPrimitiveModeTriangles;
+};
+
+struct GltfMesh {
+	std::string Name;
+	std::vector<GltfPrimitive> Primitives;
+};
+
+struct GltfNode {
+	std::string Name; // "Node<index>" for unnamed nodes, so that joints can be looked up by name.
+	int32 Mesh = GLTF_NONE;
+	int32 Skin = GLTF_NONE;
+	int32 Parent = GLTF_NONE;
+	std::vector<uint32> Children;
+
+	// Always filled, also if the file stores a matrix instead. The matrix is then decomposed, which is exact for the affine matrices
+	// glTF requires, as long as they don't shear.
+	float Translation[3] = { 0.f, 0.f, 0.f };
+	float Rotation[4] = { 0.f, 0.f, 0.f, 1.f }; // xyzw.
+	float Scale[3] = { 1.f, 1.f, 1.f };
+};
+
+struct GltfSkin {
+	std::vector<uint32> Joints; // Node indices. JOINTS_0 indexes into this array.
+	int32 InverseBindMatrices = GLTF_NONE; // Accessor of column-major 4x4 matrices. Identity if missing.
+};
+
+struct GltfAnimationSampler {
+	uint32 Input;  // Accessor of the timestamps in seconds.
+	uint32 Output; // Accessor of the values.
+	EGltfInterpolation Interpolation;
+};
+
+struct GltfAnimationChannel {
+	uint32 Sampler;
+	int32 Node;
+	EGltfAnimationPath Path;
+};
+
+struct GltfAnimation {
+	std::string Name;
+	std::vector<GltfAnimationSampler> Samplers;
+	std::vector<GltfAnimationChannel> Channels;
+};
+
+struct GltfMaterial {
+	std::string Name;
+	float BaseColorFactor[4] = { 1.f, 1.f, 1.f, 1.f };
+	float EmissiveFactor[3] = { 0.f, 0.f, 0.f };
+	float MetallicFactor = 1.f;
+	float RoughnessFactor = 1.f;
+
+	// Image indices, resolved through the texture.
+	int32 BaseColorImage = GLTF_NONE;
+	int32 NormalImage = GLTF_NONE;
+	int32 MetallicRoughnessImage = GLTF_NONE; // Roughness in green, metallic in blue.
+	int32 EmissiveImage = GLTF_NONE;
+};
+
+struct GltfImage {
+	fs::path Path; // Resolved against the directory of the file. Empty for images embedded in a buffer or a data URI.
+};
+
+struct GltfBuffer {
+	const uint8* Data;
+	uint64 Size;
+};
+
+struct GltfDocument {
+	std::vector<GltfBuffer> Buffers;
+	std::vector<GltfBufferView> BufferViews;
+	std::vector<GltfAccessor> Accessors;
+	std::vector<GltfMesh> Meshes;
+	std::vector<GltfNode> Nodes;
+	std::vector<GltfSkin> Skins;
+	std::vector<GltfAnimation> Animations;
+	std::vector<GltfMaterial> Materials;
+	std::vector<GltfImage> Images;
+
+	std::vector<uint32> SceneRoots; // Root nodes of the default scene.
+
+	// Backing memory of 'Buffers'.
+	std::vector<Ptr<MemoryMappedFile>> MappedFiles;
+	std::vector<std::vector<uint8>> DecodedBuffers; // Base64 data URIs.
+};
+
+// Returns false if the file can't be read, is malformed, or needs a feature this reader doesn't handle. Every index in the document is
+// validated, but accessors are only checked against their buffers when they are read.
+bool LoadGltfDocument(const fs::path& filename, GltfDocument& outDocument);
+
+// Converts 'accessor' to floats and writes 'numComponents' of them per element to 'destination', advancing by 'destinationStride' bytes
+// per element. Normalized integers are mapped to [0, 1] or [-1, 1], other integers are converted as they are. 'numComponents' must not
+// exceed the accessor's. Returns false if the accessor doesn't fit into its buffer.
+bool ReadGltfFloats(const GltfDocument& document, const GltfAccessor& accessor, uint32 numComponents, void* destination, uint64 destinationStride);
+
+// Same for integer accessors. Float components are truncated.
+bool ReadGltfUints(const GltfDocument& document, const GltfAccessor& accessor, uint32 numComponents, void* destination, uint64 destinationStride);
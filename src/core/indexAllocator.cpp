@@ -0,0 +1,201 @@
+#include "indexAllocator.h"
+
+#include <bit>
+#include <thread>
+
+namespace {
+	std::atomic<uint32> nextCacheSlot = 0;
+	thread_local uint32 threadCacheSlot = nextCacheSlot.fetch_add(1, std::memory_order_relaxed) % INDEX_ALLOCATOR_NUM_CACHES;
+
+	uint64 PackFreeListHead(uint32 index, uint64 previousHead) {
+		return (((previousHead >> 32) + 1) << 32) | index;
+	}
+}
+
+void IndexAllocator::Initialize(uint32 capacity) {
+	assert(capacity < INDEX_ALLOCATOR_INVALID);
+
+	_capacity = capacity;
+	_numTouched = 0;
+	_freeListHead = INDEX_ALLOCATOR_INVALID;
+	_next = std::make_unique<std::atomic<uint32>[]>(capacity);
+
+	for (Cache& cache : _caches) {
+		cache.Count = 0;
+	}
+}
+
+IndexAllocator::Cache& IndexAllocator::LockCache(uint32 slot) {
+	Cache& cache = _caches[slot];
+	while (cache.Locked.exchange(true, std::memory_order_acquire)) {
+		std::this_thread::yield();
+	}
+	return cache;
+}
+
+uint32 IndexAllocator::PopFreeList() {
+	uint64 head = _freeListHead.load(std::memory_order_acquire);
+	while ((uint32)head != INDEX_ALLOCATOR_INVALID) {
+		// '_next' of the top may change under us if another thread pops and pushes it again, but then the counter changed as well and
+		// the exchange fails.
+		uint32 next = _next[(uint32)head].load(std::memory_order_relaxed);
+		if (_freeListHead.compare_exchange_weak(head, PackFreeListHead(next, head), std::memory_order_acquire, std::memory_order_acquire)) {
+			return (uint32)head;
+		}
+	}
+	return INDEX_ALLOCATOR_INVALID;
+}
+
+void IndexAllocator::PushFreeList(uint32 index) {
+	uint64 head = _freeListHead.load(std::memory_order_relaxed);
+	do {
+		_next[index].store((uint32)head, std::memory_order_relaxed);
+	} while (not _freeListHead.compare_exchange_weak(head, PackFreeListHead(index, head), std::memory_order_release, std::memory_order_relaxed));
+}
+
+void IndexAllocator::Refill(Cache& cache) {
+	constexpr uint32 batchSize = INDEX_ALLOCATOR_CACHE_SIZE / 2;
+
+	// Returned indices first, so that the table stays compact.
+	while (cache.Count < batchSize) {
+		uint32 index = PopFreeList();
+		if (index == INDEX_ALLOCATOR_INVALID) {
+			break;
+		}
+		cache.Indices[cache.Count++] = index;
+	}
+
+	if (cache.Count == 0 and _numTouched.load(std::memory_order_relaxed) < _capacity) {
+		uint32 first = _numTouched.fetch_add(batchSize, std::memory_order_relaxed);
+		if (first < _capacity) {
+			uint32 count = Min(batchSize, _capacity - first);
+			for (uint32 i = count; i-- > 0;) {
+				cache.Indices[cache.Count++] = first + i;
+			}
+		}
+	}
+}
+
+uint32 IndexAllocator::Allocate() {
+	Cache& cache = LockCache(threadCacheSlot);
+	if (cache.Count == 0) {
+		Refill(cache);
+	}
+	uint32 index = (cache.Count > 0) ? cache.Indices[--cache.Count] : INDEX_ALLOCATOR_INVALID;
+	cache.Locked.store(false, std::memory_order_release);
+
+	if (index != INDEX_ALLOCATOR_INVALID) {
+		return index;
+	}
+
+	// The table is full, unless other threads hold free indices in their caches.
+	for (uint32 slot = 0; slot < INDEX_ALLOCATOR_NUM_CACHES; ++slot) {
+		Cache& other = LockCache(slot);
+		while (other.Count > 0) {
+			PushFreeList(other.Indices[--other.Count]);
+		}
+		other.Locked.store(false, std::memory_order_release);
+	}
+	return PopFreeList();
+}
+
+void IndexAllocator::Free(uint32 index) {
+	assert(index < _capacity);
+
+	Cache& cache = LockCache(threadCacheSlot);
+	if (cache.Count == INDEX_ALLOCATOR_CACHE_SIZE) {
+		while (cache.Count > INDEX_ALLOCATOR_CACHE_SIZE / 2) {
+			PushFreeList(cache.Indices[--cache.Count]);
+		}
+	}
+	cache.Indices[cache.Count++] = index;
+	cache.Locked.store(false, std::memory_order_release);
+}
+
+void BuddyAllocator::Initialize(uint32 capacity) {
+	std::lock_guard lock(_mutex);
+
+	_capacity = capacity;
+	_numFree = capacity;
+
+	uint32 numOrders = std::bit_width(capacity);
+	_freeBlocks.assign(numOrders, {});
+	for (uint32 order = 0; order < numOrders; ++order) {
+		_freeBlocks[order].assign(((capacity >> order) + 63) / 64, 0);
+	}
+
+	// One top-level block per set bit of the capacity, largest first, so that each one is aligned to its size.
+	uint32 offset = 0;
+	for (uint32 order = numOrders; order-- > 0;) {
+		if (capacity & (1u << order)) {
+			uint32 block = offset >> order;
+			_freeBlocks[order][block / 64] |= 1ull << (block % 64);
+			offset += 1u << order;
+		}
+	}
+}
+
+uint32 BuddyAllocator::GetOrder(uint32 count) {
+	return std::bit_width(count - 1);
+}
+
+bool BuddyAllocator::TakeBlock(uint32 order, uint32& outOffset) {
+	std::vector<uint64>& bits = _freeBlocks[order];
+	for (uint32 word = 0; word < bits.size(); ++word) {
+		if (bits[word]) {
+			uint32 bit = std::countr_zero(bits[word]);
+			bits[word] &= ~(1ull << bit);
+			outOffset = (word * 64 + bit) << order;
+			return true;
+		}
+	}
+	return false;
+}
+
+uint32 BuddyAllocator::Allocate(uint32 count) {
+	if (count == 0 or count > _capacity) {
+		return INDEX_ALLOCATOR_INVALID;
+	}
+
+	uint32 order = GetOrder(count);
+
+	std::lock_guard lock(_mutex);
+
+	for (uint32 sourceOrder = order; sourceOrder < _freeBlocks.size(); ++sourceOrder) {
+		uint32 offset;
+		if (TakeBlock(sourceOrder, offset)) {
+			// Split down to the requested size, freeing the upper halves.
+			while (sourceOrder > order) {
+				--sourceOrder;
+				uint32 buddy = (offset >> sourceOrder) + 1;
+				_freeBlocks[sourceOrder][buddy / 64] |= 1ull << (buddy % 64);
+			}
+			_numFree -= 1u << order;
+			return offset;
+		}
+	}
+	return INDEX_ALLOCATOR_INVALID;
+}
+
+void BuddyAllocator::Free(uint32 offset, uint32 count) {
+	uint32 order = GetOrder(count);
+	assert(offset % (1u << order) == 0 and offset + (1u << order) <= _capacity);
+
+	std::lock_guard lock(_mutex);
+
+	_numFree += 1u << order;
+
+	while (order + 1 < _freeBlocks.size()) {
+		uint32 buddy = (offset >> order) ^ 1;
+		std::vector<uint64>& bits = _freeBlocks[order];
+		if (buddy / 64 >= bits.size() or not (bits[buddy / 64] & (1ull << (buddy % 64)))) {
+			break;
+		}
+		bits[buddy / 64] &= ~(1ull << (buddy % 64));
+		offset &= ~(1u << order);
+		++order;
+	}
+
+	uint32 block = offset >> order;
+	_freeBlocks[order][block / 64] |= 1ull << (block % 64);
+}
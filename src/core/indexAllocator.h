@@ -0,0 +1,79 @@
+#pragma once
+
+#include "../pch.h"
+
+#include <atomic>
+
+// Allocators for slots of fixed-size tables, like descriptor heaps. They only hand out indices, so they don't depend on D3D.
+
+#define INDEX_ALLOCATOR_INVALID UINT32_MAX
+#define INDEX_ALLOCATOR_CACHE_SIZE 32
+#define INDEX_ALLOCATOR_NUM_CACHES 64
+
+// Single indices, from any thread without a global lock. Every thread works on a small cache of free indices; caches are refilled from a
+// lock-free free list of returned indices, or with a batch of never used ones, and spill half of their indices back when they overflow.
+// Threads are assigned to caches round-robin, so a cache is only shared if more threads than caches allocate. Indices are 32 bit.
+class IndexAllocator {
+public:
+	IndexAllocator() = default;
+	IndexAllocator(const IndexAllocator&) = delete;
+	IndexAllocator& operator=(const IndexAllocator&) = delete;
+
+	void Initialize(uint32 capacity);
+
+	// Returns INDEX_ALLOCATOR_INVALID if all indices are in use. Only then are the caches of other threads searched.
+	uint32 Allocate();
+	void Free(uint32 index);
+
+	uint32 Capacity() const { return _capacity; }
+	uint32 HighWaterMark() const { return Min(_numTouched.load(std::memory_order_relaxed), _capacity); } // Indices ever handed out.
+
+private:
+	struct alignas(64) Cache {
+		std::atomic<bool> Locked = false;
+		uint32 Count = 0;
+		uint32 Indices[INDEX_ALLOCATOR_CACHE_SIZE];
+	};
+
+	Cache& LockCache(uint32 slot);
+	void Refill(Cache& cache);
+	uint32 PopFreeList();
+	void PushFreeList(uint32 index);
+
+	uint32 _capacity = 0;
+	std::atomic<uint32> _numTouched = 0; // Indices at and above this have never been handed out.
+
+	// Intrusive stack through '_next'. The head holds the top index in its lower and a counter in its upper 32 bits, so that a pop can't
+	// succeed on a head which was popped and pushed again in between.
+	std::atomic<uint64> _freeListHead = INDEX_ALLOCATOR_INVALID;
+	std::unique_ptr<std::atomic<uint32>[]> _next;
+
+	Cache _caches[INDEX_ALLOCATOR_NUM_CACHES];
+};
+
+// Contiguous ranges, with a binary buddy system: sizes are rounded up to powers of two, freed blocks merge with their buddies right away.
+// Capacities which aren't a power of two are split into several top-level blocks. Protected by a mutex, since ranges are allocated far
+// less often than single indices.
+class BuddyAllocator {
+public:
+	void Initialize(uint32 capacity);
+
+	// Returns the first index, or INDEX_ALLOCATOR_INVALID. 'count' must be passed to Free again.
+	uint32 Allocate(uint32 count);
+	void Free(uint32 offset, uint32 count);
+
+	uint32 Capacity() const { return _capacity; }
+	uint32 NumFree() const { return _numFree; }
+
+private:
+	static uint32 GetOrder(uint32 count);
+	bool TakeBlock(uint32 order, uint32& outOffset);
+
+	uint32 _capacity = 0;
+	uint32 _numFree = 0;
+
+	// One bit per block of each order, set if the block is free.
+	std::vector<std::vector<uint64>> _freeBlocks;
+
+	std::mutex _mutex;
+};
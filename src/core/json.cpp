@@ -0,0 +1,258 @@
+#include "json.h"
+
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+	const JsonValue NullValue;
+	const std::string EmptyString;
+
+	// Deeper documents are rejected instead of overflowing the stack.
+	constexpr uint32 MaxDepth = 256;
+
+	struct JsonParser {
+		const char* Current;
+		const char* End;
+
+		void SkipWhitespace() {
+			while (Current < End and (*Current == ' ' or *Current == '\t' or *Current == '\n' or *Current == '\r')) {
+				++Current;
+			}
+		}
+
+		bool Consume(char c) {
+			SkipWhitespace();
+			if (Current < End and *Current == c) {
+				++Current;
+				return true;
+			}
+			return false;
+		}
+
+		bool ConsumeLiteral(const char* literal) {
+			uint64 length = strlen(literal);
+			if ((uint64)(End - Current) < length or memcmp(Current, literal, length) != 0) {
+				return false;
+			}
+			Current += length;
+			return true;
+		}
+
+		static void AppendUtf8(std::string& out, uint32 codepoint) {
+			if (codepoint < 0x80) {
+				out += (char)codepoint;
+			}
+			else if (codepoint < 0x800) {
+				out += (char)(0xC0 | (codepoint >> 6));
+				out += (char)(0x80 | (codepoint & 0x3F));
+			}
+			else if (codepoint < 0x10000) {
+				out += (char)(0xE0 | (codepoint >> 12));
+				out += (char)(0x80 | ((codepoint >> 6) & 0x3F));
+				out += (char)(0x80 | (codepoint & 0x3F));
+			}
+			else {
+				out += (char)(0xF0 | (codepoint >> 18));
+				out += (char)(0x80 | ((codepoint >> 12) & 0x3F));
+				out += (char)(0x80 | ((codepoint >> 6) & 0x3F));
+				out += (char)(0x80 | (codepoint & 0x3F));
+			}
+		}
+
+		bool ParseHex4(uint32& outValue) {
+			if (End - Current < 4) {
+				return false;
+			}
+			outValue = 0;
+			for (uint32 i = 0; i < 4; ++i) {
+				char c = *Current++;
+				uint32 digit;
+				if (c >= '0' and c <= '9') digit = c - '0';
+				else if (c >= 'a' and c <= 'f') digit = c - 'a' + 10;
+				else if (c >= 'A' and c <= 'F') digit = c - 'A' + 10;
+				else return false;
+				outValue = (outValue << 4) | digit;
+			}
+			return true;
+		}
+
+		// 'Current' is behind the opening quote.
+		bool ParseString(std::string& out) {
+			while (Current < End) {
+				// Copy runs without escapes at once.
+				const char* runStart = Current;
+				while (Current < End and *Current != '"' and *Current != '\\' and (uint8)*Current >= 0x20) {
+					++Current;
+				}
+				out.append(runStart, Current - runStart);
+
+				if (Current == End or (uint8)*Current < 0x20) {
+					return false;
+				}
+				if (*Current++ == '"') {
+					return true;
+				}
+
+				if (Current == End) {
+					return false;
+				}
+				char escape = *Current++;
+				switch (escape) {
+					case '"': out += '"'; break;
+					case '\\': out += '\\'; break;
+					case '/': out += '/'; break;
+					case 'b': out += '\b'; break;
+					case 'f': out += '\f'; break;
+					case 'n': out += '\n'; break;
+					case 'r': out += '\r'; break;
+					case 't': out += '\t'; break;
+					case 'u': {
+						uint32 codepoint;
+						if (not ParseHex4(codepoint)) {
+							return false;
+						}
+						if (codepoint >= 0xD800 and codepoint < 0xDC00) {
+							uint32 low;
+							if (not ConsumeLiteral("\\u") or not ParseHex4(low) or low < 0xDC00 or low >= 0xE000) {
+								return false;
+							}
+							codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+						}
+						else if (codepoint >= 0xDC00 and codepoint < 0xE000) {
+							return false;
+						}
+						AppendUtf8(out, codepoint);
+						break;
+					}
+					default: return false;
+				}
+			}
+			return false;
+		}
+
+		bool ParseNumber(double& out) {
+			// strtod needs a terminated string, and the number may end exactly at the end of the buffer.
+			char buffer[64];
+			const char* start = Current;
+			if (Current < End and *Current == '-') ++Current;
+			while (Current < End and ((*Current >= '0' and *Current <= '9') or *Current == '.' or *Current == 'e' or *Current == 'E'
+				or *Current == '+' or *Current == '-')) {
+				++Current;
+			}
+
+			uint64 length = Current - start;
+			if (length == 0 or length >= sizeof(buffer)) {
+				return false;
+			}
+			memcpy(buffer, start, length);
+			buffer[length] = 0;
+
+			char* parsedEnd;
+			out = strtod(buffer, &parsedEnd);
+			return parsedEnd == buffer + length;
+		}
+
+		bool ParseValue(JsonValue& out, uint32 depth) {
+			if (depth > MaxDepth) {
+				return false;
+			}
+
+			SkipWhitespace();
+			if (Current == End) {
+				return false;
+			}
+
+			switch (*Current) {
+				case '{': {
+					++Current;
+					out.Type = EJsonTypeObject;
+					if (Consume('}')) {
+						return true;
+					}
+					do {
+						if (not Consume('"')) {
+							return false;
+						}
+						auto& member = out.Members.emplace_back();
+						if (not ParseString(member.first) or not Consume(':') or not ParseValue(member.second, depth + 1)) {
+							return false;
+						}
+					} while (Consume(','));
+					return Consume('}');
+				}
+				case '[': {
+					++Current;
+					out.Type = EJsonTypeArray;
+					if (Consume(']')) {
+						return true;
+					}
+					do {
+						if (not ParseValue(out.Elements.emplace_back(), depth + 1)) {
+							return false;
+						}
+					} while (Consume(','));
+					return Consume(']');
+				}
+				case '"': {
+					++Current;
+					out.Type = EJsonTypeString;
+					return ParseString(out.String);
+				}
+				case 't': {
+					out.Type = EJsonTypeBool;
+					out.Bool = true;
+					return ConsumeLiteral("true");
+				}
+				case 'f': {
+					out.Type = EJsonTypeBool;
+					out.Bool = false;
+					return ConsumeLiteral("false");
+				}
+				case 'n': {
+					out.Type = EJsonTypeNull;
+					return ConsumeLiteral("null");
+				}
+				default: {
+					out.Type = EJsonTypeNumber;
+					return ParseNumber(out.Number);
+				}
+			}
+		}
+	};
+}
+
+const JsonValue& JsonValue::operator[](const char* key) const {
+	for (const auto& member : Members) {
+		if (member.first == key) {
+			return member.second;
+		}
+	}
+	return NullValue;
+}
+
+const JsonValue& JsonValue::operator[](uint32 index) const {
+	return (index < Elements.size()) ? Elements[index] : NullValue;
+}
+
+const std::string& JsonValue::AsString() const {
+	return (Type == EJsonTypeString) ? String : EmptyString;
+}
+
+bool ParseJson(const char* text, uint64 length, JsonValue& outValue) {
+	outValue = JsonValue();
+
+	JsonParser parser = { text, text + length };
+
+	// Skip a UTF-8 byte order mark.
+	if (length >= 3 and memcmp(text, "\xEF\xBB\xBF", 3) == 0) {
+		parser.Current += 3;
+	}
+
+	if (not parser.ParseValue(outValue, 0)) {
+		outValue = JsonValue();
+		return false;
+	}
+
+	parser.SkipWhitespace();
+	return parser.Current == parser.End;
+}
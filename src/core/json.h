@@ -0,0 +1,53 @@
+#pragma once
+
+#include "../pch.h"
+
+#include <string>
+
+// Minimal JSON reader, enough for asset formats like glTF. Values are parsed into a tree up front, lookups of missing members and
+// out-of-range elements return a null value instead of failing, so optional fields can be read without checks.
+
+enum EJsonType {
+	EJsonTypeNull,
+	EJsonTypeBool,
+	EJsonTypeNumber,
+	EJsonTypeString,
+	EJsonTypeArray,
+	EJsonTypeObject,
+};
+
+struct JsonValue {
+	EJsonType Type = EJsonTypeNull;
+	bool Bool = false;
+	double Number = 0.0;
+	std::string String;
+	std::vector<JsonValue> Elements;
+	std::vector<std::pair<std::string, JsonValue>> Members; // In file order.
+
+	bool IsNull() const { return Type == EJsonTypeNull; }
+	bool IsNumber() const { return Type == EJsonTypeNumber; }
+	bool IsString() const { return Type == EJsonTypeString; }
+	bool IsArray() const { return Type == EJsonTypeArray; }
+	bool IsObject() const { return Type == EJsonTypeObject; }
+
+	// Number of elements of arrays. 0 for everything else.
+	uint32 Size() const { return (uint32)Elements.size(); }
+
+	const JsonValue& operator[](const char* key) const;
+	const JsonValue& operator[](uint32 index) const;
+
+	// Return 'fallback' if the value has a different type, or doesn't fit into the requested one.
+	bool AsBool(bool fallback = false) const { return (Type == EJsonTypeBool) ? Bool : fallback; }
+	double AsNumber(double fallback = 0.0) const { return (Type == EJsonTypeNumber) ? Number : fallback; }
+	float AsFloat(float fallback = 0.f) const { return (Type == EJsonTypeNumber) ? (float)Number : fallback; }
+	int32 AsInt(int32 fallback = 0) const { return IsNumberInRange(-2147483648.0, 2147483647.0) ? (int32)Number : fallback; }
+	uint32 AsUint(uint32 fallback = 0) const { return IsNumberInRange(0.0, 4294967295.0) ? (uint32)Number : fallback; }
+	uint64 AsUint64(uint64 fallback = 0) const { return IsNumberInRange(0.0, 18446744073709549568.0) ? (uint64)Number : fallback; }
+	const std::string& AsString() const; // Empty for non-strings.
+
+private:
+	bool IsNumberInRange(double low, double high) const { return Type == EJsonTypeNumber and Number >= low and Number <= high; }
+};
+
+// Returns false on syntax errors. Strings are decoded to UTF-8, including \u escapes and surrogate pairs.
+bool ParseJson(const char* text, uint64 length, JsonValue& outValue);
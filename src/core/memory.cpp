@@ -1,6 +1,7 @@
 #include "memory.h"
 #include <algorithm>
 #include "math.h"
+#include "memoryTracking.h"
 
 #ifdef _MSC_VER
 struct Struct {
@@ -16,6 +17,8 @@ namespace {
 		auto result = static_cast<MemoryBlock*>(data);
 		result->Start = (uint8*)data + blockSize;
 		result->Size = size;
+		result->Capacity = size;
+		TRACK_ALLOCATION(EMemoryCategoryArenaBlocks, blockSize + size);
 		return result;
 	}
 }
@@ -85,6 +88,7 @@ void MemoryArena::Free() {
 	Reset();
 	for (MemoryBlock* block = FreeBlocks; block; ) {
 		MemoryBlock* next = block->Next;
+		TRACK_FREE(EMemoryCategoryArenaBlocks, AlignTo(sizeof(MemoryBlock), 64) + block->Capacity);
 		_aligned_free(block);
 		block = next;
 	}
@@ -35,6 +35,7 @@ struct MemoryBlock {
 	uint8* Start;
 	uint8* Current;
 	uint64 Size;
+	uint64 Capacity; // Size when the block was allocated.
 	MemoryBlock* Next;
 };
 
@@ -0,0 +1,99 @@
+#include "memoryMappedFile.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+bool MemoryMappedFile::Open(const fs::path& filename) {
+	Close();
+
+	_file = CreateFileW(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (_file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	if (not GetFileSizeEx(_file, &size) or size.QuadPart == 0) {
+		Close();
+		return false;
+	}
+
+	_mapping = CreateFileMappingW(_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (not _mapping) {
+		Close();
+		return false;
+	}
+
+	_data = (const uint8*)MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+	if (not _data) {
+		Close();
+		return false;
+	}
+
+	_size = (uint64)size.QuadPart;
+	return true;
+}
+
+void MemoryMappedFile::Close() {
+	if (_data) {
+		UnmapViewOfFile(_data);
+	}
+	if (_mapping) {
+		CloseHandle(_mapping);
+	}
+	if (_file != INVALID_HANDLE_VALUE) {
+		CloseHandle(_file);
+	}
+
+	_data = nullptr;
+	_size = 0;
+	_mapping = nullptr;
+	_file = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+bool MemoryMappedFile::Open(const fs::path& filename) {
+	Close();
+
+	int file = open(filename.c_str(), O_RDONLY);
+	if (file < 0) {
+		return false;
+	}
+
+	struct stat info;
+	if (fstat(file, &info) != 0 or info.st_size == 0) {
+		close(file);
+		return false;
+	}
+
+	// The mapping stays valid after the descriptor is closed.
+	void* data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+	close(file);
+
+	if (data == MAP_FAILED) {
+		return false;
+	}
+
+	madvise(data, (size_t)info.st_size, MADV_SEQUENTIAL);
+
+	_data = (const uint8*)data;
+	_size = (uint64)info.st_size;
+	return true;
+}
+
+void MemoryMappedFile::Close() {
+	if (_data) {
+		munmap((void*)_data, (size_t)_size);
+	}
+
+	_data = nullptr;
+	_size = 0;
+}
+
+#endif
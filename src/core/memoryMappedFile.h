@@ -0,0 +1,28 @@
+#pragma once
+
+#include "../pch.h"
+
+// Read-only mapping of a whole file. Pages are only read from disk when they are touched.
+class MemoryMappedFile {
+public:
+	MemoryMappedFile() = default;
+	MemoryMappedFile(const MemoryMappedFile&) = delete;
+	MemoryMappedFile& operator=(const MemoryMappedFile&) = delete;
+	~MemoryMappedFile() { Close(); }
+
+	bool Open(const fs::path& filename);
+	void Close();
+
+	const uint8* Data() const { return _data; }
+	uint64 Size() const { return _size; }
+	bool IsOpen() const { return _data != nullptr; }
+
+private:
+	const uint8* _data = nullptr;
+	uint64 _size = 0;
+
+#ifdef _WIN32
+	HANDLE _file = INVALID_HANDLE_VALUE;
+	HANDLE _mapping = nullptr;
+#endif
+};
@@ -0,0 +1,84 @@
+#include "memoryTracking.h"
+
+const char* MemoryCategoryNames[EMemoryCategoryCount] = {
+	"Arena blocks",
+	"Meshes",
+	"Animation",
+	"Buffers",
+	"Textures",
+	"Upload",
+	"Graveyard",
+};
+
+MemoryTracker GlobalMemoryTracker;
+
+void MemoryTracker::UpdatePeak(Counter& counter, uint64 bytes) {
+	uint64 peak = counter.PeakBytes.load(std::memory_order_relaxed);
+	while (bytes > peak and not counter.PeakBytes.compare_exchange_weak(peak, bytes, std::memory_order_relaxed)) {}
+}
+
+MemorySnapshot MemoryTracker::Snapshot(uint64 frameId) const {
+	MemorySnapshot result = {};
+	result.FrameId = frameId;
+	for (uint32 i = 0; i < EMemoryCategoryCount; i++) {
+		uint64 packed = _counters[i].Packed.load(std::memory_order_relaxed);
+		result.Categories[i].CurrentBytes = packed & BytesMask;
+		result.Categories[i].NumAllocations = (uint32)(packed >> CountShift);
+		result.Categories[i].PeakBytes = _counters[i].PeakBytes.load(std::memory_order_relaxed);
+	}
+	return result;
+}
+
+void MemoryTracker::NewFrame(uint64 frameId) {
+	_snapshots[_snapshotWriteIndex] = Snapshot(frameId);
+	_snapshotWriteIndex = (_snapshotWriteIndex + 1) % MAX_NUM_MEMORY_SNAPSHOTS;
+	_numSnapshots = Min(_numSnapshots + 1, (uint32)MAX_NUM_MEMORY_SNAPSHOTS);
+}
+
+const MemorySnapshot* MemoryTracker::GetFrameSnapshot(uint32 framesAgo) const {
+	if (framesAgo >= _numSnapshots) {
+		return nullptr;
+	}
+	return &_snapshots[(_snapshotWriteIndex + MAX_NUM_MEMORY_SNAPSHOTS - 1 - framesAgo) % MAX_NUM_MEMORY_SNAPSHOTS];
+}
+
+std::string FormatMemoryReport(const MemorySnapshot& snapshot) {
+	std::string result;
+	char line[160];
+
+	snprintf(line, sizeof(line), "%-14s %12s %12s %12s\n", "Category", "Current MB", "Peak MB", "Allocations");
+	result += line;
+
+	uint64 totalBytes = 0;
+	uint64 totalAllocations = 0;
+	for (uint32 i = 0; i < EMemoryCategoryCount; i++) {
+		const MemoryCategoryUsage& usage = snapshot.Categories[i];
+		snprintf(line, sizeof(line), "%-14s %12.2f %12.2f %12u\n", MemoryCategoryNames[i], usage.CurrentBytes / (1024.0 * 1024.0),
+			usage.PeakBytes / (1024.0 * 1024.0), usage.NumAllocations);
+		result += line;
+
+		// Retired resources are still counted in their own category.
+		if (i != EMemoryCategoryGraveyard) {
+			totalBytes += usage.CurrentBytes;
+			totalAllocations += usage.NumAllocations;
+		}
+	}
+
+	snprintf(line, sizeof(line), "%-14s %12.2f %12s %12llu\n", "Total", totalBytes / (1024.0 * 1024.0), "", (unsigned long long)totalAllocations);
+	result += line;
+	return result;
+}
+
+std::string FormatMemoryLeakReport(const MemorySnapshot& snapshot) {
+	std::string result;
+	for (uint32 i = 0; i < EMemoryCategoryCount; i++) {
+		const MemoryCategoryUsage& usage = snapshot.Categories[i];
+		if (usage.NumAllocations > 0 or usage.CurrentBytes > 0) {
+			char line[160];
+			snprintf(line, sizeof(line), "Memory leak: %s still holds %llu bytes in %u allocation%s.\n", MemoryCategoryNames[i],
+				(unsigned long long)usage.CurrentBytes, usage.NumAllocations, (usage.NumAllocations == 1) ? "" : "s");
+			result += line;
+		}
+	}
+	return result;
+}
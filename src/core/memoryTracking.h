@@ -0,0 +1,143 @@
+#pragma once
+
+#include "../pch.h"
+
+#include <atomic>
+#include <string>
+
+// Counters of where memory goes, per category: bytes and allocations currently held, and the peak of the bytes. Owners report their
+// allocations and frees with TRACK_ALLOCATION and TRACK_FREE, which compile to nothing with ENABLE_MEMORY_TRACKING set to 0. With it set
+// to 1, each is a single relaxed atomic add on a counter which packs bytes and number of allocations, plus a compare with the peak.
+//
+// GPU resources are counted with the size the device reserves for them, whether placed or committed. Memory which lives in an arena is
+// counted as the arena's blocks, not again by whatever lives in it.
+
+#define ENABLE_MEMORY_TRACKING 0
+
+#define MAX_NUM_MEMORY_SNAPSHOTS 256
+
+enum EMemoryCategory : uint8 {
+	EMemoryCategoryArenaBlocks,
+	EMemoryCategoryMeshes,      // Vertices and triangles of CPU meshes which don't live in an arena.
+	EMemoryCategoryAnimation,   // Keyframes of animation clips.
+	EMemoryCategoryBuffers,     // GPU buffers, including ranges of shared buffers.
+	EMemoryCategoryTextures,    // GPU textures, including render targets.
+	EMemoryCategoryUpload,      // The upload ring, and upload buffers which are released once the GPU has read them.
+	EMemoryCategoryGraveyard,   // Retired GPU resources waiting for the GPU. Also counted in their own category until they are released.
+
+	EMemoryCategoryCount,
+};
+
+extern const char* MemoryCategoryNames[EMemoryCategoryCount];
+
+struct MemoryCategoryUsage {
+	uint64 CurrentBytes;
+	uint64 PeakBytes;
+	uint32 NumAllocations; // Currently held.
+};
+
+struct MemorySnapshot {
+	uint64 FrameId;
+	MemoryCategoryUsage Categories[EMemoryCategoryCount];
+};
+
+class MemoryTracker {
+public:
+	MemoryTracker() = default;
+	MemoryTracker(const MemoryTracker&) = delete;
+	MemoryTracker& operator=(const MemoryTracker&) = delete;
+
+	// Any thread.
+	void Allocate(EMemoryCategory category, uint64 size) {
+		Counter& counter = _counters[category];
+		uint64 previous = counter.Packed.fetch_add(size + (1ull << CountShift), std::memory_order_relaxed);
+		uint64 bytes = (previous & BytesMask) + size;
+		if (bytes > counter.PeakBytes.load(std::memory_order_relaxed)) {
+			UpdatePeak(counter, bytes);
+		}
+	}
+
+	// Any thread. 'size' is the sum of the 'count' allocations freed.
+	void Free(EMemoryCategory category, uint64 size, uint32 count = 1) {
+		_counters[category].Packed.fetch_sub(size + ((uint64)count << CountShift), std::memory_order_relaxed);
+	}
+
+	// Any thread. Categories are read one after the other, so allocations which move between categories meanwhile may be counted twice.
+	MemorySnapshot Snapshot(uint64 frameId = 0) const;
+
+	// One thread only. Keeps a snapshot of each of the last MAX_NUM_MEMORY_SNAPSHOTS frames.
+	void NewFrame(uint64 frameId);
+
+	// 0 is the last frame. Returns nullptr for frames which weren't snapshot (yet).
+	const MemorySnapshot* GetFrameSnapshot(uint32 framesAgo) const;
+
+private:
+	// Up to 1 TB and 16M allocations per category.
+	static constexpr uint32 CountShift = 40;
+	static constexpr uint64 BytesMask = (1ull << CountShift) - 1;
+
+	struct alignas(64) Counter {
+		std::atomic<uint64> Packed = 0; // Bytes in the low bits, allocations in the high ones.
+		std::atomic<uint64> PeakBytes = 0;
+	};
+
+	static void UpdatePeak(Counter& counter, uint64 bytes);
+
+	Counter _counters[EMemoryCategoryCount];
+
+	MemorySnapshot _snapshots[MAX_NUM_MEMORY_SNAPSHOTS] = {};
+	uint32 _snapshotWriteIndex = 0;
+	uint32 _numSnapshots = 0;
+};
+
+extern MemoryTracker GlobalMemoryTracker;
+
+#if ENABLE_MEMORY_TRACKING
+
+#define TRACK_ALLOCATION(category, size) GlobalMemoryTracker.Allocate(category, size)
+#define TRACK_FREE(category, size) GlobalMemoryTracker.Free(category, size)
+#define TRACK_FREES(category, size, count) GlobalMemoryTracker.Free(category, size, count)
+#define MEMORY_TRACKING_NEW_FRAME(frameId) GlobalMemoryTracker.NewFrame(frameId)
+
+#else
+
+#define TRACK_ALLOCATION(category, size)
+#define TRACK_FREE(category, size)
+#define TRACK_FREES(category, size, count)
+#define MEMORY_TRACKING_NEW_FRAME(frameId)
+
+#endif
+
+// For standard containers whose memory belongs to a category, e.g. std::vector<float, TrackedAllocator<float, EMemoryCategoryAnimation>>.
+template<typename T, EMemoryCategory Category>
+struct TrackedAllocator {
+	using value_type = T;
+
+	template<typename U>
+	struct rebind {
+		using other = TrackedAllocator<U, Category>;
+	};
+
+	TrackedAllocator() = default;
+	template<typename U>
+	TrackedAllocator(const TrackedAllocator<U, Category>&) {}
+
+	T* allocate(size_t n) {
+		TRACK_ALLOCATION(Category, n * sizeof(T));
+		return std::allocator<T>().allocate(n);
+	}
+
+	void deallocate(T* pointer, size_t n) {
+		TRACK_FREE(Category, n * sizeof(T));
+		std::allocator<T>().deallocate(pointer, n);
+	}
+
+	template<typename U>
+	bool operator==(const TrackedAllocator<U, Category>&) const { return true; }
+};
+
+// A row per category, with totals. For the breakdown of a scene, or a log.
+std::string FormatMemoryReport(const MemorySnapshot& snapshot);
+
+// The categories which still hold allocations, e.g. at shutdown. Empty if there are none.
+std::string FormatMemoryLeakReport(const MemorySnapshot& snapshot);
@@ -0,0 +1,642 @@
+#include "mipGenerator.h"
+#include "threading.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(_M_X64) or defined(__SSE2__)
+#include <emmintrin.h>
+#define MIP_GENERATOR_SSE
+#endif
+
+namespace {
+	constexpr double Pi = 3.14159265358979323846;
+
+	// Filter support radius in destination pixels.
+	constexpr double BoxSupport = 0.5;
+	constexpr double KaiserSupport = 3.0;
+	constexpr double KaiserAlpha = 4.0;
+	constexpr double LanczosSupport = 3.0;
+
+	constexpr uint32 MinPixelsForParallel = 256 * 256;
+	constexpr uint32 MinRowsPerBand = 16;
+	constexpr uint32 TargetNumBands = 32;
+
+	constexpr uint32 NumAlphaHistogramBins = 4096;
+
+	// Linear encoding of an sRGB value, given as float in [0, 1].
+	double SRGBToLinear(double c) {
+		return (c <= 0.04045) ? (c / 12.92) : std::pow((c + 0.055) / 1.055, 2.4);
+	}
+
+	double LinearToSRGB(double c) {
+		return (c <= 0.0031308) ? (c * 12.92) : (1.055 * std::pow(c, 1.0 / 2.4) - 0.055);
+	}
+
+	struct SRGBTables {
+		static constexpr uint32 NumBuckets = 4096;
+
+		float Decode[256];
+
+		// Encoding looks up the code at the lower end of one of the uniform buckets in linear space and then steps up if the value is past the
+		// midpoint to the next code. The steepest part of the curve covers less than one code per bucket, so a single step gives exact rounding.
+		float Threshold[257]; // Smallest linear value which rounds to each code. The last entry is never reached.
+		uint8 BucketCode[NumBuckets];
+
+		SRGBTables() {
+			for (uint32 c = 0; c < 256; ++c) {
+				Decode[c] = (float)SRGBToLinear(c / 255.0);
+				Threshold[c] = (c == 0) ? 0.f : (float)SRGBToLinear((c - 0.5) / 255.0);
+			}
+			Threshold[256] = 2.f;
+
+			uint32 code = 0;
+			for (uint32 b = 0; b < NumBuckets; ++b) {
+				float lower = b / (float)NumBuckets;
+				while (lower >= Threshold[code + 1]) {
+					++code;
+				}
+				BucketCode[b] = (uint8)code;
+			}
+		}
+
+		// 'linear' must be in [0, 1].
+		static uint32 GetBucket(float linear) {
+			return Min((uint32)(linear * NumBuckets), NumBuckets - 1);
+		}
+
+		uint8 Encode(float linear, uint32 bucket) const {
+			uint32 code = BucketCode[bucket];
+			code += linear >= Threshold[code + 1];
+			return (uint8)code;
+		}
+	};
+
+	const SRGBTables& GetSRGBTables() {
+		static SRGBTables tables;
+		return tables;
+	}
+
+	uint32 FloatBits(float f) { uint32 u; memcpy(&u, &f, sizeof(u)); return u; }
+	float BitsToFloat(uint32 u) { float f; memcpy(&f, &u, sizeof(f)); return f; }
+
+	// Round to nearest even. Overflows become infinity, NaNs stay NaNs.
+	uint16 FloatToHalf(float value) {
+		uint32 f = FloatBits(value);
+		uint32 sign = f & 0x80000000;
+		f ^= sign;
+
+		uint32 result;
+		if (f >= 0x47800000) {
+			result = (f > 0x7f800000) ? 0x7e00 : 0x7c00;
+		}
+		else if (f < 0x38800000) {
+			// Denormal or zero. Adding 0.5 lines the mantissa up so that the FPU does the rounding.
+			result = FloatBits(BitsToFloat(f) + 0.5f) - FloatBits(0.5f);
+		}
+		else {
+			uint32 mantissaOdd = (f >> 13) & 1;
+			f += ((uint32)(15 - 127) << 23) + 0xfff;
+			f += mantissaOdd;
+			result = f >> 13;
+		}
+		return (uint16)(result | (sign >> 16));
+	}
+
+	float HalfToFloat(uint16 h) {
+		const uint32 shiftedExponent = 0x7c00 << 13;
+		uint32 f = ((uint32)h & 0x7fff) << 13;
+		uint32 exponent = shiftedExponent & f;
+		f += (uint32)(127 - 15) << 23;
+
+		if (exponent == shiftedExponent) {
+			f += (uint32)(128 - 16) << 23; // Infinity or NaN.
+		}
+		else if (exponent == 0) {
+			f += 1 << 23; // Denormal, renormalize.
+			f = FloatBits(BitsToFloat(f) - BitsToFloat(113 << 23));
+		}
+		return BitsToFloat(f | (((uint32)h & 0x8000) << 16));
+	}
+
+	bool HasAlpha(EMipFormat format) {
+		return format == EMipFormatRGBA8 or format == EMipFormatRGBA16F or format == EMipFormatRGBA32F;
+	}
+
+	double Sinc(double x) {
+		if (std::abs(x) < 1e-6) {
+			return 1.0;
+		}
+		x *= Pi;
+		return std::sin(x) / x;
+	}
+
+	// Zeroth-order modified Bessel function of the first kind.
+	double Bessel0(double x) {
+		double sum = 1.0;
+		double term = 1.0;
+		double halfX = x * 0.5;
+		for (uint32 k = 1; k < 32; ++k) {
+			term *= (halfX / k) * (halfX / k);
+			sum += term;
+			if (term < sum * 1e-12) {
+				break;
+			}
+		}
+		return sum;
+	}
+
+	double GetFilterSupport(EMipFilter filter) {
+		switch (filter) {
+			case EMipFilterKaiser: return KaiserSupport;
+			case EMipFilterLanczos: return LanczosSupport;
+			default: return BoxSupport;
+		}
+	}
+
+	double EvaluateFilter(EMipFilter filter, double x) {
+		x = std::abs(x);
+		switch (filter) {
+			case EMipFilterKaiser: {
+				if (x >= KaiserSupport) {
+					return 0.0;
+				}
+				double t = x / KaiserSupport;
+				return Sinc(x) * Bessel0(KaiserAlpha * std::sqrt(1.0 - t * t)) / Bessel0(KaiserAlpha);
+			}
+			case EMipFilterLanczos:
+				return (x < LanczosSupport) ? Sinc(x) * Sinc(x / LanczosSupport) : 0.0;
+			default:
+				return (x <= BoxSupport) ? 1.0 : 0.0;
+		}
+	}
+
+	// Resampling weights along one axis. Every destination pixel has the same number of taps, unused ones have a weight of 0.
+	// Source indices are clamped to the edge.
+	struct FilterTaps {
+		uint32 NumTaps;
+		std::vector<uint32> Indices;
+		std::vector<float> Weights;
+	};
+
+	// Source pixels with a non-zero weight for the destination pixel centered at 'center'. The box filter weights by area coverage,
+	// which also handles odd sizes, the others sample the kernel at the source pixel centers.
+	void GetFilterRange(EMipFilter filter, double center, double radius, int32& outFirst, int32& outLast) {
+		if (filter == EMipFilterBox) {
+			outFirst = (int32)std::floor(center - radius);
+			outLast = (int32)std::ceil(center + radius) - 1;
+		}
+		else {
+			outFirst = (int32)std::floor(center - radius - 0.5) + 1;
+			outLast = (int32)std::ceil(center + radius - 0.5) - 1;
+		}
+	}
+
+	FilterTaps ComputeFilterTaps(EMipFilter filter, uint32 srcSize, uint32 dstSize) {
+		double scale = (double)srcSize / dstSize;
+		double radius = GetFilterSupport(filter) * scale;
+
+		FilterTaps taps;
+		taps.NumTaps = 1;
+		for (uint32 i = 0; i < dstSize; ++i) {
+			int32 first, last;
+			GetFilterRange(filter, (i + 0.5) * scale, radius, first, last);
+			taps.NumTaps = Max(taps.NumTaps, (uint32)(last - first + 1));
+		}
+
+		taps.Indices.resize((size_t)dstSize * taps.NumTaps);
+		taps.Weights.resize((size_t)dstSize * taps.NumTaps);
+
+		std::vector<double> weights(taps.NumTaps);
+
+		for (uint32 i = 0; i < dstSize; ++i) {
+			double center = (i + 0.5) * scale;
+			int32 first, last;
+			GetFilterRange(filter, center, radius, first, last);
+
+			double sum = 0.0;
+			for (uint32 t = 0; t < taps.NumTaps; ++t) {
+				int32 j = first + (int32)t;
+				if (j > last) {
+					weights[t] = 0.0;
+				}
+				else if (filter == EMipFilterBox) {
+					weights[t] = std::fmax(std::fmin(j + 1.0, center + radius) - std::fmax((double)j, center - radius), 0.0);
+				}
+				else {
+					weights[t] = EvaluateFilter(filter, (j + 0.5 - center) / scale);
+				}
+				sum += weights[t];
+			}
+
+			for (uint32 t = 0; t < taps.NumTaps; ++t) {
+				int32 j = first + (int32)t;
+				taps.Indices[(size_t)i * taps.NumTaps + t] = (uint32)std::clamp(j, 0, (int32)srcSize - 1);
+				taps.Weights[(size_t)i * taps.NumTaps + t] = (float)(weights[t] / sum);
+			}
+		}
+
+		return taps;
+	}
+
+	// Converts one row of a level in its storage format to linear RGBA floats.
+	void LoadLinearRow(EMipFormat format, bool isSRGB, const uint8* row, uint32 width, float* out) {
+		const SRGBTables& srgb = GetSRGBTables();
+		const float* decode = srgb.Decode;
+		constexpr float normalize = 1.f / 255.f;
+
+		switch (format) {
+			case EMipFormatR8:
+				for (uint32 x = 0; x < width; ++x) {
+					out[x * 4 + 0] = row[x] * normalize;
+					out[x * 4 + 1] = 0.f;
+					out[x * 4 + 2] = 0.f;
+					out[x * 4 + 3] = 1.f;
+				}
+				break;
+			case EMipFormatRG8:
+				for (uint32 x = 0; x < width; ++x) {
+					out[x * 4 + 0] = row[x * 2 + 0] * normalize;
+					out[x * 4 + 1] = row[x * 2 + 1] * normalize;
+					out[x * 4 + 2] = 0.f;
+					out[x * 4 + 3] = 1.f;
+				}
+				break;
+			case EMipFormatRGBA8:
+				for (uint32 x = 0; x < width; ++x) {
+					for (uint32 c = 0; c < 3; ++c) {
+						out[x * 4 + c] = isSRGB ? decode[row[x * 4 + c]] : row[x * 4 + c] * normalize;
+					}
+					out[x * 4 + 3] = row[x * 4 + 3] * normalize;
+				}
+				break;
+			case EMipFormatRGBA16F: {
+				const uint16* halfs = (const uint16*)row;
+				for (uint32 i = 0; i < width * 4; ++i) {
+					out[i] = HalfToFloat(halfs[i]);
+				}
+				break;
+			}
+			case EMipFormatRGBA32F:
+				memcpy(out, row, (size_t)width * 4 * sizeof(float));
+				break;
+		}
+	}
+
+	void StoreLinearRow(EMipFormat format, bool isSRGB, const float* in, uint32 width, float alphaScale, uint8* row) {
+		const SRGBTables& srgb = GetSRGBTables();
+
+		auto unorm = [](float v) {
+			return (uint8)(std::fmin(std::fmax(v, 0.f), 1.f) * 255.f + 0.5f);
+		};
+
+		switch (format) {
+			case EMipFormatR8:
+				for (uint32 x = 0; x < width; ++x) {
+					row[x] = unorm(in[x * 4 + 0]);
+				}
+				break;
+			case EMipFormatRG8:
+				for (uint32 x = 0; x < width; ++x) {
+					row[x * 2 + 0] = unorm(in[x * 4 + 0]);
+					row[x * 2 + 1] = unorm(in[x * 4 + 1]);
+				}
+				break;
+			case EMipFormatRGBA8: {
+#ifdef MIP_GENERATOR_SSE
+				const __m128 scale = _mm_setr_ps(1.f, 1.f, 1.f, alphaScale);
+				const __m128 zero = _mm_setzero_ps();
+				const __m128 one = _mm_set1_ps(1.f);
+				const __m128 unormScale = _mm_set1_ps(255.f);
+				const __m128 half = _mm_set1_ps(0.5f);
+				const __m128 bucketScale = _mm_set1_ps((float)SRGBTables::NumBuckets);
+				const __m128 maxBucket = _mm_set1_ps((float)(SRGBTables::NumBuckets - 1));
+
+				for (uint32 x = 0; x < width; ++x) {
+					__m128 v = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(in + x * 4), scale), zero), one);
+					__m128i codes = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(v, unormScale), half));
+					codes = _mm_packus_epi16(_mm_packs_epi32(codes, codes), codes);
+					uint32 packed = (uint32)_mm_cvtsi128_si32(codes);
+					memcpy(row + x * 4, &packed, sizeof(packed));
+
+					if (isSRGB) {
+						alignas(16) float values[4];
+						alignas(16) int32 buckets[4];
+						_mm_store_ps(values, v);
+						_mm_store_si128((__m128i*)buckets, _mm_cvttps_epi32(_mm_min_ps(_mm_mul_ps(v, bucketScale), maxBucket)));
+						for (uint32 c = 0; c < 3; ++c) {
+							row[x * 4 + c] = srgb.Encode(values[c], (uint32)buckets[c]);
+						}
+					}
+				}
+#else
+				for (uint32 x = 0; x < width; ++x) {
+					for (uint32 c = 0; c < 3; ++c) {
+						float v = std::fmin(std::fmax(in[x * 4 + c], 0.f), 1.f);
+						row[x * 4 + c] = isSRGB ? srgb.Encode(v, SRGBTables::GetBucket(v)) : unorm(v);
+					}
+					row[x * 4 + 3] = unorm(in[x * 4 + 3] * alphaScale);
+				}
+#endif
+				break;
+			}
+			case EMipFormatRGBA16F: {
+				// Negative lobes of the sharper filters would ring around bright texels, which turns into black halos.
+				uint16* halfs = (uint16*)row;
+				for (uint32 x = 0; x < width; ++x) {
+					for (uint32 c = 0; c < 3; ++c) {
+						halfs[x * 4 + c] = FloatToHalf(std::fmax(in[x * 4 + c], 0.f));
+					}
+					halfs[x * 4 + 3] = FloatToHalf(std::fmin(std::fmax(in[x * 4 + 3] * alphaScale, 0.f), 1.f));
+				}
+				break;
+			}
+			case EMipFormatRGBA32F: {
+				float* floats = (float*)row;
+				for (uint32 x = 0; x < width; ++x) {
+					for (uint32 c = 0; c < 3; ++c) {
+						floats[x * 4 + c] = std::fmax(in[x * 4 + c], 0.f);
+					}
+					floats[x * 4 + 3] = std::fmin(std::fmax(in[x * 4 + 3] * alphaScale, 0.f), 1.f);
+				}
+				break;
+			}
+		}
+	}
+
+	// One output pixel is one 4-wide vector, so the inner loops are the same for every format.
+	void FilterRowHorizontal(const float* src, const FilterTaps& taps, uint32 dstWidth, float* dst) {
+		const uint32* indices = taps.Indices.data();
+		const float* weights = taps.Weights.data();
+		uint32 numTaps = taps.NumTaps;
+
+		for (uint32 x = 0; x < dstWidth; ++x, indices += numTaps, weights += numTaps) {
+#ifdef MIP_GENERATOR_SSE
+			__m128 sum = _mm_setzero_ps();
+			for (uint32 t = 0; t < numTaps; ++t) {
+				sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[t]), _mm_loadu_ps(src + indices[t] * 4)));
+			}
+			_mm_storeu_ps(dst + x * 4, sum);
+#else
+			float sum[4] = {};
+			for (uint32 t = 0; t < numTaps; ++t) {
+				for (uint32 c = 0; c < 4; ++c) {
+					sum[c] += weights[t] * src[indices[t] * 4 + c];
+				}
+			}
+			memcpy(dst + x * 4, sum, sizeof(sum));
+#endif
+		}
+	}
+
+	void FilterRowVertical(const float* const* rows, const float* weights, uint32 numTaps, uint32 width, float* dst) {
+		for (uint32 x = 0; x < width; ++x) {
+#ifdef MIP_GENERATOR_SSE
+			__m128 sum = _mm_setzero_ps();
+			for (uint32 t = 0; t < numTaps; ++t) {
+				sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[t]), _mm_loadu_ps(rows[t] + x * 4)));
+			}
+			_mm_storeu_ps(dst + x * 4, sum);
+#else
+			float sum[4] = {};
+			for (uint32 t = 0; t < numTaps; ++t) {
+				for (uint32 c = 0; c < 4; ++c) {
+					sum[c] += weights[t] * rows[t][x * 4 + c];
+				}
+			}
+			memcpy(dst + x * 4, sum, sizeof(sum));
+#endif
+		}
+	}
+
+	// A level to filter from. The top level is read in its storage format, all others come from the linear float copy of the previous level.
+	struct SourceLevel {
+		EMipFormat Format;
+		bool IsSRGB;
+		const uint8* Pixels;
+		uint64 RowPitch;
+		const float* Linear;
+		uint32 Width;
+		uint32 Height;
+	};
+
+	void FilterBand(const SourceLevel& src, const FilterTaps& xTaps, const FilterTaps& yTaps, uint32 dstWidth, uint32 firstRow, uint32 endRow, float* dstLinear) {
+		uint32 numTaps = yTaps.NumTaps;
+
+		uint32 minRow = UINT32_MAX;
+		uint32 maxRow = 0;
+		for (size_t i = (size_t)firstRow * numTaps; i < (size_t)endRow * numTaps; ++i) {
+			minRow = Min(minRow, yTaps.Indices[i]);
+			maxRow = Max(maxRow, yTaps.Indices[i]);
+		}
+
+		// Horizontally filtered source rows of this band. Neighboring bands filter the rows they share twice, which is cheaper than synchronizing.
+		uint32 numRows = maxRow - minRow + 1;
+		std::vector<float> horizontal((size_t)numRows * dstWidth * 4);
+		std::vector<float> rowScratch(src.Linear ? 0 : (size_t)src.Width * 4);
+
+		for (uint32 r = 0; r < numRows; ++r) {
+			uint32 y = minRow + r;
+			const float* row;
+			if (src.Linear) {
+				row = src.Linear + (size_t)y * src.Width * 4;
+			}
+			else {
+				LoadLinearRow(src.Format, src.IsSRGB, src.Pixels + y * src.RowPitch, src.Width, rowScratch.data());
+				row = rowScratch.data();
+			}
+			FilterRowHorizontal(row, xTaps, dstWidth, horizontal.data() + (size_t)r * dstWidth * 4);
+		}
+
+		std::vector<const float*> rows(numTaps);
+		for (uint32 y = firstRow; y < endRow; ++y) {
+			for (uint32 t = 0; t < numTaps; ++t) {
+				rows[t] = horizontal.data() + (size_t)(yTaps.Indices[(size_t)y * numTaps + t] - minRow) * dstWidth * 4;
+			}
+			FilterRowVertical(rows.data(), yTaps.Weights.data() + (size_t)y * numTaps, numTaps, dstWidth, dstLinear + (size_t)y * dstWidth * 4);
+		}
+	}
+
+	// Runs 'work' for bands of rows, on the job system if the level is large enough.
+	template <typename Work>
+	void ForEachBand(uint32 width, uint32 height, bool parallel, const Work& work) {
+		if (not parallel or width * height < MinPixelsForParallel) {
+			work(0u, height);
+			return;
+		}
+
+		uint32 rowsPerBand = Max(MinRowsPerBand, (height + TargetNumBands - 1) / TargetNumBands);
+
+		uint32 numBands = (height + rowsPerBand - 1) / rowsPerBand;
+
+		// Not a ThreadJobContext: its wait runs unrelated jobs, which may block on the texture load this is part of.
+		ParallelFor(numBands, [&](uint32 band) {
+			uint32 y = band * rowsPerBand;
+			work(y, Min(y + rowsPerBand, height));
+		});
+	}
+
+	uint64 CountAlphaAbove(const float* linear, uint64 numPixels, float cutoff) {
+		uint64 count = 0;
+		for (uint64 i = 0; i < numPixels; ++i) {
+			count += linear[i * 4 + 3] > cutoff;
+		}
+		return count;
+	}
+
+	// Scale for the alpha of a level, so that its coverage at 'cutoff' matches 'targetCoverage'. Instead of searching for the scale, this finds
+	// the alpha value above which 'targetCoverage' of the texels lie, using a histogram, and maps that value to the cutoff.
+	float ComputeAlphaScale(const float* linear, uint64 numPixels, float cutoff, float targetCoverage) {
+		std::vector<uint32> histogram(NumAlphaHistogramBins, 0);
+		for (uint64 i = 0; i < numPixels; ++i) {
+			float alpha = std::fmin(std::fmax(linear[i * 4 + 3], 0.f), 1.f);
+			++histogram[Min((uint32)(alpha * NumAlphaHistogramBins), NumAlphaHistogramBins - 1)];
+		}
+
+		uint64 targetCount = (uint64)(targetCoverage * numPixels + 0.5);
+		uint64 count = 0;
+		uint32 bin = NumAlphaHistogramBins;
+		while (bin > 0 and count < targetCount) {
+			count += histogram[--bin];
+		}
+
+		// Texels with equal alpha fall into the same bin, so the bin where the target is crossed can hold many of them. Keep or drop it as a
+		// whole, whichever ends up closer to the target.
+		if (bin < NumAlphaHistogramBins) {
+			uint64 countWithoutBin = count - histogram[bin];
+			if (targetCount - countWithoutBin < count - targetCount) {
+				++bin;
+			}
+		}
+
+		float threshold = (float)bin / NumAlphaHistogramBins;
+		return (threshold > 0.f) ? cutoff / threshold : 1.f;
+	}
+}
+
+uint32 GetNumMipLevels(uint32 width, uint32 height) {
+	uint32 numLevels = 1;
+	while ((Max(width, height) >> numLevels) > 0) {
+		++numLevels;
+	}
+	return numLevels;
+}
+
+uint32 GetMipFormatSize(EMipFormat format) {
+	switch (format) {
+		case EMipFormatR8: return 1;
+		case EMipFormatRG8: return 2;
+		case EMipFormatRGBA8: return 4;
+		case EMipFormatRGBA16F: return 8;
+		case EMipFormatRGBA32F: return 16;
+	}
+	return 0;
+}
+
+void GenerateMipChain(EMipFormat format, const MipLevel* levels, uint32 numLevels, const MipGenerationSettings& settings) {
+	if (numLevels < 2) {
+		return;
+	}
+
+	bool isSRGB = settings.IsSRGB and format == EMipFormatRGBA8;
+	bool preserveCoverage = settings.AlphaCutoff > 0.f and HasAlpha(format);
+
+	float targetCoverage = 0.f;
+	if (preserveCoverage) {
+		std::vector<float> row((size_t)levels[0].Width * 4);
+		uint64 count = 0;
+		for (uint32 y = 0; y < levels[0].Height; ++y) {
+			LoadLinearRow(format, isSRGB, levels[0].Pixels + y * levels[0].RowPitch, levels[0].Width, row.data());
+			count += CountAlphaAbove(row.data(), levels[0].Width, settings.AlphaCutoff);
+		}
+		targetCoverage = (float)((double)count / ((uint64)levels[0].Width * levels[0].Height));
+	}
+
+	// Linear float copies of the previous and the current level.
+	std::vector<float> linear[2];
+
+	SourceLevel src = { format, isSRGB, levels[0].Pixels, levels[0].RowPitch, nullptr, levels[0].Width, levels[0].Height };
+
+	for (uint32 level = 1; level < numLevels; ++level) {
+		const MipLevel& dst = levels[level];
+		assert(dst.Width == Max(levels[0].Width >> level, 1u) and dst.Height == Max(levels[0].Height >> level, 1u));
+
+		std::vector<float>& dstLinear = linear[level % 2];
+		dstLinear.resize((size_t)dst.Width * dst.Height * 4);
+
+		FilterTaps xTaps = ComputeFilterTaps(settings.Filter, src.Width, dst.Width);
+		FilterTaps yTaps = ComputeFilterTaps(settings.Filter, src.Height, dst.Height);
+
+		ForEachBand(dst.Width, dst.Height, settings.Parallel, [&](uint32 firstRow, uint32 endRow) {
+			FilterBand(src, xTaps, yTaps, dst.Width, firstRow, endRow, dstLinear.data());
+		});
+
+		// The scale only applies to the stored level. The next level is filtered from the unscaled alpha, so that the scales don't compound.
+		float alphaScale = 1.f;
+		if (preserveCoverage and targetCoverage > 0.f and targetCoverage < 1.f) {
+			alphaScale = ComputeAlphaScale(dstLinear.data(), (uint64)dst.Width * dst.Height, settings.AlphaCutoff, targetCoverage);
+		}
+
+		ForEachBand(dst.Width, dst.Height, settings.Parallel, [&](uint32 firstRow, uint32 endRow) {
+			for (uint32 y = firstRow; y < endRow; ++y) {
+				StoreLinearRow(format, isSRGB, dstLinear.data() + (size_t)y * dst.Width * 4, dst.Width, alphaScale, dst.Pixels + y * dst.RowPitch);
+			}
+		});
+
+		src = { format, isSRGB, nullptr, 0, dstLinear.data(), dst.Width, dst.Height };
+	}
+}
+
+void GenerateReferenceMipChain(EMipFilter filter, const MipLevel* levels, uint32 numLevels) {
+	const MipLevel& top = levels[0];
+	std::vector<double> linear((size_t)top.Width * top.Height * 4);
+	for (uint32 y = 0; y < top.Height; ++y) {
+		for (uint32 x = 0; x < top.Width; ++x) {
+			const uint8* texel = top.Pixels + y * top.RowPitch + x * 4;
+			double* out = linear.data() + ((size_t)y * top.Width + x) * 4;
+			for (uint32 c = 0; c < 3; ++c) {
+				out[c] = SRGBToLinear(texel[c] / 255.0);
+			}
+			out[3] = texel[3] / 255.0;
+		}
+	}
+
+	for (uint32 level = 1; level < numLevels; ++level) {
+		const MipLevel& dst = levels[level];
+		FilterTaps xTaps = ComputeFilterTaps(filter, top.Width, dst.Width);
+		FilterTaps yTaps = ComputeFilterTaps(filter, top.Height, dst.Height);
+
+		std::vector<double> horizontal((size_t)dst.Width * top.Height * 4, 0.0);
+		for (uint32 y = 0; y < top.Height; ++y) {
+			for (uint32 x = 0; x < dst.Width; ++x) {
+				for (uint32 t = 0; t < xTaps.NumTaps; ++t) {
+					size_t i = (size_t)x * xTaps.NumTaps + t;
+					const double* texel = linear.data() + ((size_t)y * top.Width + xTaps.Indices[i]) * 4;
+					for (uint32 c = 0; c < 4; ++c) {
+						horizontal[((size_t)y * dst.Width + x) * 4 + c] += xTaps.Weights[i] * texel[c];
+					}
+				}
+			}
+		}
+
+		for (uint32 y = 0; y < dst.Height; ++y) {
+			for (uint32 x = 0; x < dst.Width; ++x) {
+				double sum[4] = {};
+				for (uint32 t = 0; t < yTaps.NumTaps; ++t) {
+					size_t i = (size_t)y * yTaps.NumTaps + t;
+					const double* texel = horizontal.data() + ((size_t)yTaps.Indices[i] * dst.Width + x) * 4;
+					for (uint32 c = 0; c < 4; ++c) {
+						sum[c] += yTaps.Weights[i] * texel[c];
+					}
+				}
+
+				uint8* out = dst.Pixels + y * dst.RowPitch + x * 4;
+				for (uint32 c = 0; c < 4; ++c) {
+					double v = std::fmin(std::fmax(sum[c], 0.0), 1.0);
+					out[c] = (uint8)std::lround(255.0 * ((c < 3) ? LinearToSRGB(v) : v));
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "../pch.h"
+
+// CPU mip chain generation for the formats the texture loader produces. Independent of DirectXTex and D3D.
+//
+// Every level is filtered from the previous one, which is kept in linear float precision, so quantization errors don't accumulate
+// down the chain. sRGB texels are linearized before filtering and encoded again afterwards. The filters are separable, and each
+// level is split into bands of rows, which run on the job system.
+
+enum EMipFormat {
+	EMipFormatR8,
+	EMipFormatRG8,
+	EMipFormatRGBA8,
+	EMipFormatRGBA16F,
+	EMipFormatRGBA32F,
+};
+
+enum EMipFilter {
+	EMipFilterBox,     // 2x2 average. Fastest, but blurry and prone to aliasing.
+	EMipFilterKaiser,  // Kaiser-windowed sinc. Sharp with little ringing, the default for color textures.
+	EMipFilterLanczos, // Lanczos-3. Sharpest, with the most ringing.
+};
+
+struct MipLevel {
+	uint8* Pixels;
+	uint32 Width;
+	uint32 Height;
+	uint64 RowPitch;
+};
+
+struct MipGenerationSettings {
+	EMipFilter Filter = EMipFilterKaiser;
+	bool IsSRGB = false;      // Only for EMipFormatRGBA8. The alpha channel is always linear.
+
+	// If > 0, the alpha of every level is scaled so that the fraction of texels with an alpha above this value matches the top level.
+	// Meant for alpha-tested textures, which otherwise get thinner with every level.
+	float AlphaCutoff = 0.f;
+
+	bool Parallel = true;
+};
+
+uint32 GetNumMipLevels(uint32 width, uint32 height);
+uint32 GetMipFormatSize(EMipFormat format); // Bytes per pixel.
+
+// Fills levels 1 to numLevels-1 from level 0. Every level must be allocated by the caller with dimensions max(1, size >> level).
+void GenerateMipChain(EMipFormat format, const MipLevel* levels, uint32 numLevels, const MipGenerationSettings& settings);
+
+// Filters levels 1 to numLevels-1 directly from level 0 in double precision, with exact sRGB conversions and the same kernels as
+// GenerateMipChain. Much slower, this is the reference the quality of GenerateMipChain is measured against. sRGB RGBA8 only.
+void GenerateReferenceMipChain(EMipFilter filter, const MipLevel* levels, uint32 numLevels);
@@ -0,0 +1,188 @@
+#include "pipelineCache.h"
+
+#include <cstring>
+#include <fstream>
+
+#define XXH_INLINE_ALL
+#include <xxhash.h>
+
+#define PIPELINE_CACHE_MAGIC 0x43505350 // "PSPC"
+
+namespace {
+	struct FileHeader {
+		uint32 Magic;
+		uint32 Version;
+		uint64 DeviceHash;
+		uint64 Run;
+		uint64 NumEntries;
+	};
+
+	struct EntryHeader {
+		uint64 Key;
+		uint64 LastUsedRun;
+		uint64 Size;
+		uint64 Checksum;
+	};
+}
+
+PipelineHasher& PipelineHasher::Add(const void* data, uint64 size) {
+	_hash = XXH3_64bits_withSeed(data, (size_t)size, _hash);
+	return *this;
+}
+
+PipelineHasher& PipelineHasher::AddString(const char* string) {
+	if (not string) {
+		return Add<uint64>(UINT64_MAX);
+	}
+	uint64 length = strlen(string);
+	Add(length);
+	return Add(string, length);
+}
+
+uint64 HashBytes(const void* data, uint64 size) {
+	return XXH3_64bits(data, (size_t)size);
+}
+
+uint64 GetPipelineCacheKey(const uint64* shaderHashes, uint32 numShaders, uint64 descHash) {
+	PipelineHasher hasher;
+	hasher.Add<uint32>(PIPELINE_CACHE_VERSION).Add(numShaders).Add(shaderHashes, sizeof(uint64) * numShaders).Add(descHash);
+	return hasher.Finish();
+}
+
+void PipelineCache::Initialize(const fs::path& filename, uint64 deviceHash) {
+	_filename = filename;
+	_deviceHash = deviceHash;
+	_run = 1;
+	_entries.clear();
+	_dirty = false;
+	_numLoadedEntries = 0;
+	_numDamagedEntries = 0;
+	_numHits = 0;
+	_numMisses = 0;
+
+	std::ifstream stream(filename, std::ios::binary);
+	if (not stream) {
+		return;
+	}
+
+	FileHeader header;
+	if (not stream.read((char*)&header, sizeof(header)) or header.Magic != PIPELINE_CACHE_MAGIC or header.Version != PIPELINE_CACHE_VERSION) {
+		_dirty = true;
+		return;
+	}
+	// Blobs of another device or driver would all be rejected.
+	if (header.DeviceHash != deviceHash) {
+		_dirty = true;
+		return;
+	}
+	_run = header.Run + 1;
+
+	std::error_code error;
+	uint64 fileSize = (uint64)fs::file_size(filename, error);
+	uint64 offset = sizeof(header);
+
+	for (uint64 i = 0; i < header.NumEntries; ++i) {
+		EntryHeader entryHeader;
+		bool intact = offset + sizeof(entryHeader) <= fileSize and stream.read((char*)&entryHeader, sizeof(entryHeader));
+		offset += sizeof(entryHeader);
+
+		// The size is checked before anything is allocated for it, since a damaged size may be anything.
+		intact = intact and entryHeader.Size <= fileSize - Min(offset, fileSize);
+
+		Entry entry;
+		if (intact) {
+			entry.LastUsedRun = entryHeader.LastUsedRun;
+			entry.Data.resize(entryHeader.Size);
+			intact = (bool)stream.read((char*)entry.Data.data(), entryHeader.Size) and HashBytes(entry.Data.data(), entryHeader.Size) == entryHeader.Checksum;
+			offset += entryHeader.Size;
+		}
+
+		// Nothing after a damaged entry can be trusted, since its size may be wrong.
+		if (not intact) {
+			_numDamagedEntries += (uint32)(header.NumEntries - i);
+			_dirty = true;
+			break;
+		}
+
+		_entries[entryHeader.Key] = std::move(entry);
+		++_numLoadedEntries;
+	}
+}
+
+bool PipelineCache::Find(uint64 key, std::vector<uint8>& outData) {
+	std::lock_guard lock(_mutex);
+
+	auto it = _entries.find(key);
+	if (it == _entries.end()) {
+		++_numMisses;
+		return false;
+	}
+
+	++_numHits;
+	if (it->second.LastUsedRun != _run) {
+		it->second.LastUsedRun = _run;
+		_dirty = true;
+	}
+	outData = it->second.Data;
+	return true;
+}
+
+void PipelineCache::Insert(uint64 key, const void* data, uint64 size) {
+	std::lock_guard lock(_mutex);
+
+	Entry& entry = _entries[key];
+	entry.LastUsedRun = _run;
+	entry.Data.assign((const uint8*)data, (const uint8*)data + size);
+	_dirty = true;
+}
+
+void PipelineCache::Remove(uint64 key) {
+	std::lock_guard lock(_mutex);
+	if (_entries.erase(key)) {
+		_dirty = true;
+	}
+}
+
+bool PipelineCache::Save() {
+	if (not _dirty) {
+		return true;
+	}
+
+	for (auto it = _entries.begin(); it != _entries.end();) {
+		if (_run - it->second.LastUsedRun > PIPELINE_CACHE_MAX_UNUSED_RUNS) {
+			it = _entries.erase(it);
+		}
+		else {
+			++it;
+		}
+	}
+
+	// Write to a temporary file first, so that a crash doesn't leave a half-written cache behind.
+	fs::path tempPath = _filename;
+	tempPath += ".tmp";
+
+	{
+		std::ofstream stream(tempPath, std::ios::binary | std::ios::trunc);
+		if (not stream) {
+			return false;
+		}
+
+		FileHeader header = { PIPELINE_CACHE_MAGIC, PIPELINE_CACHE_VERSION, _deviceHash, _run, _entries.size() };
+		stream.write((const char*)&header, sizeof(header));
+
+		for (auto& [key, entry] : _entries) {
+			EntryHeader entryHeader = { key, entry.LastUsedRun, entry.Data.size(), HashBytes(entry.Data.data(), entry.Data.size()) };
+			stream.write((const char*)&entryHeader, sizeof(entryHeader));
+			stream.write((const char*)entry.Data.data(), entry.Data.size());
+		}
+
+		if (not stream) {
+			return false;
+		}
+	}
+
+	std::error_code error;
+	fs::rename(tempPath, _filename, error);
+	_dirty = (bool)error;
+	return not error;
+}
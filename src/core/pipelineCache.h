@@ -0,0 +1,78 @@
+#pragma once
+
+#include "../pch.h"
+
+#include <unordered_map>
+
+// Bump this when the key layout changes, so that old cache files are no longer used.
+#define PIPELINE_CACHE_VERSION 1
+#define PIPELINE_CACHE_FILENAME "pipeline_cache.bin"
+
+// Entries which weren't used in this many runs are dropped on save, e.g. those of shaders which have since changed.
+#define PIPELINE_CACHE_MAX_UNUSED_RUNS 8
+
+// Incremental 64-bit hash for pipeline keys. Strings are hashed by content, so that keys don't depend on where the data lives.
+class PipelineHasher {
+public:
+	PipelineHasher& Add(const void* data, uint64 size);
+	PipelineHasher& AddString(const char* string); // A null string hashes differently from an empty one.
+	template<class T> PipelineHasher& Add(const T& value) { return Add(&value, sizeof(T)); }
+
+	uint64 Finish() const { return _hash; }
+
+private:
+	uint64 _hash = 0x9E3779B97F4A7C15ull;
+};
+
+uint64 HashBytes(const void* data, uint64 size);
+
+// Key of a pipeline in the cache: the content hashes of its shaders (in stage order, 0 for unused stages) and a hash of the rest of its
+// description.
+uint64 GetPipelineCacheKey(const uint64* shaderHashes, uint32 numShaders, uint64 descHash);
+
+// Compiled pipeline blobs by key, in a single file. Independent of D3D: the blobs are opaque bytes.
+//
+// The file remembers the device it was written for. Blobs of another device or driver version are useless, so a file with a different
+// device hash starts an empty cache. Every entry carries a checksum, and reading stops at the first damaged entry.
+class PipelineCache {
+public:
+	// Reads the cache file. A missing, outdated or damaged file starts an empty cache.
+	void Initialize(const fs::path& filename, uint64 deviceHash);
+
+	// Copies the blob for 'key' into 'outData'. Thread safe.
+	bool Find(uint64 key, std::vector<uint8>& outData);
+
+	// Thread safe.
+	void Insert(uint64 key, const void* data, uint64 size);
+
+	// For blobs which the device rejected. Thread safe.
+	void Remove(uint64 key);
+
+	// Writes the file, if anything changed since it was read. Not thread safe with respect to the other functions.
+	bool Save();
+
+	uint32 NumEntries() const { return (uint32)_entries.size(); }
+	uint32 NumLoadedEntries() const { return _numLoadedEntries; }
+	uint32 NumDamagedEntries() const { return _numDamagedEntries; }
+	uint32 NumHits() const { return _numHits; }
+	uint32 NumMisses() const { return _numMisses; }
+
+private:
+	struct Entry {
+		uint64 LastUsedRun;
+		std::vector<uint8> Data;
+	};
+
+	fs::path _filename;
+	uint64 _deviceHash = 0;
+	uint64 _run = 0; // Incremented every time the file is read.
+
+	std::unordered_map<uint64, Entry> _entries;
+	std::mutex _mutex;
+
+	bool _dirty = false;
+	uint32 _numLoadedEntries = 0;
+	uint32 _numDamagedEntries = 0;
+	uint32 _numHits = 0;
+	uint32 _numMisses = 0;
+};
@@ -0,0 +1,369 @@
+#include "profileStatistics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+namespace {
+	bool NamesEqual(const char* a, const char* b) {
+		return a == b or strcmp(a, b) == 0;
+	}
+
+	uint32 HashBlock(const char* track, uint32 parent, const char* name) {
+		uint32 hash = 2166136261u ^ parent;
+		for (const char* s : { track, name }) {
+			for (const char* c = s; *c; c++) {
+				hash = (hash ^ (uint8)*c) * 16777619u;
+			}
+			hash = (hash ^ 0xFF) * 16777619u;
+		}
+		return hash;
+	}
+
+	// Nearest rank.
+	float Percentile(const std::vector<float>& sorted, float percent) {
+		uint32 rank = (uint32)std::ceil(percent / 100.f * sorted.size());
+		return sorted[Max(rank, 1u) - 1];
+	}
+
+	void WriteCsvString(std::ostream& stream, const char* string) {
+		stream << '"';
+		for (const char* c = string; *c; c++) {
+			if (*c == '"') {
+				stream << '"';
+			}
+			stream << *c;
+		}
+		stream << '"';
+	}
+
+	void WriteJsonString(std::ostream& stream, const char* string) {
+		stream << '"';
+		for (const char* c = string; *c; c++) {
+			if (*c == '"' or *c == '\\') {
+				stream << '\\' << *c;
+			}
+			else if ((uint8)*c < 0x20) {
+				char escaped[8];
+				snprintf(escaped, sizeof(escaped), "\\u%04x", (uint32)(uint8)*c);
+				stream << escaped;
+			}
+			else {
+				stream << *c;
+			}
+		}
+		stream << '"';
+	}
+
+	void WriteCsvRow(std::ostream& stream, const ProfileBlockStatistics& s) {
+		WriteCsvString(stream, s.Track);
+		stream << ',';
+		WriteCsvString(stream, s.Path.c_str());
+
+		char numbers[256];
+		snprintf(numbers, sizeof(numbers), ",%u,%u,%u,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f\n", s.Depth, s.NumFrames, s.LastCount, s.LastMilliseconds,
+			s.MinMilliseconds, s.AverageMilliseconds, s.P50Milliseconds, s.P95Milliseconds, s.P99Milliseconds, s.MaxMilliseconds);
+		stream << numbers;
+	}
+
+	void WriteJsonStatistics(std::ostream& stream, const ProfileBlockStatistics& s) {
+		stream << "{\"track\":";
+		WriteJsonString(stream, s.Track);
+		stream << ",\"path\":";
+		WriteJsonString(stream, s.Path.c_str());
+
+		char numbers[384];
+		snprintf(numbers, sizeof(numbers), ",\"depth\":%u,\"frames\":%u,\"lastCount\":%u,\"lastMs\":%.4f,\"minMs\":%.4f,\"avgMs\":%.4f,"
+			"\"p50Ms\":%.4f,\"p95Ms\":%.4f,\"p99Ms\":%.4f,\"maxMs\":%.4f}", s.Depth, s.NumFrames, s.LastCount, s.LastMilliseconds, s.MinMilliseconds,
+			s.AverageMilliseconds, s.P50Milliseconds, s.P95Milliseconds, s.P99Milliseconds, s.MaxMilliseconds);
+		stream << numbers;
+	}
+}
+
+ProfileStatistics::TrackStack* ProfileStatistics::FindTrack(const char* name, uint32& numTracks) {
+	for (uint32 i = 0; i < numTracks; i++) {
+		if (NamesEqual(_tracks[i].Name, name)) {
+			return &_tracks[i];
+		}
+	}
+	if (numTracks == MAX_NUM_PROFILE_STATISTICS_TRACKS) {
+		return nullptr;
+	}
+
+	TrackStack& track = _tracks[numTracks++];
+	track.Name = name;
+	track.Depth = 0;
+	track.NumOverflowing = 0;
+	return &track;
+}
+
+uint32 ProfileStatistics::FindOrAddBlock(const char* track, uint32 parent, const char* name, uint32 depth) {
+	uint32 mask = arraysize(_table) - 1;
+	static_assert((arraysize(_table) & (arraysize(_table) - 1)) == 0);
+
+	for (uint32 slot = HashBlock(track, parent, name) & mask;; slot = (slot + 1) & mask) {
+		if (_table[slot] == 0) {
+			if (_numBlocks == MAX_NUM_PROFILE_STATISTICS_BLOCKS) {
+				return InvalidIndex;
+			}
+
+			uint32 index = _numBlocks++;
+			Block& block = _blocks[index];
+			block.Track = track;
+			block.Name = name;
+			block.Parent = parent;
+			block.Depth = depth;
+			block.LastCount = 0;
+			block.Samples = {};
+
+			_table[slot] = (uint16)(index + 1);
+			return index;
+		}
+
+		uint32 index = _table[slot] - 1;
+		const Block& block = _blocks[index];
+		if (block.Parent == parent and NamesEqual(block.Name, name) and NamesEqual(block.Track, track)) {
+			return index;
+		}
+	}
+}
+
+void ProfileStatistics::AddSample(SampleRing& samples, float milliseconds) {
+	uint32 slot = _numFrames % PROFILE_STATISTICS_WINDOW;
+	if (samples.Frames[slot] == _numFrames) {
+		samples.Milliseconds[slot] += milliseconds;
+	}
+	else {
+		samples.Frames[slot] = _numFrames;
+		samples.Milliseconds[slot] = milliseconds;
+	}
+}
+
+bool ProfileStatistics::AddFrame(uint64 frameId, float frameMilliseconds, const ProfileStatisticsEvent* events, uint32 numEvents) {
+	// Against the window before this frame.
+	float median = ComputeStatistics(_frameSamples).P50Milliseconds;
+	bool enoughFrames = (Min(_numFrames, (uint32)PROFILE_STATISTICS_WINDOW) >= Settings.MinFramesBeforeSpikes);
+
+	_numFrames++;
+	AddSample(_frameSamples, frameMilliseconds);
+
+	uint32 numTracks = 0;
+	for (uint32 i = 0; i < numEvents; i++) {
+		const ProfileStatisticsEvent& e = events[i];
+		TrackStack* track = FindTrack(e.Track, numTracks);
+		if (not track) {
+			_numDroppedEvents++;
+			continue;
+		}
+
+		if (e.Type == EProfileStatisticsEventBegin) {
+			if (track->Depth == MAX_PROFILE_STATISTICS_DEPTH) {
+				track->NumOverflowing++;
+				_numDroppedEvents++;
+				continue;
+			}
+
+			uint32 d = track->Depth++;
+			uint32 parent = (d == 0) ? InvalidIndex : track->Blocks[d - 1];
+			bool parentMissing = (d > 0 and parent == InvalidIndex);
+
+			uint32 index = parentMissing ? InvalidIndex : FindOrAddBlock(track->Name, parent, e.Name, d);
+			if (index == InvalidIndex) {
+				_numDroppedEvents++;
+			}
+			track->Blocks[d] = index;
+			track->Names[d] = e.Name;
+			track->Begins[d] = e.Milliseconds;
+		}
+		else {
+			if (track->NumOverflowing > 0) {
+				track->NumOverflowing--;
+				continue;
+			}
+
+			// Begins which were never ended are closed along with their parent.
+			uint32 d = track->Depth;
+			while (d > 0 and not NamesEqual(track->Names[d - 1], e.Name)) {
+				d--;
+			}
+			if (d == 0) {
+				_numDroppedEvents++;
+				continue;
+			}
+			_numDroppedEvents += track->Depth - d;
+
+			track->Depth = d - 1;
+			uint32 index = track->Blocks[d - 1];
+			if (index != InvalidIndex) {
+				Block& block = _blocks[index];
+				block.LastCount = (block.Samples.Frames[_numFrames % PROFILE_STATISTICS_WINDOW] == _numFrames) ? block.LastCount + 1 : 1;
+				AddSample(block.Samples, (float)(e.Milliseconds - track->Begins[d - 1]));
+			}
+		}
+	}
+
+	for (uint32 i = 0; i < numTracks; i++) {
+		_numDroppedEvents += _tracks[i].Depth + _tracks[i].NumOverflowing;
+	}
+
+	bool spike = (Settings.SpikeFactor > 0.f and enoughFrames and frameMilliseconds > Settings.SpikeFactor * median)
+		or (Settings.SpikeMilliseconds > 0.f and frameMilliseconds > Settings.SpikeMilliseconds);
+
+	if (spike) {
+		_numSpikes++;
+		_lastSpikeFrameId = frameId;
+
+		if (not Settings.SpikeDumpDirectory.empty() and (not _dumped or frameId - _lastDumpFrameId >= Settings.MinFramesBetweenDumps)) {
+			DumpSpike(frameId);
+		}
+	}
+
+	return spike;
+}
+
+ProfileBlockStatistics ProfileStatistics::ComputeStatistics(const SampleRing& samples) const {
+	ProfileBlockStatistics result = {};
+
+	std::vector<float> sorted;
+	sorted.reserve(PROFILE_STATISTICS_WINDOW);
+	for (uint32 i = 0; i < PROFILE_STATISTICS_WINDOW; i++) {
+		uint32 frame = samples.Frames[i];
+		if (frame != 0 and frame + PROFILE_STATISTICS_WINDOW > _numFrames) {
+			sorted.push_back(samples.Milliseconds[i]);
+		}
+	}
+
+	uint32 lastSlot = _numFrames % PROFILE_STATISTICS_WINDOW;
+	if (_numFrames > 0 and samples.Frames[lastSlot] == _numFrames) {
+		result.LastMilliseconds = samples.Milliseconds[lastSlot];
+	}
+
+	result.NumFrames = (uint32)sorted.size();
+	if (sorted.empty()) {
+		return result;
+	}
+
+	std::sort(sorted.begin(), sorted.end());
+
+	double sum = 0.0;
+	for (float s : sorted) {
+		sum += s;
+	}
+
+	result.MinMilliseconds = sorted.front();
+	result.MaxMilliseconds = sorted.back();
+	result.AverageMilliseconds = (float)(sum / sorted.size());
+	result.P50Milliseconds = Percentile(sorted, 50.f);
+	result.P95Milliseconds = Percentile(sorted, 95.f);
+	result.P99Milliseconds = Percentile(sorted, 99.f);
+	return result;
+}
+
+std::string ProfileStatistics::GetPath(uint32 blockIndex) const {
+	const Block& block = _blocks[blockIndex];
+	return (block.Parent == InvalidIndex) ? std::string(block.Name) : GetPath(block.Parent) + "/" + block.Name;
+}
+
+ProfileBlockStatistics ProfileStatistics::GetFrameStatistics() const {
+	ProfileBlockStatistics result = ComputeStatistics(_frameSamples);
+	result.Track = _name;
+	result.Path = "Frame";
+	result.LastCount = (result.NumFrames > 0) ? 1 : 0;
+	return result;
+}
+
+std::vector<ProfileBlockStatistics> ProfileStatistics::GetBlockStatistics() const {
+	// Parents are added before their children, so the chain of indices from the root sorts depth first in order of occurrence.
+	std::vector<std::vector<uint32>> chains(_numBlocks);
+	std::vector<uint32> order;
+	for (uint32 i = 0; i < _numBlocks; i++) {
+		const Block& block = _blocks[i];
+		if (block.Parent != InvalidIndex) {
+			chains[i] = chains[block.Parent];
+		}
+		chains[i].push_back(i);
+		order.push_back(i);
+	}
+
+	// Tracks in the order they first occurred.
+	std::vector<uint32> trackOrder(_numBlocks);
+	for (uint32 i = 0; i < _numBlocks; i++) {
+		trackOrder[i] = i;
+		for (uint32 j = 0; j < i; j++) {
+			if (NamesEqual(_blocks[j].Track, _blocks[i].Track)) {
+				trackOrder[i] = trackOrder[j];
+				break;
+			}
+		}
+	}
+
+	std::sort(order.begin(), order.end(), [&](uint32 a, uint32 b) {
+		return (trackOrder[a] != trackOrder[b]) ? (trackOrder[a] < trackOrder[b]) : (chains[a] < chains[b]);
+	});
+
+	std::vector<ProfileBlockStatistics> result;
+	for (uint32 index : order) {
+		const Block& block = _blocks[index];
+		ProfileBlockStatistics statistics = ComputeStatistics(block.Samples);
+		if (statistics.NumFrames == 0) {
+			continue;
+		}
+
+		statistics.Track = block.Track;
+		statistics.Path = GetPath(index);
+		statistics.Depth = block.Depth;
+		statistics.LastCount = (block.Samples.Frames[_numFrames % PROFILE_STATISTICS_WINDOW] == _numFrames) ? block.LastCount : 0;
+		result.push_back(std::move(statistics));
+	}
+	return result;
+}
+
+bool ProfileStatistics::ExportCsv(const fs::path& filename) const {
+	std::ofstream stream(filename, std::ios::trunc);
+	if (not stream) {
+		return false;
+	}
+
+	stream << "track,path,depth,frames,last_count,last_ms,min_ms,avg_ms,p50_ms,p95_ms,p99_ms,max_ms\n";
+	WriteCsvRow(stream, GetFrameStatistics());
+	for (const ProfileBlockStatistics& s : GetBlockStatistics()) {
+		WriteCsvRow(stream, s);
+	}
+	return (bool)stream;
+}
+
+bool ProfileStatistics::ExportJson(const fs::path& filename) const {
+	std::ofstream stream(filename, std::ios::trunc);
+	if (not stream) {
+		return false;
+	}
+
+	stream << "{\"name\":";
+	WriteJsonString(stream, _name);
+	stream << ",\"window\":" << PROFILE_STATISTICS_WINDOW << ",\"numSpikes\":" << _numSpikes << ",\"lastSpikeFrameId\":" << _lastSpikeFrameId
+		<< ",\"numDroppedEvents\":" << _numDroppedEvents << ",\n\"frame\":";
+	WriteJsonStatistics(stream, GetFrameStatistics());
+	stream << ",\n\"blocks\":[";
+
+	bool first = true;
+	for (const ProfileBlockStatistics& s : GetBlockStatistics()) {
+		stream << (first ? "\n" : ",\n");
+		WriteJsonStatistics(stream, s);
+		first = false;
+	}
+	stream << "\n]}\n";
+	return (bool)stream;
+}
+
+void ProfileStatistics::DumpSpike(uint64 frameId) {
+	std::error_code error;
+	fs::create_directories(Settings.SpikeDumpDirectory, error);
+
+	std::string basename = std::string(_name) + "_spike_" + std::to_string(frameId);
+	ExportCsv(Settings.SpikeDumpDirectory / (basename + ".csv"));
+	ExportJson(Settings.SpikeDumpDirectory / (basename + ".json"));
+
+	_lastDumpFrameId = frameId;
+	_dumped = true;
+}
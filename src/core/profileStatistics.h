@@ -0,0 +1,131 @@
+#pragma once
+
+#include "../pch.h"
+
+#include <string>
+
+// Rolling per-block timing statistics of a profiled timeline, like the GPU queues of DxProfiling or the threads of the CPU profiler. Every
+// frame is handed over as a stream of begin and end events, from which the block hierarchy is reconstructed. Blocks are identified by
+// track, parent and name, so the same name under different parents counts separately, and a block which occurs several times in a frame
+// counts with the sum of its durations.
+//
+// All memory is allocated up front: every block keeps its durations of the last PROFILE_STATISTICS_WINDOW frames, and blocks are never
+// removed. Percentiles are computed when statistics are requested, not per frame.
+
+#define PROFILE_STATISTICS_WINDOW 256
+#define MAX_NUM_PROFILE_STATISTICS_BLOCKS 256
+#define MAX_NUM_PROFILE_STATISTICS_TRACKS 16
+#define MAX_PROFILE_STATISTICS_DEPTH 32
+
+enum EProfileStatisticsEventType {
+	EProfileStatisticsEventBegin,
+	EProfileStatisticsEventEnd,
+};
+
+struct ProfileStatisticsEvent {
+	EProfileStatisticsEventType Type;
+	const char* Track;    // Blocks of different tracks nest independently, e.g. those of different queues. Must outlive the statistics.
+	const char* Name;     // Must outlive the statistics. Ends match begins by name.
+	double Milliseconds;  // Relative to any point, as long as it is the same for all events of a track in a frame.
+};
+
+struct ProfileStatisticsSettings {
+	float SpikeFactor = 2.f;            // Frames which take longer than this times the median of the window are spikes. 0 disables.
+	float SpikeMilliseconds = 0.f;      // Frames which take longer than this are spikes. 0 disables.
+	uint32 MinFramesBeforeSpikes = 30;  // For SpikeFactor, so that the median means something.
+
+	fs::path SpikeDumpDirectory;        // If not empty, spikes dump the statistics there as CSV and JSON.
+	uint32 MinFramesBetweenDumps = 300;
+};
+
+struct ProfileBlockStatistics {
+	const char* Track;
+	std::string Path;        // Names from the root down, separated by '/'.
+	uint32 Depth;
+	uint32 NumFrames;        // Frames of the window in which the block occurred. The statistics below are over these.
+	uint32 LastCount;        // Occurrences in the last frame.
+	float LastMilliseconds;  // In the last frame. 0 if the block didn't occur.
+
+	float MinMilliseconds;
+	float AverageMilliseconds;
+	float P50Milliseconds;
+	float P95Milliseconds;
+	float P99Milliseconds;
+	float MaxMilliseconds;
+};
+
+class ProfileStatistics {
+public:
+	ProfileStatistics(const char* name) : _name(name) {}
+	ProfileStatistics(const ProfileStatistics&) = delete;
+	ProfileStatistics& operator=(const ProfileStatistics&) = delete;
+
+	// Events of a track must be in time order, tracks may be interleaved. Returns true if the frame is a spike.
+	bool AddFrame(uint64 frameId, float frameMilliseconds, const ProfileStatisticsEvent* events, uint32 numEvents);
+
+	// Track is the name of the statistics, path is "Frame".
+	ProfileBlockStatistics GetFrameStatistics() const;
+
+	// Blocks which occurred in the window, by track, then depth first in the order they first occurred.
+	std::vector<ProfileBlockStatistics> GetBlockStatistics() const;
+
+	const char* Name() const { return _name; }
+	uint32 NumBlocks() const { return _numBlocks; }
+	uint32 NumSpikes() const { return _numSpikes; }
+	uint64 LastSpikeFrameId() const { return _lastSpikeFrameId; }
+	uint64 NumDroppedEvents() const { return _numDroppedEvents; } // Ends without begin, begins without end, and blocks which didn't fit.
+
+	// One row per block, the frame first.
+	bool ExportCsv(const fs::path& filename) const;
+	bool ExportJson(const fs::path& filename) const;
+
+	ProfileStatisticsSettings Settings;
+
+private:
+	static constexpr uint32 InvalidIndex = UINT32_MAX;
+
+	struct SampleRing {
+		uint32 Frames[PROFILE_STATISTICS_WINDOW]; // Number of the frame the slot was written in, 0 for never.
+		float Milliseconds[PROFILE_STATISTICS_WINDOW];
+	};
+
+	struct Block {
+		const char* Track;
+		const char* Name;
+		uint32 Parent;
+		uint32 Depth;
+		uint32 LastCount;
+		SampleRing Samples;
+	};
+
+	struct TrackStack {
+		const char* Name;
+		uint32 Depth;
+		uint32 NumOverflowing; // Begins beyond MAX_PROFILE_STATISTICS_DEPTH, whose ends are skipped.
+		uint32 Blocks[MAX_PROFILE_STATISTICS_DEPTH]; // InvalidIndex for blocks which didn't fit into the table.
+		const char* Names[MAX_PROFILE_STATISTICS_DEPTH];
+		double Begins[MAX_PROFILE_STATISTICS_DEPTH];
+	};
+
+	TrackStack* FindTrack(const char* name, uint32& numTracks);
+	uint32 FindOrAddBlock(const char* track, uint32 parent, const char* name, uint32 depth);
+	void AddSample(SampleRing& samples, float milliseconds);
+	ProfileBlockStatistics ComputeStatistics(const SampleRing& samples) const;
+	std::string GetPath(uint32 blockIndex) const;
+	void DumpSpike(uint64 frameId);
+
+	const char* _name;
+
+	uint32 _numFrames = 0; // Starts at 1 with the first frame.
+	uint32 _numBlocks = 0;
+	uint32 _numSpikes = 0;
+	uint64 _lastSpikeFrameId = 0;
+	uint64 _lastDumpFrameId = 0;
+	bool _dumped = false;
+	uint64 _numDroppedEvents = 0;
+
+	SampleRing _frameSamples = {};
+	Block _blocks[MAX_NUM_PROFILE_STATISTICS_BLOCKS];
+	uint16 _table[MAX_NUM_PROFILE_STATISTICS_BLOCKS * 2] = {}; // Open addressing into _blocks, by track, parent and name. 0 is empty.
+	TrackStack _tracks[MAX_NUM_PROFILE_STATISTICS_TRACKS];
+};
@@ -0,0 +1,396 @@
+#include "renderGraph.h"
+#include "memory.h"
+
+#include <algorithm>
+
+void RenderGraph::Reset() {
+	_resources.clear();
+	_passes.clear();
+}
+
+RenderGraphResource RenderGraph::CreateTransient(const char* name, uint64 sizeInBytes, uint64 alignment, uint32 heapGroup) {
+	assert(alignment > 0 and (alignment & (alignment - 1)) == 0);
+
+	_resources.push_back({ name, sizeInBytes, alignment, heapGroup, true, ERenderGraphAccessNone, ERenderGraphAccessNone });
+	return (RenderGraphResource)_resources.size() - 1;
+}
+
+RenderGraphResource RenderGraph::Import(const char* name, uint32 initialState, uint32 finalState) {
+	_resources.push_back({ name, 0, 1, 0, false, initialState, finalState });
+	return (RenderGraphResource)_resources.size() - 1;
+}
+
+RenderGraphPass RenderGraph::AddPass(const char* name, uint32 flags) {
+	_passes.push_back({ name, flags, {} });
+	return (RenderGraphPass)_passes.size() - 1;
+}
+
+void RenderGraph::Read(RenderGraphPass pass, RenderGraphResource resource, uint32 access) {
+	assert(access != ERenderGraphAccessNone and (access & ERenderGraphAccessWriteMask) == 0);
+	AddAccess(pass, resource, access, false);
+}
+
+void RenderGraph::Write(RenderGraphPass pass, RenderGraphResource resource, uint32 access) {
+	// Exactly one write access.
+	assert((access & ERenderGraphAccessWriteMask) == access and (access & (access - 1)) == 0);
+	AddAccess(pass, resource, access, true);
+}
+
+void RenderGraph::AddAccess(RenderGraphPass pass, RenderGraphResource resource, uint32 access, bool write) {
+	assert(pass < _passes.size() and resource < _resources.size());
+
+	for (Access& existing : _passes[pass].Accesses) {
+		if (existing.Resource == resource) {
+			// A pass which reads and writes the same resource keeps the write state, which has to cover the read (an unordered access
+			// write, or a depth write with a depth test). Two different writes can't be in one state.
+			assert(not (write and existing.Write and existing.State != access));
+			if (write) {
+				existing.State = access;
+			}
+			else if (not existing.Write) {
+				existing.State |= access;
+			}
+			existing.Read |= not write;
+			existing.Write |= write;
+			return;
+		}
+	}
+
+	_passes[pass].Accesses.push_back({ resource, access, not write, write });
+}
+
+void RenderGraph::CullPasses(std::vector<bool>& culled) const {
+	// Backwards over the passes. 'needed' is set if the contents of the resource, as they are at this point, are read by a live pass later.
+	std::vector<bool> needed(_resources.size(), false);
+
+	for (uint32 p = (uint32)_passes.size(); p-- > 0; ) {
+		const Pass& pass = _passes[p];
+
+		bool alive = (pass.Flags & ERenderGraphPassFlagsSideEffects) != 0;
+		for (const Access& access : pass.Accesses) {
+			if (access.Write and (needed[access.Resource] or not _resources[access.Resource].Transient)) {
+				alive = true;
+			}
+		}
+
+		culled[p] = not alive;
+		if (not alive) {
+			continue;
+		}
+
+		for (const Access& access : pass.Accesses) {
+			if (access.Write and not access.Read) {
+				needed[access.Resource] = false;
+			}
+		}
+		for (const Access& access : pass.Accesses) {
+			if (access.Read) {
+				needed[access.Resource] = true;
+			}
+		}
+	}
+}
+
+void RenderGraph::SortPasses(const std::vector<bool>& culled, std::vector<RenderGraphPass>& order) const {
+	uint32 numPasses = (uint32)_passes.size();
+
+	// Dependencies between live passes. A read depends on the last write before it, a write on the last write and all reads since.
+	std::vector<std::vector<RenderGraphPass>> dependents(numPasses);
+	std::vector<uint32> numDependencies(numPasses, 0);
+
+	auto addDependency = [&](RenderGraphPass from, RenderGraphPass to) {
+		if (from != RENDER_GRAPH_INVALID and from != to) {
+			dependents[from].push_back(to);
+			++numDependencies[to];
+		}
+	};
+
+	std::vector<RenderGraphPass> lastWriter(_resources.size(), RENDER_GRAPH_INVALID);
+	std::vector<std::vector<RenderGraphPass>> readersSinceWrite(_resources.size());
+
+	for (RenderGraphPass p = 0; p < numPasses; ++p) {
+		if (culled[p]) {
+			continue;
+		}
+
+		for (const Access& access : _passes[p].Accesses) {
+			addDependency(lastWriter[access.Resource], p);
+
+			if (access.Write) {
+				for (RenderGraphPass reader : readersSinceWrite[access.Resource]) {
+					addDependency(reader, p);
+				}
+				readersSinceWrite[access.Resource].clear();
+				lastWriter[access.Resource] = p;
+			}
+			else {
+				readersSinceWrite[access.Resource].push_back(p);
+			}
+		}
+	}
+
+	// Of all passes which are ready, the one whose inputs were produced most recently goes first. This keeps producers and consumers
+	// close together, which shortens the lifetimes of the transient resources in between, so that more of them share memory. Passes
+	// without inputs go as late as possible for the same reason. Ties go to the declaration order.
+	std::vector<int32> latestDependency(numPasses, -1);
+	std::vector<RenderGraphPass> ready;
+	for (RenderGraphPass p = 0; p < numPasses; ++p) {
+		if (not culled[p] and numDependencies[p] == 0) {
+			ready.push_back(p);
+		}
+	}
+
+	order.clear();
+	while (not ready.empty()) {
+		uint32 best = 0;
+		for (uint32 i = 1; i < (uint32)ready.size(); ++i) {
+			RenderGraphPass a = ready[i];
+			RenderGraphPass b = ready[best];
+			if (latestDependency[a] > latestDependency[b] or (latestDependency[a] == latestDependency[b] and a < b)) {
+				best = i;
+			}
+		}
+
+		RenderGraphPass p = ready[best];
+		ready.erase(ready.begin() + best);
+
+		int32 position = (int32)order.size();
+		order.push_back(p);
+
+		for (RenderGraphPass dependent : dependents[p]) {
+			latestDependency[dependent] = position;
+			if (--numDependencies[dependent] == 0) {
+				ready.push_back(dependent);
+			}
+		}
+	}
+}
+
+void RenderGraph::PlaceTransients(RenderGraphCompileResult& result) const {
+	uint32 numResources = (uint32)_resources.size();
+
+	std::vector<RenderGraphResource> sorted;
+	uint32 numHeapGroups = 0;
+	for (RenderGraphResource r = 0; r < numResources; ++r) {
+		if (_resources[r].Transient and result.FirstUse[r] != RENDER_GRAPH_INVALID) {
+			sorted.push_back(r);
+			numHeapGroups = Max(numHeapGroups, _resources[r].HeapGroup + 1);
+			result.TransientBytesWithoutAliasing += _resources[r].SizeInBytes;
+		}
+	}
+	result.HeapSizes.assign(numHeapGroups, 0);
+
+	// Largest first, each at the lowest offset which doesn't overlap a resource that is alive at the same time. Placing the large ones
+	// first leaves the gaps between them to the small ones.
+	std::sort(sorted.begin(), sorted.end(), [&](RenderGraphResource a, RenderGraphResource b) {
+		if (_resources[a].SizeInBytes != _resources[b].SizeInBytes) {
+			return _resources[a].SizeInBytes > _resources[b].SizeInBytes;
+		}
+		return a < b;
+	});
+
+	struct Range {
+		uint64 Begin;
+		uint64 End;
+	};
+
+	std::vector<Range> occupied;
+	for (uint32 i = 0; i < (uint32)sorted.size(); ++i) {
+		RenderGraphResource r = sorted[i];
+		const Resource& resource = _resources[r];
+
+		occupied.clear();
+		for (uint32 j = 0; j < i; ++j) {
+			RenderGraphResource other = sorted[j];
+			bool overlapping = result.FirstUse[other] <= result.LastUse[r] and result.FirstUse[r] <= result.LastUse[other];
+			if (overlapping and _resources[other].HeapGroup == resource.HeapGroup) {
+				occupied.push_back({ result.HeapOffsets[other], result.HeapOffsets[other] + _resources[other].SizeInBytes });
+			}
+		}
+		std::sort(occupied.begin(), occupied.end(), [](const Range& a, const Range& b) { return a.Begin < b.Begin; });
+
+		uint64 offset = 0;
+		for (const Range& range : occupied) {
+			if (offset + resource.SizeInBytes <= range.Begin) {
+				break;
+			}
+			offset = Max(offset, AlignTo(range.End, resource.Alignment));
+		}
+
+		result.HeapOffsets[r] = offset;
+		result.HeapSizes[resource.HeapGroup] = Max(result.HeapSizes[resource.HeapGroup], offset + resource.SizeInBytes);
+	}
+
+	for (uint64 heapSize : result.HeapSizes) {
+		result.TransientBytesWithAliasing += heapSize;
+	}
+
+	uint32 numPasses = (uint32)result.Passes.size();
+	for (uint32 p = 0; p < numPasses; ++p) {
+		uint64 live = 0;
+		for (RenderGraphResource r : sorted) {
+			if (result.FirstUse[r] <= p and p <= result.LastUse[r]) {
+				live += _resources[r].SizeInBytes;
+			}
+		}
+		result.PeakLiveTransientBytes = Max(result.PeakLiveTransientBytes, live);
+	}
+}
+
+void RenderGraph::ComputeBarriers(RenderGraphCompileResult& result) const {
+	uint32 numPasses = (uint32)result.Passes.size();
+	uint32 numResources = (uint32)_resources.size();
+
+	// A split barrier may stay open from after pass 'from' to before pass 'to', if none of the passes in between records into several
+	// command lists. 'from' is RENDER_GRAPH_INVALID for the start of the graph.
+	auto canSplit = [&](uint32 from, uint32 to) {
+		uint32 first = (from == RENDER_GRAPH_INVALID) ? 0 : from + 1;
+		if (first >= to) {
+			return false;
+		}
+		for (uint32 p = first; p < to; ++p) {
+			if (_passes[result.Passes[p].Pass].Flags & ERenderGraphPassFlagsMultipleCommandLists) {
+				return false;
+			}
+		}
+		return true;
+	};
+
+	// Transition for the resource, so that it is in 'after' before pass 'to', or at the end of the graph if 'to' is 'numPasses'.
+	auto transition = [&](RenderGraphResource r, uint32 before, uint32 after, uint32 from, uint32 to) {
+		RenderGraphBarrier barrier = { ERenderGraphBarrierTransition, ERenderGraphBarrierSplitNone, r, RENDER_GRAPH_INVALID, before, after };
+		++result.NumTransitions;
+
+		auto& end = (to == numPasses) ? result.Passes[numPasses - 1].BarriersAfter : result.Passes[to].BarriersBefore;
+		if (canSplit(from, to)) {
+			auto& begin = (from == RENDER_GRAPH_INVALID) ? result.Passes[0].BarriersBefore : result.Passes[from].BarriersAfter;
+			barrier.Split = ERenderGraphBarrierSplitBegin;
+			begin.push_back(barrier);
+			barrier.Split = ERenderGraphBarrierSplitEnd;
+			++result.NumSplitTransitions;
+		}
+		end.push_back(barrier);
+	};
+
+	// Accesses in execution order. Reads between two writes are merged into one state, so that a resource which is read in different
+	// ways is transitioned once.
+	struct Segment {
+		uint32 First;
+		uint32 Last;
+		uint32 State;
+		bool Write;
+	};
+
+	std::vector<std::vector<Segment>> segments(numResources);
+	for (uint32 p = 0; p < numPasses; ++p) {
+		for (const Access& access : _passes[result.Passes[p].Pass].Accesses) {
+			auto& s = segments[access.Resource];
+			if (not access.Write and not s.empty() and not s.back().Write) {
+				s.back().Last = p;
+				s.back().State |= access.State;
+			}
+			else {
+				s.push_back({ p, p, access.State, access.Write });
+			}
+		}
+	}
+
+	for (RenderGraphResource r = 0; r < numResources; ++r) {
+		const Resource& resource = _resources[r];
+		const auto& s = segments[r];
+
+		if (s.empty()) {
+			if (not resource.Transient and resource.InitialState != resource.FinalState and numPasses > 0) {
+				transition(r, resource.InitialState, resource.FinalState, RENDER_GRAPH_INVALID, numPasses);
+			}
+			continue;
+		}
+
+		uint32 state = resource.Transient ? s[0].State : resource.InitialState;
+		uint32 last = RENDER_GRAPH_INVALID;
+
+		if (resource.Transient) {
+			// The memory may have belonged to other resources before. Those which overlap it and are already dead must be done with it.
+			RenderGraphResource before = RENDER_GRAPH_INVALID;
+			uint32 numBefore = 0;
+			for (RenderGraphResource other = 0; other < numResources; ++other) {
+				if (other == r or not _resources[other].Transient or _resources[other].HeapGroup != resource.HeapGroup
+					or result.LastUse[other] == RENDER_GRAPH_INVALID or result.LastUse[other] >= s[0].First) {
+					continue;
+				}
+				uint64 begin = result.HeapOffsets[r], end = begin + resource.SizeInBytes;
+				uint64 otherBegin = result.HeapOffsets[other], otherEnd = otherBegin + _resources[other].SizeInBytes;
+				if (begin < otherEnd and otherBegin < end) {
+					before = other;
+					++numBefore;
+				}
+			}
+
+			if (numBefore > 0) {
+				result.Passes[s[0].First].BarriersBefore.push_back({ ERenderGraphBarrierAliasing, ERenderGraphBarrierSplitNone, r,
+					(numBefore == 1) ? before : RENDER_GRAPH_INVALID, ERenderGraphAccessNone, ERenderGraphAccessNone });
+				++result.NumAliasingBarriers;
+			}
+		}
+
+		for (const Segment& segment : s) {
+			if (segment.State != state) {
+				transition(r, state, segment.State, last, segment.First);
+				state = segment.State;
+			}
+			else if (last != RENDER_GRAPH_INVALID and segment.Write and state == ERenderGraphAccessUnorderedAccess) {
+				result.Passes[segment.First].BarriersBefore.push_back({ ERenderGraphBarrierUAV, ERenderGraphBarrierSplitNone, r,
+					RENDER_GRAPH_INVALID, state, state });
+				++result.NumUAVBarriers;
+			}
+			last = segment.Last;
+		}
+
+		if (not resource.Transient and state != resource.FinalState) {
+			transition(r, state, resource.FinalState, last, numPasses);
+		}
+	}
+}
+
+bool RenderGraph::Compile(RenderGraphCompileResult& result) const {
+	uint32 numPasses = (uint32)_passes.size();
+	uint32 numResources = (uint32)_resources.size();
+
+	result = {};
+	result.Culled.assign(numPasses, false);
+	CullPasses(result.Culled);
+
+	std::vector<RenderGraphPass> order;
+	SortPasses(result.Culled, order);
+
+	for (RenderGraphPass p = 0; p < numPasses; ++p) {
+		result.NumCulledPasses += result.Culled[p];
+	}
+	if (order.size() + result.NumCulledPasses != numPasses) {
+		return false;
+	}
+
+	result.HeapOffsets.assign(numResources, RENDER_GRAPH_INVALID);
+	result.FirstUse.assign(numResources, RENDER_GRAPH_INVALID);
+	result.LastUse.assign(numResources, RENDER_GRAPH_INVALID);
+
+	result.Passes.resize(order.size());
+	for (uint32 i = 0; i < (uint32)order.size(); ++i) {
+		result.Passes[i].Pass = order[i];
+
+		for (const Access& access : _passes[order[i]].Accesses) {
+			if (result.FirstUse[access.Resource] == RENDER_GRAPH_INVALID) {
+				// The contents of a transient resource are undefined before its first write.
+				if (_resources[access.Resource].Transient and (not access.Write or access.Read)) {
+					return false;
+				}
+				result.FirstUse[access.Resource] = i;
+			}
+			result.LastUse[access.Resource] = i;
+		}
+	}
+
+	PlaceTransients(result);
+	ComputeBarriers(result);
+	return true;
+}
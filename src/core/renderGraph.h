@@ -0,0 +1,152 @@
+#pragma once
+
+#include "../pch.h"
+
+// Frame graph compiler. Passes declare which resources they read and write, and Compile works out everything which follows from that:
+// the execution order, which passes can be culled, the barriers between passes and where transient resources live in shared memory.
+// It only deals with handles, sizes and access flags, so it doesn't depend on D3D. The renderer maps accesses to resource states and
+// records the barriers.
+
+#define RENDER_GRAPH_INVALID UINT32_MAX
+
+typedef uint32 RenderGraphResource;
+typedef uint32 RenderGraphPass;
+
+// Accesses which a pass can declare. They map one to one to D3D12 resource states. Read accesses can be combined, writes are exclusive.
+// Resources are tracked as a whole: a pass which writes one mip and reads another declares a single unordered access write.
+enum ERenderGraphAccess : uint32 {
+	ERenderGraphAccessNone = 0, // Common state. Only valid as initial or final state of imported resources.
+
+	ERenderGraphAccessRenderTarget = (1 << 0),
+	ERenderGraphAccessDepthWrite = (1 << 1),
+	ERenderGraphAccessUnorderedAccess = (1 << 2),
+	ERenderGraphAccessCopyDest = (1 << 3),
+
+	ERenderGraphAccessDepthRead = (1 << 4),
+	ERenderGraphAccessPixelShaderRead = (1 << 5),
+	ERenderGraphAccessNonPixelShaderRead = (1 << 6),
+	ERenderGraphAccessCopySource = (1 << 7),
+
+	ERenderGraphAccessWriteMask = ERenderGraphAccessRenderTarget | ERenderGraphAccessDepthWrite | ERenderGraphAccessUnorderedAccess | ERenderGraphAccessCopyDest,
+	ERenderGraphAccessShaderRead = ERenderGraphAccessPixelShaderRead | ERenderGraphAccessNonPixelShaderRead,
+};
+
+enum ERenderGraphPassFlags : uint32 {
+	ERenderGraphPassFlagsNone = 0,
+
+	// Never culled, for passes with effects outside of the graph, like a copy into a readback buffer.
+	ERenderGraphPassFlagsSideEffects = (1 << 0),
+
+	// The pass is recorded into several command lists. Split barriers begin and end in the same command list, so none may stay open
+	// across this pass.
+	ERenderGraphPassFlagsMultipleCommandLists = (1 << 1),
+};
+
+enum ERenderGraphBarrierType : uint8 {
+	ERenderGraphBarrierTransition,
+	ERenderGraphBarrierUAV,
+	ERenderGraphBarrierAliasing,
+};
+
+enum ERenderGraphBarrierSplit : uint8 {
+	ERenderGraphBarrierSplitNone,
+	ERenderGraphBarrierSplitBegin,
+	ERenderGraphBarrierSplitEnd,
+};
+
+struct RenderGraphBarrier {
+	ERenderGraphBarrierType Type;
+	ERenderGraphBarrierSplit Split;
+	RenderGraphResource Resource;
+	RenderGraphResource ResourceBefore; // Aliasing only. RENDER_GRAPH_INVALID if more than one resource used the memory before.
+	uint32 StateBefore; // ERenderGraphAccess flags. Transitions only.
+	uint32 StateAfter;
+};
+
+struct RenderGraphCompiledPass {
+	RenderGraphPass Pass;
+	std::vector<RenderGraphBarrier> BarriersBefore;
+	std::vector<RenderGraphBarrier> BarriersAfter; // Beginnings of split barriers and final transitions of imported resources.
+};
+
+struct RenderGraphCompileResult {
+	std::vector<RenderGraphCompiledPass> Passes; // In execution order, without culled passes.
+	std::vector<bool> Culled; // Per declared pass.
+
+	// Per resource. Transient resources which are used by no pass which survives culling get RENDER_GRAPH_INVALID as offset.
+	std::vector<uint64> HeapOffsets;
+	std::vector<uint32> FirstUse; // Index into 'Passes', RENDER_GRAPH_INVALID if unused.
+	std::vector<uint32> LastUse;
+
+	std::vector<uint64> HeapSizes; // Per heap group.
+
+	uint64 TransientBytesWithoutAliasing; // Sum of all used transient resources.
+	uint64 TransientBytesWithAliasing; // Sum of all heap sizes.
+	uint64 PeakLiveTransientBytes; // Most transient memory alive during any one pass. The lower bound for the above.
+	uint32 NumCulledPasses;
+	uint32 NumTransitions;
+	uint32 NumSplitTransitions; // Counted once, not as begin and end.
+	uint32 NumUAVBarriers;
+	uint32 NumAliasingBarriers;
+};
+
+class RenderGraph {
+public:
+	void Reset();
+
+	// Transient resources only live during the frame. Their first access must be a write, and they are created in the state of this
+	// access, so no transition precedes it. Resources in the same heap group may share memory; heap groups exist because not every
+	// kind of resource can be placed in the same heap.
+	RenderGraphResource CreateTransient(const char* name, uint64 sizeInBytes, uint64 alignment, uint32 heapGroup = 0);
+
+	// Imported resources outlive the frame, like history textures or the frame result. They start in 'initialState' and are transitioned
+	// to 'finalState' after their last use. A write to an imported resource is an output of the graph, which keeps the pass alive.
+	RenderGraphResource Import(const char* name, uint32 initialState, uint32 finalState);
+
+	// Passes execute in declaration order, as far as dependencies go: a read depends on the last earlier write of the resource, a write
+	// on all reads and the write before it.
+	RenderGraphPass AddPass(const char* name, uint32 flags = ERenderGraphPassFlagsNone);
+	void Read(RenderGraphPass pass, RenderGraphResource resource, uint32 access);
+	void Write(RenderGraphPass pass, RenderGraphResource resource, uint32 access);
+
+	bool Compile(RenderGraphCompileResult& result) const;
+
+	const char* GetResourceName(RenderGraphResource resource) const { return _resources[resource].Name; }
+	const char* GetPassName(RenderGraphPass pass) const { return _passes[pass].Name; }
+	uint32 NumResources() const { return (uint32)_resources.size(); }
+	uint32 NumPasses() const { return (uint32)_passes.size(); }
+
+private:
+	struct Resource {
+		const char* Name;
+		uint64 SizeInBytes;
+		uint64 Alignment;
+		uint32 HeapGroup;
+		bool Transient;
+		uint32 InitialState;
+		uint32 FinalState;
+	};
+
+	struct Access {
+		RenderGraphResource Resource;
+		uint32 State;
+		bool Read;
+		bool Write;
+	};
+
+	struct Pass {
+		const char* Name;
+		uint32 Flags;
+		std::vector<Access> Accesses;
+	};
+
+	void AddAccess(RenderGraphPass pass, RenderGraphResource resource, uint32 access, bool write);
+
+	void CullPasses(std::vector<bool>& culled) const;
+	void SortPasses(const std::vector<bool>& culled, std::vector<RenderGraphPass>& order) const;
+	void PlaceTransients(RenderGraphCompileResult& result) const;
+	void ComputeBarriers(RenderGraphCompileResult& result) const;
+
+	std::vector<Resource> _resources;
+	std::vector<Pass> _passes;
+};
@@ -0,0 +1,281 @@
+#include "resourceStateTracker.h"
+
+#include <algorithm>
+
+namespace {
+	bool IsReadOnly(uint32 state) {
+		return state != 0 and (state & RESOURCE_STATE_WRITE_MASK) == 0;
+	}
+
+	// A resource in 'current' can be used as if it was in 'requested' without a barrier.
+	bool Covers(uint32 current, uint32 requested) {
+		return current == requested or (IsReadOnly(current) and IsReadOnly(requested) and (current & requested) == requested);
+	}
+}
+
+void ResourceStateStatistics::Add(const ResourceStateStatistics& other) {
+	NumRequested += other.NumRequested;
+	NumRecorded += other.NumRecorded;
+	NumRedundant += other.NumRedundant;
+	NumMerged += other.NumMerged;
+	NumCorrected += other.NumCorrected;
+	NumFixups += other.NumFixups;
+}
+
+void LocalResourceStateTracker::Reset() {
+	_resources.clear();
+	_pending.clear();
+	_openSplits.clear();
+	_statistics = {};
+}
+
+LocalResourceStateTracker::Resource& LocalResourceStateTracker::GetResource(uint64 resource, uint32 numSubresources, bool decays) {
+	auto it = _resources.find(resource);
+	if (it == _resources.end()) {
+		uint32 n = Max(numSubresources, 1u);
+		it = _resources.emplace(resource, Resource{ n, decays, std::vector<uint32>(n, RESOURCE_STATE_UNKNOWN) }).first;
+	}
+	return it->second;
+}
+
+void LocalResourceStateTracker::Transition(const ResourceStateBarrier& barrier, std::vector<ResourceStateBarrier>& out) {
+	if (barrier.Split == EResourceStateBarrierSplitEnd) {
+		for (uint32 i = 0; i < (uint32)_openSplits.size(); ++i) {
+			OpenSplit& split = _openSplits[i];
+			if (split.Resource == barrier.Resource and split.Subresource == barrier.Subresource) {
+				if (not split.Dropped) {
+					out.push_back(barrier);
+					out.back().Before = split.Before;
+				}
+				_openSplits.erase(_openSplits.begin() + i);
+				return;
+			}
+		}
+
+		// The state was updated at the beginning.
+		out.push_back(barrier);
+		return;
+	}
+
+	++_statistics.NumRequested;
+	bool split = (barrier.Split == EResourceStateBarrierSplitBegin);
+
+	Resource& resource = GetResource(barrier.Resource, barrier.NumSubresources, barrier.Decays);
+	if (barrier.Subresource != RESOURCE_STATE_ALL_SUBRESOURCES and barrier.Subresource >= resource.NumSubresources) {
+		out.push_back(barrier);
+		return;
+	}
+
+	uint32 first = (barrier.Subresource == RESOURCE_STATE_ALL_SUBRESOURCES) ? 0 : barrier.Subresource;
+	uint32 end = (barrier.Subresource == RESOURCE_STATE_ALL_SUBRESOURCES) ? resource.NumSubresources : barrier.Subresource + 1;
+
+	// Subresources the list hasn't touched yet must be in the requested 'before' state when the list starts.
+	bool allUnknown = true;
+	for (uint32 i = first; i < end; ++i) {
+		allUnknown &= (resource.States[i] == RESOURCE_STATE_UNKNOWN);
+	}
+
+	if (allUnknown and barrier.Subresource == RESOURCE_STATE_ALL_SUBRESOURCES) {
+		_pending.push_back({ barrier.Resource, RESOURCE_STATE_ALL_SUBRESOURCES, barrier.Before });
+	}
+	for (uint32 i = first; i < end; ++i) {
+		if (resource.States[i] == RESOURCE_STATE_UNKNOWN) {
+			if (not allUnknown or barrier.Subresource != RESOURCE_STATE_ALL_SUBRESOURCES) {
+				_pending.push_back({ barrier.Resource, i, barrier.Before });
+			}
+			resource.States[i] = barrier.Before;
+		}
+	}
+
+	bool uniform = true;
+	for (uint32 i = first + 1; i < end; ++i) {
+		uniform &= (resource.States[i] == resource.States[first]);
+	}
+
+	if (uniform) {
+		uint32 current = resource.States[first];
+		if (Covers(current, barrier.After)) {
+			++_statistics.NumRedundant;
+			if (split) {
+				_openSplits.push_back({ barrier.Resource, barrier.Subresource, current, true });
+			}
+			return;
+		}
+
+		if (current != barrier.Before) {
+			++_statistics.NumCorrected;
+			if (split) {
+				_openSplits.push_back({ barrier.Resource, barrier.Subresource, current, false });
+			}
+		}
+
+		out.push_back(barrier);
+		out.back().Before = current;
+		for (uint32 i = first; i < end; ++i) {
+			resource.States[i] = barrier.After;
+		}
+		return;
+	}
+
+	// The subresources are in different states, so the transition has to be split up per subresource. A split barrier is recorded in full
+	// right away, and its end is dropped.
+	bool corrected = false;
+	for (uint32 i = first; i < end; ++i) {
+		uint32 current = resource.States[i];
+		if (Covers(current, barrier.After)) {
+			continue;
+		}
+		corrected |= (current != barrier.Before);
+
+		ResourceStateBarrier subresourceBarrier = barrier;
+		subresourceBarrier.Subresource = i;
+		subresourceBarrier.Before = current;
+		subresourceBarrier.Split = EResourceStateBarrierSplitNone;
+		out.push_back(subresourceBarrier);
+		resource.States[i] = barrier.After;
+	}
+	_statistics.NumCorrected += corrected;
+
+	if (split) {
+		_openSplits.push_back({ barrier.Resource, barrier.Subresource, barrier.Before, true });
+	}
+}
+
+void LocalResourceStateTracker::Merge(std::vector<ResourceStateBarrier>& out, uint32 first) {
+	// A transition which continues the last barrier on the same resource in this batch is folded into it. Transitions which cancel each
+	// other out are removed entirely.
+	std::vector<bool> removed(out.size(), false);
+
+	for (uint32 j = first + 1; j < (uint32)out.size(); ++j) {
+		const ResourceStateBarrier& later = out[j];
+		if (later.Type != EResourceStateBarrierTransition or later.Split != EResourceStateBarrierSplitNone) {
+			continue;
+		}
+
+		for (uint32 k = j; k-- > first; ) {
+			if (removed[k] or out[k].Resource != later.Resource) {
+				continue;
+			}
+
+			ResourceStateBarrier& earlier = out[k];
+			if (earlier.Type == EResourceStateBarrierTransition and earlier.Split == EResourceStateBarrierSplitNone
+				and earlier.Subresource == later.Subresource and earlier.After == later.Before) {
+				earlier.After = later.After;
+				removed[j] = true;
+				++_statistics.NumMerged;
+
+				if (earlier.Before == earlier.After) {
+					removed[k] = true;
+					++_statistics.NumMerged;
+				}
+			}
+			break;
+		}
+	}
+
+	uint32 numKept = first;
+	for (uint32 i = first; i < (uint32)out.size(); ++i) {
+		if (not removed[i]) {
+			out[numKept++] = out[i];
+		}
+	}
+	out.resize(numKept);
+}
+
+void LocalResourceStateTracker::Filter(const ResourceStateBarrier* barriers, uint32 numBarriers, std::vector<ResourceStateBarrier>& out) {
+	uint32 first = (uint32)out.size();
+
+	for (uint32 i = 0; i < numBarriers; ++i) {
+		if (barriers[i].Type == EResourceStateBarrierTransition) {
+			Transition(barriers[i], out);
+		}
+		else {
+			out.push_back(barriers[i]);
+		}
+	}
+
+	Merge(out, first);
+
+	for (uint32 i = first; i < (uint32)out.size(); ++i) {
+		_statistics.NumRecorded += (out[i].Type == EResourceStateBarrierTransition and out[i].Split != EResourceStateBarrierSplitEnd);
+	}
+}
+
+void ResourceStateTable::Submit(const LocalResourceStateTracker& list, bool copyQueue, std::vector<ResourceStateBarrier>& out) {
+	std::lock_guard lock(_mutex);
+
+	uint32 numFixups = 0;
+	for (const auto& pending : list._pending) {
+		auto it = _states.find(pending.Resource);
+		if (it == _states.end()) {
+			continue;
+		}
+
+		const std::vector<uint32>& states = it->second;
+		uint32 numSubresources = list._resources.at(pending.Resource).NumSubresources;
+		uint32 first = (pending.Subresource == RESOURCE_STATE_ALL_SUBRESOURCES) ? 0 : pending.Subresource;
+		uint32 end = (pending.Subresource == RESOURCE_STATE_ALL_SUBRESOURCES) ? numSubresources : pending.Subresource + 1;
+		end = Min(end, (uint32)states.size());
+		if (first >= end) {
+			continue;
+		}
+
+		bool uniform = true;
+		for (uint32 i = first + 1; i < end; ++i) {
+			uniform &= (states[i] == states[first]);
+		}
+
+		ResourceStateBarrier fixup = { pending.Resource, numSubresources, pending.Subresource, states[first], pending.State,
+			EResourceStateBarrierTransition, EResourceStateBarrierSplitNone, false };
+
+		if (uniform and end - first == numSubresources) {
+			if (states[first] != RESOURCE_STATE_UNKNOWN and states[first] != pending.State) {
+				out.push_back(fixup);
+				++numFixups;
+			}
+			continue;
+		}
+
+		for (uint32 i = first; i < end; ++i) {
+			if (states[i] != RESOURCE_STATE_UNKNOWN and states[i] != pending.State) {
+				fixup.Subresource = i;
+				fixup.Before = states[i];
+				out.push_back(fixup);
+				++numFixups;
+			}
+		}
+	}
+
+	for (const auto& [key, resource] : list._resources) {
+		std::vector<uint32>& states = _states[key];
+		if (states.size() < resource.NumSubresources) {
+			states.resize(resource.NumSubresources, RESOURCE_STATE_UNKNOWN);
+		}
+		if (copyQueue or resource.Decays) {
+			// All subresources, also the ones the list didn't transition.
+			std::fill(states.begin(), states.end(), 0u);
+			continue;
+		}
+		for (uint32 i = 0; i < resource.NumSubresources; ++i) {
+			if (resource.States[i] != RESOURCE_STATE_UNKNOWN) {
+				states[i] = resource.States[i];
+			}
+		}
+	}
+
+	_statistics.Add(list._statistics);
+	_statistics.NumFixups += numFixups;
+	_statistics.NumRecorded += numFixups;
+}
+
+void ResourceStateTable::Forget(uint64 resource) {
+	std::lock_guard lock(_mutex);
+	_states.erase(resource);
+}
+
+ResourceStateStatistics ResourceStateTable::TakeStatistics() {
+	std::lock_guard lock(_mutex);
+	ResourceStateStatistics result = _statistics;
+	_statistics = {};
+	return result;
+}
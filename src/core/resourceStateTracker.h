@@ -0,0 +1,122 @@
+#pragma once
+
+#include "../pch.h"
+
+#include <unordered_map>
+
+// Resource state tracking for command lists, independent of D3D. Resources are opaque 64 bit keys, states are D3D12_RESOURCE_STATES values.
+//
+// Every command list filters its transitions through a local tracker, which knows the state of everything the list has transitioned so
+// far. It drops transitions into the state a resource is already in, corrects a wrong 'before' state, and folds chains of transitions
+// within one batch into one. The first transition of a resource in a list can't be checked locally, so the tracker keeps the state which
+// the list expects there. At submission, the global table compares these with the state the previous lists left the resources in, and
+// hands out fix-up barriers, which are executed right before the list.
+//
+// D3D12 returns some resources to the common state when a list finishes executing: buffers, simultaneous-access textures, and everything
+// a copy queue list touched. The table records the common state for those, not the last state the list transitioned them to.
+
+#define RESOURCE_STATE_UNKNOWN UINT32_MAX
+#define RESOURCE_STATE_ALL_SUBRESOURCES UINT32_MAX // Same value as D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES.
+
+// Render target, unordered access, depth write, stream out, copy dest, resolve dest and the video write states. A state without any of
+// these bits is a combination of read states, which covers all of its subsets.
+#define RESOURCE_STATE_WRITE_MASK (0x4 | 0x8 | 0x10 | 0x100 | 0x400 | 0x1000 | 0x20000 | 0x80000 | 0x800000)
+
+enum EResourceStateBarrierType : uint8 {
+	EResourceStateBarrierTransition,
+	// UAV and aliasing barriers. Passed through with all fields unchanged, so 'Before' and 'After' may carry anything. Transitions are never
+	// merged across them.
+	EResourceStateBarrierOther,
+};
+
+enum EResourceStateBarrierSplit : uint8 {
+	EResourceStateBarrierSplitNone,
+	EResourceStateBarrierSplitBegin,
+	EResourceStateBarrierSplitEnd,
+};
+
+struct ResourceStateBarrier {
+	uint64 Resource;
+	uint32 NumSubresources;
+	uint32 Subresource;
+	uint32 Before;
+	uint32 After;
+	EResourceStateBarrierType Type;
+	EResourceStateBarrierSplit Split;
+	bool Decays; // Buffers and simultaneous-access textures. Taken from the first transition of the resource in a list.
+};
+
+struct ResourceStateStatistics {
+	uint64 NumRequested;   // Transitions asked for. A split barrier counts once.
+	uint64 NumRecorded;    // Transitions which ended up in command lists, including fix-ups.
+	uint64 NumRedundant;   // Dropped, because the resource was already in the requested state.
+	uint64 NumMerged;      // Folded into an earlier transition of the same batch.
+	uint64 NumCorrected;   // Recorded with a different 'before' state than requested.
+	uint64 NumFixups;      // Inserted at submission.
+
+	void Add(const ResourceStateStatistics& other);
+};
+
+// Per command list. Not thread safe, like the list itself.
+class LocalResourceStateTracker {
+public:
+	void Reset();
+
+	// Filters one batch of barriers, which are recorded together, and appends what is left to 'out'.
+	void Filter(const ResourceStateBarrier* barriers, uint32 numBarriers, std::vector<ResourceStateBarrier>& out);
+
+	const ResourceStateStatistics& Statistics() const { return _statistics; }
+
+private:
+	struct Resource {
+		uint32 NumSubresources;
+		bool Decays;
+		std::vector<uint32> States; // Per subresource, RESOURCE_STATE_UNKNOWN until the list transitions it.
+	};
+
+	// State a subresource must be in when the list starts executing.
+	struct Pending {
+		uint64 Resource;
+		uint32 Subresource;
+		uint32 State;
+	};
+
+	// A split barrier whose begin was changed. The end gets the same treatment.
+	struct OpenSplit {
+		uint64 Resource;
+		uint32 Subresource;
+		uint32 Before;
+		bool Dropped;
+	};
+
+	Resource& GetResource(uint64 resource, uint32 numSubresources, bool decays);
+	void Transition(const ResourceStateBarrier& barrier, std::vector<ResourceStateBarrier>& out);
+	void Merge(std::vector<ResourceStateBarrier>& out, uint32 first);
+
+	std::unordered_map<uint64, Resource> _resources;
+	std::vector<Pending> _pending;
+	std::vector<OpenSplit> _openSplits;
+	ResourceStateStatistics _statistics = {};
+
+	friend class ResourceStateTable;
+};
+
+// States of all resources at the end of the last submitted list, shared by all queues. Thread safe.
+class ResourceStateTable {
+public:
+	// Must be called in the order the lists are executed. Appends the fix-ups for the list to 'out' and takes over the states it leaves
+	// its resources in. A resource which was never submitted before is assumed to be in the state the list expects. 'copyQueue' lists
+	// leave everything they touched in the common state.
+	void Submit(const LocalResourceStateTracker& list, bool copyQueue, std::vector<ResourceStateBarrier>& out);
+
+	// For resources which are about to be released. The key may be reused by a new resource.
+	void Forget(uint64 resource);
+
+	// Statistics of all lists submitted since the last call.
+	ResourceStateStatistics TakeStatistics();
+
+private:
+	std::unordered_map<uint64, std::vector<uint32>> _states;
+	ResourceStateStatistics _statistics = {};
+	std::mutex _mutex;
+};
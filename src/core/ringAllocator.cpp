@@ -0,0 +1,111 @@
+#include "ringAllocator.h"
+
+void RingAllocator::Initialize(uint64 capacity, uint64 granularity) {
+	assert(granularity > 0 and (granularity & (granularity - 1)) == 0);
+	assert(capacity > 0 and capacity % granularity == 0);
+
+	_capacity = capacity;
+	_granularity = granularity;
+	_head = 0;
+	_tail = 0;
+	_numFailedAllocations = 0;
+	_numWastedBytes = 0;
+	_epochs.clear();
+	_firstEpoch = 0;
+	_openFenceValue = 0;
+	_openNumWriters = 0;
+}
+
+uint64 RingAllocator::Allocate(uint64 size, uint64 alignment) {
+	uint64 claimSize = AlignTo(Max<uint64>(size, 1), _granularity);
+	if (alignment > _granularity) {
+		claimSize += alignment - _granularity;
+	}
+
+	if (claimSize > _capacity) {
+		_numFailedAllocations.fetch_add(1, std::memory_order_relaxed);
+		return RING_ALLOCATOR_FAILED;
+	}
+
+	// At most two claims: if the first one straddles the end of the ring, the second starts at or behind its beginning.
+	for (uint32 attempt = 0; attempt < 2; ++attempt) {
+		// Cheap early out, so that a full ring doesn't push the head further and further ahead with claims nobody can use.
+		uint64 tail = _tail.load(std::memory_order_acquire);
+		if (_head.load(std::memory_order_relaxed) + claimSize - tail > _capacity) {
+			break;
+		}
+
+		// Release, so that whatever the thread did before claiming is visible to anyone who reads a head past the claim.
+		uint64 start = _head.fetch_add(claimSize, std::memory_order_release);
+		uint64 end = start + claimSize;
+
+		// The tail only moves forward, so a fresh value can only help. If the claim still doesn't fit, it overlaps memory the GPU may be
+		// reading. It can't be given back, since other threads may have claimed behind it, but it's never written and is reclaimed with
+		// the epoch it falls into.
+		if (end - _tail.load(std::memory_order_acquire) > _capacity) {
+			_numWastedBytes.fetch_add(claimSize, std::memory_order_relaxed);
+			break;
+		}
+
+		uint64 physicalStart = start % _capacity;
+		if (physicalStart + claimSize > _capacity) {
+			_numWastedBytes.fetch_add(claimSize, std::memory_order_relaxed);
+			continue;
+		}
+
+		return AlignTo(physicalStart, Max(alignment, _granularity));
+	}
+
+	_numFailedAllocations.fetch_add(1, std::memory_order_relaxed);
+	return RING_ALLOCATOR_FAILED;
+}
+
+void RingAllocator::EndEpoch(uint64 fenceValue) {
+	std::lock_guard lock(_epochMutex);
+
+	// Skip epochs without allocations, so that idle queues don't grow the list. Writers stay registered with the open epoch.
+	uint64 head = Head();
+	uint64 lastHead = _epochs.empty() ? _tail.load(std::memory_order_relaxed) : _epochs.back().Head;
+	if (head > lastHead) {
+		_epochs.push_back({ head, Max(fenceValue, _openFenceValue), _openNumWriters });
+		_openFenceValue = 0;
+		_openNumWriters = 0;
+	}
+}
+
+void RingAllocator::Reclaim(uint64 completedFenceValue) {
+	std::lock_guard lock(_epochMutex);
+
+	// In order: an epoch with writers holds back all later ones, which may contain the rest of the writers' allocations.
+	while (not _epochs.empty() and _epochs.front().NumWriters == 0 and _epochs.front().FenceValue <= completedFenceValue) {
+		_tail.store(_epochs.front().Head, std::memory_order_release);
+		_epochs.pop_front();
+		++_firstEpoch;
+	}
+}
+
+uint64 RingAllocator::BeginWriting() {
+	std::lock_guard lock(_epochMutex);
+
+	++_openNumWriters;
+	return _firstEpoch + _epochs.size();
+}
+
+void RingAllocator::EndWriting(uint64 epoch, uint64 fenceValue) {
+	std::lock_guard lock(_epochMutex);
+
+	// The writer may have allocated in its own epoch and every one after it, so they all wait for its fence value. Its epoch can't have
+	// been reclaimed, since it still counted the writer.
+	assert(epoch >= _firstEpoch and epoch <= _firstEpoch + _epochs.size());
+	for (uint64 i = epoch - _firstEpoch; i < _epochs.size(); ++i) {
+		_epochs[i].FenceValue = Max(_epochs[i].FenceValue, fenceValue);
+	}
+	_openFenceValue = Max(_openFenceValue, fenceValue);
+
+	if (epoch - _firstEpoch < _epochs.size()) {
+		--_epochs[epoch - _firstEpoch].NumWriters;
+	}
+	else {
+		--_openNumWriters;
+	}
+}
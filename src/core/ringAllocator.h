@@ -0,0 +1,71 @@
+#pragma once
+
+#include "../pch.h"
+#include "memory.h"
+
+#include <atomic>
+#include <deque>
+
+// Linear allocator over a ring of 'capacity' bytes, for memory which is written once by the CPU and read by the GPU a frame later.
+// Independent of D3D: it only hands out offsets, the caller maps them into its own buffer.
+//
+// Head and tail are monotonically increasing virtual offsets, the physical offset is the virtual one modulo the capacity. Allocate is
+// lock-free: threads claim space with a single atomic add on the head. Space is given back in epochs: EndEpoch records the current head
+// together with the fence value which the work submitted in that epoch signals, and Reclaim moves the tail past every epoch whose fence
+// value has completed. Allocations made before EndEpoch without a writer must therefore be submitted before that fence value is signaled.
+//
+// Work which is submitted later, like a command list still recording when the epoch is closed, registers as a writer first. BeginWriting
+// returns the open epoch, EndWriting is called with the fence value of the submission. Until then that epoch and all later ones stay
+// in the ring, and afterwards none of them is reclaimed before the submission's fence value has completed.
+
+#define RING_ALLOCATOR_FAILED UINT64_MAX
+
+class RingAllocator {
+public:
+	// 'granularity' must be a power of two and 'capacity' a multiple of it. Every allocation is rounded up to the granularity, so that
+	// the head stays aligned without any extra work.
+	void Initialize(uint64 capacity, uint64 granularity = 256);
+
+	// Returns the physical offset, or RING_ALLOCATOR_FAILED if the ring is full. Alignments up to the granularity are free, larger
+	// ones are padded. Thread safe.
+	uint64 Allocate(uint64 size, uint64 alignment);
+
+	// Thread safe, but not with respect to writerless allocations of the epoch being closed (see above).
+	void EndEpoch(uint64 fenceValue);
+	void Reclaim(uint64 completedFenceValue);
+
+	// Thread safe. Every BeginWriting must be matched by exactly one EndWriting with the epoch it returned.
+	uint64 BeginWriting();
+	void EndWriting(uint64 epoch, uint64 fenceValue);
+
+	uint64 Capacity() const { return _capacity; }
+	uint64 Head() const { return _head.load(); } // Virtual.
+	uint64 NumBytesInFlight() const { return _head.load(std::memory_order_relaxed) - _tail.load(std::memory_order_relaxed); }
+	uint64 NumFailedAllocations() const { return _numFailedAllocations.load(std::memory_order_relaxed); }
+	uint64 NumWastedBytes() const { return _numWastedBytes.load(std::memory_order_relaxed); } // At the end of the ring, and by failed claims.
+
+private:
+	struct Epoch {
+		uint64 Head;
+		uint64 FenceValue;
+		uint32 NumWriters;
+	};
+
+	uint64 _capacity = 0;
+	uint64 _granularity = 0;
+
+	// On separate cache lines, since every allocation writes the head and reads the tail.
+	alignas(64) std::atomic<uint64> _head = 0;
+	alignas(64) std::atomic<uint64> _tail = 0;
+
+	alignas(64) std::atomic<uint64> _numFailedAllocations = 0;
+	std::atomic<uint64> _numWastedBytes = 0;
+
+	// Closed epochs, oldest first. Epochs are numbered in the order they are opened, the front one is '_firstEpoch', the open one
+	// '_firstEpoch + _epochs.size()'.
+	std::deque<Epoch> _epochs;
+	uint64 _firstEpoch = 0;
+	uint64 _openFenceValue = 0; // The largest fence value of the writers which were submitted in the open epoch.
+	uint32 _openNumWriters = 0;
+	std::mutex _epochMutex;
+};
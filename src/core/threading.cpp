@@ -1,9 +1,31 @@
 #include "threading.h"
 #include "math.h"
+#include "cpuProfiling.h"
 #include <intrin.h>
 
 JobFactory* JobFactory::_instance = new JobFactory{};
 
+namespace {
+    struct ParallelForState {
+        std::atomic<uint32> NextItem = 0;
+        std::atomic<uint32> NumFinished = 0;
+        uint32 Count = 0;
+        const std::function<void(uint32)>* Work = nullptr; // Only valid until NumFinished reaches Count.
+        ThreadJobContext Context; // Queue entries need one. Nobody waits on it.
+
+        // Returns false once every item is claimed.
+        bool RunNextItem() {
+            uint32 i = NextItem++;
+            if (i >= Count) {
+                return false;
+            }
+            (*Work)(i);
+            ++NumFinished;
+            return true;
+        }
+    };
+}
+
 bool JobFactory::PerformWork() {
     WorkQueueEntry entry;
     if (_queue.PopFront(entry)) {
@@ -17,6 +39,8 @@ bool JobFactory::PerformWork() {
 }
 
 void JobFactory::WorkerThreadProc() {
+    CPU_PROFILE_THREAD_NAME("Worker thread");
+
     while (true) {
         if (not PerformWork()) {
             WaitForSingleObjectEx(_semaphoreHandle, INFINITE, FALSE);
@@ -27,6 +51,7 @@ void JobFactory::WorkerThreadProc() {
 void JobFactory::InitializeJobSystem() {
     uint32 numThreads = std::thread::hardware_concurrency();
     numThreads = clamp(numThreads, 1u, 8u);
+    _numThreads = numThreads;
     _semaphoreHandle = CreateSemaphoreExW(0, 0, numThreads, 0, 0, SEMAPHORE_ALL_ACCESS);
 
     for (uint32 i = 0; i < numThreads; i++) {
@@ -45,16 +70,24 @@ void JobFactory::InitializeJobSystem() {
 }
 
 void ThreadJobContext::AddWork(const std::function<void()> &work) {
+    while (not TryAddWork(work)) {
+        JobFactory::Instance()->PerformWork();
+    }
+}
+
+bool ThreadJobContext::TryAddWork(const std::function<void()> &work) {
     WorkQueueEntry entry;
     entry.Callback = work;
     entry.Context = this;
     ++NumJobs;
 
-    while (not JobFactory::Instance()->_queue.PushBack(entry)) {
-        JobFactory::Instance()->PerformWork();
+    if (not JobFactory::Instance()->_queue.PushBack(entry)) {
+        --NumJobs;
+        return false;
     }
 
     ReleaseSemaphore(JobFactory::Instance()->_semaphoreHandle, 1, 0);
+    return true;
 }
 
 void ThreadJobContext::WaitForWorkCompletion() {
@@ -66,4 +99,29 @@ void ThreadJobContext::WaitForWorkCompletion() {
     }
 }
 
+void ParallelFor(uint32 count, const std::function<void(uint32)> &work) {
+    if (count == 0) {
+        return;
+    }
+
+    // Shared with the helper jobs. A helper which only starts after the loop has finished finds nothing left to claim, and never touches
+    // 'work'.
+    auto state = std::make_shared<ParallelForState>();
+    state->Count = count;
+    state->Work = &work;
 
+    uint32 numHelpers = Min(JobFactory::Instance()->NumThreads(), count - 1);
+    for (uint32 i = 0; i < numHelpers; ++i) {
+        // With a full queue, the calling thread does the rest itself.
+        if (not state->Context.TryAddWork([state]() { while (state->RunNextItem()) {} })) {
+            break;
+        }
+    }
+
+    while (state->RunNextItem()) {}
+
+    // The remaining items are running on worker threads. They don't wait for anything, so this spin is short.
+    while (state->NumFinished.load() < count) {
+        std::this_thread::yield();
+    }
+}
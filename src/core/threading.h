@@ -39,8 +39,16 @@ struct ThreadJobContext {
 
 	void AddWork(const std::function<void()>& work);
 	void WaitForWorkCompletion();
+
+	// Returns false if the queue is full, instead of running queued jobs on this thread until there is room.
+	bool TryAddWork(const std::function<void()>& work);
 };
 
+// Runs 'work(i)' for every i in [0, count) on the worker threads and on the calling thread. Unlike WaitForWorkCompletion, the calling thread
+// only picks up items of this loop while it waits, never unrelated jobs from the queue. Use it where the caller may hold something other jobs
+// block on, such as the promise of an in-flight texture load.
+void ParallelFor(uint32 count, const std::function<void(uint32)>& work);
+
 struct WorkQueueEntry {
 	std::function<void()> Callback;
 	ThreadJobContext* Context;
@@ -50,6 +58,7 @@ class JobFactory {
 public:
 	void InitializeJobSystem();
 	static JobFactory* Instance() { return _instance; }
+	uint32 NumThreads() const { return _numThreads; }
 private:
 	template<class T, uint32 capacity>
 	struct ThreadSafeRingBuffer {
@@ -66,6 +75,7 @@ private:
 
 	ThreadSafeRingBuffer<WorkQueueEntry, 256> _queue = {};
 	HANDLE _semaphoreHandle = {};
+	uint32 _numThreads = 0;
 	static JobFactory* _instance;
 
 	bool PerformWork();
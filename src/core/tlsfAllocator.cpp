@@ -0,0 +1,323 @@
+#include "tlsfAllocator.h"
+
+#include <bit>
+#include <numeric>
+
+namespace {
+	// Divisions are the most expensive part of an allocation, so powers of two, which are the common case, avoid them.
+	uint64 RoundUp(uint64 value, uint64 multiple) {
+		if ((multiple & (multiple - 1)) == 0) {
+			return (value + multiple - 1) & ~(multiple - 1);
+		}
+		return (value + multiple - 1) / multiple * multiple;
+	}
+}
+
+void TlsfAllocator::Initialize(uint64 capacity, uint64 granularity) {
+	assert(granularity > 0 and capacity >= granularity);
+
+	_capacity = capacity - capacity % granularity;
+	_granularity = granularity;
+	_numFreeBytes = _capacity;
+	_numAllocations = 0;
+
+	_blocks.clear();
+	_unusedBlocks.clear();
+
+	_firstLevelBitmap = 0;
+	for (uint32 i = 0; i < TLSF_FIRST_LEVEL_COUNT; ++i) {
+		_secondLevelBitmaps[i] = 0;
+		for (uint32 j = 0; j < TLSF_SECOND_LEVEL_COUNT; ++j) {
+			_freeLists[i][j] = TLSF_ALLOCATOR_INVALID;
+		}
+	}
+
+	uint32 block = NewBlock();
+	_blocks[block].Offset = 0;
+	_blocks[block].Size = _capacity;
+	_lastPhysical = block;
+	InsertFree(block);
+}
+
+void TlsfAllocator::GetSizeClass(uint64 size, uint32& firstLevel, uint32& secondLevel) {
+	if (size < TLSF_SECOND_LEVEL_COUNT) {
+		firstLevel = 0;
+		secondLevel = (uint32)size;
+		return;
+	}
+
+	uint32 highestBit = 63 - (uint32)std::countl_zero(size);
+	firstLevel = highestBit - TLSF_SECOND_LEVEL_LOG2 + 1;
+	secondLevel = (uint32)(size >> (highestBit - TLSF_SECOND_LEVEL_LOG2)) - TLSF_SECOND_LEVEL_COUNT;
+}
+
+uint32 TlsfAllocator::FindFreeBlock(uint64 size) const {
+	// Round up to the next size class, so that every block in the list found is large enough.
+	if (size >= TLSF_SECOND_LEVEL_COUNT) {
+		uint32 highestBit = 63 - (uint32)std::countl_zero(size);
+		uint64 step = 1ull << (highestBit - TLSF_SECOND_LEVEL_LOG2);
+		if (size > UINT64_MAX - step) {
+			return TLSF_ALLOCATOR_INVALID;
+		}
+		size += step - 1;
+	}
+
+	uint32 firstLevel, secondLevel;
+	GetSizeClass(size, firstLevel, secondLevel);
+
+	uint32 secondLevelMap = _secondLevelBitmaps[firstLevel] & (~0u << secondLevel);
+	if (not secondLevelMap) {
+		uint64 firstLevelMap = (firstLevel + 1 < 64) ? (_firstLevelBitmap & (~0ull << (firstLevel + 1))) : 0;
+		if (not firstLevelMap) {
+			return TLSF_ALLOCATOR_INVALID;
+		}
+		firstLevel = (uint32)std::countr_zero(firstLevelMap);
+		secondLevelMap = _secondLevelBitmaps[firstLevel];
+	}
+	secondLevel = (uint32)std::countr_zero(secondLevelMap);
+
+	return _freeLists[firstLevel][secondLevel];
+}
+
+uint32 TlsfAllocator::NewBlock() {
+	uint32 block;
+	if (not _unusedBlocks.empty()) {
+		block = _unusedBlocks.back();
+		_unusedBlocks.pop_back();
+	}
+	else {
+		block = (uint32)_blocks.size();
+		_blocks.emplace_back();
+	}
+
+	_blocks[block] = { 0, 0, 1, 0, TLSF_ALLOCATOR_INVALID, TLSF_ALLOCATOR_INVALID, TLSF_ALLOCATOR_INVALID, TLSF_ALLOCATOR_INVALID, false, true };
+	return block;
+}
+
+void TlsfAllocator::DeleteBlock(uint32 block) {
+	_unusedBlocks.push_back(block);
+}
+
+void TlsfAllocator::InsertFree(uint32 block) {
+	Block& b = _blocks[block];
+	b.Free = true;
+
+	uint32 firstLevel, secondLevel;
+	GetSizeClass(b.Size, firstLevel, secondLevel);
+
+	uint32 head = _freeLists[firstLevel][secondLevel];
+	b.PrevFree = TLSF_ALLOCATOR_INVALID;
+	b.NextFree = head;
+	if (head != TLSF_ALLOCATOR_INVALID) {
+		_blocks[head].PrevFree = block;
+	}
+	_freeLists[firstLevel][secondLevel] = block;
+
+	_firstLevelBitmap |= (1ull << firstLevel);
+	_secondLevelBitmaps[firstLevel] |= (1u << secondLevel);
+}
+
+void TlsfAllocator::RemoveFree(uint32 block) {
+	Block& b = _blocks[block];
+	b.Free = false;
+
+	if (b.PrevFree != TLSF_ALLOCATOR_INVALID) {
+		_blocks[b.PrevFree].NextFree = b.NextFree;
+	}
+	if (b.NextFree != TLSF_ALLOCATOR_INVALID) {
+		_blocks[b.NextFree].PrevFree = b.PrevFree;
+	}
+
+	uint32 firstLevel, secondLevel;
+	GetSizeClass(b.Size, firstLevel, secondLevel);
+
+	if (_freeLists[firstLevel][secondLevel] == block) {
+		_freeLists[firstLevel][secondLevel] = b.NextFree;
+		if (b.NextFree == TLSF_ALLOCATOR_INVALID) {
+			_secondLevelBitmaps[firstLevel] &= ~(1u << secondLevel);
+			if (not _secondLevelBitmaps[firstLevel]) {
+				_firstLevelBitmap &= ~(1ull << firstLevel);
+			}
+		}
+	}
+}
+
+uint32 TlsfAllocator::Split(uint32 block, uint64 size) {
+	uint32 rest = NewBlock(); // May move '_blocks', so no references before this.
+
+	Block& b = _blocks[block];
+	Block& r = _blocks[rest];
+	r.Offset = b.Offset + size;
+	r.Size = b.Size - size;
+	r.PrevPhysical = block;
+	r.NextPhysical = b.NextPhysical;
+	b.Size = size;
+	b.NextPhysical = rest;
+
+	if (r.NextPhysical != TLSF_ALLOCATOR_INVALID) {
+		_blocks[r.NextPhysical].PrevPhysical = rest;
+	}
+	else {
+		_lastPhysical = rest;
+	}
+	return rest;
+}
+
+TlsfAllocation TlsfAllocator::Allocate(uint64 size, uint64 alignment, uint64 userData) {
+	return Allocate(size, alignment, userData, UINT64_MAX);
+}
+
+TlsfAllocation TlsfAllocator::Allocate(uint64 size, uint64 alignment, uint64 userData, uint64 maxFreeBlockSize) {
+	TlsfAllocation result = { TLSF_ALLOCATOR_INVALID, 0, 0 };
+
+	// Offsets of blocks are multiples of the granularity, so an alignment which is one as well costs at most 'alignment - granularity'
+	// bytes in front of the allocation. These become a free block of their own.
+	alignment = (alignment >= _granularity and RoundUp(alignment, _granularity) == alignment) ? alignment : std::lcm(Max<uint64>(alignment, 1), _granularity);
+	uint64 alignedSize = RoundUp(Max<uint64>(size, 1), _granularity);
+	uint64 searchSize = alignedSize + (alignment - _granularity);
+	if (alignedSize > _capacity or searchSize > _capacity) {
+		return result;
+	}
+
+	uint32 block = FindFreeBlock(searchSize);
+	if (block == TLSF_ALLOCATOR_INVALID or _blocks[block].Size > maxFreeBlockSize) {
+		return result;
+	}
+	RemoveFree(block);
+
+	uint64 offset = _blocks[block].Offset;
+	uint64 padding = RoundUp(offset, alignment) - offset;
+	if (padding) {
+		uint32 rest = Split(block, padding);
+		InsertFree(block); // The block before was used or there is none, since free blocks never touch.
+		block = rest;
+	}
+
+	if (_blocks[block].Size - alignedSize >= _granularity) {
+		uint32 rest = Split(block, alignedSize);
+		InsertFree(rest);
+	}
+
+	Block& b = _blocks[block];
+	b.Free = false;
+	b.Movable = true;
+	b.Alignment = alignment;
+	b.UserData = userData;
+
+	_numFreeBytes -= b.Size;
+	++_numAllocations;
+
+	result = { block, b.Offset, b.Size };
+	return result;
+}
+
+void TlsfAllocator::Free(uint32 block) {
+	assert(block < _blocks.size() and not _blocks[block].Free);
+
+	_numFreeBytes += _blocks[block].Size;
+	--_numAllocations;
+
+	uint32 prev = _blocks[block].PrevPhysical;
+	if (prev != TLSF_ALLOCATOR_INVALID and _blocks[prev].Free) {
+		RemoveFree(prev);
+		Block& p = _blocks[prev];
+		Block& b = _blocks[block];
+		p.Size += b.Size;
+		p.NextPhysical = b.NextPhysical;
+		if (b.NextPhysical != TLSF_ALLOCATOR_INVALID) {
+			_blocks[b.NextPhysical].PrevPhysical = prev;
+		}
+		else {
+			_lastPhysical = prev;
+		}
+		DeleteBlock(block);
+		block = prev;
+	}
+
+	uint32 next = _blocks[block].NextPhysical;
+	if (next != TLSF_ALLOCATOR_INVALID and _blocks[next].Free) {
+		RemoveFree(next);
+		Block& b = _blocks[block];
+		Block& n = _blocks[next];
+		b.Size += n.Size;
+		b.NextPhysical = n.NextPhysical;
+		if (n.NextPhysical != TLSF_ALLOCATOR_INVALID) {
+			_blocks[n.NextPhysical].PrevPhysical = block;
+		}
+		else {
+			_lastPhysical = block;
+		}
+		DeleteBlock(next);
+	}
+
+	InsertFree(block);
+}
+
+uint32 TlsfAllocator::PlanDefragmentation(std::vector<TlsfMove>& moves, uint64 maxBytes) {
+	uint32 firstMove = (uint32)moves.size();
+	uint64 numBytesMoved = 0;
+
+	// Allocations next to free space move into free blocks which are smaller than the one their old place merges into. Every move
+	// therefore turns a small hole into a larger one, and the largest free blocks are never cut up.
+	uint32 block = _lastPhysical;
+	while (block != TLSF_ALLOCATOR_INVALID) {
+		uint32 prev = _blocks[block].PrevPhysical;
+		uint32 next = _blocks[block].NextPhysical;
+
+		bool planned = false;
+		for (uint32 i = firstMove; i < (uint32)moves.size(); ++i) {
+			planned |= (moves[i].Destination.Block == block);
+		}
+
+		uint64 mergedSize = _blocks[block].Size;
+		if (prev != TLSF_ALLOCATOR_INVALID and _blocks[prev].Free) {
+			mergedSize += _blocks[prev].Size;
+		}
+		if (next != TLSF_ALLOCATOR_INVALID and _blocks[next].Free) {
+			mergedSize += _blocks[next].Size;
+		}
+
+		if (not _blocks[block].Free and _blocks[block].Movable and not planned and mergedSize > _blocks[block].Size) {
+			Block b = _blocks[block]; // Copy, since Allocate may move '_blocks'.
+			if (numBytesMoved + b.Size > maxBytes) {
+				break;
+			}
+
+			// The neighbours are smaller than the merged block, so they may be picked. Then the move would only shift the allocation.
+			TlsfAllocation destination = Allocate(b.Size, b.Alignment, b.UserData, mergedSize - b.Size - 1);
+			if (destination.Valid()) {
+				bool adjacent = (destination.Offset < b.Offset + b.Size + mergedSize and b.Offset < destination.Offset + destination.Size + mergedSize);
+				if (adjacent) {
+					Free(destination.Block);
+				}
+				else {
+					moves.push_back({ block, b.Offset, b.Size, b.UserData, destination });
+					numBytesMoved += b.Size;
+				}
+			}
+		}
+
+		block = prev;
+	}
+
+	return (uint32)moves.size() - firstMove;
+}
+
+uint64 TlsfAllocator::LargestFreeBlock() const {
+	if (not _firstLevelBitmap) {
+		return 0;
+	}
+
+	uint32 firstLevel = 63 - (uint32)std::countl_zero(_firstLevelBitmap);
+	uint32 secondLevel = 31 - (uint32)std::countl_zero(_secondLevelBitmaps[firstLevel]);
+
+	uint64 result = 0;
+	for (uint32 block = _freeLists[firstLevel][secondLevel]; block != TLSF_ALLOCATOR_INVALID; block = _blocks[block].NextFree) {
+		result = Max(result, _blocks[block].Size);
+	}
+	return result;
+}
+
+float TlsfAllocator::Fragmentation() const {
+	return _numFreeBytes ? 1.f - (float)LargestFreeBlock() / (float)_numFreeBytes : 0.f;
+}
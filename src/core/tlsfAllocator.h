@@ -0,0 +1,100 @@
+#pragma once
+
+#include "../pch.h"
+#include "memory.h"
+
+// Two-level segregated fit allocator over a range of 'capacity' bytes, for GPU heaps and buffers which are suballocated. Independent of
+// D3D: it only hands out offsets, the caller places its resources at them.
+//
+// Free blocks are kept in lists by size class. The first level is the power of two of the size, the second splits each power of two into
+// TLSF_SECOND_LEVEL_COUNT linear steps, and two bitmaps find the first non-empty list which is large enough in constant time. Freed blocks
+// merge with free neighbours right away, so there are never two free blocks next to each other. Not thread safe.
+
+#define TLSF_ALLOCATOR_INVALID UINT32_MAX
+#define TLSF_SECOND_LEVEL_LOG2 4
+#define TLSF_SECOND_LEVEL_COUNT (1 << TLSF_SECOND_LEVEL_LOG2)
+#define TLSF_FIRST_LEVEL_COUNT (65 - TLSF_SECOND_LEVEL_LOG2)
+
+struct TlsfAllocation {
+	uint32 Block; // TLSF_ALLOCATOR_INVALID if the allocation failed.
+	uint64 Offset;
+	uint64 Size;
+
+	bool Valid() const { return Block != TLSF_ALLOCATOR_INVALID; }
+};
+
+// A reallocation at a lower offset, which PlanDefragmentation has already reserved. The caller copies 'Size' bytes from 'SourceOffset' to
+// 'Destination.Offset' (or recreates the resource there) and calls FinishMove once nothing uses the source anymore.
+struct TlsfMove {
+	uint32 SourceBlock;
+	uint64 SourceOffset;
+	uint64 Size;
+	uint64 UserData;
+	TlsfAllocation Destination;
+};
+
+class TlsfAllocator {
+public:
+	// Every allocation is rounded up to 'granularity', which doesn't have to be a power of two.
+	void Initialize(uint64 capacity, uint64 granularity = 256);
+
+	// 'alignment' doesn't have to be a power of two either. 'userData' is handed back by PlanDefragmentation.
+	TlsfAllocation Allocate(uint64 size, uint64 alignment = 1, uint64 userData = 0);
+	void Free(uint32 block);
+
+	// Reserves new places for allocations whose old places would merge with free neighbours into larger free blocks, until 'maxBytes'
+	// would be exceeded. Allocations marked as not movable stay. Returns the number of moves appended.
+	uint32 PlanDefragmentation(std::vector<TlsfMove>& moves, uint64 maxBytes);
+	void FinishMove(const TlsfMove& move) { Free(move.SourceBlock); }
+	void SetMovable(uint32 block, bool movable) { _blocks[block].Movable = movable; }
+	void SetUserData(uint32 block, uint64 userData) { _blocks[block].UserData = userData; }
+
+	uint64 Capacity() const { return _capacity; }
+	uint64 NumFreeBytes() const { return _numFreeBytes; }
+	uint64 NumUsedBytes() const { return _capacity - _numFreeBytes; }
+	uint32 NumAllocations() const { return _numAllocations; }
+	uint64 LargestFreeBlock() const;
+	bool Empty() const { return _numAllocations == 0; }
+
+	// 0 if all free memory is in one block, close to 1 if it is scattered over many small ones.
+	float Fragmentation() const;
+
+private:
+	struct Block {
+		uint64 Offset;
+		uint64 Size;
+		uint64 Alignment;
+		uint64 UserData;
+		uint32 PrevPhysical; // Neighbours in memory.
+		uint32 NextPhysical;
+		uint32 PrevFree;     // Neighbours in the free list of the size class, if free.
+		uint32 NextFree;
+		bool Free;
+		bool Movable;
+	};
+
+	static void GetSizeClass(uint64 size, uint32& firstLevel, uint32& secondLevel);
+	uint32 FindFreeBlock(uint64 size) const;
+	TlsfAllocation Allocate(uint64 size, uint64 alignment, uint64 userData, uint64 maxFreeBlockSize);
+
+	uint32 NewBlock();
+	void DeleteBlock(uint32 block);
+	void InsertFree(uint32 block);
+	void RemoveFree(uint32 block);
+
+	// Splits 'size' bytes off the front of a used block and returns the block with the rest, which is free.
+	uint32 Split(uint32 block, uint64 size);
+
+	uint64 _capacity = 0;
+	uint64 _granularity = 0;
+	uint64 _numFreeBytes = 0;
+	uint32 _numAllocations = 0;
+
+	std::vector<Block> _blocks;
+	std::vector<uint32> _unusedBlocks;
+	uint32 _lastPhysical = TLSF_ALLOCATOR_INVALID;
+
+	uint64 _firstLevelBitmap = 0;
+	uint32 _secondLevelBitmaps[TLSF_FIRST_LEVEL_COUNT] = {};
+	uint32 _freeLists[TLSF_FIRST_LEVEL_COUNT][TLSF_SECOND_LEVEL_COUNT];
+};
@@ -122,6 +122,31 @@ DxBarrierBatcher& DxBarrierBatcher::Aliasing(DxResource before, DxResource after
 	return *this;
 }
 
+DxBarrierBatcher& DxBarrierBatcher::RenderGraphBarriers(const std::vector<RenderGraphBarrier>& barriers, const DxResource* resources) {
+	for (const RenderGraphBarrier& barrier : barriers) {
+		const DxResource& res = resources[barrier.Resource];
+		D3D12_RESOURCE_STATES from = GetD3D12ResourceStates(barrier.StateBefore);
+		D3D12_RESOURCE_STATES to = GetD3D12ResourceStates(barrier.StateAfter);
+
+		if (barrier.Type == ERenderGraphBarrierUAV) {
+			UAV(res);
+		}
+		else if (barrier.Type == ERenderGraphBarrierAliasing) {
+			Aliasing((barrier.ResourceBefore == RENDER_GRAPH_INVALID) ? DxResource() : resources[barrier.ResourceBefore], res);
+		}
+		else if (barrier.Split == ERenderGraphBarrierSplitBegin) {
+			TransitionBegin(res, from, to);
+		}
+		else if (barrier.Split == ERenderGraphBarrierSplitEnd) {
+			TransitionEnd(res, from, to);
+		}
+		else {
+			Transition(res, from, to);
+		}
+	}
+	return *this;
+}
+
 void DxBarrierBatcher::Submit() {
 	if (NumBarriers) {
 		Cl->Barriers(Barriers, NumBarriers);
@@ -129,3 +154,15 @@ void DxBarrierBatcher::Submit() {
 	}
 }
 
+D3D12_RESOURCE_STATES GetD3D12ResourceStates(uint32 renderGraphAccess) {
+	D3D12_RESOURCE_STATES states = D3D12_RESOURCE_STATE_COMMON;
+	if (renderGraphAccess & ERenderGraphAccessRenderTarget) { states |= D3D12_RESOURCE_STATE_RENDER_TARGET; }
+	if (renderGraphAccess & ERenderGraphAccessDepthWrite) { states |= D3D12_RESOURCE_STATE_DEPTH_WRITE; }
+	if (renderGraphAccess & ERenderGraphAccessUnorderedAccess) { states |= D3D12_RESOURCE_STATE_UNORDERED_ACCESS; }
+	if (renderGraphAccess & ERenderGraphAccessCopyDest) { states |= D3D12_RESOURCE_STATE_COPY_DEST; }
+	if (renderGraphAccess & ERenderGraphAccessDepthRead) { states |= D3D12_RESOURCE_STATE_DEPTH_READ; }
+	if (renderGraphAccess & ERenderGraphAccessPixelShaderRead) { states |= D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE; }
+	if (renderGraphAccess & ERenderGraphAccessNonPixelShaderRead) { states |= D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE; }
+	if (renderGraphAccess & ERenderGraphAccessCopySource) { states |= D3D12_RESOURCE_STATE_COPY_SOURCE; }
+	return states;
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "DxContext.h"
+#include "../core/renderGraph.h"
 
 class DxCommandList;
 
@@ -27,10 +28,15 @@ public:
 
 	DxBarrierBatcher& Aliasing(DxResource before, DxResource after);
 
+	// Barriers of a compiled render graph pass. 'resources' is indexed by the graph's resource handles.
+	DxBarrierBatcher& RenderGraphBarriers(const std::vector<RenderGraphBarrier>& barriers, const DxResource* resources);
+
 	void Submit();
 
 	DxCommandList* Cl;
 	CD3DX12_RESOURCE_BARRIER Barriers[16];
 	uint32 NumBarriers = 0;
 
-};
\ No newline at end of file
+};
+
+D3D12_RESOURCE_STATES GetD3D12ResourceStates(uint32 renderGraphAccess);
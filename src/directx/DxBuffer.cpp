@@ -3,10 +3,11 @@
 #include "DxCommandList.h"
 
 namespace {
-	void Retire(DxResource resource, DxCpuDescriptorHandle srv, DxCpuDescriptorHandle uav, DxCpuDescriptorHandle clear, DxGpuDescriptorHandle gpuClear, DxCpuDescriptorHandle raytracing) {
+	void Retire(DxResource resource, const DxMemoryAllocation& allocation, DxCpuDescriptorHandle srv, DxCpuDescriptorHandle uav, DxCpuDescriptorHandle clear, DxGpuDescriptorHandle gpuClear, DxCpuDescriptorHandle raytracing) {
 		DxContext& context = DxContext::Instance();
 		BufferGrave grave;
 		grave.Resource = resource;
+		grave.Allocation = allocation;
 		grave.Srv = srv;
 		grave.Uav = uav;
 		grave.Clear = clear;
@@ -78,20 +79,33 @@ void DxBuffer::UploadData(const void* bufferData) {
 		nullptr,
 		IID_PPV_ARGS(intermediateResource.GetAddressOf())
 	));
+	TRACK_ALLOCATION(EMemoryCategoryUpload, TotalSize);
 
 	D3D12_SUBRESOURCE_DATA subresourceData = {};
 	subresourceData.pData = bufferData;
 	subresourceData.RowPitch = TotalSize;
 	subresourceData.SlicePitch = subresourceData.RowPitch;
 
-	commandList->TransitionBarrier(Resource, D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_DEST);
+	if (IsBufferRange()) {
+		// Other ranges of the shared buffer may be read on other queues right now. Buffers are promoted to copy dest implicitly, so there is
+		// no need for a transition of the whole resource.
+		void* mapped;
+		ThrowIfFailed(intermediateResource->Map(0, nullptr, &mapped));
+		memcpy(mapped, bufferData, TotalSize);
+		intermediateResource->Unmap(0, nullptr);
 
-	UpdateSubresources(commandList->CommandList(),
-		Resource.Get(), intermediateResource.Get(),
-		0, 0, 1, &subresourceData);
+		commandList->CommandList()->CopyBufferRegion(Resource.Get(), OffsetInResource, intermediateResource.Get(), 0, TotalSize);
+	}
+	else {
+		commandList->TransitionBarrier(Resource, D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_DEST);
+
+		UpdateSubresources(commandList->CommandList(),
+			Resource.Get(), intermediateResource.Get(),
+			0, 0, 1, &subresourceData);
+	}
 
 	// We are omitting the transition to common here, since the resource automatically decays to common state after being accessed on a copy queue
-	dxContext.Retire(intermediateResource);
+	dxContext.Retire(intermediateResource, EMemoryCategoryUpload, TotalSize);
 	dxContext.ExecuteCommandList(commandList);
 }
 
@@ -113,24 +127,27 @@ void DxBuffer::UpdateDataRange(const void* data, uint32 offset, uint32 size) {
 		nullptr,
 		IID_PPV_ARGS(intermediateResource.GetAddressOf())
 	));
+	TRACK_ALLOCATION(EMemoryCategoryUpload, size);
 
-	commandList->TransitionBarrier(Resource, D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_DEST);
+	if (not IsBufferRange()) {
+		commandList->TransitionBarrier(Resource, D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_DEST);
+	}
 
 	void* mapped;
 	ThrowIfFailed(intermediateResource->Map(0, nullptr, &mapped));
 	memcpy(mapped, data, size);
 	intermediateResource->Unmap(0, nullptr);
 
-	commandList->CommandList()->CopyBufferRegion(Resource.Get(), offset, intermediateResource.Get(), 0, size);
+	commandList->CommandList()->CopyBufferRegion(Resource.Get(), OffsetInResource + offset, intermediateResource.Get(), 0, size);
 
 	// We are omitting the transition to common here, since the resource automatically decays to common state after being accessed on a copy queue.
 
-	dxContext.Retire(intermediateResource);
+	dxContext.Retire(intermediateResource, EMemoryCategoryUpload, size);
 	dxContext.ExecuteCommandList(commandList);
 }
 
 void DxBuffer::Initialize(uint32 elementSize, uint32 elementCount, void* data, bool allowUnorderedAccess, bool allowClearing,
-	bool raytracing, D3D12_RESOURCE_STATES initialState, D3D12_HEAP_TYPE heapType) {
+	bool raytracing, D3D12_RESOURCE_STATES initialState, D3D12_HEAP_TYPE heapType, bool allowSuballocation) {
 	DxContext& dxContext = DxContext::Instance();
 	D3D12_RESOURCE_FLAGS flags = allowUnorderedAccess ? D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS : D3D12_RESOURCE_FLAG_NONE;
 
@@ -149,17 +166,19 @@ void DxBuffer::Initialize(uint32 elementSize, uint32 elementCount, void* data, b
 	GpuClearUAV = {};
 	RaytracingSRV = {};
 
-	const auto heapProperties = CD3DX12_HEAP_PROPERTIES(heapType);
-	const auto resourceDesc = CD3DX12_RESOURCE_DESC::Buffer(TotalSize, flags);
-	ThrowIfFailed(dxContext.GetDevice()->CreateCommittedResource(
-		&heapProperties,
-		D3D12_HEAP_FLAG_NONE,
-		&resourceDesc,
-		initialState,
-		nullptr,
-		IID_PPV_ARGS(Resource.GetAddressOf())
-	));
-	GpuVirtualAddress = Resource->GetGPUVirtualAddress();
+	Resource = nullptr;
+	OffsetInResource = 0;
+
+	// Views index from the element size, so the range is aligned to it.
+	if (allowSuballocation and heapType == D3D12_HEAP_TYPE_DEFAULT and TotalSize > 0) {
+		Resource = dxContext.MemoryAllocator().AllocateBufferRange(TotalSize, elementSize, Allocation);
+		OffsetInResource = (uint32)Allocation.Offset;
+	}
+	if (not Resource) {
+		const auto resourceDesc = CD3DX12_RESOURCE_DESC::Buffer(TotalSize, flags);
+		Resource = dxContext.MemoryAllocator().CreateResource(resourceDesc, heapType, initialState, nullptr, Allocation);
+	}
+	GpuVirtualAddress = Resource->GetGPUVirtualAddress() + OffsetInResource;
 
 	if (data) {
 		if (heapType == D3D12_HEAP_TYPE_DEFAULT) {
@@ -210,7 +229,8 @@ Ptr<DxBuffer> DxBuffer::CreateReadback(uint32 elementSize, uint32 elementCount,
 
 Ptr<DxVertexBuffer> DxVertexBuffer::Create(uint32 elementSize, uint32 elementCount, void* data, bool allowUnorderedAccess, bool allowClearing) {
 	Ptr<DxVertexBuffer> result = MakePtr<DxVertexBuffer>();
-	result->Initialize(elementSize, elementCount, data, allowUnorderedAccess, allowClearing);
+	result->Initialize(elementSize, elementCount, data, allowUnorderedAccess, allowClearing, false, D3D12_RESOURCE_STATE_COMMON, D3D12_HEAP_TYPE_DEFAULT,
+		not allowUnorderedAccess and not allowClearing);
 	result->View.BufferLocation = result->GpuVirtualAddress;
 	result->View.SizeInBytes = result->TotalSize;
 	result->View.StrideInBytes = elementSize;
@@ -242,7 +262,8 @@ DXGI_FORMAT DxIndexBuffer::GetIndexBufferFormat(uint32 elementSize) {
 
 Ptr<DxIndexBuffer> DxIndexBuffer::Create(uint32 elementSize, uint32 elementCount, void* data, bool allowUnorderedAccess, bool allowClearing) {
 	Ptr<DxIndexBuffer> result = MakePtr<DxIndexBuffer>();
-	result->Initialize(elementSize, elementCount, data, allowUnorderedAccess, allowClearing);
+	result->Initialize(elementSize, elementCount, data, allowUnorderedAccess, allowClearing, false, D3D12_RESOURCE_STATE_COMMON, D3D12_HEAP_TYPE_DEFAULT,
+		not allowUnorderedAccess and not allowClearing);
 	result->View.BufferLocation = result->GpuVirtualAddress;
 	result->View.SizeInBytes = result->TotalSize;
 	result->View.Format = GetIndexBufferFormat(elementSize);
@@ -264,29 +285,23 @@ DxBuffer::~DxBuffer() {
 		name[min(arraysize(name) - 1, size)] = 0;
 	}
 
-	Retire(Resource, DefaultSRV, DefaultUAV, CpuClearUAV, GpuClearUAV, RaytracingSRV);
+	Retire(Resource, Allocation, DefaultSRV, DefaultUAV, CpuClearUAV, GpuClearUAV, RaytracingSRV);
 }
 
 void DxBuffer::Resize(uint32 newElementCount, D3D12_RESOURCE_STATES initialState) {
 	DxContext& context = DxContext::Instance();
 
-	Retire(Resource, DefaultSRV, DefaultUAV, CpuClearUAV, GpuClearUAV, RaytracingSRV);
+	Retire(Resource, Allocation, DefaultSRV, DefaultUAV, CpuClearUAV, GpuClearUAV, RaytracingSRV);
 
 	ElementCount = newElementCount;
 	TotalSize = ElementCount * ElementSize;
 
 	auto desc = Resource->GetDesc();
 
-	CD3DX12_HEAP_PROPERTIES heapProperties(HeapType);
+	// A resized buffer gets a resource of its own, even if it was a buffer range before.
 	CD3DX12_RESOURCE_DESC resourceDesc = CD3DX12_RESOURCE_DESC::Buffer(TotalSize, desc.Flags);
-	ThrowIfFailed(context.GetDevice()->CreateCommittedResource(
-		&heapProperties,
-		D3D12_HEAP_FLAG_NONE,
-		&resourceDesc,
-		initialState,
-		nullptr,
-		IID_PPV_ARGS(Resource.GetAddressOf())
-	));
+	Resource = context.MemoryAllocator().CreateResource(resourceDesc, HeapType, initialState, nullptr, Allocation);
+	OffsetInResource = 0;
 	GpuVirtualAddress = Resource->GetGPUVirtualAddress();
 
 	if (SupportsSRV) {
@@ -323,5 +338,9 @@ BufferGrave::~BufferGrave() {
 		if (Raytracing.CpuHandle.ptr) {
 			context.DescriptorAllocatorCPU().FreeHandle(Raytracing);
 		}
+
+		// Moved-from graves have no resource, so the memory is freed only once.
+		Resource.Reset();
+		context.MemoryAllocator().Free(Allocation);
 	}
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include "dx.h"
 #include "DxDescriptor.h"
+#include "DxMemoryAllocator.h"
 
 class DxContext;
 struct DxDescriptorHandle;
@@ -25,6 +26,10 @@ public:
 	virtual ~DxBuffer();
 
 	DxResource Resource = nullptr;
+	DxMemoryAllocation Allocation;
+
+	// Non-zero for buffer ranges, which share their resource with other buffers. GpuVirtualAddress and the views include it already.
+	uint32 OffsetInResource = 0;
 
 	uint32 ElementSize = 0;
 	uint32 ElementCount = 0;
@@ -54,14 +59,17 @@ public:
 	void UpdateUploadData(void* data, uint32 size);
 	void Resize(uint32 newElementCount, D3D12_RESOURCE_STATES initialState = D3D12_RESOURCE_STATE_COMMON);
 
+	bool IsBufferRange() const { return Allocation.Pool == EDxMemoryPoolBufferRanges; }
+
 	static Ptr<DxBuffer> Create(uint32 elementSize, uint32 elementCount, void* data, bool allowUnorderedAccess = false, bool allowClearing = false, D3D12_RESOURCE_STATES initialState = D3D12_RESOURCE_STATE_COMMON);
 	static Ptr<DxBuffer> CreateUpload(uint32 elementSize, uint32 elementCount, void* data);
 	static Ptr<DxBuffer> CreateRaytracingTLASBuffer(uint32 size);
 	static Ptr<DxBuffer> CreateReadback(uint32 elementSize, uint32 elementCount, D3D12_RESOURCE_STATES initialState = D3D12_RESOURCE_STATE_COPY_DEST);
 
 protected:
+	// 'allowSuballocation' places small buffers in a range of a shared buffer. Only for buffers which are never transitioned explicitly.
 	void Initialize(uint32 elementSize, uint32 elementCount, void* data, bool allowUnorderedAccess, bool allowClearing, bool raytracing = false,
-		D3D12_RESOURCE_STATES initialState = D3D12_RESOURCE_STATE_COMMON, D3D12_HEAP_TYPE heapType = D3D12_HEAP_TYPE_DEFAULT);
+		D3D12_RESOURCE_STATES initialState = D3D12_RESOURCE_STATE_COMMON, D3D12_HEAP_TYPE heapType = D3D12_HEAP_TYPE_DEFAULT, bool allowSuballocation = false);
 
 	friend class DxDescriptorRange;
 };
@@ -88,6 +96,7 @@ public:
 
 struct BufferGrave {
 	DxResource Resource;
+	DxMemoryAllocation Allocation;
 
 	DxCpuDescriptorHandle Srv;
 	DxCpuDescriptorHandle Uav;
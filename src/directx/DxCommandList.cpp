@@ -12,8 +12,88 @@ DxCommandList::DxCommandList(D3D12_COMMAND_LIST_TYPE type) {
 }
 
 
+namespace {
+	uint32 GetNumPlanes(DXGI_FORMAT format) {
+		switch (format) {
+		case DXGI_FORMAT_D24_UNORM_S8_UINT:
+		case DXGI_FORMAT_R24G8_TYPELESS:
+		case DXGI_FORMAT_D32_FLOAT_S8X24_UINT:
+		case DXGI_FORMAT_R32G8X24_TYPELESS:
+			return 2;
+		default:
+			return 1;
+		}
+	}
+
+	uint32 GetNumSubresources(const D3D12_RESOURCE_DESC& desc) {
+		if (desc.Dimension == D3D12_RESOURCE_DIMENSION_BUFFER) {
+			return 1;
+		}
+
+		uint32 arraySize = (desc.Dimension == D3D12_RESOURCE_DIMENSION_TEXTURE3D) ? 1 : desc.DepthOrArraySize;
+		return desc.MipLevels * arraySize * GetNumPlanes(desc.Format);
+	}
+}
+
 void DxCommandList::Barriers(CD3DX12_RESOURCE_BARRIER* barriers, uint32 numBarriers) {
-	_commandList->ResourceBarrier(numBarriers, barriers);
+	_stateBarriers.clear();
+	for (uint32 i = 0; i < numBarriers; ++i) {
+		const D3D12_RESOURCE_BARRIER& barrier = barriers[i];
+
+		ResourceStateBarrier& stateBarrier = _stateBarriers.emplace_back();
+		stateBarrier.Split = (barrier.Flags & D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY) ? EResourceStateBarrierSplitBegin
+			: (barrier.Flags & D3D12_RESOURCE_BARRIER_FLAG_END_ONLY) ? EResourceStateBarrierSplitEnd
+			: EResourceStateBarrierSplitNone;
+
+		if (barrier.Type == D3D12_RESOURCE_BARRIER_TYPE_TRANSITION) {
+			stateBarrier.Type = EResourceStateBarrierTransition;
+			stateBarrier.Resource = (uint64)barrier.Transition.pResource;
+			D3D12_RESOURCE_DESC desc = barrier.Transition.pResource->GetDesc();
+			stateBarrier.NumSubresources = GetNumSubresources(desc);
+			stateBarrier.Decays = (desc.Dimension == D3D12_RESOURCE_DIMENSION_BUFFER) or (desc.Flags & D3D12_RESOURCE_FLAG_ALLOW_SIMULTANEOUS_ACCESS);
+			stateBarrier.Subresource = barrier.Transition.Subresource;
+			stateBarrier.Before = barrier.Transition.StateBefore;
+			stateBarrier.After = barrier.Transition.StateAfter;
+		}
+		else {
+			// Other barriers are passed through unchanged, so 'Before' can carry the index of the original.
+			stateBarrier.Type = EResourceStateBarrierOther;
+			stateBarrier.Resource = (barrier.Type == D3D12_RESOURCE_BARRIER_TYPE_UAV) ? (uint64)barrier.UAV.pResource : (uint64)barrier.Aliasing.pResourceAfter;
+			stateBarrier.NumSubresources = 0;
+			stateBarrier.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+			stateBarrier.Before = i;
+			stateBarrier.After = 0;
+			stateBarrier.Decays = false;
+		}
+	}
+
+	_filteredBarriers.clear();
+	_stateTracker.Filter(_stateBarriers.data(), numBarriers, _filteredBarriers);
+
+	RecordBarriers(_filteredBarriers.data(), (uint32)_filteredBarriers.size(), barriers);
+}
+
+void DxCommandList::RecordBarriers(const ResourceStateBarrier* barriers, uint32 numBarriers, const CD3DX12_RESOURCE_BARRIER* original) {
+	if (numBarriers == 0) {
+		return;
+	}
+
+	_recordedBarriers.clear();
+	for (uint32 i = 0; i < numBarriers; ++i) {
+		const ResourceStateBarrier& barrier = barriers[i];
+		if (barrier.Type == EResourceStateBarrierTransition) {
+			D3D12_RESOURCE_BARRIER_FLAGS flags = (barrier.Split == EResourceStateBarrierSplitBegin) ? D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY
+				: (barrier.Split == EResourceStateBarrierSplitEnd) ? D3D12_RESOURCE_BARRIER_FLAG_END_ONLY
+				: D3D12_RESOURCE_BARRIER_FLAG_NONE;
+			_recordedBarriers.push_back(CD3DX12_RESOURCE_BARRIER::Transition((ID3D12Resource*)barrier.Resource,
+				(D3D12_RESOURCE_STATES)barrier.Before, (D3D12_RESOURCE_STATES)barrier.After, barrier.Subresource, flags));
+		}
+		else {
+			_recordedBarriers.push_back(original[barrier.Before]);
+		}
+	}
+
+	_commandList->ResourceBarrier((uint32)_recordedBarriers.size(), _recordedBarriers.data());
 }
 
 void DxCommandList::TransitionBarrier(const Ptr<DxTexture> &texture, D3D12_RESOURCE_STATES from, D3D12_RESOURCE_STATES to, uint32 subresource) {
@@ -26,7 +106,7 @@ void DxCommandList::TransitionBarrier(const Ptr<DxBuffer> &buffer, D3D12_RESOURC
 
 void DxCommandList::TransitionBarrier(DxResource resource, D3D12_RESOURCE_STATES from, D3D12_RESOURCE_STATES to, uint32 subresource) {
 	CD3DX12_RESOURCE_BARRIER barrier = CD3DX12_RESOURCE_BARRIER::Transition(resource.Get(), from, to, subresource);
-	_commandList->ResourceBarrier(1, &barrier);
+	Barriers(&barrier, 1);
 }
 
 void DxCommandList::UavBarrier(const Ptr<DxTexture> &texture) {
@@ -39,7 +119,7 @@ void DxCommandList::UavBarrier(const Ptr<DxBuffer> &buffer) {
 
 void DxCommandList::UavBarrier(DxResource resource) {
 	CD3DX12_RESOURCE_BARRIER barrier = CD3DX12_RESOURCE_BARRIER::UAV(resource.Get());
-	_commandList->ResourceBarrier(1, &barrier);
+	Barriers(&barrier, 1);
 }
 
 void DxCommandList::AliasingBarrier(const Ptr<DxTexture> &before, const Ptr<DxTexture> &after) {
@@ -52,7 +132,7 @@ void DxCommandList::AliasingBarrier(const Ptr<DxBuffer> &before, const Ptr<DxBuf
 
 void DxCommandList::AliasingBarrier(DxResource before, DxResource after) {
 	CD3DX12_RESOURCE_BARRIER barrier = CD3DX12_RESOURCE_BARRIER::Aliasing(before.Get(), after.Get());
-	_commandList->ResourceBarrier(1, &barrier);
+	Barriers(&barrier, 1);
 }
 
 void DxCommandList::AssertResourceState(const Ptr<DxTexture> &texture, D3D12_RESOURCE_STATES state, uint32 subresource) {
@@ -127,7 +207,12 @@ void DxCommandList::SetCompute32BitConstants(uint32 rootParameterIndex, uint32 n
 }
 
 DxAllocation DxCommandList::AllocateDynamicBuffer(uint32 sizeInBytes, uint32 alignment) {
-	DxAllocation allocation = _uploadBuffer.Allocate(sizeInBytes, alignment);
+	if (not _writesUploadBuffer) {
+		_uploadEpoch = _uploadBuffer->BeginWriting();
+		_writesUploadBuffer = true;
+	}
+
+	DxAllocation allocation = _uploadBuffer->Allocate(sizeInBytes, alignment);
 	return allocation;
 }
 
@@ -342,6 +427,17 @@ void DxCommandList::ClearDepth(DxRenderTarget &renderTarget, float depth) {
 	ClearDepth(renderTarget.DSV, depth);
 }
 
+void DxCommandList::ClearDepth(DxDsvDescriptorHandle dsv, const D3D12_RECT* rects, uint32 numRects, float depth) {
+	// D3D12 clears the whole view for zero rects.
+	if (numRects > 0) {
+		_commandList->ClearDepthStencilView(dsv, D3D12_CLEAR_FLAG_DEPTH, depth, 0, numRects, rects);
+	}
+}
+
+void DxCommandList::ClearDepth(DxRenderTarget &renderTarget, const D3D12_RECT* rects, uint32 numRects, float depth) {
+	ClearDepth(renderTarget.DSV, rects, numRects, depth);
+}
+
 void DxCommandList::ClearStencil(DxDsvDescriptorHandle dsv, uint32 stencil) {
 	_commandList->ClearDepthStencilView(dsv, D3D12_CLEAR_FLAG_STENCIL, 0.f, stencil, 0, nullptr);
 }
@@ -474,6 +570,6 @@ void DxCommandList::Reset() {
 		_descriptorHeaps[i] = nullptr;
 	}
 
-	_uploadBuffer.Reset();
 	_dynamicDescriptorHeap.Reset();
+	_stateTracker.Reset();
 }
@@ -8,16 +8,20 @@
 #include "DxTexture.h"
 #include "DxBuffer.h"
 #include "DxRenderTarget.h"
+#include "../core/resourceStateTracker.h"
+#include "../core/fenceRecycler.h"
 
-class DxCommandList {
+// Queues recycle lists once the fence reaches the value of their last execution. The base holds that value while the list is in flight.
+class DxCommandList : private FenceRecyclable {
 public:
 	DxCommandList(D3D12_COMMAND_LIST_TYPE type);
 
 	D3D12_COMMAND_LIST_TYPE Type() { return _type; }
+	uint64 ProfileOrder() const { return _profileOrder; }
 
 	ID3D12GraphicsCommandList4* CommandList() const { return _commandList.Get(); }
 
-	// Barriers
+	// Barriers. All of them go through the list's state tracker, which drops redundant transitions and corrects wrong 'before' states.
 	void Barriers(CD3DX12_RESOURCE_BARRIER* barriers, uint32 numBarriers);
 
 	// Avoid calling these. Instead, use the dx_barrier_batcher interface to batch multiple barriers into a single submission.
@@ -133,6 +137,8 @@ public:
 
 	void ClearDepth(DxDsvDescriptorHandle dsv, float depth = 1.f);
 	void ClearDepth(DxRenderTarget& renderTarget, float depth = 1.f);
+	void ClearDepth(DxDsvDescriptorHandle dsv, const D3D12_RECT* rects, uint32 numRects, float depth = 1.f);
+	void ClearDepth(DxRenderTarget& renderTarget, const D3D12_RECT* rects, uint32 numRects, float depth = 1.f);
 
 	void ClearStencil(DxDsvDescriptorHandle dsv, uint32 stencil = 0);
 	void ClearStencil(DxRenderTarget& renderTarget, uint32 stencil = 0);
@@ -176,14 +182,22 @@ private:
 	DxCommandAllocator _commandAllocator = nullptr;
 	DxGraphicsCommandList _commandList = nullptr;
 
-	DxUploadBuffer _uploadBuffer;
+	DxUploadBuffer* _uploadBuffer = nullptr; // The one of the queue the list is executed on.
+	bool _writesUploadBuffer = false;
+	uint64 _uploadEpoch = 0; // Returned by BeginWriting, while '_writesUploadBuffer' is set.
 	DxDynamicDescriptorHeap _dynamicDescriptorHeap;
 	ID3D12DescriptorHeap* _descriptorHeaps[D3D12_DESCRIPTOR_HEAP_TYPE_NUM_TYPES];
 
-	DxCommandList* _next;
-	uint64 _lastExecutionFenceValue;
-
 	DxQueryHeap _timeStampQueryHeap;
+	uint64 _profileOrder = 0; // Order in which the lists were handed out. Sorts profile events of different lists with equal timestamps.
+
+	LocalResourceStateTracker _stateTracker;
+	std::vector<ResourceStateBarrier> _stateBarriers;
+	std::vector<ResourceStateBarrier> _filteredBarriers;
+	std::vector<CD3DX12_RESOURCE_BARRIER> _recordedBarriers;
+
+	// Records without tracking. 'original' holds the D3D barriers for entries which aren't transitions and may be null if there are none.
+	void RecordBarriers(const ResourceStateBarrier* barriers, uint32 numBarriers, const CD3DX12_RESOURCE_BARRIER* original);
 
 	friend class DxContext;
 	friend class DxCommandQueue;
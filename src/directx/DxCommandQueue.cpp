@@ -6,6 +6,19 @@
 
 namespace {
 	DWORD ProcessRunningCommandAllocators(void* data);
+
+	// User and kernel time the thread has spent so far.
+	double GetThreadCpuMilliseconds(HANDLE thread) {
+		FILETIME creationTime, exitTime, kernelTime, userTime;
+		if (not GetThreadTimes(thread, &creationTime, &exitTime, &kernelTime, &userTime)) {
+			return 0.0;
+		}
+
+		// In units of 100 ns.
+		uint64 kernel = ((uint64)kernelTime.dwHighDateTime << 32) | kernelTime.dwLowDateTime;
+		uint64 user = ((uint64)userTime.dwHighDateTime << 32) | userTime.dwLowDateTime;
+		return (kernel + user) * 1e-4;
+	}
 }
 
 void DxCommandQueue::Initialize(DxDevice device) {
@@ -25,6 +38,8 @@ void DxCommandQueue::Initialize(DxDevice device) {
 		// TODO: Calibrate command queue time line with CPU.
 	}
 
+	_fenceEvent = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+	_wakeEvent = CreateEventW(nullptr, FALSE, FALSE, nullptr);
 	_processThread = std::thread([&] { ProcessRunningCommandAllocators(); });
 
 	switch (CommandListType) {
@@ -72,55 +87,58 @@ void DxCommandQueue::WaitForOtherQueue(DxCommandQueue& other) const {
 }
 
 void DxCommandQueue::Flush() {
-	while (_numRunningCommandLists) {}
+	while (_recycler.NumInFlight()) {
+		std::this_thread::yield();
+	}
 
 	WaitForFence(Signal());
 }
 
 void DxCommandQueue::LeaveThread() {
 	if (_processThread.joinable()) {
+		SetEvent(_wakeEvent);
 		_processThread.join();
 	}
+
+	CloseHandle(_fenceEvent);
+	CloseHandle(_wakeEvent);
+	_fenceEvent = _wakeEvent = nullptr;
 }
 
 void DxCommandQueue::ProcessRunningCommandAllocators() {
 	DxContext& dxContext = DxContext::Instance();
 
-	while (dxContext.IsRunning()) {
-		while (true) {
-			_commandListMutex.lock();
-			DxCommandList* list = _runningCommandLists;
-			if (list) {
-				_runningCommandLists = list->_next;
-			}
-			_commandListMutex.unlock();
-
-			if (list) {
-				WaitForFence(list->_lastExecutionFenceValue);
-				list->Reset();
+	// Lists still in flight when the application quits are recycled before the thread exits, so that Flush returns.
+	while (dxContext.IsRunning() or _recycler.NumInFlight()) {
+		uint64 waitFor = _recycler.Update(_fence->GetCompletedValue(), [](FenceRecyclable* recyclable) {
+			static_cast<DxCommandList*>(recyclable)->Reset();
+		});
 
-				_commandListMutex.lock();
-				list->_next = _freeCommandLists;
-				_freeCommandLists = list;
-				AtomicDecrement(_numRunningCommandLists);
-				_commandListMutex.unlock();
-			}
-			else {
-				break;
+		if (waitFor == 0) {
+			if (_recycler.BeginIdleWait()) {
+				WaitForSingleObject(_wakeEvent, INFINITE);
 			}
+			_recycler.EndIdleWait();
+		}
+		else {
+			// Everything the fence has passed by the time we wake up is recycled in one batch. The wake event only matters for quitting.
+			ThrowIfFailed(_fence->SetEventOnCompletion(waitFor, _fenceEvent));
+			HANDLE events[] = { _fenceEvent, _wakeEvent };
+			WaitForMultipleObjects(arraysize(events), events, FALSE, INFINITE);
 		}
+	}
+}
 
-		std::this_thread::yield();
+FenceRecyclerStatistics DxCommandQueue::RecyclerStatistics() {
+	FenceRecyclerStatistics result = _recycler.GetStatistics();
+	if (_processThread.joinable()) {
+		result.CpuMilliseconds = GetThreadCpuMilliseconds(_processThread.native_handle());
 	}
+	return result;
 }
 
 DxCommandList *DxCommandQueue::GetFreeCommandList() {
-	_commandListMutex.lock();
-	DxCommandList* result = _freeCommandLists;
-	if (result) {
-		_freeCommandLists = result->_next;
-	}
-	_commandListMutex.unlock();
+	DxCommandList* result = static_cast<DxCommandList*>(_recycler.PopFree());
 
 	if (not result) {
 		result = new DxCommandList(CommandListType);
@@ -136,20 +154,46 @@ DxCommandList *DxCommandQueue::GetFreeCommandList() {
 uint64 DxCommandQueue::Execute(DxCommandList* commandList) {
 	ThrowIfFailed(commandList->CommandList()->Close());
 
-	ID3D12CommandList* d3d12List = commandList->CommandList();
-	NativeQueue->ExecuteCommandLists(1, &d3d12List);
+	std::lock_guard lock(_submitMutex);
 
-	uint64 fenceValue = Signal();
+	// Resources the list didn't expect in the state they are in get transitioned by a separate list, which executes right before. Only
+	// the direct queue can do that for all states, so the other queues' lists are trusted, like they were before there was tracking.
+	_fixups.clear();
+	DxContext::Instance().ResourceStates().Submit(commandList->_stateTracker, CommandListType == D3D12_COMMAND_LIST_TYPE_COPY, _fixups);
 
-	commandList->_lastExecutionFenceValue = fenceValue;
+	DxCommandList* fixupList = nullptr;
+	if (not _fixups.empty() and CommandListType == D3D12_COMMAND_LIST_TYPE_DIRECT) {
+		fixupList = GetFreeCommandList();
+		fixupList->RecordBarriers(_fixups.data(), (uint32)_fixups.size(), nullptr);
+		ThrowIfFailed(fixupList->CommandList()->Close());
+	}
 
-	_commandListMutex.lock();
+	ID3D12CommandList* d3d12Lists[] = { fixupList ? fixupList->CommandList() : nullptr, commandList->CommandList() };
+	if (fixupList) {
+		NativeQueue->ExecuteCommandLists(2, d3d12Lists);
+	}
+	else {
+		NativeQueue->ExecuteCommandLists(1, d3d12Lists + 1);
+	}
 
-	commandList->_next = _runningCommandLists;
-	_runningCommandLists = commandList;
-	AtomicIncrement(_numRunningCommandLists);
+	uint64 fenceValue = Signal();
+
+	commandList->FenceValue = fenceValue;
+
+	// Everything the list allocated is covered by the fence value now, so the upload buffer may reclaim it once that has completed.
+	if (commandList->_writesUploadBuffer) {
+		commandList->_uploadBuffer->EndWriting(commandList->_uploadEpoch, fenceValue);
+		commandList->_writesUploadBuffer = false;
+	}
 
-	_commandListMutex.unlock();
+	bool wake = _recycler.Submit(commandList);
+	if (fixupList) {
+		fixupList->FenceValue = fenceValue;
+		wake |= _recycler.Submit(fixupList);
+	}
+	if (wake) {
+		SetEvent(_wakeEvent);
+	}
 
-	return _fenceValue;
+	return fenceValue;
 }
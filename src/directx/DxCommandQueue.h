@@ -3,6 +3,8 @@
 #include "../pch.h"
 #include "dx.h"
 #include "mutex"
+#include "../core/resourceStateTracker.h"
+#include "../core/fenceRecycler.h"
 
 class DxCommandList;
 
@@ -18,6 +20,8 @@ public:
 	uint64 TimestampFrequency() const { return _timestampFrequency; }
 
 	uint64 Signal();
+	uint64 LastSignaledFenceValue() const { return _fenceValue; }
+	uint64 CompletedFenceValue() const { return _fence->GetCompletedValue(); }
 	bool IsFenceComplete(uint64 fenceValue) const;
 	void WaitForFence(uint64 fenceValue) const;
 	void WaitForOtherQueue(DxCommandQueue& other) const;
@@ -27,18 +31,26 @@ public:
 	DxCommandList* GetFreeCommandList();
 	uint64 Execute(DxCommandList* commandList);
 
+	uint32 TotalNumCommandLists() const { return _totalNumCommandLists; }
+
+	// Including the CPU time of the recycling thread so far.
+	FenceRecyclerStatistics RecyclerStatistics();
+
 private:
 	void ProcessRunningCommandAllocators();
 
 	uint64 _timestampFrequency; // In hz
 
-	DxCommandList* _runningCommandLists = nullptr;
-	DxCommandList* _freeCommandLists = nullptr;
+	// Executed lists are reset by a thread which sleeps until the fence reaches the lowest value in flight, or until a list is executed
+	// while nothing was in flight.
+	FenceRecycler _recycler;
+	HANDLE _fenceEvent = nullptr;
+	HANDLE _wakeEvent = nullptr;
 
-	volatile uint32 _numRunningCommandLists;
 	volatile uint32 _totalNumCommandLists;
 
-	std::mutex _commandListMutex = {};
+	std::mutex _submitMutex = {}; // Lists reach the resource state table in the order they are executed.
+	std::vector<ResourceStateBarrier> _fixups;
 	std::thread _processThread = {};
 
 	Com<ID3D12Fence> _fence = nullptr;
@@ -177,6 +177,8 @@ bool DxContext::Initialize() {
 	_descriptorAllocatorGPU.Initialize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, 128, true);
 	_rtvAllocator.Initialize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV, 1024, false);
 	_dsvAllocator.Initialize(D3D12_DESCRIPTOR_HEAP_TYPE_DSV, 1024, false);
+	_frameDescriptorAllocator.Initialize(_device.Get(), 1024 * 8);
+	_memoryAllocator.Initialize(_device.Get());
 
 	for (uint32 i = 0; i < NUM_BUFFERED_FRAMES; i++) {
 #if ENABLE_DX_PROFILING
@@ -185,15 +187,15 @@ bool DxContext::Initialize() {
 #endif
 	}
 
-	_frameUploadBuffer.Reset();
-	_frameUploadBuffer.PagePool = &_pagePools[_bufferFrameId];
-
-	_pagePools[_bufferFrameId].Reset();
-
 	RenderQueue.Initialize(_device);
 	ComputeQueue.Initialize(_device);
 	CopyQueue.Initialize(_device);
 
+	// Sized for a few frames of constant buffers and dynamic geometry. Larger allocations get their own buffers, as the page pools did.
+	_renderUploadBuffer.Initialize(_device.Get(), &RenderQueue, MB(32), MB(2));
+	_computeUploadBuffer.Initialize(_device.Get(), &ComputeQueue, MB(8), MB(2));
+	_copyUploadBuffer.Initialize(_device.Get(), &CopyQueue, MB(8), MB(2));
+
 	return true;
 }
 
@@ -217,6 +219,7 @@ void DxContext::Quit() {
 	CopyQueue.LeaveThread();
 
 	for (uint32 b = 0; b < NUM_BUFFERED_FRAMES; b++) {
+		FreeTrackedGraveyardMemory(b);
 		_textureGraveyard[b].clear();
 		_bufferedGraveyard[b].clear();
 		_objectGraveyard[b].clear();
@@ -224,12 +227,14 @@ void DxContext::Quit() {
 }
 
 void DxContext::Retire(TextureGrave &&texture) {
+	TRACK_ALLOCATION(EMemoryCategoryGraveyard, texture.Allocation.Size);
 	_mutex.lock();
 	_textureGraveyard[_bufferFrameId].push_back(std::move(texture));
 	_mutex.unlock();
 }
 
 void DxContext::Retire(struct BufferGrave &&buffer) {
+	TRACK_ALLOCATION(EMemoryCategoryGraveyard, buffer.Allocation.Size);
 	_mutex.lock();
 	_bufferedGraveyard[_bufferFrameId].push_back(std::move(buffer));
 	_mutex.unlock();
@@ -240,21 +245,60 @@ void DxContext::Retire(DxObject obj) {
 	_objectGraveyard[_bufferFrameId].push_back(obj);
 	_mutex.unlock();
 }
+
+void DxContext::Retire(DxObject obj, EMemoryCategory category, uint64 size) {
+	TRACK_ALLOCATION(EMemoryCategoryGraveyard, size);
+	_mutex.lock();
+	_objectGraveyard[_bufferFrameId].push_back(obj);
+	RetiredObjectMemory& retired = _retiredObjectMemory[_bufferFrameId][category];
+	retired.Size += size;
+	retired.Count++;
+	_mutex.unlock();
+}
+
+// Graves free their own category when they are destroyed, retired objects don't know theirs.
+void DxContext::FreeTrackedGraveyardMemory(uint32 bufferFrameId) {
+#if ENABLE_MEMORY_TRACKING
+	uint64 size = 0;
+	uint32 count = 0;
+	for (const TextureGrave& grave : _textureGraveyard[bufferFrameId]) {
+		size += grave.Allocation.Size;
+		count++;
+	}
+	for (const BufferGrave& grave : _bufferedGraveyard[bufferFrameId]) {
+		size += grave.Allocation.Size;
+		count++;
+	}
+	for (uint32 c = 0; c < EMemoryCategoryCount; c++) {
+		RetiredObjectMemory& retired = _retiredObjectMemory[bufferFrameId][c];
+		TRACK_FREES((EMemoryCategory)c, retired.Size, retired.Count);
+		size += retired.Size;
+		count += retired.Count;
+		retired = {};
+	}
+	TRACK_FREES(EMemoryCategoryGraveyard, size, count);
+#endif
+}
 DxCommandQueue& DxContext::GetQueue(D3D12_COMMAND_LIST_TYPE type) {
 	return type == D3D12_COMMAND_LIST_TYPE_DIRECT ? RenderQueue :
 		type == D3D12_COMMAND_LIST_TYPE_COMPUTE ? ComputeQueue :
 		CopyQueue;
 }
 
+DxUploadBuffer& DxContext::GetUploadBuffer(const DxCommandQueue& queue) {
+	return &queue == &RenderQueue ? _renderUploadBuffer :
+		&queue == &ComputeQueue ? _computeUploadBuffer :
+		_copyUploadBuffer;
+}
+
 DxCommandList* DxContext::GetFreeCommandList(DxCommandQueue& queue) {
 	DxCommandList* result = queue.GetFreeCommandList();
 
-	_mutex.lock();
-	result->_uploadBuffer.PagePool = &_pagePools[_bufferFrameId];
-	_mutex.unlock();
+	result->_uploadBuffer = &GetUploadBuffer(queue);
 
 #if ENABLE_DX_PROFILING
 	result->_timeStampQueryHeap = _timestampHeaps[_bufferFrameId].Heap;
+	result->_profileOrder = AtomicIncrement(_numCommandListsHandedOut);
 #endif
 
 	return result;
@@ -281,7 +325,7 @@ uint64 DxContext::ExecuteCommandList(DxCommandList* commandList) {
 }
 
 DxAllocation DxContext::AllocateDynamicBuffer(uint32 sizeInBytes, uint32 alignment) {
-	DxAllocation allocation = _frameUploadBuffer.Allocate(sizeInBytes, alignment);
+	DxAllocation allocation = _renderUploadBuffer.Allocate(sizeInBytes, alignment);
 	return allocation;
 }
 
@@ -319,17 +363,31 @@ void DxContext::NewFrame(uint64 frameId) {
 	_timestampQueryIndex[_bufferFrameId] = 0;
 #endif
 
+	// The memory of released resources may be reused by new ones, which would then inherit stale states.
+	for (const TextureGrave& grave : _textureGraveyard[_bufferFrameId]) {
+		_resourceStates.Forget((uint64)grave.Resource.Get());
+	}
+	for (const BufferGrave& grave : _bufferedGraveyard[_bufferFrameId]) {
+		_resourceStates.Forget((uint64)grave.Resource.Get());
+	}
+	for (const DxObject& object : _objectGraveyard[_bufferFrameId]) {
+		_resourceStates.Forget((uint64)object.Get());
+	}
+
+	FreeTrackedGraveyardMemory(_bufferFrameId);
 	_textureGraveyard[_bufferFrameId].clear();
 	_bufferedGraveyard[_bufferFrameId].clear();
 	_objectGraveyard[_bufferFrameId].clear();
 
-	_frameUploadBuffer.Reset();
-	_frameUploadBuffer.PagePool = &_pagePools[_bufferFrameId];
+	_barrierStatistics = _resourceStates.TakeStatistics();
 
-	_pagePools[_bufferFrameId].Reset();
 	_frameDescriptorAllocator.NewFrame(_bufferFrameId);
 
 	_mutex.unlock();
+
+	_renderUploadBuffer.NewFrame();
+	_computeUploadBuffer.NewFrame();
+	_copyUploadBuffer.NewFrame();
 }
 
 bool DxContext::CheckTearingSupport() {
@@ -8,6 +8,8 @@
 #include "DxDescriptorAllocation.h"
 #include "DxBuffer.h"
 #include "DxQuery.h"
+#include "DxMemoryAllocator.h"
+#include "../core/resourceStateTracker.h"
 
 
 struct DxMemoryUsage {
@@ -34,7 +36,8 @@ public:
 	DxCommandList* GetFreeRenderCommandList();
 	uint64 ExecuteCommandList(DxCommandList* commandList);
 
-	// Carefully with these functions. They are not thread safe
+	// Allocate from the render queue's upload buffer and may be called from any thread. Unlike allocations of command lists, the memory
+	// must be used by command lists which are executed before the next frame starts.
 	DxAllocation AllocateDynamicBuffer(uint32 sizeInBytes, uint32 alignment = D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
 	DxDynamicConstantBuffer UploadDynamicConstantBuffer(uint32 sizeInBytes, const void* data);
 	template<typename T> DxDynamicConstantBuffer UploadDynamicConstantBuffer(const T& data) {
@@ -71,10 +74,24 @@ public:
 
 	bool IsRunning() const { return _running; }
 
+	// Descriptor heaps and upload buffers are thread safe, but the rest of resource creation (the texture factory, command lists recorded for
+	// mip generation) is not. Loaders which create resources from several threads hold this lock while doing so.
+	std::mutex& ResourceCreationMutex() { return _resourceCreationMutex; }
+
+	// Places buffers and textures in pooled heaps. Their graves free the memory.
+	DxMemoryAllocator& MemoryAllocator() { return _memoryAllocator; }
+
 	void Retire(struct TextureGrave&& texture);
 	void Retire(struct BufferGrave&& buffer);
 	void Retire(DxObject obj);
+	// For objects counted by the memory tracker, e.g. upload buffers. 'size' is freed from 'category' when the object is released.
+	void Retire(DxObject obj, EMemoryCategory category, uint64 size);
 
+	// States of all resources after the last executed command list. Entries of retired resources are forgotten when they are released.
+	ResourceStateTable& ResourceStates() { return _resourceStates; }
+
+	// How many transitions the command lists of the last frame asked for and how many were actually recorded.
+	const ResourceStateStatistics& BarrierStatistics() const { return _barrierStatistics; }
 
 	DxFrameDescriptorAllocator& FrameDescriptorAllocator() { return _frameDescriptorAllocator; }
 	const DxFrameDescriptorAllocator& FrameDescriptorAllocator() const { return _frameDescriptorAllocator; }
@@ -90,6 +107,7 @@ private:
 
 	DxCommandQueue& GetQueue(D3D12_COMMAND_LIST_TYPE type);
 	DxCommandList* GetFreeCommandList(DxCommandQueue& queue);
+	DxUploadBuffer& GetUploadBuffer(const DxCommandQueue& queue);
 
 	uint64 _frameId = 0;
 	uint32 _bufferFrameId = 0;
@@ -106,25 +124,42 @@ private:
 
 #if ENABLE_DX_PROFILING
 	uint32 _timestampQueryIndex[NUM_BUFFERED_FRAMES] = {};
+	uint64 _numCommandListsHandedOut = 0;
 	DxTimestampQueryHeap _timestampHeaps[NUM_BUFFERED_FRAMES];
 	Ptr<DxBuffer> _resolvedTimestampBuffers[NUM_BUFFERED_FRAMES];
 #endif
 
 	std::mutex _mutex = {};
+	std::mutex _resourceCreationMutex = {};
 	MemoryArena _arena;
 
-	DxPagePool _pagePools[NUM_BUFFERED_FRAMES] = {{MB(2)}, {MB(2)}};
+	DxUploadBuffer _renderUploadBuffer;
+	DxUploadBuffer _computeUploadBuffer;
+	DxUploadBuffer _copyUploadBuffer;
 	DxFrameDescriptorAllocator _frameDescriptorAllocator = {};
-	DxUploadBuffer _frameUploadBuffer = {};
 
 	uint32 _descriptorHandleIncrementSize = 0;
 
 	volatile bool _running = true;
 
+	// Before the graveyards, which free into it when they are destroyed.
+	DxMemoryAllocator _memoryAllocator;
+
 	std::vector<struct TextureGrave> _textureGraveyard[NUM_BUFFERED_FRAMES];
 	std::vector<struct BufferGrave> _bufferedGraveyard[NUM_BUFFERED_FRAMES];
 	std::vector<DxObject> _objectGraveyard[NUM_BUFFERED_FRAMES];
 
+	struct RetiredObjectMemory {
+		uint64 Size;
+		uint32 Count;
+	};
+	RetiredObjectMemory _retiredObjectMemory[NUM_BUFFERED_FRAMES][EMemoryCategoryCount] = {};
+
+	void FreeTrackedGraveyardMemory(uint32 bufferFrameId);
+
+	ResourceStateTable _resourceStates;
+	ResourceStateStatistics _barrierStatistics = {};
+
 	bool _raytracingSupported = false;
 	bool _meshShaderSupported = false;
 	static DxContext& _instance;
@@ -116,7 +116,7 @@ DxCpuDescriptorHandle &DxCpuDescriptorHandle::CreateBufferSRV(const DxBuffer *bu
     srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
     srvDesc.Format = DXGI_FORMAT_UNKNOWN;
     srvDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
-    srvDesc.Buffer.FirstElement = bufferRange.FirstElement;
+    srvDesc.Buffer.FirstElement = buffer->OffsetInResource / buffer->ElementSize + bufferRange.FirstElement; // Buffer ranges are aligned to their element size.
     srvDesc.Buffer.NumElements = (bufferRange.NumElements != -1) ? bufferRange.NumElements : (buffer->ElementCount - bufferRange.FirstElement);
     srvDesc.Buffer.StructureByteStride = buffer->ElementSize;
     srvDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_NONE;
@@ -127,7 +127,7 @@ DxCpuDescriptorHandle &DxCpuDescriptorHandle::CreateBufferSRV(const DxBuffer *bu
 }
 
 DxCpuDescriptorHandle &DxCpuDescriptorHandle::CreateRawBufferSRV(const DxBuffer *buffer, BufferRange bufferRange) {
-    uint32 firstElementByteOffset = bufferRange.FirstElement * buffer->ElementSize;
+    uint32 firstElementByteOffset = buffer->OffsetInResource + bufferRange.FirstElement * buffer->ElementSize;
     assert(firstElementByteOffset % 16 == 0);
 
     uint32 count = (bufferRange.NumElements != -1) ? bufferRange.NumElements : (buffer->ElementCount - bufferRange.FirstElement);
@@ -222,7 +222,7 @@ DxCpuDescriptorHandle &DxCpuDescriptorHandle::CreateBufferUAV(const DxBuffer *bu
     D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
     uavDesc.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
     uavDesc.Buffer.CounterOffsetInBytes = 0;
-    uavDesc.Buffer.FirstElement = bufferRange.FirstElement;
+    uavDesc.Buffer.FirstElement = buffer->OffsetInResource / buffer->ElementSize + bufferRange.FirstElement;
     uavDesc.Buffer.NumElements = (bufferRange.NumElements != -1) ? bufferRange.NumElements : (buffer->ElementCount - bufferRange.FirstElement);
     uavDesc.Buffer.StructureByteStride = buffer->ElementSize;
     uavDesc.Buffer.Flags = D3D12_BUFFER_UAV_FLAG_NONE;
@@ -233,7 +233,7 @@ DxCpuDescriptorHandle &DxCpuDescriptorHandle::CreateBufferUAV(const DxBuffer *bu
 }
 
 DxCpuDescriptorHandle &DxCpuDescriptorHandle::CreateBufferUintUAV(const DxBuffer *buffer, BufferRange bufferRange) {
-    uint32 firstElementByteOffset = bufferRange.FirstElement * buffer->ElementSize;
+    uint32 firstElementByteOffset = buffer->OffsetInResource + bufferRange.FirstElement * buffer->ElementSize;
     assert(firstElementByteOffset % 16 == 0);
 
     uint32 count = (bufferRange.NumElements != -1) ? bufferRange.NumElements : (buffer->ElementCount - bufferRange.FirstElement);
@@ -27,17 +27,36 @@ DxDescriptorRange DxDescriptorPage::GetRange(uint32 count) {
 }
 
 bool DxDescriptorPage::HaveEnoughSpace(uint32 count) const {
-    return _maxNumDescriptors - _usedDescriptors > count;
+    return _maxNumDescriptors - _usedDescriptors >= count;
 }
 
 void DxDescriptorPage::Reset() {
     _usedDescriptors = 0;
 }
 
+void DxFrameDescriptorAllocator::Initialize(ID3D12Device* device, uint32 numDescriptors) {
+    D3D12_DESCRIPTOR_HEAP_DESC desc = {};
+    desc.NumDescriptors = numDescriptors;
+    desc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+    desc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
+
+    ThrowIfFailed(device->CreateDescriptorHeap(&desc, IID_PPV_ARGS(_descriptorHeap.GetAddressOf())));
+
+    _descriptorHandleIncrementSize = device->GetDescriptorHandleIncrementSize(desc.Type);
+    _base.CpuHandle = _descriptorHeap->GetCPUDescriptorHandleForHeapStart();
+    _base.GpuHandle = _descriptorHeap->GetGPUDescriptorHandleForHeapStart();
+    _ranges.Initialize(numDescriptors);
+}
+
 void DxFrameDescriptorAllocator::NewFrame(uint32 bufferedFrameId) {
     _mutex.lock();
 
     _currentFrame = bufferedFrameId;
+    for (const UsedRange& range : _usedRanges[_currentFrame]) {
+        _ranges.Free(range.Offset, range.Count);
+    }
+    _usedRanges[_currentFrame].clear();
+
     while (not _usedPages[_currentFrame].empty()) {
         _freePages.push(std::move(_usedPages[_currentFrame].top()));
         _usedPages[_currentFrame].pop();
@@ -47,6 +66,21 @@ void DxFrameDescriptorAllocator::NewFrame(uint32 bufferedFrameId) {
 }
 
 DxDescriptorRange DxFrameDescriptorAllocator::AllocateContiguousDescriptorRange(uint32 count) {
+    uint32 offset = _ranges.Allocate(count);
+    if (offset != INDEX_ALLOCATOR_INVALID) {
+        DxDescriptorRange result(count, _descriptorHandleIncrementSize);
+        result.SetBase(CD3DX12_CPU_DESCRIPTOR_HANDLE(_base.CpuHandle, offset, _descriptorHandleIncrementSize),
+            CD3DX12_GPU_DESCRIPTOR_HANDLE(_base.GpuHandle, offset, _descriptorHandleIncrementSize));
+        result.DescriptorHeap = _descriptorHeap;
+
+        _mutex.lock();
+        _usedRanges[_currentFrame].push_back({ offset, count });
+        _mutex.unlock();
+
+        return result;
+    }
+
+    // The shared heap is full. Fall back to pages with heaps of their own.
     _mutex.lock();
 
     DxDescriptorPage* current = nullptr;
@@ -56,12 +90,12 @@ DxDescriptorRange DxFrameDescriptorAllocator::AllocateContiguousDescriptorRange(
 
     if (not current or not current->HaveEnoughSpace(count)) {
         std::unique_ptr<DxDescriptorPage> freePage = nullptr;
-        if (not _freePages.empty()) {
+        if (not _freePages.empty() and _freePages.top()->Capacity() >= count) {
             freePage = std::move(_freePages.top());
             _freePages.pop();
         }
         if (not freePage) {
-            freePage = std::make_unique<DxDescriptorPage>(1024);
+            freePage = std::make_unique<DxDescriptorPage>(Max(count, 1024u));
             freePage->Init(DxContext::Instance().GetDevice());
         }
 
@@ -5,15 +5,18 @@
 #include "dx.h"
 #include "DxDescriptor.h"
 #include "../core/threading.h"
+#include "../core/indexAllocator.h"
 
 void CreateDescriptorHeap(const D3D12_DESCRIPTOR_HEAP_DESC& desc, Com<ID3D12DescriptorHeap>& heap);
 uint32 GetIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE type);
 
+// Descriptors are allocated and freed from any thread, see IndexAllocator.
 template<class DescriptorT>
 class DxDescriptorHeap {
 public:
     void Initialize(D3D12_DESCRIPTOR_HEAP_TYPE type, uint32 numDescriptors, bool shaderVisible);
     DxDescriptorHeap() = default;
+    // Throws a DxException if the heap is full.
     DescriptorT GetFreeHandle();
     void FreeHandle(DescriptorT handle);
     ID3D12DescriptorHeap* DescriptorHeap() const { return _descriptorHeap.Get(); }
@@ -28,8 +31,7 @@ protected:
     CD3DX12_CPU_DESCRIPTOR_HANDLE _cpuBase = D3D12_DEFAULT;
     CD3DX12_GPU_DESCRIPTOR_HANDLE _gpuBase = D3D12_DEFAULT;
     uint32 _descriptorHandleIncrementSize = 0;
-    std::vector<uint16> _freeDescriptors = {};
-    uint32 _allFreeIncludingAndAfter = 0;
+    IndexAllocator _freeDescriptors;
 
     DxCpuDescriptorHandle GetHandle(uint32 index) { return {CD3DX12_CPU_DESCRIPTOR_HANDLE(_cpuBase, index, _descriptorHandleIncrementSize)}; }
 };
@@ -73,6 +75,7 @@ public:
     void Init(ID3D12Device* device, D3D12_DESCRIPTOR_HEAP_TYPE type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, D3D12_DESCRIPTOR_HEAP_FLAGS flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE);
     DxDescriptorRange GetRange(uint32 count);
     bool HaveEnoughSpace(uint32 count) const;
+    uint32 Capacity() const { return _maxNumDescriptors; }
     void Reset();
 
 private:
@@ -83,14 +86,28 @@ private:
     uint32 _descriptorHandleIncrementSize = 0;
 };
 
+// Contiguous, shader visible descriptor tables which live for one frame. They are suballocated from one heap with a BuddyAllocator and
+// freed NUM_BUFFERED_FRAMES frames later. Tables which don't fit anymore get a page of their own.
 class DxFrameDescriptorAllocator {
 public:
     DxFrameDescriptorAllocator() = default;
+    void Initialize(ID3D12Device* device, uint32 numDescriptors);
     void NewFrame(uint32 bufferedFrameId);
     DxDescriptorRange AllocateContiguousDescriptorRange(uint32 count);
 
 protected:
+    struct UsedRange {
+        uint32 Offset;
+        uint32 Count;
+    };
+
+    Com<ID3D12DescriptorHeap> _descriptorHeap = nullptr;
+    DxDoubleDescriptorHandle _base = {};
+    uint32 _descriptorHandleIncrementSize = 0;
+    BuddyAllocator _ranges;
+
     std::mutex _mutex = {};
+    std::vector<UsedRange> _usedRanges[NUM_BUFFERED_FRAMES] = {};
     std::stack<std::unique_ptr<DxDescriptorPage>> _usedPages[NUM_BUFFERED_FRAMES] = {};
     std::stack<std::unique_ptr<DxDescriptorPage>> _freePages = {};
     uint32 _currentFrame = NUM_BUFFERED_FRAMES - 1;
@@ -115,7 +132,7 @@ void DxDescriptorHeap<DescriptorT>::Initialize(D3D12_DESCRIPTOR_HEAP_TYPE type,
     }
 
     CreateDescriptorHeap(desc, _descriptorHeap);
-    _allFreeIncludingAndAfter = 0;
+    _freeDescriptors.Initialize(numDescriptors);
     _descriptorHandleIncrementSize = GetIncrementSize(type);
     _cpuBase = _descriptorHeap->GetCPUDescriptorHandleForHeapStart();
     if (shaderVisible) {
@@ -126,13 +143,10 @@ void DxDescriptorHeap<DescriptorT>::Initialize(D3D12_DESCRIPTOR_HEAP_TYPE type,
 
 template<class DescriptorT>
 DescriptorT DxDescriptorHeap<DescriptorT>::GetFreeHandle() {
-    uint32 index;
-    if (!_freeDescriptors.empty()) {
-        index = _freeDescriptors.back();
-        _freeDescriptors.pop_back();
-    }
-    else {
-        index = AtomicAdd(_allFreeIncludingAndAfter, 1);
+    uint32 index = _freeDescriptors.Allocate();
+    if (index == INDEX_ALLOCATOR_INVALID) {
+        // A handle past the end of the heap would silently overwrite other descriptors, so this fails in release builds too.
+        throw DxException(E_OUTOFMEMORY, L"DxDescriptorHeap::GetFreeHandle (heap is full, increase its size in DxContext::Initialize)", AnsiToWString(__FILE__), __LINE__);
     }
     return { CD3DX12_CPU_DESCRIPTOR_HANDLE(_cpuBase, index, _descriptorHandleIncrementSize)};
 }
@@ -140,7 +154,7 @@ DescriptorT DxDescriptorHeap<DescriptorT>::GetFreeHandle() {
 template<class DescriptorT>
 void DxDescriptorHeap<DescriptorT>::FreeHandle(DescriptorT handle) {
     uint32 index = (uint32)((handle.CpuHandle.ptr - _cpuBase.ptr) / _descriptorHandleIncrementSize);
-    _freeDescriptors.push_back(index);
+    _freeDescriptors.Free(index);
 }
 
 template<class DescriptorT>
@@ -0,0 +1,283 @@
+#include "DxMemoryAllocator.h"
+
+namespace {
+	EMemoryCategory GetMemoryCategory(EDxMemoryPool pool) {
+		return (pool == EDxMemoryPoolTextures) ? EMemoryCategoryTextures : (pool == EDxMemoryPoolUploadBuffers) ? EMemoryCategoryUpload : EMemoryCategoryBuffers;
+	}
+}
+
+void DxMemoryAllocator::Initialize(ID3D12Device* device) {
+	_device = device;
+
+	_pools[EDxMemoryPoolDefaultBuffers] = { D3D12_HEAP_TYPE_DEFAULT, D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS, DX_MEMORY_HEAP_SIZE, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT };
+	_pools[EDxMemoryPoolUploadBuffers] = { D3D12_HEAP_TYPE_UPLOAD, D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS, DX_MEMORY_HEAP_SIZE, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT };
+	_pools[EDxMemoryPoolReadbackBuffers] = { D3D12_HEAP_TYPE_READBACK, D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS, DX_MEMORY_HEAP_SIZE, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT };
+	_pools[EDxMemoryPoolTextures] = { D3D12_HEAP_TYPE_DEFAULT, D3D12_HEAP_FLAG_ALLOW_ONLY_NON_RT_DS_TEXTURES, DX_MEMORY_HEAP_SIZE, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT };
+	// Vertex and index buffers only need their element size as alignment.
+	_pools[EDxMemoryPoolBufferRanges] = { D3D12_HEAP_TYPE_DEFAULT, D3D12_HEAP_FLAG_NONE, DX_MEMORY_BUFFER_RANGE_POOL_SIZE, 16 };
+}
+
+EDxMemoryPool DxMemoryAllocator::GetPool(const D3D12_RESOURCE_DESC& desc, D3D12_HEAP_TYPE heapType, D3D12_RESOURCE_STATES initialState) {
+	if (desc.Dimension == D3D12_RESOURCE_DIMENSION_BUFFER) {
+		// Acceleration structures are rebuilt in place, so there is nothing to gain from packing them.
+		if (initialState == D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE) {
+			return EDxMemoryPoolCount;
+		}
+		return heapType == D3D12_HEAP_TYPE_DEFAULT ? EDxMemoryPoolDefaultBuffers :
+			heapType == D3D12_HEAP_TYPE_UPLOAD ? EDxMemoryPoolUploadBuffers :
+			heapType == D3D12_HEAP_TYPE_READBACK ? EDxMemoryPoolReadbackBuffers :
+			EDxMemoryPoolCount;
+	}
+
+	bool renderTargetOrDepthStencil = desc.Flags & (D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET | D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL);
+	if (heapType == D3D12_HEAP_TYPE_DEFAULT and not renderTargetOrDepthStencil and desc.SampleDesc.Count <= 1) {
+		return EDxMemoryPoolTextures;
+	}
+	return EDxMemoryPoolCount;
+}
+
+Ptr<DxMemoryAllocator::Heap> DxMemoryAllocator::CreateHeap(EDxMemoryPool pool) {
+	const Pool& p = _pools[pool];
+	Ptr<Heap> heap = MakePtr<Heap>();
+
+	if (pool == EDxMemoryPoolBufferRanges) {
+		auto heapProperties = CD3DX12_HEAP_PROPERTIES(p.HeapType);
+		auto resourceDesc = CD3DX12_RESOURCE_DESC::Buffer(p.HeapSize);
+		ThrowIfFailed(_device->CreateCommittedResource(
+			&heapProperties,
+			D3D12_HEAP_FLAG_NONE,
+			&resourceDesc,
+			D3D12_RESOURCE_STATE_COMMON,
+			nullptr,
+			IID_PPV_ARGS(heap->Buffer.GetAddressOf())
+		));
+		SET_NAME(heap->Buffer, "Buffer ranges");
+	}
+	else {
+		CD3DX12_HEAP_DESC heapDesc(p.HeapSize, p.HeapType, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT, p.HeapFlags);
+		ThrowIfFailed(_device->CreateHeap(&heapDesc, IID_PPV_ARGS(heap->NativeHeap.GetAddressOf())));
+		SET_NAME(heap->NativeHeap, "Resource heap");
+	}
+
+	heap->Allocator.Initialize(p.HeapSize, p.Granularity);
+	return heap;
+}
+
+bool DxMemoryAllocator::Allocate(EDxMemoryPool pool, uint64 size, uint64 alignment, DxMemoryAllocation& outAllocation) {
+	Pool& p = _pools[pool];
+	if (size > p.HeapSize / 2) {
+		return false;
+	}
+
+	const std::lock_guard lock(_mutex);
+
+	// Older heaps first, so that the newer ones empty out and can be released.
+	uint32 heapIndex = UINT32_MAX;
+	for (uint32 i = 0; i < p.Heaps.size(); i++) {
+		if (p.Heaps[i]) {
+			TlsfAllocation allocation = p.Heaps[i]->Allocator.Allocate(size, alignment);
+			if (allocation.Valid()) {
+				heapIndex = i;
+				outAllocation = { pool, i, allocation.Block, allocation.Offset, allocation.Size, false, GetMemoryCategory(pool) };
+				break;
+			}
+		}
+	}
+
+	if (heapIndex == UINT32_MAX) {
+		heapIndex = 0;
+		while (heapIndex < p.Heaps.size() and p.Heaps[heapIndex]) {
+			heapIndex++;
+		}
+		if (heapIndex == p.Heaps.size()) {
+			p.Heaps.emplace_back();
+		}
+		p.Heaps[heapIndex] = CreateHeap(pool);
+
+		TlsfAllocation allocation = p.Heaps[heapIndex]->Allocator.Allocate(size, alignment);
+		assert(allocation.Valid());
+		outAllocation = { pool, heapIndex, allocation.Block, allocation.Offset, allocation.Size, false, GetMemoryCategory(pool) };
+	}
+
+	p.Heaps[heapIndex]->Allocator.SetMovable(outAllocation.Block, false);
+	TRACK_ALLOCATION(outAllocation.Category, outAllocation.Size);
+	if (pool == EDxMemoryPoolBufferRanges) {
+		_numBufferRanges++;
+	}
+	else {
+		_numPlacedResources++;
+	}
+	return true;
+}
+
+DxResource DxMemoryAllocator::CreateResource(const D3D12_RESOURCE_DESC& desc, D3D12_HEAP_TYPE heapType, D3D12_RESOURCE_STATES initialState,
+	const D3D12_CLEAR_VALUE* clearValue, DxMemoryAllocation& outAllocation) {
+	outAllocation = {};
+	DxResource resource = nullptr;
+
+	EDxMemoryPool pool = GetPool(desc, heapType, initialState);
+	if (pool != EDxMemoryPoolCount) {
+		D3D12_RESOURCE_ALLOCATION_INFO info = _device->GetResourceAllocationInfo(0, 1, &desc);
+		if (info.Alignment <= D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT and Allocate(pool, info.SizeInBytes, info.Alignment, outAllocation)) {
+			ID3D12Heap* heap = GetHeap(outAllocation);
+			ThrowIfFailed(_device->CreatePlacedResource(
+				heap,
+				outAllocation.Offset,
+				&desc,
+				initialState,
+				clearValue,
+				IID_PPV_ARGS(resource.GetAddressOf())
+			));
+			return resource;
+		}
+	}
+
+	auto heapProperties = CD3DX12_HEAP_PROPERTIES(heapType);
+	ThrowIfFailed(_device->CreateCommittedResource(
+		&heapProperties,
+		D3D12_HEAP_FLAG_NONE,
+		&desc,
+		initialState,
+		clearValue,
+		IID_PPV_ARGS(resource.GetAddressOf())
+	));
+
+	outAllocation.Committed = true;
+	outAllocation.Category = (desc.Dimension != D3D12_RESOURCE_DIMENSION_BUFFER) ? EMemoryCategoryTextures
+		: (heapType == D3D12_HEAP_TYPE_UPLOAD) ? EMemoryCategoryUpload : EMemoryCategoryBuffers;
+#if ENABLE_MEMORY_TRACKING
+	outAllocation.Size = _device->GetResourceAllocationInfo(0, 1, &desc).SizeInBytes;
+	TRACK_ALLOCATION(outAllocation.Category, outAllocation.Size);
+#endif
+
+	_mutex.lock();
+	_numCommittedResources++;
+	_mutex.unlock();
+	return resource;
+}
+
+DxResource DxMemoryAllocator::AllocateBufferRange(uint64 size, uint64 alignment, DxMemoryAllocation& outAllocation) {
+	outAllocation = {};
+	if (size > DX_MEMORY_MAX_BUFFER_RANGE_SIZE or not Allocate(EDxMemoryPoolBufferRanges, size, alignment, outAllocation)) {
+		return nullptr;
+	}
+
+	const std::lock_guard lock(_mutex);
+	return _pools[EDxMemoryPoolBufferRanges].Heaps[outAllocation.Heap]->Buffer;
+}
+
+void DxMemoryAllocator::Free(DxMemoryAllocation& allocation) {
+	const std::lock_guard lock(_mutex);
+
+	if (allocation.Committed or allocation.Valid()) {
+		TRACK_FREE(allocation.Category, allocation.Size);
+	}
+
+	if (allocation.Committed) {
+		_numCommittedResources--;
+	}
+	else if (allocation.Valid()) {
+		Pool& p = _pools[allocation.Pool];
+		Ptr<Heap>& heap = p.Heaps[allocation.Heap];
+		heap->Allocator.Free(allocation.Block);
+
+		if (allocation.Pool == EDxMemoryPoolBufferRanges) {
+			_numBufferRanges--;
+		}
+		else {
+			_numPlacedResources--;
+		}
+
+		// Keep the first heap of every pool around, so that a level which is unloaded and loaded again doesn't recreate it.
+		if (heap->Allocator.Empty() and allocation.Heap > 0) {
+			heap = nullptr;
+		}
+	}
+
+	allocation = {};
+}
+
+uint32 DxMemoryAllocator::PlanDefragmentation(EDxMemoryPool pool, uint64 maxBytes, std::vector<DxMemoryMove>& moves) {
+	const std::lock_guard lock(_mutex);
+
+	std::vector<TlsfMove> tlsfMoves;
+	uint32 numMoves = 0;
+
+	// Moves stay within their heap.
+	Pool& p = _pools[pool];
+	for (uint32 i = 0; i < p.Heaps.size() and maxBytes > 0; i++) {
+		if (not p.Heaps[i]) {
+			continue;
+		}
+
+		tlsfMoves.clear();
+		p.Heaps[i]->Allocator.PlanDefragmentation(tlsfMoves, maxBytes);
+
+		for (const TlsfMove& move : tlsfMoves) {
+			DxMemoryMove& m = moves.emplace_back();
+			m.Source = { pool, i, move.SourceBlock, move.SourceOffset, move.Size, false, GetMemoryCategory(pool) };
+			m.Destination = { pool, i, move.Destination.Block, move.Destination.Offset, move.Destination.Size, false, GetMemoryCategory(pool) };
+			TRACK_ALLOCATION(m.Destination.Category, m.Destination.Size);
+			m.UserData = move.UserData;
+
+			// The destination is not movable until its owner attaches itself again.
+			p.Heaps[i]->Allocator.SetMovable(move.Destination.Block, false);
+			maxBytes -= Min(maxBytes, move.Size);
+			numMoves++;
+		}
+	}
+
+	if (pool == EDxMemoryPoolBufferRanges) {
+		_numBufferRanges += numMoves;
+	}
+	else {
+		_numPlacedResources += numMoves;
+	}
+	return numMoves;
+}
+
+void DxMemoryAllocator::FinishMove(const DxMemoryMove& move) {
+	DxMemoryAllocation source = move.Source;
+	Free(source);
+}
+
+void DxMemoryAllocator::SetUserData(const DxMemoryAllocation& allocation, uint64 userData) {
+	if (not allocation.Valid()) {
+		return;
+	}
+
+	const std::lock_guard lock(_mutex);
+	TlsfAllocator& allocator = _pools[allocation.Pool].Heaps[allocation.Heap]->Allocator;
+	allocator.SetUserData(allocation.Block, userData);
+	allocator.SetMovable(allocation.Block, true);
+}
+
+ID3D12Heap* DxMemoryAllocator::GetHeap(const DxMemoryAllocation& allocation) {
+	if (not allocation.Valid()) {
+		return nullptr;
+	}
+
+	const std::lock_guard lock(_mutex);
+	return _pools[allocation.Pool].Heaps[allocation.Heap]->NativeHeap.Get();
+}
+
+DxMemoryStatistics DxMemoryAllocator::GetStatistics() {
+	const std::lock_guard lock(_mutex);
+
+	DxMemoryStatistics result = {};
+	result.NumPlacedResources = _numPlacedResources;
+	result.NumBufferRanges = _numBufferRanges;
+	result.NumCommittedResources = _numCommittedResources;
+
+	for (const Pool& pool : _pools) {
+		for (const Ptr<Heap>& heap : pool.Heaps) {
+			if (heap) {
+				result.NumHeaps++;
+				result.NumHeapBytes += heap->Allocator.Capacity();
+				result.NumUsedBytes += heap->Allocator.NumUsedBytes();
+				result.MaxFragmentation = Max(result.MaxFragmentation, heap->Allocator.Fragmentation());
+			}
+		}
+	}
+	return result;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <mutex>
+
+#include "dx.h"
+#include "../pch.h"
+#include "../core/memory.h"
+#include "../core/memoryTracking.h"
+#include "../core/tlsfAllocator.h"
+
+#define DX_MEMORY_HEAP_SIZE MB(64)
+#define DX_MEMORY_BUFFER_RANGE_POOL_SIZE MB(16)
+#define DX_MEMORY_MAX_BUFFER_RANGE_SIZE KB(64) // Larger immutable buffers are worth a placed resource of their own.
+
+enum EDxMemoryPool : uint8 {
+	EDxMemoryPoolDefaultBuffers,
+	EDxMemoryPoolUploadBuffers,
+	EDxMemoryPoolReadbackBuffers,
+	EDxMemoryPoolTextures,     // Without render target or depth stencil flags. Placed ones of those would have to be cleared before first use.
+	EDxMemoryPoolBufferRanges, // Ranges of shared default heap buffers, for small vertex and index buffers which are written once.
+
+	EDxMemoryPoolCount,
+};
+
+// Where a resource's memory came from. Committed resources have an invalid allocation, which is still freed, for the statistics.
+struct DxMemoryAllocation {
+	EDxMemoryPool Pool = EDxMemoryPoolCount;
+	uint32 Heap = 0;
+	uint32 Block = TLSF_ALLOCATOR_INVALID;
+	uint64 Offset = 0; // In the heap, or in the shared buffer for buffer ranges.
+	uint64 Size = 0;   // Of committed resources only with ENABLE_MEMORY_TRACKING.
+	bool Committed = false;
+	EMemoryCategory Category = EMemoryCategoryBuffers;
+
+	bool Valid() const { return Block != TLSF_ALLOCATOR_INVALID; }
+};
+
+// A reallocation planned by DxMemoryAllocator::PlanDefragmentation. The memory at 'Destination' is already reserved.
+struct DxMemoryMove {
+	DxMemoryAllocation Source;
+	DxMemoryAllocation Destination;
+	uint64 UserData;
+};
+
+struct DxMemoryStatistics {
+	uint32 NumHeaps;
+	uint64 NumHeapBytes;
+	uint64 NumUsedBytes;
+	uint32 NumPlacedResources;
+	uint32 NumBufferRanges;
+	uint32 NumCommittedResources; // Resources which don't fit any pool.
+	float MaxFragmentation;       // Of the worst heap.
+};
+
+// Places resources in large heaps instead of giving each one a committed allocation of its own. Every heap type and resource class gets its
+// own pool of heaps, which are suballocated by a TlsfAllocator. Resources which don't fit a pool (render targets, depth stencils, MSAA,
+// anything larger than half a heap) fall back to committed resources. Thread safe.
+class DxMemoryAllocator {
+public:
+	void Initialize(ID3D12Device* device);
+
+	// 'outAllocation' must be freed once the GPU is done with the resource and the resource has been released, which the graveyards take
+	// care of.
+	DxResource CreateResource(const D3D12_RESOURCE_DESC& desc, D3D12_HEAP_TYPE heapType, D3D12_RESOURCE_STATES initialState,
+		const D3D12_CLEAR_VALUE* clearValue, DxMemoryAllocation& outAllocation);
+
+	// Returns the shared buffer, which the range at 'outAllocation.Offset' is a part of, or null if the range doesn't fit. The shared buffers
+	// stay in the common state, which vertex and index reads and copies promote from and decay back to.
+	DxResource AllocateBufferRange(uint64 size, uint64 alignment, DxMemoryAllocation& outAllocation);
+
+	void Free(DxMemoryAllocation& allocation);
+
+	// Defragmentation hooks. The owner of each move recreates its resource at the destination (GetHeap), copies the contents over on the GPU
+	// and calls FinishMove once the GPU is done with the old resource. 'userData' is what SetUserData attached to the allocation.
+	uint32 PlanDefragmentation(EDxMemoryPool pool, uint64 maxBytes, std::vector<DxMemoryMove>& moves);
+	void FinishMove(const DxMemoryMove& move);
+	// Allocations are not movable until their owner attaches the data it needs to find them again.
+	void SetUserData(const DxMemoryAllocation& allocation, uint64 userData);
+	ID3D12Heap* GetHeap(const DxMemoryAllocation& allocation);
+
+	DxMemoryStatistics GetStatistics();
+
+private:
+	struct Heap {
+		DxHeap NativeHeap; // Null in the buffer range pool, which suballocates committed buffers instead.
+		DxResource Buffer;
+		TlsfAllocator Allocator;
+	};
+
+	struct Pool {
+		D3D12_HEAP_TYPE HeapType;
+		D3D12_HEAP_FLAGS HeapFlags;
+		uint64 HeapSize;
+		uint64 Granularity;
+		std::vector<Ptr<Heap>> Heaps; // Released heaps leave null entries, so that the indices in allocations stay valid.
+	};
+
+	static EDxMemoryPool GetPool(const D3D12_RESOURCE_DESC& desc, D3D12_HEAP_TYPE heapType, D3D12_RESOURCE_STATES initialState);
+	bool Allocate(EDxMemoryPool pool, uint64 size, uint64 alignment, DxMemoryAllocation& outAllocation);
+	Ptr<Heap> CreateHeap(EDxMemoryPool pool);
+
+	ID3D12Device* _device = nullptr;
+	Pool _pools[EDxMemoryPoolCount] = {};
+
+	uint32 _numPlacedResources = 0;
+	uint32 _numBufferRanges = 0;
+	uint32 _numCommittedResources = 0;
+
+	std::mutex _mutex;
+};
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "../pch.h"
+#include "../core/threading.h"
+
+// The job system runs at most 8 workers, so more chunks would only queue up.
+#define MAX_NUM_RECORDING_CHUNKS 8
+
+// Below this many draws per chunk, the cost of an extra command list and the redundant state setup outweighs the parallelism.
+#define MIN_NUM_DRAWS_PER_RECORDING_CHUNK 128
+
+struct RecordingChunk {
+	uint32 First;
+	uint32 Count;
+};
+
+// Splits the items [0, numItems) into contiguous chunks of roughly equal weight. 'weight(i)' returns the cost of item i, usually its number of draws.
+// At most 'maxNumChunks' chunks are created, and a chunk is only started if every chunk still gets at least 'minWeightPerChunk'.
+// Returns the number of chunks written to 'outChunks'. The chunks cover all items in order, so submitting them in order reproduces the serial recording.
+template <typename WeightT>
+static uint32 SplitIntoRecordingChunks(uint32 numItems, const WeightT& weight, uint32 minWeightPerChunk, uint32 maxNumChunks, RecordingChunk* outChunks) {
+	if (numItems == 0) {
+		return 0;
+	}
+
+	uint64 totalWeight = 0;
+	for (uint32 i = 0; i < numItems; ++i) {
+		totalWeight += weight(i);
+	}
+
+	uint32 numChunks = (uint32)Min((uint64)maxNumChunks, Max((uint64)1, totalWeight / Max(minWeightPerChunk, 1u)));
+	numChunks = Min(numChunks, numItems);
+
+	uint64 targetWeight = (totalWeight + numChunks - 1) / numChunks;
+
+	uint32 chunkIndex = 0;
+	uint64 chunkWeight = 0;
+	outChunks[0] = { 0, 0 };
+
+	for (uint32 i = 0; i < numItems; ++i) {
+		// Start a new chunk once the current one is full, but keep at least one item for each remaining chunk.
+		if (chunkWeight >= targetWeight and chunkIndex + 1 < numChunks) {
+			outChunks[++chunkIndex] = { i, 0 };
+			chunkWeight = 0;
+		}
+
+		++outChunks[chunkIndex].Count;
+		chunkWeight += weight(i);
+	}
+
+	return chunkIndex + 1;
+}
+
+static uint32 SplitIntoRecordingChunks(uint32 numItems, uint32 minItemsPerChunk, uint32 maxNumChunks, RecordingChunk* outChunks) {
+	return SplitIntoRecordingChunks(numItems, [](uint32) { return 1u; }, minItemsPerChunk, maxNumChunks, outChunks);
+}
+
+// Records each chunk into its own command list. 'acquire()' returns a fresh command list and is only called on the calling thread.
+// 'record(commandList, chunk, chunkIndex)' runs on the job system, except for the first chunk, which the calling thread records itself.
+// Every command list carries its own upload buffer and dynamic descriptor heap, so the recording functions must not touch shared mutable state,
+// apart from per-chunk slots indexed by 'chunkIndex'.
+// The command lists are returned in chunk order in 'outCommandLists'. The caller submits them in this order.
+// The command list type is a template parameter, so the chunking and ordering can be driven with a mock command list.
+template <typename CommandListT, typename AcquireT, typename RecordT>
+static void RecordChunksInParallel(const RecordingChunk* chunks, uint32 numChunks, const AcquireT& acquire, const RecordT& record, CommandListT** outCommandLists) {
+	assert(numChunks <= MAX_NUM_RECORDING_CHUNKS);
+
+	for (uint32 c = 0; c < numChunks; ++c) {
+		outCommandLists[c] = acquire();
+	}
+
+	if (numChunks == 0) {
+		return;
+	}
+
+	if (numChunks == 1) {
+		record(outCommandLists[0], chunks[0], 0u);
+		return;
+	}
+
+	ThreadJobContext context;
+	for (uint32 c = 1; c < numChunks; ++c) {
+		context.AddWork([&record, chunks, outCommandLists, c]() {
+			record(outCommandLists[c], chunks[c], c);
+		});
+	}
+
+	record(outCommandLists[0], chunks[0], 0u);
+	context.WaitForWorkCompletion();
+}
@@ -6,7 +6,10 @@
 #include <corecrt_io.h>
 
 #include "../core/threading.h"
+#include "../core/pipelineCache.h"
+#include "../core/cpuProfiling.h"
 
+#include <chrono>
 #include <unordered_map>
 #include <set>
 #include <deque>
@@ -31,6 +34,90 @@ namespace {
 
 		}
 	}
+
+	double MillisecondsSince(std::chrono::high_resolution_clock::time_point start) {
+		return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+	// Cached blobs are only valid for the adapter and driver version they were compiled by.
+	uint64 GetDeviceHash() {
+		IDXGIAdapter4* adapter = DxContext::Instance().GetAdapter();
+		DXGI_ADAPTER_DESC1 desc;
+		ThrowIfFailed(adapter->GetDesc1(&desc));
+
+		LARGE_INTEGER driverVersion = {};
+		adapter->CheckInterfaceSupport(__uuidof(IDXGIDevice), &driverVersion);
+
+		PipelineHasher hasher;
+		hasher.Add(desc.VendorId).Add(desc.DeviceId).Add(desc.SubSysId).Add(desc.Revision).Add(driverVersion.QuadPart);
+		return hasher.Finish();
+	}
+
+	// Everything but the pointers, which differ between runs. The shaders are part of the key by their contents instead. Padding is hashed
+	// along with the rest, which at worst costs a cache miss. The driver checks cached blobs against the description anyway.
+	uint64 HashPipelineDesc(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc) {
+		D3D12_GRAPHICS_PIPELINE_STATE_DESC d;
+		memcpy(&d, &desc, sizeof(d));
+		d.pRootSignature = nullptr;
+		d.VS = d.PS = d.DS = d.HS = d.GS = {};
+		d.StreamOutput.pSODeclaration = nullptr;
+		d.StreamOutput.pBufferStrides = nullptr;
+		d.InputLayout.pInputElementDescs = nullptr;
+		d.CachedPSO = {};
+
+		PipelineHasher hasher;
+		hasher.Add(d);
+		for (uint32 i = 0; i < desc.InputLayout.NumElements; i++) {
+			D3D12_INPUT_ELEMENT_DESC element = desc.InputLayout.pInputElementDescs[i];
+			hasher.AddString(element.SemanticName);
+			element.SemanticName = nullptr;
+			hasher.Add(element);
+		}
+		for (uint32 i = 0; i < desc.StreamOutput.NumEntries; i++) {
+			D3D12_SO_DECLARATION_ENTRY entry = desc.StreamOutput.pSODeclaration[i];
+			hasher.AddString(entry.SemanticName);
+			entry.SemanticName = nullptr;
+			hasher.Add(entry);
+		}
+		if (desc.StreamOutput.NumStrides) {
+			hasher.Add(desc.StreamOutput.pBufferStrides, sizeof(UINT) * desc.StreamOutput.NumStrides);
+		}
+		return hasher.Finish();
+	}
+
+	uint64 HashPipelineDesc(const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc) {
+		PipelineHasher hasher;
+		hasher.Add(desc.NodeMask).Add(desc.Flags);
+		return hasher.Finish();
+	}
+
+	// 'create' creates the pipeline from the description, which may carry a cached blob.
+	template<typename Desc, typename Create>
+	DxPipelineState CreateCachedPipeline(PipelineCache& cache, uint64 key, Desc& desc, const Create& create, std::atomic<uint32>& numRejected) {
+		DxPipelineState result = nullptr;
+
+		std::vector<uint8> cached;
+		if (cache.Find(key, cached)) {
+			desc.CachedPSO = { cached.data(), cached.size() };
+			// The driver refuses blobs which don't match the description, e.g. if a user root signature changed since the blob was written.
+			if (FAILED(create(desc, result))) {
+				result = nullptr;
+				cache.Remove(key);
+				++numRejected;
+			}
+			desc.CachedPSO = {};
+		}
+
+		if (not result) {
+			ThrowIfFailed(create(desc, result));
+
+			DxBlob blob;
+			if (SUCCEEDED(result->GetCachedBlob(blob.GetAddressOf()))) {
+				cache.Insert(key, blob->GetBufferPointer(), blob->GetBufferSize());
+			}
+		}
+		return result;
+	}
 }
 
 void DxPipelineFactory::ReloadablePipelineState::Initialize(const D3D12_GRAPHICS_PIPELINE_STATE_DESC &desc, const GraphicsPipelineFiles &files, DxRootSignature* rootSignature) {
@@ -75,19 +162,18 @@ DxPipelineFactory::ReloadableRootSignature* DxPipelineFactory::PushBlob(const ch
 	if (filename) {
 		auto it = _shaderBlobs.find(filename);
 		if (it == _shaderBlobs.end()) {
-			// New file
-			std::wstring filepath = shaderDir + StringToWideString(filename) + L".cso";
-
-			DxBlob blob;
-			ThrowIfFailed(D3DReadFileToBlob(filepath.c_str(), blob.GetAddressOf()));
+			// New file. It is read in LoadPendingBlobs, together with all other new files.
+			ShaderFile file = { .Blob = nullptr, .UsedByPipelines = {pipelineIndex} };
 
 			if (isRootSignature) {
 				_rootSignatureFromFiles.push_back({filename, {}});
 				result = &_rootSignatureFromFiles.back();
+				file.RootSignature = result;
 			}
 
 			_mutex.lock();
-			_shaderBlobs[filename] = {.Blob = blob, .UsedByPipelines = {pipelineIndex} };
+			_shaderBlobs[filename] = file;
+			_pendingBlobs.push_back(filename);
 			_mutex.unlock();
 		}
 		else {
@@ -151,6 +237,7 @@ DxPipeline DxPipelineFactory::CreateReloadablePipeline(const D3D12_GRAPHICS_PIPE
 	DxRootSignature* rootSignature = &reloadableRs->RootSignature;
 
 	state.Initialize(desc, files, rootSignature);
+	state.RootSignatureFile = files.shaders[rootSignatureFile];
 
 	DxPipeline result = {&state.Pipeline, rootSignature};
 	return result;
@@ -182,6 +269,7 @@ DxPipeline DxPipelineFactory::CreateReloadablePipeline(const char *csFile) {
 	DxRootSignature* rootSignature = &reloadableRs->RootSignature;
 
 	state.Initialize(csFile, rootSignature);
+	state.RootSignatureFile = csFile;
 
 	DxPipeline result = {&state.Pipeline, rootSignature};
 	return result;
@@ -231,6 +319,45 @@ DxPipeline DxPipelineFactory::CreateReloadablePipeline(const D3D12_PIPELINE_STAT
 }
 
 
+void DxPipelineFactory::LoadPendingBlobs() {
+	std::vector<ShaderFile*> files(_pendingBlobs.size());
+	for (uint32 i = 0; i < _pendingBlobs.size(); i++) {
+		files[i] = &_shaderBlobs[_pendingBlobs[i]];
+	}
+
+	concurrency::parallel_for(0, (int)files.size(), [&](int i) {
+		std::wstring filepath = shaderDir + StringToWideString(_pendingBlobs[i]) + L".cso";
+		ThrowIfFailed(D3DReadFileToBlob(filepath.c_str(), files[i]->Blob.GetAddressOf()));
+		files[i]->Hash = HashBytes(files[i]->Blob->GetBufferPointer(), files[i]->Blob->GetBufferSize());
+	});
+
+	// Files with the same contents (e.g. a shader compiled under two names) share one blob. Pipeline cache keys only depend on the hash.
+	for (ShaderFile* file : files) {
+		auto [it, inserted] = _blobsByHash.try_emplace(file->Hash, file->Blob);
+		if (inserted) {
+			_statistics.NumShaderBytes += file->Blob->GetBufferSize();
+		}
+		else {
+			file->Blob = it->second;
+			_statistics.NumDuplicateShaderFiles++;
+		}
+	}
+
+	_statistics.NumShaderFiles += (uint32)files.size();
+	_pendingBlobs.clear();
+}
+
+uint64 DxPipelineFactory::GetShaderHash(const char* filename) {
+	if (not filename) {
+		return 0;
+	}
+
+	// Like the blobs, this is read without the lock. CheckForChangedPipelines holds it while loading pipelines, and the file watcher
+	// only writes to it between those calls.
+	auto it = _shaderBlobs.find(filename);
+	return it != _shaderBlobs.end() ? it->second.Hash : 0;
+}
+
 void DxPipelineFactory::LoadRootSignature(ReloadableRootSignature &r) {
 	DxBlob rs = _shaderBlobs[r.File].Blob;
 
@@ -267,7 +394,16 @@ void DxPipelineFactory::LoadPipeline(ReloadablePipelineState& p) {
 			}
 
 			p.GraphicsDesc.pRootSignature = p.RootSignature->RootSignature();
-			ThrowIfFailed(dxContext.GetDevice()->CreateGraphicsPipelineState(&p.GraphicsDesc, IID_PPV_ARGS(p.Pipeline.GetAddressOf())));
+
+			const uint64 shaderHashes[] = {
+				GetShaderHash(p.GraphicsFiles.VS), GetShaderHash(p.GraphicsFiles.PS), GetShaderHash(p.GraphicsFiles.GS),
+				GetShaderHash(p.GraphicsFiles.DS), GetShaderHash(p.GraphicsFiles.HS), GetShaderHash(p.RootSignatureFile),
+			};
+			uint64 key = GetPipelineCacheKey(shaderHashes, arraysize(shaderHashes), HashPipelineDesc(p.GraphicsDesc));
+
+			p.Pipeline = CreateCachedPipeline(_pipelineCache, key, p.GraphicsDesc, [&](const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, DxPipelineState& result) {
+				return dxContext.GetDevice()->CreateGraphicsPipelineState(&desc, IID_PPV_ARGS(result.GetAddressOf()));
+			}, _numRejectedCachedPipelines);
 		}
 		else {
 			if (p.GraphicsFiles.VS) {
@@ -291,8 +427,12 @@ void DxPipelineFactory::LoadPipeline(ReloadablePipelineState& p) {
 				p.Stream->SetPixelShader(shader);
 			}
 
+			// The layout of the stream is up to the caller, so there is nothing to key a cache entry on.
 			p.Stream->SetRootSignature(*p.RootSignature);
-			ThrowIfFailed(dxContext.GetDevice()->CreatePipelineState(&p.StreamDesc, IID_PPV_ARGS(&p.Pipeline)));
+			DxPipelineState pipeline = nullptr;
+			ThrowIfFailed(dxContext.GetDevice()->CreatePipelineState(&p.StreamDesc, IID_PPV_ARGS(pipeline.GetAddressOf())));
+			p.Pipeline = pipeline;
+			++_numUncachedPipelines;
 		}
 	}
 	else {
@@ -300,22 +440,52 @@ void DxPipelineFactory::LoadPipeline(ReloadablePipelineState& p) {
 		p.ComputeDesc.CS = CD3DX12_SHADER_BYTECODE(shader.Get());
 
 		p.ComputeDesc.pRootSignature = p.RootSignature->RootSignature();
-		ThrowIfFailed(dxContext.GetDevice()->CreateComputePipelineState(&p.ComputeDesc, IID_PPV_ARGS(p.Pipeline.GetAddressOf())));
+
+		const uint64 shaderHashes[] = { GetShaderHash(p.ComputeFile), GetShaderHash(p.RootSignatureFile) };
+		uint64 key = GetPipelineCacheKey(shaderHashes, arraysize(shaderHashes), HashPipelineDesc(p.ComputeDesc));
+
+		p.Pipeline = CreateCachedPipeline(_pipelineCache, key, p.ComputeDesc, [&](const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc, DxPipelineState& result) {
+			return dxContext.GetDevice()->CreateComputePipelineState(&desc, IID_PPV_ARGS(result.GetAddressOf()));
+		}, _numRejectedCachedPipelines);
 	}
 }
 
 void DxPipelineFactory::CreateAllPendingReloadablePipelines() {
+	CPU_PROFILE_BLOCK("Create pipelines");
+
 	static int rsOffset = 0;
 	static int pipelineOffset = 0;
 
+	auto start = std::chrono::high_resolution_clock::now();
+
+	if (not _pipelineCacheInitialized) {
+		_pipelineCache.Initialize(PIPELINE_CACHE_FILENAME, GetDeviceHash());
+		_pipelineCacheInitialized = true;
+	}
+
+	uint32 numHits = _pipelineCache.NumHits();
+	uint32 numMisses = _pipelineCache.NumMisses();
+
+	double millisecondsShaderFiles = 0.0;
+	double millisecondsRootSignatures = 0.0;
+	double millisecondsPipelines = 0.0;
+
+	auto phaseStart = std::chrono::high_resolution_clock::now();
+	LoadPendingBlobs();
+	millisecondsShaderFiles = MillisecondsSince(phaseStart);
+
 #if 1
+	phaseStart = std::chrono::high_resolution_clock::now();
 	concurrency::parallel_for(rsOffset, (int)_rootSignatureFromFiles.size(), [&](int i) {
 		LoadRootSignature(_rootSignatureFromFiles[i]);
 	});
+	millisecondsRootSignatures = MillisecondsSince(phaseStart);
 
+	phaseStart = std::chrono::high_resolution_clock::now();
 	concurrency::parallel_for(pipelineOffset, (int)_pipelines.size(), [&](int i) {
 		LoadPipeline(_pipelines[i]);
 	});
+	millisecondsPipelines = MillisecondsSince(phaseStart);
 #else
 	for (int i = 0; i < _rootSignatureFromFiles.size(); i++) {
 		LoadRootSignature(_rootSignatureFromFiles[i]);
@@ -326,13 +496,35 @@ void DxPipelineFactory::CreateAllPendingReloadablePipelines() {
 	}
 #endif
 
+	_statistics.NumRootSignatures += (uint32)_rootSignatureFromFiles.size() - rsOffset;
+	_statistics.NumPipelines += (uint32)_pipelines.size() - pipelineOffset;
+	_statistics.NumCacheHits += _pipelineCache.NumHits() - numHits;
+	_statistics.NumCacheMisses += _pipelineCache.NumMisses() - numMisses;
+	_statistics.NumCacheRejected = _numRejectedCachedPipelines;
+	_statistics.NumUncachedPipelines = _numUncachedPipelines;
+	_statistics.MillisecondsShaderFiles += millisecondsShaderFiles;
+	_statistics.MillisecondsRootSignatures += millisecondsRootSignatures;
+	_statistics.MillisecondsPipelines += millisecondsPipelines;
+
+	double millisecondsTotal = MillisecondsSince(start);
+	_statistics.MillisecondsTotal += millisecondsTotal;
+
+	printf("Created %u pipelines in %.1f ms (shader files %.1f ms, root signatures %.1f ms, pipelines %.1f ms). Pipeline cache: %u hits, %u misses.\n",
+		(uint32)_pipelines.size() - pipelineOffset, millisecondsTotal, millisecondsShaderFiles, millisecondsRootSignatures, millisecondsPipelines,
+		_pipelineCache.NumHits() - numHits, _pipelineCache.NumMisses() - numMisses);
+
 	rsOffset = (int)_rootSignatureFromFiles.size();
 	pipelineOffset = (int)_pipelines.size();
 
-	std::thread fileWatcher([&]() {
-		CheckForFileChanges();
-	});
-	fileWatcher.detach();
+	_pipelineCache.Save();
+
+	if (not _watchingFiles) {
+		std::thread fileWatcher([&]() {
+			CheckForFileChanges();
+		});
+		fileWatcher.detach();
+		_watchingFiles = true;
+	}
 }
 
 void DxPipelineFactory::CheckForChangedPipelines() {
@@ -343,9 +535,15 @@ void DxPipelineFactory::CheckForChangedPipelines() {
 	concurrency::parallel_for(0, (int)_dirtyPipelines.size(), [&](int i) {
 		LoadPipeline(*_dirtyPipelines[i]);
 	});
+	bool reloaded = not _dirtyPipelines.empty();
 	_dirtyPipelines.clear();
-	_dirtyPipelines.clear();
+	_dirtyRootSignatures.clear();
 	_mutex.unlock();
+
+	// Reloaded shaders are new cache entries. The entries of their old versions age out.
+	if (reloaded) {
+		_pipelineCache.Save();
+	}
 }
 
 
@@ -442,12 +640,17 @@ DWORD DxPipelineFactory::CheckForFileChanges() {
 						std::cout << "Reloading shader blob " << changedPath << std::endl;
 						DxBlob blob;
 						ThrowIfFailed(D3DReadFileToBlob(changedPath.wstring().c_str(), blob.GetAddressOf()));
+						uint64 hash = HashBytes(blob->GetBufferPointer(), blob->GetBufferSize());
 
+						// Saving a shader source without changing the code recompiles to the same blob.
 						_mutex.lock();
-						it->second.Blob = blob;
-						_dirtyPipelines.insert(_dirtyPipelines.end(), it->second.UsedByPipelines.begin(), it->second.UsedByPipelines.end());
-						if (it->second.RootSignature) {
-							_dirtyRootSignatures.push_back(it->second.RootSignature);
+						if (hash != it->second.Hash) {
+							it->second.Blob = blob;
+							it->second.Hash = hash;
+							_dirtyPipelines.insert(_dirtyPipelines.end(), it->second.UsedByPipelines.begin(), it->second.UsedByPipelines.end());
+							if (it->second.RootSignature) {
+								_dirtyRootSignatures.push_back(it->second.RootSignature);
+							}
 						}
 						_mutex.unlock();
 					}
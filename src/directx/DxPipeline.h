@@ -2,7 +2,9 @@
 
 #include "dx.h"
 #include "DxContext.h"
+#include "../core/pipelineCache.h"
 
+#include <atomic>
 #include <unordered_map>
 #include <set>
 #include <deque>
@@ -304,6 +306,24 @@ enum ERsFile {
 	ERsInMeshShader
 };
 
+// Accumulated over all calls of CreateAllPendingReloadablePipelines.
+struct DxPipelineCreationStatistics {
+	uint32 NumPipelines;
+	uint32 NumRootSignatures;
+	uint32 NumShaderFiles;
+	uint32 NumDuplicateShaderFiles; // Files with the same contents as another one. They share one blob.
+	uint64 NumShaderBytes;
+	uint32 NumCacheHits;
+	uint32 NumCacheMisses;
+	uint32 NumCacheRejected;        // Cached pipelines which the driver refused, e.g. because a root signature changed.
+	uint32 NumUncachedPipelines;    // Stream pipelines, whose layout is up to the caller.
+
+	double MillisecondsShaderFiles;
+	double MillisecondsRootSignatures;
+	double MillisecondsPipelines;
+	double MillisecondsTotal;
+};
+
 class DxPipelineFactory {
 public:
 	DxPipelineFactory() = default;
@@ -312,8 +332,12 @@ public:
 		return _instance;
 	}
 
+	// Reads the shader files of all pipelines created since the last call and creates their root signatures and pipelines, all in parallel.
+	// Pipelines are looked up in the on-disk pipeline cache first, by the contents of their shaders and their description.
 	void CreateAllPendingReloadablePipelines();
 	void CheckForChangedPipelines();
+
+	const DxPipelineCreationStatistics& CreationStatistics() const { return _statistics; }
 	DxPipeline CreateReloadablePipeline(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, const GraphicsPipelineFiles& files,
 		DxRootSignature userRootSignature);
 	DxPipeline CreateReloadablePipeline(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, const GraphicsPipelineFiles& files,
@@ -388,6 +412,7 @@ private:
 
 		DxPipelineState Pipeline = nullptr;
 		DxRootSignature* RootSignature;
+		const char* RootSignatureFile = nullptr; // Null for user root signatures.
 		bool UserRootSignature = false;
 
 		D3D12_INPUT_ELEMENT_DESC InputLayout[16] = {};
@@ -406,14 +431,17 @@ private:
 
 	struct ShaderFile {
 		DxBlob Blob;
+		uint64 Hash = 0; // Of the contents.
 		std::set<ReloadablePipelineState*> UsedByPipelines;
 
 		ReloadableRootSignature* RootSignature;
 	};
 
 	ReloadableRootSignature* PushBlob(const char* filename, ReloadablePipelineState* pipelineIndex, bool isRootSignature = false);
+	void LoadPendingBlobs();
 	void LoadRootSignature(ReloadableRootSignature& r);
 	void LoadPipeline(ReloadablePipelineState& p);
+	uint64 GetShaderHash(const char* filename);
 	DWORD CheckForFileChanges();
 
 	static DxPipelineFactory* _instance;
@@ -427,6 +455,16 @@ private:
 	std::vector<ReloadablePipelineState*> _dirtyPipelines = {};
 	std::vector<ReloadableRootSignature*> _dirtyRootSignatures = {};
 
+	std::vector<const char*> _pendingBlobs = {}; // Registered, but not read yet.
+	std::unordered_map<uint64, DxBlob> _blobsByHash = {};
+
+	PipelineCache _pipelineCache;
+	bool _pipelineCacheInitialized = false;
+	bool _watchingFiles = false;
+	std::atomic<uint32> _numRejectedCachedPipelines = 0;
+	std::atomic<uint32> _numUncachedPipelines = 0;
+	DxPipelineCreationStatistics _statistics = {};
+
 	std::mutex _mutex = {};
 
 	friend void LoadRootSignature(ReloadableRootSignature& r);
@@ -32,6 +32,10 @@ struct DxProfileFrame {
     uint64 EndClock;
     uint64 GlobalFrameId;
 
+    // GPU and CPU (QueryPerformanceCounter) timestamp at the same moment, per queue.
+    uint64 CalibrationGpuClock[EProfileClCount];
+    uint64 CalibrationCpuClock[EProfileClCount];
+
     float Duration;
 
     uint32 Count[EProfileClCount];
@@ -41,13 +45,18 @@ static DxProfileFrame ProfileFrames[MAX_NUM_DX_PROFILE_FRAMES];
 static uint32 ProfileFrameWriteIndex;
 static bool PauseRecording;
 
+static const char* QueueTrackNames[EProfileClCount] = { "GPU graphics", "GPU compute" };
+
+static ProfileStatistics GpuStatistics("GPU");
+static ProfileStatisticsEvent StatisticsEvents[MAX_NUM_DX_PROFILE_EVENTS];
+
 void ProfileFrameMarker(DxCommandList* commandList) {
     assert(commandList->Type() == D3D12_COMMAND_LIST_TYPE_DIRECT);
 
     uint32 queryIndex = DxContext::Instance().IncrementQueryIndex();
     commandList->QueryTimestamp(queryIndex);
 
-    ProfileEvents[DxContext::Instance().BufferedFrameId()][queryIndex] = { EProfileEventFrameMarker, EProfileClGraphics, "Frame end" };
+    ProfileEvents[DxContext::Instance().BufferedFrameId()][queryIndex] = { EProfileEventFrameMarker, EProfileClGraphics, "Frame end", 0, commandList->ProfileOrder() };
 }
 
 void ResolveTimeStampQueries(uint64* timestamps) {
@@ -65,8 +74,9 @@ void ResolveTimeStampQueries(uint64* timestamps) {
             events[i].Timestamp = timestamps[i];
         }
 
-        std::sort(events, events + numQueries, [](const DxProfileEvent& a, const DxProfileEvent& b) {
-            return a.Timestamp < b.Timestamp;
+        // Stable, so that events of one list with equal timestamps stay in query order.
+        std::stable_sort(events, events + numQueries, [](const DxProfileEvent& a, const DxProfileEvent& b) {
+            return (a.Timestamp != b.Timestamp) ? (a.Timestamp < b.Timestamp) : (a.ListOrder < b.ListOrder);
         });
 
         DxProfileBlock* stack[EProfileClCount][1024];
@@ -141,6 +151,22 @@ void ResolveTimeStampQueries(uint64* timestamps) {
 
         frame.Duration = (float)(frame.EndClock - frame.StartClock) / context.RenderQueue.TimestampFrequency() * 1000.f;
 
+        context.RenderQueue.NativeQueue->GetClockCalibration(&frame.CalibrationGpuClock[EProfileClGraphics], &frame.CalibrationCpuClock[EProfileClGraphics]);
+        context.ComputeQueue.NativeQueue->GetClockCalibration(&frame.CalibrationGpuClock[EProfileClCompute], &frame.CalibrationCpuClock[EProfileClCompute]);
+
+        double frequencies[EProfileClCount] = { (double)context.RenderQueue.TimestampFrequency(), (double)context.ComputeQueue.TimestampFrequency() };
+
+        uint32 numStatisticsEvents = 0;
+        for (uint32 i = 0; i < numQueries; i++) {
+            const DxProfileEvent& e = events[i];
+            if (e.Type != EProfileEventFrameMarker) {
+                EProfileStatisticsEventType type = (e.Type == EProfileEventBeginBlock) ? EProfileStatisticsEventBegin : EProfileStatisticsEventEnd;
+                double milliseconds = (double)(int64)(e.Timestamp - frame.StartClock) / frequencies[e.ClType] * 1000.0;
+                StatisticsEvents[numStatisticsEvents++] = { type, QueueTrackNames[e.ClType], e.Name, milliseconds };
+            }
+        }
+        GpuStatistics.AddFrame(frame.GlobalFrameId, frame.Duration, StatisticsEvents, numStatisticsEvents);
+
         for (uint32 cl = 0; cl < EProfileClCount; cl++) {
             frame.Count[cl] = count[cl];
 
@@ -162,4 +188,59 @@ void ResolveTimeStampQueries(uint64* timestamps) {
     static uint32 highlightFrameIndex = -1;
 }
 
+static void GetGpuTraceEvents(uint32 numFrames, std::vector<TraceEvent>& outEvents) {
+    DxContext& context = DxContext::Instance();
+
+    LARGE_INTEGER qpcFrequency;
+    QueryPerformanceFrequency(&qpcFrequency);
+
+    for (uint32 f = 0; f < numFrames and f < MAX_NUM_DX_PROFILE_FRAMES; f++) {
+        uint32 index = (ProfileFrameWriteIndex + MAX_NUM_DX_PROFILE_FRAMES - 1 - f) % MAX_NUM_DX_PROFILE_FRAMES;
+        const DxProfileFrame& frame = ProfileFrames[index];
+        if (frame.EndClock == 0) {
+            break;
+        }
+
+        for (uint32 cl = 0; cl < EProfileClCount; cl++) {
+            double gpuFrequency = (double)((cl == EProfileClGraphics) ? context.RenderQueue.TimestampFrequency() : context.ComputeQueue.TimestampFrequency());
+
+            for (uint32 i = 0; i < frame.Count[cl]; i++) {
+                const DxProfileBlock& block = frame.Blocks[cl][i];
+                double gpuOffset = (double)(int64)(block.StartClock - frame.CalibrationGpuClock[cl]) / gpuFrequency;
+                uint64 qpc = frame.CalibrationCpuClock[cl] + (int64)(gpuOffset * qpcFrequency.QuadPart);
+                outEvents.push_back({ block.Name, QueueTrackNames[cl], QpcToCpuProfileMicroseconds(qpc), (block.EndClock - block.StartClock) / gpuFrequency * 1e6 });
+            }
+        }
+    }
+}
+
 #endif
+
+ProfileStatistics* GetGpuProfileStatistics() {
+#if ENABLE_DX_PROFILING
+    return &GpuStatistics;
+#else
+    return nullptr;
+#endif
+}
+
+bool ExportProfileStatistics(const fs::path& directory) {
+    std::error_code error;
+    fs::create_directories(directory, error);
+
+    ProfileStatistics& cpuStatistics = GetCpuProfileStatistics();
+    bool result = cpuStatistics.ExportCsv(directory / "cpu_statistics.csv") and cpuStatistics.ExportJson(directory / "cpu_statistics.json");
+
+    if (ProfileStatistics* gpuStatistics = GetGpuProfileStatistics()) {
+        result &= gpuStatistics->ExportCsv(directory / "gpu_statistics.csv") and gpuStatistics->ExportJson(directory / "gpu_statistics.json");
+    }
+    return result;
+}
+
+bool ExportProfileTrace(const fs::path& filename, uint32 numFrames) {
+    std::vector<TraceEvent> gpuEvents;
+#if ENABLE_DX_PROFILING
+    GetGpuTraceEvents(numFrames, gpuEvents);
+#endif
+    return ExportChromeTrace(filename, numFrames, gpuEvents);
+}
@@ -3,8 +3,20 @@
 #include "DxCommandList.h"
 #include "../core/threading.h"
 #include "DxContext.h"
+#include "../core/cpuProfiling.h"
 
 extern bool ProfilerWindowOpen;
+
+// Writes the CPU scopes of the last 'numFrames' frames as a Chrome trace, together with the GPU blocks of the same frames if DX profiling
+// is enabled. GPU blocks are moved onto the CPU's time line with the queues' clock calibration.
+bool ExportProfileTrace(const fs::path& filename, uint32 numFrames);
+
+// Rolling statistics over the resolved frames, with a track per queue. nullptr if DX profiling is disabled.
+ProfileStatistics* GetGpuProfileStatistics();
+
+// Writes the CPU and, if DX profiling is enabled, the GPU statistics as CSV and JSON into 'directory'.
+bool ExportProfileStatistics(const fs::path& directory);
+
 #if ENABLE_DX_PROFILING
 
 #define COMPOSITE_VARNAME_(a, b) a##b
@@ -35,33 +47,43 @@ struct DxProfileEvent {
     EProfileClType ClType;
     const char* Name;
     uint64 Timestamp;
+    uint64 ListOrder; // DxCommandList::ProfileOrder of the list the event was recorded on.
 };
 
 extern DxProfileEvent ProfileEvents[NUM_BUFFERED_FRAMES][MAX_NUM_DX_PROFILE_EVENTS];
 
+static void RecordProfileEvent(DxCommandList* commandList, EProfileEventType type, const char* name) {
+    DxContext& context = DxContext::Instance();
+    uint32 queryIndex = context.IncrementQueryIndex();
+    commandList->QueryTimestamp(queryIndex);
+
+    EProfileClType clType = (commandList->Type() == D3D12_COMMAND_LIST_TYPE_DIRECT) ? EProfileClGraphics : EProfileClCompute;
+    ProfileEvents[context.BufferedFrameId()][queryIndex] = { type, clType, name, 0, commandList->ProfileOrder() };
+}
+
 struct DxProfileBlockRecorder {
     DxCommandList* CommandList;
     const char* Name;
 
     DxProfileBlockRecorder(DxCommandList* commandList, const char* name) : CommandList(commandList), Name(name) {
-        DxContext& context = DxContext::Instance();
-        uint32 queryIndex = context.IncrementQueryIndex();
-        commandList->QueryTimestamp(queryIndex);
-
-        ProfileEvents[context.FrameId()][queryIndex] = { EProfileEventBeginBlock, commandList->Type() == D3D12_COMMAND_LIST_TYPE_DIRECT ? EProfileClGraphics : EProfileClCompute, Name};
+        RecordProfileEvent(CommandList, EProfileEventBeginBlock, Name);
     }
 
     ~DxProfileBlockRecorder() {
-        DxContext& context = DxContext::Instance();
-        uint32 queryIndex = context.IncrementQueryIndex();
-        CommandList->QueryTimestamp(queryIndex);
-
-        ProfileEvents[context.FrameId()][queryIndex] = { EProfileEventEndBlock, CommandList->Type() == D3D12_COMMAND_LIST_TYPE_DIRECT ? EProfileClGraphics : EProfileClCompute, Name};
+        RecordProfileEvent(CommandList, EProfileEventEndBlock, Name);
     }
 };
 
+// For blocks which begin and end on different command lists of the same queue, e.g. around passes recorded in parallel.
+// Events are resolved in timestamp order. Worker threads may profile blocks inside, because equal timestamps are ordered by the order in
+// which their command lists were handed out, which is the submission order of the chunks.
+#define DX_PROFILE_BLOCK_BEGIN(cl, name) RecordProfileEvent(cl, EProfileEventBeginBlock, name)
+#define DX_PROFILE_BLOCK_END(cl, name) RecordProfileEvent(cl, EProfileEventEndBlock, name)
+
 #else
 
 #define DX_PROFILE_BLOCK(cl, name)
+#define DX_PROFILE_BLOCK_BEGIN(cl, name)
+#define DX_PROFILE_BLOCK_END(cl, name)
 
 #endif
\ No newline at end of file
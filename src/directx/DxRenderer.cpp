@@ -11,6 +11,7 @@
 #include "DxContext.h"
 #include "DxProfiling.h"
 #include "../core/random.h"
+#include "../core/brdfIntegration.h"
 
 #include "depth_only_rs.hlsli"
 #include "outline_rs.hlsli"
@@ -19,8 +20,10 @@
 #include "camera.hlsli"
 #include "transform.hlsli"
 #include "../render/Raytracing.h"
+#include "../render/DrawInstancing.h"
 
 #include <iostream>
+#include <chrono>
 
 #define SSR_RAYCAST_WIDTH (RenderWidth / 2)
 #define SSR_RAYCAST_HEIGHT (RenderHeight / 2)
@@ -42,6 +45,26 @@ namespace {
 
 		return r;
 	}
+
+	// Instance data lives in the upload buffer of the recording command list and is bound as a root SRV.
+	// Each command list has its own upload buffer, so chunks recorded on different threads never share one.
+	template <typename T>
+	T* AllocateInstanceData(DxCommandList* cl, uint32 numInstances, D3D12_GPU_VIRTUAL_ADDRESS& outGpuAddress) {
+		DxAllocation allocation = cl->AllocateDynamicBuffer(numInstances * sizeof(T), 16);
+		outGpuAddress = allocation.GpuPtr;
+		return (T*)allocation.CpuPtr;
+	}
+
+	D3D12_RECT GetViewportRect(const vec4& viewport) {
+		return { (LONG)viewport.x, (LONG)viewport.y, (LONG)(viewport.x + viewport.z), (LONG)(viewport.y + viewport.w) };
+	}
+
+	void AccumulateDrawStatistics(RenderStatistics& stats, const RenderStatistics& chunkStats) {
+		stats.NumDrawCalls += chunkStats.NumDrawCalls;
+		stats.NumDrawCallsMerged += chunkStats.NumDrawCallsMerged;
+		stats.NumStateChanges += chunkStats.NumStateChanges;
+		stats.NumStateChangesSaved += chunkStats.NumStateChangesSaved;
+	}
 }
 
 DxRenderer* DxRenderer::_instance = new DxRenderer{};
@@ -79,6 +102,9 @@ void DxRenderer::Initialize(DXGI_FORMAT screenFormat, uint32 width, uint32 heigh
 	_shadowMap = textureFactory->CreateDepthTexture(SHADOW_MAP_WIDTH, SHADOW_MAP_HEIGHT, shadowDepthFormat);
 	SET_NAME(_shadowMap->Resource, "Shadow map");
 
+	_staticShadowMapCache = textureFactory->CreateDepthTexture(SHADOW_MAP_WIDTH, SHADOW_MAP_HEIGHT, shadowDepthFormat);
+	SET_NAME(_staticShadowMapCache->Resource, "Static shadow map cache");
+
 	DxPipelineFactory* pipelineFactory = DxPipelineFactory::Instance();
 	// Sky.
 	{
@@ -113,6 +139,12 @@ void DxRenderer::Initialize(DXGI_FORMAT screenFormat, uint32 width, uint32 heigh
 
 		_shadowPipeline = pipelineFactory->CreateReloadablePipeline(desc, { "shadow_vs" }, ERsInVertexShader);
 		_pointLightShadowPipeline = pipelineFactory->CreateReloadablePipeline(desc, { "shadow_point_light_vs", "shadow_point_light_ps" }, ERsInVertexShader);
+
+		auto copyDesc = CREATE_GRAPHICS_PIPELINE
+			.RenderTargets(0, 0, shadowDepthFormat)
+			.DepthSettings(true, true, D3D12_COMPARISON_FUNC_ALWAYS);
+
+		_shadowMapCopyPipeline = pipelineFactory->CreateReloadablePipeline(copyDesc, { "fullscreen_triangle_vs", "shadow_map_copy_ps" });
 	}
 
 	// Outline.
@@ -182,9 +214,17 @@ void DxRenderer::Initialize(DXGI_FORMAT screenFormat, uint32 width, uint32 heigh
 	pipelineFactory->CreateAllPendingReloadablePipelines();
 
 	{
-		DxCommandList* cl = dxContext.GetFreeRenderCommandList();
-		_brdfTex = texturePreprocessor->IntegrateBRDF(cl);
-		dxContext.ExecuteCommandList(cl);
+		// Integrated offline, see brdfIntegration.h. Only if the file is missing does the table have to be integrated here.
+		_brdfTex = textureFactory->LoadTextureFromFile(BRDF_LUT_FILE, ETextureLoadFlagsNoncolor);
+		if (not _brdfTex) {
+			std::vector<float> texels(BRDF_LUT_SIZE * BRDF_LUT_SIZE * 4);
+			IntegrateBrdfLut(BRDF_LUT_SIZE, BRDF_LUT_NUM_SAMPLES, texels.data());
+
+			std::vector<uint16> quantized(texels.size());
+			QuantizeBrdfLut(texels.data(), BRDF_LUT_SIZE, quantized.data());
+			_brdfTex = textureFactory->CreateTexture(quantized.data(), BRDF_LUT_SIZE, BRDF_LUT_SIZE, (DXGI_FORMAT)BRDF_LUT_FORMAT);
+		}
+		SET_NAME(_brdfTex->Resource, "BRDF LUT");
 	}
 
 	for (uint32 i = 0; i < std::size(_haltonSequence); i++) {
@@ -415,6 +455,684 @@ void DxRenderer::AllocateLightCullingBuffers() {
 	}
 }
 
+FrameGraphReport DxRenderer::CompileFrameGraph() {
+	FrameGraphReport report = {};
+	ID3D12Device5* device = DxContext::Instance().GetDevice();
+
+	RenderGraph& graph = _frameGraph;
+	graph.Reset();
+
+	// Render targets and depth buffers, other textures and buffers go into separate heaps, which every resource heap tier supports.
+	auto transient = [&](const char* name, const DxResource& resource) {
+		if (!resource) {
+			return RENDER_GRAPH_INVALID;
+		}
+
+		D3D12_RESOURCE_DESC desc = resource->GetDesc();
+		D3D12_RESOURCE_ALLOCATION_INFO info = device->GetResourceAllocationInfo(0, 1, &desc);
+		report.CommittedBytes += info.SizeInBytes;
+
+		uint32 heapGroup = (desc.Dimension == D3D12_RESOURCE_DIMENSION_BUFFER) ? 2
+			: (desc.Flags & (D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET | D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL)) ? 0 : 1;
+		return graph.CreateTransient(name, info.SizeInBytes, info.Alignment, heapGroup);
+	};
+
+	auto read = [&](RenderGraphPass pass, RenderGraphResource resource, uint32 access) {
+		if (resource != RENDER_GRAPH_INVALID) {
+			graph.Read(pass, resource, access);
+		}
+	};
+	auto write = [&](RenderGraphPass pass, RenderGraphResource resource, uint32 access) {
+		if (resource != RENDER_GRAPH_INVALID) {
+			graph.Write(pass, resource, access);
+		}
+	};
+
+	const uint32 nps = ERenderGraphAccessNonPixelShaderRead;
+	const uint32 ps = ERenderGraphAccessPixelShaderRead;
+	const uint32 uav = ERenderGraphAccessUnorderedAccess;
+	const uint32 rt = ERenderGraphAccessRenderTarget;
+	const uint32 depth = ERenderGraphAccessDepthWrite;
+
+	RenderGraphResource depthStencil = transient("Depth stencil", _depthStencilBuffer->Resource);
+	RenderGraphResource hdrColor = transient("HDR color", _hdrColorTexture->Resource);
+	RenderGraphResource worldNormals = transient("World normals", _worldNormalsTexture->Resource);
+	RenderGraphResource velocities = transient("Screen velocities", _screenVelocitiesTexture->Resource);
+	RenderGraphResource objectIDs = _objectIDsTexture ? transient("Object IDs", _objectIDsTexture->Resource) : RENDER_GRAPH_INVALID;
+	RenderGraphResource reflectance = transient("Reflectance", _reflectanceTexture->Resource);
+	RenderGraphResource linearDepth = transient("Linear depth", _linearDepthBuffer->Resource);
+	RenderGraphResource opaqueDepth = transient("Opaque depth", _opaqueDepthBuffer->Resource);
+	RenderGraphResource ssrRaycast = transient("SSR raycast", _ssrRaycastTexture->Resource);
+	RenderGraphResource ssrResolve = transient("SSR resolve", _ssrResolveTexture->Resource);
+	RenderGraphResource hdrPostProcessing = transient("HDR post processing", _hdrPostProcessingTexture->Resource);
+	RenderGraphResource ldrPostProcessing = transient("LDR post processing", _ldrPostProcessingTexture->Resource);
+	RenderGraphResource cullingGrid = transient("Tiled culling grid", _tiledCullingGrid->Resource);
+	RenderGraphResource indexCounter = transient("Tiled index counter", _tiledCullingIndexCounter->Resource);
+	RenderGraphResource indexList = transient("Tiled index list", _tiledObjectsIndexList->Resource);
+	RenderGraphResource frusta = transient("Tiled frusta", _tiledWorldSpaceFrustaBuffer->Resource);
+
+	// Only used by the downsample and bloom passes, which are disabled. They are allocated nevertheless.
+	transient("Previous frame HDR color temp", _prevFrameHDRColorTempTexture->Resource);
+	transient("Bloom", _bloomTexture->Resource);
+	transient("Bloom temp", _bloomTempTexture->Resource);
+
+	RenderGraphResource ssrOutput = graph.Import("SSR temporal output", uav, nps);
+	RenderGraphResource ssrHistory = graph.Import("SSR temporal history", nps, uav);
+	RenderGraphResource prevFrameHDRColor = graph.Import("Previous frame HDR color", nps, nps);
+	RenderGraphResource shadowMap = graph.Import("Shadow map", depth, depth);
+	RenderGraphResource staticShadowMapCache = graph.Import("Static shadow map cache", depth, depth);
+	RenderGraphResource frameResult = graph.Import("Frame result", ERenderGraphAccessNone, ERenderGraphAccessNone);
+
+	RenderGraphPass pass = graph.AddPass("Depth pre-pass", ERenderGraphPassFlagsMultipleCommandLists);
+	write(pass, depthStencil, depth);
+	write(pass, velocities, rt);
+	write(pass, objectIDs, rt);
+
+	pass = graph.AddPass("Cull lights & decals");
+	read(pass, depthStencil, nps);
+	write(pass, frusta, uav);
+	write(pass, indexCounter, uav);
+	write(pass, indexList, uav);
+	write(pass, cullingGrid, uav);
+
+	pass = graph.AddPass("Linear depth pyramid");
+	read(pass, depthStencil, nps);
+	write(pass, linearDepth, uav);
+
+	pass = graph.AddPass("Shadow maps", ERenderGraphPassFlagsMultipleCommandLists);
+	write(pass, staticShadowMapCache, depth);
+	write(pass, shadowMap, depth);
+
+	pass = graph.AddPass("Sky");
+	write(pass, hdrColor, rt);
+	write(pass, velocities, rt);
+	write(pass, objectIDs, rt);
+	write(pass, depthStencil, depth);
+
+	if (objectIDs != RENDER_GRAPH_INVALID) {
+		pass = graph.AddPass("Copy hovered object ID", ERenderGraphPassFlagsSideEffects);
+		read(pass, objectIDs, ERenderGraphAccessCopySource);
+	}
+
+	pass = graph.AddPass("Main opaque light pass", ERenderGraphPassFlagsMultipleCommandLists);
+	write(pass, hdrColor, rt);
+	write(pass, worldNormals, rt);
+	write(pass, reflectance, rt);
+	write(pass, depthStencil, depth);
+	read(pass, shadowMap, ps);
+	read(pass, cullingGrid, ps);
+	read(pass, indexList, ps);
+
+	pass = graph.AddPass("Copy opaque depth");
+	read(pass, depthStencil, ERenderGraphAccessCopySource);
+	write(pass, opaqueDepth, ERenderGraphAccessCopyDest);
+
+	if (Settings.EnableSSR) {
+		pass = graph.AddPass("SSR raycast");
+		write(pass, ssrRaycast, uav);
+		read(pass, depthStencil, nps);
+		read(pass, linearDepth, nps);
+		read(pass, worldNormals, nps);
+		read(pass, reflectance, nps);
+
+		pass = graph.AddPass("SSR resolve");
+		write(pass, ssrResolve, uav);
+		read(pass, depthStencil, nps);
+		read(pass, worldNormals, nps);
+		read(pass, reflectance, nps);
+		read(pass, ssrRaycast, nps);
+		read(pass, prevFrameHDRColor, nps);
+		read(pass, velocities, nps);
+
+		pass = graph.AddPass("SSR temporal");
+		write(pass, ssrOutput, uav);
+		read(pass, ssrResolve, nps);
+		read(pass, ssrHistory, nps);
+		read(pass, velocities, nps);
+
+		pass = graph.AddPass("SSR median blur");
+		write(pass, ssrResolve, uav);
+		read(pass, ssrOutput, nps);
+	}
+
+	pass = graph.AddPass("Specular ambient");
+	write(pass, hdrPostProcessing, uav);
+	read(pass, hdrColor, nps);
+	read(pass, worldNormals, nps);
+	read(pass, reflectance, nps);
+	if (Settings.EnableSSR) {
+		read(pass, ssrResolve, nps);
+	}
+
+	if (_transparentRenderPass && _transparentRenderPass->_drawCalls.size() > 0) {
+		pass = graph.AddPass("Transparent light pass", ERenderGraphPassFlagsMultipleCommandLists);
+		write(pass, hdrPostProcessing, rt);
+		write(pass, depthStencil, depth);
+		read(pass, opaqueDepth, ps);
+		read(pass, shadowMap, ps);
+		read(pass, cullingGrid, ps);
+		read(pass, indexList, ps);
+	}
+
+	pass = graph.AddPass("Tonemap");
+	read(pass, hdrPostProcessing, nps);
+	write(pass, ldrPostProcessing, uav);
+
+	pass = graph.AddPass("Present");
+	read(pass, ldrPostProcessing, nps);
+	write(pass, frameResult, uav);
+
+	// Fails only if a pass reads a transient resource before it is written, which would be a mistake in the declarations above.
+	if (!graph.Compile(report.Compiled)) {
+		assert(false);
+	}
+	return report;
+}
+
+template <typename RecordT>
+DxCommandList* DxRenderer::RecordParallelPass(DxCommandList* cl, const RecordingChunk* chunks, uint32 numChunks, const RecordT& record, float& outRecordTime) {
+	outRecordTime = 0.f;
+	if (numChunks == 0) {
+		return cl;
+	}
+
+	DxContext& dxContext = DxContext::Instance();
+
+	for (uint32 c = 0; c < numChunks; ++c) {
+		_recordingScratch[c].Stats = {};
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	DxCommandList* commandLists[MAX_NUM_RECORDING_CHUNKS];
+	RecordChunksInParallel(chunks, numChunks,
+		[&dxContext]() {
+			DxCommandList* chunkCl = dxContext.GetFreeRenderCommandList();
+			chunkCl->SetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+			return chunkCl;
+		},
+		[this, &record](DxCommandList* chunkCl, RecordingChunk chunk, uint32 chunkIndex) {
+			record(chunkCl, chunk, _recordingScratch[chunkIndex]);
+		},
+		commandLists);
+
+	auto end = std::chrono::high_resolution_clock::now();
+	outRecordTime = std::chrono::duration<float, std::milli>(end - start).count();
+
+	// Everything recorded before the pass goes first, then the chunks in order. The queue sees the same command stream as with serial recording.
+	dxContext.ExecuteCommandList(cl);
+	for (uint32 c = 0; c < numChunks; ++c) {
+		dxContext.ExecuteCommandList(commandLists[c]);
+		AccumulateDrawStatistics(Stats, _recordingScratch[c].Stats);
+	}
+	Stats.NumRecordingChunks += numChunks;
+
+	DxCommandList* next = dxContext.GetFreeRenderCommandList();
+	next->SetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	return next;
+}
+
+void DxRenderer::RecordDepthPrepassChunk(DxCommandList* cl, RecordingChunk chunk, RecordingScratch& scratch, DxRenderTarget renderTarget, DxDynamicConstantBuffer cameraCBV) {
+	cl->SetRenderTarget(renderTarget);
+	cl->SetViewport(renderTarget.Viewport);
+
+	// The chunk indexes the concatenation of static runs, dynamic runs and animated draws.
+	uint32 numStaticRuns = (uint32)_staticDepthOnlyRuns.size();
+	uint32 numInstancedRuns = numStaticRuns + (uint32)_dynamicDepthOnlyRuns.size();
+	uint32 begin = chunk.First;
+	uint32 end = chunk.First + chunk.Count;
+
+	// Static and dynamic draws share the instanced pipeline.
+	if (begin < numInstancedRuns) {
+		cl->SetPipelineState(*_depthOnlyPipeline.Pipeline);
+		cl->SetGraphicsRootSignature(*_depthOnlyPipeline.RootSignature);
+
+		cl->SetGraphicsDynamicConstantBuffer(DepthOnlyRsInstancedCamera, cameraCBV);
+	}
+
+	// Static.
+	if (begin < numStaticRuns) {
+		DX_PROFILE_BLOCK(cl, "Static");
+
+		const auto& drawCalls = _opaqueRenderPass->_staticDepthOnlyDrawCalls;
+		for (uint32 r = begin, rEnd = Min(end, numStaticRuns); r < rEnd; ++r) {
+			const InstanceRun& run = _staticDepthOnlyRuns[r];
+
+			D3D12_GPU_VIRTUAL_ADDRESS instancesAddress;
+			DepthOnlyInstance* instances = AllocateInstanceData<DepthOnlyInstance>(cl, run.Count, instancesAddress);
+			for (uint32 j = 0; j < run.Count; ++j) {
+				const auto& dc = drawCalls[run.First + j];
+				const mat4& m = dc.Transform;
+				instances[j] = { _jitteredCamera.ViewProj * m, _jitteredCamera.PrevFrameViewProj * m, (uint32)dc.ObjectID };
+			}
+
+			const auto& dc = drawCalls[run.First];
+			const SubmeshInfo& submesh = dc.Submesh;
+
+			cl->SetRootGraphicsSRV(DepthOnlyRsInstances, instancesAddress);
+
+			cl->SetVertexBuffer(0, dc.VertexBuffer);
+			cl->SetIndexBuffer(dc.IndexBuffer);
+			cl->DrawIndexed(submesh.NumTriangles * 3, run.Count, submesh.FirstTriangle * 3, submesh.BaseVertex, 0);
+			++scratch.Stats.NumDrawCalls;
+		}
+	}
+
+	// Dynamic.
+	if (begin < numInstancedRuns and end > numStaticRuns) {
+		DX_PROFILE_BLOCK(cl, "Dynamic");
+
+		const auto& drawCalls = _opaqueRenderPass->_dynamicDepthOnlyDrawCalls;
+		for (uint32 r = Max(begin, numStaticRuns), rEnd = Min(end, numInstancedRuns); r < rEnd; ++r) {
+			const InstanceRun& run = _dynamicDepthOnlyRuns[r - numStaticRuns];
+
+			D3D12_GPU_VIRTUAL_ADDRESS instancesAddress;
+			DepthOnlyInstance* instances = AllocateInstanceData<DepthOnlyInstance>(cl, run.Count, instancesAddress);
+			for (uint32 j = 0; j < run.Count; ++j) {
+				const auto& dc = drawCalls[run.First + j];
+				instances[j] = { _jitteredCamera.ViewProj * dc.Transform, _jitteredCamera.PrevFrameViewProj * dc.PrevFrameTransform, (uint32)dc.ObjectID };
+			}
+
+			const auto& dc = drawCalls[run.First];
+			const SubmeshInfo& submesh = dc.Submesh;
+
+			cl->SetRootGraphicsSRV(DepthOnlyRsInstances, instancesAddress);
+
+			cl->SetVertexBuffer(0, dc.VertexBuffer);
+			cl->SetIndexBuffer(dc.IndexBuffer);
+			cl->DrawIndexed(submesh.NumTriangles * 3, run.Count, submesh.FirstTriangle * 3, submesh.BaseVertex, 0);
+			++scratch.Stats.NumDrawCalls;
+		}
+	}
+
+	// Animated.
+	if (end > numInstancedRuns) {
+		DX_PROFILE_BLOCK(cl, "Animated");
+
+		cl->SetPipelineState(*_animatedDepthOnlyPipeline.Pipeline);
+		cl->SetGraphicsRootSignature(*_animatedDepthOnlyPipeline.RootSignature);
+
+		cl->SetGraphicsDynamicConstantBuffer(DepthOnlyRsCamera, cameraCBV);
+
+		const auto& drawCalls = _opaqueRenderPass->_animatedDepthOnlyDrawCalls;
+		for (uint32 i = Max(begin, numInstancedRuns) - numInstancedRuns; i < end - numInstancedRuns; ++i) {
+			const auto& dc = drawCalls[i];
+			const mat4& m = dc.Transform;
+			const mat4& prevFrameM = dc.PrevFrameTransform;
+			const SubmeshInfo& submesh = dc.Submesh;
+			const SubmeshInfo& prevFrameSubmesh = dc.PrevFrameSubmesh;
+			const Ptr<DxVertexBuffer>& prevFrameVertexBuffer = dc.PrevFrameVertexBuffer;
+
+			cl->SetGraphics32BitConstants(DepthOnlyRsObjectId, (uint32)dc.ObjectID);
+			cl->SetGraphics32BitConstants(DepthOnlyRsMvp, DepthOnlyTransformCb{ _jitteredCamera.ViewProj * m, _jitteredCamera.PrevFrameViewProj * prevFrameM });
+			cl->SetRootGraphicsSRV(DepthOnlyRsPrevFramePositions, prevFrameVertexBuffer->GpuVirtualAddress + prevFrameSubmesh.BaseVertex * prevFrameVertexBuffer->ElementSize);
+
+			cl->SetVertexBuffer(0, dc.VertexBuffer);
+			cl->SetIndexBuffer(dc.IndexBuffer);
+			cl->DrawIndexed(submesh.NumTriangles * 3, 1, submesh.FirstTriangle * 3, submesh.BaseVertex, 0);
+			++scratch.Stats.NumDrawCalls;
+		}
+	}
+}
+
+void DxRenderer::PrepareShadowViews(const vec4* sunViewports, const vec4* spotLightViewports, const vec4 (*pointLightViewports)[2]) {
+	_shadowViews.clear();
+	_staticShadowViews.clear();
+	_shadowMapClearRects.clear();
+	_staticShadowMapClearRects.clear();
+	_shadowMapCopyViewports.clear();
+
+	_shadowMapUpdateTracker.BeginFrame();
+	uint32 numDrawsSkipped = 0;
+
+	// Every viewport in the shadow map is one unit of work. Its weight is the number of draws recorded for it.
+	// The sun cascades follow the camera, so they are always rendered from scratch.
+	if (_sunShadowRenderPass) {
+		uint32 numDraws = 0;
+		for (uint32 i = 0; i < _sun.NumShadowCascades; ++i) {
+			numDraws += (uint32)_sunShadowRenderPass->_drawCalls[i].size(); // Cascade i also renders the draws of all lower cascades.
+			_shadowViews.push_back({ EShadowViewSunCascade, i, numDraws, false });
+			_shadowMapClearRects.push_back(GetViewportRect(sunViewports[i]));
+		}
+	}
+
+	auto addLight = [this, &numDrawsSkipped](EShadowViewType type, uint32 index, EShadowMapUpdate update, uint32 numStaticDraws, uint32 numDynamicDraws, const vec4* viewports, uint32 numViewports) {
+		if (update == EShadowMapUpdateNone) {
+			numDrawsSkipped += (numStaticDraws + numDynamicDraws) * numViewports;
+			return;
+		}
+
+		if (update == EShadowMapUpdateFull) {
+			for (uint32 v = 0; v < numViewports; ++v) {
+				_staticShadowMapClearRects.push_back(GetViewportRect(viewports[v]));
+			}
+			if (numStaticDraws > 0) {
+				_staticShadowViews.push_back({ type, index, numStaticDraws * numViewports, true });
+			}
+		}
+		else {
+			numDrawsSkipped += numStaticDraws * numViewports;
+		}
+
+		for (uint32 v = 0; v < numViewports; ++v) {
+			_shadowMapCopyViewports.push_back(viewports[v]);
+		}
+		if (numDynamicDraws > 0) {
+			_shadowViews.push_back({ type, index, numDynamicDraws * numViewports, false });
+		}
+	};
+
+	for (uint32 i = 0; i < _numSpotLightShadowRenderPasses; ++i) {
+		const SpotShadowRenderPass* pass = _spotLightShadowRenderPasses[i];
+		const vec4& viewport = spotLightViewports[i];
+		if (viewport.z <= 0.f) {
+			continue; // The light got no space in the shadow map.
+		}
+
+		ShadowMapHashes hashes;
+		hashes.Light = HashShadowMapValue(HashShadowMapValue(SHADOW_MAP_HASH_SEED, pass->ViewProjMatrix), viewport);
+		hashes.StaticCasters = HashShadowCasters(pass->_staticDrawCalls);
+		hashes.DynamicCasters = HashShadowCasters(pass->_dynamicDrawCalls);
+		hashes.NumDynamicCasters = (uint32)pass->_dynamicDrawCalls.size();
+
+		uint64 id = ((uint64)EShadowViewSpotLight << 32) | i;
+		EShadowMapUpdate update = _shadowMapUpdateTracker.Update(id, hashes, pass->ViewportWasCached and Settings.CacheShadowMaps);
+		addLight(EShadowViewSpotLight, i, update, (uint32)pass->_staticDrawCalls.size(), (uint32)pass->_dynamicDrawCalls.size(), &viewport, 1);
+	}
+
+	for (uint32 i = 0; i < numPointLightShadowRenderPasses; ++i) {
+		const PointShadowRenderPass* pass = _pointLightShadowRenderPasses[i];
+		const vec4* viewports = pointLightViewports[i];
+		if (viewports[0].z <= 0.f or viewports[1].z <= 0.f) {
+			continue;
+		}
+
+		ShadowMapHashes hashes;
+		hashes.Light = HashShadowMapValue(SHADOW_MAP_HASH_SEED, pass->LightPosition);
+		hashes.Light = HashShadowMapValue(hashes.Light, pass->MaxDistance);
+		hashes.Light = HashShadowMapValue(hashes.Light, viewports[0]);
+		hashes.Light = HashShadowMapValue(hashes.Light, viewports[1]);
+		hashes.StaticCasters = HashShadowCasters(pass->_staticDrawCalls);
+		hashes.DynamicCasters = HashShadowCasters(pass->_dynamicDrawCalls);
+		hashes.NumDynamicCasters = (uint32)pass->_dynamicDrawCalls.size();
+
+		uint64 id = ((uint64)EShadowViewPointLight << 32) | i;
+		EShadowMapUpdate update = _shadowMapUpdateTracker.Update(id, hashes, pass->ViewportWasCached and Settings.CacheShadowMaps);
+		addLight(EShadowViewPointLight, i, update, (uint32)pass->_staticDrawCalls.size(), (uint32)pass->_dynamicDrawCalls.size(), viewports, 2);
+	}
+
+	Stats.NumShadowMapFullUpdates = _shadowMapUpdateTracker.Stats.NumFullUpdates;
+	Stats.NumShadowMapDynamicUpdates = _shadowMapUpdateTracker.Stats.NumDynamicUpdates;
+	Stats.NumShadowMapsSkipped = _shadowMapUpdateTracker.Stats.NumSkippedUpdates;
+	Stats.NumShadowDrawsSkipped = numDrawsSkipped;
+}
+
+void DxRenderer::RecordShadowChunk(DxCommandList* cl, RecordingChunk chunk, RecordingScratch& scratch, const ShadowView* views, DxRenderTarget renderTarget, const vec4* sunViewports, const vec4* spotLightViewports, const vec4 (*pointLightViewports)[2]) {
+	cl->SetRenderTarget(renderTarget);
+
+	const DxPipeline* lastPipeline = nullptr;
+
+	const char* groupNames[] = { "Sun", "Spot lights", "Point lights" };
+	const char* openGroup = nullptr;
+
+	for (uint32 i = chunk.First; i < chunk.First + chunk.Count; ++i) {
+		const ShadowView& view = views[i];
+
+		// The views are ordered by type. A group which spans several chunks shows up once per chunk.
+		if (groupNames[view.Type] != openGroup) {
+			if (openGroup) {
+				DX_PROFILE_BLOCK_END(cl, openGroup);
+			}
+			openGroup = groupNames[view.Type];
+			DX_PROFILE_BLOCK_BEGIN(cl, openGroup);
+		}
+
+		const DxPipeline* pipeline = (view.Type == EShadowViewPointLight) ? &_pointLightShadowPipeline : &_shadowPipeline;
+		if (pipeline != lastPipeline) {
+			cl->SetPipelineState(*pipeline->Pipeline);
+			cl->SetGraphicsRootSignature(*pipeline->RootSignature);
+			lastPipeline = pipeline;
+		}
+
+		switch (view.Type) {
+			case EShadowViewSunCascade: {
+				DX_PROFILE_BLOCK(cl, (view.Index == 0) ? "First cascade" : (view.Index == 1) ? "Second cascade" : (view.Index == 2) ? "Third cascade" : "Fourth cascade");
+
+				vec4 vp = sunViewports[view.Index];
+				cl->SetViewport(vp.x, vp.y, vp.z, vp.w);
+
+				for (uint32 cascade = 0; cascade <= view.Index; ++cascade) {
+					RenderShadowDrawCalls(cl, scratch, _sunShadowRenderPass->_drawCalls[cascade], _sun.ViewProj[view.Index]);
+				}
+				break;
+			}
+			case EShadowViewSpotLight: {
+				DX_PROFILE_BLOCK(cl, "Single light");
+
+				vec4 vp = spotLightViewports[view.Index];
+				cl->SetViewport(vp.x, vp.y, vp.z, vp.w);
+
+				const SpotShadowRenderPass* pass = _spotLightShadowRenderPasses[view.Index];
+				RenderShadowDrawCalls(cl, scratch, view.StaticLayer ? pass->_staticDrawCalls : pass->_dynamicDrawCalls, pass->ViewProjMatrix);
+				break;
+			}
+			case EShadowViewPointLight: {
+				DX_PROFILE_BLOCK(cl, "Single light");
+
+				const PointShadowRenderPass* pass = _pointLightShadowRenderPasses[view.Index];
+				const auto& drawCalls = view.StaticLayer ? pass->_staticDrawCalls : pass->_dynamicDrawCalls;
+				scratch.Stats.NumDrawCallsMerged += 2 * FindInstanceRuns(drawCalls.data(), (uint32)drawCalls.size(), SameGeometry{}, scratch.InstanceRuns);
+
+				// The model matrices are the same for both hemispheres, so they are uploaded only once.
+				scratch.InstanceAddresses.clear();
+				for (const InstanceRun& run : scratch.InstanceRuns) {
+					D3D12_GPU_VIRTUAL_ADDRESS instancesAddress;
+					mat4* instances = AllocateInstanceData<mat4>(cl, run.Count, instancesAddress);
+					for (uint32 j = 0; j < run.Count; ++j) {
+						instances[j] = drawCalls[run.First + j].Transform;
+					}
+					scratch.InstanceAddresses.push_back(instancesAddress);
+				}
+
+				for (uint32 v = 0; v < 2; ++v) {
+					DX_PROFILE_BLOCK(cl, (v == 0) ? "First hemisphere" : "Second hemisphere");
+
+					vec4 vp = pointLightViewports[view.Index][v];
+					cl->SetViewport(vp.x, vp.y, vp.z, vp.w);
+
+					float flip = (v == 0) ? 1.f : -1.f;
+					cl->SetGraphics32BitConstants(PointShadowRsCb, PointShadowCb{ pass->LightPosition, pass->MaxDistance, flip });
+
+					for (uint32 r = 0; r < (uint32)scratch.InstanceRuns.size(); ++r) {
+						const InstanceRun& run = scratch.InstanceRuns[r];
+						const auto& dc = drawCalls[run.First];
+						const SubmeshInfo& submesh = dc.Submesh;
+
+						cl->SetRootGraphicsSRV(PointShadowRsInstances, scratch.InstanceAddresses[r]);
+
+						cl->SetVertexBuffer(0, dc.VertexBuffer);
+						cl->SetIndexBuffer(dc.IndexBuffer);
+
+						cl->DrawIndexed(submesh.NumTriangles * 3, run.Count, submesh.FirstTriangle * 3, submesh.BaseVertex, 0);
+						++scratch.Stats.NumDrawCalls;
+					}
+				}
+				break;
+			}
+		}
+	}
+
+	if (openGroup) {
+		DX_PROFILE_BLOCK_END(cl, openGroup);
+	}
+}
+
+void DxRenderer::RecordOpaqueChunk(DxCommandList* cl, RecordingChunk chunk, RecordingScratch& scratch, DxRenderTarget renderTarget, const CommonMaterialInfo& materialInfo) {
+	cl->SetRenderTarget(renderTarget);
+	cl->SetViewport(renderTarget.Viewport);
+
+	// Every chunk starts on a fresh command list, so the first draw of a chunk binds everything.
+	MaterialSetupFunction lastSetupFunc = 0;
+	MaterialBase* lastMaterial = nullptr;
+	DxVertexBuffer* lastVertexBuffer = nullptr;
+	DxIndexBuffer* lastIndexBuffer = nullptr;
+
+	RenderStatistics& stats = scratch.Stats;
+	const auto& drawCalls = _opaqueRenderPass->_drawCalls;
+
+	for (uint32 r = chunk.First; r < chunk.First + chunk.Count; ++r)
+	{
+		const InstanceRun& run = _opaqueRuns[r];
+		const auto& dc = drawCalls[run.First];
+		const SubmeshInfo& submesh = dc.Submesh;
+
+		// Materials with instancing support always use the instanced pipeline, even for single draws. This avoids switching back and forth.
+		MaterialSetupFunction setupFunc = dc.InstancedMaterialSetup ? dc.InstancedMaterialSetup : dc.MaterialSetup;
+
+		// Draws are sorted by state, so most of these binds are redundant.
+		if (setupFunc != lastSetupFunc)
+		{
+			setupFunc(cl, materialInfo);
+			lastSetupFunc = setupFunc;
+			lastMaterial = nullptr; // New root signature, material parameters have to be bound again.
+			++stats.NumStateChanges;
+		}
+		else {
+			++stats.NumStateChangesSaved;
+		}
+
+		if (dc.Material.get() != lastMaterial) {
+			dc.Material->PrepareForRendering(cl);
+			lastMaterial = dc.Material.get();
+			++stats.NumStateChanges;
+		}
+		else {
+			++stats.NumStateChangesSaved;
+		}
+
+		if (dc.InstancedMaterialSetup) {
+			D3D12_GPU_VIRTUAL_ADDRESS instancesAddress;
+			TransformCb* instances = AllocateInstanceData<TransformCb>(cl, run.Count, instancesAddress);
+			for (uint32 j = 0; j < run.Count; ++j) {
+				const mat4& m = drawCalls[run.First + j].Transform;
+				instances[j] = { _jitteredCamera.ViewProj * m, m };
+			}
+			cl->SetRootGraphicsSRV(0, instancesAddress);
+		}
+		else {
+			const mat4& m = dc.Transform;
+			cl->SetGraphics32BitConstants(0, TransformCb{ _jitteredCamera.ViewProj * m, m });
+		}
+
+		if (dc.VertexBuffer.get() != lastVertexBuffer) {
+			cl->SetVertexBuffer(0, dc.VertexBuffer);
+			lastVertexBuffer = dc.VertexBuffer.get();
+			++stats.NumStateChanges;
+		}
+		else {
+			++stats.NumStateChangesSaved;
+		}
+
+		if (dc.IndexBuffer.get() != lastIndexBuffer) {
+			cl->SetIndexBuffer(dc.IndexBuffer);
+			lastIndexBuffer = dc.IndexBuffer.get();
+			++stats.NumStateChanges;
+		}
+		else {
+			++stats.NumStateChangesSaved;
+		}
+
+		cl->DrawIndexed(submesh.NumTriangles * 3, run.Count, submesh.FirstTriangle * 3, submesh.BaseVertex, 0);
+		++stats.NumDrawCalls;
+	}
+}
+
+void DxRenderer::RecordTransparentChunk(DxCommandList* cl, RecordingChunk chunk, RecordingScratch& scratch, DxRenderTarget renderTarget, const CommonMaterialInfo& materialInfo) {
+	cl->SetRenderTarget(renderTarget);
+	cl->SetViewport(renderTarget.Viewport);
+
+	MaterialSetupFunction lastSetupFunc = 0;
+	MaterialBase* lastMaterial = nullptr;
+	DxVertexBuffer* lastVertexBuffer = nullptr;
+	DxIndexBuffer* lastIndexBuffer = nullptr;
+
+	RenderStatistics& stats = scratch.Stats;
+	const auto& drawCalls = _transparentRenderPass->_drawCalls;
+
+	for (uint32 i = chunk.First; i < chunk.First + chunk.Count; ++i) {
+		const auto& dc = drawCalls[i];
+		const mat4& m = dc.Transform;
+		const SubmeshInfo& submesh = dc.Submesh;
+
+		// Draws are sorted by state, so most of these binds are redundant.
+		if (dc.MaterialSetup != lastSetupFunc)
+		{
+			dc.MaterialSetup(cl, materialInfo);
+			lastSetupFunc = dc.MaterialSetup;
+			lastMaterial = nullptr; // New root signature, material parameters have to be bound again.
+			++stats.NumStateChanges;
+		}
+		else {
+			++stats.NumStateChangesSaved;
+		}
+
+		if (dc.Material.get() != lastMaterial) {
+			dc.Material->PrepareForRendering(cl);
+			lastMaterial = dc.Material.get();
+			++stats.NumStateChanges;
+		}
+		else {
+			++stats.NumStateChangesSaved;
+		}
+
+		cl->SetGraphics32BitConstants(0, TransformCb{ _unjitteredCamera.ViewProj * m, m });
+
+		if (dc.VertexBuffer.get() != lastVertexBuffer) {
+			cl->SetVertexBuffer(0, dc.VertexBuffer);
+			lastVertexBuffer = dc.VertexBuffer.get();
+			++stats.NumStateChanges;
+		}
+		else {
+			++stats.NumStateChangesSaved;
+		}
+
+		if (dc.IndexBuffer.get() != lastIndexBuffer) {
+			cl->SetIndexBuffer(dc.IndexBuffer);
+			lastIndexBuffer = dc.IndexBuffer.get();
+			++stats.NumStateChanges;
+		}
+		else {
+			++stats.NumStateChangesSaved;
+		}
+
+		cl->DrawIndexed(submesh.NumTriangles * 3, 1, submesh.FirstTriangle * 3, submesh.BaseVertex, 0);
+		++stats.NumDrawCalls;
+	}
+}
+
+void DxRenderer::RenderShadowDrawCalls(DxCommandList* cl, RecordingScratch& scratch, const std::vector<ShadowRenderPass::DrawCall>& drawCalls, const mat4& viewProj) {
+	scratch.Stats.NumDrawCallsMerged += FindInstanceRuns(drawCalls.data(), (uint32)drawCalls.size(), SameGeometry{}, scratch.InstanceRuns);
+
+	for (const InstanceRun& run : scratch.InstanceRuns) {
+		D3D12_GPU_VIRTUAL_ADDRESS instancesAddress;
+		mat4* instances = AllocateInstanceData<mat4>(cl, run.Count, instancesAddress);
+		for (uint32 j = 0; j < run.Count; ++j) {
+			instances[j] = viewProj * drawCalls[run.First + j].Transform;
+		}
+
+		const auto& dc = drawCalls[run.First];
+		const SubmeshInfo& submesh = dc.Submesh;
+
+		cl->SetRootGraphicsSRV(ShadowRsInstances, instancesAddress);
+
+		cl->SetVertexBuffer(0, dc.VertexBuffer);
+		cl->SetIndexBuffer(dc.IndexBuffer);
+
+		cl->DrawIndexed(submesh.NumTriangles * 3, run.Count, submesh.FirstTriangle * 3, submesh.BaseVertex, 0);
+		++scratch.Stats.NumDrawCalls;
+	}
+}
+
 void DxRenderer::GaussianBlur(DxCommandList *cl, Ptr<DxTexture> inputOutput, Ptr<DxTexture> temp, uint32 inputMip, uint32 outputMip, GaussianBlurKernelSize kernel, uint32 numIterations) {
 	DX_PROFILE_BLOCK(cl, "Gaussian Blur");
 
@@ -720,8 +1438,6 @@ void DxRenderer::EndFrame(const UserInput &input) {
 		frameResultState = D3D12_RESOURCE_STATE_RENDER_TARGET;
 	}
 
-	DxBarrierBatcher(cl).TransitionBegin(FrameResult, frameResultState, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-
 	if (Mode == ERendererModeRasterized) {
 		cl->ClearDepthAndStencil(_depthStencilBuffer->DsvHandle);
 		cl->SetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
@@ -730,86 +1446,49 @@ void DxRenderer::EndFrame(const UserInput &input) {
 			dxContext.RenderQueue.WaitForOtherQueue(dxContext.ComputeQueue); // Wait for GPU skinning.
 		}
 
+		Stats = {};
+		if (_opaqueRenderPass) {
+			_opaqueRenderPass->Sort(_jitteredCamera.Position.xyz, _jitteredCamera.Forward.xyz);
+			Stats.OpaqueSortTime = _opaqueRenderPass->SortTime;
+		}
+		if (_transparentRenderPass) {
+			_transparentRenderPass->Sort(_unjitteredCamera.Position.xyz, _unjitteredCamera.Forward.xyz);
+			Stats.TransparentSortTime = _transparentRenderPass->SortTime;
+		}
+		if (_sunShadowRenderPass) {
+			_sunShadowRenderPass->Sort();
+		}
+		for (uint32 i = 0; i < _numSpotLightShadowRenderPasses; ++i) {
+			_spotLightShadowRenderPasses[i]->Sort();
+		}
+		for (uint32 i = 0; i < numPointLightShadowRenderPasses; ++i) {
+			_pointLightShadowRenderPasses[i]->Sort();
+		}
+
+		// The depth pre-pass, shadow, opaque and transparent passes are split into chunks, which are recorded into separate command lists on the job system.
+		// Split barriers must not stay open across these command lists, so all transitions around them are complete.
+		uint32 maxNumRecordingChunks = Settings.ParallelCommandRecording ? MAX_NUM_RECORDING_CHUNKS : 1;
+		RecordingChunk recordingChunks[MAX_NUM_RECORDING_CHUNKS];
+
 		// ----------------------------------------
 		// DEPTH-ONLY PASS
 		// ----------------------------------------
 		DxRenderTarget depthOnlyRenderTarget({ _screenVelocitiesTexture, _objectIDsTexture }, _depthStencilBuffer);
-		cl->SetRenderTarget(depthOnlyRenderTarget);
-		cl->SetViewport(depthOnlyRenderTarget.Viewport);
 #if 1
-		{
-			DX_PROFILE_BLOCK(cl, "Depth pre-pass");
+		if (_opaqueRenderPass) {
+			DX_PROFILE_BLOCK_BEGIN(cl, "Depth pre-pass");
 
-			// Static.
-			if (_opaqueRenderPass && _opaqueRenderPass->_staticDepthOnlyDrawCalls.size() > 0) {
-				DX_PROFILE_BLOCK(cl, "Static");
+			Stats.NumDrawCallsMerged += FindInstanceRuns(_opaqueRenderPass->_staticDepthOnlyDrawCalls.data(), (uint32)_opaqueRenderPass->_staticDepthOnlyDrawCalls.size(), SameGeometry{}, _staticDepthOnlyRuns);
+			Stats.NumDrawCallsMerged += FindInstanceRuns(_opaqueRenderPass->_dynamicDepthOnlyDrawCalls.data(), (uint32)_opaqueRenderPass->_dynamicDepthOnlyDrawCalls.size(), SameGeometry{}, _dynamicDepthOnlyRuns);
 
-				cl->SetPipelineState(*_depthOnlyPipeline.Pipeline);
-				cl->SetGraphicsRootSignature(*_depthOnlyPipeline.RootSignature);
+			uint32 numItems = (uint32)(_staticDepthOnlyRuns.size() + _dynamicDepthOnlyRuns.size() + _opaqueRenderPass->_animatedDepthOnlyDrawCalls.size());
+			uint32 numChunks = SplitIntoRecordingChunks(numItems, MIN_NUM_DRAWS_PER_RECORDING_CHUNK, maxNumRecordingChunks, recordingChunks);
 
-				cl->SetGraphicsDynamicConstantBuffer(DepthOnlyRsCamera, materialInfo.CameraCBV);
+			cl = RecordParallelPass(cl, recordingChunks, numChunks, [&](DxCommandList* chunkCl, RecordingChunk chunk, RecordingScratch& scratch) {
+				RecordDepthPrepassChunk(chunkCl, chunk, scratch, depthOnlyRenderTarget, materialInfo.CameraCBV);
+			}, Stats.DepthPrepassRecordTime);
 
-				for (const auto& dc : _opaqueRenderPass->_staticDepthOnlyDrawCalls) {
-					const mat4& m = dc.Transform;
-					const SubmeshInfo& submesh = dc.Submesh;
-
-					cl->SetGraphics32BitConstants(DepthOnlyRsObjectId, (uint32)dc.ObjectID);
-					cl->SetGraphics32BitConstants(DepthOnlyRsMvp, DepthOnlyTransformCb{ _jitteredCamera.ViewProj * m, _jitteredCamera.PrevFrameViewProj * m });
-
-					cl->SetVertexBuffer(0, dc.VertexBuffer);
-					cl->SetIndexBuffer(dc.IndexBuffer);
-					cl->DrawIndexed(submesh.NumTriangles * 3, 1, submesh.FirstTriangle * 3, submesh.BaseVertex, 0);
-				}
-			}
-
-			// Dynamic.
-			if (_opaqueRenderPass && _opaqueRenderPass->_dynamicDepthOnlyDrawCalls.size() > 0) {
-				DX_PROFILE_BLOCK(cl, "Dynamic");
-
-				cl->SetPipelineState(*_depthOnlyPipeline.Pipeline);
-				cl->SetGraphicsRootSignature(*_depthOnlyPipeline.RootSignature);
-
-				cl->SetGraphicsDynamicConstantBuffer(DepthOnlyRsCamera, materialInfo.CameraCBV);
-
-				for (const auto& dc : _opaqueRenderPass->_dynamicDepthOnlyDrawCalls) {
-					const mat4& m = dc.Transform;
-					const mat4& prevFrameM = dc.PrevFrameTransform;
-					const SubmeshInfo& submesh = dc.Submesh;
-
-					cl->SetGraphics32BitConstants(DepthOnlyRsObjectId, (uint32)dc.ObjectID);
-					cl->SetGraphics32BitConstants(DepthOnlyRsMvp, DepthOnlyTransformCb{ _jitteredCamera.ViewProj * m, _jitteredCamera.PrevFrameViewProj * prevFrameM });
-
-					cl->SetVertexBuffer(0, dc.VertexBuffer);
-					cl->SetIndexBuffer(dc.IndexBuffer);
-					cl->DrawIndexed(submesh.NumTriangles * 3, 1, submesh.FirstTriangle * 3, submesh.BaseVertex, 0);
-				}
-			}
-
-			// Animated.
-			if (_opaqueRenderPass && _opaqueRenderPass->_animatedDepthOnlyDrawCalls.size() > 0) {
-				DX_PROFILE_BLOCK(cl, "Animated");
-
-				cl->SetPipelineState(*_animatedDepthOnlyPipeline.Pipeline);
-				cl->SetGraphicsRootSignature(*_animatedDepthOnlyPipeline.RootSignature);
-
-				cl->SetGraphicsDynamicConstantBuffer(DepthOnlyRsCamera, materialInfo.CameraCBV);
-
-				for (const auto& dc : _opaqueRenderPass->_animatedDepthOnlyDrawCalls) {
-					const mat4& m = dc.Transform;
-					const mat4& prevFrameM = dc.PrevFrameTransform;
-					const SubmeshInfo& submesh = dc.Submesh;
-					const SubmeshInfo& prevFrameSubmesh = dc.PrevFrameSubmesh;
-					const Ptr<DxVertexBuffer>& prevFrameVertexBuffer = dc.PrevFrameVertexBuffer;
-
-					cl->SetGraphics32BitConstants(DepthOnlyRsObjectId, (uint32)dc.ObjectID);
-					cl->SetGraphics32BitConstants(DepthOnlyRsMvp, DepthOnlyTransformCb{ _jitteredCamera.ViewProj * m, _jitteredCamera.PrevFrameViewProj * prevFrameM });
-					cl->SetRootGraphicsSRV(DepthOnlyRsPrevFramePositions, prevFrameVertexBuffer->GpuVirtualAddress + prevFrameSubmesh.BaseVertex * prevFrameVertexBuffer->ElementSize);
-
-					cl->SetVertexBuffer(0, dc.VertexBuffer);
-					cl->SetIndexBuffer(dc.IndexBuffer);
-					cl->DrawIndexed(submesh.NumTriangles * 3, 1, submesh.FirstTriangle * 3, submesh.BaseVertex, 0);
-				}
-			}
+			DX_PROFILE_BLOCK_END(cl, "Depth pre-pass");
 		}
 		DxBarrierBatcher(cl).Transition(_depthStencilBuffer, D3D12_RESOURCE_STATE_DEPTH_WRITE, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
 #endif
@@ -886,7 +1565,7 @@ void DxRenderer::EndFrame(const UserInput &input) {
 
 			DxBarrierBatcher(cl)
 			.UAV(_linearDepthBuffer)
-			.TransitionBegin(_linearDepthBuffer, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE)
+			.Transition(_linearDepthBuffer, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE)
 			.Transition(_depthStencilBuffer, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_DEPTH_WRITE);
 		}
 #endif
@@ -896,96 +1575,53 @@ void DxRenderer::EndFrame(const UserInput &input) {
 		// ----------------------------------------
 #if 1
 		{
-			DX_PROFILE_BLOCK(cl, "Shadow map pass");
+			DX_PROFILE_BLOCK_BEGIN(cl, "Shadow map pass");
 
 			DxRenderTarget shadowRenderTarget({}, _shadowMap);
+			DxRenderTarget staticShadowRenderTarget({}, _staticShadowMapCache);
 
-			cl->ClearDepth(shadowRenderTarget);
-
-			cl->SetPipelineState(*_shadowPipeline.Pipeline);
-			cl->SetGraphicsRootSignature(*_shadowPipeline.RootSignature);
-
-			cl->SetRenderTarget(shadowRenderTarget);
-			cl->ClearDepth(shadowRenderTarget);
+			PrepareShadowViews(sunCPUShadowViewports, spotLightViewports, pointLightViewports);
 
-			{
-				DX_PROFILE_BLOCK(cl, "Sun");
+			// Only the tiles which are rendered from scratch are cleared. All others are either kept from the last frame or restored from the cache.
+			cl->ClearDepth(shadowRenderTarget, _shadowMapClearRects.data(), (uint32)_shadowMapClearRects.size());
+			cl->ClearDepth(staticShadowRenderTarget, _staticShadowMapClearRects.data(), (uint32)_staticShadowMapClearRects.size());
 
-				if (_sunShadowRenderPass) {
-					for (uint32 i = 0; i < _sun.NumShadowCascades; ++i) {
-						DX_PROFILE_BLOCK(cl, (i == 0) ? "First cascade" : (i == 1) ? "Second cascade" : (i == 2) ? "Third cascade" : "Fourth cascade");
+			// Static casters of lights which moved or whose static casters moved, into the cache.
+			uint32 numChunks = SplitIntoRecordingChunks((uint32)_staticShadowViews.size(), [this](uint32 i) { return _staticShadowViews[i].NumDraws; },
+				MIN_NUM_DRAWS_PER_RECORDING_CHUNK, maxNumRecordingChunks, recordingChunks);
 
-						vec4 vp = sunCPUShadowViewports[i];
-						cl->SetViewport(vp.x, vp.y, vp.z, vp.w);
+			float staticRecordTime;
+			cl = RecordParallelPass(cl, recordingChunks, numChunks, [&](DxCommandList* chunkCl, RecordingChunk chunk, RecordingScratch& scratch) {
+				RecordShadowChunk(chunkCl, chunk, scratch, _staticShadowViews.data(), staticShadowRenderTarget, sunCPUShadowViewports, spotLightViewports, pointLightViewports);
+			}, staticRecordTime);
 
-						for (uint32 cascade = 0; cascade <= i; ++cascade) {
-							for (const auto& dc : _sunShadowRenderPass->_drawCalls[cascade]) {
-								const mat4& m = dc.Transform;
-								const SubmeshInfo& submesh = dc.Submesh;
-								cl->SetGraphics32BitConstants(ShadowRsMvp, _sun.ViewProj[i] * m);
+			// Restore the static casters of every light which gets new dynamic shadows.
+			if (_shadowMapCopyViewports.size() > 0) {
+				DxBarrierBatcher(cl).Transition(_staticShadowMapCache, D3D12_RESOURCE_STATE_DEPTH_WRITE, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
 
-								cl->SetVertexBuffer(0, dc.VertexBuffer);
-								cl->SetIndexBuffer(dc.IndexBuffer);
+				cl->SetRenderTarget(shadowRenderTarget);
+				cl->SetPipelineState(*_shadowMapCopyPipeline.Pipeline);
+				cl->SetGraphicsRootSignature(*_shadowMapCopyPipeline.RootSignature);
+				cl->SetDescriptorHeapSRV(ShadowMapCopyRsTexture, 0, _staticShadowMapCache);
 
-								cl->DrawIndexed(submesh.NumTriangles * 3, 1, submesh.FirstTriangle * 3, submesh.BaseVertex, 0);
-							}
-						}
-					}
+				for (const vec4& vp : _shadowMapCopyViewports) {
+					cl->SetViewport(vp.x, vp.y, vp.z, vp.w);
+					cl->DrawFullscreenTriangle();
 				}
-			}
-
-			{
-				DX_PROFILE_BLOCK(cl, "Spot lights");
 
-				for (uint32 i = 0; i < _numSpotLightShadowRenderPasses; ++i) {
-					DX_PROFILE_BLOCK(cl, "Single light");
-
-					const mat4& viewProj = _spotLightShadowRenderPasses[i]->ViewProjMatrix;
-
-					cl->SetViewport(spotLightViewports[i].x, spotLightViewports[i].y, spotLightViewports[i].z, spotLightViewports[i].w);
-
-					for (const auto& dc : _spotLightShadowRenderPasses[i]->_drawCalls) {
-						const mat4& m = dc.Transform;
-						const SubmeshInfo& submesh = dc.Submesh;
-						cl->SetGraphics32BitConstants(ShadowRsMvp, viewProj * m);
-
-						cl->SetVertexBuffer(0, dc.VertexBuffer);
-						cl->SetIndexBuffer(dc.IndexBuffer);
-
-						cl->DrawIndexed(submesh.NumTriangles * 3, 1, submesh.FirstTriangle * 3, submesh.BaseVertex, 0);
-					}
-				}
+				DxBarrierBatcher(cl).Transition(_staticShadowMapCache, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_DEPTH_WRITE);
 			}
 
-			cl->SetPipelineState(*_pointLightShadowPipeline.Pipeline);
-			cl->SetGraphicsRootSignature(*_pointLightShadowPipeline.RootSignature);
+			// Sun cascades and dynamic casters.
+			numChunks = SplitIntoRecordingChunks((uint32)_shadowViews.size(), [this](uint32 i) { return _shadowViews[i].NumDraws; },
+				MIN_NUM_DRAWS_PER_RECORDING_CHUNK, maxNumRecordingChunks, recordingChunks);
 
-			{
-				DX_PROFILE_BLOCK(cl, "Point lights");
-
-				for (uint32 i = 0; i < numPointLightShadowRenderPasses; ++i) {
-					DX_PROFILE_BLOCK(cl, "Single light");
-
-					for (uint32 v = 0; v < 2; ++v) {
-						DX_PROFILE_BLOCK(cl, (v == 0) ? "First hemisphere" : "Second hemisphere");
-
-						cl->SetViewport(pointLightViewports[i][v].x, pointLightViewports[i][v].y, pointLightViewports[i][v].z, pointLightViewports[i][v].w);
-
-						float flip = (v == 0) ? 1.f : -1.f;
+			cl = RecordParallelPass(cl, recordingChunks, numChunks, [&](DxCommandList* chunkCl, RecordingChunk chunk, RecordingScratch& scratch) {
+				RecordShadowChunk(chunkCl, chunk, scratch, _shadowViews.data(), shadowRenderTarget, sunCPUShadowViewports, spotLightViewports, pointLightViewports);
+			}, Stats.ShadowRecordTime);
+			Stats.ShadowRecordTime += staticRecordTime;
 
-						for (const auto& dc : _pointLightShadowRenderPasses[i]->_drawCalls) {
-							const mat4& m = dc.Transform;
-							const SubmeshInfo& submesh = dc.Submesh;
-							cl->SetGraphics32BitConstants(ShadowRsMvp, PointShadowTransformCb{m, _pointLightShadowRenderPasses[i]->LightPosition, _pointLightShadowRenderPasses[i]->MaxDistance, flip});
-
-							cl->SetVertexBuffer(0, dc.VertexBuffer);
-							cl->SetIndexBuffer(dc.IndexBuffer);
-
-							cl->DrawIndexed(submesh.NumTriangles * 3, 1, submesh.FirstTriangle * 3, submesh.BaseVertex, 0);
-						}
-					}
-				}
-			}
+			DX_PROFILE_BLOCK_END(cl, "Shadow map pass");
 		}
 		DxBarrierBatcher(cl).Transition(_shadowMap, D3D12_RESOURCE_STATE_DEPTH_WRITE, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
 #endif
@@ -1050,7 +1686,7 @@ void DxRenderer::EndFrame(const UserInput &input) {
 				cl->CopyTextureRegionToBuffer(_objectIDsTexture, _hoveredObjectIDReadbackBuffer, dxContext.BufferedFrameId(), (uint32)input.Mouse.X, (uint32)input.Mouse.Y, 1, 1);
 			}
 
-			DxBarrierBatcher(cl).TransitionBegin(_objectIDsTexture, D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_RENDER_TARGET);
+			DxBarrierBatcher(cl).Transition(_objectIDsTexture, D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_RENDER_TARGET);
 		}
 #endif
 
@@ -1062,29 +1698,20 @@ void DxRenderer::EndFrame(const UserInput &input) {
 		cl->SetViewport(hdrOpaqueRenderTarget.Viewport);
 #if 1
 		if (_opaqueRenderPass && _opaqueRenderPass->_drawCalls.size() > 0) {
-			DX_PROFILE_BLOCK(cl, "Main opaque light pass");
-
-			MaterialSetupFunction lastSetupFunc = 0;
+			DX_PROFILE_BLOCK_BEGIN(cl, "Main opaque light pass");
 
-			for (const auto& dc : _opaqueRenderPass->_drawCalls)
-			{
-				const mat4& m = dc.Transform;
-				const SubmeshInfo& submesh = dc.Submesh;
+			const auto& drawCalls = _opaqueRenderPass->_drawCalls;
 
-				if (dc.MaterialSetup != lastSetupFunc)
-				{
-					dc.MaterialSetup(cl, materialInfo);
-					lastSetupFunc = dc.MaterialSetup;
-				}
+			// Consecutive draws with the same material and geometry are merged, if the material has an instanced pipeline.
+			Stats.NumDrawCallsMerged += FindInstanceRuns(drawCalls.data(), (uint32)drawCalls.size(), SameMaterialAndGeometry{}, _opaqueRuns);
 
-				dc.Material->PrepareForRendering(cl);
+			uint32 numChunks = SplitIntoRecordingChunks((uint32)_opaqueRuns.size(), MIN_NUM_DRAWS_PER_RECORDING_CHUNK, maxNumRecordingChunks, recordingChunks);
 
-				cl->SetGraphics32BitConstants(0, TransformCb{ _jitteredCamera.ViewProj * m, m });
+			cl = RecordParallelPass(cl, recordingChunks, numChunks, [&](DxCommandList* chunkCl, RecordingChunk chunk, RecordingScratch& scratch) {
+				RecordOpaqueChunk(chunkCl, chunk, scratch, hdrOpaqueRenderTarget, materialInfo);
+			}, Stats.OpaqueRecordTime);
 
-				cl->SetVertexBuffer(0, dc.VertexBuffer);
-				cl->SetIndexBuffer(dc.IndexBuffer);
-				cl->DrawIndexed(submesh.NumTriangles * 3, 1, submesh.FirstTriangle * 3, submesh.BaseVertex, 0);
-			}
+			DX_PROFILE_BLOCK_END(cl, "Main opaque light pass");
 		}
 
 		DxBarrierBatcher(cl)
@@ -1097,8 +1724,7 @@ void DxRenderer::EndFrame(const UserInput &input) {
 		.TransitionEnd(_worldNormalsTexture, D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE)
 		.TransitionEnd(_screenVelocitiesTexture, D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE)
 		.Transition(_reflectanceTexture, D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE)
-		.TransitionEnd(FrameResult, frameResultState, D3D12_RESOURCE_STATE_UNORDERED_ACCESS)
-		.TransitionEnd(_linearDepthBuffer, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+		.Transition(FrameResult, frameResultState, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
 #endif
 
 		Ptr<DxTexture> hdrResult = _hdrColorTexture;
@@ -1241,12 +1867,21 @@ void DxRenderer::EndFrame(const UserInput &input) {
 		materialInfo.OpaqueDepth = _opaqueDepthBuffer;
 		materialInfo.WorldNormals = _worldNormalsTexture;
 #endif
+		// SSR history for the next frame. Done before the transparent pass, so no split barrier stays open across its command lists.
+		if (Settings.EnableSSR) {
+			DxBarrierBatcher(cl)
+			.TransitionEnd(_ssrRaycastTexture, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS) // For next frame.
+			.TransitionEnd(_ssrTemporalTextures[_ssrHistoryIndex], D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS) // For next frame.
+			.Transition(_ssrResolveTexture, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS); // For next frame.
+
+			_ssrHistoryIndex = 1 - _ssrHistoryIndex;
+		}
 #if 1
 		// ----------------------------------------
 		// TRANSPARENT LIGHT PASS
 		// ----------------------------------------
 		if (_transparentRenderPass && _transparentRenderPass->_drawCalls.size() > 0) {
-			DX_PROFILE_BLOCK(cl, "Transparent light pass");
+			DX_PROFILE_BLOCK_BEGIN(cl, "Transparent light pass");
 
 			DxBarrierBatcher(cl)
 			.Transition(hdrResult, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_RENDER_TARGET)
@@ -1254,43 +1889,18 @@ void DxRenderer::EndFrame(const UserInput &input) {
 
 			DxRenderTarget hdrTransparentRenderTarget({ hdrResult }, _depthStencilBuffer);
 
-			cl->SetRenderTarget(hdrTransparentRenderTarget);
-			cl->SetViewport(hdrTransparentRenderTarget.Viewport);
-
-			MaterialSetupFunction lastSetupFunc = 0;
-
-			for (const auto& dc : _transparentRenderPass->_drawCalls) {
-				const mat4& m = dc.Transform;
-				const SubmeshInfo& submesh = dc.Submesh;
-
-				if (dc.MaterialSetup != lastSetupFunc)
-				{
-					dc.MaterialSetup(cl, materialInfo);
-					lastSetupFunc = dc.MaterialSetup;
-				}
-
-				dc.Material->PrepareForRendering(cl);
-
-				cl->SetGraphics32BitConstants(0, TransformCb{ _unjitteredCamera.ViewProj * m, m });
-
-				cl->SetVertexBuffer(0, dc.VertexBuffer);
-				cl->SetIndexBuffer(dc.IndexBuffer);
-				cl->DrawIndexed(submesh.NumTriangles * 3, 1, submesh.FirstTriangle * 3, submesh.BaseVertex, 0);
-			}
+			// Chunks are submitted in order, so the back-to-front order of the draws is preserved.
+			uint32 numChunks = SplitIntoRecordingChunks((uint32)_transparentRenderPass->_drawCalls.size(), MIN_NUM_DRAWS_PER_RECORDING_CHUNK, maxNumRecordingChunks, recordingChunks);
 
+			cl = RecordParallelPass(cl, recordingChunks, numChunks, [&](DxCommandList* chunkCl, RecordingChunk chunk, RecordingScratch& scratch) {
+				RecordTransparentChunk(chunkCl, chunk, scratch, hdrTransparentRenderTarget, materialInfo);
+			}, Stats.TransparentRecordTime);
 
 			DxBarrierBatcher(cl)
 				.Transition(hdrResult, D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE)
 				.Transition(_depthStencilBuffer, D3D12_RESOURCE_STATE_DEPTH_WRITE, D3D12_RESOURCE_STATE_GENERIC_READ);
-		}
 
-		if (Settings.EnableSSR) {
-			DxBarrierBatcher(cl)
-			.TransitionEnd(_ssrRaycastTexture, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS) // For next frame.
-			.TransitionEnd(_ssrTemporalTextures[_ssrHistoryIndex], D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS) // For next frame.
-			.Transition(_ssrResolveTexture, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS); // For next frame.
-
-			_ssrHistoryIndex = 1 - _ssrHistoryIndex;
+			DX_PROFILE_BLOCK_END(cl, "Transparent light pass");
 		}
 #endif
 		// ----------------------------------------
@@ -1536,12 +2146,11 @@ void DxRenderer::EndFrame(const UserInput &input) {
 		.Transition(_linearDepthBuffer, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS)
 		.Transition(_opaqueDepthBuffer, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COPY_DEST)
 		.Transition(_reflectanceTexture, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_RENDER_TARGET);
-		DxBarrierBatcher(cl).TransitionEnd(_objectIDsTexture, D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_RENDER_TARGET);
 	}
 	else if (dxContext.RaytracingSupported() && _raytracer) {
 		DxBarrierBatcher(cl)
 			.Transition(_hdrColorTexture, D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_UNORDERED_ACCESS)
-			.TransitionEnd(FrameResult, frameResultState, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+			.Transition(FrameResult, frameResultState, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
 
 		{
 			DX_PROFILE_BLOCK(cl, "Raytracing");
@@ -8,6 +8,10 @@
 #include "../render/pbr.hpp"
 #include "../core/input.h"
 #include "../render/Raytracer.h"
+#include "../render/DrawInstancing.h"
+#include "../render/ShadowMapCache.h"
+#include "../core/renderGraph.h"
+#include "DxParallelRecording.h"
 
 #include "light_source.hlsli"
 #include "camera.hlsli"
@@ -55,6 +59,38 @@ struct RenderSettings {
 
 	bool EnableSharpen = true;
 	float SharpenStrength = 0.5f;
+
+	bool ParallelCommandRecording = true; // Record the depth pre-pass, shadow, opaque and transparent passes on the job system.
+	bool CacheShadowMaps = true; // Re-render spot and point light shadow maps only when the light or a caster in range moved.
+};
+
+struct RenderStatistics {
+	float OpaqueSortTime = 0.f; // In milliseconds.
+	float TransparentSortTime = 0.f; // In milliseconds.
+
+	uint32 NumDrawCalls = 0; // Depth-only, shadow, opaque and transparent draws, after instancing.
+	uint32 NumDrawCallsMerged = 0; // Draws saved by collapsing repeated geometry into instanced draws.
+	uint32 NumStateChanges = 0; // Pipeline setups, material, vertex and index buffer binds which were actually recorded.
+	uint32 NumStateChangesSaved = 0; // Binds which were skipped, because the state was already set by the previous draw.
+
+	// CPU time from the start of recording until all chunks of the pass are recorded. In milliseconds.
+	// Compare against NumDrawCalls with ParallelCommandRecording switched on and off to benchmark the parallel recording.
+	float DepthPrepassRecordTime = 0.f;
+	float ShadowRecordTime = 0.f;
+	float OpaqueRecordTime = 0.f;
+	float TransparentRecordTime = 0.f;
+	uint32 NumRecordingChunks = 0; // Command lists recorded for the passes above.
+
+	// Spot and point light shadow maps. A point light counts once, although it has two viewports.
+	uint32 NumShadowMapFullUpdates = 0; // Static and dynamic casters were rendered.
+	uint32 NumShadowMapDynamicUpdates = 0; // Static casters were restored from the cache, only dynamic casters were rendered.
+	uint32 NumShadowMapsSkipped = 0; // Nothing changed, last frame's shadow map was kept.
+	uint32 NumShadowDrawsSkipped = 0; // Shadow draws (before instancing) which were not recorded because of the above.
+};
+
+struct FrameGraphReport {
+	RenderGraphCompileResult Compiled;
+	uint64 CommittedBytes; // Size of the resources which the graph treats as transient, as they are allocated now: committed and unshared.
 };
 
 class DxRenderer {
@@ -72,6 +108,12 @@ public:
 	void BeginFrame(uint32 width, uint32 height);
 	void EndFrame(const UserInput& input);
 
+	// Declares the rasterized passes of EndFrame with their reads and writes and compiles them as a render graph, with the sizes of the
+	// current render targets. EndFrame still records its own barriers; this reports what the graph would do with the same pass list,
+	// most of all how much memory the transient targets would need if they shared placed heaps.
+	FrameGraphReport CompileFrameGraph();
+	const RenderGraph& GetFrameGraph() const { return _frameGraph; }
+
 	void SetCamera(const RenderCamera& camera);
 	void SetEnvironment(const Ptr<PbrEnvironment>& environment);
 	void SetSun(const DirectionalLight& light);
@@ -118,6 +160,7 @@ public:
 
 	RendererMode Mode = ERendererModeRasterized;
 	RenderSettings Settings;
+	RenderStatistics Stats;
 
 	uint32 RenderWidth;
 	uint32 RenderHeight;
@@ -175,6 +218,7 @@ private:
 	DxPipeline _animatedDepthOnlyPipeline;
 	DxPipeline _shadowPipeline;
 	DxPipeline _pointLightShadowPipeline;
+	DxPipeline _shadowMapCopyPipeline;
 
 	DxPipeline _outlineMarkerPipeline;
 	DxPipeline _outlineDrawerPipline;
@@ -208,6 +252,8 @@ private:
 	Ptr<DxTexture> _noiseTexture;
 
 	Ptr<DxTexture> _shadowMap;
+	Ptr<DxTexture> _staticShadowMapCache; // Same layout as the shadow map, but only with the static casters of the spot and point lights.
+	ShadowMapUpdateTracker _shadowMapUpdateTracker;
 
 	Ptr<DxTexture> _brdfTex;
 
@@ -289,15 +335,57 @@ private:
 	RenderSettings _oldSettings;
 	RendererMode _oldMode = ERendererModeRasterized;
 
+	enum EShadowViewType {
+		EShadowViewSunCascade,
+		EShadowViewSpotLight,
+		EShadowViewPointLight,
+	};
+
+	// One viewport in the shadow map. This is the unit of work when the shadow pass is split into chunks.
+	// Spot and point lights are rendered in two layers: The static casters into the cache, the dynamic casters into the shadow map.
+	struct ShadowView {
+		EShadowViewType Type;
+		uint32 Index;
+		uint32 NumDraws;
+		bool StaticLayer;
+	};
+
+	// Scratch memory of one chunk during parallel recording. Chunk i only ever touches slot i.
+	struct RecordingScratch {
+		std::vector<InstanceRun> InstanceRuns;
+		std::vector<D3D12_GPU_VIRTUAL_ADDRESS> InstanceAddresses;
+		RenderStatistics Stats;
+	};
+
+	RecordingScratch _recordingScratch[MAX_NUM_RECORDING_CHUNKS];
+	std::vector<InstanceRun> _staticDepthOnlyRuns;
+	std::vector<InstanceRun> _dynamicDepthOnlyRuns;
+	std::vector<InstanceRun> _opaqueRuns;
+	std::vector<ShadowView> _shadowViews;
+	std::vector<ShadowView> _staticShadowViews;
+	std::vector<D3D12_RECT> _shadowMapClearRects;
+	std::vector<D3D12_RECT> _staticShadowMapClearRects;
+	std::vector<vec4> _shadowMapCopyViewports; // Tiles which are restored from the static cache.
+
 	void RecalculateViewport(bool resizeTextures);
 	void AllocateLightCullingBuffers();
 
+	RenderGraph _frameGraph;
+
 	enum GaussianBlurKernelSize
 	{
 		EGaussian_Blur_5x5,
 		EGaussian_Blur_9x9,
 	};
 
+	template <typename RecordT>
+	DxCommandList* RecordParallelPass(DxCommandList* cl, const RecordingChunk* chunks, uint32 numChunks, const RecordT& record, float& outRecordTime);
+	void RecordDepthPrepassChunk(DxCommandList* cl, RecordingChunk chunk, RecordingScratch& scratch, DxRenderTarget renderTarget, DxDynamicConstantBuffer cameraCBV);
+	void PrepareShadowViews(const vec4* sunViewports, const vec4* spotLightViewports, const vec4 (*pointLightViewports)[2]);
+	void RecordShadowChunk(DxCommandList* cl, RecordingChunk chunk, RecordingScratch& scratch, const ShadowView* views, DxRenderTarget renderTarget, const vec4* sunViewports, const vec4* spotLightViewports, const vec4 (*pointLightViewports)[2]);
+	void RecordOpaqueChunk(DxCommandList* cl, RecordingChunk chunk, RecordingScratch& scratch, DxRenderTarget renderTarget, const CommonMaterialInfo& materialInfo);
+	void RecordTransparentChunk(DxCommandList* cl, RecordingChunk chunk, RecordingScratch& scratch, DxRenderTarget renderTarget, const CommonMaterialInfo& materialInfo);
+	void RenderShadowDrawCalls(DxCommandList* cl, RecordingScratch& scratch, const std::vector<ShadowRenderPass::DrawCall>& drawCalls, const mat4& viewProj);
 	void GaussianBlur(DxCommandList* cl, Ptr<DxTexture> inputOutput, Ptr<DxTexture> temp, uint32 inputMip, uint32 outputMip, GaussianBlurKernelSize kernel, uint32 numIterations = 1);
 	void SpecularAmbient(DxCommandList* cl, DxDynamicConstantBuffer cameraCBV, const Ptr<DxTexture>& hdrInput, const Ptr<DxTexture>& ssr, const Ptr<DxTexture>& output);
 	void TonemapAndPresent(DxCommandList* cl, const Ptr<DxTexture>& hdrResult);
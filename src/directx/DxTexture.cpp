@@ -5,7 +5,15 @@
 #include "DxContext.h"
 #include "DirectXTex.h"
 #include "../render/TexturePreprocessing.h"
+#include "../core/assetCache.h"
+#include "../core/ddsLayout.h"
+#include "../core/memoryMappedFile.h"
+#include "../core/mipGenerator.h"
+#include "../core/blockCompression.h"
+#include "../core/cpuProfiling.h"
 #include "DxCommandList.h"
+#include "DxRenderer.h"
+#include <chrono>
 
 namespace fs = std::filesystem;
 
@@ -44,6 +52,107 @@ namespace {
 		return format;
 	}
 
+	// Part of the key of DDS cache files, so that a new DirectXTex or a change of the preprocessing invalidates them.
+	constexpr EBlockCompressionQuality TextureCompressionQuality = EBlockCompressionQualityNormal;
+
+	uint64 GetTextureImporterVersion() {
+		return ((uint64)DIRECTX_TEX_VERSION << 32) | ((uint64)TextureCompressionQuality << 16) | TEXTURE_CACHE_VERSION;
+	}
+
+	bool GetMipFormat(DXGI_FORMAT format, EMipFormat& outFormat, bool& outIsSRGB) {
+		outIsSRGB = false;
+		switch (format) {
+			case DXGI_FORMAT_R8_UNORM: outFormat = EMipFormatR8; return true;
+			case DXGI_FORMAT_R8G8_UNORM: outFormat = EMipFormatRG8; return true;
+			case DXGI_FORMAT_R8G8B8A8_UNORM:
+			case DXGI_FORMAT_B8G8R8A8_UNORM: outFormat = EMipFormatRGBA8; return true;
+			case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+			case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB: outFormat = EMipFormatRGBA8; outIsSRGB = true; return true;
+			case DXGI_FORMAT_R16G16B16A16_FLOAT: outFormat = EMipFormatRGBA16F; return true;
+			case DXGI_FORMAT_R32G32B32A32_FLOAT: outFormat = EMipFormatRGBA32F; return true;
+			default: return false;
+		}
+	}
+
+	// Returns false for formats and dimensions the mip generator doesn't handle. These go through DirectXTex instead.
+	bool GenerateMipMapsOnCpu(const DirectX::ScratchImage& scratchImage, const DirectX::TexMetadata& metadata, uint32 flags, DirectX::ScratchImage& mipChainImage) {
+		EMipFormat format;
+		bool isSRGB;
+		if (metadata.dimension != DirectX::TEX_DIMENSION_TEXTURE2D or metadata.IsCubemap() or not GetMipFormat(metadata.format, format, isSRGB)) {
+			return false;
+		}
+
+		uint32 numLevels = GetNumMipLevels((uint32)metadata.width, (uint32)metadata.height);
+		if (FAILED(mipChainImage.Initialize2D(metadata.format, metadata.width, metadata.height, metadata.arraySize, numLevels))) {
+			return false;
+		}
+
+		MipGenerationSettings settings;
+		// The sharper filters ring around very bright texels, which is far more visible in HDR images.
+		settings.Filter = (format == EMipFormatRGBA16F or format == EMipFormatRGBA32F) ? EMipFilterBox : EMipFilterKaiser;
+		settings.IsSRGB = isSRGB;
+		settings.AlphaCutoff = (flags & ETextureLoadFlagsPreserveAlphaCoverage) ? 0.5f : 0.f;
+
+		std::vector<MipLevel> levels(numLevels);
+		for (size_t item = 0; item < metadata.arraySize; ++item) {
+			for (uint32 level = 0; level < numLevels; ++level) {
+				const DirectX::Image* image = mipChainImage.GetImage(level, item, 0);
+				levels[level] = { image->pixels, (uint32)image->width, (uint32)image->height, (uint64)image->rowPitch };
+			}
+
+			const DirectX::Image* source = scratchImage.GetImage(0, item, 0);
+			for (uint32 y = 0; y < levels[0].Height; ++y) {
+				memcpy(levels[0].Pixels + y * levels[0].RowPitch, source->pixels + y * source->rowPitch, Min((uint64)source->rowPitch, levels[0].RowPitch));
+			}
+
+			GenerateMipChain(format, levels.data(), numLevels, settings);
+		}
+
+		return true;
+	}
+
+	bool GetBlockFormat(DXGI_FORMAT sourceFormat, DXGI_FORMAT compressedFormat, EBlockFormat& outFormat) {
+		bool isRGBA8 = (sourceFormat == DXGI_FORMAT_R8G8B8A8_UNORM or sourceFormat == DXGI_FORMAT_R8G8B8A8_UNORM_SRGB);
+		switch (compressedFormat) {
+			case DXGI_FORMAT_BC1_UNORM:
+			case DXGI_FORMAT_BC1_UNORM_SRGB: outFormat = EBlockFormatBC1; return isRGBA8;
+			case DXGI_FORMAT_BC3_UNORM:
+			case DXGI_FORMAT_BC3_UNORM_SRGB: outFormat = EBlockFormatBC3; return isRGBA8;
+			case DXGI_FORMAT_BC7_UNORM:
+			case DXGI_FORMAT_BC7_UNORM_SRGB: outFormat = EBlockFormatBC7; return isRGBA8;
+			case DXGI_FORMAT_BC4_UNORM: outFormat = EBlockFormatBC4; return sourceFormat == DXGI_FORMAT_R8_UNORM;
+			case DXGI_FORMAT_BC5_UNORM: outFormat = EBlockFormatBC5; return sourceFormat == DXGI_FORMAT_R8G8_UNORM;
+			default: return false;
+		}
+	}
+
+	// Returns false for source formats the block encoder doesn't handle. These go through DirectXTex instead.
+	bool CompressImageOnCpu(const DirectX::ScratchImage& scratchImage, const DirectX::TexMetadata& metadata, DXGI_FORMAT compressedFormat, DirectX::ScratchImage& compressedImage) {
+		EBlockFormat format;
+		if (not GetBlockFormat(metadata.format, compressedFormat, format)) {
+			return false;
+		}
+
+		DirectX::TexMetadata compressedMetadata = metadata;
+		compressedMetadata.format = compressedFormat;
+		if (FAILED(compressedImage.Initialize(compressedMetadata))) {
+			return false;
+		}
+
+		BlockCompressionSettings settings;
+		settings.Quality = TextureCompressionQuality;
+
+		uint32 bytesPerPixel = (uint32)DirectX::BitsPerPixel(metadata.format) / 8;
+		for (size_t i = 0; i < scratchImage.GetImageCount(); ++i) {
+			const DirectX::Image& source = scratchImage.GetImages()[i];
+			const DirectX::Image& destination = compressedImage.GetImages()[i];
+			CompressBlocks(format, source.pixels, (uint32)source.width, (uint32)source.height, (uint64)source.rowPitch, bytesPerPixel,
+				destination.pixels, (uint64)destination.rowPitch, settings);
+		}
+
+		return true;
+	}
+
 	bool LoadImageFromFile(fs::path filepath, uint32 flags, DirectX::ScratchImage& scratchImage, D3D12_RESOURCE_DESC& textureDesc) {
 		if (flags & ETextureLoadFlagsGenMipsOnGpu) {
 			flags &= ~ETextureLoadFlagsGenMipsOnCpu;
@@ -52,29 +161,16 @@ namespace {
 
 		fs::path extension = filepath.extension();
 
-		fs::path cachedFilename = filepath;
-		cachedFilename.replace_extension("." + std::to_string(flags) + ".cache.dds");
-
-		fs::path cacheFilepath = L"asset_cache" / cachedFilename;
+		AssetCache* assetCache = AssetCache::Instance();
+		uint64 importerVersion = GetTextureImporterVersion();
 
+		fs::path cacheFilepath;
 		bool fromCache = false;
 		DirectX::TexMetadata metadata;
 
 		if (!(flags & ETextureLoadFlagsAlwaysLoadFromSource)) {
-			// Look for cached.
-
-			WIN32_FILE_ATTRIBUTE_DATA cachedData;
-			if (GetFileAttributesExW(cacheFilepath.c_str(), GetFileExInfoStandard, &cachedData)) {
-				FILETIME cachedFiletime = cachedData.ftLastWriteTime;
-
-				WIN32_FILE_ATTRIBUTE_DATA originalData;
-				assert(GetFileAttributesExW(filepath.c_str(), GetFileExInfoStandard, &originalData));
-				FILETIME originalFiletime = originalData.ftLastWriteTime;
-
-				if (CompareFileTime(&cachedFiletime, &originalFiletime) >= 0) {
-					// Cached file is newer than original, so load this.
-					fromCache = SUCCEEDED(DirectX::LoadFromDDSFile(cacheFilepath.c_str(), DirectX::DDS_FLAGS_NONE, &metadata, scratchImage));
-				}
+			if (assetCache->Lookup(filepath, importerVersion, flags, ".dds", cacheFilepath)) {
+				fromCache = SUCCEEDED(DirectX::LoadFromDDSFile(cacheFilepath.c_str(), DirectX::DDS_FLAGS_NONE, &metadata, scratchImage));
 			}
 		}
 
@@ -125,7 +221,9 @@ namespace {
 			if (flags & ETextureLoadFlagsGenMipsOnCpu) {
 				DirectX::ScratchImage mipChainImage;
 
-				ThrowIfFailed(DirectX::GenerateMipMaps(scratchImage.GetImages(), scratchImage.GetImageCount(), metadata, DirectX::TEX_FILTER_DEFAULT, 0, mipChainImage));
+				if (not GenerateMipMapsOnCpu(scratchImage, metadata, flags, mipChainImage)) {
+					ThrowIfFailed(DirectX::GenerateMipMaps(scratchImage.GetImages(), scratchImage.GetImageCount(), metadata, DirectX::TEX_FILTER_DEFAULT, 0, mipChainImage));
+				}
 				scratchImage = std::move(mipChainImage);
 				metadata = scratchImage.GetMetadata();
 			}
@@ -157,16 +255,24 @@ namespace {
 									compressedFormat = DirectX::IsSRGB(metadata.format) ? DXGI_FORMAT_BC1_UNORM_SRGB : DXGI_FORMAT_BC1_UNORM;
 								}
 								else {
-									compressedFormat = DirectX::IsSRGB(metadata.format) ? DXGI_FORMAT_BC3_UNORM_SRGB : DXGI_FORMAT_BC3_UNORM; // 7 would be better, but takes forever to compress.
+									// BC7 is only fast to compress with our own encoder. DirectXTex takes forever, so other sources stay on BC3.
+									EBlockFormat blockFormat;
+									bool useBC7 = GetBlockFormat(metadata.format, DXGI_FORMAT_BC7_UNORM, blockFormat);
+									compressedFormat = useBC7
+										? (DirectX::IsSRGB(metadata.format) ? DXGI_FORMAT_BC7_UNORM_SRGB : DXGI_FORMAT_BC7_UNORM)
+										: (DirectX::IsSRGB(metadata.format) ? DXGI_FORMAT_BC3_UNORM_SRGB : DXGI_FORMAT_BC3_UNORM);
 								}
 								break;
 							}
 						}
 
 						DirectX::ScratchImage compressedImage;
-						DirectX::TEX_COMPRESS_FLAGS compressFlags = DirectX::TEX_COMPRESS_PARALLEL;
-						ThrowIfFailed(DirectX::Compress(scratchImage.GetImages(), scratchImage.GetImageCount(), metadata,
-						compressedFormat, compressFlags, DirectX::TEX_THRESHOLD_DEFAULT, compressedImage));
+						if (not CompressImageOnCpu(scratchImage, metadata, compressedFormat, compressedImage)) {
+							DirectX::TEX_COMPRESS_FLAGS compressFlags = DirectX::TEX_COMPRESS_PARALLEL;
+							ThrowIfFailed(DirectX::Compress(scratchImage.GetImages(), scratchImage.GetImageCount(), metadata,
+							compressedFormat, compressFlags, DirectX::TEX_THRESHOLD_DEFAULT, compressedImage));
+						}
+						scratchImage = std::move(compressedImage);
 						metadata = scratchImage.GetMetadata();
 					}
 				}
@@ -176,8 +282,12 @@ namespace {
 			}
 
 			if (flags & ETextureLoadFlagsCacheToDds) {
+				if (cacheFilepath.empty()) {
+					assetCache->Lookup(filepath, importerVersion, flags, ".dds", cacheFilepath);
+				}
 				fs::create_directories(cacheFilepath.parent_path());
 				ThrowIfFailed(DirectX::SaveToDDSFile(scratchImage.GetImages(), scratchImage.GetImageCount(), metadata, DirectX::DDS_FLAGS_NONE, cacheFilepath.c_str()));
+				assetCache->Register(filepath, importerVersion, flags, ".dds");
 			}
 		}
 
@@ -230,9 +340,10 @@ namespace {
 			CheckFormatSupport(formatSupport, D3D12_FORMAT_SUPPORT2_UAV_TYPED_STORE);
 	}
 
-	void Retire(DxResource resource, DxCpuDescriptorHandle srv, DxCpuDescriptorHandle uav, DxCpuDescriptorHandle stencil, DxRtvDescriptorHandle rtv, DxDsvDescriptorHandle dsv, std::vector<DxCpuDescriptorHandle>&& mipUAVs) {
+	void Retire(DxResource resource, const DxMemoryAllocation& allocation, DxCpuDescriptorHandle srv, DxCpuDescriptorHandle uav, DxCpuDescriptorHandle stencil, DxRtvDescriptorHandle rtv, DxDsvDescriptorHandle dsv, std::vector<DxCpuDescriptorHandle>&& mipUAVs) {
 		TextureGrave grave;
 		grave.Resource = resource;
+		grave.Allocation = allocation;
 		grave.Srv = srv;
 		grave.Uav = uav;
 		grave.Stencil = stencil;
@@ -716,6 +827,9 @@ Ptr<DxTexture> TextureFactory::LoadVolumeTextureInternal(const std::string& dirn
 	subresource.SlicePitch = scratchImages.begin()->GetImages()[0].slicePitch;
 	subresource.pData = allPixels;
 
+	// Only the creation and upload are serialized, the decode above runs in parallel.
+	std::lock_guard lock(DxContext::Instance().ResourceCreationMutex());
+
 	Ptr<DxTexture> result = TextureFactory::Instance()->CreateVolumeTexture(0, width, height, depth, textureDesc.Format, false);
 	result->UploadSubresourceData(&subresource, 0, 1);
 
@@ -725,6 +839,17 @@ Ptr<DxTexture> TextureFactory::LoadVolumeTextureInternal(const std::string& dirn
 }
 
 Ptr<DxTexture> TextureFactory::LoadTextureInternal(const std::string& filename, uint32 flags) {
+	// Cache files already contain the final format and mip chain, so they can be copied to the GPU as they are.
+	// Anything the parser doesn't handle falls through to DirectXTex below.
+	if (not (flags & (ETextureLoadFlagsAlwaysLoadFromSource | ETextureLoadFlagsAllocateFullMipChain | ETextureLoadFlagsGenMipsOnGpu))) {
+		fs::path cacheFilepath;
+		if (AssetCache::Instance()->Lookup(filename, GetTextureImporterVersion(), flags, ".dds", cacheFilepath)) {
+			if (Ptr<DxTexture> result = LoadMappedDdsInternal(cacheFilepath, TEXTURE_STAGING_BUDGET)) {
+				return result;
+			}
+		}
+	}
+
 	DirectX::ScratchImage scratchImage;
 	D3D12_RESOURCE_DESC textureDesc;
 
@@ -743,7 +868,10 @@ Ptr<DxTexture> TextureFactory::LoadTextureInternal(const std::string& filename,
 		subresource.pData = images[i].pixels;
 	}
 
-	Ptr<DxTexture> result = TextureFactory::Instance()->CreateTexture(textureDesc, subresourceData.get(), numImages);
+	// Only the creation and upload are serialized, the decode above runs in parallel.
+	std::lock_guard lock(DxContext::Instance().ResourceCreationMutex());
+
+	Ptr<DxTexture> result = CreateTexture(textureDesc, subresourceData.get(), numImages);
 	SET_NAME(result->Resource, "Loaded from file");
 
 	if (flags & ETextureLoadFlagsGenMipsOnGpu) {
@@ -758,6 +886,161 @@ Ptr<DxTexture> TextureFactory::LoadTextureInternal(const std::string& filename,
 	return result;
 }
 
+Ptr<DxTexture> TextureFactory::LoadMappedDdsInternal(const fs::path& filename, uint64 stagingBudget) {
+	MemoryMappedFile file;
+	if (not file.Open(filename)) {
+		return nullptr;
+	}
+
+	DdsTextureInfo info;
+	if (not ParseDdsFile(file.Data(), file.Size(), info) or info.Dimension != EDdsDimension2D) {
+		return nullptr;
+	}
+
+	std::vector<DdsUploadRegion> regions;
+	std::vector<DdsUploadBatch> batches;
+	if (not PlanDdsUpload(info, stagingBudget, regions, batches)) {
+		return nullptr;
+	}
+
+	uint64 stagingSize = 0;
+	for (const DdsUploadBatch& batch : batches) {
+		stagingSize = Max(stagingSize, batch.StagingSize);
+	}
+
+	DxContext& dxContext = DxContext::Instance();
+	auto textureDesc = CD3DX12_RESOURCE_DESC::Tex2D((DXGI_FORMAT)info.Format, info.Width, info.Height, (uint16)info.ArraySize, (uint16)info.NumMipLevels);
+
+	// Two staging buffers, so that the rows of the next batch are copied while the GPU still reads the previous one.
+	// Small textures need a single batch and therefore a single buffer.
+	uint32 numStagingBuffers = Min((uint32)batches.size(), 2u);
+	DxResource stagingBuffers[2];
+	uint8* stagingMemory[2] = {};
+	uint64 fenceValues[2] = {};
+
+	Ptr<DxTexture> result;
+	{
+		std::lock_guard lock(dxContext.ResourceCreationMutex());
+
+		result = CreateTexture(textureDesc, nullptr, 0);
+		SET_NAME(result->Resource, "Loaded from file");
+
+		auto heapProperties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
+		auto bufferDesc = CD3DX12_RESOURCE_DESC::Buffer(stagingSize);
+		for (uint32 i = 0; i < numStagingBuffers; ++i) {
+			ThrowIfFailed(dxContext.GetDevice()->CreateCommittedResource(
+				&heapProperties,
+				D3D12_HEAP_FLAG_NONE,
+				&bufferDesc,
+				D3D12_RESOURCE_STATE_GENERIC_READ,
+				nullptr,
+				IID_PPV_ARGS(stagingBuffers[i].GetAddressOf())
+			));
+			TRACK_ALLOCATION(EMemoryCategoryUpload, stagingSize);
+
+			CD3DX12_RANGE readRange(0, 0);
+			ThrowIfFailed(stagingBuffers[i]->Map(0, &readRange, (void**)&stagingMemory[i]));
+		}
+	}
+
+	uint32 blockSize = info.IsBlockCompressed ? 4 : 1;
+
+	for (uint32 b = 0; b < (uint32)batches.size(); ++b) {
+		const DdsUploadBatch& batch = batches[b];
+		uint32 bufferIndex = b % numStagingBuffers;
+
+		if (b >= numStagingBuffers) {
+			dxContext.CopyQueue.WaitForFence(fenceValues[bufferIndex]);
+		}
+
+		// Touching the mapping pages the file in from disk, so this runs outside of the lock.
+		for (uint32 r = batch.FirstRegion; r < batch.FirstRegion + batch.NumRegions; ++r) {
+			CopyDdsRegion(file.Data(), info, regions[r], stagingMemory[bufferIndex]);
+		}
+
+		std::lock_guard lock(dxContext.ResourceCreationMutex());
+
+		DxCommandList* commandList = dxContext.GetFreeCopyCommandList();
+		commandList->TransitionBarrier(result->Resource, D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_DEST);
+
+		for (uint32 r = batch.FirstRegion; r < batch.FirstRegion + batch.NumRegions; ++r) {
+			const DdsUploadRegion& region = regions[r];
+			const DdsSubresourceLayout& subresource = info.Subresources[region.Subresource];
+
+			D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprint;
+			footprint.Offset = region.StagingOffset;
+			footprint.Footprint.Format = textureDesc.Format;
+			footprint.Footprint.Width = AlignTo(subresource.Width, blockSize);
+			footprint.Footprint.Height = region.NumRows * blockSize;
+			footprint.Footprint.Depth = 1;
+			footprint.Footprint.RowPitch = region.StagingRowPitch;
+
+			CD3DX12_TEXTURE_COPY_LOCATION destination(result->Resource.Get(), region.Subresource);
+			CD3DX12_TEXTURE_COPY_LOCATION source(stagingBuffers[bufferIndex].Get(), footprint);
+			commandList->CommandList()->CopyTextureRegion(&destination, 0, region.FirstRow * blockSize, 0, &source, nullptr);
+		}
+
+		// As in UploadSubresourceData, the texture decays back to common after the copy queue is done with it.
+		fenceValues[bufferIndex] = dxContext.ExecuteCommandList(commandList);
+	}
+
+	std::lock_guard lock(dxContext.ResourceCreationMutex());
+	for (uint32 i = 0; i < numStagingBuffers; ++i) {
+		dxContext.Retire(stagingBuffers[i], EMemoryCategoryUpload, stagingSize);
+	}
+
+	return result;
+}
+
+std::string TextureFactory::GetCacheKey(const std::string& filename, uint32 flags) {
+	return filename + "|" + std::to_string(flags);
+}
+
+std::shared_future<Ptr<DxTexture>> TextureFactory::BeginLoad(const std::string& key, Ptr<std::promise<Ptr<DxTexture>>>& outPromise) {
+	std::lock_guard lock(_mutex);
+
+	outPromise = nullptr;
+
+	auto inFlight = _inFlightLoads.find(key);
+	if (inFlight != _inFlightLoads.end()) {
+		return inFlight->second;
+	}
+
+	auto cached = _textureCache.find(key);
+	if (cached != _textureCache.end()) {
+		if (Ptr<DxTexture> sp = cached->second.lock()) {
+			std::promise<Ptr<DxTexture>> ready;
+			ready.set_value(sp);
+			return ready.get_future().share();
+		}
+	}
+
+	outPromise = MakePtr<std::promise<Ptr<DxTexture>>>();
+	std::shared_future<Ptr<DxTexture>> future = outPromise->get_future().share();
+	_inFlightLoads[key] = future;
+	return future;
+}
+
+void TextureFactory::FinishLoad(const std::string& key, std::promise<Ptr<DxTexture>>& promise, const Ptr<DxTexture>& texture) {
+	{
+		std::lock_guard lock(_mutex);
+		_textureCache[key] = texture;
+		_inFlightLoads.erase(key);
+	}
+
+	// Waiters are only woken up after the cache is updated, so a request coming in now already finds the texture in the cache.
+	promise.set_value(texture);
+}
+
+void TextureFactory::FailLoad(const std::string& key, std::promise<Ptr<DxTexture>>& promise, std::exception_ptr exception) {
+	{
+		std::lock_guard lock(_mutex);
+		_inFlightLoads.erase(key);
+	}
+
+	promise.set_exception(exception);
+}
+
 DxTexture::DxTexture(DxResource resource, CD3DX12_CPU_DESCRIPTOR_HANDLE rtvHandle) {
 	Resource = resource;
 	RtvHandles = rtvHandle;
@@ -765,31 +1048,97 @@ DxTexture::DxTexture(DxResource resource, CD3DX12_CPU_DESCRIPTOR_HANDLE rtvHandl
 
 
 Ptr<DxTexture> TextureFactory::LoadTextureFromFile(const char *filename, uint32 flags) {
-	_mutex.lock();
+	CPU_PROFILE_BLOCK("Load texture");
 
 	std::string s = filename;
+	std::string key = GetCacheKey(s, flags);
+
+	Ptr<std::promise<Ptr<DxTexture>>> promise;
+	std::shared_future<Ptr<DxTexture>> future = BeginLoad(key, promise);
 
-	auto sp = _textureCache[s].lock();
-	if (not sp) {
-		_textureCache[s] = sp = LoadTextureInternal(s, flags);
+	if (promise) {
+		try {
+			FinishLoad(key, *promise, LoadTextureInternal(s, flags));
+		}
+		catch (...) {
+			FailLoad(key, *promise, std::current_exception());
+		}
 	}
 
-	_mutex.unlock();
-	return sp;
+	return future.get();
 }
 
-Ptr<DxTexture> TextureFactory::LoadVolumeTextureFromDirectory(const char *dirname, uint32 flags) {
-	_mutex.lock();
+AsyncTexture TextureFactory::LoadTextureFromFileAsync(const char* filename, uint32 flags, const Ptr<DxTexture>& placeholder) {
+	std::string s = filename;
+	std::string key = GetCacheKey(s, flags);
+
+	AsyncTexture result;
+	result._placeholder = placeholder;
+	if (not result._placeholder) {
+		DxRenderer* renderer = DxRenderer::Instance();
+		result._placeholder = (flags & ETextureLoadFlagsNoncolor) ? renderer->GetBlackTexture() : renderer->GetWhiteTexture();
+	}
+
+	Ptr<std::promise<Ptr<DxTexture>>> promise;
+	result._future = BeginLoad(key, promise);
 
+	if (promise) {
+		_asyncLoadContext.AddWork([this, s, key, flags, promise]() {
+			try {
+				FinishLoad(key, *promise, LoadTextureInternal(s, flags));
+			}
+			catch (...) {
+				FailLoad(key, *promise, std::current_exception());
+			}
+		});
+	}
+
+	return result;
+}
+
+void TextureFactory::WaitForAsyncLoads() {
+	_asyncLoadContext.WaitForWorkCompletion();
+}
+
+Ptr<DxTexture> TextureFactory::LoadVolumeTextureFromDirectory(const char *dirname, uint32 flags) {
 	std::string s = dirname;
+	std::string key = GetCacheKey(s, flags);
 
-	auto sp = _textureCache[s].lock();
-	if (!sp) {
-		_textureCache[s] = sp = LoadVolumeTextureInternal(s, flags);
+	Ptr<std::promise<Ptr<DxTexture>>> promise;
+	std::shared_future<Ptr<DxTexture>> future = BeginLoad(key, promise);
+
+	if (promise) {
+		try {
+			FinishLoad(key, *promise, LoadVolumeTextureInternal(s, flags));
+		}
+		catch (...) {
+			FailLoad(key, *promise, std::current_exception());
+		}
 	}
 
-	_mutex.unlock();
-	return sp;
+	return future.get();
+}
+
+bool AsyncTexture::IsLoaded() const {
+	return _future.valid() and _future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+Ptr<DxTexture> AsyncTexture::Get() const {
+	if (IsLoaded()) {
+		// A failed load keeps the placeholder. The exception is only reported by Wait.
+		try {
+			if (Ptr<DxTexture> texture = _future.get()) {
+				return texture;
+			}
+		}
+		catch (...) {
+		}
+	}
+	return _placeholder;
+}
+
+Ptr<DxTexture> AsyncTexture::Wait() const {
+	return _future.valid() ? _future.get() : nullptr;
 }
 
 void DxTexture::UploadSubresourceData(D3D12_SUBRESOURCE_DATA* subresourceData, uint32 firstSubresource, uint32 numSubresource) {
@@ -810,9 +1159,10 @@ void DxTexture::UploadSubresourceData(D3D12_SUBRESOURCE_DATA* subresourceData, u
 		nullptr,
 		IID_PPV_ARGS(intermediateResource.GetAddressOf())
 	));
+	TRACK_ALLOCATION(EMemoryCategoryUpload, requiredSize);
 
 	UpdateSubresources(commandList->CommandList(), Resource.Get(), intermediateResource.Get(), 0, firstSubresource, numSubresource, subresourceData);
-	dxContext.Retire(intermediateResource);
+	dxContext.Retire(intermediateResource, EMemoryCategoryUpload, requiredSize);
 
 	// We are omitting the transition to common here, since the resource automatically decays to common state after being accessed on a copy queue.
 	// commandList->TransitionBarrier(Resource, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_COMMON);
@@ -879,15 +1229,7 @@ Ptr<DxTexture> TextureFactory::CreateTexture(D3D12_RESOURCE_DESC textureDesc, D3
 		__debugbreak();
 	}
 
-	auto heapProperties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
-	ThrowIfFailed(dxContext.GetDevice()->CreateCommittedResource(
-		&heapProperties,
-		D3D12_HEAP_FLAG_NONE,
-		&textureDesc,
-		initialState,
-		nullptr,
-		IID_PPV_ARGS(&result->Resource)
-	));
+	result->Resource = dxContext.MemoryAllocator().CreateResource(textureDesc, D3D12_HEAP_TYPE_DEFAULT, initialState, nullptr, result->Allocation);
 
 	result->NumMipLevels = result->Resource->GetDesc().MipLevels;
 	result->Width = (uint32)textureDesc.Width;
@@ -974,15 +1316,7 @@ Ptr<DxTexture> TextureFactory::CreateDepthTexture(uint32 width, uint32 height, D
 	D3D12_RESOURCE_DESC desc = CD3DX12_RESOURCE_DESC::Tex2D(typelessFormat, width, height,
 		arrayLength, 1, 1, 0, D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL);
 
-	auto heapProperties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
-	ThrowIfFailed(dxContext.GetDevice()->CreateCommittedResource(
-		&heapProperties,
-		D3D12_HEAP_FLAG_NONE,
-		&desc,
-		D3D12_RESOURCE_STATE_DEPTH_WRITE,
-		&optimizedClearValue,
-		IID_PPV_ARGS(result->Resource.GetAddressOf())
-	));
+	result->Resource = dxContext.MemoryAllocator().CreateResource(desc, D3D12_HEAP_TYPE_DEFAULT, D3D12_RESOURCE_STATE_DEPTH_WRITE, &optimizedClearValue, result->Allocation);
 
 	result->NumMipLevels = 1;
 	result->_requestedNumMipLevels = 1;
@@ -1103,7 +1437,7 @@ void DxTexture::AllocateMipUAVs() {
 }
 
 DxTexture::~DxTexture() {
-	Retire(Resource, DefaultSRV, DefaultUAV, StencilSRV, RtvHandles, DsvHandle, std::move(MipUAVs));
+	Retire(Resource, Allocation, DefaultSRV, DefaultUAV, StencilSRV, RtvHandles, DsvHandle, std::move(MipUAVs));
 }
 
 void DxTexture::Resize(uint32 newWidth, uint32 newHeight, D3D12_RESOURCE_STATES initialState) {
@@ -1116,7 +1450,7 @@ void DxTexture::Resize(uint32 newWidth, uint32 newHeight, D3D12_RESOURCE_STATES
 
 	bool hasMipUAVs = MipUAVs.size() > 0;
 
-	Retire(Resource, DefaultSRV, DefaultUAV, StencilSRV, RtvHandles, DsvHandle, std::move(MipUAVs));
+	Retire(Resource, Allocation, DefaultSRV, DefaultUAV, StencilSRV, RtvHandles, DsvHandle, std::move(MipUAVs));
 
 	D3D12_RESOURCE_DESC desc = Resource->GetDesc();
 	Resource.Reset();
@@ -1139,15 +1473,7 @@ void DxTexture::Resize(uint32 newWidth, uint32 newHeight, D3D12_RESOURCE_STATES
 	Width = newWidth;
 	Height = newHeight;
 
-	auto heapProperties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
-	ThrowIfFailed(dxContext.GetDevice()->CreateCommittedResource(
-		&heapProperties,
-		D3D12_HEAP_FLAG_NONE,
-		&desc,
-		state,
-		clearValue,
-		IID_PPV_ARGS(Resource.GetAddressOf())
-	));
+	Resource = dxContext.MemoryAllocator().CreateResource(desc, D3D12_HEAP_TYPE_DEFAULT, state, clearValue, Allocation);
 
 	NumMipLevels = Resource->GetDesc().MipLevels;
 
@@ -1229,5 +1555,8 @@ TextureGrave::~TextureGrave() {
 		for (DxCpuDescriptorHandle handle : MipUAVs) {
 			dxContext.DescriptorAllocatorCPU().FreeHandle(handle);
 		}
+
+		Resource.Reset();
+		dxContext.MemoryAllocator().Free(Allocation);
 	}
 }
@@ -1,16 +1,18 @@
 #pragma once
 
+#include <future>
 #include <mutex>
 #include <unordered_map>
 
 #include "../directx/dx.h"
 #include "DxDescriptor.h"
+#include "DxMemoryAllocator.h"
+#include "../core/threading.h"
+#include "../core/memory.h"
 
 
-// If the TextureLoadFlags flags is set, the system will cache the texture as DDS to disk for faster loading next time.
-// This is not done if the original file has a newer write time.
-// It is also not done if the cache was created with different flags.
-// Therefore: If you change these flags, delete the texture cache!
+// If the ETextureLoadFlagsCacheToDds flag is set, the system will cache the texture as DDS to disk for faster loading next time.
+// The cache is keyed by the contents of the original file, the load flags and the DirectXTex version, see AssetCache.
 
 // If you want the mip chain to be computed on the GPU, you must call this yourself. This system only supports CPU mip levels for now.
 
@@ -24,6 +26,7 @@ enum TextureLoadFlags {
 	ETextureLoadFlagsPremultiplyAlpha		= (1 << 5),
 	ETextureLoadFlagsCacheToDds				= (1 << 6),
 	ETextureLoadFlagsAlwaysLoadFromSource	= (1 << 7), // By default the system will always try to load a cached version of the texture. You can prevent this with this flag.
+	ETextureLoadFlagsPreserveAlphaCoverage	= (1 << 8), // For alpha-tested textures. Keeps the fraction of texels with alpha above 0.5 the same in all CPU-generated mips.
 
 	ETextureLoadFlagsDefault = ETextureLoadFlagsCompress | ETextureLoadFlagsGenMipsOnCpu | ETextureLoadFlagsCacheToDds,
 };
@@ -35,6 +38,7 @@ public:
 	virtual ~DxTexture();
 
 	DxResource Resource;
+	DxMemoryAllocation Allocation;
 	uint32 Width, Height, Depth;
 	DXGI_FORMAT Format;
 
@@ -85,6 +89,7 @@ private:
 
 struct TextureGrave {
 	DxResource Resource;
+	DxMemoryAllocation Allocation;
 
 	DxCpuDescriptorHandle Srv;
 	DxCpuDescriptorHandle Uav;
@@ -104,6 +109,31 @@ struct TextureGrave {
 	~TextureGrave();
 };
 
+// Returned by TextureFactory::LoadTextureFromFileAsync. Hands out a placeholder until the texture is decoded and uploaded.
+// Cheap to copy, all copies refer to the same load.
+class AsyncTexture {
+public:
+	AsyncTexture() = default;
+
+	bool IsLoaded() const;
+
+	// Returns the loaded texture, or the placeholder while the load is in flight or if it failed.
+	Ptr<DxTexture> Get() const;
+
+	// Blocks until the load has finished. Returns null if the file could not be loaded.
+	Ptr<DxTexture> Wait() const;
+
+private:
+	std::shared_future<Ptr<DxTexture>> _future;
+	Ptr<DxTexture> _placeholder;
+
+	friend class TextureFactory;
+};
+
+// Upper bound for the staging buffers of a single texture upload from a memory-mapped DDS file. Larger textures are streamed through
+// two buffers of this size.
+#define TEXTURE_STAGING_BUDGET MB(16)
+
 class TextureFactory {
 public:
 	static TextureFactory* Instance() { return _instance; }
@@ -117,12 +147,38 @@ public:
 	Ptr<DxTexture> LoadTextureFromFile(const char *filename, uint32 flags = ETextureLoadFlagsDefault);
 	Ptr<DxTexture> LoadVolumeTextureFromDirectory(const char* dirname, uint32 flags = ETextureLoadFlagsCompress | ETextureLoadFlagsCacheToDds | ETextureLoadFlagsNoncolor);
 
+	// Decodes the texture on the job system and returns immediately. Until the texture is ready, the handle returns the renderer's
+	// white texture for color textures and the black texture for non-color textures, unless a 'placeholder' is given.
+	// Requests for a file which is already loading attach to the running load.
+	AsyncTexture LoadTextureFromFileAsync(const char* filename, uint32 flags = ETextureLoadFlagsDefault, const Ptr<DxTexture>& placeholder = nullptr);
+
+	// Blocks until all loads started with LoadTextureFromFileAsync have finished.
+	void WaitForAsyncLoads();
 
 private:
 	static TextureFactory* _instance;
 	static Ptr<DxTexture> LoadVolumeTextureInternal(const std::string& dirname, uint32 flags);
-	static Ptr<DxTexture> LoadTextureInternal(const std::string& filename, uint32 flags);
+	Ptr<DxTexture> LoadTextureInternal(const std::string& filename, uint32 flags);
+
+	// Uploads a 2D texture straight from a memory-mapped DDS file. Returns null if the file can't be parsed, in which case the caller
+	// falls back to DirectXTex.
+	Ptr<DxTexture> LoadMappedDdsInternal(const fs::path& filename, uint64 stagingBudget);
 
-	std::unordered_map<std::string, WeakPtr<DxTexture>> _textureCache; // TODO: Pack flags into key.
+	// Returns the cached or in-flight load of 'key'. If there is none, registers a new one and returns its promise in 'outPromise',
+	// which the caller must fulfill with FinishLoad. Otherwise 'outPromise' is null.
+	std::shared_future<Ptr<DxTexture>> BeginLoad(const std::string& key, Ptr<std::promise<Ptr<DxTexture>>>& outPromise);
+	void FinishLoad(const std::string& key, std::promise<Ptr<DxTexture>>& promise, const Ptr<DxTexture>& texture);
+	void FailLoad(const std::string& key, std::promise<Ptr<DxTexture>>& promise, std::exception_ptr exception);
+
+	static std::string GetCacheKey(const std::string& filename, uint32 flags);
+
+	// '_mutex' only guards the two tables. Decoding runs without any lock, so different files load in parallel.
+	std::unordered_map<std::string, WeakPtr<DxTexture>> _textureCache;
+	std::unordered_map<std::string, std::shared_future<Ptr<DxTexture>>> _inFlightLoads;
 	std::mutex _mutex;
+
+	ThreadJobContext _asyncLoadContext;
+
+	// The benchmarks in tests/textureTests.cpp go around the texture cache.
+	friend struct TextureFactoryBenchmarks;
 };
\ No newline at end of file
@@ -1,92 +1,77 @@
 #include "DxUploadBuffer.h"
 
 #include "DxContext.h"
+#include "DxCommandQueue.h"
 #include "../core/memory.h"
 
-DxPage::DxPage(uint64 pageSize) : _pageSize(pageSize) {}
-
-void DxPage::Init(ID3D12Device* device) {
-	auto resourceDesc = CD3DX12_RESOURCE_DESC::Buffer(_pageSize);
-	auto heapDesc = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
+namespace {
+	DxResource CreateMappedUploadBuffer(ID3D12Device* device, uint64 size, uint8** outCpuPtr) {
+		auto resourceDesc = CD3DX12_RESOURCE_DESC::Buffer(size);
+		auto heapDesc = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
+
+		DxResource buffer = nullptr;
+		ThrowIfFailed(device->CreateCommittedResource(
+			&heapDesc,
+			D3D12_HEAP_FLAG_NONE,
+			&resourceDesc,
+			D3D12_RESOURCE_STATE_GENERIC_READ,
+			nullptr,
+			IID_PPV_ARGS(buffer.GetAddressOf())
+		));
+
+		// Upload heaps may stay mapped for their whole lifetime.
+		ThrowIfFailed(buffer->Map(0, nullptr, (void**)outCpuPtr));
+		return buffer;
+	}
+}
 
-	ThrowIfFailed(device->CreateCommittedResource(
-		&heapDesc,
-		D3D12_HEAP_FLAG_NONE,
-		&resourceDesc,
-		D3D12_RESOURCE_STATE_GENERIC_READ,
-		nullptr,
-		IID_PPV_ARGS(_buffer.GetAddressOf())
-	));
+void DxUploadBuffer::Initialize(ID3D12Device* device, DxCommandQueue* queue, uint64 capacity, uint64 dedicatedThreshold) {
+	_queue = queue;
+	_dedicatedThreshold = dedicatedThreshold;
 
-	Base.GpuPtr = _buffer->GetGPUVirtualAddress();
-	_buffer->Map(0, nullptr, (void**)&Base.CpuPtr);
+	_ring.Initialize(capacity, D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
+	_buffer = CreateMappedUploadBuffer(device, capacity, &_base.CpuPtr);
+	_base.GpuPtr = _buffer->GetGPUVirtualAddress();
+	SET_NAME(_buffer, "Upload ring");
+	TRACK_ALLOCATION(EMemoryCategoryUpload, capacity);
 }
 
-DxPage* DxPagePool::GetFreePage() {
-	_mutex.lock();
-	DxPage* page = nullptr;
+DxAllocation DxUploadBuffer::Allocate(uint64 size, uint64 alignment) {
+	// Committed resources are 64KB aligned, which covers every alignment the upload path asks for.
+	assert(alignment <= D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT);
 
-	if (!_freePages.empty()) {
-		page = _freePages.front();
-		_freePages.pop_front();
+	if (size > _dedicatedThreshold) {
+		return AllocateDedicated(size);
 	}
-	_mutex.unlock();
 
-	if (not page) {
-		ID3D12Device5* device = DxContext::Instance().GetDevice();
-		page = new DxPage{_pageSize};
-		page->Init(device);
+	uint64 offset = _ring.Allocate(size, alignment);
+	if (offset == RING_ALLOCATOR_FAILED) {
+		// The GPU may have caught up since the last frame started.
+		_ring.Reclaim(_queue->CompletedFenceValue());
+		offset = _ring.Allocate(size, alignment);
 	}
-
-	return page;
-}
-
-void DxPagePool::ReturnPage(DxPage* page) {
-	std::lock_guard lock(_mutex);
-	_usedPages.push_back(page);
-	if (!LastUsedPage) {
-		LastUsedPage = page;
+	if (offset == RING_ALLOCATOR_FAILED) {
+		return AllocateDedicated(size);
 	}
-}
 
-void DxPagePool::Reset() {
-	LastUsedPage = nullptr;
-	_freePages.resize(_usedPages.size());
-	std::ranges::copy(_usedPages, _freePages.begin());
-	_usedPages.clear();
+	return { _base.CpuPtr + offset, _base.GpuPtr + offset };
 }
 
-DxAllocation DxPage::GetAllocation(uint64 size, uint64 alignment) {
-	DxAllocation result;
-
-	uint64 offset = _currentOffset == 0 ? AlignTo(_currentOffset, alignment) : 0;
-	result.CpuPtr = Base.CpuPtr + offset;
-	result.GpuPtr = Base.GpuPtr + offset;
+DxAllocation DxUploadBuffer::AllocateDedicated(uint64 size) {
+	_numDedicatedAllocations.fetch_add(1, std::memory_order_relaxed);
 
-	_currentOffset += offset + size;
+	DxAllocation result;
+	DxResource buffer = CreateMappedUploadBuffer(DxContext::Instance().GetDevice(), size, &result.CpuPtr);
+	result.GpuPtr = buffer->GetGPUVirtualAddress();
+	SET_NAME(buffer, "Dedicated upload buffer");
+	TRACK_ALLOCATION(EMemoryCategoryUpload, size);
 
+	// Released NUM_BUFFERED_FRAMES frames from now, like every other object which may still be in use by the GPU.
+	DxContext::Instance().Retire(buffer, EMemoryCategoryUpload, size);
 	return result;
 }
 
-DxAllocation DxUploadBuffer::Allocate(uint64 size, uint64 alignment) {
-	uint64 alignedOffset = CurrentPage ? AlignTo(CurrentPage->GetOffset(), alignment) : 0;
-
-	DxPage* page = CurrentPage;
-	if (not page or page->CheckAvailableSpace(alignedOffset + size)) {
-		page = PagePool->GetFreePage();
-
-		if (CurrentPage) {
-			PagePool->ReturnPage(CurrentPage);
-		}
-		CurrentPage = page;
-	}
-
-	return page->GetAllocation(size, alignment);
-}
-
-void DxUploadBuffer::Reset() {
-	if (CurrentPage and PagePool) {
-		PagePool->ReturnPage(CurrentPage);
-	}
-	CurrentPage = nullptr;
+void DxUploadBuffer::NewFrame() {
+	_ring.EndEpoch(_queue->LastSignaledFenceValue());
+	_ring.Reclaim(_queue->CompletedFenceValue());
 }
@@ -1,56 +1,49 @@
 #pragma once
 
-#include <deque>
-#include <mutex>
+#include <atomic>
 
 #include "dx.h"
 #include "../pch.h"
+#include "../core/ringAllocator.h"
+
+class DxCommandQueue;
 
 struct DxAllocation {
 	uint8* CpuPtr;
 	D3D12_GPU_VIRTUAL_ADDRESS GpuPtr;
 };
 
-struct DxPage {
-	DxAllocation Base = {};
-
-	DxPage(uint64 pageSize);
-	void Init(ID3D12Device* device);
-	uint64 GetOffset() const { return _currentOffset; }
-	bool CheckAvailableSpace(uint64 size) const { return size < _pageSize - _currentOffset; }
-	DxAllocation GetAllocation(uint64 offset, uint64 alignment);
-
-private:
-	DxResource _buffer = nullptr;
-	uint64 _pageSize;
-	uint64 _currentOffset = 0;
-};
-
-class DxPagePool {
+// Upload memory of one command queue: a single persistently mapped buffer, suballocated by a RingAllocator from any thread.
+//
+// NewFrame closes the epoch with the last fence value signaled on the queue and reclaims the epochs the GPU has finished. A command list
+// which allocates registers as writer with the open epoch and attaches its fence value when it is executed, so a list which is still
+// recording only holds back the epochs it may have allocated in, not the closing of later ones. Frame allocations without a command list
+// must be submitted within the frame.
+//
+// Allocations larger than the dedicated threshold, and those which don't fit because the GPU is too far behind, get their own committed
+// buffer, which is retired through the graveyard.
+class DxUploadBuffer {
 public:
-	DxPagePool(uint64 pageSize) : _pageSize(pageSize) {}
+	void Initialize(ID3D12Device* device, DxCommandQueue* queue, uint64 capacity, uint64 dedicatedThreshold);
 
-	DxPage* LastUsedPage = nullptr;
+	DxAllocation Allocate(uint64 size, uint64 alignment);
+	void NewFrame();
+
+	uint64 BeginWriting() { return _ring.BeginWriting(); }
+	void EndWriting(uint64 epoch, uint64 fenceValue) { _ring.EndWriting(epoch, fenceValue); }
 
-	DxPage* GetFreePage();
-	void ReturnPage(DxPage* page);
-	void Reset();
+	const RingAllocator& Ring() const { return _ring; }
+	uint64 NumDedicatedAllocations() const { return _numDedicatedAllocations.load(std::memory_order_relaxed); }
 
 private:
-	std::deque<DxPage*> _freePages = {};
-	std::deque<DxPage*> _usedPages = {};
-	DxPage* _lastUsedPage = nullptr;
-	uint64 _pageSize;
+	DxAllocation AllocateDedicated(uint64 size);
 
-	std::mutex _mutex = {};
-};
+	RingAllocator _ring;
+	DxResource _buffer = nullptr;
+	DxAllocation _base = {};
 
-class DxUploadBuffer {
-public:
-	DxPagePool* PagePool = nullptr;
-	DxPage* CurrentPage = nullptr;
+	DxCommandQueue* _queue = nullptr;
+	uint64 _dedicatedThreshold = 0;
 
-	DxAllocation Allocate(uint64 size, uint64 alignment);
-	void Reset();
+	std::atomic<uint64> _numDedicatedAllocations = 0;
 };
-
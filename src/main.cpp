@@ -5,6 +5,7 @@
 #include "directx/dx.h"
 #include "directx/DxContext.h"
 #include "core/memory.h"
+#include "core/memoryTracking.h"
 
 int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR pCmdLine, int nCmdShow) {
 #ifdef _DEBUG
@@ -19,6 +20,10 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR pCmdLin
 			return -1;
 		}
 		application->Run();
+#if ENABLE_MEMORY_TRACKING
+		// After the graveyards are flushed. The upload rings and whatever the application never releases are still held here.
+		std::cout << FormatMemoryLeakReport(GlobalMemoryTracker.Snapshot());
+#endif
 	}
 	catch (DxException& e) {
 		MessageBox(nullptr, e.ToString().c_str(), L"HR Failed", MB_OK);
@@ -2,11 +2,13 @@
 
 #pragma once
 
+#ifdef _WIN32
 #define NOMINMAX
 #define WIN32_LEAN_AND_MEAN
 #include <Windows.h>
 #include <windowsx.h>
 #include <tchar.h>
+#endif
 
 #include <limits>
 #include <array>
@@ -22,7 +24,9 @@ namespace fs = std::filesystem;
 
 #include <mutex>
 
+#ifdef _WIN32
 #include <wrl.h>
+#endif
 
 using int8 = int8_t;
 using uint8 = uint8_t;
@@ -47,8 +51,10 @@ template <typename T> struct is_ref<Ptr<T>> : std::true_type {};
 
 template <typename T> inline constexpr bool is_ref_v = is_ref<T>::value;
 
+#ifdef _WIN32
 template <typename T>
 using Com = Microsoft::WRL::ComPtr<T>;
+#endif
 
 #define arraysize(arr) (sizeof(arr) / sizeof((arr)[0]))
 
@@ -1,11 +1,13 @@
 #include "../pch.h"
 #include "assimp.h"
 #include "../render/pbr.hpp"
+#include "../core/assetCache.h"
 
 #include <assimp/Exporter.hpp>
 #include <assimp/postprocess.h>
 #include <assimp/LogStream.hpp>
 #include <assimp/DefaultLogger.hpp>
+#include <assimp/version.h>
 
 #include <filesystem>
 #include <iostream>
@@ -20,38 +22,36 @@ struct AssimpLogger : public Assimp::LogStream {
     }
 };
 
+static std::mutex loggerMutex;
+
 const aiScene *LoadAssimpSceneFile(const char *filepathRaw, Assimp::Importer &importer) {
 #if 1
-    if (Assimp::DefaultLogger::isNullLogger()) {
-        Assimp::DefaultLogger::create("", Assimp::Logger::VERBOSE);
-        Assimp::DefaultLogger::get()->attachStream(new AssimpLogger, Assimp::Logger::Err | Assimp::Logger::Warn);
+    {
+        // Scenes are imported from several threads, each with its own importer, but the logger is global.
+        std::lock_guard lock(loggerMutex);
+        if (Assimp::DefaultLogger::isNullLogger()) {
+            Assimp::DefaultLogger::create("", Assimp::Logger::VERBOSE);
+            Assimp::DefaultLogger::get()->attachStream(new AssimpLogger, Assimp::Logger::Err | Assimp::Logger::Warn);
+        }
     }
 #endif
 
     fs::path filepath = filepathRaw;
-    fs::path extension = filepath.extension();
-
-    fs::path cachedFilename = filepath;
-    cachedFilename.replace_extension(".cache." CACHE_FORMAT);
 
-    fs::path cacheFilepath = L"asset_cache" / cachedFilename;
+    // Everything that changes the imported scene goes into the cache key, so that changing it invalidates the cache.
+    const float maxSmoothingAngle = 80.f;
+    const uint32 removedPrimitives = aiPrimitiveType_POINT | aiPrimitiveType_LINE;
+    const uint32 importFlags = aiProcessPreset_TargetRealtime_MaxQuality | aiProcess_OptimizeGraph | aiProcess_FlipUVs;
 
-    const aiScene *scene = 0; {
-        // Look for cached.
+    uint64 importerVersion = ((uint64)aiGetVersionMajor() << 48) | ((uint64)aiGetVersionMinor() << 32) | ((uint64)aiGetVersionRevision() << 8) | MESH_CACHE_VERSION;
+    uint32 cacheFlags = importFlags ^ (removedPrimitives << 24) ^ (uint32)(maxSmoothingAngle * 1000.f);
 
-        WIN32_FILE_ATTRIBUTE_DATA cachedData;
-        if (GetFileAttributesExW(cacheFilepath.c_str(), GetFileExInfoStandard, &cachedData)) {
-            FILETIME cachedFiletime = cachedData.ftLastWriteTime;
+    AssetCache* assetCache = AssetCache::Instance();
+    fs::path cacheFilepath;
 
-            WIN32_FILE_ATTRIBUTE_DATA originalData;
-            assert(GetFileAttributesExW(filepath.c_str(), GetFileExInfoStandard, &originalData));
-            FILETIME originalFiletime = originalData.ftLastWriteTime;
-
-            if (CompareFileTime(&cachedFiletime, &originalFiletime) >= 0) {
-                // Cached file is newer than original, so load this.
-                scene = importer.ReadFile(cacheFilepath.string(), 0);
-            }
-        }
+    const aiScene *scene = 0;
+    if (assetCache->Lookup(filepath, importerVersion, cacheFlags, ".cache." CACHE_FORMAT, cacheFilepath)) {
+        scene = importer.ReadFile(cacheFilepath.string(), 0);
     }
 
     if (!scene) {
@@ -66,11 +66,10 @@ const aiScene *LoadAssimpSceneFile(const char *filepathRaw, Assimp::Importer &im
 #endif
         std::cout << std::endl;
 
-        importer.SetPropertyFloat(AI_CONFIG_PP_GSN_MAX_SMOOTHING_ANGLE, 80.f);
-        importer.SetPropertyInteger(AI_CONFIG_PP_SBP_REMOVE, aiPrimitiveType_POINT | aiPrimitiveType_LINE);
+        importer.SetPropertyFloat(AI_CONFIG_PP_GSN_MAX_SMOOTHING_ANGLE, maxSmoothingAngle);
+        importer.SetPropertyInteger(AI_CONFIG_PP_SBP_REMOVE, removedPrimitives);
         //importer.SetPropertyInteger(AI_CONFIG_PP_SLM_VERTEX_LIMIT, UINT16_MAX); // So that we can use 16 bit indices.
 
-        uint32 importFlags = aiProcessPreset_TargetRealtime_MaxQuality | aiProcess_OptimizeGraph | aiProcess_FlipUVs;
         uint32 exportFlags = 0;
 
         scene = importer.ReadFile(filepath.string(), importFlags);
@@ -86,7 +85,9 @@ const aiScene *LoadAssimpSceneFile(const char *filepathRaw, Assimp::Importer &im
 		}
 #endif
 
-        exporter.Export(scene, CACHE_FORMAT, cacheFilepath.string(), exportFlags);
+        if (scene and exporter.Export(scene, CACHE_FORMAT, cacheFilepath.string(), exportFlags) == aiReturn_SUCCESS) {
+            assetCache->Register(filepath, importerVersion, cacheFlags, ".cache." CACHE_FORMAT);
+        }
     }
 
     if (scene) {
@@ -1,6 +1,8 @@
 #include "../pch.h"
 #include "geometry.h"
 #include "../core/memory.h"
+#include "../core/memoryTracking.h"
+#include "../core/gltf.h"
 
 #include "assimp/scene.h"
 #include <unordered_map>
@@ -41,10 +43,64 @@ namespace {
 
 		return result;
 	}
+
+	// Per-triangle tangents along the U direction, accumulated per vertex and made orthogonal to the normal.
+	void GenerateTangents(const vec3* positions, const vec2* uvs, const vec3* normals, const IndexedLine32* triangles, uint32 numTriangles,
+		uint32 numVertices, vec3* outTangents) {
+		for (uint32 i = 0; i < numVertices; ++i) {
+			outTangents[i] = vec3(0.f, 0.f, 0.f);
+		}
+
+		for (uint32 i = 0; i < numTriangles; ++i) {
+			IndexedLine32 t = triangles[i];
+			vec3 e0 = positions[t.B] - positions[t.A];
+			vec3 e1 = positions[t.C] - positions[t.A];
+			vec2 d0 = uvs[t.B] - uvs[t.A];
+			vec2 d1 = uvs[t.C] - uvs[t.A];
+
+			float determinant = d0.x * d1.y - d1.x * d0.y;
+			if (determinant == 0.f) {
+				continue;
+			}
+
+			vec3 tangent = (e0 * d1.y - e1 * d0.y) * (1.f / determinant);
+			outTangents[t.A] += tangent;
+			outTangents[t.B] += tangent;
+			outTangents[t.C] += tangent;
+		}
+
+		for (uint32 i = 0; i < numVertices; ++i) {
+			vec3 n = normals[i];
+			outTangents[i] = noz(outTangents[i] - n * dot(n, outTangents[i]));
+		}
+	}
+
+	// Rounds the weights to bytes which sum up to exactly 255. The rounding error goes to the largest weight.
+	SkinningWeights QuantizeSkinWeights(const uint32* joints, const float* weights) {
+		SkinningWeights result = {};
+
+		float sum = weights[0] + weights[1] + weights[2] + weights[3];
+		if (sum <= 0.f) {
+			result.SkinWeights[0] = 255;
+			return result;
+		}
+
+		uint32 total = 0;
+		uint32 largest = 0;
+		for (uint32 i = 0; i < 4; ++i) {
+			result.SkinIndices[i] = (uint8)joints[i];
+			result.SkinWeights[i] = (uint8)clamp(weights[i] / sum * 255.f + 0.5f, 0.f, 255.f);
+			total += result.SkinWeights[i];
+			largest = (weights[i] > weights[largest]) ? i : largest;
+		}
+		result.SkinWeights[largest] = (uint8)(result.SkinWeights[largest] + 255 - total);
+		return result;
+	}
 }
 
-CpuMesh::CpuMesh(uint32 flags) {
+CpuMesh::CpuMesh(uint32 flags, MemoryArena* arena) {
 	Flags = flags;
+	_arena = arena;
 	VertexInfo info = GetVertexInfo(flags);
 	VertexSize = info.VertexSize;
 	SkinOffset = info.SkinOffset;
@@ -58,16 +114,28 @@ CpuMesh::CpuMesh(CpuMesh&& mesh) {
 	_triangles = mesh._triangles;
 	_numVertices = mesh._numVertices;
 	_numTriangles = mesh._numTriangles;
+	_vertexCapacity = mesh._vertexCapacity;
+	_triangleCapacity = mesh._triangleCapacity;
+	_arena = mesh._arena;
+	NumGrowths = mesh.NumGrowths;
+	NumBytesCopied = mesh.NumBytesCopied;
 
 	mesh._vertices = 0;
 	mesh._triangles = 0;
+	mesh._vertexCapacity = 0;
+	mesh._triangleCapacity = 0;
 }
 
 CpuMesh::~CpuMesh() {
+	if (_arena) {
+		return;
+	}
 	if (_vertices) {
+		TRACK_FREE(EMemoryCategoryMeshes, (uint64)_vertexCapacity * VertexSize);
 		_aligned_free(_vertices);
 	}
 	if (_triangles) {
+		TRACK_FREE(EMemoryCategoryMeshes, (uint64)_triangleCapacity * sizeof(TriangleT));
 		_aligned_free(_triangles);
 	}
 }
@@ -78,8 +146,69 @@ void CpuMesh::AlignNextTriangle() {
 }
 
 void CpuMesh::Reserve(uint32 vertexCount, uint32 triangleCount) {
-	_vertices = (uint8*)_aligned_realloc(_vertices, (_numVertices + vertexCount) * VertexSize, 64);
-	_triangles = (TriangleT*)_aligned_realloc(_triangles, (_numTriangles + triangleCount + 8) * sizeof(TriangleT), 64); // Allocate 8 more, such that we can align without problems.
+	uint32 neededVertices = _numVertices + vertexCount;
+	uint32 neededTriangles = _numTriangles + triangleCount + 8; // Allocate 8 more, such that we can align without problems.
+
+	// The capacity at least doubles, so a mesh built from many pushes copies each vertex a constant number of times on average.
+	if (neededVertices > _vertexCapacity or neededTriangles > _triangleCapacity) {
+		Grow(Max(neededVertices, _vertexCapacity * 2), Max(neededTriangles, _triangleCapacity * 2));
+	}
+}
+
+void CpuMesh::ReserveCapacity(uint32 numVertices, uint32 numTriangles, uint32 numSubmeshes) {
+	numTriangles += 8 * numSubmeshes;
+	if (numVertices > _vertexCapacity or numTriangles > _triangleCapacity) {
+		Grow(Max(numVertices, _vertexCapacity), Max(numTriangles, _triangleCapacity));
+	}
+}
+
+void* CpuMesh::AllocateStorage(uint64 size) {
+	return AlignTo(_arena->Allocate(size + 63), 64);
+}
+
+void CpuMesh::Grow(uint32 vertexCapacity, uint32 triangleCapacity) {
+	uint64 usedVertexBytes = (uint64)_numVertices * VertexSize;
+	uint64 usedTriangleBytes = (uint64)_numTriangles * sizeof(TriangleT);
+
+	if (vertexCapacity > _vertexCapacity) {
+		if (_arena) {
+			uint8* vertices = (uint8*)AllocateStorage((uint64)vertexCapacity * VertexSize);
+			if (usedVertexBytes) {
+				memcpy(vertices, _vertices, usedVertexBytes);
+			}
+			_vertices = vertices;
+		}
+		else {
+			if (_vertices) {
+				TRACK_FREE(EMemoryCategoryMeshes, (uint64)_vertexCapacity * VertexSize);
+			}
+			_vertices = (uint8*)_aligned_realloc(_vertices, (uint64)vertexCapacity * VertexSize, 64);
+			TRACK_ALLOCATION(EMemoryCategoryMeshes, (uint64)vertexCapacity * VertexSize);
+		}
+		_vertexCapacity = vertexCapacity;
+		NumBytesCopied += usedVertexBytes;
+	}
+
+	if (triangleCapacity > _triangleCapacity) {
+		if (_arena) {
+			TriangleT* triangles = (TriangleT*)AllocateStorage((uint64)triangleCapacity * sizeof(TriangleT));
+			if (usedTriangleBytes) {
+				memcpy(triangles, _triangles, usedTriangleBytes);
+			}
+			_triangles = triangles;
+		}
+		else {
+			if (_triangles) {
+				TRACK_FREE(EMemoryCategoryMeshes, (uint64)_triangleCapacity * sizeof(TriangleT));
+			}
+			_triangles = (TriangleT*)_aligned_realloc(_triangles, (uint64)triangleCapacity * sizeof(TriangleT), 64);
+			TRACK_ALLOCATION(EMemoryCategoryMeshes, (uint64)triangleCapacity * sizeof(TriangleT));
+		}
+		_triangleCapacity = triangleCapacity;
+		NumBytesCopied += usedTriangleBytes;
+	}
+
+	++NumGrowths;
 }
 
 /*
@@ -93,14 +222,18 @@ void CpuMesh::Reserve(uint32 vertexCount, uint32 triangleCount) {
 */
 
 void CpuMesh::PushVertex(vec3 position, vec2 uv, vec3 normal, vec3 tangent, SkinningWeights skin) {
-	uint8* ptrVertex = _vertices + VertexSize * _numVertices;
+	WriteVertex(_numVertices++, position, uv, normal, tangent, skin);
+}
+
+void CpuMesh::WriteVertex(uint32 index, vec3 position, vec2 uv, vec3 normal, vec3 tangent, SkinningWeights skin) {
+	uint8* ptrVertex = _vertices + VertexSize * index;
 	if (Flags & EMeshCreationFlagsWithPositions) {
 		*reinterpret_cast<vec3*>(ptrVertex) = position;
 		ptrVertex += sizeof(vec3);
 	}
 	if (Flags & EMeshCreationFlagsWithUvs) {
 		*(vec2*)ptrVertex = uv;
-		ptrVertex += sizeof(vec3);
+		ptrVertex += sizeof(vec2);
 	}
 	if (Flags & EMeshCreationFlagsWithNormals) {
 		*(vec3*)ptrVertex = normal;
@@ -112,12 +245,10 @@ void CpuMesh::PushVertex(vec3 position, vec2 uv, vec3 normal, vec3 tangent, Skin
 	}
 	if (Flags & EMeshCreationFlagsWithSkin) {
 		*(SkinningWeights*)ptrVertex = skin;
-		ptrVertex += sizeof(vec3);
+		ptrVertex += sizeof(SkinningWeights);
 	}
-	++_numVertices;
 }
 
-
 void CpuMesh::PushTriangle(IndexT a, IndexT b, IndexT c) {
 	_triangles[_numTriangles++] = { a, b, c };
 }
@@ -920,16 +1051,48 @@ SubmeshInfo CpuMesh::PushMace(uint16 slices, float shaftRadius, float headRadius
 }
 
 SubmeshInfo CpuMesh::PushAssimpMesh(const struct aiMesh* mesh, float scale, BoundingBox *aabb, AnimationSkeleton* skeleton) {
-	AlignNextTriangle();
+	SubmeshInfo result;
+	ReserveAssimpMeshes(&mesh, 1, &result);
+	WriteAssimpMesh(mesh, result, scale, aabb, skeleton);
+	return result;
+}
 
-	uint32 baseVertex = _numVertices;
-	uint32 firstTriangle = _numTriangles;
+void CpuMesh::ReserveAssimpMeshes(const struct aiMesh* const* meshes, uint32 numMeshes, SubmeshInfo* outSubmeshes) {
+	uint32 numVertices = _numVertices;
+	uint32 numTriangles = _numTriangles;
 
-	if (sizeof(IndexT) == 2) {
-		assert(mesh->mNumVertices <= UINT16_MAX);
+	for (uint32 m = 0; m < numMeshes; ++m) {
+		const aiMesh* mesh = meshes[m];
+
+		if (sizeof(IndexT) == 2) {
+			assert(mesh->mNumVertices <= UINT16_MAX);
+		}
+
+		// Same alignment as AlignNextTriangle.
+		numTriangles = AlignTo(numTriangles, 8);
+
+		SubmeshInfo& submesh = outSubmeshes[m];
+		submesh.FirstTriangle = numTriangles;
+		submesh.NumTriangles = mesh->mNumFaces;
+		submesh.BaseVertex = numVertices;
+		submesh.NumVertices = mesh->mNumVertices;
+
+		numVertices += mesh->mNumVertices;
+		numTriangles += mesh->mNumFaces;
 	}
 
-	Reserve(mesh->mNumVertices, mesh->mNumFaces);
+	Reserve(numVertices - _numVertices, numTriangles - _numTriangles);
+
+	_numVertices = numVertices;
+	_numTriangles = numTriangles;
+}
+
+void CpuMesh::WriteAssimpMesh(const struct aiMesh* mesh, const SubmeshInfo& submesh, float scale, BoundingBox* aabb, const AnimationSkeleton* skeleton) {
+	uint32 baseVertex = submesh.BaseVertex;
+
+	assert(submesh.NumVertices == mesh->mNumVertices);
+	assert(submesh.NumTriangles == mesh->mNumFaces);
+
 	vec3 position(0.f, 0.f, 0.f);
 	vec3 normal(0.f,0.f,0.f);
 	vec3 tangent(0.f,0.f,0.f);
@@ -961,7 +1124,7 @@ SubmeshInfo CpuMesh::PushAssimpMesh(const struct aiMesh* mesh, float scale, Boun
 			uv = vec2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y);
 		}
 
-		PushVertex(position, uv, normal, tangent, {});
+		WriteVertex(baseVertex + i, position, uv, normal, tangent, {});
 	}
 
 	if ((Flags & EMeshCreationFlagsWithSkin) and skeleton) {
@@ -1021,20 +1184,174 @@ SubmeshInfo CpuMesh::PushAssimpMesh(const struct aiMesh* mesh, float scale, Boun
 		}
 	}
 
+	TriangleT* triangles = _triangles + submesh.FirstTriangle;
 	for (uint32 i = 0; i < mesh->mNumFaces; i++) {
 		const aiFace& face = mesh->mFaces[i];
-		PushTriangle(face.mIndices[0], face.mIndices[1], face.mIndices[2]);
+		triangles[i] = { (IndexT)face.mIndices[0], (IndexT)face.mIndices[1], (IndexT)face.mIndices[2] };
 	}
+}
 
-	SubmeshInfo result = {};
-	result.FirstTriangle = firstTriangle;
-	result.NumTriangles = mesh->mNumFaces;
-	result.BaseVertex = baseVertex;
-	result.NumVertices = mesh->mNumVertices;
+void CpuMesh::ReserveGltfPrimitives(const GltfDocument& document, const GltfPrimitive* const* primitives, uint32 numPrimitives, SubmeshInfo* outSubmeshes) {
+	uint32 numVertices = _numVertices;
+	uint32 numTriangles = _numTriangles;
 
-	return result;
+	for (uint32 p = 0; p < numPrimitives; ++p) {
+		const GltfPrimitive* primitive = primitives[p];
+
+		uint32 primitiveVertices = document.Accessors[primitive->Position].Count;
+		uint32 primitiveIndices = (primitive->Indices != GLTF_NONE) ? document.Accessors[primitive->Indices].Count : primitiveVertices;
+
+		numTriangles = AlignTo(numTriangles, 8);
+
+		SubmeshInfo& submesh = outSubmeshes[p];
+		submesh.FirstTriangle = numTriangles;
+		submesh.NumTriangles = primitiveIndices / 3;
+		submesh.BaseVertex = numVertices;
+		submesh.NumVertices = primitiveVertices;
+
+		numVertices += submesh.NumVertices;
+		numTriangles += submesh.NumTriangles;
+	}
+
+	Reserve(numVertices - _numVertices, numTriangles - _numTriangles);
+
+	_numVertices = numVertices;
+	_numTriangles = numTriangles;
 }
 
+bool CpuMesh::WriteGltfPrimitive(const GltfDocument& document, const GltfPrimitive& primitive, const SubmeshInfo& submesh, BoundingBox* aabb,
+	const GltfSkin* skin, const AnimationSkeleton* skeleton) {
+	VertexInfo info = GetVertexInfo(Flags);
+	uint8* vertices = _vertices + (uint64)submesh.BaseVertex * VertexSize;
+	uint32 numVertices = submesh.NumVertices;
+
+	// Readers write 'Count' elements and expect at least 'numComponents' per element.
+	auto isVertexAccessor = [&](int32 accessorIndex, uint32 numComponents) {
+		const GltfAccessor& accessor = document.Accessors[accessorIndex];
+		return accessor.Count == numVertices and accessor.NumComponents >= numComponents;
+	};
+
+	// Attributes the primitive doesn't have are zeroed, like in WriteAssimpMesh.
+	auto readAttribute = [&](int32 accessorIndex, uint32 numComponents, uint32 offset) {
+		if (accessorIndex == GLTF_NONE) {
+			for (uint32 i = 0; i < numVertices; ++i) {
+				memset(vertices + (uint64)i * VertexSize + offset, 0, numComponents * sizeof(float));
+			}
+			return true;
+		}
+		return isVertexAccessor(accessorIndex, numComponents)
+			and ReadGltfFloats(document, document.Accessors[accessorIndex], numComponents, vertices + offset, VertexSize);
+	};
+
+	if ((Flags & EMeshCreationFlagsWithPositions) and not readAttribute(primitive.Position, 3, info.PositionOffset)) {
+		return false;
+	}
+	if ((Flags & EMeshCreationFlagsWithUvs) and not readAttribute(primitive.TexCoord0, 2, info.UvOffset)) {
+		return false;
+	}
+	if ((Flags & EMeshCreationFlagsWithNormals) and not readAttribute(primitive.Normal, 3, info.NormalOffset)) {
+		return false;
+	}
+	if ((Flags & EMeshCreationFlagsWithTangents) and not readAttribute(primitive.Tangent, 3, info.TangentOffset)) {
+		return false;
+	}
+
+	TriangleT* triangles = _triangles + submesh.FirstTriangle;
+	if (primitive.Indices != GLTF_NONE) {
+		const GltfAccessor& accessor = document.Accessors[primitive.Indices];
+		if (accessor.Count != submesh.NumTriangles * 3 or accessor.NumComponents != 1
+			or not ReadGltfUints(document, accessor, 1, triangles, sizeof(IndexT))) {
+			return false;
+		}
+		for (uint32 i = 0; i < submesh.NumTriangles; ++i) {
+			if (triangles[i].A >= numVertices or triangles[i].B >= numVertices or triangles[i].C >= numVertices) {
+				return false;
+			}
+		}
+	}
+	else {
+		if (numVertices != submesh.NumTriangles * 3) {
+			return false;
+		}
+		for (uint32 i = 0; i < submesh.NumTriangles; ++i) {
+			triangles[i] = { i * 3, i * 3 + 1, i * 3 + 2 };
+		}
+	}
+
+	if ((Flags & EMeshCreationFlagsWithTangents) and primitive.Tangent == GLTF_NONE and primitive.TexCoord0 != GLTF_NONE and primitive.Normal != GLTF_NONE) {
+		std::vector<vec3> positions(numVertices);
+		std::vector<vec2> uvs(numVertices);
+		std::vector<vec3> normals(numVertices);
+		std::vector<vec3> tangents(numVertices);
+
+		// Without UVs or normals in the vertex format, these accessors haven't been checked above.
+		if (not isVertexAccessor(primitive.Position, 3) or not isVertexAccessor(primitive.TexCoord0, 2) or not isVertexAccessor(primitive.Normal, 3)
+			or not ReadGltfFloats(document, document.Accessors[primitive.Position], 3, positions.data(), sizeof(vec3))
+			or not ReadGltfFloats(document, document.Accessors[primitive.TexCoord0], 2, uvs.data(), sizeof(vec2))
+			or not ReadGltfFloats(document, document.Accessors[primitive.Normal], 3, normals.data(), sizeof(vec3))) {
+			return false;
+		}
+
+		GenerateTangents(positions.data(), uvs.data(), normals.data(), triangles, submesh.NumTriangles, numVertices, tangents.data());
+		for (uint32 i = 0; i < numVertices; ++i) {
+			memcpy(vertices + (uint64)i * VertexSize + info.TangentOffset, &tangents[i], sizeof(vec3));
+		}
+	}
+
+	if (Flags & EMeshCreationFlagsWithSkin) {
+		std::vector<uint32> joints(numVertices * 4, 0);
+		std::vector<float> weights(numVertices * 4, 0.f);
+
+		if (skin and skeleton and primitive.Joints0 != GLTF_NONE and primitive.Weights0 != GLTF_NONE) {
+			const GltfAccessor& jointAccessor = document.Accessors[primitive.Joints0];
+			const GltfAccessor& weightAccessor = document.Accessors[primitive.Weights0];
+			if (jointAccessor.Count != numVertices or weightAccessor.Count != numVertices or jointAccessor.NumComponents != 4
+				or weightAccessor.NumComponents != 4 or not ReadGltfUints(document, jointAccessor, 4, joints.data(), sizeof(uint32) * 4)
+				or not ReadGltfFloats(document, weightAccessor, 4, weights.data(), sizeof(float) * 4)) {
+				return false;
+			}
+
+			// JOINTS_0 indexes into the skin's joint list. The skeleton knows the joints by name.
+			std::vector<uint32> skinToSkeleton(skin->Joints.size());
+			for (uint32 i = 0; i < (uint32)skin->Joints.size(); ++i) {
+				auto it = skeleton->NameToJointId.find(document.Nodes[skin->Joints[i]].Name);
+				if (it == skeleton->NameToJointId.end() or it->second > UINT8_MAX) {
+					return false;
+				}
+				skinToSkeleton[i] = it->second;
+			}
+
+			for (uint32 i = 0; i < numVertices * 4; ++i) {
+				if (weights[i] <= 0.f) {
+					joints[i] = 0;
+					weights[i] = 0.f;
+				}
+				else if (joints[i] >= (uint32)skinToSkeleton.size()) {
+					return false;
+				}
+				else {
+					joints[i] = skinToSkeleton[joints[i]];
+				}
+			}
+		}
+
+		for (uint32 i = 0; i < numVertices; ++i) {
+			SkinningWeights skinWeights = QuantizeSkinWeights(&joints[i * 4], &weights[i * 4]);
+			memcpy(vertices + (uint64)i * VertexSize + SkinOffset, &skinWeights, sizeof(SkinningWeights));
+		}
+	}
+
+	if (aabb) {
+		*aabb = BoundingBox::NegativeInfinity();
+		if (Flags & EMeshCreationFlagsWithPositions) {
+			for (uint32 i = 0; i < numVertices; ++i) {
+				aabb->Grow(*(const vec3*)(vertices + (uint64)i * VertexSize + info.PositionOffset));
+			}
+		}
+	}
+
+	return true;
+}
 
 DxMesh CpuMesh::CreateDxMesh() const {
 	DxMesh result;
@@ -1054,10 +1371,16 @@ Ptr<DxVertexBuffer> CpuMesh::CreateVertexBufferWithAlternativeLayout(uint32 othe
 		}
 	}
 #endif
+	// The buffer copies the data, so the own vertices can be used directly if nothing is removed.
+	if (otherFlags == Flags) {
+		return DxVertexBuffer::Create(VertexSize, _numVertices, _vertices, allowUnorderedAccess);
+	}
+
 	VertexInfo ownInfo = GetVertexInfo(Flags);
 	VertexInfo newInfo = GetVertexInfo(otherFlags);
 
-	uint8* newVertices = (uint8*)malloc(newInfo.VertexSize * _numVertices);
+	uint64 newSize = (uint64)newInfo.VertexSize * _numVertices;
+	uint8* newVertices = _arena ? (uint8*)_arena->Allocate(newSize) : (uint8*)malloc(newSize);
 
 	for (uint32 i = 0; i < _numVertices; i++) {
 		uint8* ownBase = _vertices + i * ownInfo.VertexSize;
@@ -1081,7 +1404,9 @@ Ptr<DxVertexBuffer> CpuMesh::CreateVertexBufferWithAlternativeLayout(uint32 othe
 	}
 
 	Ptr<DxVertexBuffer> vertexBuffer = DxVertexBuffer::Create(newInfo.VertexSize, _numVertices, newVertices, allowUnorderedAccess);
-	free(newVertices);
+	if (not _arena) {
+		free(newVertices);
+	}
 	return vertexBuffer;
 }
 
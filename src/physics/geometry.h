@@ -3,6 +3,7 @@
 #include "bounding_volumes.h"
 #include "../animation/animation.h"
 #include "../directx/DxBuffer.h"
+#include "../core/memory.h"
 
 class SubmeshInfo {
 public:
@@ -47,7 +48,9 @@ public:
 	using TriangleT = IndexedLine32;
 
 	CpuMesh() = default;
-	CpuMesh(uint32 flags);
+	// With an arena, the vertices and triangles are allocated from it and never freed by the mesh. Growing leaves the previous copy in the
+	// arena, so this suits meshes which are built, uploaded and then thrown away together with the arena's contents.
+	CpuMesh(uint32 flags, MemoryArena* arena = nullptr);
 	CpuMesh(const CpuMesh&) = delete;
 	CpuMesh(CpuMesh&& mesh);
 	~CpuMesh();
@@ -56,6 +59,14 @@ public:
 	uint32 VertexSize = 0;
 	uint32 SkinOffset = 0;
 
+	// How often the storage had to grow so far, and how many bytes of vertices and triangles were moved by that.
+	uint32 NumGrowths = 0;
+	uint64 NumBytesCopied = 0;
+
+	// Grows the storage to hold 'numVertices' and 'numTriangles' in total, for callers which know the final size up front. Submeshes
+	// start on a multiple of 8 triangles, so each may need up to 7 triangles of padding on top of its own.
+	void ReserveCapacity(uint32 numVertices, uint32 numTriangles, uint32 numSubmeshes = 1);
+
 	SubmeshInfo PushQuad(vec2 radius);
 	SubmeshInfo PushQuad(float radius) { return PushQuad(vec2(radius, radius)); }
 	SubmeshInfo PushCube(vec3 radius, bool flipWindingOrder = false, vec3 center = vec3(0.f, 0.f, 0.f));
@@ -70,6 +81,18 @@ public:
 
 	SubmeshInfo PushAssimpMesh(const struct aiMesh* mesh, float scale, BoundingBox* aabb = nullptr, AnimationSkeleton* skeleton = nullptr);
 
+	// Grows the mesh once for all 'meshes' and returns the slice of vertices and triangles reserved for each of them.
+	// The slices are filled with WriteAssimpMesh, which only touches its own slice and can therefore run on several threads at once.
+	void ReserveAssimpMeshes(const struct aiMesh* const* meshes, uint32 numMeshes, SubmeshInfo* outSubmeshes);
+	void WriteAssimpMesh(const struct aiMesh* mesh, const SubmeshInfo& submesh, float scale, BoundingBox* aabb = nullptr, const AnimationSkeleton* skeleton = nullptr);
+
+	// Same for the triangle primitives of a glTF document. The attributes are converted straight from the document's buffers into the
+	// interleaved vertices. Missing tangents are generated from the UVs. Returns false if the primitive's accessors don't match each other.
+	// 'skin' and 'skeleton' are only read with EMeshCreationFlagsWithSkin.
+	void ReserveGltfPrimitives(const struct GltfDocument& document, const struct GltfPrimitive* const* primitives, uint32 numPrimitives, SubmeshInfo* outSubmeshes);
+	bool WriteGltfPrimitive(const struct GltfDocument& document, const struct GltfPrimitive& primitive, const SubmeshInfo& submesh, BoundingBox* aabb = nullptr,
+		const struct GltfSkin* skin = nullptr, const AnimationSkeleton* skeleton = nullptr);
+
 	DxMesh CreateDxMesh() const;
 	Ptr<DxVertexBuffer> CreateVertexBufferWithAlternativeLayout(uint32 otherFlags, bool allowUnorderedAccess = false) const;
 
@@ -82,10 +105,18 @@ private:
 	uint32 _numVertices = 0;
 	uint32 _numTriangles = 0;
 
+	uint32 _vertexCapacity = 0;
+	uint32 _triangleCapacity = 0;
+
+	MemoryArena* _arena = nullptr;
+
 	void AlignNextTriangle();
 	void Reserve(uint32 vertexCount, uint32 triangleCount);
+	void Grow(uint32 vertexCapacity, uint32 triangleCapacity);
+	void* AllocateStorage(uint64 size);
 	void PushTriangle(IndexT a, IndexT b, IndexT c);
 	void PushVertex(vec3 position, vec2 uv, vec3 normal, vec3 tangent, SkinningWeights skin);
+	void WriteVertex(uint32 index, vec3 position, vec2 uv, vec3 normal, vec3 tangent, SkinningWeights skin);
 };
 
 static D3D12_INPUT_ELEMENT_DESC inputLayoutPosition[] = {
@@ -0,0 +1,19 @@
+#include "../pch.h"
+#include "gltf.h"
+#include "../render/pbr.hpp"
+
+Ptr<PbrMaterial> LoadGltfMaterial(const GltfDocument& document, const GltfMaterial& material) {
+    // Images embedded in a buffer have no path and are skipped.
+    auto getImagePath = [&document](int32 image) {
+        return (image != GLTF_NONE) ? document.Images[image].Path.string() : std::string();
+    };
+
+    std::string albedoName = getImagePath(material.BaseColorImage);
+    std::string normalName = getImagePath(material.NormalImage);
+
+    vec4 albedoTint(material.BaseColorFactor[0], material.BaseColorFactor[1], material.BaseColorFactor[2], material.BaseColorFactor[3]);
+    vec4 emission(material.EmissiveFactor[0], material.EmissiveFactor[1], material.EmissiveFactor[2], 1.f);
+
+    return CreatePBRMaterial(albedoName.empty() ? 0 : albedoName.c_str(), normalName.empty() ? 0 : normalName.c_str(), 0, 0,
+        emission, albedoTint, material.RoughnessFactor, material.MetallicFactor);
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "../core/math.h"
+#include "../core/gltf.h"
+
+static mat4 ReadGltfNodeTransform(const GltfNode& node) {
+    vec3 translation(node.Translation[0], node.Translation[1], node.Translation[2]);
+    quat rotation(node.Rotation[0], node.Rotation[1], node.Rotation[2], node.Rotation[3]);
+    vec3 scale(node.Scale[0], node.Scale[1], node.Scale[2]);
+    return trsToMat4(trs(translation, rotation, scale));
+}
+
+// The packed metallic-roughness texture is not bound, since the shader samples roughness and metallic from separate single-channel
+// textures. Its factors are used as overrides instead.
+Ptr<class PbrMaterial> LoadGltfMaterial(const GltfDocument& document, const GltfMaterial& material);
@@ -3,6 +3,15 @@
 #include "../render/pbr.hpp"
 
 #include "assimp.h"
+#include "gltf.h"
+#include "../directx/DxContext.h"
+#include "../core/threading.h"
+#include "../core/cpuProfiling.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace fs = std::filesystem;
 
 namespace {
     void GetMeshNamesAndTransforms(const aiNode *node, Ptr<CompositeMesh> &mesh,
@@ -19,9 +28,44 @@ namespace {
             GetMeshNamesAndTransforms(node->mChildren[i], mesh, transform);
         }
     }
+
+    // glTF counterpart. A mesh referenced by several nodes gets the name and transform of the last one, like in the Assimp path.
+    void GetGltfMeshNamesAndTransforms(const GltfDocument& document, uint32 nodeIndex, const std::vector<uint32>& firstSubmesh,
+                                       std::vector<int32>& meshSkins, Ptr<CompositeMesh>& mesh, const mat4& parentTransform = mat4::identity) {
+        const GltfNode& node = document.Nodes[nodeIndex];
+        mat4 transform = parentTransform * ReadGltfNodeTransform(node);
+        if (node.Mesh != GLTF_NONE) {
+            uint32 numPrimitives = (uint32)document.Meshes[node.Mesh].Primitives.size();
+            for (uint32 i = 0; i < numPrimitives; ++i) {
+                auto &submesh = mesh->Submeshes[firstSubmesh[node.Mesh] + i];
+                submesh.name = node.Name;
+                submesh.Transform = transform;
+            }
+            meshSkins[node.Mesh] = node.Skin;
+        }
+
+        for (uint32 child : node.Children) {
+            GetGltfMeshNamesAndTransforms(document, child, firstSubmesh, meshSkins, mesh, transform);
+        }
+    }
+
+    // Everything else is left to Assimp, which triangulates, generates normals and so on.
+    bool IsGltfPrimitiveSupported(const GltfDocument& document, const GltfPrimitive& primitive, uint32 flags) {
+        if (primitive.Mode != EGltfPrimitiveModeTriangles or primitive.Position == GLTF_NONE) {
+            return false;
+        }
+        if ((flags & EMeshCreationFlagsWithNormals) and primitive.Normal == GLTF_NONE) {
+            return false;
+        }
+        uint32 numIndices = (primitive.Indices != GLTF_NONE) ? document.Accessors[primitive.Indices].Count : document.Accessors[primitive.Position].Count;
+        return numIndices % 3 == 0;
+    }
 }
 
-Ptr<CompositeMesh> LoadMeshFromFile(const char *sceneFilename, uint32 flags) {
+Ptr<CompositeMesh> LoadAssimpMeshFromFile(const char *sceneFilename, uint32 flags, MeshLoadTimings* outTimings) {
+    using clock = std::chrono::high_resolution_clock;
+    auto start = clock::now();
+
     Assimp::Importer importer;
 
     const aiScene *scene = LoadAssimpSceneFile(sceneFilename, importer);
@@ -30,6 +74,18 @@ Ptr<CompositeMesh> LoadMeshFromFile(const char *sceneFilename, uint32 flags) {
         return 0;
     }
 
+    auto imported = clock::now();
+
+    // Materials are shared between submeshes, so each one is only resolved once. This loads their textures and
+    // runs on the job system, in parallel to the conversion of the geometry below.
+    std::vector<Ptr<PbrMaterial>> materials(scene->mNumMaterials);
+    ThreadJobContext materialContext;
+    for (uint32 i = 0; i < scene->mNumMaterials; ++i) {
+        materialContext.AddWork([&materials, scene, i]() {
+            materials[i] = LoadAssimpMaterial(scene->mMaterials[i]);
+        });
+    }
+
     CpuMesh cpuMesh(flags);
 
     Ptr<CompositeMesh> result = MakePtr<CompositeMesh>();
@@ -58,26 +114,202 @@ Ptr<CompositeMesh> LoadMeshFromFile(const char *sceneFilename, uint32 flags) {
     result->Submeshes.resize(scene->mNumMeshes);
     GetMeshNamesAndTransforms(scene->mRootNode, result);
 
+    // All submeshes get their slice of the vertex and index memory up front, so they can be converted in parallel.
+    std::vector<SubmeshInfo> infos(scene->mNumMeshes);
+    cpuMesh.ReserveAssimpMeshes(scene->mMeshes, scene->mNumMeshes, infos.data());
+
+    const AnimationSkeleton* skeleton = (flags & EMeshCreationFlagsWithSkin) ? &result->Skeleton : 0;
+
+    ThreadJobContext convertContext;
+    for (uint32 m = 1; m < scene->mNumMeshes; ++m) {
+        convertContext.AddWork([&cpuMesh, &infos, &result, scene, skeleton, m]() {
+            cpuMesh.WriteAssimpMesh(scene->mMeshes[m], infos[m], 1.f, &result->Submeshes[m].AABB, skeleton);
+        });
+    }
+    if (scene->mNumMeshes > 0) {
+        cpuMesh.WriteAssimpMesh(scene->mMeshes[0], infos[0], 1.f, &result->Submeshes[0].AABB, skeleton);
+    }
+    convertContext.WaitForWorkCompletion();
+
+    auto converted = clock::now();
+
+    materialContext.WaitForWorkCompletion();
+
+    auto materialsResolved = clock::now();
+
     result->AABB = BoundingBox::NegativeInfinity();
 
     for (uint32 m = 0; m < scene->mNumMeshes; ++m) {
         Submesh &sub = result->Submeshes[m];
 
-        aiMesh *mesh = scene->mMeshes[m];
-        sub.Info = cpuMesh.PushAssimpMesh(mesh, 1.f, &sub.AABB,
-                                          (flags & EMeshCreationFlagsWithSkin) ? &result->Skeleton : 0);
+        sub.Info = infos[m];
         sub.Material = scene->HasMaterials()
-                           ? LoadAssimpMaterial(scene->mMaterials[mesh->mMaterialIndex])
+                           ? materials[scene->mMeshes[m]->mMaterialIndex]
                            : GetDefaultPBRMaterial();
 
         result->AABB.Grow(sub.AABB.MinCorner);
         result->AABB.Grow(sub.AABB.MaxCorner);
     }
 
-    result->Mesh = cpuMesh.CreateDxMesh();
+    {
+        std::lock_guard lock(DxContext::Instance().ResourceCreationMutex());
+        result->Mesh = cpuMesh.CreateDxMesh();
+    }
+
+    result->Filepath = sceneFilename;
+    result->Flags = flags;
+
+    auto uploaded = clock::now();
+
+    if (outTimings) {
+        outTimings->Import = std::chrono::duration<double, std::milli>(imported - start).count();
+        outTimings->Convert = std::chrono::duration<double, std::milli>(converted - imported).count();
+        outTimings->Material = std::chrono::duration<double, std::milli>(materialsResolved - converted).count();
+        outTimings->Upload = std::chrono::duration<double, std::milli>(uploaded - materialsResolved).count();
+    }
 
     return result;
+}
+
+// Reads the document directly. The attribute accessors are converted into the interleaved vertex layout without an intermediate
+// scene, so there is no import cache to go through either. Returns null for files which need Assimp's post-processing.
+Ptr<CompositeMesh> LoadGltfMeshFromFile(const char *sceneFilename, uint32 flags, MeshLoadTimings* outTimings) {
+    using clock = std::chrono::high_resolution_clock;
+    auto start = clock::now();
+
+    GltfDocument document;
+    if (not LoadGltfDocument(sceneFilename, document)) {
+        return 0;
+    }
+
+    // Each primitive becomes a submesh. The primitives of a mesh are consecutive.
+    std::vector<const GltfPrimitive*> primitives;
+    std::vector<uint32> firstSubmesh(document.Meshes.size());
+    for (uint32 m = 0; m < (uint32)document.Meshes.size(); ++m) {
+        firstSubmesh[m] = (uint32)primitives.size();
+        for (const GltfPrimitive& primitive : document.Meshes[m].Primitives) {
+            if (not IsGltfPrimitiveSupported(document, primitive, flags)) {
+                return 0;
+            }
+            primitives.push_back(&primitive);
+        }
+    }
+
+    Ptr<CompositeMesh> result = MakePtr<CompositeMesh>();
+
+    if (flags & EMeshCreationFlagsWithSkin) {
+        if (not result->Skeleton.LoadFromGltf(document) or result->Skeleton.Joints.size() > 256) {
+            return 0;
+        }
+
+        for (uint32 i = 0; i < (uint32)document.Animations.size(); ++i) {
+            result->Skeleton.PushGltfAnimation(sceneFilename, document, i);
+        }
+    }
+
+    uint32 numSubmeshes = (uint32)primitives.size();
+    result->Submeshes.resize(numSubmeshes);
+    for (uint32 m = 0; m < (uint32)document.Meshes.size(); ++m) {
+        for (uint32 i = 0; i < (uint32)document.Meshes[m].Primitives.size(); ++i) {
+            result->Submeshes[firstSubmesh[m] + i].name = document.Meshes[m].Name;
+            result->Submeshes[firstSubmesh[m] + i].Transform = trs::identity;
+        }
+    }
+
+    std::vector<int32> meshSkins(document.Meshes.size(), GLTF_NONE);
+    for (uint32 root : document.SceneRoots) {
+        GetGltfMeshNamesAndTransforms(document, root, firstSubmesh, meshSkins, result);
+    }
+
+    auto imported = clock::now();
+
+    std::vector<Ptr<PbrMaterial>> materials(document.Materials.size());
+    ThreadJobContext materialContext;
+    for (uint32 i = 0; i < (uint32)document.Materials.size(); ++i) {
+        materialContext.AddWork([&materials, &document, i]() {
+            materials[i] = LoadGltfMaterial(document, document.Materials[i]);
+        });
+    }
+
+    CpuMesh cpuMesh(flags);
+
+    std::vector<SubmeshInfo> infos(numSubmeshes);
+    cpuMesh.ReserveGltfPrimitives(document, primitives.data(), numSubmeshes, infos.data());
+
+    const AnimationSkeleton* skeleton = (flags & EMeshCreationFlagsWithSkin) ? &result->Skeleton : 0;
+
+    // One job per mesh, since the skin belongs to the mesh.
+    std::vector<uint8> converted(numSubmeshes, 0);
+    ThreadJobContext convertContext;
+    for (uint32 m = 0; m < (uint32)document.Meshes.size(); ++m) {
+        convertContext.AddWork([&cpuMesh, &document, &primitives, &infos, &firstSubmesh, &meshSkins, &converted, &result, skeleton, m]() {
+            const GltfSkin* skin = (meshSkins[m] != GLTF_NONE) ? &document.Skins[meshSkins[m]] : 0;
+            for (uint32 i = 0; i < (uint32)document.Meshes[m].Primitives.size(); ++i) {
+                uint32 s = firstSubmesh[m] + i;
+                converted[s] = cpuMesh.WriteGltfPrimitive(document, *primitives[s], infos[s], &result->Submeshes[s].AABB, skin, skeleton);
+            }
+        });
+    }
+    convertContext.WaitForWorkCompletion();
+
+    auto convertedTime = clock::now();
+
+    materialContext.WaitForWorkCompletion();
+
+    auto materialsResolved = clock::now();
+
+    if (std::find(converted.begin(), converted.end(), 0) != converted.end()) {
+        return 0;
+    }
+
+    result->AABB = BoundingBox::NegativeInfinity();
+
+    for (uint32 s = 0; s < numSubmeshes; ++s) {
+        Submesh &sub = result->Submeshes[s];
+
+        sub.Info = infos[s];
+        sub.Material = (primitives[s]->Material != GLTF_NONE)
+                           ? materials[primitives[s]->Material]
+                           : GetDefaultPBRMaterial();
+
+        result->AABB.Grow(sub.AABB.MinCorner);
+        result->AABB.Grow(sub.AABB.MaxCorner);
+    }
+
+    {
+        std::lock_guard lock(DxContext::Instance().ResourceCreationMutex());
+        result->Mesh = cpuMesh.CreateDxMesh();
+    }
+
     result->Filepath = sceneFilename;
     result->Flags = flags;
+
+    auto uploaded = clock::now();
+
+    if (outTimings) {
+        outTimings->Import = std::chrono::duration<double, std::milli>(imported - start).count();
+        outTimings->Convert = std::chrono::duration<double, std::milli>(convertedTime - imported).count();
+        outTimings->Material = std::chrono::duration<double, std::milli>(materialsResolved - convertedTime).count();
+        outTimings->Upload = std::chrono::duration<double, std::milli>(uploaded - materialsResolved).count();
+    }
+
     return result;
 }
+
+namespace {
+    bool IsGltfFile(const char *sceneFilename) {
+        fs::path extension = fs::path(sceneFilename).extension();
+        return extension == ".gltf" or extension == ".glb" or extension == ".GLTF" or extension == ".GLB";
+    }
+}
+
+Ptr<CompositeMesh> LoadMeshFromFile(const char *sceneFilename, uint32 flags, MeshLoadTimings* outTimings) {
+    CPU_PROFILE_BLOCK("Load mesh");
+
+    if (IsGltfFile(sceneFilename)) {
+        if (Ptr<CompositeMesh> result = LoadGltfMeshFromFile(sceneFilename, flags, outTimings)) {
+            return result;
+        }
+    }
+    return LoadAssimpMeshFromFile(sceneFilename, flags, outTimings);
+}
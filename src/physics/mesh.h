@@ -27,9 +27,24 @@ struct CompositeMesh {
     uint32 Flags;
 };
 
-Ptr<CompositeMesh> LoadMeshFromFile(const char* sceneFilename, uint32 flags = EMeshCreationFlagsWithPositions | EMeshCreationFlagsWithUvs | EMeshCreationFlagsWithNormals | EMeshCreationFlagsWithTangents);
+// Wall time of each stage of LoadMeshFromFile, in milliseconds.
+// Materials are resolved on the job system while the submeshes are converted, so 'Material' is the time the loader still had to wait for them afterwards.
+struct MeshLoadTimings {
+    double Import;
+    double Convert;
+    double Material;
+    double Upload;
+};
+
+// Safe to call from several threads. The submeshes are converted and the materials resolved on the job system.
+// .gltf and .glb files are read directly, without Assimp, unless they use something only Assimp handles.
+Ptr<CompositeMesh> LoadMeshFromFile(const char* sceneFilename, uint32 flags = EMeshCreationFlagsWithPositions | EMeshCreationFlagsWithUvs | EMeshCreationFlagsWithNormals | EMeshCreationFlagsWithTangents, MeshLoadTimings* outTimings = nullptr);
 
 // Same function but with different default flags (includes skin).
-inline Ptr<CompositeMesh> LoadAnimatedMeshFromFile(const char* sceneFilename, uint32 flags = EMeshCreationFlagsWithPositions | EMeshCreationFlagsWithUvs | EMeshCreationFlagsWithNormals | EMeshCreationFlagsWithTangents | EMeshCreationFlagsWithSkin) {
-    return LoadMeshFromFile(sceneFilename, flags);
-}
\ No newline at end of file
+inline Ptr<CompositeMesh> LoadAnimatedMeshFromFile(const char* sceneFilename, uint32 flags = EMeshCreationFlagsWithPositions | EMeshCreationFlagsWithUvs | EMeshCreationFlagsWithNormals | EMeshCreationFlagsWithTangents | EMeshCreationFlagsWithSkin, MeshLoadTimings* outTimings = nullptr) {
+    return LoadMeshFromFile(sceneFilename, flags, outTimings);
+}
+
+// The two paths behind LoadMeshFromFile. The glTF one returns null for files which need Assimp's post-processing.
+Ptr<CompositeMesh> LoadAssimpMeshFromFile(const char* sceneFilename, uint32 flags, MeshLoadTimings* outTimings = nullptr);
+Ptr<CompositeMesh> LoadGltfMeshFromFile(const char* sceneFilename, uint32 flags, MeshLoadTimings* outTimings = nullptr);
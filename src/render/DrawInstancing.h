@@ -0,0 +1,56 @@
+#pragma once
+
+#include "../pch.h"
+#include "../physics/geometry.h"
+
+// Upper bound for one instanced draw. Keeps the per-draw instance buffer well inside a single upload page.
+#define MAX_NUM_INSTANCES_PER_DRAW 1024
+
+struct InstanceRun {
+	uint32 First;
+	uint32 Count;
+};
+
+static bool IsSameSubmesh(const SubmeshInfo& a, const SubmeshInfo& b) {
+	return a.FirstTriangle == b.FirstTriangle and a.NumTriangles == b.NumTriangles and a.BaseVertex == b.BaseVertex;
+}
+
+// Merge criterion of the depth-only and shadow passes: same buffers and same submesh.
+struct SameGeometry {
+	template <typename DrawCallT>
+	bool operator()(const DrawCallT& a, const DrawCallT& b) const {
+		return a.VertexBuffer == b.VertexBuffer and a.IndexBuffer == b.IndexBuffer and IsSameSubmesh(a.Submesh, b.Submesh);
+	}
+};
+
+// Merge criterion of the opaque pass: additionally the same material, whose pipeline must have an instanced variant.
+struct SameMaterialAndGeometry {
+	template <typename DrawCallT>
+	bool operator()(const DrawCallT& first, const DrawCallT& other) const {
+		return first.InstancedMaterialSetup and first.MaterialSetup == other.MaterialSetup and first.Material == other.Material and SameGeometry{}(first, other);
+	}
+};
+
+// Splits an already sorted draw list into runs of consecutive draws, which can be collapsed into one instanced draw.
+// 'canInstance(first, other)' decides whether 'other' can be rendered as an instance of the run started by 'first'.
+// Runs are capped at MAX_NUM_INSTANCES_PER_DRAW. Draws which can't be merged end up as runs of length 1.
+// Returns the number of draws saved.
+template <typename DrawCallT, typename PredicateT>
+static uint32 FindInstanceRuns(const DrawCallT* drawCalls, uint32 numDrawCalls, const PredicateT& canInstance, std::vector<InstanceRun>& outRuns) {
+	outRuns.clear();
+
+	uint32 i = 0;
+	while (i < numDrawCalls) {
+		const DrawCallT& first = drawCalls[i];
+
+		uint32 count = 1;
+		while (i + count < numDrawCalls and count < MAX_NUM_INSTANCES_PER_DRAW and canInstance(first, drawCalls[i + count])) {
+			++count;
+		}
+
+		outRuns.push_back({ i, count });
+		i += count;
+	}
+
+	return numDrawCalls - (uint32)outRuns.size();
+}
@@ -0,0 +1,153 @@
+#include "DrawSort.h"
+#include "../core/threading.h"
+
+#define RADIX_SORT_NUM_BUCKETS 256
+#define RADIX_SORT_MAX_NUM_CHUNKS 8
+#define RADIX_SORT_MIN_CHUNK_SIZE 2048
+
+namespace {
+	struct RadixSortChunk {
+		uint32 First;
+		uint32 Count;
+		uint32 Offsets[RADIX_SORT_NUM_BUCKETS];
+	};
+
+	uint64 MaskBits(uint32 value, uint32 numBits) {
+		return (uint64)value & ((1ull << numBits) - 1);
+	}
+
+	void CountDigits(const SortItem* items, RadixSortChunk& chunk, uint32 shift) {
+		memset(chunk.Offsets, 0, sizeof(chunk.Offsets));
+		for (uint32 i = chunk.First, end = chunk.First + chunk.Count; i < end; i++) {
+			++chunk.Offsets[(items[i].Key >> shift) & 0xFF];
+		}
+	}
+
+	void ScatterDigits(const SortItem* src, SortItem* dst, RadixSortChunk& chunk, uint32 shift) {
+		for (uint32 i = chunk.First, end = chunk.First + chunk.Count; i < end; i++) {
+			uint32 digit = (src[i].Key >> shift) & 0xFF;
+			dst[chunk.Offsets[digit]++] = src[i];
+		}
+	}
+}
+
+uint32 DrawSortIdTable::GetId(uint64 value, uint32 numBits) {
+	auto it = _ids.find(value);
+	if (it == _ids.end()) {
+		it = _ids.insert({ value, (uint32)_ids.size() }).first;
+	}
+	return it->second & ((1u << numBits) - 1);
+}
+
+uint32 QuantizeSortDepth(float depth) {
+	// The bit pattern of a positive float increases monotonically with its value, so no depth range is needed.
+	// Dropping the lowest mantissa bits leaves 24 bits of precision relative to the magnitude.
+	if (not (depth > 0.f)) {
+		return 0;
+	}
+	uint32 bits;
+	memcpy(&bits, &depth, sizeof(float));
+	return bits >> (32 - SORT_KEY_DEPTH_BITS);
+}
+
+uint64 CreateOpaqueSortKey(uint32 layer, uint32 pipeline, uint32 material, uint32 geometry, float depth) {
+	uint64 key = MaskBits(layer, SORT_KEY_LAYER_BITS);
+	key = (key << SORT_KEY_PIPELINE_BITS) | MaskBits(pipeline, SORT_KEY_PIPELINE_BITS);
+	key = (key << SORT_KEY_MATERIAL_BITS) | MaskBits(material, SORT_KEY_MATERIAL_BITS);
+	key = (key << SORT_KEY_GEOMETRY_BITS) | MaskBits(geometry, SORT_KEY_GEOMETRY_BITS);
+	key = (key << SORT_KEY_DEPTH_BITS) | MaskBits(QuantizeSortDepth(depth), SORT_KEY_DEPTH_BITS);
+	return key;
+}
+
+uint64 CreateTransparentSortKey(uint32 layer, uint32 pipeline, uint32 material, uint32 geometry, float depth) {
+	uint32 invertedDepth = ((1u << SORT_KEY_DEPTH_BITS) - 1) - QuantizeSortDepth(depth);
+
+	uint64 key = MaskBits(layer, SORT_KEY_LAYER_BITS);
+	key = (key << SORT_KEY_DEPTH_BITS) | MaskBits(invertedDepth, SORT_KEY_DEPTH_BITS);
+	key = (key << SORT_KEY_PIPELINE_BITS) | MaskBits(pipeline, SORT_KEY_PIPELINE_BITS);
+	key = (key << SORT_KEY_MATERIAL_BITS) | MaskBits(material, SORT_KEY_MATERIAL_BITS);
+	key = (key << SORT_KEY_GEOMETRY_BITS) | MaskBits(geometry, SORT_KEY_GEOMETRY_BITS);
+	return key;
+}
+
+uint64 CreateGeometrySortKey(uint32 geometry, uint32 submesh, float depth) {
+	uint64 key = MaskBits(geometry, SORT_KEY_GEOMETRY_ONLY_BITS);
+	key = (key << SORT_KEY_SUBMESH_BITS) | MaskBits(submesh, SORT_KEY_SUBMESH_BITS);
+	key = (key << SORT_KEY_DEPTH_BITS) | MaskBits(QuantizeSortDepth(depth), SORT_KEY_DEPTH_BITS);
+	return key;
+}
+
+void RadixSort(SortItem* items, SortItem* scratch, uint32 count) {
+	if (count <= 1) {
+		return;
+	}
+
+	// One histogram per digit over the whole input. A digit whose histogram has a single full bucket does not change the order.
+	uint32 histograms[sizeof(uint64)][RADIX_SORT_NUM_BUCKETS] = {};
+	for (uint32 i = 0; i < count; i++) {
+		uint64 key = items[i].Key;
+		for (uint32 d = 0; d < sizeof(uint64); d++) {
+			++histograms[d][(key >> (d * 8)) & 0xFF];
+		}
+	}
+
+	uint32 numChunks = Min((uint32)RADIX_SORT_MAX_NUM_CHUNKS, Max(1u, count / RADIX_SORT_MIN_CHUNK_SIZE));
+	uint32 chunkSize = (count + numChunks - 1) / numChunks;
+
+	RadixSortChunk chunks[RADIX_SORT_MAX_NUM_CHUNKS];
+	for (uint32 c = 0; c < numChunks; c++) {
+		chunks[c].First = c * chunkSize;
+		chunks[c].Count = Min(chunkSize, count - chunks[c].First);
+	}
+
+	SortItem* src = items;
+	SortItem* dst = scratch;
+
+	for (uint32 d = 0; d < sizeof(uint64); d++) {
+		uint32 shift = d * 8;
+		if (histograms[d][(src[0].Key >> shift) & 0xFF] == count) {
+			continue;
+		}
+
+		if (numChunks == 1) {
+			uint32 offset = 0;
+			for (uint32 b = 0; b < RADIX_SORT_NUM_BUCKETS; b++) {
+				chunks[0].Offsets[b] = offset;
+				offset += histograms[d][b];
+			}
+			ScatterDigits(src, dst, chunks[0], shift);
+		}
+		else {
+			ThreadJobContext context;
+			for (uint32 c = 0; c < numChunks; c++) {
+				context.AddWork([src, &chunks, c, shift]() {
+					CountDigits(src, chunks[c], shift);
+				});
+			}
+			context.WaitForWorkCompletion();
+
+			// Bucket-major, chunk-minor prefix sum keeps the sort stable.
+			uint32 offset = 0;
+			for (uint32 b = 0; b < RADIX_SORT_NUM_BUCKETS; b++) {
+				for (uint32 c = 0; c < numChunks; c++) {
+					uint32 bucketCount = chunks[c].Offsets[b];
+					chunks[c].Offsets[b] = offset;
+					offset += bucketCount;
+				}
+			}
+
+			for (uint32 c = 0; c < numChunks; c++) {
+				context.AddWork([src, dst, &chunks, c, shift]() {
+					ScatterDigits(src, dst, chunks[c], shift);
+				});
+			}
+			context.WaitForWorkCompletion();
+		}
+
+		std::swap(src, dst);
+	}
+
+	if (src != items) {
+		memcpy(items, src, sizeof(SortItem) * count);
+	}
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "../pch.h"
+#include <unordered_map>
+
+// 64-bit draw sort keys. Fields from most to least significant bit:
+// Opaque:      [layer 2][pipeline 10][material 16][geometry 12][depth 24] -> state buckets, front-to-back inside a bucket.
+// Transparent: [layer 2][inverted depth 24][pipeline 10][material 16][geometry 12] -> strictly back-to-front.
+// Geometry:    [geometry 20][submesh 20][depth 24] -> identical meshes next to each other, for the depth-only and shadow passes.
+#define SORT_KEY_LAYER_BITS 2
+#define SORT_KEY_PIPELINE_BITS 10
+#define SORT_KEY_MATERIAL_BITS 16
+#define SORT_KEY_GEOMETRY_BITS 12
+#define SORT_KEY_DEPTH_BITS 24
+
+#define SORT_KEY_GEOMETRY_ONLY_BITS 20
+#define SORT_KEY_SUBMESH_BITS 20
+
+static_assert(SORT_KEY_LAYER_BITS + SORT_KEY_PIPELINE_BITS + SORT_KEY_MATERIAL_BITS + SORT_KEY_GEOMETRY_BITS + SORT_KEY_DEPTH_BITS == 64, "Sort key must use exactly 64 bits.");
+
+struct SortItem {
+	uint64 Key;
+	uint32 Index;
+};
+
+// Maps pointers (pipeline setup functions, materials, buffers) or other 64-bit values to small, dense ids for the key fields.
+// Ids are handed out in first-seen order and wrap around when a field overflows. This only weakens the grouping, the renderer still compares the real state.
+class DrawSortIdTable {
+public:
+	uint32 GetId(uint64 value, uint32 numBits);
+	uint32 GetId(const void* ptr, uint32 numBits) { return GetId((uint64)ptr, numBits); }
+	void Reset() { _ids.clear(); }
+
+private:
+	std::unordered_map<uint64, uint32> _ids;
+};
+
+// Scratch state for sorting draws by geometry. Each pass keeps its own, so that sorting stops allocating once the buffers have grown to the
+// pass's draw count.
+struct GeometrySortBuffers {
+	std::vector<SortItem> Items;
+	std::vector<SortItem> Scratch;
+	DrawSortIdTable GeometryIds;
+	DrawSortIdTable SubmeshIds;
+};
+
+// Combines the buffer pointer with the submesh range, so that different submeshes of one buffer land in different buckets.
+static uint64 GetSubmeshSortValue(const void* buffer, uint32 firstTriangle, uint32 baseVertex) {
+	return (uint64)buffer ^ ((uint64)firstTriangle << 32) ^ ((uint64)baseVertex * 0x9E3779B97F4A7C15ull);
+}
+
+uint32 QuantizeSortDepth(float depth);
+
+uint64 CreateOpaqueSortKey(uint32 layer, uint32 pipeline, uint32 material, uint32 geometry, float depth);
+uint64 CreateTransparentSortKey(uint32 layer, uint32 pipeline, uint32 material, uint32 geometry, float depth);
+uint64 CreateGeometrySortKey(uint32 geometry, uint32 submesh, float depth);
+
+// Stable LSD radix sort on the 64-bit key, 8 bits per pass. Passes over digits which are identical for all items are skipped.
+// Large inputs are split into chunks, which are histogrammed and scattered in parallel on the job system.
+// The result is written back to 'items'. 'scratch' must hold at least 'count' elements.
+void RadixSort(SortItem* items, SortItem* scratch, uint32 count);
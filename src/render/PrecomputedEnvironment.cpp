@@ -0,0 +1,172 @@
+#include "PrecomputedEnvironment.h"
+#include "../directx/DxContext.h"
+#include "../core/assetCache.h"
+#include "DirectXTex.h"
+
+#include <fstream>
+#include <iostream>
+
+namespace {
+	// Separate from the texture importer, so that the environment file's own texture cache entries never collide with these.
+	uint64 GetEnvironmentImporterVersion() {
+		return ((uint64)DIRECTX_TEX_VERSION << 32) | ((uint64)'E' << 24) | ENVIRONMENT_CACHE_VERSION;
+	}
+
+	// The prefiltered cubemap and the SH coefficients are separate cache entries. The lookup flags tell them apart: the SH only depend on
+	// the source, the cubemap also on its resolution.
+	constexpr uint32 SHCacheFlags = 0;
+
+	bool LoadEnvironmentImage(const fs::path& filename, DirectX::ScratchImage& outImage) {
+		fs::path extension = filename.extension();
+
+		DirectX::TexMetadata metadata;
+		DirectX::ScratchImage image;
+		HRESULT result;
+		if (extension == ".hdr") {
+			result = DirectX::LoadFromHDRFile(filename.c_str(), &metadata, image);
+		}
+		else if (extension == ".dds") {
+			result = DirectX::LoadFromDDSFile(filename.c_str(), DirectX::DDS_FLAGS_NONE, &metadata, image);
+		}
+		else if (extension == ".tga") {
+			result = DirectX::LoadFromTGAFile(filename.c_str(), &metadata, image);
+		}
+		else {
+			result = DirectX::LoadFromWICFile(filename.c_str(), DirectX::WIC_FLAGS_FORCE_RGB, &metadata, image);
+		}
+
+		if (FAILED(result) or metadata.dimension != DirectX::TEX_DIMENSION_TEXTURE2D) {
+			return false;
+		}
+
+		if (metadata.format == DXGI_FORMAT_R32G32B32A32_FLOAT) {
+			outImage = std::move(image);
+			return true;
+		}
+
+		// Only the top level is needed.
+		return SUCCEEDED(DirectX::Convert(*image.GetImage(0, 0, 0), DXGI_FORMAT_R32G32B32A32_FLOAT, DirectX::TEX_FILTER_DEFAULT,
+			DirectX::TEX_THRESHOLD_DEFAULT, outImage));
+	}
+
+	bool ReadSH(const fs::path& filename, SHIrradiance& outSH) {
+		std::ifstream stream(filename, std::ios::binary);
+		return stream.read((char*)&outSH, sizeof(outSH)) and stream.gcount() == sizeof(outSH);
+	}
+
+	bool WriteSH(const fs::path& filename, const SHIrradiance& sh) {
+		fs::create_directories(filename.parent_path());
+		std::ofstream stream(filename, std::ios::binary);
+		return (bool)stream.write((const char*)&sh, sizeof(sh));
+	}
+
+	void GetCubemapLevels(const DirectX::ScratchImage& cubemap, std::vector<CubemapLevel>& outLevels) {
+		const DirectX::TexMetadata& metadata = cubemap.GetMetadata();
+		outLevels.resize(metadata.mipLevels);
+		for (uint32 level = 0; level < metadata.mipLevels; ++level) {
+			for (uint32 face = 0; face < 6; ++face) {
+				const DirectX::Image* image = cubemap.GetImage(level, face, 0);
+				outLevels[level].Faces[face] = (float*)image->pixels;
+				outLevels[level].Size = (uint32)image->width;
+				outLevels[level].RowPitch = (uint64)image->rowPitch;
+			}
+		}
+	}
+
+	// Converts the RGBA32F result to the half format the GPU preprocessing produces.
+	bool ConvertToHalf(DirectX::ScratchImage& cubemap) {
+		DirectX::ScratchImage converted;
+		if (FAILED(DirectX::Convert(cubemap.GetImages(), cubemap.GetImageCount(), cubemap.GetMetadata(), DXGI_FORMAT_R16G16B16A16_FLOAT,
+			DirectX::TEX_FILTER_DEFAULT, DirectX::TEX_THRESHOLD_DEFAULT, converted))) {
+			return false;
+		}
+		cubemap = std::move(converted);
+		return true;
+	}
+
+	Ptr<DxTexture> CreateCubemap(const DirectX::ScratchImage& cubemap) {
+		const DirectX::TexMetadata& metadata = cubemap.GetMetadata();
+		const DirectX::Image* images = cubemap.GetImages();
+		uint32 numImages = (uint32)cubemap.GetImageCount();
+
+		// DirectXTex stores the levels of each face together, which is also the subresource order of D3D.
+		std::vector<D3D12_SUBRESOURCE_DATA> subresourceData(numImages);
+		for (uint32 i = 0; i < numImages; ++i) {
+			subresourceData[i].RowPitch = images[i].rowPitch;
+			subresourceData[i].SlicePitch = images[i].slicePitch;
+			subresourceData[i].pData = images[i].pixels;
+		}
+
+		CD3DX12_RESOURCE_DESC textureDesc = CD3DX12_RESOURCE_DESC::Tex2D(metadata.format, metadata.width, (uint32)metadata.height, 6, (uint16)metadata.mipLevels);
+
+		std::lock_guard lock(DxContext::Instance().ResourceCreationMutex());
+		return TextureFactory::Instance()->CreateTexture(textureDesc, subresourceData.data(), numImages);
+	}
+}
+
+bool LoadPrecomputedEnvironment(const fs::path& filename, uint32 environmentResolution, uint32 irradianceResolution, PrecomputedEnvironment& outEnvironment) {
+	AssetCache* assetCache = AssetCache::Instance();
+	uint64 importerVersion = GetEnvironmentImporterVersion();
+
+	fs::path shCacheFilepath, environmentCacheFilepath;
+	bool shCached = assetCache->Lookup(filename, importerVersion, SHCacheFlags, ".sh", shCacheFilepath)
+		and ReadSH(shCacheFilepath, outEnvironment.IrradianceSH);
+
+	DirectX::ScratchImage environment;
+	bool environmentCached = assetCache->Lookup(filename, importerVersion, environmentResolution, ".dds", environmentCacheFilepath)
+		and SUCCEEDED(DirectX::LoadFromDDSFile(environmentCacheFilepath.c_str(), DirectX::DDS_FLAGS_NONE, nullptr, environment));
+
+	if (not shCached or not environmentCached) {
+		std::cout << "Precomputing lighting of environment '" << filename.string() << "' for faster loading next time." << std::endl;
+
+		DirectX::ScratchImage source;
+		if (not LoadEnvironmentImage(filename, source)) {
+			std::cerr << "Couldn't load environment '" << filename.string() << "'." << std::endl;
+			return false;
+		}
+
+		const DirectX::Image* sourceImage = source.GetImage(0, 0, 0);
+		EnvironmentImage image = { (const float*)sourceImage->pixels, (uint32)sourceImage->width, (uint32)sourceImage->height, (uint64)sourceImage->rowPitch };
+
+		if (not shCached) {
+			outEnvironment.IrradianceSH = ProjectEnvironmentToSH(image);
+			if (WriteSH(shCacheFilepath, outEnvironment.IrradianceSH)) {
+				assetCache->Register(filename, importerVersion, SHCacheFlags, ".sh");
+			}
+		}
+
+		if (not environmentCached) {
+			ThrowIfFailed(environment.InitializeCube(DXGI_FORMAT_R32G32B32A32_FLOAT, environmentResolution, environmentResolution, 1, 0));
+
+			std::vector<CubemapLevel> levels;
+			GetCubemapLevels(environment, levels);
+			PrefilterEnvironmentGGX(image, levels.data(), (uint32)levels.size(), GGXPrefilterSettings{});
+
+			if (not ConvertToHalf(environment)) {
+				return false;
+			}
+
+			fs::create_directories(environmentCacheFilepath.parent_path());
+			if (SUCCEEDED(DirectX::SaveToDDSFile(environment.GetImages(), environment.GetImageCount(), environment.GetMetadata(),
+				DirectX::DDS_FLAGS_NONE, environmentCacheFilepath.c_str()))) {
+				assetCache->Register(filename, importerVersion, environmentResolution, ".dds");
+			}
+		}
+	}
+
+	// Evaluating the SH is cheap enough that the irradiance cubemap is never cached.
+	DirectX::ScratchImage irradiance;
+	ThrowIfFailed(irradiance.InitializeCube(DXGI_FORMAT_R32G32B32A32_FLOAT, irradianceResolution, irradianceResolution, 1, 1));
+
+	std::vector<CubemapLevel> irradianceLevels;
+	GetCubemapLevels(irradiance, irradianceLevels);
+	BakeSHIrradianceCubemap(outEnvironment.IrradianceSH, irradianceLevels[0]);
+
+	if (not ConvertToHalf(irradiance)) {
+		return false;
+	}
+
+	outEnvironment.Irradiance = CreateCubemap(irradiance);
+	outEnvironment.Environment = CreateCubemap(environment);
+	return true;
+}
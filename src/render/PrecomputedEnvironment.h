@@ -0,0 +1,15 @@
+#pragma once
+
+#include "../directx/DxTexture.h"
+#include "../core/environmentLighting.h"
+
+// CPU replacement for the irradiance convolution and environment prefiltering which CreateEnvironment runs on the GPU. The results are
+// cached on disk, keyed by the contents of the environment file, so switching back to an environment only loads the cache.
+struct PrecomputedEnvironment {
+	SHIrradiance IrradianceSH;
+	Ptr<DxTexture> Irradiance;  // IrradianceSH evaluated into a small cubemap, for the shaders which sample the irradiance as a texture.
+	Ptr<DxTexture> Environment; // GGX prefiltered, with a full mip chain.
+};
+
+// Returns false if the environment file can't be read. Thread safe.
+bool LoadPrecomputedEnvironment(const fs::path& filename, uint32 environmentResolution, uint32 irradianceResolution, PrecomputedEnvironment& outEnvironment);
@@ -3,11 +3,133 @@
 #include "../directx/DxRenderer.h"
 #include "../directx/DxContext.h"
 
+#include <chrono>
+
+namespace {
+    // Sorts depth-only and shadow draws, so that identical meshes are adjacent. Draws of the same mesh go front-to-back.
+    // Only allocates when the draw count exceeds what 'buffers' held before.
+    template <typename DrawCallT>
+    void SortByGeometry(std::vector<DrawCallT>& drawCalls, GeometrySortBuffers& buffers, vec3 cameraPosition, vec3 cameraForward) {
+        uint32 numDrawCalls = (uint32)drawCalls.size();
+        if (numDrawCalls <= 1) {
+            return;
+        }
+
+        buffers.GeometryIds.Reset();
+        buffers.SubmeshIds.Reset();
+
+        buffers.Items.resize(numDrawCalls);
+        buffers.Scratch.resize(numDrawCalls);
+        SortItem* items = buffers.Items.data();
+
+        for (uint32 i = 0; i < numDrawCalls; i++) {
+            const DrawCallT& dc = drawCalls[i];
+
+            vec3 position(dc.Transform.m03, dc.Transform.m13, dc.Transform.m23);
+            float depth = dot(position - cameraPosition, cameraForward);
+
+            uint32 geometry = buffers.GeometryIds.GetId(dc.VertexBuffer.get(), SORT_KEY_GEOMETRY_ONLY_BITS);
+            uint32 submesh = buffers.SubmeshIds.GetId(GetSubmeshSortValue(dc.IndexBuffer.get(), dc.Submesh.FirstTriangle, dc.Submesh.BaseVertex), SORT_KEY_SUBMESH_BITS);
+
+            items[i].Key = CreateGeometrySortKey(geometry, submesh, depth);
+            items[i].Index = i;
+        }
+
+        RadixSort(items, buffers.Scratch.data(), numDrawCalls);
+
+        // Apply the permutation in place, one cycle at a time. Visited items are marked by pointing them at themselves.
+        for (uint32 i = 0; i < numDrawCalls; i++) {
+            if (items[i].Index == i) {
+                continue;
+            }
+
+            DrawCallT first = std::move(drawCalls[i]);
+            uint32 dst = i;
+            for (uint32 src = items[dst].Index; src != i; src = items[dst].Index) {
+                drawCalls[dst] = std::move(drawCalls[src]);
+                items[dst].Index = dst;
+                dst = src;
+            }
+            drawCalls[dst] = std::move(first);
+            items[dst].Index = dst;
+        }
+    }
+}
+
 void GeometryRenderPass::Reset() {
     _drawCalls.clear();
     _outlinedObjects.clear();
 }
 
+void GeometryRenderPass::SortDrawCalls(vec3 cameraPosition, vec3 cameraForward, bool backToFront) {
+    auto start = std::chrono::high_resolution_clock::now();
+
+    uint32 numDrawCalls = (uint32)_drawCalls.size();
+
+    _pipelineIds.Reset();
+    _materialIds.Reset();
+    _geometryIds.Reset();
+
+    _sortItems.resize(numDrawCalls);
+    _sortScratch.resize(numDrawCalls);
+
+    for (uint32 i = 0; i < numDrawCalls; i++) {
+        const DrawCall& dc = _drawCalls[i];
+
+        vec3 position(dc.Transform.m03, dc.Transform.m13, dc.Transform.m23);
+        float depth = dot(position - cameraPosition, cameraForward);
+
+        uint32 layer = (uint32)dc.DrawType;
+        uint32 pipeline = _pipelineIds.GetId((const void*)dc.MaterialSetup, SORT_KEY_PIPELINE_BITS);
+        uint32 material = _materialIds.GetId(dc.Material.get(), SORT_KEY_MATERIAL_BITS);
+        uint32 geometry = _geometryIds.GetId(GetSubmeshSortValue(dc.VertexBuffer.get(), dc.Submesh.FirstTriangle, dc.Submesh.BaseVertex), SORT_KEY_GEOMETRY_BITS);
+
+        _sortItems[i].Key = backToFront
+            ? CreateTransparentSortKey(layer, pipeline, material, geometry, depth)
+            : CreateOpaqueSortKey(layer, pipeline, material, geometry, depth);
+        _sortItems[i].Index = i;
+    }
+
+    RadixSort(_sortItems.data(), _sortScratch.data(), numDrawCalls);
+
+    // The scratch buffer is free again, reuse it as the old-to-new index map for the outlines.
+    for (uint32 i = 0; i < numDrawCalls; i++) {
+        _sortScratch[_sortItems[i].Index].Index = i;
+    }
+
+    // Apply the permutation in place by following its cycles, so sorting doesn't allocate a second draw call list.
+    for (uint32 i = 0; i < numDrawCalls; i++) {
+        if (_sortItems[i].Index == i) {
+            continue;
+        }
+
+        DrawCall first = std::move(_drawCalls[i]);
+        uint32 dst = i;
+        for (uint32 src = _sortItems[dst].Index; src != i; src = _sortItems[dst].Index) {
+            _drawCalls[dst] = std::move(_drawCalls[src]);
+            _sortItems[dst].Index = dst;
+            dst = src;
+        }
+        _drawCalls[dst] = std::move(first);
+        _sortItems[dst].Index = dst;
+    }
+
+    for (uint16& outlined : _outlinedObjects) {
+        outlined = (uint16)_sortScratch[outlined].Index;
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    SortTime = std::chrono::duration<float, std::milli>(end - start).count();
+}
+
+void OpaqueRenderPass::Sort(vec3 cameraPosition, vec3 cameraForward) {
+    SortDrawCalls(cameraPosition, cameraForward, false);
+
+    // Animated draws reference per-object skinned vertex buffers and are never instanced, so their order is kept.
+    SortByGeometry(_staticDepthOnlyDrawCalls, _geometrySortBuffers, cameraPosition, cameraForward);
+    SortByGeometry(_dynamicDepthOnlyDrawCalls, _geometrySortBuffers, cameraPosition, cameraForward);
+}
+
 void OpaqueRenderPass::Reset() {
     GeometryRenderPass::Reset();
 
@@ -25,14 +147,20 @@ void SunShadowRenderPass::RenderObject(uint32 cascadeIndex, const Ptr<DxVertexBu
     });
 }
 
+void SunShadowRenderPass::Sort() {
+    for (uint32 i = 0; i < std::size(_drawCalls); i++) {
+        SortByGeometry(_drawCalls[i], _sortBuffers, vec3(0.f), vec3(0.f));
+    }
+}
+
 void SunShadowRenderPass::Reset() {
     for (uint32 i = 0; i < std::size(_drawCalls); i++) {
         _drawCalls[i].clear();
     }
 }
 
-void SpotShadowRenderPass::RenderObject(const Ptr<DxVertexBuffer> &vertexBuffer, const Ptr<DxIndexBuffer> &indexBuffer, SubmeshInfo submesh, const mat4 &transform) {
-    _drawCalls.push_back({
+void SpotShadowRenderPass::RenderStaticObject(const Ptr<DxVertexBuffer> &vertexBuffer, const Ptr<DxIndexBuffer> &indexBuffer, SubmeshInfo submesh, const mat4 &transform) {
+    _staticDrawCalls.push_back({
         transform,
         vertexBuffer,
         indexBuffer,
@@ -40,12 +168,36 @@ void SpotShadowRenderPass::RenderObject(const Ptr<DxVertexBuffer> &vertexBuffer,
     });
 }
 
+void SpotShadowRenderPass::RenderDynamicObject(const Ptr<DxVertexBuffer> &vertexBuffer, const Ptr<DxIndexBuffer> &indexBuffer, SubmeshInfo submesh, const mat4 &transform) {
+    _dynamicDrawCalls.push_back({
+        transform,
+        vertexBuffer,
+        indexBuffer,
+        submesh
+    });
+}
+
+void SpotShadowRenderPass::Sort() {
+    SortByGeometry(_staticDrawCalls, _sortBuffers, vec3(0.f), vec3(0.f));
+    SortByGeometry(_dynamicDrawCalls, _sortBuffers, vec3(0.f), vec3(0.f));
+}
+
 void SpotShadowRenderPass::Reset() {
-    _drawCalls.clear();
+    _staticDrawCalls.clear();
+    _dynamicDrawCalls.clear();
+}
+
+void PointShadowRenderPass::RenderStaticObject(const Ptr<DxVertexBuffer> &vertexBuffer, const Ptr<DxIndexBuffer> &indexBuffer, SubmeshInfo submesh, const mat4 &transform) {
+    _staticDrawCalls.push_back({
+        transform,
+        vertexBuffer,
+        indexBuffer,
+        submesh
+    });
 }
 
-void PointShadowRenderPass::RenderObject(const Ptr<DxVertexBuffer> &vertexBuffer, const Ptr<DxIndexBuffer> &indexBuffer, SubmeshInfo submesh, const mat4 &transform) {
-    _drawCalls.push_back({
+void PointShadowRenderPass::RenderDynamicObject(const Ptr<DxVertexBuffer> &vertexBuffer, const Ptr<DxIndexBuffer> &indexBuffer, SubmeshInfo submesh, const mat4 &transform) {
+    _dynamicDrawCalls.push_back({
         transform,
         vertexBuffer,
         indexBuffer,
@@ -53,8 +205,14 @@ void PointShadowRenderPass::RenderObject(const Ptr<DxVertexBuffer> &vertexBuffer
     });
 }
 
+void PointShadowRenderPass::Sort() {
+    SortByGeometry(_staticDrawCalls, _sortBuffers, vec3(0.f), vec3(0.f));
+    SortByGeometry(_dynamicDrawCalls, _sortBuffers, vec3(0.f), vec3(0.f));
+}
+
 void PointShadowRenderPass::Reset() {
-    _drawCalls.clear();
+    _staticDrawCalls.clear();
+    _dynamicDrawCalls.clear();
 }
 
 
@@ -5,6 +5,7 @@
 #include "../physics/mesh.h"
 #include "LightSource.h"
 #include "material.h"
+#include "DrawSort.h"
 
 struct RaytracingTlas;
 class DxVertexBuffer;
@@ -15,15 +16,26 @@ class RaytracingBlas;
 class GeometryRenderPass {
 public:
     void Reset();
+
+    float SortTime = 0.f; // In milliseconds, measured in the last call to SortDrawCalls.
 protected:
+    // Reorders the draw calls by their 64-bit sort key. Outlined object indices are remapped accordingly.
+    void SortDrawCalls(vec3 cameraPosition, vec3 cameraForward, bool backToFront);
+
     template<bool opaque, class MaterialT>
     void Common(const Ptr<DxVertexBuffer>& vertexBuffer, const Ptr<DxIndexBuffer>& indexBuffer, SubmeshInfo submesh, const Ptr<MaterialT>& material, const mat4& transform,
         bool outline, bool setTransform = true) {
         static_assert(std::is_base_of_v<MaterialBase, MaterialT>, "Material must inherit from MaterialBase");
 
         MaterialSetupFunction setupFunction;
+        MaterialSetupFunction instancedSetupFunction = nullptr;
         if constexpr(opaque) {
             setupFunction = MaterialT::SetupOpaquePipeline;
+
+            // Materials opt into automatic instancing by providing an instanced variant of their opaque pipeline.
+            if constexpr (requires { MaterialT::SetupOpaqueInstancedPipeline; }) {
+                instancedSetupFunction = MaterialT::SetupOpaqueInstancedPipeline;
+            }
         }
         else {
             setupFunction = MaterialT::SetupTransparentPipeline;
@@ -36,6 +48,7 @@ protected:
         dc.Material = material;
         dc.Submesh = submesh;
         dc.MaterialSetup = setupFunction;
+        dc.InstancedMaterialSetup = instancedSetupFunction;
         dc.DrawType = EDrawTypeDefault;
         dc.SetTransform = setTransform;
 
@@ -64,6 +77,7 @@ protected:
         dc.Material = material;
         dc.DispatchInfo = { dispatchX, dispatchY, dispatchZ };
         dc.MaterialSetup = setupFunction;
+        dc.InstancedMaterialSetup = nullptr;
         dc.DrawType = EDrawTypeMeshShader;
         dc.SetTransform = setTransform;
 
@@ -94,6 +108,7 @@ private:
             DispatchInfo DispatchInfo;
         };
         MaterialSetupFunction MaterialSetup;
+        MaterialSetupFunction InstancedMaterialSetup; // Null, if the material does not support instancing. Expects a TransformCb structured buffer in root parameter 0.
         EDrawType DrawType;
         bool SetTransform;
     };
@@ -101,7 +116,14 @@ private:
     std::vector<DrawCall> _drawCalls;
     std::vector<uint16> _outlinedObjects;
 
+    std::vector<SortItem> _sortItems;
+    std::vector<SortItem> _sortScratch;
+    DrawSortIdTable _pipelineIds;
+    DrawSortIdTable _materialIds;
+    DrawSortIdTable _geometryIds;
+
     friend class DxRenderer;
+    friend struct RenderPassBenchmarks;
 };
 
 // Renders opaque objects. It also generates screen space velocities, which is why there are three methods for static, dynamic and animated objects.
@@ -142,6 +164,10 @@ public:
         );
     }
 
+    // Groups draws into pipeline/material/geometry buckets, front-to-back inside each bucket.
+    // The depth-only draws are grouped by mesh, so that repeated meshes can be instanced.
+    void Sort(vec3 cameraPosition, vec3 cameraForward);
+
     void Reset();
 
 private:
@@ -177,7 +203,10 @@ private:
     std::vector<DynamicDepthOnlyDrawCall> _dynamicDepthOnlyDrawCalls;
     std::vector<AnimatedDepthOnlyDrawCall> _animatedDepthOnlyDrawCalls;
 
+    GeometrySortBuffers _geometrySortBuffers; // Shared by the static and dynamic depth-only draws, which are sorted one after the other.
+
     friend class DxRenderer;
+    friend struct RenderPassBenchmarks;
 };
 
 // Transparent pass currently generates no screen velocities and no object ids.
@@ -188,6 +217,9 @@ struct TransparentRenderPass : public GeometryRenderPass {
         Common<false>(vertexBuffer, indexBuffer, submesh, material, transform, outline);
     }
 
+    // Strictly back-to-front. State only breaks ties between draws at the same quantized depth.
+    void Sort(vec3 cameraPosition, vec3 cameraForward) { SortDrawCalls(cameraPosition, cameraForward, true); }
+
     friend class DxRenderer;
 };
 
@@ -215,6 +247,8 @@ protected:
         SubmeshInfo Submesh;
     };
 
+    GeometrySortBuffers _sortBuffers;
+
     friend class DxRenderer;
 };
 
@@ -225,12 +259,15 @@ public:
     // Since each cascade includes the next lower one, if you submit a draw to cascade N, it will also be rendered in N-1 automatically. No need to add it to the lower one.
     void RenderObject(uint32 cascadeIndex, const Ptr<DxVertexBuffer>& vertexBuffer, const Ptr<DxIndexBuffer>& indexBuffer, SubmeshInfo submesh, const mat4& transform);
 
+    // Groups draws by mesh, so that repeated meshes can be instanced.
+    void Sort();
     void Reset();
 
 private:
     std::vector<DrawCall> _drawCalls[MAX_NUM_SHADOW_CASCADES];
 
     friend class DxRenderer;
+    friend struct RenderPassBenchmarks;
 };
 
 class SpotShadowRenderPass : public ShadowRenderPass {
@@ -238,12 +275,21 @@ public:
     mat4 ViewProjMatrix;
     vec4 Viewport;
 
-    void RenderObject(const Ptr<DxVertexBuffer>& vertexBuffer, const Ptr<DxIndexBuffer>& indexBuffer, SubmeshInfo submesh, const mat4& transform);
+    // False, if the viewport was newly assigned this frame, so that the shadow map has to be re-rendered regardless of what moved.
+    bool ViewportWasCached = false;
+
+    // Static casters are cached in a separate shadow map and only re-rendered, when the light or one of them moves.
+    // Dynamic (animated) casters are rendered on top of the cached static ones every frame.
+    void RenderStaticObject(const Ptr<DxVertexBuffer>& vertexBuffer, const Ptr<DxIndexBuffer>& indexBuffer, SubmeshInfo submesh, const mat4& transform);
+    void RenderDynamicObject(const Ptr<DxVertexBuffer>& vertexBuffer, const Ptr<DxIndexBuffer>& indexBuffer, SubmeshInfo submesh, const mat4& transform);
 
+    // Groups draws by mesh, so that repeated meshes can be instanced.
+    void Sort();
     void Reset();
 
 private:
-    std::vector<DrawCall> _drawCalls;
+    std::vector<DrawCall> _staticDrawCalls;
+    std::vector<DrawCall> _dynamicDrawCalls;
 
     friend class DxRenderer;
 };
@@ -255,13 +301,21 @@ public:
     vec3 LightPosition;
     float MaxDistance;
 
+    // False, if one of the viewports was newly assigned this frame.
+    bool ViewportWasCached = false;
+
     // TODO: Split this into positive and negative direction for frustum culling.
-    void RenderObject(const Ptr<DxVertexBuffer>& vertexBuffer, const Ptr<DxIndexBuffer>& indexBuffer, SubmeshInfo submesh, const mat4& transform);
+    // See SpotShadowRenderPass for static and dynamic casters.
+    void RenderStaticObject(const Ptr<DxVertexBuffer>& vertexBuffer, const Ptr<DxIndexBuffer>& indexBuffer, SubmeshInfo submesh, const mat4& transform);
+    void RenderDynamicObject(const Ptr<DxVertexBuffer>& vertexBuffer, const Ptr<DxIndexBuffer>& indexBuffer, SubmeshInfo submesh, const mat4& transform);
 
+    // Groups draws by mesh, so that repeated meshes can be instanced.
+    void Sort();
     void Reset();
 
 private:
-    std::vector<DrawCall> _drawCalls;
+    std::vector<DrawCall> _staticDrawCalls;
+    std::vector<DrawCall> _dynamicDrawCalls;
 
     friend class DxRenderer;
 };
@@ -1,161 +1,359 @@
-// #include "ShadowMapCache.h"
-// #include "../directx/DxRenderer.h"
-//
-//
-// struct TreeNode {
-// 	uint32 X, Y;
-// };
-//
-// static constexpr uint32 maximumSize = 2048;
-// static constexpr uint32 minimumSize = 128;
-// static_assert(SHADOW_MAP_WIDTH % maximumSize == 0, "");
-// static_assert(SHADOW_MAP_HEIGHT % maximumSize == 0, "");
-// static_assert(isPowerOfTwo(maximumSize), "");
-// static_assert(isPowerOfTwo(minimumSize), "");
-//
-// static constexpr uint32 numBuckets = IndexOfLeastSignificantSetBit(maximumSize) - IndexOfLeastSignificantSetBit(minimumSize) + 1;
-// static std::vector<TreeNode> nodes[numBuckets];
-//
-// static void Initialize() {
-// 	for (uint32 y = 0; y < SHADOW_MAP_HEIGHT / maximumSize; ++y) {
-// 		for (uint32 x = 0; x < SHADOW_MAP_WIDTH / maximumSize; ++x) {
-// 			nodes[0].push_back({ x * maximumSize, y * maximumSize });
-// 		}
-// 	}
-// }
-//
-// static uint32 GetIndex(uint32 size) {
-// 	uint32 index = IndexOfLeastSignificantSetBit(size) - IndexOfLeastSignificantSetBit(minimumSize);
-// 	index = numBuckets - index - 1;
-// 	return index;
-// }
-//
-// static TreeNode Insert(uint32 size) {
-// 	assert(size <= maximumSize);
-// 	assert(size >= minimumSize);
-// 	assert(isPowerOfTwo(size));
-//
-// 	uint32 index = GetIndex(size);
-//
-// 	uint32 insertIndex = index;
-// 	for (; insertIndex != -1 && nodes[insertIndex].size() == 0; --insertIndex);
-//
-// 	assert(insertIndex != -1);
-// 	assert(nodes[insertIndex].size() > 0);
-//
-//
-// 	for (uint32 i = insertIndex; i < index; ++i) {
-// 		uint32 nodeSize = 1 << (IndexOfLeastSignificantSetBit(maximumSize) - i);
-// 		uint32 halfSize = nodeSize / 2;
-//
-// 		TreeNode n = nodes[i].back();
-// 		nodes[i].pop_back();
-//
-// 		nodes[i + 1].push_back({ n.X, n.Y });
-// 		nodes[i + 1].push_back({ n.X + halfSize, n.Y });
-// 		nodes[i + 1].push_back({ n.X, n.Y + halfSize });
-// 		nodes[i + 1].push_back({ n.X + halfSize, n.Y + halfSize });
-// 	}
-//
-// 	TreeNode result = nodes[index].back();
-// 	nodes[index].pop_back();
-// 	return result;
-// }
-//
-// static void Free(TreeNode remove, uint32 size) {
-// 	if (size == maximumSize) {
-// 		nodes[0].push_back(remove);
-// 		return;
-// 	}
-//
-//
-// 	uint32 index = GetIndex(size);
-// 	std::vector<TreeNode>& list = nodes[index];
-// 	if (list.size() == 0) {
-// 		list.push_back(remove);
-// 		return;
-// 	}
-//
-//
-// 	uint32 doubleSize = size * 2;
-// 	uint32 shift = IndexOfLeastSignificantSetBit(doubleSize);
-//
-// 	uint32 parentX = remove.X >> shift;
-// 	uint32 parentY = remove.Y >> shift;
-// 	uint32 parentWidth = SHADOW_MAP_WIDTH >> shift;
-// 	uint32 parentIndex = parentY * parentWidth + parentX;
-//
-//
-// 	uint32 nodesWithThisParent = 0;
-// 	auto insertIt = list.end();
-//
-// 	for (auto it = list.begin(); it != list.end(); ++it) {
-// 		TreeNode node = *it;
-//
-// 		uint32 pX = node.X >> shift;
-// 		uint32 pY = node.Y >> shift;
-// 		uint32 pi = pY * parentWidth + pX;
-//
-// 		if (pi == parentIndex)
-// 		{
-// 			++nodesWithThisParent;
-// 		}
-// 		else if (pi > parentIndex)
-// 		{
-// 			insertIt = it;
-// 			break;
-// 		}
-// 	}
-//
-// 	assert(nodesWithThisParent < 4);
-//
-// 	if (nodesWithThisParent == 3) {
-// 		auto eraseIt = insertIt - 3;
-// 		list.erase(eraseIt, insertIt);
-// 		Free(TreeNode{ parentX * doubleSize, parentY * doubleSize }, doubleSize);
-// 	}
-// 	else {
-// 		list.insert(insertIt, remove);
-// 	}
-// }
-//
-// void ShadowMapLightInfo::TestShadowMapCache(ShadowMapLightInfo* infos, uint32 numInfos) {
-// 	Initialize();
-// 	auto r = Insert(512);
-// 	auto r2 = Insert(1024);
-// 	Free(r, 512);
-//
-// 	for (uint32 i = 0; i < numInfos; ++i) {
-// 		ShadowMapLightInfo& info = infos[i];
-//
-// 		if (info.LightMovedOrAppeared || info.Viewport.CpuVP[3] < 0.f) {
-// 			// Render static geometry.
-// 			// Cache result.
-// 			// Render dynamic geometry.
-// 		}
-// 		else {
-// 			if (info.GeometryInRangeMoved) {
-// 				// Copy static cache to active.
-// 				// Render dynamic geometry.
-// 			}
-// 			else {
-// 				// Shadow map exists.
-// 				// Copy it from back to front buffer?
-// 			}
-// 		}
-// 	}
-//
-// 	for (uint32 i = 0; i < numInfos; ++i)
-// 	{
-// 		ShadowMapLightInfo& info = infos[i];
-//
-// 		// info.Viewport.CpuVP[0] = rect.x;
-// 		// info.Viewport.CpuVP[1] = rect.y;
-// 		// info.Viewport.CpuVP[2] = rect.w;
-// 		// info.Viewport.CpuVP[3] = rect.h;
-// 		// info.Viewport.ShaderVP.x = (float)rect.x / SHADOW_MAP_WIDTH;
-// 		// info.Viewport.ShaderVP.y = (float)rect.y / SHADOW_MAP_WIDTH;
-// 		// info.Viewport.ShaderVP.z = (float)rect.w / SHADOW_MAP_WIDTH;
-// 		// info.Viewport.ShaderVP.w = (float)rect.h / SHADOW_MAP_WIDTH;
-// 	}
-// }
+#include "ShadowMapCache.h"
+
+#include <algorithm>
+
+void ShadowMapAtlas::Initialize(uint32 width, uint32 height, uint32 minimumSize, uint32 maximumSize) {
+	assert(isPowerOfTwo(minimumSize));
+	assert(isPowerOfTwo(maximumSize));
+	assert(minimumSize <= maximumSize);
+	assert(width % maximumSize == 0);
+	assert(height % maximumSize == 0);
+
+	Width = width;
+	Height = height;
+	MinimumSize = minimumSize;
+	MaximumSize = maximumSize;
+
+	_numLevels = IndexOfLeastSignificantSetBit(maximumSize) - IndexOfLeastSignificantSetBit(minimumSize) + 1;
+	assert(_numLevels <= SHADOW_MAP_ATLAS_MAX_NUM_LEVELS);
+
+	Reset();
+}
+
+void ShadowMapAtlas::Reset() {
+	for (uint32 i = 0; i < SHADOW_MAP_ATLAS_MAX_NUM_LEVELS; ++i) {
+		_freeNodes[i].clear();
+	}
+
+	for (uint32 y = 0; y < Height / MaximumSize; ++y) {
+		for (uint32 x = 0; x < Width / MaximumSize; ++x) {
+			InsertNode(0, x * MaximumSize, y * MaximumSize);
+		}
+	}
+}
+
+uint32 ShadowMapAtlas::GetLevel(uint32 size) const {
+	return IndexOfLeastSignificantSetBit(MaximumSize) - IndexOfLeastSignificantSetBit(size);
+}
+
+uint32 ShadowMapAtlas::GetKey(uint32 x, uint32 y, uint32 level) const {
+	uint32 size = GetSize(level);
+	if (level == 0) {
+		return (y / size) * (Width / size) + x / size;
+	}
+
+	// Parent index in the upper bits, position inside the parent in the lowest two bits.
+	uint32 parentSize = size * 2;
+	uint32 parentIndex = (y / parentSize) * (Width / parentSize) + x / parentSize;
+	uint32 childIndex = ((y / size) & 1) * 2 + ((x / size) & 1);
+	return parentIndex * 4 + childIndex;
+}
+
+void ShadowMapAtlas::InsertNode(uint32 level, uint32 x, uint32 y) {
+	std::vector<TreeNode>& list = _freeNodes[level];
+	TreeNode node = { x, y, GetKey(x, y, level) };
+
+	auto it = std::lower_bound(list.begin(), list.end(), node.Key, [](const TreeNode& n, uint32 key) { return n.Key < key; });
+	assert(it == list.end() or it->Key != node.Key); // Double free.
+	list.insert(it, node);
+}
+
+bool ShadowMapAtlas::Insert(uint32 size, uint32& outX, uint32& outY) {
+	assert(size <= MaximumSize);
+	assert(size >= MinimumSize);
+	assert(isPowerOfTwo(size));
+
+	uint32 level = GetLevel(size);
+
+	// Smallest free node which is at least as large as requested.
+	int32 insertLevel = (int32)level;
+	for (; insertLevel >= 0 and _freeNodes[insertLevel].empty(); --insertLevel);
+
+	if (insertLevel < 0) {
+		return false;
+	}
+
+	TreeNode node = _freeNodes[insertLevel].back();
+	_freeNodes[insertLevel].pop_back();
+
+	// Split down to the requested size. The top left child is split further, the other three become free.
+	for (uint32 i = (uint32)insertLevel; i < level; ++i) {
+		uint32 halfSize = GetSize(i) / 2;
+
+		InsertNode(i + 1, node.X + halfSize, node.Y);
+		InsertNode(i + 1, node.X, node.Y + halfSize);
+		InsertNode(i + 1, node.X + halfSize, node.Y + halfSize);
+	}
+
+	outX = node.X;
+	outY = node.Y;
+	return true;
+}
+
+void ShadowMapAtlas::Free(uint32 x, uint32 y, uint32 size) {
+	assert(size <= MaximumSize);
+	assert(size >= MinimumSize);
+	assert(isPowerOfTwo(size));
+
+	uint32 level = GetLevel(size);
+	if (level == 0) {
+		InsertNode(0, x, y);
+		return;
+	}
+
+	std::vector<TreeNode>& list = _freeNodes[level];
+	uint32 parentKey = GetKey(x, y, level) / 4;
+
+	auto first = std::lower_bound(list.begin(), list.end(), parentKey * 4, [](const TreeNode& n, uint32 key) { return n.Key < key; });
+	auto last = first;
+	while (last != list.end() and last->Key / 4 == parentKey) {
+		++last;
+	}
+
+	uint32 numFreeSiblings = (uint32)(last - first);
+	assert(numFreeSiblings < 4);
+
+	if (numFreeSiblings == 3) {
+		// All four children are free, so merge them back into the parent.
+		list.erase(first, last);
+
+		uint32 parentSize = size * 2;
+		Free(x / parentSize * parentSize, y / parentSize * parentSize, parentSize);
+	}
+	else {
+		InsertNode(level, x, y);
+	}
+}
+
+uint64 ShadowMapAtlas::GetNumFreeTexels() const {
+	uint64 result = 0;
+	for (uint32 i = 0; i < _numLevels; ++i) {
+		uint64 size = GetSize(i);
+		result += _freeNodes[i].size() * size * size;
+	}
+	return result;
+}
+
+uint32 ShadowMapAtlas::GetLargestFreeSize() const {
+	for (uint32 i = 0; i < _numLevels; ++i) {
+		if (not _freeNodes[i].empty()) {
+			return GetSize(i);
+		}
+	}
+	return 0;
+}
+
+float ShadowMapAtlas::GetFragmentation() const {
+	uint64 numFreeTexels = GetNumFreeTexels();
+	if (numFreeTexels == 0) {
+		return 0.f;
+	}
+
+	for (uint32 i = 0; i < _numLevels; ++i) {
+		if (not _freeNodes[i].empty()) {
+			uint64 size = GetSize(i);
+			return 1.f - (float)(_freeNodes[i].size() * size * size) / (float)numFreeTexels;
+		}
+	}
+	return 0.f;
+}
+
+void ShadowMapCache::Initialize(uint32 width, uint32 height, uint32 minimumSize, uint32 maximumSize) {
+	_atlas.Initialize(width, height, minimumSize, maximumSize);
+	_entries.clear();
+}
+
+uint32 ShadowMapCache::GetTileSize(float idealSize, const CacheEntry* current) const {
+	idealSize = clamp(idealSize, (float)_atlas.MinimumSize, (float)_atlas.MaximumSize);
+
+	// A little hysteresis, so that a light whose ideal size hovers around a power of two does not get a new tile every frame.
+	if (current and idealSize >= current->Size * 0.9f and idealSize < current->Size * 2.2f) {
+		return current->Size;
+	}
+
+	uint32 size = _atlas.MaximumSize;
+	while (size > _atlas.MinimumSize and (float)size > idealSize) {
+		size /= 2;
+	}
+	return size;
+}
+
+bool ShadowMapCache::EvictLeastRecentlyUsed() {
+	auto lru = _entries.end();
+	for (auto it = _entries.begin(); it != _entries.end(); ++it) {
+		if (it->second.LastUsedFrame < _frame and (lru == _entries.end() or it->second.LastUsedFrame < lru->second.LastUsedFrame)) {
+			lru = it;
+		}
+	}
+
+	if (lru == _entries.end()) {
+		return false;
+	}
+
+	_atlas.Free(lru->second.X, lru->second.Y, lru->second.Size);
+	_entries.erase(lru);
+	++Stats.NumEvictions;
+	return true;
+}
+
+void ShadowMapCache::WriteViewport(const CacheEntry& entry, ShadowMapViewport* viewport) const {
+	viewport->CpuVP[0] = (int32)entry.X;
+	viewport->CpuVP[1] = (int32)entry.Y;
+	viewport->CpuVP[2] = (int32)entry.Size;
+	viewport->CpuVP[3] = (int32)entry.Size;
+	viewport->ShaderVP = vec4(
+		(float)entry.X / _atlas.Width,
+		(float)entry.Y / _atlas.Height,
+		(float)entry.Size / _atlas.Width,
+		(float)entry.Size / _atlas.Height);
+}
+
+void ShadowMapCache::Update(ShadowMapRequest* requests, uint32 numRequests) {
+	++_frame;
+	Stats = {};
+
+	std::stable_sort(requests, requests + numRequests, [](const ShadowMapRequest& a, const ShadowMapRequest& b) { return a.IdealSize > b.IdealSize; });
+
+	// If the requests would not even fit into an empty atlas, shrink all of them evenly instead of dropping the least important lights entirely.
+	float scale = 1.f;
+	uint64 capacity = (uint64)_atlas.Width * _atlas.Height;
+	while (scale * _atlas.MaximumSize > _atlas.MinimumSize) {
+		uint64 numWantedTexels = 0;
+		for (uint32 i = 0; i < numRequests; ++i) {
+			uint64 size = GetTileSize(requests[i].IdealSize * scale, nullptr);
+			numWantedTexels += size * size;
+		}
+		if (numWantedTexels <= capacity) {
+			break;
+		}
+		scale *= 0.5f;
+	}
+
+	// First keep all tiles which are still of the right size, so that they can't be evicted by the new allocations below.
+	std::vector<uint32> misses;
+	for (uint32 i = 0; i < numRequests; ++i) {
+		ShadowMapRequest& request = requests[i];
+
+		auto it = _entries.find(request.Id);
+		if (it != _entries.end()) {
+			CacheEntry& entry = it->second;
+			assert(entry.LastUsedFrame != _frame); // Id requested twice.
+
+			if (GetTileSize(request.IdealSize * scale, &entry) == entry.Size) {
+				entry.LastUsedFrame = _frame;
+				entry.Cached = true;
+				WriteViewport(entry, request.Viewport);
+				++Stats.NumHits;
+				continue;
+			}
+
+			// The contents have to be re-rendered at the new size anyway.
+			_atlas.Free(entry.X, entry.Y, entry.Size);
+			_entries.erase(it);
+		}
+
+		misses.push_back(i);
+	}
+
+	for (uint32 i : misses) {
+		ShadowMapRequest& request = requests[i];
+
+		uint32 wantedSize = GetTileSize(request.IdealSize * scale, nullptr);
+		uint32 size = wantedSize;
+
+		while (true) {
+			uint32 x, y;
+			if (_atlas.Insert(size, x, y)) {
+				CacheEntry& entry = _entries[request.Id];
+				entry = { x, y, size, _frame, false };
+				WriteViewport(entry, request.Viewport);
+
+				++Stats.NumAllocations;
+				Stats.NumDowngrades += (size < wantedSize);
+				break;
+			}
+
+			if (EvictLeastRecentlyUsed()) {
+				continue;
+			}
+
+			if (size > _atlas.MinimumSize) {
+				size /= 2;
+				continue;
+			}
+
+			*request.Viewport = {};
+			++Stats.NumFailures;
+			break;
+		}
+	}
+}
+
+bool ShadowMapCache::WasCached(uint64 id) const {
+	auto it = _entries.find(id);
+	return it != _entries.end() and it->second.LastUsedFrame == _frame and it->second.Cached;
+}
+
+void ShadowMapCache::Free(uint64 id) {
+	auto it = _entries.find(id);
+	if (it != _entries.end()) {
+		_atlas.Free(it->second.X, it->second.Y, it->second.Size);
+		_entries.erase(it);
+	}
+}
+
+void ShadowMapCache::Clear() {
+	_atlas.Reset();
+	_entries.clear();
+}
+
+EShadowMapUpdate ShadowMapUpdateTracker::Update(uint64 id, const ShadowMapHashes& hashes, bool contentsValid) {
+	auto it = _renderedHashes.find(id);
+
+	EShadowMapUpdate result;
+	if (not contentsValid or it == _renderedHashes.end() or it->second.Light != hashes.Light or it->second.StaticCasters != hashes.StaticCasters) {
+		result = EShadowMapUpdateFull;
+	}
+	else if (hashes.NumDynamicCasters > 0 or it->second.DynamicCasters != hashes.DynamicCasters) {
+		// Dynamic casters are animated, so their vertices change without any of the hashed state changing. Any dynamic caster in range forces an update.
+		// The hash catches the last dynamic caster leaving the range, whose shadow must still be removed.
+		result = EShadowMapUpdateDynamic;
+	}
+	else {
+		result = EShadowMapUpdateNone;
+	}
+
+	_renderedHashes[id] = hashes;
+
+	Stats.NumFullUpdates += (result == EShadowMapUpdateFull);
+	Stats.NumDynamicUpdates += (result == EShadowMapUpdateDynamic);
+	Stats.NumSkippedUpdates += (result == EShadowMapUpdateNone);
+	return result;
+}
+
+float GetShadowMapImportance(vec3 cameraPosition, float cameraVerticalFOV, vec3 sphereCenter, float sphereRadius) {
+	float distance = length(sphereCenter - cameraPosition);
+	if (distance <= sphereRadius) {
+		return 1.f;
+	}
+
+	// Tangent of the angle under which the sphere is seen, relative to the tangent of half the field of view.
+	float projectedRadius = sphereRadius / sqrt(distance * distance - sphereRadius * sphereRadius);
+	float tanHalfFOV = tan(cameraVerticalFOV * 0.5f);
+	return Min(projectedRadius / tanHalfFOV, 1.f);
+}
+
+void GetSpotLightBoundingSphere(vec3 position, vec3 direction, float outerAngle, float maxDistance, vec3& outCenter, float& outRadius) {
+	float cosAngle = cos(outerAngle);
+
+	if (cosAngle <= 0.70710678f) {
+		// Wide cone: The cap circle is the widest part.
+		outCenter = position + direction * (cosAngle * maxDistance);
+		outRadius = sin(outerAngle) * maxDistance;
+	}
+	else {
+		// Narrow cone: The sphere passes through the apex and the cap circle.
+		outRadius = maxDistance / (2.f * cosAngle);
+		outCenter = position + direction * outRadius;
+	}
+}
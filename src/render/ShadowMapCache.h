@@ -1,20 +1,183 @@
-// #pragma once
-//
-// #include "../core/math.h"
-//
-// struct ShadowMapViewport {
-//     int32 CpuVP[4]; // x, y, width, height.
-//     vec4 ShaderVP;
-// };
-//
-// struct ShadowMapLightInfo {
-//     ShadowMapViewport Viewport; // Previous frame viewport. Gets updated by cache.
-//     bool LightMovedOrAppeared;
-//     bool GeometryInRangeMoved;
-//     //uint64 dynamicGeometryHash;
-//     //uint64 prevFrameDynamicGeometryHash;
-//     //uint64 lightTransformHash;
-//     //uint64 prevFrameLightTransformHash;
-//
-//     static void TestShadowMapCache(ShadowMapLightInfo* infos, uint32 numInfos);
-// };
+#pragma once
+
+#include "../core/math.h"
+#include <vector>
+#include <unordered_map>
+
+#define SHADOW_MAP_ATLAS_MAX_NUM_LEVELS 16
+
+struct ShadowMapViewport {
+	int32 CpuVP[4]; // x, y, width, height in texels.
+	vec4 ShaderVP;  // Same, but normalized by the atlas size.
+
+	// The render passes expect the viewports in texels.
+	vec4 AsVec4() const { return vec4((float)CpuVP[0], (float)CpuVP[1], (float)CpuVP[2], (float)CpuVP[3]); }
+	bool IsValid() const { return CpuVP[2] > 0; }
+};
+
+// Quadtree allocator for square, power-of-two tiles in the shadow map atlas.
+// The atlas is covered by a grid of root nodes of 'maximumSize'. Larger free nodes are split into four children on demand,
+// and a freed tile is merged with its three buddies, if they are all free.
+class ShadowMapAtlas {
+public:
+	void Initialize(uint32 width, uint32 height, uint32 minimumSize, uint32 maximumSize);
+	void Reset();
+
+	// 'size' must be a power of two between the minimum and maximum size. Returns false if no free node of this size can be found or created.
+	bool Insert(uint32 size, uint32& outX, uint32& outY);
+	void Free(uint32 x, uint32 y, uint32 size);
+
+	uint64 GetNumFreeTexels() const;
+	uint32 GetLargestFreeSize() const;
+
+	// Fraction of the free space which is not in tiles of the largest free size. 0 if the free space is in as few tiles as possible, close to 1 if it is shattered into small tiles.
+	float GetFragmentation() const;
+
+	uint32 Width = 0, Height = 0;
+	uint32 MinimumSize = 0, MaximumSize = 0;
+
+private:
+	struct TreeNode {
+		uint32 X, Y;
+		uint32 Key;
+	};
+
+	uint32 GetLevel(uint32 size) const;
+	uint32 GetSize(uint32 level) const { return MaximumSize >> level; }
+	uint32 GetKey(uint32 x, uint32 y, uint32 level) const;
+	void InsertNode(uint32 level, uint32 x, uint32 y);
+
+	uint32 _numLevels = 0;
+
+	// Level 0 holds the root nodes of the maximum size. Each free list is sorted by key, which places the four children of a parent next to each other.
+	std::vector<TreeNode> _freeNodes[SHADOW_MAP_ATLAS_MAX_NUM_LEVELS];
+};
+
+struct ShadowMapCacheStatistics {
+	uint32 NumHits;        // Tile of the requested size was still allocated from a previous frame.
+	uint32 NumAllocations; // New tile was allocated.
+	uint32 NumEvictions;   // Tiles of lights not requested this frame, which were freed to make room.
+	uint32 NumDowngrades;  // Requests which only got a smaller tile than wanted.
+	uint32 NumFailures;    // Requests which got no tile at all.
+};
+
+struct ShadowMapRequest {
+	uint64 Id;         // Stable identifier of the light (and the tile within the light, for multi-tile lights).
+	float IdealSize;   // In texels. Quantized to a power of two by the cache.
+	ShadowMapViewport* Viewport;
+};
+
+// Keeps tiles of the shadow map atlas assigned to lights across frames, so that the contents can be reused.
+// Tiles of lights which were not requested this frame stay allocated until the space is needed, and are then evicted least recently used first.
+class ShadowMapCache {
+public:
+	void Initialize(uint32 width, uint32 height, uint32 minimumSize, uint32 maximumSize);
+
+	// Assigns a viewport to every request. Larger requests are served first, so under pressure the least important lights are shrunk or dropped.
+	// If the requests exceed the whole atlas, all of them are scaled down by powers of two. A request which gets no tile gets an empty viewport.
+	// Reorders 'requests'.
+	void Update(ShadowMapRequest* requests, uint32 numRequests);
+
+	// Returns true if the tile of 'id' was assigned in this frame's Update and was already allocated in the frame before, i.e. the previous contents are still there.
+	bool WasCached(uint64 id) const;
+
+	void Free(uint64 id);
+	void Clear();
+
+	const ShadowMapAtlas& GetAtlas() const { return _atlas; }
+
+	ShadowMapCacheStatistics Stats = {};
+
+private:
+	struct CacheEntry {
+		uint32 X, Y, Size;
+		uint64 LastUsedFrame;
+		bool Cached;
+	};
+
+	uint32 GetTileSize(float idealSize, const CacheEntry* current) const;
+	bool EvictLeastRecentlyUsed();
+	void WriteViewport(const CacheEntry& entry, ShadowMapViewport* viewport) const;
+
+	ShadowMapAtlas _atlas;
+	std::unordered_map<uint64, CacheEntry> _entries;
+	uint64 _frame = 0;
+};
+
+// Stable ids for the lights of the application. Point lights need two tiles, one per hemisphere.
+static uint64 GetSunShadowMapId(uint32 cascade) { return (1ull << 32) | cascade; }
+static uint64 GetSpotShadowMapId(uint32 lightIndex) { return (2ull << 32) | lightIndex; }
+static uint64 GetPointShadowMapId(uint32 lightIndex, uint32 hemisphere) { return (3ull << 32) | (lightIndex * 2 + hemisphere); }
+
+// Fraction of the screen height covered by a bounding sphere of a light's influence. 1, if the camera is inside the sphere.
+float GetShadowMapImportance(vec3 cameraPosition, float cameraVerticalFOV, vec3 sphereCenter, float sphereRadius);
+
+// Smallest sphere around the cone of a spot light.
+void GetSpotLightBoundingSphere(vec3 position, vec3 direction, float outerAngle, float maxDistance, vec3& outCenter, float& outRadius);
+
+enum EShadowMapUpdate {
+	EShadowMapUpdateNone,    // Neither the light nor any caster in range changed. Last frame's shadow map is still valid.
+	EShadowMapUpdateDynamic, // Restore the static casters from the cache and render the dynamic casters on top.
+	EShadowMapUpdateFull,    // Render the static casters into the cache, then proceed like a dynamic update.
+};
+
+struct ShadowMapHashes {
+	uint64 Light;          // Transformation, projection and viewport of the light.
+	uint64 StaticCasters;  // Set and transformations of the static casters in range.
+	uint64 DynamicCasters; // Same for the dynamic casters.
+	uint32 NumDynamicCasters;
+};
+
+struct ShadowMapUpdateStatistics {
+	uint32 NumFullUpdates;
+	uint32 NumDynamicUpdates;
+	uint32 NumSkippedUpdates;
+};
+
+#define SHADOW_MAP_HASH_SEED 0xCBF29CE484222325ull
+
+// FNV-1a.
+static uint64 HashShadowMapData(uint64 hash, const void* data, uint64 size) {
+	const uint8* bytes = (const uint8*)data;
+	for (uint64 i = 0; i < size; ++i) {
+		hash = (hash ^ bytes[i]) * 0x100000001B3ull;
+	}
+	return hash;
+}
+
+template <typename T>
+static uint64 HashShadowMapValue(uint64 hash, const T& value) {
+	return HashShadowMapData(hash, &value, sizeof(T));
+}
+
+// Hashes buffers, submeshes and transformations of shadow draw calls. The draw calls must be in a deterministic order, e.g. sorted.
+template <typename DrawCallT>
+static uint64 HashShadowCasters(const std::vector<DrawCallT>& drawCalls) {
+	uint64 hash = HashShadowMapValue(SHADOW_MAP_HASH_SEED, (uint64)drawCalls.size());
+	for (const DrawCallT& dc : drawCalls) {
+		hash = HashShadowMapValue(hash, (uint64)dc.VertexBuffer.get());
+		hash = HashShadowMapValue(hash, (uint64)dc.IndexBuffer.get());
+		hash = HashShadowMapValue(hash, dc.Submesh);
+		hash = HashShadowMapValue(hash, dc.Transform);
+	}
+	return hash;
+}
+
+// Remembers the hashes each light's shadow map was last rendered with, and decides how much of it must be re-rendered.
+class ShadowMapUpdateTracker {
+public:
+	// Call once per frame, before the Update calls. Resets the statistics.
+	void BeginFrame() { Stats = {}; }
+
+	// 'contentsValid' is false if the light's viewport was newly assigned and holds someone else's shadows, see ShadowMapCache::WasCached.
+	// Records 'hashes' as the state the shadow map will be rendered with, so the caller must perform the returned update.
+	EShadowMapUpdate Update(uint64 id, const ShadowMapHashes& hashes, bool contentsValid);
+
+	void Free(uint64 id) { _renderedHashes.erase(id); }
+	void Clear() { _renderedHashes.clear(); }
+
+	ShadowMapUpdateStatistics Stats = {};
+
+private:
+	std::unordered_map<uint64, ShadowMapHashes> _renderedHashes;
+};
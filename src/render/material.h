@@ -44,6 +44,8 @@ using MaterialSetupFunction = void(*)(DxCommandList*, const CommonMaterialInfo&)
 // - Have a function void prepareForRendering, which sets up uniforms specific to this material instance.
 // - Initialize the shader to the dx_renderer's HDR render target and have the depth test to EQUAL.
 // - Currently all materials must use the default_vs vertex shader and have the transform bound to root parameter 0.
+// - Optionally have a static function setupOpaqueInstancedPipeline, using default_instanced_vs. The renderer then binds a StructuredBuffer<TransformCb> to root parameter 0
+//   and merges consecutive draws with the same material and geometry into one instanced draw.
 
 struct MaterialBase {
     virtual void PrepareForRendering(DxCommandList* commandList) = 0;
@@ -1,6 +1,7 @@
 #include "pbr.hpp"
 #include "../directx/DxTexture.h"
 #include "TexturePreprocessing.h"
+#include "PrecomputedEnvironment.h"
 #include "../directx/DxContext.h"
 #include "../directx/DxCommandList.h"
 #include "../directx/DxRenderer.h"
@@ -73,6 +74,7 @@ static bool operator==(const MaterialKey& a, const MaterialKey& b) {
 }
 
 static DxPipeline defaultOpaquePBRPipeline;
+static DxPipeline defaultOpaqueInstancedPBRPipeline;
 static DxPipeline defaultTransparentPBRPipeline;
 static std::unordered_map<MaterialKey, WeakPtr<PbrMaterial>> materialCache;
 static std::mutex materialMutex;
@@ -92,21 +94,32 @@ Ptr<PbrMaterial> CreatePBRMaterial(const char *albedoTex, const char *normalTex,
 	};
 
 	materialMutex.lock();
-
 	auto sp = materialCache[s].lock();
+	materialMutex.unlock();
+
+	if (sp) {
+		return sp;
+	}
+
+	// The textures are loaded without holding the lock, so materials of different meshes can be created in parallel.
+	// The texture factory makes sure that a texture shared by several materials is only loaded once.
 	TextureFactory* textureFactory = TextureFactory::Instance();
-	if (!sp) {
-		Ptr<PbrMaterial> material = MakePtr<PbrMaterial>();
+	Ptr<PbrMaterial> material = MakePtr<PbrMaterial>();
 
-		if (albedoTex) material->Albedo = textureFactory->LoadTextureFromFile(albedoTex);
-		if (normalTex) material->Normal = textureFactory->LoadTextureFromFile(normalTex, ETextureLoadFlagsDefault | ETextureLoadFlagsNoncolor);
-		if (roughTex) material->Roughness = textureFactory->LoadTextureFromFile(roughTex, ETextureLoadFlagsDefault | ETextureLoadFlagsNoncolor);
-		if (metallicTex) material->Metallic = textureFactory->LoadTextureFromFile(metallicTex, ETextureLoadFlagsDefault | ETextureLoadFlagsNoncolor);
-		material->Emission = emission;
-		material->AlbedoTint = albedoTint;
-		material->RoughnessOverride = roughOverride;
-		material->MetallicOverride = metallicOverride;
+	if (albedoTex) material->Albedo = textureFactory->LoadTextureFromFile(albedoTex);
+	if (normalTex) material->Normal = textureFactory->LoadTextureFromFile(normalTex, ETextureLoadFlagsDefault | ETextureLoadFlagsNoncolor);
+	if (roughTex) material->Roughness = textureFactory->LoadTextureFromFile(roughTex, ETextureLoadFlagsDefault | ETextureLoadFlagsNoncolor);
+	if (metallicTex) material->Metallic = textureFactory->LoadTextureFromFile(metallicTex, ETextureLoadFlagsDefault | ETextureLoadFlagsNoncolor);
+	material->Emission = emission;
+	material->AlbedoTint = albedoTint;
+	material->RoughnessOverride = roughOverride;
+	material->MetallicOverride = metallicOverride;
+
+	materialMutex.lock();
 
+	// Someone else may have created the same material in the meantime. Keep theirs, so that equal materials stay shared.
+	sp = materialCache[s].lock();
+	if (!sp) {
 		materialCache[s] = sp = material;
 	}
 
@@ -135,6 +148,15 @@ Ptr<PbrEnvironment> CreateEnvironment(const char *filename, uint32 skyResolution
 		if (equiSky) {
 			Ptr<PbrEnvironment> environment = MakePtr<PbrEnvironment>();
 
+			// The irradiance and the prefiltered environment come from the CPU, usually straight from the cache. Only the sky is converted
+			// on the GPU, since it is too large to precompute at its full resolution.
+			PrecomputedEnvironment precomputed;
+			if (LoadPrecomputedEnvironment(filename, environmentResolution, irradianceResolution, precomputed)) {
+				environment->Environment = precomputed.Environment;
+				environment->Irradiance = precomputed.Irradiance;
+				environment->IrradianceSH = precomputed.IrradianceSH;
+			}
+
 			DxCommandList* cl;
 			if (asyncCompute) {
 				dxContext.ComputeQueue.WaitForOtherQueue(dxContext.CopyQueue);
@@ -146,8 +168,10 @@ Ptr<PbrEnvironment> CreateEnvironment(const char *filename, uint32 skyResolution
 			}
 			//generateMipMapsOnGPU(cl, equiSky);
 			environment->Sky = texturePreprocessor->EquirectangularToCubemap(cl, equiSky, skyResolution, 0, DXGI_FORMAT_R16G16B16A16_FLOAT);
-			environment->Environment = texturePreprocessor->PrefilterEnvironment(cl, environment->Sky, environmentResolution);
-			environment->Irradiance = texturePreprocessor->CubemapToIrradiance(cl, environment->Sky, irradianceResolution);
+			if (not environment->Environment) {
+				environment->Environment = texturePreprocessor->PrefilterEnvironment(cl, environment->Sky, environmentResolution);
+				environment->Irradiance = texturePreprocessor->CubemapToIrradiance(cl, environment->Sky, irradianceResolution);
+			}
 
 			SET_NAME(environment->Sky->Resource, "Sky");
 			SET_NAME(environment->Environment->Resource, "Environment");
@@ -195,6 +219,13 @@ void PbrMaterial::SetupOpaquePipeline(DxCommandList* cl, const CommonMaterialInf
 	SetupCommon(cl, info);
 }
 
+void PbrMaterial::SetupOpaqueInstancedPipeline(DxCommandList* cl, const CommonMaterialInfo& info) {
+	cl->SetPipelineState(*defaultOpaqueInstancedPBRPipeline.Pipeline);
+	cl->SetGraphicsRootSignature(*defaultOpaqueInstancedPBRPipeline.RootSignature);
+
+	SetupCommon(cl, info);
+}
+
 void PbrMaterial::SetupTransparentPipeline(DxCommandList* cl, const CommonMaterialInfo& info) {
 	cl->SetPipelineState(*defaultTransparentPBRPipeline.Pipeline);
 	cl->SetGraphicsRootSignature(*defaultTransparentPBRPipeline.RootSignature);
@@ -244,6 +275,7 @@ void PbrMaterial::InitializePipeline() {
 			.DepthSettings(true, false, D3D12_COMPARISON_FUNC_EQUAL);
 
 		defaultOpaquePBRPipeline = pipelineFactory->CreateReloadablePipeline(desc, { "default_vs", "default_pbr_ps" });
+		defaultOpaqueInstancedPBRPipeline = pipelineFactory->CreateReloadablePipeline(desc, { "default_instanced_vs", "default_pbr_ps" }, ERsInVertexShader);
 	}
 
 	{
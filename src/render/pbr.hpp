@@ -3,11 +3,13 @@
 #include "../core/math.h"
 #include "material.h"
 #include "../directx/DxPipeline.h"
+#include "../core/environmentLighting.h"
 
 struct PbrEnvironment {
     Ptr<DxTexture> Sky;
     Ptr<DxTexture> Environment;
     Ptr<DxTexture> Irradiance;
+    SHIrradiance IrradianceSH = {}; // Same lighting as Irradiance, in 27 floats. Zero if the GPU fallback was used.
 };
 
 class PbrMaterial : public MaterialBase {
@@ -29,6 +31,7 @@ public:
     void PrepareForRendering(DxCommandList *commandList) override;
 
     static void SetupOpaquePipeline(DxCommandList* commandList, const CommonMaterialInfo& info);
+    static void SetupOpaqueInstancedPipeline(DxCommandList* commandList, const CommonMaterialInfo& info);
     static void SetupTransparentPipeline(DxCommandList* commandList, const CommonMaterialInfo& info);
     static void InitializePipeline();
 
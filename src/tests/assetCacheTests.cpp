@@ -0,0 +1,79 @@
+#include "testing.h"
+#include "../core/assetCache.h"
+
+#include <chrono>
+#include <fstream>
+#include <random>
+
+// Creates 'numAssets' files of 'assetSize' random bytes in a temporary directory, caches them, and then measures how long a fresh
+// cache takes to read the manifest and validate all of them. The temporary files are deleted afterwards.
+BENCHMARK(AssetCache) {
+	using clock = std::chrono::high_resolution_clock;
+
+	const uint32 numAssets = 1000;
+	const uint32 assetSize = 64 * 1024;
+
+	fs::path root = fs::temp_directory_path() / "asset_cache_benchmark";
+	fs::path sourceDirectory = root / "sources";
+	fs::path cacheDirectory = root / "cache";
+
+	std::error_code error;
+	fs::remove_all(root, error);
+	fs::create_directories(sourceDirectory);
+	fs::create_directories(cacheDirectory);
+
+	std::minstd_rand rng(14878213);
+	std::vector<uint32> data((assetSize + 3) / 4);
+	std::vector<fs::path> sources(numAssets);
+
+	{
+		AssetCache cache;
+		cache.Initialize(cacheDirectory);
+
+		for (uint32 i = 0; i < numAssets; ++i) {
+			for (uint32& d : data) {
+				d = (uint32)rng();
+			}
+
+			sources[i] = sourceDirectory / ("asset_" + std::to_string(i) + ".bin");
+			std::ofstream(sources[i], std::ios::binary).write((const char*)data.data(), assetSize);
+
+			fs::path cacheFile;
+			CHECK(not cache.Lookup(sources[i], 0, 0, ".bin", cacheFile), "New sources miss the cache");
+			std::ofstream(cacheFile, std::ios::binary).write((const char*)data.data(), Min(assetSize, 16u));
+			cache.Register(sources[i], 0, 0, ".bin");
+		}
+
+		cache.SaveManifest();
+	}
+
+	// A fresh cache, as it would be at startup.
+	AssetCache cache;
+
+	auto start = clock::now();
+	cache.Initialize(cacheDirectory);
+	auto manifestRead = clock::now();
+
+	uint32 numMisses = 0;
+	for (uint32 i = 0; i < numAssets; ++i) {
+		fs::path cacheFile;
+		numMisses += not cache.Lookup(sources[i], 0, 0, ".bin", cacheFile);
+	}
+	auto unchangedValidated = clock::now();
+
+	for (uint32 i = 0; i < numAssets; ++i) {
+		fs::path cacheFile;
+		numMisses += not cache.Lookup(sources[i], 0, 0, ".bin", cacheFile, true);
+	}
+	auto rehashValidated = clock::now();
+
+	CHECK(numMisses == 0, "Cached sources hit the cache");
+
+	// Unchanged: only sizes and write times are compared. Rehash: every source is hashed, e.g. after a checkout which touched all write times.
+	printf("%u assets. Manifest %.2f ms, validation %.2f ms, validation with rehash %.2f ms.\n", numAssets,
+		std::chrono::duration<double, std::milli>(manifestRead - start).count(),
+		std::chrono::duration<double, std::milli>(unchangedValidated - manifestRead).count(),
+		std::chrono::duration<double, std::milli>(rehashValidated - unchangedValidated).count());
+
+	fs::remove_all(root, error);
+}
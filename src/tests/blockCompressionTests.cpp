@@ -0,0 +1,96 @@
+#include "testing.h"
+#include "../core/blockCompression.h"
+
+#include <chrono>
+#include <cmath>
+
+namespace {
+	// Channels CompressBlocks reads and the format stores. BC1 is measured without its 1-bit alpha.
+	uint32 GetNumMeasuredChannels(EBlockFormat format) {
+		switch (format) {
+			case EBlockFormatBC1: return 3;
+			case EBlockFormatBC4: return 1;
+			case EBlockFormatBC5: return 2;
+			default: return 4;
+		}
+	}
+
+	float Clamp255(float v) {
+		return std::fmin(std::fmax(v, 0.f), 255.f);
+	}
+
+	uint32 HashNoise(uint32 x, uint32 y) {
+		uint32 h = x * 374761393u + y * 668265263u;
+		h = (h ^ (h >> 13)) * 1274126177u;
+		return h ^ (h >> 16);
+	}
+
+	// A mix of what textures contain: smooth gradients, hard edges, fine detail and noise, with an alpha channel that has both cutout
+	// shapes and soft transitions.
+	void FillBenchmarkImage(std::vector<uint8>& pixels, uint32 width, uint32 height) {
+		for (uint32 y = 0; y < height; ++y) {
+			for (uint32 x = 0; x < width; ++x) {
+				float u = (float)x / width;
+				float v = (float)y / height;
+				uint32 noise = HashNoise(x, y);
+				uint8* texel = pixels.data() + ((uint64)y * width + x) * 4;
+
+				bool checker = ((x / 37) + (y / 23)) & 1;
+				float detail = 0.5f + 0.5f * std::sin(x * 0.7f) * std::cos(y * 0.45f);
+
+				texel[0] = (uint8)Clamp255(255.f * u + (noise & 15) - 8.f);
+				texel[1] = (uint8)Clamp255(checker ? 200.f * v : 255.f * detail);
+				texel[2] = (uint8)Clamp255(128.f + 100.f * std::sin(u * 20.f + v * 7.f) + ((noise >> 8) & 7));
+				texel[3] = (uint8)(((x / 64 + y / 64) % 3 == 0) ? 0 : Clamp255(255.f * (0.5f + 0.5f * std::cos(v * 31.f))));
+			}
+		}
+	}
+}
+
+// Compresses a synthetic RGBA image into every format at every quality level and measures the throughput and the error after decoding.
+// The RMSE is over the channels the format stores, in 8-bit units.
+BENCHMARK(BlockCompression) {
+	const uint32 width = 2048;
+	const uint32 height = 2048;
+	const char* formatNames[] = { "BC1", "BC3", "BC4", "BC5", "BC7" };
+	const char* qualityNames[] = { "fast", "normal", "high" };
+
+	using clock = std::chrono::high_resolution_clock;
+
+	std::vector<uint8> source((uint64)width * height * 4);
+	FillBenchmarkImage(source, width, height);
+
+	uint32 numBlocksX = Max((width + 3) / 4, 1u);
+	uint32 numBlocksY = Max((height + 3) / 4, 1u);
+	std::vector<uint8> blocks((uint64)numBlocksX * numBlocksY * 16);
+	std::vector<uint8> decoded(source.size());
+
+	for (uint32 f = 0; f < EBlockFormatCount; ++f) {
+		EBlockFormat format = (EBlockFormat)f;
+		uint64 blockRowPitch = (uint64)numBlocksX * GetBlockSize(format);
+
+		uint32 numChannels = GetNumMeasuredChannels(format);
+
+		for (uint32 q = 0; q < EBlockCompressionQualityCount; ++q) {
+			BlockCompressionSettings settings;
+			settings.Quality = (EBlockCompressionQuality)q;
+
+			auto start = clock::now();
+			CompressBlocks(format, source.data(), width, height, (uint64)width * 4, 4, blocks.data(), blockRowPitch, settings);
+			double seconds = std::chrono::duration<double>(clock::now() - start).count();
+
+			DecompressBlocks(format, blocks.data(), blockRowPitch, width, height, decoded.data(), (uint64)width * 4, 4);
+
+			double squaredError = 0.0;
+			for (uint64 i = 0; i < (uint64)width * height; ++i) {
+				for (uint32 c = 0; c < numChannels; ++c) {
+					double d = (double)source[i * 4 + c] - decoded[i * 4 + c];
+					squaredError += d * d;
+				}
+			}
+
+			printf("%s, %s, %ux%u: %.0f blocks/s, %.3f RMSE.\n", formatNames[f], qualityNames[q], width, height, numBlocksX * numBlocksY / seconds,
+				std::sqrt(squaredError / ((double)width * height * numChannels)));
+		}
+	}
+}
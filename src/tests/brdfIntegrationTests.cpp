@@ -0,0 +1,171 @@
+#include "testing.h"
+#include "../core/brdfIntegration.h"
+#include "../core/ddsLayout.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+namespace {
+	constexpr double Pi = 3.14159265358979323846;
+
+	// Same as in brdfIntegration.cpp.
+	double GeometrySmith(double NdotL, double NdotV, double roughness) {
+		double k = roughness * roughness * 0.5;
+		return (NdotV / (NdotV * (1.0 - k) + k)) * (NdotL / (NdotL * (1.0 - k) + k));
+	}
+
+	double Pow5(double x) {
+		double x2 = x * x;
+		return x2 * x2 * x;
+	}
+
+	struct SplitSum {
+		double Scale;
+		double Bias;
+	};
+
+	// The same integral as IntegrateBrdfLut, taken directly over a regular grid of light directions, i.e. without any importance sampling.
+	// Only accurate if the GGX lobe is several grid cells wide.
+	SplitSum IntegrateTexelQuadrature(double NdotV, double roughness, uint32 numTheta, uint32 numPhi) {
+		double alpha = roughness * roughness;
+		double a2 = alpha * alpha;
+		double vx = std::sqrt(1.0 - NdotV * NdotV);
+		double vz = NdotV;
+
+		double dTheta = 0.5 * Pi / numTheta;
+		double dPhi = Pi / numPhi; // The integrand is symmetric in y, so the half space y >= 0 is integrated twice.
+
+		double scale = 0.0;
+		double bias = 0.0;
+		for (uint32 t = 0; t < numTheta; ++t) {
+			double theta = (t + 0.5) * dTheta;
+			double NdotL = std::cos(theta);
+			double sinTheta = std::sin(theta);
+			double G = GeometrySmith(NdotL, NdotV, roughness);
+
+			for (uint32 p = 0; p < numPhi; ++p) {
+				double phi = (p + 0.5) * dPhi;
+				double lx = sinTheta * std::cos(phi);
+				double ly = sinTheta * std::sin(phi);
+
+				double hx = lx + vx, hy = ly, hz = NdotL + vz;
+				double invLength = 1.0 / std::sqrt(hx * hx + hy * hy + hz * hz);
+				double NdotH = hz * invLength;
+				double VdotH = (vx * hx + vz * hz) * invLength;
+
+				double d = NdotH * NdotH * (a2 - 1.0) + 1.0;
+				double D = a2 / (Pi * d * d);
+
+				// The BRDF times NdotL. The NdotL of its denominator cancels.
+				double value = D * G / (4.0 * NdotV) * sinTheta * dTheta * dPhi * 2.0;
+				double Fc = Pow5(1.0 - VdotH);
+				scale += (1.0 - Fc) * value;
+				bias += Fc * value;
+			}
+		}
+		return { scale, bias };
+	}
+
+	// EnvBRDFApprox from [Karis 2014], "Physically Based Shading on Mobile".
+	SplitSum AnalyticFit(double NdotV, double roughness) {
+		double r[4] = { roughness * -1.0 + 1.0, roughness * -0.0275 + 0.0425, roughness * -0.572 + 1.04, roughness * 0.022 - 0.04 };
+		double a004 = Min(r[0] * r[0], std::exp2(-9.28 * NdotV)) * r[0] + r[1];
+		return { -1.04 * a004 + r[2], 1.04 * a004 + r[3] };
+	}
+
+	bool ReadFile(const fs::path& filename, std::vector<uint8>& outData) {
+		std::ifstream stream(filename, std::ios::binary | std::ios::ate);
+		if (not stream) {
+			return false;
+		}
+		outData.resize((size_t)stream.tellg());
+		stream.seekg(0);
+		return (bool)stream.read((char*)outData.data(), (std::streamsize)outData.size());
+	}
+}
+
+// Checks a freshly integrated table against the references above and against the shipped file, and measures the startup cost with and
+// without the file.
+TEST(BrdfLut) {
+	using clock = std::chrono::high_resolution_clock;
+	auto milliseconds = [](clock::time_point start) { return std::chrono::duration<double, std::milli>(clock::now() - start).count(); };
+
+	const uint32 size = BRDF_LUT_SIZE;
+	const uint32 numSamples = BRDF_LUT_NUM_SAMPLES;
+
+	std::vector<float> serial((size_t)size * size * 4);
+	std::vector<float> parallel(serial.size());
+
+	auto start = clock::now();
+	IntegrateBrdfLut(size, numSamples, serial.data(), false);
+	double millisecondsIntegrateSerial = milliseconds(start);
+
+	start = clock::now();
+	IntegrateBrdfLut(size, numSamples, parallel.data(), true);
+	double millisecondsIntegrateParallel = milliseconds(start);
+
+	CHECK(memcmp(serial.data(), parallel.data(), serial.size() * sizeof(float)) == 0, "Serial and parallel integration give the same bits");
+
+	auto texel = [&](uint32 x, uint32 y) { return serial.data() + ((size_t)y * size + x) * 4; };
+
+	// Largest absolute errors of the scale, bias and average albedo channels.
+	double maxErrorMirror = 0.0;
+	double maxErrorQuadrature = 0.0;
+	double maxErrorAnalyticFit = 0.0; // Only an approximation itself, so this is informational.
+
+	// At the smallest roughness, GGX is close enough to a mirror that the half vector is always the normal, and NdotL = NdotV.
+	double mirrorRoughness = 0.5 / size;
+	for (uint32 y = 0; y < size; ++y) {
+		double NdotV = (y + 0.5) / size;
+		double G = GeometrySmith(NdotV, NdotV, mirrorRoughness);
+		double Fc = Pow5(1.0 - NdotV);
+		const float* t = texel(0, y);
+		maxErrorMirror = Max(maxErrorMirror, Max(std::abs(t[0] - (1.0 - Fc) * G), std::abs(t[1] - Fc * G)));
+		maxErrorMirror = Max(maxErrorMirror, std::abs(t[2] - 1.0));
+	}
+
+	// Roughness from 0.25 and NdotV from 1/16 on, where a 512 x 512 grid resolves the lobe. At grazing angles, the reflected lobe is
+	// squeezed against the horizon.
+	for (uint32 x = size / 4; x < size; x += 7) {
+		for (uint32 y = size / 16; y < size; y += 7) {
+			SplitSum reference = IntegrateTexelQuadrature((y + 0.5) / size, (x + 0.5) / size, 512, 512);
+			const float* t = texel(x, y);
+			maxErrorQuadrature = Max(maxErrorQuadrature, Max(std::abs(t[0] - reference.Scale), std::abs(t[1] - reference.Bias)));
+		}
+	}
+
+	for (uint32 y = 0; y < size; ++y) {
+		for (uint32 x = 0; x < size; ++x) {
+			SplitSum fit = AnalyticFit((y + 0.5) / size, (x + 0.5) / size);
+			const float* t = texel(x, y);
+			maxErrorAnalyticFit = Max(maxErrorAnalyticFit, Max(std::abs(t[0] - fit.Scale), std::abs(t[1] - fit.Bias)));
+		}
+	}
+
+	std::vector<uint16> quantized(serial.size());
+	QuantizeBrdfLut(serial.data(), size, quantized.data());
+
+	start = clock::now();
+	std::vector<uint8> file;
+	DdsTextureInfo info;
+	bool loaded = ReadFile(BRDF_LUT_FILE, file) and ParseDdsFile(file.data(), file.size(), info);
+	double millisecondsLoadFile = milliseconds(start); // Reading and parsing. The GPU upload is the same either way.
+
+	bool fileMatches = false;
+	if (loaded and info.Format == BRDF_LUT_FORMAT and info.Width == size and info.Height == size and info.Subresources.size() == 1) {
+		const DdsSubresourceLayout& subresource = info.Subresources[0];
+		fileMatches = subresource.SliceSize == quantized.size() * sizeof(uint16)
+			and memcmp(file.data() + subresource.SourceOffset, quantized.data(), subresource.SliceSize) == 0;
+	}
+	CHECK(fileMatches, "The shipped file holds exactly what IntegrateBrdfLut computes now");
+	CHECK(maxErrorMirror < 1e-3, "Matches a perfect mirror at the smallest roughness");
+	CHECK(maxErrorQuadrature < 5e-3, "Matches quadrature without importance sampling");
+
+	printf("%u, %u samples. Errors: mirror %.5f, quadrature %.5f, analytic fit %.3f.\n", size, numSamples, maxErrorMirror, maxErrorQuadrature,
+		maxErrorAnalyticFit);
+	printf("Startup: %.1f ms integrating serial, %.1f ms parallel, %.3f ms loading the file.\n", millisecondsIntegrateSerial,
+		millisecondsIntegrateParallel, millisecondsLoadFile);
+}
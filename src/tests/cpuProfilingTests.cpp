@@ -0,0 +1,200 @@
+#include "testing.h"
+#include "../core/cpuProfiling.h"
+#include "../core/json.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+namespace {
+	using Clock = std::chrono::high_resolution_clock;
+
+	const char* testThreadName = "Profiler test thread";
+	const char* testOuter = "Outer";
+	const char* testInner = "Inner";
+	const char* testLeaf = "Leaf";
+
+	struct NameCounts {
+		uint64 Outer = 0;
+		uint64 Inner = 0;
+		uint64 Leaf = 0;
+		uint64 Other = 0;
+	};
+
+	void CountNames(const CpuProfileFrame& frame, NameCounts& counts) {
+		for (const CpuProfileEvent& e : frame.Events) {
+			uint64& count = (e.Name == testOuter) ? counts.Outer : (e.Name == testInner) ? counts.Inner : (e.Name == testLeaf) ? counts.Leaf : counts.Other;
+			count++;
+		}
+	}
+
+	void RecordNestedScopes() {
+		CpuProfileBlockRecorder outer(testOuter);
+		{
+			CpuProfileBlockRecorder inner(testInner);
+			CpuProfileBlockRecorder leaf(testLeaf);
+		}
+		CpuProfileBlockRecorder inner(testInner);
+	}
+}
+
+// Records nested scopes from several threads while the calling thread collects frames, and checks that no scope is lost or duplicated and
+// that nesting, thread names and the exported trace come out right.
+TEST(CpuProfiler) {
+	const uint32 numThreads = 4;
+
+	double millisecondsFrameMarker = 0.0; // Collecting the scopes of all threads of the threaded run.
+
+	// Whatever this thread recorded before.
+	CpuProfileFrameMarker(0);
+
+	// Nesting.
+	{
+		RecordNestedScopes();
+		CpuProfileFrameMarker(1);
+		const CpuProfileFrame& frame = *GetCpuProfileFrame(0);
+
+		CHECK(frame.Events.size() == 4, "Nested scopes are collected");
+		if (frame.Events.size() == 4) {
+			CHECK(frame.Events[0].Name == testOuter and frame.Events[0].Depth == 0, "Outer scope comes first, at depth 0");
+			CHECK(frame.Events[1].Name == testInner and frame.Events[1].Depth == 1, "First inner scope at depth 1");
+			CHECK(frame.Events[2].Name == testLeaf and frame.Events[2].Depth == 2, "Leaf scope at depth 2");
+			CHECK(frame.Events[3].Name == testInner and frame.Events[3].Depth == 1, "Second inner scope at depth 1");
+		}
+		for (const CpuProfileEvent& e : frame.Events) {
+			CHECK(e.BeginClock <= e.EndClock, "Scopes end after they begin");
+		}
+		CHECK(not frame.Statistics.empty() and frame.Statistics[0].Name == testOuter, "Statistics are sorted by total time");
+		auto inner = std::find_if(frame.Statistics.begin(), frame.Statistics.end(), [](const CpuProfileStatistic& s) { return s.Name == testInner; });
+		CHECK(inner != frame.Statistics.end() and inner->Count == 2, "Statistics count scopes of the same name");
+	}
+
+	// Threaded, collected while the threads record.
+	{
+		const uint32 numRounds = 2000;
+		std::atomic<uint32> numRunning = numThreads;
+
+		std::vector<std::thread> threads;
+		for (uint32 t = 0; t < numThreads; ++t) {
+			threads.emplace_back([&] {
+				SetCpuProfileThreadName(testThreadName);
+				for (uint32 r = 0; r < numRounds; r++) {
+					RecordNestedScopes();
+
+					// Some work between the scopes, so that the collector can keep up.
+					uint64 start = CpuProfileClock();
+					while (CpuProfileClock() - start < 2000) {}
+				}
+				numRunning.fetch_sub(1);
+			});
+		}
+
+		NameCounts counts;
+		uint64 numLost = 0;
+		uint32 numFrames = 0;
+		double markerSeconds = 0.0;
+		bool running = true;
+		while (running) {
+			running = (numRunning.load() > 0);
+
+			auto start = Clock::now();
+			CpuProfileFrameMarker(2 + numFrames);
+			markerSeconds += std::chrono::duration<double>(Clock::now() - start).count();
+			numFrames++;
+
+			const CpuProfileFrame& frame = *GetCpuProfileFrame(0);
+			CountNames(frame, counts);
+			numLost += frame.NumLostEvents;
+		}
+		for (std::thread& thread : threads) {
+			thread.join();
+		}
+		millisecondsFrameMarker = markerSeconds * 1e3 / numFrames;
+
+		uint64 expected = (uint64)numThreads * numRounds;
+		CHECK(counts.Other == 0, "Only the threads' scopes are collected");
+		CHECK(counts.Outer + counts.Inner + counts.Leaf + numLost == expected * 4, "Every scope is collected or counted as lost");
+		CHECK(counts.Outer <= expected and counts.Inner <= expected * 2 and counts.Leaf <= expected, "No scope is collected twice");
+	}
+
+	// Export, with a track of another timeline.
+	{
+		fs::path filename = fs::temp_directory_path() / "cpu_profile_test.json";
+		std::vector<TraceEvent> otherEvents = { { "Test GPU block", "GPU \"graphics\"", 10.0, 5.0 } };
+		CHECK(ExportChromeTrace(filename, 4, otherEvents), "Trace is written");
+
+		std::stringstream contents;
+		contents << std::ifstream(filename).rdbuf();
+		std::string text = contents.str();
+		fs::remove(filename);
+
+		JsonValue trace;
+		CHECK(ParseJson(text.c_str(), text.size(), trace), "Trace is valid JSON");
+
+		const JsonValue& events = trace["traceEvents"];
+		CHECK(events.IsArray(), "Trace has an event array");
+
+		bool foundOther = false, foundTrack = false, foundThreadName = false, foundOuter = false, foundFrame = false;
+		for (uint32 i = 0; i < events.Size(); i++) {
+			const JsonValue& e = events[i];
+			const std::string& name = e["name"].AsString();
+			const std::string& phase = e["ph"].AsString();
+			foundOther |= (name == "Test GPU block" and phase == "X" and e["ts"].AsNumber() == 10.0 and e["dur"].AsNumber() == 5.0);
+			foundTrack |= (name == "thread_name" and e["args"]["name"].AsString() == "GPU \"graphics\"");
+			foundThreadName |= (name == "thread_name" and e["args"]["name"].AsString() == testThreadName);
+			foundOuter |= (name == testOuter and phase == "X" and e["dur"].AsNumber() >= 0.0);
+			foundFrame |= (phase == "i");
+		}
+		CHECK(foundOther and foundTrack, "Events of other timelines are exported on their own track");
+		CHECK(foundThreadName, "Thread names are exported");
+		CHECK(foundOuter, "Scopes are exported as complete events");
+		CHECK(foundFrame, "Frame markers are exported");
+	}
+
+	printf("%.3f ms per frame marker.\n", millisecondsFrameMarker);
+}
+
+// Recording a scope, including both clock reads, and reading the clock alone.
+BENCHMARK(CpuProfiler) {
+	const uint32 numScopes = 1000000;
+
+	CpuProfileFrameMarker(0);
+
+	// Timed in chunks which fit into the ring buffer, collected in between.
+	{
+		const char* name = "Benchmark scope";
+		double seconds = 0.0;
+		uint64 numCollected = 0;
+		for (uint32 done = 0; done < numScopes;) {
+			uint32 count = Min(numScopes - done, (uint32)MAX_NUM_CPU_PROFILE_EVENTS_PER_THREAD / 2);
+
+			auto start = Clock::now();
+			for (uint32 i = 0; i < count; i++) {
+				CpuProfileBlockRecorder block(name);
+			}
+			seconds += std::chrono::duration<double>(Clock::now() - start).count();
+
+			CpuProfileFrameMarker(0);
+			for (const CpuProfileEvent& e : GetCpuProfileFrame(0)->Events) {
+				numCollected += (e.Name == name);
+			}
+			done += count;
+		}
+		double nanosecondsPerScope = seconds * 1e9 / Max(numScopes, 1u);
+		CHECK(numCollected == numScopes, "Every scope of the timed run is collected");
+
+		uint64 sum = 0;
+		auto start = Clock::now();
+		for (uint32 i = 0; i < numScopes; i++) {
+			sum += CpuProfileClock();
+		}
+		double nanosecondsPerClockRead = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / Max(numScopes, 1u);
+		volatile uint64 sink = sum; // Keeps the clock reads from being optimized away.
+		(void)sink;
+
+		printf("%.1f ns per scope, %.1f ns per clock read.\n", nanosecondsPerScope, nanosecondsPerClockRead);
+	}
+}
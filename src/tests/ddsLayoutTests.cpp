@@ -0,0 +1,390 @@
+#include "testing.h"
+#include "../core/ddsLayout.h"
+#include "../core/memory.h"
+
+#include <chrono>
+#include <cstring>
+
+namespace {
+	// Layout of the file headers, as read by ParseDdsFile. The tests write them directly and damage single fields.
+	struct DdsPixelFormat {
+		uint32 Size;
+		uint32 Flags;
+		uint32 FourCC;
+		uint32 RGBBitCount;
+		uint32 RBitMask;
+		uint32 GBitMask;
+		uint32 BBitMask;
+		uint32 ABitMask;
+	};
+
+	struct DdsHeader {
+		uint32 Size;
+		uint32 Flags;
+		uint32 Height;
+		uint32 Width;
+		uint32 PitchOrLinearSize;
+		uint32 Depth;
+		uint32 MipMapCount;
+		uint32 Reserved1[11];
+		DdsPixelFormat PixelFormat;
+		uint32 Caps;
+		uint32 Caps2;
+		uint32 Caps3;
+		uint32 Caps4;
+		uint32 Reserved2;
+	};
+
+	struct DdsHeaderDX10 {
+		uint32 DxgiFormat;
+		uint32 ResourceDimension;
+		uint32 MiscFlag;
+		uint32 ArraySize;
+		uint32 MiscFlags2;
+	};
+
+	constexpr uint32 MakeFourCC(char a, char b, char c, char d) {
+		return (uint32)(uint8)a | ((uint32)(uint8)b << 8) | ((uint32)(uint8)c << 16) | ((uint32)(uint8)d << 24);
+	}
+
+	constexpr uint32 FormatR8G8B8A8Unorm = 28;
+	constexpr uint32 FormatBC1Unorm = 71;
+	constexpr uint32 FormatBC7Unorm = 98;
+
+	struct TestDds {
+		DdsHeader Header = {};
+		DdsHeaderDX10 Header10 = {};
+		bool HasHeader10 = true;
+
+		// Headers followed by 'dataSize' bytes of a pattern, so that copies can be compared against the file.
+		std::vector<uint8> Write(uint64 dataSize) const {
+			uint64 headerSize = sizeof(uint32) + sizeof(DdsHeader) + (HasHeader10 ? sizeof(DdsHeaderDX10) : 0);
+			std::vector<uint8> result(headerSize + dataSize);
+
+			uint32 magic = MakeFourCC('D', 'D', 'S', ' ');
+			memcpy(result.data(), &magic, sizeof(magic));
+			memcpy(result.data() + sizeof(uint32), &Header, sizeof(Header));
+			if (HasHeader10) {
+				memcpy(result.data() + sizeof(uint32) + sizeof(DdsHeader), &Header10, sizeof(Header10));
+			}
+
+			for (uint64 i = 0; i < dataSize; ++i) {
+				result[headerSize + i] = (uint8)(i * 7 + i / 251);
+			}
+			return result;
+		}
+	};
+
+	// A 2D texture, or a cubemap, with a DX10 header.
+	TestDds MakeDds(uint32 format, uint32 width, uint32 height, uint32 numMipLevels = 1, uint32 arraySize = 1, bool cubemap = false) {
+		TestDds dds;
+		dds.Header.Size = sizeof(DdsHeader);
+		dds.Header.Flags = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000; // Caps, height, width, pixel format, mip count.
+		dds.Header.Width = width;
+		dds.Header.Height = height;
+		dds.Header.MipMapCount = numMipLevels;
+		dds.Header.PixelFormat.Size = sizeof(DdsPixelFormat);
+		dds.Header.PixelFormat.Flags = 0x4; // FourCC.
+		dds.Header.PixelFormat.FourCC = MakeFourCC('D', 'X', '1', '0');
+		dds.Header.Caps = 0x1000;
+		dds.Header10 = { format, 3, cubemap ? 0x4u : 0u, arraySize, 0 };
+		return dds;
+	}
+
+	bool Parse(const std::vector<uint8>& file, DdsTextureInfo& info) {
+		return ParseDdsFile(file.data(), file.size(), info);
+	}
+
+	// Size of the texture data behind the headers of 'dds'. The parser only reads the headers, so claiming an unlimited file size lets it lay out
+	// the data without it being there.
+	uint64 GetDataSize(const TestDds& dds) {
+		std::vector<uint8> headers = dds.Write(0);
+		DdsTextureInfo info;
+		return ParseDdsFile(headers.data(), UINT64_MAX, info) ? GetDdsTextureDataSize(info) : 0;
+	}
+
+	// The regions must cover every row of every subresource once and in order. Every region must lie inside its batch, with aligned offsets
+	// and row pitches, and every batch inside the budget.
+	bool PlanIsValid(const DdsTextureInfo& info, uint64 stagingBudget, const std::vector<DdsUploadRegion>& regions, const std::vector<DdsUploadBatch>& batches) {
+		uint32 subresource = 0;
+		uint32 row = 0;
+		uint32 nextRegion = 0;
+
+		for (const DdsUploadBatch& batch : batches) {
+			if (batch.FirstRegion != nextRegion or batch.NumRegions == 0 or batch.StagingSize > stagingBudget) {
+				return false;
+			}
+
+			uint64 end = 0;
+			for (uint32 r = batch.FirstRegion; r < batch.FirstRegion + batch.NumRegions; ++r) {
+				const DdsUploadRegion& region = regions[r];
+				const DdsSubresourceLayout& layout = info.Subresources[region.Subresource];
+
+				if (region.Subresource != subresource or region.FirstRow != row or region.NumRows == 0
+					or region.StagingOffset % DDS_PLACEMENT_ALIGNMENT != 0 or region.StagingOffset < end
+					or region.StagingRowPitch % DDS_ROW_PITCH_ALIGNMENT != 0 or region.StagingRowPitch < layout.RowSize) {
+					return false;
+				}
+
+				end = region.StagingOffset + (uint64)region.NumRows * region.StagingRowPitch;
+				if (end > batch.StagingSize) {
+					return false;
+				}
+
+				row += region.NumRows;
+				if (row > layout.NumRows) {
+					return false;
+				}
+				if (row == layout.NumRows) {
+					++subresource;
+					row = 0;
+				}
+			}
+			nextRegion += batch.NumRegions;
+		}
+
+		return nextRegion == (uint32)regions.size() and subresource == (uint32)info.Subresources.size();
+	}
+
+	// Copies every batch into a staging buffer and compares each row with the file.
+	bool CopiesMatchFile(const std::vector<uint8>& file, const DdsTextureInfo& info, const std::vector<DdsUploadRegion>& regions, const std::vector<DdsUploadBatch>& batches) {
+		std::vector<uint8> staging;
+		for (const DdsUploadBatch& batch : batches) {
+			staging.assign(batch.StagingSize, 0);
+			for (uint32 r = batch.FirstRegion; r < batch.FirstRegion + batch.NumRegions; ++r) {
+				const DdsUploadRegion& region = regions[r];
+				const DdsSubresourceLayout& layout = info.Subresources[region.Subresource];
+				CopyDdsRegion(file.data(), info, region, staging.data());
+
+				for (uint32 row = 0; row < region.NumRows; ++row) {
+					const uint8* expected = file.data() + layout.SourceOffset + (uint64)(region.FirstRow + row) * layout.RowSize;
+					if (memcmp(staging.data() + region.StagingOffset + (uint64)row * region.StagingRowPitch, expected, layout.RowSize) != 0) {
+						return false;
+					}
+				}
+			}
+		}
+		return true;
+	}
+}
+
+// Layouts of uncompressed and block-compressed mip chains and cubemaps, and rejection of malformed and truncated files.
+TEST(ParseDdsFile) {
+	DdsTextureInfo info;
+
+	// Full mip chain of an uncompressed texture.
+	{
+		TestDds dds = MakeDds(FormatR8G8B8A8Unorm, 256, 128, 9);
+		const uint64 dataSize = 4 * (256 * 128 + 128 * 64 + 64 * 32 + 32 * 16 + 16 * 8 + 8 * 4 + 4 * 2 + 2 * 1 + 1 * 1);
+		std::vector<uint8> file = dds.Write(dataSize);
+
+		CHECK(Parse(file, info), "Uncompressed mip chain parses");
+		CHECK(info.Format == FormatR8G8B8A8Unorm and info.Dimension == EDdsDimension2D and not info.IsBlockCompressed and not info.IsCubemap,
+			"Format and dimension come from the DX10 header");
+		CHECK(info.Subresources.size() == 9 and GetDdsTextureDataSize(info) == dataSize, "One subresource per mip");
+		CHECK(info.Subresources[0].SourceOffset == 4 + sizeof(DdsHeader) + sizeof(DdsHeaderDX10) and info.Subresources[0].RowSize == 1024
+			and info.Subresources[0].NumRows == 128, "The first mip starts behind the headers");
+		CHECK(info.Subresources[8].Width == 1 and info.Subresources[8].Height == 1 and info.Subresources[8].RowSize == 4,
+			"The smallest mip is a single pixel");
+
+		bool contiguous = true;
+		for (uint32 i = 1; i < 9; ++i) {
+			contiguous &= (info.Subresources[i].SourceOffset == info.Subresources[i - 1].SourceOffset + info.Subresources[i - 1].SliceSize);
+		}
+		CHECK(contiguous, "Mips follow each other in the file");
+
+		file.pop_back();
+		CHECK(not Parse(file, info), "A file missing the last byte of the smallest mip is rejected");
+	}
+
+	// Block-compressed mip tails. Mips below 4x4 still take a whole block per row.
+	{
+		TestDds dds = MakeDds(FormatBC1Unorm, 16, 8, 5);
+		std::vector<uint8> file = dds.Write(32 * 2 + 16 + 8 + 8 + 8);
+		CHECK(Parse(file, info) and info.IsBlockCompressed and info.Subresources.size() == 5, "BC1 mip chain parses");
+
+		const uint32 expectedRowSizes[] = { 32, 16, 8, 8, 8 };
+		const uint32 expectedNumRows[] = { 2, 1, 1, 1, 1 };
+		bool layoutsMatch = true;
+		for (uint32 i = 0; i < 5; ++i) {
+			layoutsMatch &= (info.Subresources[i].RowSize == expectedRowSizes[i] and info.Subresources[i].NumRows == expectedNumRows[i]);
+		}
+		CHECK(layoutsMatch, "Mips of 2x1 and 1x1 pixels take one block");
+		CHECK(info.Subresources[4].Width == 1 and info.Subresources[4].Height == 1, "Mip sizes are in pixels, not blocks");
+
+		file.pop_back();
+		CHECK(not Parse(file, info), "A truncated block-compressed mip tail is rejected");
+
+		std::vector<uint8> odd = MakeDds(FormatBC7Unorm, 6, 6, 3).Write(2 * 32 + 16 + 16);
+		CHECK(Parse(odd, info) and info.Subresources[0].RowSize == 32 and info.Subresources[0].NumRows == 2 and info.Subresources[1].RowSize == 16
+			and info.Subresources[2].RowSize == 16 and GetDdsTextureDataSize(info) == odd.size() - (4 + sizeof(DdsHeader) + sizeof(DdsHeaderDX10)),
+			"Sizes which are no multiple of 4 round up to whole blocks");
+	}
+
+	// Cubemaps. Each face has all its mips before the next face starts.
+	{
+		TestDds dds = MakeDds(FormatR8G8B8A8Unorm, 64, 64, 7, 1, true);
+		uint64 faceSize = 4 * (64 * 64 + 32 * 32 + 16 * 16 + 8 * 8 + 4 * 4 + 2 * 2 + 1);
+		std::vector<uint8> file = dds.Write(6 * faceSize);
+		CHECK(Parse(file, info) and info.IsCubemap and info.ArraySize == 6 and info.Subresources.size() == 42, "A cubemap has six faces");
+		CHECK(info.Subresources[7].SourceOffset == info.Subresources[0].SourceOffset + faceSize and info.Subresources[7].Width == 64,
+			"Subresources are ordered by face, then by mip");
+
+		file.pop_back();
+		CHECK(not Parse(file, info), "A truncated last face is rejected");
+
+		TestDds cubeArray = MakeDds(FormatBC1Unorm, 4, 4, 1, 2, true);
+		CHECK(Parse(cubeArray.Write(12 * 8), info) and info.ArraySize == 12, "Cubemap arrays have six faces per cube");
+
+		TestDds legacy = MakeDds(FormatBC1Unorm, 8, 8);
+		legacy.HasHeader10 = false;
+		legacy.Header.PixelFormat.FourCC = MakeFourCC('D', 'X', 'T', '1');
+		legacy.Header.Caps2 = 0x200 | 0xFC00;
+		CHECK(Parse(legacy.Write(6 * 4 * 8), info) and info.Format == FormatBC1Unorm and info.IsCubemap and info.ArraySize == 6,
+			"Legacy cubemaps with all faces parse");
+
+		legacy.Header.Caps2 = 0x200 | 0x400;
+		CHECK(not Parse(legacy.Write(6 * 4 * 8), info), "Partial legacy cubemaps are rejected");
+	}
+
+	// Array sizes. Cubemaps multiply the array size by 6, which must neither wrap around nor exceed the D3D12 limit.
+	{
+		CHECK(Parse(MakeDds(FormatR8G8B8A8Unorm, 1, 1, 1, 341, true).Write(341 * 6 * 4), info) and info.ArraySize == 2046,
+			"The largest cubemap array parses");
+		CHECK(not Parse(MakeDds(FormatR8G8B8A8Unorm, 1, 1, 1, 342, true).Write(342 * 6 * 4), info), "Cubemap arrays of more than 2048 faces are rejected");
+		CHECK(not Parse(MakeDds(FormatR8G8B8A8Unorm, 1, 1, 1, 0x2AAAAAAB, true).Write(64), info), "Array sizes which wrap around when multiplied by 6 are rejected");
+		CHECK(not Parse(MakeDds(FormatR8G8B8A8Unorm, 1, 1, 1, 2049).Write(2049 * 4), info), "Arrays of more than 2048 slices are rejected");
+	}
+
+	// Malformed headers.
+	{
+		TestDds valid = MakeDds(FormatR8G8B8A8Unorm, 4, 4);
+		const uint64 dataSize = 64;
+		CHECK(Parse(valid.Write(dataSize), info), "The unmodified file parses");
+
+		std::vector<uint8> file = valid.Write(dataSize);
+		CHECK(not ParseDdsFile(file.data(), 4 + sizeof(DdsHeader) - 1, info), "Files shorter than the header are rejected");
+		CHECK(not ParseDdsFile(file.data(), 4 + sizeof(DdsHeader) + 4, info), "Files ending inside the DX10 header are rejected");
+
+		file[0] = 'X';
+		CHECK(not Parse(file, info), "Files without the magic number are rejected");
+
+		auto rejects = [&](auto modify) {
+			TestDds dds = valid;
+			modify(dds);
+			return not Parse(dds.Write(dataSize), info);
+		};
+
+		CHECK(rejects([](TestDds& dds) { dds.Header.Size = 123; }), "Wrong header sizes are rejected");
+		CHECK(rejects([](TestDds& dds) { dds.Header.PixelFormat.Size = 0; }), "Wrong pixel format sizes are rejected");
+		CHECK(rejects([](TestDds& dds) { dds.Header10.ArraySize = 0; }), "Empty arrays are rejected");
+		CHECK(rejects([](TestDds& dds) { dds.Header10.DxgiFormat = 0; }), "Unknown formats are rejected");
+		CHECK(rejects([](TestDds& dds) { dds.Header10.DxgiFormat = 103; }), "Planar and video formats are rejected");
+		CHECK(rejects([](TestDds& dds) { dds.Header10.ResourceDimension = 5; }), "Unknown resource dimensions are rejected");
+		CHECK(rejects([](TestDds& dds) { dds.Header.Width = 0; }), "Empty textures are rejected");
+		CHECK(rejects([](TestDds& dds) { dds.Header.Width = 16385; }), "Textures larger than D3D12 allows are rejected");
+		CHECK(rejects([](TestDds& dds) { dds.Header.MipMapCount = 4; }), "More mips than the size allows are rejected");
+		CHECK(rejects([](TestDds& dds) { dds.Header.Flags |= 0x800000; dds.Header.Depth = 2; dds.Header10.ResourceDimension = 4; dds.Header10.ArraySize = 2; }),
+			"Volume texture arrays are rejected");
+		CHECK(rejects([](TestDds& dds) { dds.HasHeader10 = false; dds.Header.PixelFormat.FourCC = MakeFourCC('A', 'B', 'C', 'D'); }),
+			"Unknown legacy FourCCs are rejected");
+	}
+}
+
+// Upload plans must copy every row exactly once, within the staging budget, and the copies must reproduce the file.
+TEST(PlanDdsUpload) {
+	DdsTextureInfo info;
+	std::vector<DdsUploadRegion> regions;
+	std::vector<DdsUploadBatch> batches;
+
+	struct Case {
+		TestDds Dds;
+		uint64 StagingBudget;
+		const char* Description;
+	};
+
+	Case cases[] = {
+		{ MakeDds(FormatR8G8B8A8Unorm, 256, 128, 9), MB(1), "A mip chain fits into one batch" },
+		{ MakeDds(FormatR8G8B8A8Unorm, 256, 128, 9), KB(64), "Large mips are split by rows" },
+		{ MakeDds(FormatBC1Unorm, 16, 8, 5), KB(1), "Block-compressed mip tails get a row pitch each" },
+		{ MakeDds(FormatR8G8B8A8Unorm, 64, 64, 7, 1, true), KB(4), "Cubemap faces are split across batches" },
+		{ MakeDds(FormatBC7Unorm, 100, 60, 7, 3), 2 * DDS_PLACEMENT_ALIGNMENT, "Array slices with odd sizes are split across batches" },
+	};
+
+	for (const Case& c : cases) {
+		std::vector<uint8> file = c.Dds.Write(GetDataSize(c.Dds));
+		bool planned = Parse(file, info) and PlanDdsUpload(info, c.StagingBudget, regions, batches);
+		CHECK(planned and PlanIsValid(info, c.StagingBudget, regions, batches) and CopiesMatchFile(file, info, regions, batches), c.Description);
+	}
+
+	{
+		TestDds dds = MakeDds(FormatR8G8B8A8Unorm, 256, 128, 9);
+		std::vector<uint8> file = dds.Write(GetDataSize(dds));
+		CHECK(Parse(file, info) and PlanDdsUpload(info, MB(1), regions, batches) and batches.size() == 1 and regions.size() == 9,
+			"Subresources which fit are not split");
+		CHECK(Parse(file, info) and not PlanDdsUpload(info, 512, regions, batches), "Budgets smaller than a row are rejected");
+	}
+
+	{
+		TestDds dds = MakeDds(FormatR8G8B8A8Unorm, 8, 8);
+		dds.Header.Flags |= 0x800000;
+		dds.Header.Depth = 4;
+		dds.Header10.ResourceDimension = 4;
+		std::vector<uint8> file = dds.Write(8 * 8 * 4 * 4);
+		CHECK(Parse(file, info) and info.Dimension == EDdsDimension3D and not PlanDdsUpload(info, MB(1), regions, batches),
+			"Volume textures can't be planned");
+	}
+}
+
+// Parsing, planning and copying of large mip chains through a staging buffer of the texture factory's default size. Runs without a GPU,
+// so this is the CPU side of loading a cached DDS file.
+BENCHMARK(DdsLayout) {
+	const uint32 numIterations = 10;
+	const uint64 stagingBudget = MB(16);
+
+	struct Case {
+		TestDds Dds;
+		const char* Name;
+	};
+
+	Case cases[] = {
+		{ MakeDds(FormatBC7Unorm, 4096, 4096, 13), "4096x4096 BC7" },
+		{ MakeDds(FormatR8G8B8A8Unorm, 2048, 2048, 12), "2048x2048 RGBA8" },
+		{ MakeDds(FormatBC1Unorm, 1024, 1024, 11, 1, true), "1024x1024 BC1 cubemap" },
+	};
+
+	std::vector<uint8> staging(stagingBudget);
+
+	for (const Case& c : cases) {
+		std::vector<uint8> file = c.Dds.Write(GetDataSize(c.Dds));
+
+		DdsTextureInfo info;
+		std::vector<DdsUploadRegion> regions;
+		std::vector<DdsUploadBatch> batches;
+
+		double planMilliseconds = 0.0;
+		double copyMilliseconds = 0.0;
+		bool valid = true;
+
+		for (uint32 iteration = 0; iteration < numIterations; ++iteration) {
+			auto start = std::chrono::high_resolution_clock::now();
+			valid &= Parse(file, info) and PlanDdsUpload(info, stagingBudget, regions, batches);
+			auto planned = std::chrono::high_resolution_clock::now();
+
+			for (const DdsUploadRegion& region : regions) {
+				CopyDdsRegion(file.data(), info, region, staging.data());
+			}
+			auto end = std::chrono::high_resolution_clock::now();
+
+			planMilliseconds += std::chrono::duration<double, std::milli>(planned - start).count();
+			copyMilliseconds += std::chrono::duration<double, std::milli>(end - planned).count();
+		}
+
+		CHECK(valid, "Benchmark textures parse and plan");
+
+		uint64 numBytes = GetDdsTextureDataSize(info);
+		double gbPerSecond = (double)numBytes * numIterations / (copyMilliseconds * 1e-3) / (1024.0 * 1024.0 * 1024.0);
+		printf("%s: %llu KB in %u regions, %u batches. Parse and plan %.3f ms, copy %.3f ms (%.2f GB/s).\n", c.Name, (unsigned long long)BYTE_TO_KB(numBytes),
+			(uint32)regions.size(), (uint32)batches.size(), planMilliseconds / numIterations, copyMilliseconds / numIterations, gbPerSecond);
+	}
+}
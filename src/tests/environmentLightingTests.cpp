@@ -0,0 +1,242 @@
+#include "testing.h"
+#include "../core/environmentLighting.h"
+
+#include <chrono>
+#include <cmath>
+
+namespace {
+	constexpr double Pi = 3.14159265358979323846;
+
+	struct Vec3 {
+		float X, Y, Z;
+	};
+
+	Vec3 operator+(Vec3 a, Vec3 b) { return { a.X + b.X, a.Y + b.Y, a.Z + b.Z }; }
+	Vec3 operator*(Vec3 a, float s) { return { a.X * s, a.Y * s, a.Z * s }; }
+	float Dot(Vec3 a, Vec3 b) { return a.X * b.X + a.Y * b.Y + a.Z * b.Z; }
+	Vec3 Normalize(Vec3 a) { return a * (1.f / std::sqrt(Dot(a, a))); }
+
+	Vec3 EquirectangularDirection(float u, float v) {
+		Vec3 d;
+		GetEquirectangularDirection(u, v, &d.X);
+		return d;
+	}
+
+	Vec3 CubemapDirection(uint32 face, float u, float v) {
+		Vec3 d;
+		GetCubemapDirection(face, u, v, &d.X);
+		return d;
+	}
+
+	// Without the clamp of brdf.hlsli, like the prefiltering.
+	float DistributionGGX(float NdotH, float roughness) {
+		float a = roughness * roughness;
+		float a2 = a * a;
+		float d = NdotH * NdotH * (a2 - 1.f) + 1.f;
+		return a2 / (d * d * (float)Pi);
+	}
+
+	struct OwnedCubemap {
+		std::vector<std::vector<float>> Storage;
+		std::vector<CubemapLevel> Levels;
+
+		OwnedCubemap(uint32 size) {
+			for (uint32 levelSize = size; levelSize > 0; levelSize >>= 1) {
+				std::vector<float>& storage = Storage.emplace_back((size_t)levelSize * levelSize * 6 * 4);
+				CubemapLevel level;
+				for (uint32 face = 0; face < 6; ++face) {
+					level.Faces[face] = storage.data() + (size_t)face * levelSize * levelSize * 4;
+				}
+				level.Size = levelSize;
+				level.RowPitch = (uint64)levelSize * 4 * sizeof(float);
+				Levels.push_back(level);
+			}
+		}
+	};
+
+	void FillBenchmarkEnvironment(std::vector<float>& pixels, uint32 width, uint32 height) {
+		Vec3 sunDirection = Normalize({ 0.4f, 0.6f, -0.5f });
+		float cosSunRadius = std::cos(4.f * (float)Pi / 180.f);
+
+		for (uint32 y = 0; y < height; ++y) {
+			for (uint32 x = 0; x < width; ++x) {
+				float u = (x + 0.5f) / width;
+				float v = (y + 0.5f) / height;
+				Vec3 d = EquirectangularDirection(u, v);
+				float* p = pixels.data() + ((size_t)y * width + x) * 4;
+
+				if (d.Y > 0.f) {
+					p[0] = 1.2f - 0.9f * d.Y;
+					p[1] = 1.3f - 0.7f * d.Y;
+					p[2] = 1.5f - 0.2f * d.Y;
+				}
+				else {
+					p[0] = 0.3f;
+					p[1] = 0.25f;
+					p[2] = 0.2f;
+				}
+
+				if (Dot(d, sunDirection) > cosSunRadius) {
+					p[0] += 60.f;
+					p[1] += 55.f;
+					p[2] += 45.f;
+				}
+
+				// Windows of a room-like environment.
+				if (std::abs(u - 0.25f) < 0.03f and std::abs(v - 0.45f) < 0.08f) {
+					p[0] += 8.f; p[1] += 8.f; p[2] += 9.f;
+				}
+				if (std::abs(u - 0.7f) < 0.05f and std::abs(v - 0.4f) < 0.04f) {
+					p[0] += 4.f; p[1] += 3.f; p[2] += 2.f;
+				}
+
+				p[3] = 1.f;
+			}
+		}
+	}
+
+	// Points spread evenly over the sphere.
+	Vec3 FibonacciDirection(uint32 i, uint32 count) {
+		float y = 1.f - 2.f * (i + 0.5f) / count;
+		float r = std::sqrt(Max(0.f, 1.f - y * y));
+		float phi = (float)i * 2.39996323f;
+		return { r * std::cos(phi), y, r * std::sin(phi) };
+	}
+
+	double RelativeError(const float* value, const double* reference) {
+		double error = 0.0;
+		for (uint32 c = 0; c < 3; ++c) {
+			error += std::abs(value[c] - reference[c]) / Max(reference[c], 1e-6);
+		}
+		return error / 3.0;
+	}
+}
+
+// Precomputes the lighting of a synthetic environment with a sky gradient, a sun and a few bright patches, and compares both results
+// against brute-force convolution at a set of directions spread over the sphere. The errors are relative, averaged over the color channels.
+BENCHMARK(EnvironmentLighting) {
+	const uint32 width = 2048;
+	const uint32 height = 1024;
+	const uint32 environmentResolution = 128;
+
+	using clock = std::chrono::high_resolution_clock;
+	auto milliseconds = [](clock::time_point start) { return std::chrono::duration<double, std::milli>(clock::now() - start).count(); };
+
+	std::vector<float> pixels((size_t)width * height * 4);
+	FillBenchmarkEnvironment(pixels, width, height);
+	EnvironmentImage image = { pixels.data(), width, height, (uint64)width * 4 * sizeof(float) };
+
+	auto start = clock::now();
+	ProjectEnvironmentToSH(image, false);
+	double millisecondsSHSerial = milliseconds(start);
+
+	start = clock::now();
+	SHIrradiance sh = ProjectEnvironmentToSH(image, true);
+	double millisecondsSHParallel = milliseconds(start);
+
+	OwnedCubemap prefiltered(environmentResolution);
+	uint32 numLevels = (uint32)prefiltered.Levels.size();
+
+	GGXPrefilterSettings settings;
+	settings.Parallel = false;
+	start = clock::now();
+	PrefilterEnvironmentGGX(image, prefiltered.Levels.data(), numLevels, settings);
+	double millisecondsPrefilterSerial = milliseconds(start);
+
+	settings.Parallel = true;
+	start = clock::now();
+	PrefilterEnvironmentGGX(image, prefiltered.Levels.data(), numLevels, settings);
+	double millisecondsPrefilterParallel = milliseconds(start);
+
+	// Directions and solid angles of all environment texels, for the brute-force references.
+	std::vector<Vec3> directions((size_t)width * height);
+	std::vector<float> solidAngles(height);
+	for (uint32 y = 0; y < height; ++y) {
+		solidAngles[y] = (float)((2.0 * Pi / width) * (Pi / height) * std::sin(Pi * (y + 0.5) / height));
+		for (uint32 x = 0; x < width; ++x) {
+			directions[(size_t)y * width + x] = EquirectangularDirection((x + 0.5f) / width, (y + 0.5f) / height);
+		}
+	}
+
+	const uint32 numIrradianceDirections = 64;
+	double squaredErrorSum = 0.0;
+	double irradianceErrorMax = 0.0;
+	start = clock::now();
+	for (uint32 i = 0; i < numIrradianceDirections; ++i) {
+		Vec3 n = FibonacciDirection(i, numIrradianceDirections);
+
+		double reference[3] = {};
+		for (uint32 y = 0; y < height; ++y) {
+			for (uint32 x = 0; x < width; ++x) {
+				size_t index = (size_t)y * width + x;
+				float cosine = Dot(n, directions[index]);
+				if (cosine > 0.f) {
+					double weight = (double)cosine * solidAngles[y];
+					for (uint32 c = 0; c < 3; ++c) {
+						reference[c] += pixels[index * 4 + c] * weight;
+					}
+				}
+			}
+		}
+		for (double& r : reference) {
+			r /= Pi;
+		}
+
+		float value[3];
+		EvaluateSHIrradiance(sh, &n.X, value);
+		double error = RelativeError(value, reference);
+		squaredErrorSum += error * error;
+		irradianceErrorMax = Max(irradianceErrorMax, error);
+	}
+	double millisecondsBruteForceIrradiance = milliseconds(start);
+	double irradianceErrorRMS = std::sqrt(squaredErrorSum / numIrradianceDirections);
+
+	// The prefiltered texels are compared at their exact texel direction, so that no interpolation of the result is involved.
+	const uint32 numTexelsPerLevel = 16;
+	uint32 numPrefilterSamples = 0;
+	squaredErrorSum = 0.0;
+	for (uint32 levelIndex = 1; levelIndex < numLevels; ++levelIndex) {
+		const CubemapLevel& level = prefiltered.Levels[levelIndex];
+		float roughness = (float)levelIndex / (numLevels - 1);
+
+		for (uint32 i = 0; i < numTexelsPerLevel; ++i) {
+			uint32 face = i % 6;
+			uint32 x = (i * 7 + 3) % level.Size;
+			uint32 y = (i * 5 + 1) % level.Size;
+			Vec3 n = CubemapDirection(face, (x + 0.5f) / level.Size, (y + 0.5f) / level.Size);
+
+			double reference[3] = {};
+			double totalWeight = 0.0;
+			for (uint32 py = 0; py < height; ++py) {
+				for (uint32 px = 0; px < width; ++px) {
+					size_t index = (size_t)py * width + px;
+					Vec3 l = directions[index];
+					float NdotL = Dot(n, l);
+					if (NdotL > 0.f) {
+						Vec3 h = Normalize(n + l);
+						double weight = (double)DistributionGGX(Dot(n, h), roughness) * NdotL * solidAngles[py];
+						for (uint32 c = 0; c < 3; ++c) {
+							reference[c] += pixels[index * 4 + c] * weight;
+						}
+						totalWeight += weight;
+					}
+				}
+			}
+			for (double& r : reference) {
+				r /= totalWeight;
+			}
+
+			const float* value = (const float*)((const uint8*)level.Faces[face] + y * level.RowPitch) + x * 4;
+			double error = RelativeError(value, reference);
+			squaredErrorSum += error * error;
+			++numPrefilterSamples;
+		}
+	}
+	double prefilterErrorRMS = std::sqrt(squaredErrorSum / Max(numPrefilterSamples, 1u)); // Over all levels except 0.
+
+	printf("%ux%u: SH projection %.2f ms serial, %.2f ms parallel (brute-force convolution of %u directions %.1f ms). "
+		"GGX prefilter (%u) %.1f ms serial, %.1f ms parallel.\n", width, height, millisecondsSHSerial, millisecondsSHParallel, numIrradianceDirections,
+		millisecondsBruteForceIrradiance, environmentResolution, millisecondsPrefilterSerial, millisecondsPrefilterParallel);
+	printf("Errors: irradiance %.2f%% RMS, %.2f%% max, prefiltered %.2f%% RMS.\n", irradianceErrorRMS * 100.0, irradianceErrorMax * 100.0,
+		prefilterErrorRMS * 100.0);
+}
@@ -0,0 +1,354 @@
+#include "testing.h"
+#include "../core/fenceRecycler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <thread>
+
+#define FENCE_RECYCLER_TEST_IDLE_MILLISECONDS 100
+
+namespace {
+	using Clock = std::chrono::high_resolution_clock;
+
+	struct Xorshift {
+		uint64 State;
+
+		uint32 Next() {
+			State ^= State << 13;
+			State ^= State >> 7;
+			State ^= State << 17;
+			return (uint32)(State >> 16);
+		}
+	};
+
+	enum ETestObjectState : uint32 {
+		ETestObjectStateFree,
+		ETestObjectStateRecording,
+		ETestObjectStateSubmitted,
+	};
+
+	struct TestObject : FenceRecyclable {
+		std::atomic<uint32> State = ETestObjectStateFree;
+	};
+
+	// Stands in for an ID3D12Fence and the events waiting on it. Wake plays the role of the event which Submit asks to set.
+	struct SimulatedFence {
+		std::mutex Mutex;
+		std::condition_variable Changed;
+		std::atomic<uint64> Completed = 0;
+		uint64 Signaled = 0; // Under the submission mutex of the workload.
+		bool Woken = false;
+
+		// Until 'value' is reached or Wake is called. 0 only waits for Wake.
+		void Wait(uint64 value) {
+			std::unique_lock lock(Mutex);
+			Changed.wait(lock, [&] { return Woken or (value and Completed.load() >= value); });
+			Woken = false;
+		}
+
+		void Wake() {
+			std::lock_guard lock(Mutex);
+			Woken = true;
+			Changed.notify_all();
+		}
+
+		void Advance(uint64 value) {
+			std::lock_guard lock(Mutex);
+			Completed.store(value);
+			Changed.notify_all();
+		}
+	};
+
+	struct Workload {
+		SimulatedFence Fence;
+		std::mutex SubmitMutex;
+		std::mutex ObjectsMutex;
+		std::vector<std::unique_ptr<TestObject>> Objects;
+		std::atomic<bool> Running = true;
+		double RecyclerCpuMilliseconds = 0.0;
+		double Milliseconds = 0.0;
+	};
+
+	// 'acquire' returns a free object or nullptr, 'submit' hands a submitted one to the recycler, 'recycle' runs the recycler thread until
+	// 'Running' is cleared and nothing is in flight.
+	template<typename Acquire, typename Submit, typename Recycle>
+	void RunWorkload(Workload& workload, uint32 numThreads, uint32 numSubmissionsPerThread, TestContext& test,
+		const Acquire& acquire, const Submit& submit, const Recycle& recycle) {
+
+		auto start = Clock::now();
+
+		std::thread recycler([&] {
+			recycle();
+			workload.RecyclerCpuMilliseconds = GetCurrentThreadCpuMilliseconds();
+		});
+
+		std::atomic<bool> submitting = true;
+		std::thread gpu([&] {
+			Xorshift rng = { 0x9E3779B97F4A7C15ull };
+			while (true) {
+				uint64 signaled;
+				{
+					std::lock_guard lock(workload.SubmitMutex);
+					signaled = workload.Fence.Signaled;
+				}
+				uint64 completed = workload.Fence.Completed.load();
+				if (completed < signaled) {
+					workload.Fence.Advance(Min(signaled, completed + 1 + rng.Next() % 64));
+				}
+				else if (not submitting.load()) {
+					break;
+				}
+				std::this_thread::sleep_for(std::chrono::microseconds(rng.Next() % 50));
+			}
+		});
+
+		std::vector<std::thread> threads;
+		for (uint32 t = 0; t < numThreads; ++t) {
+			threads.emplace_back([&] {
+				for (uint32 i = 0; i < numSubmissionsPerThread; ++i) {
+					TestObject* object = acquire();
+					if (not object) {
+						std::lock_guard lock(workload.ObjectsMutex);
+						object = workload.Objects.emplace_back(std::make_unique<TestObject>()).get();
+					}
+
+					uint32 previous = object->State.exchange(ETestObjectStateRecording);
+					CHECK(previous == ETestObjectStateFree, "Free objects are not in use");
+
+					{
+						std::lock_guard lock(workload.SubmitMutex);
+						object->FenceValue = ++workload.Fence.Signaled;
+						object->State.store(ETestObjectStateSubmitted);
+					}
+
+					// Outside of the lock, so that objects reach the recycler out of fence order.
+					submit(object);
+
+					// Frames: bursts of submissions with idle time in between, which is where a polling thread burns its time.
+					if (i % 256 == 255) {
+						std::this_thread::sleep_for(std::chrono::milliseconds(2));
+					}
+				}
+			});
+		}
+
+		for (std::thread& thread : threads) {
+			thread.join();
+		}
+		submitting.store(false);
+		gpu.join();
+
+		// The application idles, e.g. in a loading screen or minimized.
+		std::this_thread::sleep_for(std::chrono::milliseconds(FENCE_RECYCLER_TEST_IDLE_MILLISECONDS));
+
+		workload.Running.store(false);
+		workload.Fence.Wake();
+		recycler.join();
+
+		workload.Milliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+}
+
+// Submits objects from several threads against a simulated fence, which a "GPU" thread advances at random pace. Checks that every object
+// is recycled exactly once, never before its fence value was reached, and that the free list hands out every object again. Also compares
+// the CPU time of the recycler thread with the polling one it replaces, over the workload and FENCE_RECYCLER_TEST_IDLE_MILLISECONDS without
+// any submissions.
+TEST(FenceRecycler) {
+	const uint32 numThreads = 4;
+	const uint32 numSubmissionsPerThread = 20000;
+
+	FenceRecyclerStatistics statistics;
+	double pollingCpuMilliseconds = 0.0; // The same workload with a thread which yields in a loop and waits for objects in submission order.
+	double milliseconds = 0.0;           // Wall time of the slower of the two runs.
+
+	// Deterministic ordering.
+	{
+		FenceRecycler recycler;
+		TestObject objects[3];
+		objects[0].FenceValue = 3;
+		objects[1].FenceValue = 1;
+		objects[2].FenceValue = 2;
+
+		uint32 numReset = 0;
+		auto reset = [&](FenceRecyclable*) { numReset++; };
+
+		CHECK(recycler.Update(0, reset) == 0, "Nothing pending without submissions");
+		CHECK(recycler.BeginIdleWait(), "Idle wait without submissions");
+		CHECK(recycler.Submit(&objects[0]), "Submission wakes an idle recycler");
+		recycler.EndIdleWait();
+		CHECK(not recycler.BeginIdleWait(), "No idle wait with a submission pending");
+		recycler.EndIdleWait();
+		CHECK(not recycler.Submit(&objects[1]), "Submission doesn't wake a busy recycler");
+		recycler.Submit(&objects[2]);
+
+		CHECK(recycler.Update(0, reset) == 1, "Waits for the lowest fence value first");
+		CHECK(numReset == 0, "Nothing recycled before its fence value");
+		CHECK(recycler.PopFree() == nullptr, "Nothing free before its fence value");
+		CHECK(recycler.Update(2, reset) == 3, "Waits for the next fence value after a batch");
+		CHECK(numReset == 2 and recycler.NumInFlight() == 1, "Everything up to the fence value recycled in one batch");
+
+		FenceRecyclable* a = recycler.PopFree();
+		FenceRecyclable* b = recycler.PopFree();
+		CHECK(a and b and a != b and a != &objects[0] and b != &objects[0], "Recycled objects are free again");
+		CHECK(recycler.PopFree() == nullptr, "Free objects are handed out once");
+
+		CHECK(recycler.Update(100, reset) == 0 and numReset == 3, "Nothing pending after the last batch");
+		CHECK(recycler.PopFree() == &objects[0], "Last object is free again");
+		CHECK(recycler.GetStatistics().NumBatches == 2, "One batch per completed fence value");
+	}
+
+	// Concurrent pops. Every thread takes its share of the free objects, so whenever a thread pops, at least as many are left as it still
+	// needs, and it must never find the list empty.
+	{
+		const uint32 numPoppingThreads = Max(numThreads, 2u);
+		const uint32 numObjectsPerThread = 1024;
+		FenceRecycler recycler;
+		std::vector<TestObject> objects(numPoppingThreads * numObjectsPerThread);
+		for (TestObject& object : objects) {
+			object.FenceValue = 1;
+			recycler.Submit(&object);
+		}
+		recycler.Update(1, [](FenceRecyclable*) {});
+
+		std::atomic<uint32> numEmpty = 0;
+		std::vector<std::thread> threads;
+		for (uint32 t = 0; t < numPoppingThreads; ++t) {
+			threads.emplace_back([&] {
+				for (uint32 i = 0; i < numObjectsPerThread;) {
+					if (FenceRecyclable* object = recycler.PopFree()) {
+						((TestObject*)object)->State++;
+						++i;
+					}
+					else {
+						numEmpty++;
+					}
+				}
+			});
+		}
+		for (std::thread& thread : threads) {
+			thread.join();
+		}
+
+		bool allOnce = true;
+		for (const TestObject& object : objects) {
+			allOnce &= (object.State.load() == 1);
+		}
+		CHECK(allOnce and recycler.PopFree() == nullptr, "Concurrent pops hand out every object once");
+		CHECK(numEmpty.load() == 0, "Concurrent pops don't see an empty list while objects are free");
+	}
+
+	// Threaded, against a simulated fence.
+	uint32 numObjects = 0;
+	{
+		Workload workload;
+		FenceRecycler recycler;
+		uint64 numEarly = 0;
+		uint64 numTwice = 0;
+
+		RunWorkload(workload, numThreads, numSubmissionsPerThread, test,
+			[&] { return (TestObject*)recycler.PopFree(); },
+			[&](TestObject* object) {
+				if (recycler.Submit(object)) {
+					workload.Fence.Wake();
+				}
+			},
+			[&] {
+				while (workload.Running.load() or recycler.NumInFlight() > 0) {
+					uint64 waitFor = recycler.Update(workload.Fence.Completed.load(), [&](FenceRecyclable* recyclable) {
+						// Counted instead of checked right away, so that the timing stays comparable with the baseline.
+						TestObject* object = (TestObject*)recyclable;
+						numEarly += (object->FenceValue > workload.Fence.Completed.load());
+						numTwice += (object->State.exchange(ETestObjectStateFree) != ETestObjectStateSubmitted);
+					});
+
+					if (waitFor == 0) {
+						if (recycler.BeginIdleWait()) {
+							workload.Fence.Wait(0);
+						}
+						recycler.EndIdleWait();
+					}
+					else {
+						workload.Fence.Wait(waitFor);
+					}
+				}
+			});
+
+		statistics = recycler.GetStatistics();
+		statistics.CpuMilliseconds = workload.RecyclerCpuMilliseconds;
+		milliseconds = workload.Milliseconds;
+
+		CHECK(numEarly == 0, "Objects are recycled after their fence value");
+		CHECK(numTwice == 0, "Objects are recycled once");
+
+		uint64 numSubmissions = (uint64)numThreads * numSubmissionsPerThread;
+		CHECK(statistics.NumSubmitted == numSubmissions and statistics.NumRecycled == numSubmissions, "Every submission is recycled");
+
+		std::vector<FenceRecyclable*> free;
+		while (FenceRecyclable* object = recycler.PopFree()) {
+			free.push_back(object);
+		}
+		std::sort(free.begin(), free.end());
+		numObjects = (uint32)workload.Objects.size();
+		CHECK(free.size() == numObjects and std::adjacent_find(free.begin(), free.end()) == free.end(), "Every object is free once at the end");
+	}
+
+	// Baseline: running objects on a stack behind a mutex, waited for one by one, and a thread which yields while there are none.
+	{
+		Workload workload;
+		std::mutex mutex;
+		TestObject* running = nullptr;
+		TestObject* freeList = nullptr;
+		std::atomic<uint32> numRunning = 0;
+
+		RunWorkload(workload, numThreads, numSubmissionsPerThread, test,
+			[&] {
+				std::lock_guard lock(mutex);
+				TestObject* object = freeList;
+				if (object) {
+					freeList = (TestObject*)object->NextRecyclable.load();
+				}
+				return object;
+			},
+			[&](TestObject* object) {
+				std::lock_guard lock(mutex);
+				object->NextRecyclable.store(running);
+				running = object;
+				numRunning++;
+			},
+			[&] {
+				while (workload.Running.load() or numRunning.load() > 0) {
+					while (true) {
+						mutex.lock();
+						TestObject* object = running;
+						if (object) {
+							running = (TestObject*)object->NextRecyclable.load();
+						}
+						mutex.unlock();
+
+						if (not object) {
+							break;
+						}
+
+						while (workload.Fence.Completed.load() < object->FenceValue) {
+							workload.Fence.Wait(object->FenceValue);
+						}
+						object->State.store(ETestObjectStateFree);
+
+						mutex.lock();
+						object->NextRecyclable.store(freeList);
+						freeList = object;
+						numRunning--;
+						mutex.unlock();
+					}
+					std::this_thread::yield();
+				}
+			});
+
+		pollingCpuMilliseconds = workload.RecyclerCpuMilliseconds;
+		milliseconds = Max(milliseconds, workload.Milliseconds);
+	}
+
+	printf("%llu recycled in %llu batches, recycler thread %.1f ms CPU (polling %.1f ms) in %.1f ms.\n",
+		(unsigned long long)statistics.NumRecycled, (unsigned long long)statistics.NumBatches, statistics.CpuMilliseconds, pollingCpuMilliseconds, milliseconds);
+}
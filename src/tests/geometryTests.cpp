@@ -0,0 +1,95 @@
+#include "testing.h"
+#include "../physics/geometry.h"
+#include "../core/memory.h"
+
+#include <chrono>
+
+namespace {
+	struct CpuMeshBuildStats {
+		double Milliseconds;
+		uint32 NumGrowths;
+		uint64 NumBytesCopied;
+	};
+}
+
+// Builds a mesh of 'numSubmeshes' procedural shapes with each growth strategy, 'numIterations' times. Times are per build.
+BENCHMARK(CpuMeshBuild) {
+	const uint32 numSubmeshes = 500;
+	const uint32 numIterations = 5;
+	const uint32 flags = EMeshCreationFlagsWithPositions | EMeshCreationFlagsWithUvs | EMeshCreationFlagsWithNormals | EMeshCreationFlagsWithTangents;
+	const uint32 numShapes = 4;
+
+	auto pushShape = [](CpuMesh& mesh, uint32 shape) {
+		switch (shape) {
+			case 0: return mesh.PushSphere(32, 16, 1.f);
+			case 1: return mesh.PushCapsule(32, 16, 2.f, 0.5f);
+			case 2: return mesh.PushTorus(32, 32, 1.f, 0.25f);
+			default: return mesh.PushCube(1.f);
+		}
+	};
+
+	// Sizes of the shapes, for the exact growth and for presizing.
+	SubmeshInfo shapeInfos[numShapes];
+	for (uint32 i = 0; i < numShapes; ++i) {
+		CpuMesh probe(flags);
+		shapeInfos[i] = pushShape(probe, i);
+	}
+
+	uint32 totalVertices = 0;
+	uint32 totalTriangles = 0;
+	for (uint32 i = 0; i < numSubmeshes; ++i) {
+		totalVertices += shapeInfos[i % numShapes].NumVertices;
+		totalTriangles += shapeInfos[i % numShapes].NumTriangles;
+	}
+
+	MemoryArena arena;
+	arena.MinimumBlockSize = MB(16);
+
+	auto measure = [&](CpuMeshBuildStats& stats, bool exact, bool useArena, bool presize) {
+		for (uint32 iteration = 0; iteration < numIterations; ++iteration) {
+			auto start = std::chrono::high_resolution_clock::now();
+
+			CpuMesh mesh(flags, useArena ? &arena : nullptr);
+			if (presize) {
+				mesh.ReserveCapacity(totalVertices, totalTriangles, numSubmeshes);
+			}
+
+			uint32 numVertices = 0;
+			uint32 numTriangles = 0;
+			for (uint32 i = 0; i < numSubmeshes; ++i) {
+				const SubmeshInfo& info = shapeInfos[i % numShapes];
+				if (exact) {
+					// Exactly what the pushes used to request. The pushes themselves then find enough room.
+					numVertices += info.NumVertices;
+					numTriangles = AlignTo(numTriangles, 8) + info.NumTriangles;
+					mesh.ReserveCapacity(numVertices, numTriangles);
+				}
+				pushShape(mesh, i % numShapes);
+			}
+
+			auto end = std::chrono::high_resolution_clock::now();
+
+			stats.Milliseconds += std::chrono::duration<double, std::milli>(end - start).count() / numIterations;
+			stats.NumGrowths = mesh.NumGrowths;
+			stats.NumBytesCopied = mesh.NumBytesCopied;
+
+			arena.Reset();
+		}
+	};
+
+	CpuMeshBuildStats exactGrowth = {}; // Reallocating to the exact new size on every push, which is how CpuMesh used to grow.
+	CpuMeshBuildStats geometric = {};
+	CpuMeshBuildStats arenaGrowth = {};
+	CpuMeshBuildStats presized = {};    // ReserveCapacity with the final size before pushing.
+	measure(exactGrowth, true, false, false);
+	measure(geometric, false, false, false);
+	measure(arenaGrowth, false, true, false);
+	measure(presized, false, false, true);
+
+	arena.Free();
+
+	printf("%u submeshes, %u vertices, %u triangles: exact growth %.2f ms (%u growths, %.1f MB copied), geometric %.2f ms (%u, %.1f MB), arena %.2f ms, "
+		"presized %.2f ms.\n", numSubmeshes, totalVertices, totalTriangles, exactGrowth.Milliseconds, exactGrowth.NumGrowths,
+		exactGrowth.NumBytesCopied / (1024.0 * 1024.0), geometric.Milliseconds, geometric.NumGrowths, geometric.NumBytesCopied / (1024.0 * 1024.0),
+		arenaGrowth.Milliseconds, presized.Milliseconds);
+}
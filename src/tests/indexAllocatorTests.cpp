@@ -0,0 +1,234 @@
+#include "testing.h"
+#include "../core/indexAllocator.h"
+
+#include <chrono>
+#include <thread>
+
+namespace {
+	using Clock = std::chrono::high_resolution_clock;
+
+	struct Xorshift {
+		uint64 State;
+
+		uint32 Next() {
+			State ^= State << 13;
+			State ^= State >> 7;
+			State ^= State << 17;
+			return (uint32)(State >> 16);
+		}
+	};
+
+	// A "descriptor heap" which only remembers who owns each slot.
+	struct FakeHeap {
+		std::unique_ptr<std::atomic<uint32>[]> Owners;
+
+		FakeHeap(uint32 capacity) : Owners(std::make_unique<std::atomic<uint32>[]>(capacity)) {}
+
+		// Return false if a slot was already taken, or not owned by 'owner'.
+		bool Take(uint32 first, uint32 count, uint32 owner) {
+			bool result = true;
+			for (uint32 i = first; i < first + count; ++i) {
+				result &= (Owners[i].exchange(owner, std::memory_order_relaxed) == 0);
+			}
+			return result;
+		}
+		bool Release(uint32 first, uint32 count, uint32 owner) {
+			bool result = true;
+			for (uint32 i = first; i < first + count; ++i) {
+				result &= (Owners[i].exchange(0, std::memory_order_relaxed) == owner);
+			}
+			return result;
+		}
+	};
+
+	struct StressCounters {
+		std::atomic<uint64> NumFailedAllocations = 0;
+		std::atomic<uint64> NumDoubleAllocations = 0;
+	};
+
+	struct HeldRange {
+		uint32 Offset;
+		uint32 Count;
+	};
+
+	// Every thread keeps up to its share of half the table allocated and picks allocations and frees at random. Returns the seconds the
+	// slowest thread took.
+	template<class AllocateT, class FreeT>
+	double RunStressWorkload(uint32 numThreads, uint32 numOperationsPerThread, uint32 capacity, AllocateT allocate, FreeT free,
+		BuddyAllocator* ranges, FakeHeap& heap, FakeHeap& rangeHeap, StressCounters& counters) {
+
+		std::atomic<uint32> numReady = 0;
+		std::atomic<bool> start = false;
+
+		std::vector<std::thread> threads;
+		for (uint32 t = 0; t < numThreads; ++t) {
+			threads.emplace_back([&, t] {
+				uint32 owner = t + 1;
+				Xorshift rng = { 0x2545F4914F6CDD1Dull * owner };
+				uint32 maxHeld = Max(capacity / (numThreads * 2), 1u);
+				std::vector<uint32> held;
+				std::vector<HeldRange> heldRanges;
+				held.reserve(maxHeld);
+
+				numReady.fetch_add(1);
+				while (not start.load(std::memory_order_acquire)) {}
+
+				for (uint32 i = 0; i < numOperationsPerThread; ++i) {
+					uint32 r = rng.Next();
+
+					if (ranges and (r & 3) == 3) {
+						if (not heldRanges.empty() and (heldRanges.size() >= 16 or (r & 4))) {
+							uint32 slot = (r >> 8) % heldRanges.size();
+							HeldRange range = heldRanges[slot];
+							heldRanges[slot] = heldRanges.back();
+							heldRanges.pop_back();
+							if (not rangeHeap.Release(range.Offset, range.Count, owner)) {
+								counters.NumDoubleAllocations.fetch_add(1, std::memory_order_relaxed);
+							}
+							ranges->Free(range.Offset, range.Count);
+						}
+						else {
+							uint32 count = 1 + (r >> 8) % 64;
+							uint32 offset = ranges->Allocate(count);
+							if (offset == INDEX_ALLOCATOR_INVALID) {
+								counters.NumFailedAllocations.fetch_add(1, std::memory_order_relaxed);
+							}
+							else {
+								if (not rangeHeap.Take(offset, count, owner)) {
+									counters.NumDoubleAllocations.fetch_add(1, std::memory_order_relaxed);
+								}
+								heldRanges.push_back({ offset, count });
+							}
+						}
+						continue;
+					}
+
+					if (not held.empty() and (held.size() >= maxHeld or (r & 4))) {
+						uint32 slot = (r >> 8) % held.size();
+						uint32 index = held[slot];
+						held[slot] = held.back();
+						held.pop_back();
+						if (not heap.Release(index, 1, owner)) {
+							counters.NumDoubleAllocations.fetch_add(1, std::memory_order_relaxed);
+						}
+						free(index);
+					}
+					else {
+						uint32 index = allocate();
+						if (index == INDEX_ALLOCATOR_INVALID) {
+							counters.NumFailedAllocations.fetch_add(1, std::memory_order_relaxed);
+						}
+						else {
+							if (not heap.Take(index, 1, owner)) {
+								counters.NumDoubleAllocations.fetch_add(1, std::memory_order_relaxed);
+							}
+							held.push_back(index);
+						}
+					}
+				}
+
+				for (uint32 index : held) {
+					heap.Release(index, 1, owner);
+					free(index);
+				}
+				for (HeldRange range : heldRanges) {
+					rangeHeap.Release(range.Offset, range.Count, owner);
+					ranges->Free(range.Offset, range.Count);
+				}
+			});
+		}
+
+		while (numReady.load() < numThreads) {
+			std::this_thread::yield();
+		}
+		auto startTime = Clock::now();
+		start.store(true, std::memory_order_release);
+		for (std::thread& thread : threads) {
+			thread.join();
+		}
+		return std::chrono::duration<double>(Clock::now() - startTime).count();
+	}
+}
+
+// Allocates and frees from several threads against a fake heap, which records the owner of every slot. A quarter of the operations are
+// ranges of 1 to 64 slots from a BuddyAllocator over another fake heap. Afterwards the whole table must be allocatable again.
+TEST(IndexAllocatorStress) {
+	const uint32 numThreads = 8;
+	const uint32 numOperationsPerThread = 250000;
+	const uint32 capacity = 65536 * 4;
+
+	FakeHeap heap(capacity);
+	FakeHeap rangeHeap(capacity);
+	StressCounters counters;
+	IndexAllocator indices;
+	indices.Initialize(capacity);
+	BuddyAllocator ranges;
+	ranges.Initialize(capacity);
+
+	RunStressWorkload(numThreads, numOperationsPerThread, capacity,
+		[&] { return indices.Allocate(); }, [&](uint32 index) { indices.Free(index); }, &ranges, heap, rangeHeap, counters);
+
+	// Everything was returned, so the whole table must be available again, and the ranges must have merged back.
+	bool complete = (ranges.NumFree() == capacity);
+	for (uint32 i = 0; i < capacity; ++i) {
+		uint32 index = indices.Allocate();
+		complete &= (index != INDEX_ALLOCATOR_INVALID) and heap.Take(index, 1, 1);
+	}
+	complete &= (indices.Allocate() == INDEX_ALLOCATOR_INVALID);
+	complete &= (ranges.Allocate(capacity) == 0 or (capacity & (capacity - 1)) != 0);
+
+	CHECK(complete, "Everything is returned and the whole table is allocatable again");
+	CHECK(counters.NumDoubleAllocations == 0, "No index or range is handed out twice");
+	CHECK(counters.NumFailedAllocations == 0, "Nothing fails while the table is at most half full");
+}
+
+// The same workload with single indices only, against a free list behind a mutex as a baseline.
+BENCHMARK(IndexAllocator) {
+	const uint32 numOperationsPerThread = 1000000;
+	const uint32 capacity = 65536 * 4;
+
+	for (uint32 numThreads = 1; numThreads <= 16; numThreads *= 2) {
+		uint64 numOperations = (uint64)numThreads * numOperationsPerThread;
+		double millionOperationsPerSecond = 0.0;
+		double millionOperationsPerSecondMutex = 0.0;
+
+		// Timed, single indices only, to compare with the baseline below.
+		{
+			FakeHeap heap(capacity);
+			StressCounters counters;
+			IndexAllocator indices;
+			indices.Initialize(capacity);
+
+			double seconds = RunStressWorkload(numThreads, numOperationsPerThread, capacity,
+				[&] { return indices.Allocate(); }, [&](uint32 index) { indices.Free(index); }, nullptr, heap, heap, counters);
+			millionOperationsPerSecond = numOperations / seconds * 1e-6;
+		}
+
+		// The same workload with a free list behind a mutex. The fake heap only keeps the work comparable.
+		{
+			FakeHeap heap(capacity);
+			StressCounters counters;
+			std::mutex mutex;
+			std::vector<uint32> freeList;
+			uint32 numTouched = 0;
+
+			double seconds = RunStressWorkload(numThreads, numOperationsPerThread, capacity,
+				[&] {
+					std::lock_guard lock(mutex);
+					if (not freeList.empty()) {
+						uint32 index = freeList.back();
+						freeList.pop_back();
+						return index;
+					}
+					return (numTouched < capacity) ? numTouched++ : INDEX_ALLOCATOR_INVALID;
+				},
+				[&](uint32 index) {
+					std::lock_guard lock(mutex);
+					freeList.push_back(index);
+				}, nullptr, heap, heap, counters);
+			millionOperationsPerSecondMutex = numOperations / seconds * 1e-6;
+		}
+
+		printf("%u threads: %.1f M/s (%.1f M/s with a mutex).\n", numThreads, millionOperationsPerSecond, millionOperationsPerSecondMutex);
+	}
+}
@@ -0,0 +1,144 @@
+#include "testing.h"
+#include "../core/memoryTracking.h"
+
+#include <chrono>
+#include <thread>
+
+// Checks the counters, peaks and frame snapshots of a tracker of its own against known sequences, from one and from several threads, and
+// the reports. With ENABLE_MEMORY_TRACKING, also checks that TrackedAllocator reports to the global tracker.
+TEST(MemoryTracking) {
+	using Clock = std::chrono::high_resolution_clock;
+
+	const uint32 numThreads = 4;
+	const uint32 numAllocationsPerThread = 1000000;
+
+	// Known sequences.
+	{
+		Ptr<MemoryTracker> tracker = MakePtr<MemoryTracker>();
+		tracker->Allocate(EMemoryCategoryMeshes, 100);
+		tracker->Allocate(EMemoryCategoryMeshes, 50);
+		tracker->Free(EMemoryCategoryMeshes, 100);
+
+		MemorySnapshot snapshot = tracker->Snapshot();
+		const MemoryCategoryUsage& meshes = snapshot.Categories[EMemoryCategoryMeshes];
+		CHECK(meshes.CurrentBytes == 50 and meshes.NumAllocations == 1, "Current bytes and allocations");
+		CHECK(meshes.PeakBytes == 150, "Peak bytes");
+
+		bool othersEmpty = true;
+		for (uint32 i = 0; i < EMemoryCategoryCount; i++) {
+			othersEmpty &= (i == EMemoryCategoryMeshes or snapshot.Categories[i].NumAllocations == 0);
+		}
+		CHECK(othersEmpty, "Categories are counted separately");
+
+		for (uint32 i = 0; i < 3; i++) {
+			tracker->Allocate(EMemoryCategoryUpload, 10);
+		}
+		tracker->Free(EMemoryCategoryUpload, 30, 3);
+		snapshot = tracker->Snapshot();
+		CHECK(snapshot.Categories[EMemoryCategoryUpload].CurrentBytes == 0 and snapshot.Categories[EMemoryCategoryUpload].NumAllocations == 0
+			and snapshot.Categories[EMemoryCategoryUpload].PeakBytes == 30, "Several allocations are freed at once");
+
+		uint64 large = 200ull << 30;
+		tracker->Allocate(EMemoryCategoryTextures, large);
+		snapshot = tracker->Snapshot();
+		CHECK(snapshot.Categories[EMemoryCategoryTextures].CurrentBytes == large and snapshot.Categories[EMemoryCategoryTextures].NumAllocations == 1,
+			"Large sizes don't spill into the allocation count");
+		tracker->Free(EMemoryCategoryTextures, large);
+
+		CHECK(FormatMemoryLeakReport(tracker->Snapshot()).find("Meshes still holds 50 bytes in 1 allocation.") != std::string::npos,
+			"Leak report names what is left");
+		tracker->Free(EMemoryCategoryMeshes, 50);
+		CHECK(FormatMemoryLeakReport(tracker->Snapshot()).empty(), "No leak report without leaks");
+
+		std::string report = FormatMemoryReport(tracker->Snapshot());
+		bool allNamed = true;
+		for (const char* name : MemoryCategoryNames) {
+			allNamed &= (report.find(name) != std::string::npos);
+		}
+		CHECK(allNamed and report.find("Total") != std::string::npos, "Report has every category and the total");
+	}
+
+	// Frame snapshots.
+	{
+		Ptr<MemoryTracker> tracker = MakePtr<MemoryTracker>();
+		CHECK(tracker->GetFrameSnapshot(0) == nullptr, "No snapshots before the first frame");
+
+		const uint32 numFrames = MAX_NUM_MEMORY_SNAPSHOTS + 44;
+		for (uint32 f = 0; f < numFrames; f++) {
+			tracker->Allocate(EMemoryCategoryArenaBlocks, 1);
+			tracker->NewFrame(f);
+		}
+
+		const MemorySnapshot* last = tracker->GetFrameSnapshot(0);
+		const MemorySnapshot* oldest = tracker->GetFrameSnapshot(MAX_NUM_MEMORY_SNAPSHOTS - 1);
+		CHECK(last and last->FrameId == numFrames - 1 and last->Categories[EMemoryCategoryArenaBlocks].NumAllocations == numFrames,
+			"Last frame's snapshot");
+		CHECK(oldest and oldest->FrameId == numFrames - MAX_NUM_MEMORY_SNAPSHOTS
+			and oldest->Categories[EMemoryCategoryArenaBlocks].CurrentBytes == numFrames - MAX_NUM_MEMORY_SNAPSHOTS + 1, "Oldest frame's snapshot");
+		CHECK(tracker->GetFrameSnapshot(MAX_NUM_MEMORY_SNAPSHOTS) == nullptr, "Older frames are overwritten");
+	}
+
+	// Timed on one thread, then from several on the same category. Every thread holds up to 'numLive' allocations of varying size at a time.
+	{
+		const uint32 numLive = 8;
+		auto run = [numAllocationsPerThread](MemoryTracker& tracker, uint32 thread) {
+			uint64 sizes[numLive] = {};
+			for (uint32 i = 0; i < numAllocationsPerThread; i++) {
+				uint32 slot = i % numLive;
+				if (sizes[slot]) {
+					tracker.Free(EMemoryCategoryBuffers, sizes[slot]);
+				}
+				sizes[slot] = 1 + (i * 7 + thread) % 4096;
+				tracker.Allocate(EMemoryCategoryBuffers, sizes[slot]);
+			}
+			for (uint64 size : sizes) {
+				if (size) {
+					tracker.Free(EMemoryCategoryBuffers, size);
+				}
+			}
+		};
+
+		Ptr<MemoryTracker> tracker = MakePtr<MemoryTracker>();
+		auto start = Clock::now();
+		run(*tracker, 0);
+		double nanosecondsPerAllocation = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / Max(numAllocationsPerThread, 1u);
+
+		MemorySnapshot snapshot = tracker->Snapshot();
+		CHECK(snapshot.Categories[EMemoryCategoryBuffers].CurrentBytes == 0 and snapshot.Categories[EMemoryCategoryBuffers].NumAllocations == 0,
+			"Everything allocated on one thread is freed");
+
+		tracker = MakePtr<MemoryTracker>();
+		std::vector<std::thread> threads;
+		start = Clock::now();
+		for (uint32 t = 0; t < numThreads; t++) {
+			threads.emplace_back([&, t] { run(*tracker, t); });
+		}
+		for (std::thread& thread : threads) {
+			thread.join();
+		}
+		double nanosecondsPerContendedAllocation = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / Max(numAllocationsPerThread, 1u);
+
+		snapshot = tracker->Snapshot();
+		const MemoryCategoryUsage& buffers = snapshot.Categories[EMemoryCategoryBuffers];
+		CHECK(buffers.CurrentBytes == 0 and buffers.NumAllocations == 0, "Everything allocated on several threads is freed");
+		CHECK(buffers.PeakBytes > 0 and buffers.PeakBytes <= (uint64)numThreads * numLive * 4096,
+			"Peak stays within what the threads held at once");
+
+		printf("%.1f ns per allocation, %.1f ns contended on %u threads.\n", nanosecondsPerAllocation, nanosecondsPerContendedAllocation, numThreads);
+	}
+
+#if ENABLE_MEMORY_TRACKING
+	{
+		MemoryCategoryUsage before = GlobalMemoryTracker.Snapshot().Categories[EMemoryCategoryAnimation];
+		{
+			std::vector<float, TrackedAllocator<float, EMemoryCategoryAnimation>> keyframes;
+			keyframes.reserve(1000);
+			MemoryCategoryUsage during = GlobalMemoryTracker.Snapshot().Categories[EMemoryCategoryAnimation];
+			CHECK(during.CurrentBytes == before.CurrentBytes + 1000 * sizeof(float) and during.NumAllocations == before.NumAllocations + 1,
+				"Tracked containers report their allocations");
+		}
+		MemoryCategoryUsage after = GlobalMemoryTracker.Snapshot().Categories[EMemoryCategoryAnimation];
+		CHECK(after.CurrentBytes == before.CurrentBytes and after.NumAllocations == before.NumAllocations, "Tracked containers report their frees");
+	}
+#endif
+}
@@ -0,0 +1,146 @@
+#include "testing.h"
+#include "../physics/mesh.h"
+#include "../core/threading.h"
+#include "../directx/DxContext.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace {
+	std::vector<std::string> FindFiles(const char* directory, std::initializer_list<const char*> extensions) {
+		std::vector<std::string> files;
+		for (auto& p : fs::directory_iterator(directory)) {
+			fs::path extension = p.path().extension();
+			for (const char* e : extensions) {
+				if (extension == e) {
+					files.push_back(p.path().string());
+				}
+			}
+		}
+		std::sort(files.begin(), files.end());
+		return files;
+	}
+
+	// Loads 'numAssets' mesh files found in 'directory', each on its own job if 'parallel' is set, otherwise one after another.
+	// If there are fewer files, they are loaded repeatedly. Repeated files still go through import and conversion, but share materials and
+	// textures with the first load.
+	void RunMeshLoad(TestContext& test, const char* directory, uint32 numAssets, bool parallel) {
+		std::vector<std::string> files = FindFiles(directory, { ".obj", ".fbx", ".gltf", ".glb" });
+		CHECK(not files.empty(), "Mesh files found");
+		if (files.empty()) {
+			return;
+		}
+
+		// Meshes are kept alive until the end, so that repeated files find their materials in the cache.
+		std::vector<Ptr<CompositeMesh>> meshes(numAssets);
+		std::vector<MeshLoadTimings> timings(numAssets);
+
+		auto loadAsset = [&files, &meshes, &timings](uint32 i) {
+			meshes[i] = LoadMeshFromFile(files[i % files.size()].c_str(),
+				EMeshCreationFlagsWithPositions | EMeshCreationFlagsWithUvs | EMeshCreationFlagsWithNormals | EMeshCreationFlagsWithTangents, &timings[i]);
+		};
+
+		auto start = std::chrono::high_resolution_clock::now();
+
+		if (parallel) {
+			ThreadJobContext context;
+			for (uint32 i = 0; i < numAssets; ++i) {
+				context.AddWork([&loadAsset, i]() { loadAsset(i); });
+			}
+			context.WaitForWorkCompletion();
+		}
+		else {
+			for (uint32 i = 0; i < numAssets; ++i) {
+				loadAsset(i);
+			}
+		}
+
+		DxContext::Instance().FlushApplication();
+
+		auto end = std::chrono::high_resolution_clock::now();
+		double milliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+
+		MeshLoadTimings stages = {}; // Summed over all assets.
+		uint32 numFailed = 0;
+		for (uint32 i = 0; i < numAssets; ++i) {
+			if (not meshes[i]) {
+				++numFailed;
+				continue;
+			}
+
+			stages.Import += timings[i].Import;
+			stages.Convert += timings[i].Convert;
+			stages.Material += timings[i].Material;
+			stages.Upload += timings[i].Upload;
+		}
+		CHECK(numFailed == 0, "Every mesh loads");
+
+		printf("%s: %u assets in %.1f ms (%u failed). Import %.1f ms, convert %.1f ms, material %.1f ms, upload %.1f ms (summed over assets).\n",
+			parallel ? "Parallel" : "Serial", numAssets, milliseconds, numFailed, stages.Import, stages.Convert, stages.Material, stages.Upload);
+	}
+}
+
+DEVICE_BENCHMARK(MeshLoad) {
+	for (bool parallel : { false, true }) {
+		RunMeshLoad(test, "assets/meshes", 24, parallel);
+	}
+}
+
+// Loads every .gltf and .glb file in the meshes directory several times through the direct glTF path and through Assimp, one after another
+// on the calling thread. Assimp reads from its import cache, which is filled before measuring.
+DEVICE_BENCHMARK(GltfLoad) {
+	const uint32 numIterations = 10;
+	const uint32 flags = EMeshCreationFlagsWithPositions | EMeshCreationFlagsWithUvs | EMeshCreationFlagsWithNormals | EMeshCreationFlagsWithTangents;
+
+	std::vector<std::string> files = FindFiles("assets/meshes", { ".gltf", ".glb", ".GLTF", ".GLB" });
+
+	uint32 numAssets = 0;
+	uint32 numUnsupported = 0; // Files the glTF path leaves to Assimp. They are not measured.
+	double gltfMilliseconds = 0.0;
+	double assimpMilliseconds = 0.0;
+	MeshLoadTimings gltfStages = {}; // Summed over all assets and iterations.
+	MeshLoadTimings assimpStages = {};
+
+	using clock = std::chrono::high_resolution_clock;
+
+	for (const std::string& file : files) {
+		// Both paths load once untimed. This fills Assimp's import cache and the texture cache, so that both are measured as they
+		// behave at runtime.
+		Ptr<CompositeMesh> gltfMesh = LoadGltfMeshFromFile(file.c_str(), flags);
+		Ptr<CompositeMesh> assimpMesh = LoadAssimpMeshFromFile(file.c_str(), flags);
+
+		if (not gltfMesh or not assimpMesh) {
+			++numUnsupported;
+			continue;
+		}
+
+		++numAssets;
+
+		for (uint32 i = 0; i < numIterations; ++i) {
+			MeshLoadTimings timings;
+
+			auto start = clock::now();
+			gltfMesh = LoadGltfMeshFromFile(file.c_str(), flags, &timings);
+			auto end = clock::now();
+			gltfMilliseconds += std::chrono::duration<double, std::milli>(end - start).count();
+			gltfStages.Import += timings.Import;
+			gltfStages.Convert += timings.Convert;
+			gltfStages.Material += timings.Material;
+			gltfStages.Upload += timings.Upload;
+
+			start = clock::now();
+			assimpMesh = LoadAssimpMeshFromFile(file.c_str(), flags, &timings);
+			end = clock::now();
+			assimpMilliseconds += std::chrono::duration<double, std::milli>(end - start).count();
+			assimpStages.Import += timings.Import;
+			assimpStages.Convert += timings.Convert;
+			assimpStages.Material += timings.Material;
+			assimpStages.Upload += timings.Upload;
+		}
+	}
+
+	DxContext::Instance().FlushApplication();
+
+	printf("%u assets (%u left to Assimp), direct %.1f ms, Assimp %.1f ms. Import %.1f / %.1f ms, convert %.1f / %.1f ms.\n", numAssets, numUnsupported,
+		gltfMilliseconds, assimpMilliseconds, gltfStages.Import, assimpStages.Import, gltfStages.Convert, assimpStages.Convert);
+}
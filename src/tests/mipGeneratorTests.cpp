@@ -0,0 +1,146 @@
+#include "testing.h"
+#include "../core/mipGenerator.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace {
+	constexpr double Pi = 3.14159265358979323846;
+
+	struct BenchmarkImage {
+		std::vector<uint8> Data;
+		std::vector<MipLevel> Levels;
+	};
+
+	BenchmarkImage AllocateBenchmarkImage(uint32 width, uint32 height) {
+		BenchmarkImage image;
+		uint32 numLevels = GetNumMipLevels(width, height);
+
+		uint64 size = 0;
+		for (uint32 level = 0; level < numLevels; ++level) {
+			size += (uint64)Max(width >> level, 1u) * Max(height >> level, 1u) * 4;
+		}
+		image.Data.resize(size);
+
+		uint64 offset = 0;
+		for (uint32 level = 0; level < numLevels; ++level) {
+			MipLevel mip = { image.Data.data() + offset, Max(width >> level, 1u), Max(height >> level, 1u), 0 };
+			mip.RowPitch = (uint64)mip.Width * 4;
+			image.Levels.push_back(mip);
+			offset += mip.RowPitch * mip.Height;
+		}
+		return image;
+	}
+
+	// Zone plate in red and green, which aliases visibly with a poor filter, a gradient in blue and soft blobs in alpha.
+	void FillBenchmarkImage(const MipLevel& level) {
+		double scale = Pi / Max(level.Width, level.Height);
+		for (uint32 y = 0; y < level.Height; ++y) {
+			for (uint32 x = 0; x < level.Width; ++x) {
+				double dx = x - level.Width * 0.5;
+				double dy = y - level.Height * 0.5;
+				double r2 = dx * dx + dy * dy;
+				uint8* texel = level.Pixels + y * level.RowPitch + x * 4;
+				texel[0] = (uint8)(127.5 + 127.5 * std::cos(r2 * scale * 0.5));
+				texel[1] = (uint8)(127.5 + 127.5 * std::cos(r2 * scale * 0.25));
+				texel[2] = (uint8)(255.0 * x / level.Width);
+				texel[3] = (uint8)(127.5 + 127.5 * std::sin(x * 0.05) * std::cos(y * 0.03));
+			}
+		}
+	}
+
+	// Averages the stored sRGB values as if they were linear, as naive downsamplers do.
+	void GenerateGammaIncorrectBoxMipChain(const BenchmarkImage& image) {
+		for (uint32 level = 1; level < (uint32)image.Levels.size(); ++level) {
+			const MipLevel& src = image.Levels[level - 1];
+			const MipLevel& dst = image.Levels[level];
+			for (uint32 y = 0; y < dst.Height; ++y) {
+				for (uint32 x = 0; x < dst.Width; ++x) {
+					uint32 x0 = Min(2 * x, src.Width - 1), x1 = Min(2 * x + 1, src.Width - 1);
+					uint32 y0 = Min(2 * y, src.Height - 1), y1 = Min(2 * y + 1, src.Height - 1);
+					for (uint32 c = 0; c < 4; ++c) {
+						uint32 sum = src.Pixels[y0 * src.RowPitch + x0 * 4 + c] + src.Pixels[y0 * src.RowPitch + x1 * 4 + c]
+							+ src.Pixels[y1 * src.RowPitch + x0 * 4 + c] + src.Pixels[y1 * src.RowPitch + x1 * 4 + c];
+						dst.Pixels[y * dst.RowPitch + x * 4 + c] = (uint8)((sum + 2) / 4);
+					}
+				}
+			}
+		}
+	}
+
+	// Over the color channels of all levels below the top.
+	double ComputePSNR(const BenchmarkImage& a, const BenchmarkImage& b) {
+		double squaredError = 0.0;
+		uint64 count = 0;
+		for (uint32 level = 1; level < (uint32)a.Levels.size(); ++level) {
+			const MipLevel& la = a.Levels[level];
+			const MipLevel& lb = b.Levels[level];
+			for (uint32 y = 0; y < la.Height; ++y) {
+				for (uint32 x = 0; x < la.Width; ++x) {
+					for (uint32 c = 0; c < 3; ++c) {
+						double d = (double)la.Pixels[y * la.RowPitch + x * 4 + c] - lb.Pixels[y * lb.RowPitch + x * 4 + c];
+						squaredError += d * d;
+						++count;
+					}
+				}
+			}
+		}
+
+		double mse = squaredError / Max(count, (uint64)1);
+		return (mse > 0.0) ? 10.0 * std::log10(255.0 * 255.0 / mse) : std::numeric_limits<double>::infinity();
+	}
+}
+
+// Generates the mip chain of a synthetic sRGB RGBA8 image with each filter and measures the throughput in source megapixels, i.e. the
+// size of the top level, per second. The quality is the PSNR against GenerateReferenceMipChain, averaged over all generated levels.
+BENCHMARK(MipGeneration) {
+	const uint32 width = 4096;
+	const uint32 height = 4096;
+	const uint32 numIterations = 4;
+	const char* filterNames[] = { "box", "Kaiser", "Lanczos" }; // Indexed by EMipFilter.
+
+	using clock = std::chrono::high_resolution_clock;
+
+	BenchmarkImage image = AllocateBenchmarkImage(width, height);
+	FillBenchmarkImage(image.Levels[0]);
+
+	BenchmarkImage reference = AllocateBenchmarkImage(width, height);
+	double megapixels = (double)width * height * numIterations / 1e6;
+
+	for (uint32 f = 0; f < arraysize(filterNames); ++f) {
+		EMipFilter filter = (EMipFilter)f;
+		double megapixelsPerSecond[2] = {}; // Serial, parallel.
+
+		MipGenerationSettings settings;
+		settings.Filter = filter;
+		settings.IsSRGB = true;
+
+		for (bool parallel : { false, true }) {
+			settings.Parallel = parallel;
+
+			auto start = clock::now();
+			for (uint32 i = 0; i < numIterations; ++i) {
+				GenerateMipChain(EMipFormatRGBA8, image.Levels.data(), (uint32)image.Levels.size(), settings);
+			}
+			double seconds = std::chrono::duration<double>(clock::now() - start).count();
+
+			megapixelsPerSecond[parallel] = megapixels / seconds;
+		}
+
+		memcpy(reference.Levels[0].Pixels, image.Levels[0].Pixels, (size_t)image.Levels[0].RowPitch * height);
+		GenerateReferenceMipChain(filter, reference.Levels.data(), (uint32)reference.Levels.size());
+		double psnr = ComputePSNR(image, reference);
+		printf("%s, %ux%u: %.1f MP/s serial, %.1f MP/s parallel, %.2f dB PSNR.\n", filterNames[f], width, height, megapixelsPerSecond[0],
+			megapixelsPerSecond[1], psnr);
+
+		if (filter == EMipFilterBox) {
+			// For comparison.
+			BenchmarkImage naive = AllocateBenchmarkImage(width, height);
+			memcpy(naive.Levels[0].Pixels, image.Levels[0].Pixels, (size_t)image.Levels[0].RowPitch * height);
+			GenerateGammaIncorrectBoxMipChain(naive);
+			printf("Gamma-incorrect box: %.2f dB PSNR.\n", ComputePSNR(naive, reference));
+		}
+	}
+}
@@ -0,0 +1,201 @@
+#include "testing.h"
+#include "../directx/DxParallelRecording.h"
+
+#include <chrono>
+#include <thread>
+
+namespace {
+	// Stands in for a DxCommandList. Draws are encoded into 'Commands', their instance transforms into 'Upload', like the real lists
+	// write into their command allocator and upload buffer.
+	struct MockCommandList {
+		std::vector<uint32> Commands;
+		std::vector<float> Upload;
+		std::thread::id AcquireThread;
+		std::thread::id RecordThread;
+		uint32 ChunkIndex = UINT32_MAX;
+		uint32 NumRecords = 0;
+
+		void Reset() {
+			Commands.clear();
+			Upload.clear();
+			ChunkIndex = UINT32_MAX;
+			NumRecords = 0;
+		}
+	};
+
+	// Roughly the CPU work of one instanced draw in the renderer: a matrix product into the upload buffer and a handful of commands.
+	void RecordMockDraw(MockCommandList* list, uint32 draw, const float* viewProj) {
+		float model[16] = {
+			1.f, 0.f, 0.f, (float)(draw % 100),
+			0.f, 1.f, 0.f, 0.f,
+			0.f, 0.f, 1.f, (float)(draw / 100),
+			0.f, 0.f, 0.f, 1.f,
+		};
+
+		size_t offset = list->Upload.size();
+		list->Upload.resize(offset + 16);
+		float* result = list->Upload.data() + offset;
+		for (uint32 row = 0; row < 4; ++row) {
+			for (uint32 col = 0; col < 4; ++col) {
+				float sum = 0.f;
+				for (uint32 k = 0; k < 4; ++k) {
+					sum += viewProj[row * 4 + k] * model[k * 4 + col];
+				}
+				result[row * 4 + col] = sum;
+			}
+		}
+
+		uint32 commands[] = { 1, (uint32)offset, 2, draw, 3, draw, 4, 36 };
+		list->Commands.insert(list->Commands.end(), std::begin(commands), std::end(commands));
+	}
+
+	// The chunks must be non-empty, contiguous and in order, and cover all items.
+	bool ChunksCoverItems(const RecordingChunk* chunks, uint32 numChunks, uint32 numItems) {
+		uint32 next = 0;
+		for (uint32 c = 0; c < numChunks; ++c) {
+			if (chunks[c].First != next or chunks[c].Count == 0) {
+				return false;
+			}
+			next += chunks[c].Count;
+		}
+		return next == numItems;
+	}
+}
+
+TEST(SplitIntoRecordingChunks) {
+	RecordingChunk chunks[MAX_NUM_RECORDING_CHUNKS];
+
+	CHECK(SplitIntoRecordingChunks(0, MIN_NUM_DRAWS_PER_RECORDING_CHUNK, MAX_NUM_RECORDING_CHUNKS, chunks) == 0, "No chunks without items");
+
+	uint32 numChunks = SplitIntoRecordingChunks(100, MIN_NUM_DRAWS_PER_RECORDING_CHUNK, MAX_NUM_RECORDING_CHUNKS, chunks);
+	CHECK(numChunks == 1 and ChunksCoverItems(chunks, numChunks, 100), "Few draws are recorded in one chunk");
+
+	numChunks = SplitIntoRecordingChunks(10000, MIN_NUM_DRAWS_PER_RECORDING_CHUNK, MAX_NUM_RECORDING_CHUNKS, chunks);
+	CHECK(numChunks == MAX_NUM_RECORDING_CHUNKS and ChunksCoverItems(chunks, numChunks, 10000), "Many draws use all chunks");
+
+	bool balanced = true;
+	for (uint32 c = 0; c < numChunks; ++c) {
+		balanced &= (chunks[c].Count >= 10000 / MAX_NUM_RECORDING_CHUNKS - 1 and chunks[c].Count <= 10000 / MAX_NUM_RECORDING_CHUNKS + 1);
+	}
+	CHECK(balanced, "Chunks of equally weighted items are equally large");
+
+	numChunks = SplitIntoRecordingChunks(3, [](uint32) { return 1000u; }, 1, MAX_NUM_RECORDING_CHUNKS, chunks);
+	CHECK(numChunks == 3 and ChunksCoverItems(chunks, numChunks, 3), "No more chunks than items");
+
+	// One heavy shadow map followed by many light ones.
+	auto weight = [](uint32 i) { return (i == 0) ? 1000u : 10u; };
+	numChunks = SplitIntoRecordingChunks(100, weight, MIN_NUM_DRAWS_PER_RECORDING_CHUNK, MAX_NUM_RECORDING_CHUNKS, chunks);
+	CHECK(numChunks > 1 and chunks[0].Count == 1 and ChunksCoverItems(chunks, numChunks, 100), "A heavy item gets a chunk of its own");
+}
+
+// Drives the parallel recording with a mock command list. The lists must come back in chunk order and together hold exactly the serial
+// command stream.
+TEST(RecordChunksInParallel) {
+	const uint32 numItems = 5000;
+	const float viewProj[16] = { 1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f };
+
+	MockCommandList serial;
+	for (uint32 i = 0; i < numItems; ++i) {
+		RecordMockDraw(&serial, i, viewProj);
+	}
+
+	std::thread::id caller = std::this_thread::get_id();
+
+	for (uint32 maxNumChunks : { 1u, 3u, (uint32)MAX_NUM_RECORDING_CHUNKS }) {
+		RecordingChunk chunks[MAX_NUM_RECORDING_CHUNKS];
+		uint32 numChunks = SplitIntoRecordingChunks(numItems, MIN_NUM_DRAWS_PER_RECORDING_CHUNK, maxNumChunks, chunks);
+
+		std::vector<std::unique_ptr<MockCommandList>> acquired;
+		MockCommandList* lists[MAX_NUM_RECORDING_CHUNKS];
+
+		RecordChunksInParallel(chunks, numChunks,
+			[&]() {
+				MockCommandList* list = acquired.emplace_back(std::make_unique<MockCommandList>()).get();
+				list->AcquireThread = std::this_thread::get_id();
+				return list;
+			},
+			[&](MockCommandList* list, RecordingChunk chunk, uint32 chunkIndex) {
+				list->RecordThread = std::this_thread::get_id();
+				list->ChunkIndex = chunkIndex;
+				++list->NumRecords;
+
+				// Offsets into the upload buffer are per list, like in the real lists. Each chunk starts at 0.
+				for (uint32 i = chunk.First; i < chunk.First + chunk.Count; ++i) {
+					RecordMockDraw(list, i, viewProj);
+				}
+			},
+			lists);
+
+		CHECK(acquired.size() == numChunks, "One command list per chunk");
+
+		bool inOrder = true;
+		bool acquiredOnCaller = true;
+		std::vector<float> upload;
+		std::vector<uint32> draws;
+		for (uint32 c = 0; c < numChunks; ++c) {
+			inOrder &= (lists[c] == acquired[c].get() and lists[c]->ChunkIndex == c and lists[c]->NumRecords == 1);
+			acquiredOnCaller &= (lists[c]->AcquireThread == caller);
+
+			upload.insert(upload.end(), lists[c]->Upload.begin(), lists[c]->Upload.end());
+			for (uint32 i = 0; i < (uint32)lists[c]->Commands.size(); i += 8) {
+				draws.push_back(lists[c]->Commands[i + 3]);
+			}
+		}
+
+		bool serialOrder = (draws.size() == numItems);
+		for (uint32 i = 0; serialOrder and i < numItems; ++i) {
+			serialOrder = (draws[i] == i);
+		}
+
+		CHECK(inOrder, "Every chunk is recorded once, into the list at its index");
+		CHECK(acquiredOnCaller, "Command lists are acquired on the calling thread");
+		CHECK(numChunks == 0 or lists[0]->RecordThread == caller, "The calling thread records the first chunk");
+		CHECK(serialOrder and upload == serial.Upload, "Submitting the lists in order reproduces the serial recording");
+	}
+}
+
+// Recording time of serial and parallel recording, for growing draw counts. Uses the mock command list, so it measures the chunking and
+// the job system, not the driver.
+BENCHMARK(ParallelRecording) {
+	const uint32 numIterations = 20;
+	const float viewProj[16] = { 1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f };
+
+	MockCommandList pool[MAX_NUM_RECORDING_CHUNKS];
+
+	printf("%u worker threads.\n", JobFactory::Instance()->NumThreads());
+
+	for (uint32 numDraws : { 500u, 2000u, 8000u, 32000u, 128000u }) {
+		double milliseconds[2] = {};
+		uint32 numChunks[2] = {};
+
+		for (uint32 parallel = 0; parallel < 2; ++parallel) {
+			RecordingChunk chunks[MAX_NUM_RECORDING_CHUNKS];
+			numChunks[parallel] = SplitIntoRecordingChunks(numDraws, MIN_NUM_DRAWS_PER_RECORDING_CHUNK, parallel ? MAX_NUM_RECORDING_CHUNKS : 1, chunks);
+
+			for (uint32 iteration = 0; iteration < numIterations; ++iteration) {
+				uint32 numAcquired = 0;
+				MockCommandList* lists[MAX_NUM_RECORDING_CHUNKS];
+
+				auto start = std::chrono::high_resolution_clock::now();
+				RecordChunksInParallel(chunks, numChunks[parallel],
+					[&]() {
+						MockCommandList* list = &pool[numAcquired++];
+						list->Reset();
+						return list;
+					},
+					[&](MockCommandList* list, RecordingChunk chunk, uint32 chunkIndex) {
+						for (uint32 i = chunk.First; i < chunk.First + chunk.Count; ++i) {
+							RecordMockDraw(list, i, viewProj);
+						}
+					},
+					lists);
+				auto end = std::chrono::high_resolution_clock::now();
+
+				milliseconds[parallel] += std::chrono::duration<double, std::milli>(end - start).count();
+			}
+		}
+
+		printf("%6u draws: serial %.3f ms, %u chunks %.3f ms, %.2fx.\n", numDraws, milliseconds[0] / numIterations, numChunks[1],
+			milliseconds[1] / numIterations, milliseconds[0] / milliseconds[1]);
+	}
+}
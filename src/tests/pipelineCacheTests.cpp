@@ -0,0 +1,170 @@
+#include "testing.h"
+#include "../core/pipelineCache.h"
+
+#include <cstring>
+#include <fstream>
+
+namespace {
+	// Layout of the cache file, as written by PipelineCache::Save. The test damages entries in place.
+	struct FileHeader {
+		uint32 Magic;
+		uint32 Version;
+		uint64 DeviceHash;
+		uint64 Run;
+		uint64 NumEntries;
+	};
+
+	struct EntryHeader {
+		uint64 Key;
+		uint64 LastUsedRun;
+		uint64 Size;
+		uint64 Checksum;
+	};
+}
+
+// Checks that keys depend on every shader hash, their order and the description hash, that string hashes don't depend on the address of
+// the string, and that the cache file survives a round trip. Then damages, truncates and outdates the file in a temporary directory and
+// checks that only the intact entries come back.
+TEST(PipelineCache) {
+	// Keys.
+	{
+		uint64 shaders[] = { 0x1234, 0, 0x5678 };
+		uint64 key = GetPipelineCacheKey(shaders, 3, 42);
+		CHECK(key == GetPipelineCacheKey(shaders, 3, 42), "Keys are deterministic");
+		CHECK(key != GetPipelineCacheKey(shaders, 3, 43), "Key depends on the description hash");
+		CHECK(key != GetPipelineCacheKey(shaders, 2, 42), "Key depends on the number of shaders");
+
+		bool allDiffer = true;
+		for (uint32 i = 0; i < 3; ++i) {
+			uint64 changed[] = { shaders[0], shaders[1], shaders[2] };
+			changed[i] ^= 1;
+			allDiffer = allDiffer and GetPipelineCacheKey(changed, 3, 42) != key;
+		}
+		CHECK(allDiffer, "Key depends on every shader hash");
+
+		uint64 swapped[] = { shaders[2], shaders[1], shaders[0] };
+		CHECK(GetPipelineCacheKey(swapped, 3, 42) != key, "Key depends on the stage order");
+
+		char a[] = "POSITION";
+		std::string b = "POSITION";
+		CHECK(PipelineHasher().AddString(a).Finish() == PipelineHasher().AddString(b.c_str()).Finish(), "Strings are hashed by content");
+		CHECK(PipelineHasher().AddString(nullptr).Finish() != PipelineHasher().AddString("").Finish(), "Null and empty strings differ");
+		CHECK(PipelineHasher().AddString("AB").AddString("C").Finish() != PipelineHasher().AddString("A").AddString("BC").Finish(),
+			"String boundaries are part of the hash");
+	}
+
+	fs::path directory = fs::temp_directory_path() / "pipeline_cache_test";
+	fs::path filename = directory / PIPELINE_CACHE_FILENAME;
+	std::error_code error;
+	fs::remove_all(directory, error);
+	fs::create_directories(directory, error);
+
+	const uint64 device = 0xD3D12;
+	const uint32 numEntries = 16;
+
+	auto makeBlob = [](uint32 i) {
+		std::vector<uint8> blob(100 + i * 37);
+		for (uint32 j = 0; j < (uint32)blob.size(); ++j) {
+			blob[j] = (uint8)(i * 31 + j * 7);
+		}
+		return blob;
+	};
+
+	// Round trip.
+	{
+		PipelineCache cache;
+		cache.Initialize(filename, device);
+		CHECK(cache.NumEntries() == 0, "Missing file starts an empty cache");
+
+		for (uint32 i = 0; i < numEntries; ++i) {
+			std::vector<uint8> blob = makeBlob(i);
+			cache.Insert(i + 1, blob.data(), blob.size());
+		}
+		CHECK(cache.Save(), "Cache is written");
+	}
+	{
+		PipelineCache cache;
+		cache.Initialize(filename, device);
+		CHECK(cache.NumLoadedEntries() == numEntries and cache.NumDamagedEntries() == 0, "All entries are read back");
+
+		bool allMatch = true;
+		std::vector<uint8> data;
+		for (uint32 i = 0; i < numEntries; ++i) {
+			allMatch = allMatch and cache.Find(i + 1, data) and data == makeBlob(i);
+		}
+		CHECK(allMatch, "Blobs survive the round trip");
+		CHECK(not cache.Find(numEntries + 1, data) and cache.NumHits() == numEntries and cache.NumMisses() == 1, "Unknown keys miss");
+
+		cache.Remove(1);
+		CHECK(cache.Save(), "Cache is written again");
+	}
+	{
+		PipelineCache cache;
+		cache.Initialize(filename, device + 1);
+		CHECK(cache.NumEntries() == 0, "Cache of another device is discarded");
+	}
+
+	// Damage the payload of one entry in the middle. It and everything after it must be dropped.
+	{
+		PipelineCache cache;
+		cache.Initialize(filename, device);
+		uint32 numIntact = cache.NumLoadedEntries();
+		CHECK(numIntact == numEntries - 1, "Removed entry stays removed");
+
+		std::vector<char> bytes(fs::file_size(filename));
+		std::ifstream(filename, std::ios::binary).read(bytes.data(), bytes.size());
+
+		uint64 offset = sizeof(FileHeader);
+		for (uint32 i = 0; i < numIntact / 2; ++i) {
+			EntryHeader entryHeader;
+			memcpy(&entryHeader, bytes.data() + offset, sizeof(entryHeader));
+			offset += sizeof(entryHeader) + entryHeader.Size;
+		}
+		bytes[offset + sizeof(EntryHeader) + 5] ^= 0x40;
+		std::ofstream(filename, std::ios::binary | std::ios::trunc).write(bytes.data(), bytes.size());
+
+		cache.Initialize(filename, device);
+		CHECK(cache.NumLoadedEntries() == numIntact / 2 and cache.NumDamagedEntries() == numIntact - numIntact / 2, "Damaged entry and its successors are dropped");
+
+		// Damaged size field: must neither crash nor allocate the bogus size.
+		EntryHeader entryHeader;
+		memcpy(&entryHeader, bytes.data() + offset, sizeof(entryHeader));
+		entryHeader.Size = UINT64_MAX / 2;
+		memcpy(bytes.data() + offset, &entryHeader, sizeof(entryHeader));
+		std::ofstream(filename, std::ios::binary | std::ios::trunc).write(bytes.data(), bytes.size());
+
+		cache.Initialize(filename, device);
+		CHECK(cache.NumLoadedEntries() == numIntact / 2, "Damaged size is detected");
+
+		// Truncated file.
+		std::ofstream(filename, std::ios::binary | std::ios::trunc).write(bytes.data(), offset + 3);
+		cache.Initialize(filename, device);
+		CHECK(cache.NumLoadedEntries() == numIntact / 2, "Truncated file keeps the complete entries");
+
+		std::ofstream(filename, std::ios::binary | std::ios::trunc).write("garbage", 7);
+		cache.Initialize(filename, device);
+		CHECK(cache.NumEntries() == 0, "Garbage file starts an empty cache");
+	}
+
+	// Entries which are never looked up age out.
+	{
+		PipelineCache cache;
+		cache.Initialize(filename, device);
+		std::vector<uint8> blob = makeBlob(0);
+		cache.Insert(1, blob.data(), blob.size());
+		cache.Insert(2, blob.data(), blob.size());
+		cache.Save();
+
+		std::vector<uint8> data;
+		for (uint32 run = 0; run < PIPELINE_CACHE_MAX_UNUSED_RUNS + 1; ++run) {
+			cache.Initialize(filename, device);
+			cache.Find(1, data);
+			cache.Save();
+		}
+
+		cache.Initialize(filename, device);
+		CHECK(cache.Find(1, data) and not cache.Find(2, data), "Unused entries age out");
+	}
+
+	fs::remove_all(directory, error);
+}
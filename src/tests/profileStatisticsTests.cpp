@@ -0,0 +1,245 @@
+#include "testing.h"
+#include "../core/profileStatistics.h"
+#include "../core/json.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+namespace {
+	struct EventStream {
+		std::vector<ProfileStatisticsEvent> Events;
+
+		void Begin(const char* track, const char* name, double milliseconds) { Events.push_back({ EProfileStatisticsEventBegin, track, name, milliseconds }); }
+		void End(const char* track, const char* name, double milliseconds) { Events.push_back({ EProfileStatisticsEventEnd, track, name, milliseconds }); }
+
+		bool AddTo(ProfileStatistics& statistics, uint64 frameId, float frameMilliseconds) {
+			bool spike = statistics.AddFrame(frameId, frameMilliseconds, Events.data(), (uint32)Events.size());
+			Events.clear();
+			return spike;
+		}
+	};
+
+	const ProfileBlockStatistics* FindBlock(const std::vector<ProfileBlockStatistics>& blocks, const char* track, const char* path) {
+		for (const ProfileBlockStatistics& block : blocks) {
+			if (strcmp(block.Track, track) == 0 and block.Path == path) {
+				return &block;
+			}
+		}
+		return nullptr;
+	}
+
+	std::string ReadTextFile(const fs::path& filename) {
+		std::stringstream contents;
+		contents << std::ifstream(filename).rdbuf();
+		return contents.str();
+	}
+}
+
+// Feeds synthetic event streams and checks hierarchy reconstruction, the rolling statistics against known distributions, malformed
+// streams, table overflow, spike detection and dumps, and the exports.
+TEST(ProfileStatistics) {
+	const char* graphics = "GPU \"graphics\"";
+	const char* compute = "GPU compute";
+
+	// Known distributions over exactly one window: outer blocks take 101 to 356 ms in shuffled order, so that the percentiles are known.
+	// Two inner blocks per frame take a quarter of that each, and a block with the same name at the root occurs every other frame.
+	Ptr<ProfileStatistics> statistics = MakePtr<ProfileStatistics>("Test");
+	statistics->Settings.SpikeFactor = 0.f;
+	{
+		EventStream stream;
+		for (uint32 f = 0; f < PROFILE_STATISTICS_WINDOW; f++) {
+			double v = (f * 37) % PROFILE_STATISTICS_WINDOW + 1;
+			stream.Begin(graphics, "Outer", 0.0);
+			stream.Begin(graphics, "Inner", 1.0);
+			stream.End(graphics, "Inner", 1.0 + v / 4.0);
+			stream.Begin(compute, "Outer", 2.0);
+			stream.Begin(graphics, "Inner", 10.0);
+			stream.End(graphics, "Inner", 10.0 + v / 4.0);
+			stream.End(compute, "Outer", 7.0);
+			stream.End(graphics, "Outer", 100.0 + v);
+			if (f % 2 == 0) {
+				stream.Begin(graphics, "Inner", 200.0);
+				stream.End(graphics, "Inner", 201.0);
+			}
+			stream.AddTo(*statistics, f, 16.f);
+		}
+
+		std::vector<ProfileBlockStatistics> blocks = statistics->GetBlockStatistics();
+		CHECK(blocks.size() == 4, "Blocks are identified by track, parent and name");
+		if (blocks.size() == 4) {
+			CHECK(blocks[0].Path == "Outer" and blocks[1].Path == "Outer/Inner" and blocks[2].Path == "Inner" and blocks[3].Track == compute,
+				"Blocks are ordered by track, then depth first");
+		}
+
+		const ProfileBlockStatistics* outer = FindBlock(blocks, graphics, "Outer");
+		CHECK(outer and outer->NumFrames == PROFILE_STATISTICS_WINDOW and outer->Depth == 0, "Outer block occurs in every frame");
+		CHECK(outer and outer->MinMilliseconds == 101.f and outer->MaxMilliseconds == 356.f and outer->AverageMilliseconds == 228.5f,
+			"Minimum, maximum and average of the outer block");
+		CHECK(outer and outer->P50Milliseconds == 228.f and outer->P95Milliseconds == 344.f and outer->P99Milliseconds == 354.f,
+			"Percentiles of the outer block");
+
+		const ProfileBlockStatistics* inner = FindBlock(blocks, graphics, "Outer/Inner");
+		CHECK(inner and inner->Depth == 1 and inner->LastCount == 2, "Inner block is nested and counted twice per frame");
+		CHECK(inner and inner->MinMilliseconds == 0.5f and inner->MaxMilliseconds == 128.f and inner->P50Milliseconds == 64.f,
+			"Occurrences in a frame are summed");
+
+		const ProfileBlockStatistics* root = FindBlock(blocks, graphics, "Inner");
+		CHECK(root and root->NumFrames == PROFILE_STATISTICS_WINDOW / 2 and root->MaxMilliseconds == 1.f, "Same name at the root is a block of its own");
+
+		const ProfileBlockStatistics* other = FindBlock(blocks, compute, "Outer");
+		CHECK(other and other->Depth == 0 and other->AverageMilliseconds == 5.f, "Interleaved tracks nest independently");
+
+		ProfileBlockStatistics frame = statistics->GetFrameStatistics();
+		CHECK(frame.NumFrames == PROFILE_STATISTICS_WINDOW and frame.P50Milliseconds == 16.f and frame.Path == "Frame", "Frame statistics");
+		CHECK(statistics->NumDroppedEvents() == 0 and statistics->NumSpikes() == 0, "Well-formed streams drop nothing");
+
+		// The first frame rolls out of the window.
+		stream.Begin(graphics, "Outer", 0.0);
+		stream.End(graphics, "Outer", 400.0);
+		stream.AddTo(*statistics, PROFILE_STATISTICS_WINDOW, 16.f);
+
+		blocks = statistics->GetBlockStatistics();
+		outer = FindBlock(blocks, graphics, "Outer");
+		CHECK(outer and outer->NumFrames == PROFILE_STATISTICS_WINDOW and outer->MinMilliseconds == 102.f and outer->MaxMilliseconds == 400.f
+			and outer->LastMilliseconds == 400.f, "Statistics roll over the window");
+		inner = FindBlock(blocks, graphics, "Outer/Inner");
+		CHECK(inner and inner->NumFrames == PROFILE_STATISTICS_WINDOW - 1 and inner->LastCount == 0 and inner->LastMilliseconds == 0.f,
+			"Blocks missing in the last frame");
+	}
+
+	// Malformed streams.
+	{
+		Ptr<ProfileStatistics> malformed = MakePtr<ProfileStatistics>("Malformed");
+		EventStream stream;
+		stream.End(graphics, "Stray", 0.0);
+		stream.Begin(graphics, "A", 0.0);
+		stream.Begin(graphics, "B", 1.0);
+		stream.End(graphics, "A", 5.0);
+		stream.Begin(graphics, "C", 6.0);
+		stream.AddTo(*malformed, 0, 16.f);
+
+		std::vector<ProfileBlockStatistics> blocks = malformed->GetBlockStatistics();
+		CHECK(malformed->NumDroppedEvents() == 3, "Stray ends and unended begins are dropped");
+		CHECK(blocks.size() == 1 and blocks[0].Path == "A" and blocks[0].LastMilliseconds == 5.f, "Ends close unended children");
+
+		stream.Begin(graphics, "A", 0.0);
+		stream.End(graphics, "A", 2.0);
+		stream.AddTo(*malformed, 1, 16.f);
+
+		blocks = malformed->GetBlockStatistics();
+		CHECK(malformed->NumDroppedEvents() == 3 and blocks.size() == 1 and blocks[0].Depth == 0 and blocks[0].LastMilliseconds == 2.f,
+			"Unended blocks don't carry over into the next frame");
+	}
+
+	// Fixed memory.
+	{
+		Ptr<ProfileStatistics> full = MakePtr<ProfileStatistics>("Full");
+		std::vector<std::string> names;
+		for (uint32 i = 0; i < MAX_NUM_PROFILE_STATISTICS_BLOCKS + 10; i++) {
+			names.push_back("Block " + std::to_string(i));
+		}
+
+		EventStream stream;
+		for (const std::string& name : names) {
+			stream.Begin(graphics, name.c_str(), 0.0);
+			stream.End(graphics, name.c_str(), 1.0);
+		}
+		stream.Begin(graphics, "Parent", 0.0);
+		stream.Begin(graphics, "Child", 0.0);
+		stream.End(graphics, "Child", 1.0);
+		stream.End(graphics, "Parent", 1.0);
+		stream.AddTo(*full, 0, 16.f);
+
+		CHECK(full->NumBlocks() == MAX_NUM_PROFILE_STATISTICS_BLOCKS and full->NumDroppedEvents() == 12, "Blocks beyond the table are dropped");
+		CHECK(full->GetBlockStatistics().size() == MAX_NUM_PROFILE_STATISTICS_BLOCKS, "Blocks in the table keep their statistics");
+
+		Ptr<ProfileStatistics> deep = MakePtr<ProfileStatistics>("Deep");
+		const uint32 numLevels = MAX_PROFILE_STATISTICS_DEPTH + 8;
+		for (uint32 i = 0; i < numLevels; i++) {
+			stream.Begin(graphics, "Deep", (double)i);
+		}
+		for (uint32 i = numLevels; i-- > 0;) {
+			stream.End(graphics, "Deep", 2.0 * numLevels - i);
+		}
+		stream.AddTo(*deep, 0, 16.f);
+
+		std::vector<ProfileBlockStatistics> blocks = deep->GetBlockStatistics();
+		CHECK(blocks.size() == MAX_PROFILE_STATISTICS_DEPTH and deep->NumDroppedEvents() == numLevels - MAX_PROFILE_STATISTICS_DEPTH,
+			"Blocks beyond the maximum depth are dropped");
+		CHECK(not blocks.empty() and blocks.back().Depth == MAX_PROFILE_STATISTICS_DEPTH - 1
+			and blocks.back().LastMilliseconds == (float)(2 * numLevels - (MAX_PROFILE_STATISTICS_DEPTH - 1) - (MAX_PROFILE_STATISTICS_DEPTH - 1)),
+			"Ends beyond the maximum depth are skipped");
+	}
+
+	// Spikes and dumps.
+	{
+		fs::path directory = fs::temp_directory_path() / "profile_statistics_test";
+		std::error_code error;
+		fs::remove_all(directory, error);
+
+		Ptr<ProfileStatistics> spikes = MakePtr<ProfileStatistics>("Spikes");
+		spikes->Settings.SpikeDumpDirectory = directory;
+		spikes->Settings.MinFramesBetweenDumps = 100;
+
+		EventStream stream;
+		auto addFrame = [&](uint64 frameId, float milliseconds) {
+			stream.Begin(graphics, "Work", 0.0);
+			stream.End(graphics, "Work", milliseconds);
+			return stream.AddTo(*spikes, frameId, milliseconds);
+		};
+
+		bool early = false;
+		for (uint32 f = 0; f < 50; f++) {
+			early |= addFrame(f, (f == 10) ? 100.f : 10.f);
+		}
+		CHECK(not early and spikes->NumSpikes() == 0, "No spikes before the window has enough frames");
+
+		CHECK(addFrame(50, 30.f), "Frames longer than twice the median are spikes");
+		CHECK(not addFrame(51, 15.f), "Frames shorter than twice the median are not");
+		CHECK(addFrame(52, 25.f) and spikes->NumSpikes() == 2 and spikes->LastSpikeFrameId() == 52, "Spikes are counted");
+
+		uint32 numFiles = (uint32)std::distance(fs::directory_iterator(directory, error), fs::directory_iterator());
+		CHECK(numFiles == 2, "Spikes are dumped once per MinFramesBetweenDumps");
+
+		std::string text = ReadTextFile(directory / "Spikes_spike_50.json");
+		JsonValue dump;
+		CHECK(ParseJson(text.c_str(), text.size(), dump) and dump["frame"]["lastMs"].AsNumber() == 30.0
+			and dump["blocks"][0u]["lastMs"].AsNumber() == 30.0, "Dumps hold the spike frame");
+		CHECK(fs::exists(directory / "Spikes_spike_50.csv"), "Dumps are written as CSV too");
+		fs::remove_all(directory, error);
+
+		spikes->Settings.SpikeFactor = 0.f;
+		spikes->Settings.SpikeMilliseconds = 20.f;
+		spikes->Settings.SpikeDumpDirectory.clear();
+		CHECK(addFrame(53, 25.f) and not addFrame(54, 15.f), "Frames longer than SpikeMilliseconds are spikes");
+	}
+
+	// Exports of the known distributions.
+	{
+		fs::path csvFilename = fs::temp_directory_path() / "profile_statistics_test.csv";
+		fs::path jsonFilename = fs::temp_directory_path() / "profile_statistics_test.json";
+		CHECK(statistics->ExportCsv(csvFilename) and statistics->ExportJson(jsonFilename), "Statistics are written");
+
+		std::vector<ProfileBlockStatistics> blocks = statistics->GetBlockStatistics();
+
+		std::string csv = ReadTextFile(csvFilename);
+		uint32 numLines = (uint32)std::count(csv.begin(), csv.end(), '\n');
+		CHECK(numLines == blocks.size() + 2 and csv.starts_with("track,path,"), "CSV has a header, the frame and a row per block");
+		CHECK(csv.find("\"GPU \"\"graphics\"\"\",\"Outer/Inner\",1,") != std::string::npos, "CSV quotes strings");
+
+		std::string text = ReadTextFile(jsonFilename);
+		JsonValue json;
+		CHECK(ParseJson(text.c_str(), text.size(), json), "JSON is valid");
+
+		const JsonValue& outer = json["blocks"][0u];
+		CHECK(json["blocks"].Size() == blocks.size() and json["name"].AsString() == "Test" and json["frame"]["frames"].AsUint() == PROFILE_STATISTICS_WINDOW,
+			"JSON has the frame and every block");
+		CHECK(outer["track"].AsString() == graphics and outer["path"].AsString() == "Outer" and outer["p95Ms"].AsNumber() == 345.0
+			and outer["maxMs"].AsNumber() == 400.0, "JSON blocks hold their statistics");
+
+		fs::remove(csvFilename);
+		fs::remove(jsonFilename);
+	}
+}
@@ -0,0 +1,367 @@
+#include "testing.h"
+#include "../core/renderGraph.h"
+#include "../core/memory.h"
+
+
+namespace {
+	struct Xorshift {
+		uint64 State;
+
+		uint32 Next() {
+			State ^= State << 13;
+			State ^= State >> 7;
+			State ^= State << 17;
+			return (uint32)(State >> 16);
+		}
+	};
+
+	const uint32 readAccesses[] = {
+		ERenderGraphAccessDepthRead, ERenderGraphAccessPixelShaderRead, ERenderGraphAccessNonPixelShaderRead, ERenderGraphAccessCopySource,
+	};
+	const uint32 writeAccesses[] = {
+		ERenderGraphAccessRenderTarget, ERenderGraphAccessDepthWrite, ERenderGraphAccessUnorderedAccess, ERenderGraphAccessCopyDest,
+	};
+
+	struct TestAccess {
+		RenderGraphPass Pass;
+		RenderGraphResource Resource;
+		uint32 State;
+		bool Write;
+	};
+
+	const RenderGraphBarrier* FindBarrier(const std::vector<RenderGraphBarrier>& barriers, RenderGraphResource resource, ERenderGraphBarrierType type) {
+		for (const RenderGraphBarrier& barrier : barriers) {
+			if (barrier.Resource == resource and barrier.Type == type) {
+				return &barrier;
+			}
+		}
+		return nullptr;
+	}
+}
+
+// Checks ordering, culling, barrier placement and memory placement on small hand-made graphs with known answers, and the invariants
+// of the result (states chain up, aliased resources never overlap in memory while both are alive) on random graphs.
+TEST(RenderGraph) {
+	const uint32 numRandomGraphs = 1000;
+
+
+	RenderGraph graph;
+	RenderGraphCompileResult compiled;
+	const uint64 size = MB(8);
+
+	// Chain of four passes. The two outer intermediates are never alive at the same time and share memory, the unused pass is culled.
+	{
+		graph.Reset();
+		RenderGraphResource t1 = graph.CreateTransient("T1", size, KB(64));
+		RenderGraphResource t2 = graph.CreateTransient("T2", size, KB(64));
+		RenderGraphResource t3 = graph.CreateTransient("T3", size, KB(64));
+		RenderGraphResource unused = graph.CreateTransient("Unused", size, KB(64));
+		RenderGraphResource out = graph.Import("Out", ERenderGraphAccessNone, ERenderGraphAccessNone);
+
+		RenderGraphPass a = graph.AddPass("A");
+		graph.Write(a, t1, ERenderGraphAccessRenderTarget);
+		RenderGraphPass b = graph.AddPass("B");
+		graph.Read(b, t1, ERenderGraphAccessPixelShaderRead);
+		graph.Write(b, t2, ERenderGraphAccessRenderTarget);
+		RenderGraphPass dead = graph.AddPass("Dead");
+		graph.Read(dead, t1, ERenderGraphAccessPixelShaderRead);
+		graph.Write(dead, unused, ERenderGraphAccessRenderTarget);
+		RenderGraphPass c = graph.AddPass("C");
+		graph.Read(c, t2, ERenderGraphAccessNonPixelShaderRead);
+		graph.Write(c, t3, ERenderGraphAccessUnorderedAccess);
+		RenderGraphPass d = graph.AddPass("D");
+		graph.Read(d, t3, ERenderGraphAccessNonPixelShaderRead);
+		graph.Write(d, out, ERenderGraphAccessUnorderedAccess);
+
+		bool ok = graph.Compile(compiled);
+		CHECK(ok, "Chain: compiles");
+		if (ok) {
+			CHECK(compiled.Culled[dead] and compiled.NumCulledPasses == 1, "Chain: unused pass is culled");
+			CHECK(compiled.Passes.size() == 4 and compiled.Passes[0].Pass == a and compiled.Passes[1].Pass == b
+				and compiled.Passes[2].Pass == c and compiled.Passes[3].Pass == d, "Chain: declaration order is kept");
+			CHECK(compiled.HeapOffsets[t1] == compiled.HeapOffsets[t3] and compiled.HeapOffsets[t1] != compiled.HeapOffsets[t2], "Chain: T1 and T3 alias");
+			CHECK(compiled.HeapOffsets[unused] == RENDER_GRAPH_INVALID, "Chain: resource of culled pass is not placed");
+			CHECK(compiled.TransientBytesWithoutAliasing == 3 * size and compiled.TransientBytesWithAliasing == 2 * size
+				and compiled.PeakLiveTransientBytes == 2 * size, "Chain: memory totals");
+
+			const RenderGraphBarrier* aliasing = FindBarrier(compiled.Passes[2].BarriersBefore, t3, ERenderGraphBarrierAliasing);
+			CHECK(aliasing and aliasing->ResourceBefore == t1, "Chain: aliasing barrier before first use of T3");
+			CHECK(compiled.NumAliasingBarriers == 1, "Chain: no other aliasing barriers");
+
+			const RenderGraphBarrier* outToUav = FindBarrier(compiled.Passes[3].BarriersBefore, out, ERenderGraphBarrierTransition);
+			CHECK(outToUav and outToUav->Split == ERenderGraphBarrierSplitEnd and outToUav->StateAfter == ERenderGraphAccessUnorderedAccess,
+				"Chain: imported resource is transitioned from the start of the graph");
+			CHECK(FindBarrier(compiled.Passes[3].BarriersAfter, out, ERenderGraphBarrierTransition) != nullptr, "Chain: imported resource returns to its final state");
+		}
+	}
+
+	// A pass in between allows a split barrier, unless it records into several command lists. The reader also depends on the pass in
+	// between, so that it can't move up to the writer.
+	for (bool multipleCommandLists : { false, true }) {
+		graph.Reset();
+		RenderGraphResource t = graph.CreateTransient("T", size, KB(64));
+		RenderGraphResource out = graph.Import("Out", ERenderGraphAccessRenderTarget, ERenderGraphAccessRenderTarget);
+		RenderGraphResource other = graph.Import("Other", ERenderGraphAccessUnorderedAccess, ERenderGraphAccessUnorderedAccess);
+
+		RenderGraphPass a = graph.AddPass("A");
+		graph.Write(a, t, ERenderGraphAccessRenderTarget);
+		RenderGraphPass b = graph.AddPass("B", multipleCommandLists ? ERenderGraphPassFlagsMultipleCommandLists : ERenderGraphPassFlagsNone);
+		graph.Write(b, other, ERenderGraphAccessUnorderedAccess);
+		RenderGraphPass c = graph.AddPass("C");
+		graph.Read(c, t, ERenderGraphAccessPixelShaderRead);
+		graph.Write(c, other, ERenderGraphAccessUnorderedAccess);
+		graph.Write(c, out, ERenderGraphAccessRenderTarget);
+
+		bool ok = graph.Compile(compiled);
+		CHECK(ok, "Split: compiles");
+		if (ok and compiled.Passes.size() == 3) {
+			const RenderGraphBarrier* begin = FindBarrier(compiled.Passes[0].BarriersAfter, t, ERenderGraphBarrierTransition);
+			const RenderGraphBarrier* end = FindBarrier(compiled.Passes[2].BarriersBefore, t, ERenderGraphBarrierTransition);
+			if (multipleCommandLists) {
+				CHECK(not begin and end and end->Split == ERenderGraphBarrierSplitNone, "Split: no split barrier across several command lists");
+			}
+			else {
+				CHECK(begin and begin->Split == ERenderGraphBarrierSplitBegin and end and end->Split == ERenderGraphBarrierSplitEnd,
+					"Split: begins after the writer, ends before the reader");
+			}
+			CHECK(compiled.NumTransitions == 1, "Split: only one transition");
+		}
+	}
+
+	// Reads between two writes get a single transition into the combined state. Consecutive unordered access writes get a UAV barrier.
+	{
+		graph.Reset();
+		RenderGraphResource t = graph.CreateTransient("T", size, KB(64));
+		RenderGraphResource out = graph.Import("Out", ERenderGraphAccessUnorderedAccess, ERenderGraphAccessUnorderedAccess);
+
+		RenderGraphPass a = graph.AddPass("A");
+		graph.Write(a, t, ERenderGraphAccessUnorderedAccess);
+		RenderGraphPass b = graph.AddPass("B");
+		graph.Write(b, t, ERenderGraphAccessUnorderedAccess);
+		RenderGraphPass c = graph.AddPass("C");
+		graph.Read(c, t, ERenderGraphAccessNonPixelShaderRead);
+		graph.Write(c, out, ERenderGraphAccessUnorderedAccess);
+		RenderGraphPass d = graph.AddPass("D");
+		graph.Read(d, t, ERenderGraphAccessPixelShaderRead);
+		graph.Write(d, out, ERenderGraphAccessUnorderedAccess);
+
+		bool ok = graph.Compile(compiled);
+		CHECK(ok, "Reads: compiles");
+		if (ok and compiled.Passes.size() == 4) {
+			CHECK(FindBarrier(compiled.Passes[1].BarriersBefore, t, ERenderGraphBarrierUAV) != nullptr, "Reads: UAV barrier between writes");
+			const RenderGraphBarrier* toRead = FindBarrier(compiled.Passes[2].BarriersBefore, t, ERenderGraphBarrierTransition);
+			CHECK(toRead and toRead->StateAfter == ERenderGraphAccessShaderRead, "Reads: one transition into both read states");
+			CHECK(FindBarrier(compiled.Passes[3].BarriersBefore, t, ERenderGraphBarrierTransition) == nullptr, "Reads: no transition between reads");
+			CHECK(FindBarrier(compiled.Passes[3].BarriersBefore, out, ERenderGraphBarrierUAV) != nullptr, "Reads: UAV barrier on imported resource");
+		}
+	}
+
+	// Two independent producer/consumer pairs, declared interleaved. Executing each consumer right after its producer lets the
+	// intermediates share memory.
+	{
+		graph.Reset();
+		RenderGraphResource t1 = graph.CreateTransient("T1", size, KB(64));
+		RenderGraphResource t2 = graph.CreateTransient("T2", size, KB(64));
+		RenderGraphResource out1 = graph.Import("Out1", ERenderGraphAccessNone, ERenderGraphAccessNone);
+		RenderGraphResource out2 = graph.Import("Out2", ERenderGraphAccessNone, ERenderGraphAccessNone);
+
+		RenderGraphPass a = graph.AddPass("A");
+		graph.Write(a, t1, ERenderGraphAccessRenderTarget);
+		RenderGraphPass b = graph.AddPass("B");
+		graph.Write(b, t2, ERenderGraphAccessRenderTarget);
+		RenderGraphPass c = graph.AddPass("C");
+		graph.Read(c, t1, ERenderGraphAccessPixelShaderRead);
+		graph.Write(c, out1, ERenderGraphAccessRenderTarget);
+		RenderGraphPass d = graph.AddPass("D");
+		graph.Read(d, t2, ERenderGraphAccessPixelShaderRead);
+		graph.Write(d, out2, ERenderGraphAccessRenderTarget);
+
+		bool ok = graph.Compile(compiled);
+		CHECK(ok, "Order: compiles");
+		if (ok and compiled.Passes.size() == 4) {
+			CHECK(compiled.Passes[0].Pass == a and compiled.Passes[1].Pass == c and compiled.Passes[2].Pass == b and compiled.Passes[3].Pass == d,
+				"Order: consumers move up to their producers");
+			CHECK(compiled.TransientBytesWithAliasing == size, "Order: intermediates share memory");
+		}
+	}
+
+	// Reading a transient resource before anything wrote it is an error.
+	{
+		graph.Reset();
+		RenderGraphResource t = graph.CreateTransient("T", size, KB(64));
+		RenderGraphPass a = graph.AddPass("A", ERenderGraphPassFlagsSideEffects);
+		graph.Read(a, t, ERenderGraphAccessPixelShaderRead);
+		CHECK(not graph.Compile(compiled), "Undefined: read before write is rejected");
+	}
+
+
+	// Random graphs. Every result is executed on a simulation of the resource states, which checks that every access finds its resource in
+	// the right state and that no resource is accessed while a split barrier is open. Resources which are alive at the same time must not
+	// overlap in memory.
+	Xorshift rng = { 0x9E3779B97F4A7C15ull };
+	for (uint32 g = 0; g < numRandomGraphs; ++g) {
+		graph.Reset();
+
+		uint32 numResources = 2 + rng.Next() % 12;
+		uint32 numPasses = 1 + rng.Next() % 16;
+
+		std::vector<bool> transient(numResources);
+		std::vector<uint64> sizes(numResources), alignments(numResources);
+		std::vector<uint32> heapGroups(numResources);
+		std::vector<uint32> finalStates(numResources);
+		std::vector<uint32> states(numResources, ERenderGraphAccessNone);
+		std::vector<bool> written(numResources, false);
+
+		for (uint32 r = 0; r < numResources; ++r) {
+			transient[r] = (rng.Next() % 4 != 0);
+			if (transient[r]) {
+				sizes[r] = KB(64) * (1 + rng.Next() % 64);
+				alignments[r] = KB(64) << (rng.Next() % 2);
+				heapGroups[r] = rng.Next() % 2;
+				graph.CreateTransient("Transient", sizes[r], alignments[r], heapGroups[r]);
+			}
+			else {
+				states[r] = (rng.Next() % 2) ? readAccesses[rng.Next() % 4] : writeAccesses[rng.Next() % 4];
+				finalStates[r] = (rng.Next() % 2) ? readAccesses[rng.Next() % 4] : writeAccesses[rng.Next() % 4];
+				graph.Import("Imported", states[r], finalStates[r]);
+				written[r] = true;
+			}
+		}
+
+		std::vector<TestAccess> accesses;
+		for (uint32 p = 0; p < numPasses; ++p) {
+			uint32 flags = ERenderGraphPassFlagsNone;
+			if (rng.Next() % 8 == 0) {
+				flags |= ERenderGraphPassFlagsSideEffects;
+			}
+			if (rng.Next() % 4 == 0) {
+				flags |= ERenderGraphPassFlagsMultipleCommandLists;
+			}
+			RenderGraphPass pass = graph.AddPass("Pass", flags);
+
+			std::vector<bool> used(numResources, false);
+			uint32 numAccesses = 1 + rng.Next() % 4;
+			for (uint32 i = 0; i < numAccesses; ++i) {
+				RenderGraphResource r = rng.Next() % numResources;
+				if (used[r]) {
+					continue;
+				}
+				used[r] = true;
+
+				if (written[r] and rng.Next() % 2) {
+					uint32 state = readAccesses[rng.Next() % 4];
+					graph.Read(pass, r, state);
+					accesses.push_back({ pass, r, state, false });
+				}
+				else {
+					uint32 state = writeAccesses[rng.Next() % 4];
+					graph.Write(pass, r, state);
+					accesses.push_back({ pass, r, state, true });
+					written[r] = true;
+				}
+			}
+		}
+
+		bool ok = graph.Compile(compiled);
+		CHECK(ok, "Random: compiles");
+		if (not ok) {
+			continue;
+		}
+
+		std::vector<uint32> position(numPasses, RENDER_GRAPH_INVALID);
+		for (uint32 i = 0; i < (uint32)compiled.Passes.size(); ++i) {
+			position[compiled.Passes[i].Pass] = i;
+		}
+
+		// Writes keep their order, and reads stay between the write they read and the next one.
+		bool orderKept = true;
+		for (RenderGraphResource r = 0; r < numResources; ++r) {
+			uint32 lastWrite = RENDER_GRAPH_INVALID;
+			std::vector<uint32> reads;
+			for (const TestAccess& access : accesses) {
+				uint32 p = position[access.Pass];
+				if (access.Resource != r or p == RENDER_GRAPH_INVALID) {
+					continue;
+				}
+				orderKept &= (lastWrite == RENDER_GRAPH_INVALID or lastWrite < p);
+				if (access.Write) {
+					for (uint32 read : reads) {
+						orderKept &= read < p;
+					}
+					lastWrite = p;
+					reads.clear();
+				}
+				else {
+					reads.push_back(p);
+				}
+			}
+		}
+		CHECK(orderKept, "Random: dependencies are respected");
+
+		// Transient resources are created in the state of their first access.
+		for (const TestAccess& access : accesses) {
+			if (transient[access.Resource] and position[access.Pass] == compiled.FirstUse[access.Resource]) {
+				states[access.Resource] = access.State;
+			}
+		}
+
+		const uint32 inTransition = UINT32_MAX;
+		bool statesValid = true;
+		auto apply = [&](const std::vector<RenderGraphBarrier>& barriers) {
+			for (const RenderGraphBarrier& barrier : barriers) {
+				if (barrier.Type != ERenderGraphBarrierTransition) {
+					continue;
+				}
+				uint32& state = states[barrier.Resource];
+				if (barrier.Split == ERenderGraphBarrierSplitEnd) {
+					statesValid &= (state == inTransition);
+					state = barrier.StateAfter;
+				}
+				else {
+					statesValid &= (state == barrier.StateBefore);
+					state = (barrier.Split == ERenderGraphBarrierSplitBegin) ? inTransition : barrier.StateAfter;
+				}
+			}
+		};
+
+		for (uint32 i = 0; i < (uint32)compiled.Passes.size(); ++i) {
+			apply(compiled.Passes[i].BarriersBefore);
+			for (const TestAccess& access : accesses) {
+				if (position[access.Pass] == i) {
+					uint32 state = states[access.Resource];
+					statesValid &= access.Write ? (state == access.State)
+						: ((state & access.State) == access.State and (state & ERenderGraphAccessWriteMask) == 0);
+				}
+			}
+			apply(compiled.Passes[i].BarriersAfter);
+		}
+		for (RenderGraphResource r = 0; r < numResources; ++r) {
+			if (not transient[r] and not compiled.Passes.empty()) {
+				statesValid &= (states[r] == finalStates[r]);
+			}
+		}
+		CHECK(statesValid, "Random: accesses find their resources in the right state");
+
+		bool memoryValid = true;
+		for (RenderGraphResource a = 0; a < numResources; ++a) {
+			if (not transient[a] or compiled.FirstUse[a] == RENDER_GRAPH_INVALID) {
+				continue;
+			}
+			uint64 aBegin = compiled.HeapOffsets[a];
+			uint64 aEnd = aBegin + sizes[a];
+			memoryValid &= (aBegin % alignments[a] == 0) and aEnd <= compiled.HeapSizes[heapGroups[a]];
+
+			for (RenderGraphResource b = a + 1; b < numResources; ++b) {
+				if (not transient[b] or compiled.FirstUse[b] == RENDER_GRAPH_INVALID or heapGroups[b] != heapGroups[a]) {
+					continue;
+				}
+				uint64 bBegin = compiled.HeapOffsets[b];
+				uint64 bEnd = bBegin + sizes[b];
+				bool aliveTogether = compiled.FirstUse[a] <= compiled.LastUse[b] and compiled.FirstUse[b] <= compiled.LastUse[a];
+				bool overlapping = aBegin < bEnd and bBegin < aEnd;
+				memoryValid &= not (aliveTogether and overlapping);
+			}
+		}
+		CHECK(memoryValid, "Random: resources alive at the same time don't overlap");
+	}
+}
@@ -0,0 +1,241 @@
+#include "testing.h"
+#include "../render/RenderPass.h"
+#include "../render/DrawInstancing.h"
+#include "../core/random.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace {
+	struct TestDraw {
+		const void* VertexBuffer;
+		const void* IndexBuffer;
+		SubmeshInfo Submesh;
+	};
+
+	struct TestMaterial : MaterialBase {
+		void PrepareForRendering(DxCommandList* commandList) override {}
+
+		static void SetupOpaquePipeline(DxCommandList* commandList, const CommonMaterialInfo& info) {}
+		static void SetupOpaqueInstancedPipeline(DxCommandList* commandList, const CommonMaterialInfo& info) {}
+	};
+
+	// Stands in for a GPU buffer. Only the address is used, for comparisons and sort keys, so nothing is ever created or dereferenced.
+	template <typename BufferT>
+	Ptr<BufferT> FakeBuffer(const void* address) {
+		return Ptr<BufferT>(Ptr<BufferT>(), (BufferT*)address);
+	}
+
+	// Every run must be non-empty, start where the previous one ended, satisfy the predicate for all its draws and stay within the
+	// instance limit. Together the runs must cover all draws.
+	template <typename DrawCallT, typename PredicateT>
+	bool RunsAreValid(const DrawCallT* drawCalls, uint32 numDrawCalls, const PredicateT& canInstance, const std::vector<InstanceRun>& runs) {
+		uint32 next = 0;
+		for (const InstanceRun& run : runs) {
+			if (run.First != next or run.Count == 0 or run.Count > MAX_NUM_INSTANCES_PER_DRAW) {
+				return false;
+			}
+			for (uint32 i = 1; i < run.Count; ++i) {
+				if (not canInstance(drawCalls[run.First], drawCalls[run.First + i])) {
+					return false;
+				}
+			}
+			next += run.Count;
+		}
+		return next == numDrawCalls;
+	}
+
+	// Number of times the vertex buffer, index buffer or submesh changes between consecutive draws.
+	template <typename DrawCallT>
+	uint32 CountGeometryChanges(const std::vector<DrawCallT>& drawCalls) {
+		uint32 result = 0;
+		for (uint32 i = 1; i < (uint32)drawCalls.size(); ++i) {
+			result += not SameGeometry{}(drawCalls[i - 1], drawCalls[i]);
+		}
+		return result;
+	}
+}
+
+// The passes' draw lists are private. Fills an opaque pass like the application does, sorts it like the renderer and splits the
+// sorted lists into instance runs with the renderer's merge criteria.
+struct RenderPassBenchmarks {
+	static void RunInstanceBatching(TestContext& test, uint32 numProps, uint32 numMeshes, uint32 numMaterials, uint32 numIterations);
+	static void RunGeometrySort(TestContext& test, uint32 numProps, uint32 numMeshes, uint32 numIterations);
+};
+
+void RenderPassBenchmarks::RunInstanceBatching(TestContext& test, uint32 numProps, uint32 numMeshes, uint32 numMaterials, uint32 numIterations) {
+	std::vector<uint64> bufferAddresses(2 * numMeshes);
+	std::vector<Ptr<TestMaterial>> materials(numMaterials);
+	for (Ptr<TestMaterial>& material : materials) {
+		material = MakePtr<TestMaterial>();
+	}
+
+	OpaqueRenderPass pass;
+	std::vector<InstanceRun> depthOnlyRuns;
+	std::vector<InstanceRun> opaqueRuns;
+	double sortMilliseconds = 0.0;
+	double findMilliseconds = 0.0;
+	bool valid = true;
+
+	for (uint32 iteration = 0; iteration < numIterations; ++iteration) {
+		pass.Reset();
+
+		// Some meshes are much more common than others, like foliage next to unique props. Every mesh always uses the same material.
+		RandomNumberGenerator rng = { 5193 + iteration };
+		for (uint32 i = 0; i < numProps; ++i) {
+			uint32 mesh = Min(rng.RandomUintBetween(0, numMeshes), rng.RandomUintBetween(0, numMeshes));
+			vec3 position(rng.RandomFloatBetween(-200.f, 200.f), rng.RandomFloatBetween(0.f, 20.f), rng.RandomFloatBetween(-200.f, 200.f));
+			SubmeshInfo submesh = { 100, 0, 0, 300 };
+
+			pass.RenderStaticObject(FakeBuffer<DxVertexBuffer>(&bufferAddresses[2 * mesh]), FakeBuffer<DxIndexBuffer>(&bufferAddresses[2 * mesh + 1]),
+				submesh, materials[mesh % numMaterials], CreateModelMatrix(position, quat::identity), (uint16)i);
+		}
+
+		auto start = std::chrono::high_resolution_clock::now();
+		pass.Sort(vec3(0.f, 10.f, 0.f), vec3(0.f, 0.f, -1.f));
+		auto sorted = std::chrono::high_resolution_clock::now();
+
+		FindInstanceRuns(pass._staticDepthOnlyDrawCalls.data(), (uint32)pass._staticDepthOnlyDrawCalls.size(), SameGeometry{}, depthOnlyRuns);
+		FindInstanceRuns(pass._drawCalls.data(), (uint32)pass._drawCalls.size(), SameMaterialAndGeometry{}, opaqueRuns);
+		auto end = std::chrono::high_resolution_clock::now();
+
+		sortMilliseconds += std::chrono::duration<double, std::milli>(sorted - start).count();
+		findMilliseconds += std::chrono::duration<double, std::milli>(end - sorted).count();
+
+		valid &= RunsAreValid(pass._staticDepthOnlyDrawCalls.data(), (uint32)pass._staticDepthOnlyDrawCalls.size(), SameGeometry{}, depthOnlyRuns);
+		valid &= RunsAreValid(pass._drawCalls.data(), (uint32)pass._drawCalls.size(), SameMaterialAndGeometry{}, opaqueRuns);
+	}
+
+	CHECK(valid, "Instance runs cover the sorted draws and only merge what the pass allows");
+	CHECK(depthOnlyRuns.size() <= numMeshes + numProps / MAX_NUM_INSTANCES_PER_DRAW, "Sorting puts all draws of a mesh into one run");
+	CHECK(opaqueRuns.size() <= numMeshes + numProps / MAX_NUM_INSTANCES_PER_DRAW, "Sorting puts all opaque draws of a mesh into one run");
+
+	printf("%u props of %u meshes: %u depth-only draws, %u opaque draws. Sort %.3f ms, finding runs %.3f ms.\n", numProps, numMeshes,
+		(uint32)depthOnlyRuns.size(), (uint32)opaqueRuns.size(), sortMilliseconds / numIterations, findMilliseconds / numIterations);
+}
+
+// Sorts a shadow cascade of randomly placed props by geometry, like every shadow pass does each frame.
+void RenderPassBenchmarks::RunGeometrySort(TestContext& test, uint32 numProps, uint32 numMeshes, uint32 numIterations) {
+	std::vector<uint64> bufferAddresses(2 * numMeshes);
+
+	SunShadowRenderPass pass;
+	const SortItem* sortItems = nullptr;
+	double sortMilliseconds = 0.0;
+	uint32 changesBefore = 0;
+	uint32 changesAfter = 0;
+	uint32 numUsedMeshes = 0;
+	bool reused = true;
+
+	for (uint32 iteration = 0; iteration < numIterations; ++iteration) {
+		pass.Reset();
+
+		std::vector<bool> used(numMeshes, false);
+		RandomNumberGenerator rng = { 7919 + iteration };
+		for (uint32 i = 0; i < numProps; ++i) {
+			uint32 mesh = Min(rng.RandomUintBetween(0, numMeshes), rng.RandomUintBetween(0, numMeshes));
+			vec3 position(rng.RandomFloatBetween(-200.f, 200.f), rng.RandomFloatBetween(0.f, 20.f), rng.RandomFloatBetween(-200.f, 200.f));
+			SubmeshInfo submesh = { 100, 0, 0, 300 };
+			used[mesh] = true;
+
+			pass.RenderObject(0, FakeBuffer<DxVertexBuffer>(&bufferAddresses[2 * mesh]), FakeBuffer<DxIndexBuffer>(&bufferAddresses[2 * mesh + 1]),
+				submesh, CreateModelMatrix(position, quat::identity));
+		}
+
+		changesBefore = CountGeometryChanges(pass._drawCalls[0]);
+
+		auto start = std::chrono::high_resolution_clock::now();
+		pass.Sort();
+		auto end = std::chrono::high_resolution_clock::now();
+		sortMilliseconds += std::chrono::duration<double, std::milli>(end - start).count();
+
+		changesAfter = CountGeometryChanges(pass._drawCalls[0]);
+		numUsedMeshes = (uint32)std::count(used.begin(), used.end(), true);
+
+		// The same number of props every frame must not grow the buffers again.
+		if (iteration > 0) {
+			reused &= (pass._sortBuffers.Items.data() == sortItems);
+		}
+		sortItems = pass._sortBuffers.Items.data();
+	}
+
+	CHECK(pass._drawCalls[0].size() == numProps, "Sorting keeps all draws");
+	CHECK(changesAfter == numUsedMeshes - 1, "Sorting puts all draws of a mesh next to each other");
+	CHECK(reused, "Sorting reuses the pass's buffers");
+
+	printf("%u props of %u meshes: sort %.3f ms, geometry changes %u -> %u (%u saved).\n", numProps, numMeshes, sortMilliseconds / numIterations,
+		changesBefore, changesAfter, changesBefore - changesAfter);
+}
+
+TEST(FindInstanceRuns) {
+	const char buffers[4] = {};
+	const SubmeshInfo submesh = { 12, 0, 0, 24 };
+	const SubmeshInfo otherSubmesh = { 12, 12, 0, 24 };
+	const TestDraw a = { &buffers[0], &buffers[1], submesh };
+	const TestDraw b = { &buffers[2], &buffers[3], submesh };
+	const TestDraw aOther = { &buffers[0], &buffers[1], otherSubmesh };
+
+	std::vector<InstanceRun> runs;
+
+	CHECK(FindInstanceRuns((const TestDraw*)nullptr, 0, SameGeometry{}, runs) == 0 and runs.empty(), "No runs without draws");
+
+	{
+		TestDraw draws[] = { a, a, b, b, b, a };
+		uint32 saved = FindInstanceRuns(draws, arraysize(draws), SameGeometry{}, runs);
+		CHECK(saved == 3 and runs.size() == 3, "Consecutive identical draws are merged");
+		CHECK(runs[0].First == 0 and runs[0].Count == 2 and runs[1].First == 2 and runs[1].Count == 3 and runs[2].First == 5 and runs[2].Count == 1,
+			"Runs start at the first draw of each group");
+	}
+
+	{
+		TestDraw draws[] = { a, aOther, a };
+		CHECK(FindInstanceRuns(draws, arraysize(draws), SameGeometry{}, runs) == 0 and runs.size() == 3, "Other submeshes of the same buffers are not merged");
+	}
+
+	{
+		TestDraw draws[] = { a, a, a };
+		CHECK(FindInstanceRuns(draws, arraysize(draws), [](const TestDraw&, const TestDraw&) { return false; }, runs) == 0 and runs.size() == 3,
+			"Draws the predicate rejects stay single");
+	}
+
+	{
+		const uint32 numDraws = 2 * MAX_NUM_INSTANCES_PER_DRAW + 100;
+		std::vector<TestDraw> draws(numDraws, a);
+		uint32 saved = FindInstanceRuns(draws.data(), numDraws, SameGeometry{}, runs);
+		CHECK(runs.size() == 3 and runs[0].Count == MAX_NUM_INSTANCES_PER_DRAW and runs[1].Count == MAX_NUM_INSTANCES_PER_DRAW and runs[2].Count == 100,
+			"Runs are capped at the instance limit");
+		CHECK(saved == numDraws - 3, "Every capped run saves all but one draw");
+	}
+
+	// The opaque criterion additionally needs the same material, and an instanced pipeline.
+	{
+		struct OpaqueDraw {
+			const void* VertexBuffer;
+			const void* IndexBuffer;
+			SubmeshInfo Submesh;
+			MaterialSetupFunction MaterialSetup;
+			MaterialSetupFunction InstancedMaterialSetup;
+			const void* Material;
+		};
+
+		const char materials[2] = {};
+		OpaqueDraw instanced = { &buffers[0], &buffers[1], submesh, TestMaterial::SetupOpaquePipeline, TestMaterial::SetupOpaqueInstancedPipeline, &materials[0] };
+		OpaqueDraw otherMaterial = instanced;
+		otherMaterial.Material = &materials[1];
+		OpaqueDraw notInstanced = instanced;
+		notInstanced.InstancedMaterialSetup = nullptr;
+
+		OpaqueDraw draws[] = { instanced, instanced, otherMaterial, notInstanced, notInstanced };
+		uint32 saved = FindInstanceRuns(draws, arraysize(draws), SameMaterialAndGeometry{}, runs);
+		CHECK(saved == 1 and runs.size() == 4 and runs[0].Count == 2, "Opaque draws merge only with the same material and an instanced pipeline");
+	}
+}
+
+// Draw count reduction on a scene of 10k props, which share 200 meshes, sorted and merged like in the renderer. Runs without a GPU.
+BENCHMARK(InstanceBatching) {
+	RenderPassBenchmarks::RunInstanceBatching(test, 10000, 200, 20, 20);
+}
+
+// Sort time and geometry changes saved by the shadow passes' sort on 10k props.
+BENCHMARK(GeometrySort) {
+	RenderPassBenchmarks::RunGeometrySort(test, 10000, 200, 20);
+}
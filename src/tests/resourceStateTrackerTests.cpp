@@ -0,0 +1,369 @@
+#include "testing.h"
+#include "../core/resourceStateTracker.h"
+
+namespace {
+	struct Xorshift {
+		uint64 State;
+
+		uint32 Next() {
+			State ^= State << 13;
+			State ^= State >> 7;
+			State ^= State << 17;
+			return (uint32)(State >> 16);
+		}
+	};
+
+	// The D3D12 values of the states the test uses.
+	const uint32 stateCommon = 0x0;
+	const uint32 stateRenderTarget = 0x4;
+	const uint32 stateUnorderedAccess = 0x8;
+	const uint32 stateDepthWrite = 0x10;
+	const uint32 stateNonPixelShader = 0x40;
+	const uint32 statePixelShader = 0x80;
+	const uint32 stateCopyDest = 0x400;
+	const uint32 stateCopySource = 0x800;
+
+	const uint32 testStates[] = {
+		stateCommon, stateRenderTarget, stateUnorderedAccess, stateDepthWrite, stateNonPixelShader, statePixelShader,
+		stateNonPixelShader | statePixelShader, stateCopyDest, stateCopySource,
+	};
+
+	ResourceStateBarrier MakeTransition(uint64 resource, uint32 numSubresources, uint32 subresource, uint32 before, uint32 after,
+		EResourceStateBarrierSplit split = EResourceStateBarrierSplitNone) {
+		return { resource, numSubresources, subresource, before, after, EResourceStateBarrierTransition, split };
+	}
+
+	// Read states combine, so a resource in several read states can be read in any subset of them without a barrier.
+	bool Covers(uint32 current, uint32 requested) {
+		bool readOnly = current != 0 and (current & RESOURCE_STATE_WRITE_MASK) == 0 and (requested & RESOURCE_STATE_WRITE_MASK) == 0;
+		return current == requested or (readOnly and requested != 0 and (current & requested) == requested);
+	}
+
+	struct TestBatch {
+		std::vector<ResourceStateBarrier> Requested;
+		std::vector<ResourceStateBarrier> Recorded;
+	};
+}
+
+// Checks redundant, wrong and chained transitions, subresources, split barriers and decay on hand-written lists, then replays random
+// lists with partly wrong 'before' states against a simulated GPU, which checks that every recorded barrier starts in the state the
+// resource is actually in.
+TEST(ResourceStateTracker) {
+	const uint32 numRandomLists = 2000;
+
+
+	LocalResourceStateTracker tracker;
+	std::vector<ResourceStateBarrier> out;
+	const uint64 t = 1;
+
+	auto filter = [&](std::initializer_list<ResourceStateBarrier> barriers) {
+		out.clear();
+		tracker.Filter(barriers.begin(), (uint32)barriers.size(), out);
+	};
+
+	// Redundant, wrong and read-subset transitions within one list.
+	{
+		tracker.Reset();
+
+		filter({ MakeTransition(t, 1, RESOURCE_STATE_ALL_SUBRESOURCES, stateCommon, stateRenderTarget) });
+		CHECK(out.size() == 1, "First use is recorded as requested");
+
+		filter({ MakeTransition(t, 1, RESOURCE_STATE_ALL_SUBRESOURCES, statePixelShader, stateRenderTarget) });
+		CHECK(out.empty() and tracker.Statistics().NumRedundant == 1, "Transition into the current state is dropped");
+
+		filter({ MakeTransition(t, 1, RESOURCE_STATE_ALL_SUBRESOURCES, statePixelShader, stateNonPixelShader | statePixelShader) });
+		CHECK(out.size() == 1 and out[0].Before == stateRenderTarget and tracker.Statistics().NumCorrected == 1, "Wrong 'before' state is corrected");
+
+		filter({ MakeTransition(t, 1, RESOURCE_STATE_ALL_SUBRESOURCES, stateNonPixelShader | statePixelShader, statePixelShader) });
+		CHECK(out.empty(), "Transition into a subset of the current read states is dropped");
+
+		filter({ MakeTransition(t, 1, RESOURCE_STATE_ALL_SUBRESOURCES, statePixelShader, stateCopyDest) });
+		CHECK(out.size() == 1 and out[0].Before == (stateNonPixelShader | statePixelShader), "Read state superset is kept");
+	}
+
+	// Chains within one batch.
+	{
+		tracker.Reset();
+		filter({
+			MakeTransition(t, 1, RESOURCE_STATE_ALL_SUBRESOURCES, stateRenderTarget, statePixelShader),
+			MakeTransition(t, 1, RESOURCE_STATE_ALL_SUBRESOURCES, statePixelShader, stateUnorderedAccess),
+		});
+		CHECK(out.size() == 1 and out[0].Before == stateRenderTarget and out[0].After == stateUnorderedAccess, "Chain is folded into one transition");
+
+		filter({
+			MakeTransition(t, 1, RESOURCE_STATE_ALL_SUBRESOURCES, stateUnorderedAccess, statePixelShader),
+			MakeTransition(t, 1, RESOURCE_STATE_ALL_SUBRESOURCES, statePixelShader, stateUnorderedAccess),
+		});
+		CHECK(out.empty(), "Transitions which cancel out are removed");
+
+		filter({
+			MakeTransition(t, 1, RESOURCE_STATE_ALL_SUBRESOURCES, stateUnorderedAccess, statePixelShader),
+			{ t, 1, RESOURCE_STATE_ALL_SUBRESOURCES, 0, 0, EResourceStateBarrierOther, EResourceStateBarrierSplitNone },
+			MakeTransition(t, 1, RESOURCE_STATE_ALL_SUBRESOURCES, statePixelShader, stateUnorderedAccess),
+		});
+		CHECK(out.size() == 3, "Transitions are not merged across other barriers on the resource");
+	}
+
+	// Fix-ups at submission.
+	{
+		ResourceStateTable table;
+		std::vector<ResourceStateBarrier> fixups;
+
+		tracker.Reset();
+		filter({ MakeTransition(t, 1, RESOURCE_STATE_ALL_SUBRESOURCES, stateCommon, stateRenderTarget) });
+		table.Submit(tracker, false, fixups);
+		CHECK(fixups.empty(), "Unknown resource is trusted");
+
+		tracker.Reset();
+		filter({ MakeTransition(t, 1, RESOURCE_STATE_ALL_SUBRESOURCES, statePixelShader, stateUnorderedAccess) });
+		table.Submit(tracker, false, fixups);
+		CHECK(fixups.size() == 1 and fixups[0].Before == stateRenderTarget and fixups[0].After == statePixelShader,
+			"Wrong first 'before' state is fixed up at submission");
+
+		fixups.clear();
+		tracker.Reset();
+		filter({ MakeTransition(t, 1, RESOURCE_STATE_ALL_SUBRESOURCES, stateUnorderedAccess, stateCopySource) });
+		table.Submit(tracker, false, fixups);
+		CHECK(fixups.empty(), "No fix-up if the list expects the right state");
+		CHECK(table.TakeStatistics().NumFixups == 1, "Fix-ups are counted");
+	}
+
+	// Decay to the common state when a list finishes.
+	{
+		ResourceStateTable table;
+		std::vector<ResourceStateBarrier> fixups;
+		const uint64 texture = 2;
+		const uint64 buffer = 3;
+
+		// Upload on the copy queue, then use on the direct queue.
+		tracker.Reset();
+		filter({ MakeTransition(texture, 3, RESOURCE_STATE_ALL_SUBRESOURCES, stateCommon, stateCopyDest) });
+		table.Submit(tracker, true, fixups);
+		tracker.Reset();
+		filter({ MakeTransition(texture, 3, RESOURCE_STATE_ALL_SUBRESOURCES, stateCommon, statePixelShader) });
+		table.Submit(tracker, false, fixups);
+		CHECK(fixups.empty(), "Copy queue list leaves its resources in the common state");
+
+		tracker.Reset();
+		filter({ MakeTransition(texture, 3, RESOURCE_STATE_ALL_SUBRESOURCES, statePixelShader, stateRenderTarget) });
+		table.Submit(tracker, false, fixups);
+		CHECK(fixups.empty(), "Direct queue list leaves textures in their last state");
+
+		ResourceStateBarrier toUnorderedAccess = MakeTransition(buffer, 1, RESOURCE_STATE_ALL_SUBRESOURCES, stateCommon, stateUnorderedAccess);
+		toUnorderedAccess.Decays = true;
+		tracker.Reset();
+		filter({ toUnorderedAccess });
+		table.Submit(tracker, false, fixups);
+
+		ResourceStateBarrier toShaderResource = MakeTransition(buffer, 1, RESOURCE_STATE_ALL_SUBRESOURCES, stateUnorderedAccess, stateNonPixelShader);
+		toShaderResource.Decays = true;
+		tracker.Reset();
+		filter({ toShaderResource });
+		table.Submit(tracker, false, fixups);
+		CHECK(fixups.size() == 1 and fixups[0].Before == stateCommon and fixups[0].After == stateUnorderedAccess,
+			"Buffer is in the common state after any list");
+	}
+
+	// Subresources.
+	{
+		tracker.Reset();
+		filter({
+			MakeTransition(t, 4, RESOURCE_STATE_ALL_SUBRESOURCES, stateRenderTarget, statePixelShader),
+		});
+		filter({
+			MakeTransition(t, 4, 1, statePixelShader, stateUnorderedAccess),
+		});
+		CHECK(out.size() == 1 and out[0].Subresource == 1, "Single subresource is transitioned");
+
+		filter({ MakeTransition(t, 4, RESOURCE_STATE_ALL_SUBRESOURCES, stateUnorderedAccess, statePixelShader) });
+		CHECK(out.size() == 1 and out[0].Subresource == 1 and out[0].Before == stateUnorderedAccess,
+			"Transition of all subresources only touches those in another state");
+
+		filter({ MakeTransition(t, 4, RESOURCE_STATE_ALL_SUBRESOURCES, statePixelShader, stateCopyDest) });
+		CHECK(out.size() == 1 and out[0].Subresource == RESOURCE_STATE_ALL_SUBRESOURCES, "Uniform subresources get one transition");
+	}
+
+	// Split barriers.
+	{
+		tracker.Reset();
+		filter({ MakeTransition(t, 1, RESOURCE_STATE_ALL_SUBRESOURCES, stateCommon, stateRenderTarget) });
+		filter({ MakeTransition(t, 1, RESOURCE_STATE_ALL_SUBRESOURCES, statePixelShader, stateCopySource, EResourceStateBarrierSplitBegin) });
+		CHECK(out.size() == 1 and out[0].Before == stateRenderTarget, "Begin of split barrier is corrected");
+		filter({ MakeTransition(t, 1, RESOURCE_STATE_ALL_SUBRESOURCES, statePixelShader, stateCopySource, EResourceStateBarrierSplitEnd) });
+		CHECK(out.size() == 1 and out[0].Before == stateRenderTarget, "End of split barrier is corrected the same way");
+
+		filter({ MakeTransition(t, 1, RESOURCE_STATE_ALL_SUBRESOURCES, stateRenderTarget, stateCopySource, EResourceStateBarrierSplitBegin) });
+		filter({ MakeTransition(t, 1, RESOURCE_STATE_ALL_SUBRESOURCES, stateRenderTarget, stateCopySource, EResourceStateBarrierSplitEnd) });
+		CHECK(out.empty(), "Redundant split barrier is dropped in full");
+	}
+
+	// Random lists against a simulated GPU. The "application" believes every transition it requested went through, and now and then it
+	// passes a wrong 'before' state.
+	const uint32 numResources = 8;
+	const uint32 numSubresources[numResources] = { 1, 1, 1, 1, 4, 6, 12, 3 };
+
+	std::vector<uint32> gpu[numResources];
+	std::vector<bool> gpuInTransition[numResources];
+	std::vector<uint32> belief[numResources];
+	for (uint32 r = 0; r < numResources; ++r) {
+		gpu[r].assign(numSubresources[r], stateCommon);
+		gpuInTransition[r].assign(numSubresources[r], false);
+		belief[r].assign(numSubresources[r], stateCommon);
+	}
+
+	auto subresourceRange = [&](uint32 r, uint32 subresource, uint32& first, uint32& end) {
+		first = (subresource == RESOURCE_STATE_ALL_SUBRESOURCES) ? 0 : subresource;
+		end = (subresource == RESOURCE_STATE_ALL_SUBRESOURCES) ? numSubresources[r] : subresource + 1;
+	};
+
+	bool barriersValid = true;
+	auto execute = [&](const ResourceStateBarrier& barrier) {
+		if (barrier.Type != EResourceStateBarrierTransition) {
+			return;
+		}
+		uint32 r = (uint32)barrier.Resource;
+		uint32 first, end;
+		subresourceRange(r, barrier.Subresource, first, end);
+		for (uint32 i = first; i < end; ++i) {
+			barriersValid &= (gpu[r][i] == barrier.Before);
+			barriersValid &= (gpuInTransition[r][i] == (barrier.Split == EResourceStateBarrierSplitEnd));
+			gpuInTransition[r][i] = (barrier.Split == EResourceStateBarrierSplitBegin);
+			if (barrier.Split != EResourceStateBarrierSplitBegin) {
+				gpu[r][i] = barrier.After;
+			}
+		}
+	};
+
+	ResourceStateTable table;
+	std::vector<ResourceStateBarrier> fixups;
+	std::vector<TestBatch> batches;
+	std::vector<ResourceStateBarrier> openSplits;
+	Xorshift rng = { 0x2545F4914F6CDD1Dull };
+	bool requestsSatisfied = true;
+
+	// Resources the table doesn't know are trusted to be in the expected state, which a wrong guess of the test would break. So the first
+	// list makes all of them known.
+	tracker.Reset();
+	out.clear();
+	for (uint32 r = 0; r < numResources; ++r) {
+		ResourceStateBarrier barrier = MakeTransition(r, numSubresources[r], RESOURCE_STATE_ALL_SUBRESOURCES, stateCommon, stateCopyDest);
+		tracker.Filter(&barrier, 1, out);
+		belief[r].assign(numSubresources[r], stateCopyDest);
+	}
+	table.Submit(tracker, false, fixups);
+	for (const ResourceStateBarrier& barrier : out) {
+		execute(barrier);
+	}
+
+	for (uint32 l = 0; l < numRandomLists; ++l) {
+		tracker.Reset();
+		batches.clear();
+
+		uint32 numBatches = 1 + rng.Next() % 8;
+		for (uint32 b = 0; b <= numBatches; ++b) {
+			TestBatch& batch = batches.emplace_back();
+
+			// Ends of split barriers go into a later batch than their beginnings. The last batch closes everything.
+			for (uint32 i = 0; i < (uint32)openSplits.size(); ) {
+				if (b == numBatches or rng.Next() % 2) {
+					batch.Requested.push_back(openSplits[i]);
+					batch.Requested.back().Split = EResourceStateBarrierSplitEnd;
+					openSplits.erase(openSplits.begin() + i);
+				}
+				else {
+					++i;
+				}
+			}
+
+			uint32 numBarriers = (b == numBatches) ? 0 : 1 + rng.Next() % 6;
+			for (uint32 i = 0; i < numBarriers; ++i) {
+				uint32 r = rng.Next() % numResources;
+				bool open = false;
+				for (const ResourceStateBarrier& split : openSplits) {
+					open |= (split.Resource == r);
+				}
+				for (const ResourceStateBarrier& requested : batch.Requested) {
+					open |= (requested.Resource == r and requested.Split == EResourceStateBarrierSplitEnd);
+				}
+				if (open) {
+					continue;
+				}
+
+				if (rng.Next() % 10 == 0) {
+					batch.Requested.push_back({ r, numSubresources[r], RESOURCE_STATE_ALL_SUBRESOURCES, 0, 0, EResourceStateBarrierOther, EResourceStateBarrierSplitNone });
+					continue;
+				}
+
+				uint32 subresource = (numSubresources[r] == 1 or rng.Next() % 2) ? RESOURCE_STATE_ALL_SUBRESOURCES : rng.Next() % numSubresources[r];
+				uint32 first, end;
+				subresourceRange(r, subresource, first, end);
+
+				uint32 before = (rng.Next() % 10 == 0) ? testStates[rng.Next() % arraysize(testStates)] : belief[r][first];
+				uint32 after = testStates[rng.Next() % arraysize(testStates)];
+				if (before == after) {
+					continue; // The batcher doesn't pass these on.
+				}
+
+				bool split = (rng.Next() % 6 == 0);
+				ResourceStateBarrier barrier = MakeTransition(r, numSubresources[r], subresource, before, after,
+					split ? EResourceStateBarrierSplitBegin : EResourceStateBarrierSplitNone);
+				batch.Requested.push_back(barrier);
+				if (split) {
+					openSplits.push_back(barrier);
+				}
+
+				for (uint32 s = first; s < end; ++s) {
+					belief[r][s] = after;
+				}
+			}
+
+			tracker.Filter(batch.Requested.data(), (uint32)batch.Requested.size(), batch.Recorded);
+		}
+
+		fixups.clear();
+		table.Submit(tracker, false, fixups);
+
+		for (const ResourceStateBarrier& fixup : fixups) {
+			execute(fixup);
+		}
+
+		for (const TestBatch& batch : batches) {
+			for (const ResourceStateBarrier& barrier : batch.Recorded) {
+				execute(barrier);
+			}
+
+			// After the batch, every resource must be usable in the state the last request on it asked for.
+			for (uint32 i = 0; i < (uint32)batch.Requested.size(); ++i) {
+				const ResourceStateBarrier& requested = batch.Requested[i];
+				if (requested.Type != EResourceStateBarrierTransition or requested.Split == EResourceStateBarrierSplitBegin) {
+					continue;
+				}
+
+				bool last = true;
+				for (uint32 j = i + 1; j < (uint32)batch.Requested.size(); ++j) {
+					last &= (batch.Requested[j].Resource != requested.Resource);
+				}
+				if (not last) {
+					continue;
+				}
+
+				uint32 r = (uint32)requested.Resource;
+				uint32 first, end;
+				subresourceRange(r, requested.Subresource, first, end);
+				for (uint32 s = first; s < end; ++s) {
+					requestsSatisfied &= not gpuInTransition[r][s] and Covers(gpu[r][s], requested.After);
+				}
+			}
+		}
+	}
+
+	CHECK(barriersValid, "Random: every recorded barrier starts in the actual state of the resource");
+	CHECK(requestsSatisfied, "Random: every resource ends up in the requested state");
+
+	ResourceStateStatistics statistics = table.TakeStatistics();
+	CHECK(statistics.NumRedundant > 0 and statistics.NumMerged > 0 and statistics.NumCorrected > 0 and statistics.NumFixups > 0,
+		"Random: lists exercise all cases");
+	printf("%llu transitions requested, %llu recorded (%llu redundant, %llu merged, %llu corrected, %llu fix-ups).\n",
+		(unsigned long long)statistics.NumRequested, (unsigned long long)statistics.NumRecorded, (unsigned long long)statistics.NumRedundant,
+		(unsigned long long)statistics.NumMerged, (unsigned long long)statistics.NumCorrected, (unsigned long long)statistics.NumFixups);
+}
@@ -0,0 +1,305 @@
+#include "testing.h"
+#include "../core/ringAllocator.h"
+
+#include <algorithm>
+#include <barrier>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <thread>
+
+namespace {
+	using Clock = std::chrono::high_resolution_clock;
+
+	struct Xorshift {
+		uint64 State;
+
+		uint32 Next() {
+			State ^= State << 13;
+			State ^= State >> 7;
+			State ^= State << 17;
+			return (uint32)(State >> 16);
+		}
+	};
+
+	// Stands in for an ID3D12Fence: the simulated GPU thread completes values in order, the CPU only reads them.
+	struct MockFence {
+		std::atomic<uint64> CompletedValue = 0;
+	};
+
+	struct StressAllocation {
+		uint64 Offset;
+		uint64 Size;
+		uint64 Tag;
+	};
+
+	struct StressFrame {
+		uint64 FenceValue;
+		std::vector<StressAllocation> Allocations;
+	};
+}
+
+// A writer which records across the end of a frame holds back its epoch and the later ones until it is submitted, and then until its
+// fence value has completed. Epochs keep being closed meanwhile, so everything behind it is reclaimed right after.
+TEST(RingAllocatorWriters) {
+	RingAllocator ring;
+	ring.Initialize(KB(64));
+
+	uint64 list = ring.BeginWriting();
+	ring.Allocate(KB(4), 256);
+	ring.Allocate(KB(4), 256); // Frame allocation without writer.
+	ring.EndEpoch(1);
+	ring.Reclaim(1);
+	CHECK(ring.NumBytesInFlight() == KB(8), "An epoch with a writer which hasn't been submitted is not reclaimed");
+
+	ring.Allocate(KB(4), 256); // The writer's, or the next frame's.
+	ring.EndEpoch(2);
+	ring.Reclaim(2);
+	CHECK(ring.NumBytesInFlight() == KB(12), "Later epochs wait for the writer");
+
+	ring.EndWriting(list, 3);
+	ring.Reclaim(2);
+	CHECK(ring.NumBytesInFlight() == KB(12), "Epochs of a submitted writer wait for its fence value");
+	ring.Reclaim(3);
+	CHECK(ring.NumBytesInFlight() == 0, "Epochs are reclaimed once the writer's fence value completed");
+
+	uint64 idle = ring.BeginWriting();
+	ring.EndEpoch(4);
+	ring.Allocate(KB(4), 256);
+	ring.EndEpoch(4);
+	ring.Reclaim(4);
+	CHECK(ring.NumBytesInFlight() == KB(4), "A writer stays with the open epoch while it is empty");
+	ring.EndWriting(idle, 5);
+	ring.Reclaim(5);
+	CHECK(ring.NumBytesInFlight() == 0, "An empty writer is released");
+}
+
+// Allocates from several threads for many frames against a mock fence, which a simulated GPU thread advances with some delay after checking
+// that everything allocated in the frame is still intact. At most 'maxFramesInFlight' frames are unfinished at a time. Every thread records
+// like a command list: it registers as writer, and now and then keeps recording into the next frame before it is submitted.
+TEST(RingAllocatorStress) {
+	const uint32 numThreads = 8;
+	const uint32 numFrames = 1000;
+	const uint32 maxFramesInFlight = 3;
+	const uint64 capacity = MB(4);
+
+	RingAllocator ring;
+	ring.Initialize(capacity);
+
+	// The "upload buffer". Every allocation gets a tag at its first and last 8 bytes, which the GPU thread checks before completing the
+	// frame. Memory which is handed out again too early has its tags overwritten.
+	std::vector<uint8> memory(capacity);
+
+	MockFence fence;
+	std::vector<std::vector<StressAllocation>> threadAllocations(numThreads);
+	std::atomic<uint64> numAllocations = 0;
+	std::atomic<uint64> numFallbacks = 0;
+	std::atomic<uint64> numCorruptions = 0;
+
+	std::deque<StressFrame> submittedFrames;
+	std::mutex submittedMutex;
+	std::condition_variable submittedCondition;
+	bool allSubmitted = false;
+
+	std::thread gpu([&] {
+		Xorshift rng = { 0x9E3779B97F4A7C15ull };
+		std::vector<StressAllocation> sorted;
+
+		while (true) {
+			StressFrame frame;
+			{
+				std::unique_lock lock(submittedMutex);
+				submittedCondition.wait(lock, [&] { return allSubmitted or not submittedFrames.empty(); });
+				if (submittedFrames.empty()) {
+					break;
+				}
+				frame = std::move(submittedFrames.front());
+				submittedFrames.pop_front();
+			}
+
+			// Take a while, so that the CPU runs into the in-flight limit and a full ring now and then.
+			uint32 numYields = rng.Next() % 64;
+			for (uint32 i = 0; i < numYields; ++i) {
+				std::this_thread::yield();
+			}
+
+			for (const StressAllocation& allocation : frame.Allocations) {
+				uint64 first, last;
+				memcpy(&first, memory.data() + allocation.Offset, sizeof(uint64));
+				memcpy(&last, memory.data() + allocation.Offset + allocation.Size - sizeof(uint64), sizeof(uint64));
+				if (first != allocation.Tag or last != allocation.Tag) {
+					numCorruptions.fetch_add(1, std::memory_order_relaxed);
+				}
+			}
+
+			sorted = frame.Allocations;
+			std::sort(sorted.begin(), sorted.end(), [](const StressAllocation& a, const StressAllocation& b) { return a.Offset < b.Offset; });
+			for (uint64 i = 1; i < sorted.size(); ++i) {
+				if (sorted[i - 1].Offset + sorted[i - 1].Size > sorted[i].Offset) {
+					numCorruptions.fetch_add(1, std::memory_order_relaxed);
+				}
+			}
+
+			fence.CompletedValue.store(frame.FenceValue, std::memory_order_release);
+		}
+	});
+
+	uint64 frameIndex = 1; // Doubles as the fence value which the frame signals.
+
+	// Runs on one thread while all others wait, like the end of a frame on the main thread.
+	auto endFrame = [&]() noexcept {
+		ring.EndEpoch(frameIndex);
+
+		StressFrame frame;
+		frame.FenceValue = frameIndex;
+		for (auto& allocations : threadAllocations) {
+			frame.Allocations.insert(frame.Allocations.end(), allocations.begin(), allocations.end());
+			allocations.clear();
+		}
+		{
+			std::lock_guard lock(submittedMutex);
+			submittedFrames.push_back(std::move(frame));
+		}
+		submittedCondition.notify_one();
+
+		++frameIndex;
+		while (frameIndex > maxFramesInFlight and fence.CompletedValue.load(std::memory_order_acquire) < frameIndex - maxFramesInFlight) {
+			std::this_thread::yield();
+		}
+		ring.Reclaim(fence.CompletedValue.load(std::memory_order_acquire));
+	};
+
+	std::barrier frameBarrier(numThreads, endFrame);
+
+	std::vector<std::thread> threads;
+	for (uint32 t = 0; t < numThreads; ++t) {
+		threads.emplace_back([&, t] {
+			Xorshift rng = { 0x2545F4914F6CDD1Dull * (t + 1) };
+			uint64 serial = 0;
+
+			std::vector<StressAllocation> recorded;
+			bool recording = false;
+			uint64 epoch = 0;
+
+			for (uint32 f = 0; f < numFrames; ++f) {
+				if (not recording) {
+					epoch = ring.BeginWriting();
+					recording = true;
+				}
+
+				uint32 numFrameAllocations = 4 + rng.Next() % 28;
+				for (uint32 i = 0; i < numFrameAllocations; ++i) {
+					uint32 r = rng.Next();
+					uint64 size = 16 + (uint64)(r % 1024) * 16 * ((r >> 28) == 0 ? 8 : 1);
+					uint64 alignment = ((r >> 24) & 15) == 0 ? 4096 : 256;
+
+					numAllocations.fetch_add(1, std::memory_order_relaxed);
+
+					uint64 offset = ring.Allocate(size, alignment);
+					if (offset == RING_ALLOCATOR_FAILED) {
+						numFallbacks.fetch_add(1, std::memory_order_relaxed);
+						continue;
+					}
+
+					if (offset % alignment != 0 or offset + size > capacity) {
+						numCorruptions.fetch_add(1, std::memory_order_relaxed);
+						continue;
+					}
+
+					uint64 tag = ((uint64)t << 48) | ++serial;
+					memcpy(memory.data() + offset, &tag, sizeof(uint64));
+					memcpy(memory.data() + offset + size - sizeof(uint64), &tag, sizeof(uint64));
+					recorded.push_back({ offset, size, tag });
+				}
+
+				// Submitted with this frame's fence value, so the GPU thread checks the allocations when it completes this frame.
+				if (rng.Next() % 4 != 0 or f == numFrames - 1) {
+					ring.EndWriting(epoch, frameIndex);
+					threadAllocations[t].insert(threadAllocations[t].end(), recorded.begin(), recorded.end());
+					recorded.clear();
+					recording = false;
+				}
+
+				frameBarrier.arrive_and_wait();
+			}
+		});
+	}
+
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+
+	{
+		std::lock_guard lock(submittedMutex);
+		allSubmitted = true;
+	}
+	submittedCondition.notify_one();
+	gpu.join();
+
+	// Fallbacks are allocations which didn't fit, and would have gone to a dedicated buffer.
+	CHECK(numCorruptions == 0, "Allocations are neither overwritten before their fence completed nor overlapping others");
+	CHECK(numFallbacks < numAllocations, "Most allocations fit into the ring");
+	printf("%llu allocations in %u frames, %llu fell back to dedicated buffers, %llu KB wasted.\n", (unsigned long long)numAllocations.load(), numFrames,
+		(unsigned long long)numFallbacks.load(), (unsigned long long)BYTE_TO_KB(ring.NumWastedBytes()));
+}
+
+// Every thread makes 'numAllocationsPerThread' small allocations at once, contending on the head. The ring claims them with an atomic add,
+// the baseline does the same bump allocation behind a mutex, like the page pools which the ring replaced.
+BENCHMARK(RingAllocator) {
+	const uint32 numAllocationsPerThread = 1000000;
+	constexpr uint64 allocationSize = 256;
+
+	for (uint32 numThreads = 1; numThreads <= 16; numThreads *= 2) {
+		uint64 totalSize = (uint64)numThreads * numAllocationsPerThread * allocationSize;
+
+		// Runs 'allocate' on all threads at once and returns the throughput.
+		auto measure = [&](auto allocate) {
+			std::atomic<uint32> numReady = 0;
+			std::atomic<bool> start = false;
+			std::atomic<uint64> sink = 0;
+
+			std::vector<std::thread> threads;
+			for (uint32 t = 0; t < numThreads; ++t) {
+				threads.emplace_back([&] {
+					numReady.fetch_add(1);
+					while (not start.load(std::memory_order_acquire)) {}
+
+					uint64 sum = 0;
+					for (uint32 i = 0; i < numAllocationsPerThread; ++i) {
+						sum += allocate();
+					}
+					sink.fetch_add(sum, std::memory_order_relaxed);
+				});
+			}
+
+			while (numReady.load() < numThreads) {
+				std::this_thread::yield();
+			}
+			auto startTime = Clock::now();
+			start.store(true, std::memory_order_release);
+			for (std::thread& thread : threads) {
+				thread.join();
+			}
+			double seconds = std::chrono::duration<double>(Clock::now() - startTime).count();
+
+			return (double)numThreads * numAllocationsPerThread / seconds * 1e-6;
+		};
+
+		// Large enough to never wrap, so that only the claim itself is measured.
+		RingAllocator ring;
+		ring.Initialize(totalSize);
+		double millionAllocationsPerSecondRing = measure([&] { return ring.Allocate(allocationSize, allocationSize); });
+
+		std::mutex mutex;
+		uint64 offset = 0;
+		double millionAllocationsPerSecondMutex = measure([&] {
+			std::lock_guard lock(mutex);
+			uint64 allocationOffset = offset;
+			offset += allocationSize;
+			return allocationOffset;
+		});
+
+		printf("%u threads: %.1f M/s ring, %.1f M/s mutex.\n", numThreads, millionAllocationsPerSecondRing, millionAllocationsPerSecondMutex);
+	}
+}
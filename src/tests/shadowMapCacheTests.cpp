@@ -0,0 +1,246 @@
+#include "testing.h"
+#include "../render/ShadowMapCache.h"
+#include "../directx/DxRenderer.h"
+#include "../core/random.h"
+
+#include <chrono>
+
+namespace {
+	// Stands in for the shadow passes' draw calls. The buffers are only hashed by address, so nothing is ever created or dereferenced.
+	struct TestCaster {
+		mat4 Transform;
+		Ptr<DxVertexBuffer> VertexBuffer;
+		Ptr<DxIndexBuffer> IndexBuffer;
+		SubmeshInfo Submesh;
+	};
+
+	template <typename BufferT>
+	Ptr<BufferT> FakeBuffer(const void* address) {
+		return Ptr<BufferT>(Ptr<BufferT>(), (BufferT*)address);
+	}
+
+	// Hashes a spot light or a sun cascade like the renderer does. Only hashed, so any matrix works as the view projection.
+	ShadowMapHashes HashShadowMap(const mat4& viewProj, vec4 viewport, const std::vector<TestCaster>& staticCasters, const std::vector<TestCaster>& dynamicCasters) {
+		ShadowMapHashes hashes;
+		hashes.Light = HashShadowMapValue(HashShadowMapValue(SHADOW_MAP_HASH_SEED, viewProj), viewport);
+		hashes.StaticCasters = HashShadowCasters(staticCasters);
+		hashes.DynamicCasters = HashShadowCasters(dynamicCasters);
+		hashes.NumDynamicCasters = (uint32)dynamicCasters.size();
+		return hashes;
+	}
+}
+
+// Skip and refresh decisions of the tracker for static casters, moved casters, animated casters, moved lights and sun cascades. Every
+// case starts from a shadow map which was just rendered and is valid.
+TEST(ShadowMapUpdateTracker) {
+	const char buffers[4] = {};
+	const SubmeshInfo submesh = { 12, 0, 0, 24 };
+
+	auto caster = [&](uint32 mesh, vec3 position) {
+		return TestCaster{ CreateModelMatrix(position, quat::identity), FakeBuffer<DxVertexBuffer>(&buffers[2 * mesh]), FakeBuffer<DxIndexBuffer>(&buffers[2 * mesh + 1]), submesh };
+	};
+
+	const mat4 light = CreateModelMatrix(vec3(0.f, 10.f, 0.f), quat::identity);
+	const vec4 viewport(0.f, 0.f, 512.f, 512.f);
+	const std::vector<TestCaster> staticCasters = { caster(0, vec3(1.f, 0.f, 0.f)), caster(1, vec3(-1.f, 0.f, 2.f)), caster(0, vec3(3.f, 0.f, -1.f)) };
+	const std::vector<TestCaster> noCasters;
+	const uint64 id = GetSpotShadowMapId(0);
+
+	ShadowMapUpdateTracker tracker;
+
+	// Renders the shadow map once with 'hashes', so that the next update starts from a valid map.
+	auto rendered = [&](const ShadowMapHashes& hashes) {
+		tracker.Clear();
+		tracker.Update(id, hashes, true);
+	};
+
+	ShadowMapHashes initial = HashShadowMap(light, viewport, staticCasters, noCasters);
+
+	// Static casters.
+	{
+		tracker.BeginFrame();
+		CHECK(tracker.Update(id, initial, true) == EShadowMapUpdateFull, "A new shadow map is rendered in full");
+		CHECK(tracker.Update(id, initial, true) == EShadowMapUpdateNone, "A shadow map of unchanged static casters is skipped");
+		CHECK(tracker.Update(id, HashShadowMap(light, viewport, staticCasters, noCasters), true) == EShadowMapUpdateNone,
+			"Hashes of the same casters are reproducible");
+		CHECK(tracker.Stats.NumFullUpdates == 1 and tracker.Stats.NumSkippedUpdates == 2 and tracker.Stats.NumDynamicUpdates == 0, "Updates are counted");
+
+		tracker.BeginFrame();
+		CHECK(tracker.Stats.NumFullUpdates == 0 and tracker.Stats.NumSkippedUpdates == 0, "BeginFrame resets the statistics");
+
+		CHECK(tracker.Update(id, initial, false) == EShadowMapUpdateFull, "A newly assigned tile is rendered in full, even if nothing changed");
+		CHECK(tracker.Update(id, initial, true) == EShadowMapUpdateNone, "The tile is skipped again once it holds the shadow map");
+	}
+
+	// Moved, added and removed static casters.
+	{
+		std::vector<TestCaster> moved = staticCasters;
+		moved[1].Transform = CreateModelMatrix(vec3(-1.f, 0.f, 2.5f), quat::identity);
+		rendered(initial);
+		CHECK(tracker.Update(id, HashShadowMap(light, viewport, moved, noCasters), true) == EShadowMapUpdateFull, "A moved static caster refreshes the cache");
+		CHECK(tracker.Update(id, HashShadowMap(light, viewport, moved, noCasters), true) == EShadowMapUpdateNone, "The moved caster is skipped once it stops");
+
+		std::vector<TestCaster> added = staticCasters;
+		added.push_back(caster(1, vec3(5.f, 0.f, 5.f)));
+		rendered(initial);
+		CHECK(tracker.Update(id, HashShadowMap(light, viewport, added, noCasters), true) == EShadowMapUpdateFull, "A static caster entering the range refreshes the cache");
+
+		std::vector<TestCaster> removed(staticCasters.begin(), staticCasters.end() - 1);
+		rendered(initial);
+		CHECK(tracker.Update(id, HashShadowMap(light, viewport, removed, noCasters), true) == EShadowMapUpdateFull, "A static caster leaving the range refreshes the cache");
+
+		std::vector<TestCaster> otherMesh = staticCasters;
+		otherMesh[0].VertexBuffer = FakeBuffer<DxVertexBuffer>(&buffers[2]);
+		rendered(initial);
+		CHECK(tracker.Update(id, HashShadowMap(light, viewport, otherMesh, noCasters), true) == EShadowMapUpdateFull, "A caster changing its mesh refreshes the cache");
+	}
+
+	// Dynamic casters.
+	{
+		std::vector<TestCaster> dynamicCasters = { caster(1, vec3(0.f, 1.f, 0.f)) };
+		ShadowMapHashes withDynamic = HashShadowMap(light, viewport, staticCasters, dynamicCasters);
+
+		rendered(initial);
+		CHECK(tracker.Update(id, withDynamic, true) == EShadowMapUpdateDynamic, "A dynamic caster entering the range keeps the static cache");
+		CHECK(tracker.Update(id, withDynamic, true) == EShadowMapUpdateDynamic, "Dynamic casters are re-rendered every frame, even if they don't move");
+		CHECK(tracker.Update(id, initial, true) == EShadowMapUpdateDynamic, "The last dynamic caster leaving the range removes its shadow");
+		CHECK(tracker.Update(id, initial, true) == EShadowMapUpdateNone, "Without dynamic casters, the map is skipped again");
+
+		std::vector<TestCaster> moved = staticCasters;
+		moved[0].Transform = CreateModelMatrix(vec3(1.f, 0.f, 1.f), quat::identity);
+		rendered(withDynamic);
+		CHECK(tracker.Update(id, HashShadowMap(light, viewport, moved, dynamicCasters), true) == EShadowMapUpdateFull,
+			"A moved static caster refreshes the cache, even with dynamic casters in range");
+	}
+
+	// Moved lights.
+	{
+		rendered(initial);
+		CHECK(tracker.Update(id, HashShadowMap(CreateModelMatrix(vec3(0.f, 10.f, 0.5f), quat::identity), viewport, staticCasters, noCasters), true) == EShadowMapUpdateFull,
+			"A moved light refreshes the cache");
+
+		rendered(initial);
+		CHECK(tracker.Update(id, HashShadowMap(light, vec4(512.f, 0.f, 512.f, 512.f), staticCasters, noCasters), true) == EShadowMapUpdateFull,
+			"A tile moved in the atlas refreshes the cache");
+
+		rendered(initial);
+		CHECK(tracker.Update(id, HashShadowMap(light, vec4(0.f, 0.f, 256.f, 256.f), staticCasters, noCasters), true) == EShadowMapUpdateFull,
+			"A resized tile refreshes the cache");
+
+		// Point lights hash their position and both hemispheres.
+		const uint64 pointId = GetPointShadowMapId(0, 0);
+		auto hashPointLight = [&](vec3 position) {
+			ShadowMapHashes hashes = HashShadowMap(mat4::identity, viewport, staticCasters, noCasters);
+			hashes.Light = HashShadowMapValue(HashShadowMapValue(SHADOW_MAP_HASH_SEED, position), viewport);
+			return hashes;
+		};
+		tracker.Clear();
+		tracker.Update(pointId, hashPointLight(vec3(0.f, 2.f, 0.f)), true);
+		CHECK(tracker.Update(pointId, hashPointLight(vec3(0.f, 2.f, 0.f)), true) == EShadowMapUpdateNone, "An unchanged point light is skipped");
+		CHECK(tracker.Update(pointId, hashPointLight(vec3(0.f, 2.1f, 0.f)), true) == EShadowMapUpdateFull, "A moved point light refreshes the cache");
+	}
+
+	// Sun cascades. Each cascade has its own id, so they are decided independently.
+	{
+		const uint32 numCascades = 4;
+		auto cascadeLight = [](uint32 cascade, float cameraZ) {
+			return CreateModelMatrix(vec3(0.f, 100.f, cameraZ + (float)cascade), quat::identity);
+		};
+
+		tracker.Clear();
+		for (uint32 i = 0; i < numCascades; ++i) {
+			tracker.Update(GetSunShadowMapId(i), HashShadowMap(cascadeLight(i, 0.f), viewport, staticCasters, noCasters), true);
+		}
+
+		tracker.BeginFrame();
+		for (uint32 i = 0; i < numCascades; ++i) {
+			// Only the last cascade follows the camera.
+			tracker.Update(GetSunShadowMapId(i), HashShadowMap(cascadeLight(i, (i == numCascades - 1) ? 1.f : 0.f), viewport, staticCasters, noCasters), true);
+		}
+		CHECK(tracker.Stats.NumFullUpdates == 1 and tracker.Stats.NumSkippedUpdates == numCascades - 1, "Only the cascade which moved is refreshed");
+
+		// Fewer cascades: the renderer frees the dropped ones. Bringing them back renders them again.
+		tracker.Free(GetSunShadowMapId(numCascades - 1));
+		CHECK(tracker.Update(GetSunShadowMapId(numCascades - 1), HashShadowMap(cascadeLight(numCascades - 1, 1.f), viewport, staticCasters, noCasters), true)
+			== EShadowMapUpdateFull, "A cascade which was dropped and added again is rendered in full");
+		CHECK(tracker.Update(GetSunShadowMapId(0), HashShadowMap(cascadeLight(0, 0.f), viewport, staticCasters, noCasters), true) == EShadowMapUpdateNone,
+			"Freeing one cascade keeps the others");
+
+		std::vector<TestCaster> moved = staticCasters;
+		moved[2].Transform = CreateModelMatrix(vec3(3.f, 0.f, -2.f), quat::identity);
+		tracker.BeginFrame();
+		for (uint32 i = 0; i < numCascades; ++i) {
+			tracker.Update(GetSunShadowMapId(i), HashShadowMap(cascadeLight(i, (i == numCascades - 1) ? 1.f : 0.f), viewport, (i < 2) ? moved : staticCasters, noCasters), true);
+		}
+		CHECK(tracker.Stats.NumFullUpdates == 2 and tracker.Stats.NumSkippedUpdates == numCascades - 2, "A moved caster refreshes only the cascades it is in");
+	}
+}
+
+// Random inserts and frees of random sizes, with the occupancy kept around 'targetOccupancy'. Runs without a GPU.
+BENCHMARK(ShadowMapAtlas) {
+	const uint32 width = SHADOW_MAP_WIDTH;
+	const uint32 height = SHADOW_MAP_HEIGHT;
+	const uint32 minimumSize = 128;
+	const uint32 maximumSize = 2048;
+	const uint32 numOperations = 1000000;
+	const float targetOccupancy = 0.8f;
+
+	struct Allocation {
+		uint32 X, Y, Size;
+	};
+
+	ShadowMapAtlas atlas;
+	atlas.Initialize(width, height, minimumSize, maximumSize);
+
+	RandomNumberGenerator rng = { 14878213 };
+	uint32 numSizes = IndexOfLeastSignificantSetBit(maximumSize) - IndexOfLeastSignificantSetBit(minimumSize) + 1;
+	uint64 totalTexels = (uint64)width * height;
+
+	std::vector<Allocation> allocations;
+	allocations.reserve(totalTexels / ((uint64)minimumSize * minimumSize));
+
+	uint32 numFailedInserts = 0;
+	double fragmentationSum = 0.0;
+	double occupancySum = 0.0;
+	double seconds = 0.0;
+
+	for (uint32 i = 0; i < numOperations; ++i) {
+		float occupancy = 1.f - (float)atlas.GetNumFreeTexels() / (float)totalTexels;
+
+		auto start = std::chrono::high_resolution_clock::now();
+		if (occupancy < targetOccupancy or allocations.empty()) {
+			// Small tiles are more common than large ones, like distant lights in a scene.
+			uint32 size = minimumSize << (Min(rng.RandomUintBetween(0, numSizes), rng.RandomUintBetween(0, numSizes)));
+
+			Allocation a = { 0, 0, size };
+			if (atlas.Insert(size, a.X, a.Y)) {
+				allocations.push_back(a);
+			}
+			else {
+				++numFailedInserts;
+			}
+		}
+		else {
+			uint32 index = rng.RandomUintBetween(0, (uint32)allocations.size());
+			Allocation a = allocations[index];
+			allocations[index] = allocations.back();
+			allocations.pop_back();
+
+			atlas.Free(a.X, a.Y, a.Size);
+		}
+		auto end = std::chrono::high_resolution_clock::now();
+		seconds += std::chrono::duration<double>(end - start).count();
+
+		fragmentationSum += atlas.GetFragmentation();
+		occupancySum += occupancy;
+	}
+
+	// Everything must merge back into the root nodes.
+	for (const Allocation& a : allocations) {
+		atlas.Free(a.X, a.Y, a.Size);
+	}
+	CHECK(atlas.GetNumFreeTexels() == totalTexels and atlas.GetFragmentation() == 0.f, "Everything merges back into the root nodes");
+
+	printf("%.3f us per operation, %u failed inserts, %.1f%% fragmentation at %.1f%% occupancy.\n", seconds * 1e6 / numOperations, numFailedInserts,
+		fragmentationSum / numOperations * 100.0, occupancySum / numOperations * 100.0);
+}
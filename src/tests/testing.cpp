@@ -0,0 +1,144 @@
+#include "testing.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#include "../core/assetCache.h"
+#include "../core/threading.h"
+#include "../directx/dx.h"
+#include "../directx/DxContext.h"
+#endif
+
+namespace {
+	struct RegisteredTest {
+		const char* Name;
+		ETestKind Kind;
+		uint32 Flags;
+		TestFunction Function;
+	};
+
+	// Function-local, because registrations run during static initialization of the other translation units.
+	std::vector<RegisteredTest>& Registry() {
+		static std::vector<RegisteredTest> registry;
+		return registry;
+	}
+
+	bool Selected(const RegisteredTest& registered, ETestKind kind, const std::vector<const char*>& filters) {
+		if (registered.Kind != kind) {
+			return false;
+		}
+		if (filters.empty()) {
+			return true;
+		}
+		for (const char* filter : filters) {
+			if (strstr(registered.Name, filter)) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+#ifdef _WIN32
+	bool InitializeDevice() {
+		if (FAILED(CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED | COINIT_DISABLE_OLE1DDE))) {
+			return false;
+		}
+		try {
+			if (not DxContext::Instance().Initialize()) {
+				return false;
+			}
+		}
+		catch (DxException& e) {
+			std::wcout << e.ToString() << L"\n";
+			return false;
+		}
+		AssetCache::Instance()->Initialize();
+		return true;
+	}
+#endif
+}
+
+void TestContext::Check(bool condition, const char* description, const char* file, uint32 line) {
+	++NumChecks;
+	if (not condition) {
+		++NumFailedChecks;
+		printf("%s(%u): check failed: %s\n", file, line, description);
+	}
+}
+
+TestRegistration::TestRegistration(const char* name, ETestKind kind, uint32 flags, TestFunction function) {
+	Registry().push_back({ name, kind, flags, function });
+}
+
+int main(int argc, char** argv) {
+	ETestKind kind = ETestKindTest;
+	std::vector<const char*> filters;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--benchmarks") == 0) {
+			kind = ETestKindBenchmark;
+		}
+		else {
+			filters.push_back(argv[i]);
+		}
+	}
+
+	std::vector<RegisteredTest> tests;
+	for (const RegisteredTest& registered : Registry()) {
+		if (Selected(registered, kind, filters)) {
+			tests.push_back(registered);
+		}
+	}
+	std::sort(tests.begin(), tests.end(), [](const RegisteredTest& a, const RegisteredTest& b) { return strcmp(a.Name, b.Name) < 0; });
+
+#ifdef _WIN32
+	JobFactory::Instance()->InitializeJobSystem();
+	bool deviceInitialized = false;
+#endif
+
+	uint32 numFailedTests = 0;
+	for (const RegisteredTest& registered : tests) {
+		if (registered.Flags & ETestFlagsNeedsDevice) {
+#ifdef _WIN32
+			if (not deviceInitialized) {
+				deviceInitialized = InitializeDevice();
+				if (not deviceInitialized) {
+					printf("%s: FAILED, no D3D12 device.\n", registered.Name);
+					++numFailedTests;
+					continue;
+				}
+			}
+#else
+			printf("%s: skipped, needs a D3D12 device.\n", registered.Name);
+			continue;
+#endif
+		}
+
+		printf("%s...\n", registered.Name);
+		fflush(stdout);
+
+		TestContext test;
+		auto start = std::chrono::steady_clock::now();
+		registered.Function(test);
+		double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		uint32 numChecks = test.NumChecks;
+		uint32 numFailedChecks = test.NumFailedChecks;
+		printf("%s: %s, %u checks, %u failed, %.1f ms.\n", registered.Name, numFailedChecks ? "FAILED" : "passed", numChecks, numFailedChecks, milliseconds);
+		fflush(stdout);
+		if (numFailedChecks) {
+			++numFailedTests;
+		}
+	}
+
+#ifdef _WIN32
+	if (deviceInitialized) {
+		DxContext::Instance().Quit();
+	}
+#endif
+
+	printf("%u of %u %s failed.\n", numFailedTests, (uint32)tests.size(), (kind == ETestKindTest) ? "tests" : "benchmarks");
+	return numFailedTests ? 1 : 0;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "../pch.h"
+
+#include <atomic>
+
+// Tests and benchmarks of the engine modules. Each one registers itself with TEST or BENCHMARK and reports failures through CHECK.
+// The tests executable runs all tests, or the benchmarks with --benchmarks. Names on the command line select a subset.
+
+struct TestContext {
+	// Safe to call from several threads.
+	void Check(bool condition, const char* description, const char* file, uint32 line);
+
+	std::atomic<uint32> NumChecks = 0;
+	std::atomic<uint32> NumFailedChecks = 0;
+};
+
+#define CHECK(condition, description) test.Check((condition), (description), __FILE__, __LINE__)
+
+enum ETestKind {
+	ETestKindTest,
+	ETestKindBenchmark,
+};
+
+enum ETestFlags {
+	ETestFlagsNone = 0,
+	ETestFlagsNeedsDevice = (1 << 0), // Runs after the D3D12 device, the job system and the asset cache are initialized.
+};
+
+typedef void (*TestFunction)(TestContext& test);
+
+struct TestRegistration {
+	TestRegistration(const char* name, ETestKind kind, uint32 flags, TestFunction function);
+};
+
+#define REGISTER_TEST(name, kind, flags) \
+	static void name(TestContext& test); \
+	static TestRegistration name##Registration(#name, kind, flags, name); \
+	static void name(TestContext& test)
+
+#define TEST(name) REGISTER_TEST(Test##name, ETestKindTest, ETestFlagsNone)
+#define DEVICE_TEST(name) REGISTER_TEST(Test##name, ETestKindTest, ETestFlagsNeedsDevice)
+#define BENCHMARK(name) REGISTER_TEST(Benchmark##name, ETestKindBenchmark, ETestFlagsNone)
+#define DEVICE_BENCHMARK(name) REGISTER_TEST(Benchmark##name, ETestKindBenchmark, ETestFlagsNeedsDevice)
@@ -0,0 +1,164 @@
+#include "testing.h"
+#include "../directx/DxTexture.h"
+#include "../directx/DxContext.h"
+#include "../core/ddsLayout.h"
+#include "../core/memory.h"
+#include "../core/memoryMappedFile.h"
+#include "DirectXTex.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+struct TextureFactoryBenchmarks {
+	static void RunLoad(TestContext& test, const char* directory, uint32 numTextures, uint32 numThreads, uint32 flags);
+	static void RunDdsUpload(TestContext& test, const char* ddsFile, uint32 numIterations, uint64 stagingBudget);
+};
+
+// Loads 'numTextures' image files found under 'directory' from 'numThreads' threads and prints the wall time. If there are fewer files,
+// they are loaded repeatedly. The texture cache is bypassed, so every run decodes all files again.
+// With ETextureLoadFlagsCacheToDds in 'flags', the first run writes the DDS cache and later runs read from it.
+void TextureFactoryBenchmarks::RunLoad(TestContext& test, const char* directory, uint32 numTextures, uint32 numThreads, uint32 flags) {
+	std::vector<std::string> files;
+	for (auto& p : fs::recursive_directory_iterator(directory)) {
+		if (not p.is_regular_file()) {
+			continue;
+		}
+
+		fs::path extension = p.path().extension();
+		if (extension == ".png" or extension == ".jpg" or extension == ".jpeg" or extension == ".tga" or extension == ".hdr" or extension == ".dds") {
+			// Skip the DDS cache files of other textures.
+			if (p.path().string().find(".cache.dds") == std::string::npos) {
+				files.push_back(p.path().string());
+			}
+		}
+	}
+	std::sort(files.begin(), files.end());
+
+	CHECK(not files.empty(), "Texture files found");
+	if (files.empty()) {
+		return;
+	}
+
+	numThreads = Max(numThreads, 1u);
+	TextureFactory* factory = TextureFactory::Instance();
+
+	std::atomic<uint32> nextTexture = 0;
+	std::atomic<uint32> numFailed = 0;
+
+	auto worker = [&]() {
+		uint32 i;
+		while ((i = nextTexture++) < numTextures) {
+			Ptr<DxTexture> texture;
+			try {
+				texture = factory->LoadTextureInternal(files[i % files.size()], flags);
+			}
+			catch (...) {
+			}
+
+			if (not texture) {
+				++numFailed;
+			}
+		}
+	};
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	std::vector<std::thread> threads;
+	for (uint32 t = 1; t < numThreads; ++t) {
+		threads.emplace_back(worker);
+	}
+	worker();
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+
+	// Include the uploads, which are still in flight on the copy queue.
+	DxContext::Instance().FlushApplication();
+
+	auto end = std::chrono::high_resolution_clock::now();
+
+	CHECK(numFailed == 0, "Every texture loads");
+	printf("%u textures on %u threads in %.1f ms (%u failed).\n", numTextures, numThreads, std::chrono::duration<double, std::milli>(end - start).count(),
+		numFailed.load());
+}
+
+// Uploads the 2D texture in 'ddsFile' 'numIterations' times through the memory-mapped path and through DirectXTex, and prints the
+// throughput of both including the GPU copies. A small 'stagingBudget' measures the streaming path.
+void TextureFactoryBenchmarks::RunDdsUpload(TestContext& test, const char* ddsFile, uint32 numIterations, uint64 stagingBudget) {
+	using clock = std::chrono::high_resolution_clock;
+
+	MemoryMappedFile file;
+	DdsTextureInfo info;
+	bool parsed = file.Open(ddsFile) and ParseDdsFile(file.Data(), file.Size(), info);
+	CHECK(parsed, "DDS file parses");
+	if (not parsed) {
+		return;
+	}
+	file.Close();
+
+	uint64 numBytesPerIteration = GetDdsTextureDataSize(info); // Without the DDS header.
+	TextureFactory* factory = TextureFactory::Instance();
+
+	DxContext& dxContext = DxContext::Instance();
+
+	// The files are read from the OS cache in both runs after this warm-up.
+	Ptr<DxTexture> warmUp = factory->LoadMappedDdsInternal(ddsFile, stagingBudget);
+	CHECK(warmUp, "Memory-mapped upload succeeds");
+	if (not warmUp) {
+		return;
+	}
+	warmUp.reset();
+	dxContext.FlushApplication();
+
+	auto mappedStart = clock::now();
+	for (uint32 i = 0; i < numIterations; ++i) {
+		Ptr<DxTexture> texture = factory->LoadMappedDdsInternal(ddsFile, stagingBudget);
+	}
+	dxContext.FlushApplication();
+	auto mappedEnd = clock::now();
+
+	auto scratchStart = clock::now();
+	for (uint32 i = 0; i < numIterations; ++i) {
+		DirectX::ScratchImage scratchImage;
+		DirectX::TexMetadata metadata;
+		fs::path filepath = ddsFile;
+		ThrowIfFailed(DirectX::LoadFromDDSFile(filepath.c_str(), DirectX::DDS_FLAGS_NONE, &metadata, scratchImage));
+
+		const DirectX::Image* images = scratchImage.GetImages();
+		auto numImages = (uint32)scratchImage.GetImageCount();
+
+		std::vector<D3D12_SUBRESOURCE_DATA> subresourceData(numImages);
+		for (uint32 j = 0; j < numImages; j++) {
+			subresourceData[j].RowPitch = images[j].rowPitch;
+			subresourceData[j].SlicePitch = images[j].slicePitch;
+			subresourceData[j].pData = images[j].pixels;
+		}
+
+		auto textureDesc = CD3DX12_RESOURCE_DESC::Tex2D(metadata.format, metadata.width, (uint32)metadata.height, (uint16)metadata.arraySize, (uint16)metadata.mipLevels);
+
+		std::lock_guard lock(dxContext.ResourceCreationMutex());
+		Ptr<DxTexture> texture = factory->CreateTexture(textureDesc, subresourceData.data(), numImages);
+	}
+	dxContext.FlushApplication();
+	auto scratchEnd = clock::now();
+
+	// The memory-mapped file is copied once into the staging buffers. DirectX::LoadFromDDSFile followed by UpdateSubresources copies twice.
+	double numBytes = (double)numBytesPerIteration * numIterations;
+	double gbPerSecondMapped = numBytes / std::chrono::duration<double>(mappedEnd - mappedStart).count() / 1e9;
+	double gbPerSecondScratchImage = numBytes / std::chrono::duration<double>(scratchEnd - scratchStart).count() / 1e9;
+	printf("%llu KB staging: %.2f GB/s mapped, %.2f GB/s through DirectXTex (%llu bytes, %u iterations).\n", BYTE_TO_KB(stagingBudget), gbPerSecondMapped,
+		gbPerSecondScratchImage, numBytesPerIteration, numIterations);
+}
+
+DEVICE_BENCHMARK(TextureLoad) {
+	for (uint32 numThreads = 1; numThreads <= 16; numThreads *= 2) {
+		TextureFactoryBenchmarks::RunLoad(test, "assets", 200, numThreads, ETextureLoadFlagsDefault);
+	}
+}
+
+DEVICE_BENCHMARK(DdsUpload) {
+	for (uint64 stagingBudget : { (uint64)TEXTURE_STAGING_BUDGET, (uint64)MB(1) }) {
+		TextureFactoryBenchmarks::RunDdsUpload(test, "assets/textures/benchmark.dds", 50, stagingBudget);
+	}
+}
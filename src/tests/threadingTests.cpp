@@ -0,0 +1,48 @@
+#include "testing.h"
+#include "../core/threading.h"
+
+#include <thread>
+
+TEST(ParallelFor) {
+	for (uint32 count : { 0u, 1u, 7u, 1000u }) {
+		std::vector<std::atomic<uint32>> numRuns(count);
+		ParallelFor(count, [&](uint32 i) { numRuns[i]++; });
+
+		bool allOnce = true;
+		for (const std::atomic<uint32>& n : numRuns) {
+			allOnce &= (n.load() == 1);
+		}
+		CHECK(allOnce, "Every item runs once");
+	}
+
+	// An unrelated job which is still queued must not end up on the calling thread, which may hold something that job waits for.
+	std::atomic<bool> release = false;
+	std::atomic<uint32> numBlocking = 0;
+	ThreadJobContext blockers;
+	uint32 numWorkers = JobFactory::Instance()->NumThreads();
+	for (uint32 i = 0; i < numWorkers; ++i) {
+		blockers.AddWork([&]() {
+			numBlocking++;
+			while (not release.load()) {
+				std::this_thread::yield();
+			}
+		});
+	}
+	while (numBlocking.load() < numWorkers) {
+		std::this_thread::yield();
+	}
+
+	std::thread::id caller = std::this_thread::get_id();
+	std::atomic<bool> unrelatedOnCaller = false;
+	ThreadJobContext unrelated;
+	unrelated.AddWork([&]() { unrelatedOnCaller = (std::this_thread::get_id() == caller); });
+
+	std::atomic<uint32> numItems = 0;
+	ParallelFor(64, [&](uint32) { numItems++; });
+	CHECK(numItems.load() == 64, "The calling thread finishes the loop while the workers are busy");
+	CHECK(not unrelatedOnCaller.load(), "The calling thread doesn't run unrelated jobs");
+
+	release = true;
+	blockers.WaitForWorkCompletion();
+	unrelated.WaitForWorkCompletion();
+}
@@ -0,0 +1,274 @@
+#include "testing.h"
+#include "../core/tlsfAllocator.h"
+#include "../core/indexAllocator.h"
+
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <map>
+
+namespace {
+	using Clock = std::chrono::high_resolution_clock;
+
+	struct Xorshift {
+		uint64 State;
+
+		uint32 Next() {
+			State ^= State << 13;
+			State ^= State >> 7;
+			State ^= State << 17;
+			return (uint32)(State >> 16);
+		}
+
+		float NextFloat() {
+			return (float)(Next() & 0xFFFFFF) / (float)0x1000000;
+		}
+	};
+
+	// Slot 'Slot' is allocated or freed. The workload is the same for both allocators, whether earlier allocations succeeded or not.
+	struct BenchmarkOperation {
+		uint32 Slot;
+		bool Allocate;
+		uint64 Size;
+		uint64 Alignment;
+	};
+
+	struct Workload {
+		std::vector<BenchmarkOperation> Operations;
+		std::vector<uint64> SlotAlignments;
+		uint32 NumSlots;
+		float AverageOccupancy; // Requested bytes over capacity, when an allocation was attempted.
+	};
+
+	// Sizes between 'minSize' and 'maxSize' (log-uniform, like the buffers and textures of a scene) with random alignments, keeping the range
+	// around 70% full.
+	Workload GenerateWorkload(uint32 numOperations, uint64 capacity, uint64 minSize, uint64 maxSize) {
+		const uint64 alignments[] = { 256, 256, KB(4), KB(64) };
+
+		Workload workload;
+		std::vector<BenchmarkOperation>& operations = workload.Operations;
+		operations.reserve(numOperations);
+		std::vector<uint32> liveSlots;
+		std::vector<uint64> slotSizes;
+		std::vector<uint64>& slotAlignments = workload.SlotAlignments;
+		uint64 liveBytes = 0;
+		double occupancySum = 0.0;
+		uint32 numAllocateOperations = 0;
+
+		Xorshift rng = { 0x9E3779B97F4A7C15ull };
+		float logMin = logf((float)minSize);
+		float logMax = logf((float)maxSize);
+
+		for (uint32 i = 0; i < numOperations; ++i) {
+			if (liveSlots.empty() or liveBytes < capacity * 7 / 10) {
+				uint64 size = Max<uint64>((uint64)expf(logMin + rng.NextFloat() * (logMax - logMin)), 1);
+				uint64 alignment = alignments[rng.Next() % arraysize(alignments)];
+				uint32 slot = (uint32)slotSizes.size();
+				slotSizes.push_back(size);
+				slotAlignments.push_back(alignment);
+				liveSlots.push_back(slot);
+				liveBytes += size;
+				occupancySum += (double)liveBytes / (double)capacity;
+				++numAllocateOperations;
+				operations.push_back({ slot, true, size, alignment });
+			}
+			else {
+				uint32 index = rng.Next() % (uint32)liveSlots.size();
+				uint32 slot = liveSlots[index];
+				liveSlots[index] = liveSlots.back();
+				liveSlots.pop_back();
+				liveBytes -= slotSizes[slot];
+				operations.push_back({ slot, false, 0, 0 });
+			}
+		}
+		workload.AverageOccupancy = (float)(occupancySum / Max(numAllocateOperations, 1u));
+		workload.NumSlots = (uint32)slotSizes.size();
+		return workload;
+	}
+
+	struct CheckedRunResult {
+		uint64 NumOverlaps;            // Allocations handed out twice, or outside the range.
+		uint64 NumFailedAllocations;
+		float AverageWaste;            // Bytes lost to rounding and alignment over requested bytes.
+		float FragmentationBeforeDefragmentation; // At the end of the run.
+		float FragmentationAfterDefragmentation;
+		uint64 NumBytesMoved;
+	};
+
+	// Checks every allocation against a shadow map of the range, which holds the live ranges by offset, so overlaps show up as neighbours.
+	// Then measures how much one PlanDefragmentation pass helps.
+	CheckedRunResult RunCheckedWorkload(const Workload& workload, uint64 capacity, uint64 granularity) {
+		CheckedRunResult result = {};
+		uint32 numSlots = workload.NumSlots;
+
+		TlsfAllocator allocator;
+		allocator.Initialize(capacity, granularity);
+		std::map<uint64, uint64> liveRanges; // Offset -> end.
+
+		auto insertRange = [&](uint64 offset, uint64 size) {
+			bool valid = offset + size <= allocator.Capacity();
+			auto next = liveRanges.lower_bound(offset);
+			if (next != liveRanges.end() and next->first < offset + size) {
+				valid = false;
+			}
+			if (next != liveRanges.begin() and std::prev(next)->second > offset) {
+				valid = false;
+			}
+			result.NumOverlaps += not valid;
+			liveRanges[offset] = offset + size;
+		};
+
+		uint64 requestedBytes = 0;
+		uint64 wastedBytes = 0;
+		std::vector<uint32> tlsfBlocks(numSlots, TLSF_ALLOCATOR_INVALID);
+		std::vector<uint64> tlsfOffsets(numSlots, 0);
+
+		for (const BenchmarkOperation& op : workload.Operations) {
+			if (op.Allocate) {
+				TlsfAllocation allocation = allocator.Allocate(op.Size, op.Alignment, op.Slot);
+				tlsfBlocks[op.Slot] = allocation.Block;
+				if (allocation.Valid()) {
+					result.NumOverlaps += (allocation.Offset % op.Alignment != 0) or (allocation.Size < op.Size);
+					insertRange(allocation.Offset, allocation.Size);
+					tlsfOffsets[op.Slot] = allocation.Offset;
+					requestedBytes += op.Size;
+					wastedBytes += allocation.Size - op.Size;
+				}
+				else {
+					++result.NumFailedAllocations;
+				}
+			}
+			else if (tlsfBlocks[op.Slot] != TLSF_ALLOCATOR_INVALID) {
+				liveRanges.erase(tlsfOffsets[op.Slot]);
+				allocator.Free(tlsfBlocks[op.Slot]);
+				tlsfBlocks[op.Slot] = TLSF_ALLOCATOR_INVALID;
+			}
+		}
+		result.AverageWaste = requestedBytes ? (float)wastedBytes / (float)requestedBytes : 0.f;
+
+		uint64 usedBytes = 0;
+		for (const auto& [offset, end] : liveRanges) {
+			usedBytes += end - offset;
+		}
+		result.NumOverlaps += (usedBytes != allocator.NumUsedBytes());
+
+		// One defragmentation pass over an eighth of the range. The destinations are reserved while the sources are still live, so they
+		// go into the shadow map before the sources leave it.
+		result.FragmentationBeforeDefragmentation = allocator.Fragmentation();
+		std::vector<TlsfMove> moves;
+		allocator.PlanDefragmentation(moves, capacity / 8);
+		for (const TlsfMove& move : moves) {
+			insertRange(move.Destination.Offset, move.Destination.Size);
+			result.NumOverlaps += (move.Destination.Offset % workload.SlotAlignments[move.UserData] != 0);
+		}
+		for (const TlsfMove& move : moves) {
+			liveRanges.erase(move.SourceOffset);
+			allocator.FinishMove(move);
+			uint32 slot = (uint32)move.UserData;
+			tlsfBlocks[slot] = move.Destination.Block;
+			result.NumBytesMoved += move.Size;
+		}
+		result.FragmentationAfterDefragmentation = allocator.Fragmentation();
+
+		for (uint32 slot = 0; slot < numSlots; ++slot) {
+			if (tlsfBlocks[slot] != TLSF_ALLOCATOR_INVALID) {
+				allocator.Free(tlsfBlocks[slot]);
+			}
+		}
+		result.NumOverlaps += not allocator.Empty() or allocator.NumFreeBytes() != allocator.Capacity() or allocator.LargestFreeBlock() != allocator.Capacity();
+
+		return result;
+	}
+}
+
+// A scene-like workload of 200,000 operations, checked allocation by allocation, then one defragmentation pass.
+TEST(TlsfAllocator) {
+	const uint64 capacity = MB(256);
+	const uint64 granularity = 256;
+
+	Workload workload = GenerateWorkload(200000, capacity, KB(1), MB(4));
+	CheckedRunResult result = RunCheckedWorkload(workload, capacity, granularity);
+	CHECK(result.NumOverlaps == 0, "Allocations neither overlap nor leave the range, and everything merges back at the end");
+	CHECK(result.FragmentationAfterDefragmentation <= result.FragmentationBeforeDefragmentation, "Defragmentation doesn't fragment");
+	CHECK(result.NumBytesMoved > 0, "Defragmentation finds something to move");
+}
+
+// Compares throughput and waste with a BuddyAllocator on the same workload, with sizes in units of the granularity.
+BENCHMARK(TlsfAllocator) {
+	const uint32 numOperations = 1000000;
+	const uint64 capacity = MB(256);
+	const uint64 granularity = 256;
+
+	Workload workload = GenerateWorkload(numOperations, capacity, KB(1), MB(4));
+	const std::vector<BenchmarkOperation>& operations = workload.Operations;
+	uint32 numSlots = workload.NumSlots;
+	std::vector<uint32> tlsfBlocks(numSlots, TLSF_ALLOCATOR_INVALID);
+
+	double millionOperationsPerSecond = 0.0;
+	double millionOperationsPerSecondBuddy = 0.0;
+	uint64 numFailedAllocationsBuddy = 0;
+	float averageWasteBuddy = 0.f;
+
+	// Timed runs. Both allocators are used behind a mutex, since BuddyAllocator has one built in and the TLSF pools of the renderer lock
+	// around theirs as well.
+	{
+		TlsfAllocator allocator;
+		allocator.Initialize(capacity, granularity);
+		std::mutex mutex;
+
+		auto startTime = Clock::now();
+		for (const BenchmarkOperation& op : operations) {
+			std::lock_guard lock(mutex);
+			if (op.Allocate) {
+				tlsfBlocks[op.Slot] = allocator.Allocate(op.Size, op.Alignment).Block;
+			}
+			else if (tlsfBlocks[op.Slot] != TLSF_ALLOCATOR_INVALID) {
+				allocator.Free(tlsfBlocks[op.Slot]);
+			}
+		}
+		double seconds = std::chrono::duration<double>(Clock::now() - startTime).count();
+		millionOperationsPerSecond = numOperations / seconds / 1e6;
+	}
+
+	{
+		BuddyAllocator allocator;
+		allocator.Initialize((uint32)(capacity / granularity));
+		std::vector<uint32> offsets(numSlots, INDEX_ALLOCATOR_INVALID);
+		std::vector<uint32> counts(numSlots, 0);
+
+		uint64 requestedBytes = 0;
+		uint64 wastedBytes = 0;
+
+		auto startTime = Clock::now();
+		for (const BenchmarkOperation& op : operations) {
+			if (op.Allocate) {
+				// Buddy blocks are aligned to their size, so larger alignments need larger blocks.
+				uint32 count = (uint32)Max((op.Size + granularity - 1) / granularity, op.Alignment / granularity);
+				counts[op.Slot] = count;
+				offsets[op.Slot] = allocator.Allocate(count);
+				if (offsets[op.Slot] != INDEX_ALLOCATOR_INVALID) {
+					requestedBytes += op.Size;
+					wastedBytes += std::bit_ceil(count) * granularity - op.Size;
+				}
+				else {
+					++numFailedAllocationsBuddy;
+				}
+			}
+			else if (offsets[op.Slot] != INDEX_ALLOCATOR_INVALID) {
+				allocator.Free(offsets[op.Slot], counts[op.Slot]);
+			}
+		}
+		double seconds = std::chrono::duration<double>(Clock::now() - startTime).count();
+		millionOperationsPerSecondBuddy = numOperations / seconds / 1e6;
+		averageWasteBuddy = requestedBytes ? (float)wastedBytes / (float)requestedBytes : 0.f;
+	}
+
+	CheckedRunResult result = RunCheckedWorkload(workload, capacity, granularity);
+	CHECK(result.NumOverlaps == 0, "Allocations neither overlap nor leave the range");
+
+	printf("%.1f M ops/s (buddy %.1f M ops/s), %llu failed allocations (buddy %llu), %.2f%% waste (buddy %.2f%%) at %.1f%% occupancy.\n",
+		millionOperationsPerSecond, millionOperationsPerSecondBuddy, (unsigned long long)result.NumFailedAllocations,
+		(unsigned long long)numFailedAllocationsBuddy, result.AverageWaste * 100.f, averageWasteBuddy * 100.f, workload.AverageOccupancy * 100.f);
+	printf("Defragmentation: fragmentation %.2f -> %.2f, %.1f MB moved.\n", result.FragmentationBeforeDefragmentation,
+		result.FragmentationAfterDefragmentation, result.NumBytesMoved / (1024.0 * 1024.0));
+}